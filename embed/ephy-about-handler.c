@@ -24,6 +24,7 @@
 #include "ephy-embed-shell.h"
 #include "ephy-file-helpers.h"
 #include "ephy-smaps.h"
+#include "ephy-trace.h"
 #include "ephy-web-app-utils.h"
 
 #include <gio/gio.h>
@@ -413,6 +414,24 @@ ephy_about_handler_handle_incognito (EphyAboutHandler *handler,
   return TRUE;
 }
 
+static gboolean
+ephy_about_handler_handle_trace (EphyAboutHandler *handler,
+                                 WebKitURISchemeRequest *request)
+{
+  GInputStream *stream;
+  char *data;
+  gsize data_length;
+
+  data = ephy_trace_to_json ();
+  data_length = strlen (data);
+
+  stream = g_memory_input_stream_new_from_data (data, data_length, g_free);
+  webkit_uri_scheme_request_finish (request, stream, data_length, "application/json");
+  g_object_unref (stream);
+
+  return TRUE;
+}
+
 static void
 ephy_about_handler_handle_blank (EphyAboutHandler *handler,
                                  WebKitURISchemeRequest *request)
@@ -445,6 +464,8 @@ ephy_about_handler_handle_request (EphyAboutHandler *handler,
     handled = ephy_about_handler_handle_applications (handler, request);
   else if (!g_strcmp0 (path, "incognito"))
     handled = ephy_about_handler_handle_incognito (handler, request);
+  else if (!g_strcmp0 (path, "trace"))
+    handled = ephy_about_handler_handle_trace (handler, request);
 
   if (!handled)
     ephy_about_handler_handle_blank (handler, request);
@@ -0,0 +1,666 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-download-manager.h"
+
+#include "ephy-debug.h"
+#include "ephy-embed-type-builtins.h"
+
+#include <string.h>
+
+/* Progress is shown at most once per frame, and for at most this many
+ * downloads in a frame; the others are shown in the next ones. So the
+ * cost of redrawing the download widgets stays the same however many
+ * downloads are running, and however often WebKit reports data. */
+#define FRAME_INTERVAL_MS 250
+#define MAX_UPDATES_PER_FRAME 8
+
+/* How much the newest sample weighs in the smoothed rate. */
+#define RATE_SMOOTHING 0.3
+
+#define SAVE_DELAY_SECONDS 2
+
+/* Records of downloads that are over are kept up to this number. */
+#define MAX_RECORDS 50
+
+#define EPHY_DOWNLOAD_MANAGER_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), EPHY_TYPE_DOWNLOAD_MANAGER, EphyDownloadManagerPrivate))
+
+typedef struct {
+  EphyDownloadManager *manager;
+  EphyDownload *download;
+  EphyDownloadRecord *record;
+
+  guint64 last_received;
+  gint64 last_sample_time;
+  gdouble rate;
+  gboolean queued;
+} TrackedDownload;
+
+struct _EphyDownloadManagerPrivate
+{
+  char *filename;
+
+  /* Newest first. */
+  GList *records;
+  guint next_id;
+
+  GList *tracked;
+  GQueue *pending;
+
+  guint frame_id;
+  guint save_id;
+};
+
+G_DEFINE_TYPE (EphyDownloadManager, ephy_download_manager, G_TYPE_OBJECT)
+
+static void
+ephy_download_record_free (EphyDownloadRecord *record)
+{
+  g_free (record->source);
+  g_free (record->destination);
+  g_slice_free (EphyDownloadRecord, record);
+}
+
+static EphyDownloadRecord *
+find_record (EphyDownloadManager *manager,
+             guint id)
+{
+  GList *l;
+
+  for (l = manager->priv->records; l != NULL; l = l->next) {
+    EphyDownloadRecord *record = (EphyDownloadRecord *)l->data;
+
+    if (record->id == id)
+      return record;
+  }
+
+  return NULL;
+}
+
+static const char *
+state_to_string (EphyDownloadState state)
+{
+  GEnumClass *enum_class;
+  GEnumValue *value;
+
+  enum_class = g_type_class_ref (EPHY_TYPE_DOWNLOAD_STATE);
+  value = g_enum_get_value (enum_class, state);
+  g_type_class_unref (enum_class);
+
+  return value ? value->value_nick : NULL;
+}
+
+static EphyDownloadState
+state_from_string (const char *string)
+{
+  GEnumClass *enum_class;
+  GEnumValue *value;
+  EphyDownloadState state;
+
+  enum_class = g_type_class_ref (EPHY_TYPE_DOWNLOAD_STATE);
+  value = string ? g_enum_get_value_by_nick (enum_class, string) : NULL;
+  state = value ? value->value : EPHY_DOWNLOAD_STATE_FAILED;
+  g_type_class_unref (enum_class);
+
+  return state;
+}
+
+static gint
+compare_records (EphyDownloadRecord *a,
+                 EphyDownloadRecord *b)
+{
+  return b->id - a->id;
+}
+
+static void
+ephy_download_manager_load (EphyDownloadManager *manager)
+{
+  EphyDownloadManagerPrivate *priv = manager->priv;
+  GKeyFile *key_file;
+  char **groups;
+  GError *error = NULL;
+  guint i;
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, priv->filename, G_KEY_FILE_NONE, &error)) {
+    if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_warning ("Could not load downloads from %s: %s", priv->filename, error->message);
+    g_error_free (error);
+    g_key_file_free (key_file);
+    return;
+  }
+
+  groups = g_key_file_get_groups (key_file, NULL);
+  for (i = 0; groups[i] != NULL; i++) {
+    EphyDownloadRecord *record;
+    char *state;
+
+    if (!g_str_has_prefix (groups[i], "download-"))
+      continue;
+
+    record = g_slice_new0 (EphyDownloadRecord);
+    record->id = g_ascii_strtoull (groups[i] + strlen ("download-"), NULL, 10);
+    record->source = g_key_file_get_string (key_file, groups[i], "source", NULL);
+    record->destination = g_key_file_get_string (key_file, groups[i], "destination", NULL);
+    record->received_bytes = g_key_file_get_uint64 (key_file, groups[i], "received", NULL);
+    record->total_bytes = g_key_file_get_uint64 (key_file, groups[i], "total", NULL);
+    record->start_time = g_key_file_get_int64 (key_file, groups[i], "start-time", NULL);
+    record->end_time = g_key_file_get_int64 (key_file, groups[i], "end-time", NULL);
+
+    state = g_key_file_get_string (key_file, groups[i], "state", NULL);
+    record->state = state_from_string (state);
+    g_free (state);
+
+    if (record->id == 0 || record->source == NULL) {
+      ephy_download_record_free (record);
+      continue;
+    }
+
+    /* Whatever was running when the last session ended did not finish. */
+    if (record->state == EPHY_DOWNLOAD_STATE_IN_PROGRESS)
+      record->state = EPHY_DOWNLOAD_STATE_INTERRUPTED;
+
+    priv->records = g_list_prepend (priv->records, record);
+    priv->next_id = MAX (priv->next_id, record->id + 1);
+  }
+
+  priv->records = g_list_sort (priv->records, (GCompareFunc)compare_records);
+
+  g_strfreev (groups);
+  g_key_file_free (key_file);
+}
+
+/**
+ * ephy_download_manager_save:
+ * @manager: an #EphyDownloadManager
+ *
+ * Writes the download records to disk now, instead of waiting for the
+ * changes to settle.
+ **/
+void
+ephy_download_manager_save (EphyDownloadManager *manager)
+{
+  EphyDownloadManagerPrivate *priv;
+  GKeyFile *key_file;
+  char *data;
+  gsize length;
+  GList *l;
+  GError *error = NULL;
+
+  g_return_if_fail (EPHY_IS_DOWNLOAD_MANAGER (manager));
+
+  priv = manager->priv;
+
+  if (priv->save_id) {
+    g_source_remove (priv->save_id);
+    priv->save_id = 0;
+  }
+
+  if (!priv->filename)
+    return;
+
+  key_file = g_key_file_new ();
+
+  for (l = priv->records; l != NULL; l = l->next) {
+    EphyDownloadRecord *record = (EphyDownloadRecord *)l->data;
+    char *group;
+
+    group = g_strdup_printf ("download-%u", record->id);
+    g_key_file_set_string (key_file, group, "source", record->source);
+    if (record->destination)
+      g_key_file_set_string (key_file, group, "destination", record->destination);
+    g_key_file_set_uint64 (key_file, group, "received", record->received_bytes);
+    g_key_file_set_uint64 (key_file, group, "total", record->total_bytes);
+    g_key_file_set_string (key_file, group, "state", state_to_string (record->state));
+    g_key_file_set_int64 (key_file, group, "start-time", record->start_time);
+    g_key_file_set_int64 (key_file, group, "end-time", record->end_time);
+    g_free (group);
+  }
+
+  data = g_key_file_to_data (key_file, &length, NULL);
+  if (!g_file_set_contents (priv->filename, data, length, &error)) {
+    g_warning ("Could not save downloads to %s: %s", priv->filename, error->message);
+    g_error_free (error);
+  }
+
+  g_free (data);
+  g_key_file_free (key_file);
+}
+
+static gboolean
+save_timeout_cb (EphyDownloadManager *manager)
+{
+  manager->priv->save_id = 0;
+  ephy_download_manager_save (manager);
+
+  return FALSE;
+}
+
+static void
+ephy_download_manager_schedule_save (EphyDownloadManager *manager)
+{
+  EphyDownloadManagerPrivate *priv = manager->priv;
+
+  if (priv->filename && !priv->save_id)
+    priv->save_id = g_timeout_add_seconds (SAVE_DELAY_SECONDS,
+                                           (GSourceFunc)save_timeout_cb,
+                                           manager);
+}
+
+static void
+trim_records (EphyDownloadManager *manager)
+{
+  EphyDownloadManagerPrivate *priv = manager->priv;
+  GList *l, *next;
+  guint n_kept = 0;
+
+  for (l = priv->records; l != NULL; l = next) {
+    EphyDownloadRecord *record = (EphyDownloadRecord *)l->data;
+
+    next = l->next;
+
+    if (record->state == EPHY_DOWNLOAD_STATE_IN_PROGRESS || ++n_kept <= MAX_RECORDS)
+      continue;
+
+    priv->records = g_list_delete_link (priv->records, l);
+    ephy_download_record_free (record);
+  }
+}
+
+static void
+update_progress (TrackedDownload *tracked)
+{
+  EphyDownloadRecord *record = tracked->record;
+  gint64 now;
+  gdouble elapsed, remaining_time = -1;
+
+  now = g_get_monotonic_time ();
+  elapsed = (gdouble)(now - tracked->last_sample_time) / G_USEC_PER_SEC;
+
+  if (elapsed > 0 && record->received_bytes >= tracked->last_received) {
+    gdouble sample = (record->received_bytes - tracked->last_received) / elapsed;
+
+    if (tracked->rate > 0)
+      tracked->rate = RATE_SMOOTHING * sample + (1 - RATE_SMOOTHING) * tracked->rate;
+    else
+      tracked->rate = sample;
+
+    tracked->last_received = record->received_bytes;
+    tracked->last_sample_time = now;
+  }
+
+  if (record->total_bytes > record->received_bytes && tracked->rate > 0)
+    remaining_time = (record->total_bytes - record->received_bytes) / tracked->rate;
+  else if (record->total_bytes > 0 && record->total_bytes == record->received_bytes)
+    remaining_time = 0;
+
+  _ephy_download_set_progress (tracked->download, tracked->rate, remaining_time);
+}
+
+static gboolean
+frame_cb (EphyDownloadManager *manager)
+{
+  EphyDownloadManagerPrivate *priv = manager->priv;
+  guint i;
+
+  for (i = 0; i < MAX_UPDATES_PER_FRAME && !g_queue_is_empty (priv->pending); i++) {
+    TrackedDownload *tracked = g_queue_pop_head (priv->pending);
+
+    tracked->queued = FALSE;
+    update_progress (tracked);
+  }
+
+  /* The sizes in the records are not saved from here: they are written
+   * with the next state or destination change, not on every frame. */
+
+  if (!g_queue_is_empty (priv->pending))
+    return TRUE;
+
+  priv->frame_id = 0;
+
+  return FALSE;
+}
+
+static void
+queue_progress (TrackedDownload *tracked)
+{
+  EphyDownloadManagerPrivate *priv = tracked->manager->priv;
+
+  if (!tracked->queued) {
+    g_queue_push_tail (priv->pending, tracked);
+    tracked->queued = TRUE;
+  }
+
+  if (!priv->frame_id)
+    priv->frame_id = g_timeout_add (FRAME_INTERVAL_MS, (GSourceFunc)frame_cb, tracked->manager);
+}
+
+static void
+update_record_sizes (TrackedDownload *tracked)
+{
+  WebKitDownload *download;
+  WebKitURIResponse *response;
+
+  download = ephy_download_get_webkit_download (tracked->download);
+  tracked->record->received_bytes = webkit_download_get_received_data_length (download);
+
+  response = webkit_download_get_response (download);
+  if (response)
+    tracked->record->total_bytes = webkit_uri_response_get_content_length (response);
+}
+
+static void
+download_received_data_cb (WebKitDownload *download,
+                           guint64 data_length,
+                           TrackedDownload *tracked)
+{
+  if (!tracked->record)
+    return;
+
+  update_record_sizes (tracked);
+  queue_progress (tracked);
+}
+
+static void
+download_destination_changed_cb (EphyDownload *download,
+                                 GParamSpec *pspec,
+                                 TrackedDownload *tracked)
+{
+  if (!tracked->record)
+    return;
+
+  g_free (tracked->record->destination);
+  tracked->record->destination = g_strdup (ephy_download_get_destination_uri (download));
+
+  ephy_download_manager_schedule_save (tracked->manager);
+}
+
+static void
+tracked_download_free (TrackedDownload *tracked)
+{
+  WebKitDownload *download;
+
+  download = ephy_download_get_webkit_download (tracked->download);
+  g_signal_handlers_disconnect_matched (download, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, tracked);
+  g_signal_handlers_disconnect_matched (tracked->download, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, tracked);
+
+  g_object_unref (tracked->download);
+  g_slice_free (TrackedDownload, tracked);
+}
+
+static void
+untrack_download (TrackedDownload *tracked)
+{
+  EphyDownloadManagerPrivate *priv = tracked->manager->priv;
+
+  priv->tracked = g_list_remove (priv->tracked, tracked);
+  if (tracked->queued)
+    g_queue_remove (priv->pending, tracked);
+
+  tracked_download_free (tracked);
+}
+
+static void
+download_failed_cb (WebKitDownload *download,
+                    GError *error,
+                    TrackedDownload *tracked)
+{
+  EphyDownloadManager *manager = tracked->manager;
+
+  /* Downloads the user cancelled are not worth remembering. */
+  if (g_error_matches (error, WEBKIT_DOWNLOAD_ERROR, WEBKIT_DOWNLOAD_ERROR_CANCELLED_BY_USER)) {
+    manager->priv->records = g_list_remove (manager->priv->records, tracked->record);
+    ephy_download_record_free (tracked->record);
+    tracked->record = NULL;
+  } else {
+    tracked->record->state = EPHY_DOWNLOAD_STATE_FAILED;
+    tracked->record->end_time = g_get_real_time () / G_USEC_PER_SEC;
+  }
+
+  /* ::finished follows. */
+}
+
+static void
+download_finished_cb (WebKitDownload *download,
+                      TrackedDownload *tracked)
+{
+  EphyDownloadManager *manager = tracked->manager;
+
+  if (tracked->record && tracked->record->state == EPHY_DOWNLOAD_STATE_IN_PROGRESS) {
+    update_record_sizes (tracked);
+    tracked->record->state = EPHY_DOWNLOAD_STATE_FINISHED;
+    tracked->record->end_time = g_get_real_time () / G_USEC_PER_SEC;
+
+    /* The last progress is shown right away. */
+    update_progress (tracked);
+  }
+
+  untrack_download (tracked);
+
+  trim_records (manager);
+  ephy_download_manager_schedule_save (manager);
+}
+
+/**
+ * ephy_download_manager_add_download:
+ * @manager: an #EphyDownloadManager
+ * @download: an #EphyDownload that just started
+ *
+ * Records @download, and reports its progress through its
+ * #EphyDownload::progress signal until it is over.
+ **/
+void
+ephy_download_manager_add_download (EphyDownloadManager *manager,
+                                    EphyDownload *download)
+{
+  EphyDownloadManagerPrivate *priv;
+  EphyDownloadRecord *record;
+  TrackedDownload *tracked;
+  WebKitDownload *wk_download;
+
+  g_return_if_fail (EPHY_IS_DOWNLOAD_MANAGER (manager));
+  g_return_if_fail (EPHY_IS_DOWNLOAD (download));
+
+  priv = manager->priv;
+
+  record = g_slice_new0 (EphyDownloadRecord);
+  record->id = priv->next_id++;
+  record->source = g_strdup (ephy_download_get_source_uri (download));
+  record->destination = g_strdup (ephy_download_get_destination_uri (download));
+  record->state = EPHY_DOWNLOAD_STATE_IN_PROGRESS;
+  record->start_time = g_get_real_time () / G_USEC_PER_SEC;
+  priv->records = g_list_prepend (priv->records, record);
+
+  tracked = g_slice_new0 (TrackedDownload);
+  tracked->manager = manager;
+  tracked->download = g_object_ref (download);
+  tracked->record = record;
+  tracked->last_sample_time = g_get_monotonic_time ();
+  priv->tracked = g_list_prepend (priv->tracked, tracked);
+
+  wk_download = ephy_download_get_webkit_download (download);
+  g_signal_connect (wk_download, "received-data",
+                    G_CALLBACK (download_received_data_cb), tracked);
+  g_signal_connect (wk_download, "failed",
+                    G_CALLBACK (download_failed_cb), tracked);
+  g_signal_connect (wk_download, "finished",
+                    G_CALLBACK (download_finished_cb), tracked);
+  g_signal_connect (download, "notify::destination",
+                    G_CALLBACK (download_destination_changed_cb), tracked);
+
+  trim_records (manager);
+  ephy_download_manager_schedule_save (manager);
+}
+
+/**
+ * ephy_download_manager_get_records:
+ * @manager: an #EphyDownloadManager
+ *
+ * Gets the records of the downloads that are running, and of those
+ * that ran recently, in this session or in previous ones.
+ *
+ * Returns: (transfer none) (element-type EphyDownloadRecord): the
+ * records, newest first
+ **/
+GList *
+ephy_download_manager_get_records (EphyDownloadManager *manager)
+{
+  g_return_val_if_fail (EPHY_IS_DOWNLOAD_MANAGER (manager), NULL);
+
+  return manager->priv->records;
+}
+
+/**
+ * ephy_download_manager_resume:
+ * @manager: an #EphyDownloadManager
+ * @id: the id of an interrupted or failed download record
+ * @parent: the #GtkWindow parent of the download, or %NULL
+ *
+ * Downloads again what the record @id describes, to the same
+ * destination. The record is replaced by the one of the new download.
+ *
+ * Returns: (transfer full): the new #EphyDownload, or %NULL
+ **/
+EphyDownload *
+ephy_download_manager_resume (EphyDownloadManager *manager,
+                              guint id,
+                              GtkWindow *parent)
+{
+  EphyDownloadRecord *record;
+  EphyDownload *download;
+
+  g_return_val_if_fail (EPHY_IS_DOWNLOAD_MANAGER (manager), NULL);
+
+  record = find_record (manager, id);
+  g_return_val_if_fail (record != NULL, NULL);
+  g_return_val_if_fail (record->state != EPHY_DOWNLOAD_STATE_IN_PROGRESS, NULL);
+
+  download = ephy_download_new_for_uri (record->source, parent);
+  if (record->destination)
+    ephy_download_set_destination_uri (download, record->destination);
+
+  ephy_download_manager_remove_record (manager, id);
+
+  return download;
+}
+
+/**
+ * ephy_download_manager_remove_record:
+ * @manager: an #EphyDownloadManager
+ * @id: the id of a download record
+ *
+ * Forgets about a download that is not running anymore.
+ **/
+void
+ephy_download_manager_remove_record (EphyDownloadManager *manager,
+                                     guint id)
+{
+  EphyDownloadRecord *record;
+
+  g_return_if_fail (EPHY_IS_DOWNLOAD_MANAGER (manager));
+
+  record = find_record (manager, id);
+  if (!record)
+    return;
+
+  g_return_if_fail (record->state != EPHY_DOWNLOAD_STATE_IN_PROGRESS);
+
+  manager->priv->records = g_list_remove (manager->priv->records, record);
+  ephy_download_record_free (record);
+
+  ephy_download_manager_schedule_save (manager);
+}
+
+static void
+ephy_download_manager_dispose (GObject *object)
+{
+  EphyDownloadManagerPrivate *priv = EPHY_DOWNLOAD_MANAGER (object)->priv;
+
+  if (priv->frame_id) {
+    g_source_remove (priv->frame_id);
+    priv->frame_id = 0;
+  }
+
+  /* Running downloads are saved as such, and are found interrupted
+   * next time. */
+  if (priv->save_id || priv->tracked)
+    ephy_download_manager_save (EPHY_DOWNLOAD_MANAGER (object));
+
+  g_queue_clear (priv->pending);
+  g_list_free_full (priv->tracked, (GDestroyNotify)tracked_download_free);
+  priv->tracked = NULL;
+
+  G_OBJECT_CLASS (ephy_download_manager_parent_class)->dispose (object);
+}
+
+static void
+ephy_download_manager_finalize (GObject *object)
+{
+  EphyDownloadManagerPrivate *priv = EPHY_DOWNLOAD_MANAGER (object)->priv;
+
+  g_list_free_full (priv->records, (GDestroyNotify)ephy_download_record_free);
+  g_queue_free (priv->pending);
+  g_free (priv->filename);
+
+  G_OBJECT_CLASS (ephy_download_manager_parent_class)->finalize (object);
+}
+
+static void
+ephy_download_manager_class_init (EphyDownloadManagerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = ephy_download_manager_dispose;
+  object_class->finalize = ephy_download_manager_finalize;
+
+  g_type_class_add_private (object_class, sizeof (EphyDownloadManagerPrivate));
+}
+
+static void
+ephy_download_manager_init (EphyDownloadManager *manager)
+{
+  manager->priv = EPHY_DOWNLOAD_MANAGER_GET_PRIVATE (manager);
+  manager->priv->pending = g_queue_new ();
+  manager->priv->next_id = 1;
+}
+
+/**
+ * ephy_download_manager_new:
+ * @filename: (allow-none): the file the records are kept in, or %NULL
+ *
+ * Creates an #EphyDownloadManager, with the records that were saved in
+ * @filename. Without a file, nothing is remembered across sessions.
+ *
+ * Returns: a new #EphyDownloadManager
+ **/
+EphyDownloadManager *
+ephy_download_manager_new (const char *filename)
+{
+  EphyDownloadManager *manager;
+
+  manager = g_object_new (EPHY_TYPE_DOWNLOAD_MANAGER, NULL);
+  manager->priv->filename = g_strdup (filename);
+
+  if (filename)
+    ephy_download_manager_load (manager);
+
+  return manager;
+}
@@ -0,0 +1,99 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#if !defined (__EPHY_EPIPHANY_H_INSIDE__) && !defined (EPIPHANY_COMPILATION)
+#error "Only <epiphany/epiphany.h> can be included directly."
+#endif
+
+#ifndef EPHY_DOWNLOAD_MANAGER_H
+#define EPHY_DOWNLOAD_MANAGER_H
+
+#include <glib-object.h>
+#include <gtk/gtk.h>
+
+#include "ephy-download.h"
+
+G_BEGIN_DECLS
+
+#define EPHY_TYPE_DOWNLOAD_MANAGER            (ephy_download_manager_get_type())
+#define EPHY_DOWNLOAD_MANAGER(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), EPHY_TYPE_DOWNLOAD_MANAGER, EphyDownloadManager))
+#define EPHY_DOWNLOAD_MANAGER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), EPHY_TYPE_DOWNLOAD_MANAGER, EphyDownloadManagerClass))
+#define EPHY_IS_DOWNLOAD_MANAGER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EPHY_TYPE_DOWNLOAD_MANAGER))
+#define EPHY_IS_DOWNLOAD_MANAGER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EPHY_TYPE_DOWNLOAD_MANAGER))
+#define EPHY_DOWNLOAD_MANAGER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), EPHY_TYPE_DOWNLOAD_MANAGER, EphyDownloadManagerClass))
+
+typedef struct _EphyDownloadManager        EphyDownloadManager;
+typedef struct _EphyDownloadManagerClass   EphyDownloadManagerClass;
+typedef struct _EphyDownloadManagerPrivate EphyDownloadManagerPrivate;
+
+struct _EphyDownloadManager
+{
+  GObject parent;
+
+  /*< private >*/
+  EphyDownloadManagerPrivate *priv;
+};
+
+struct _EphyDownloadManagerClass
+{
+  GObjectClass parent_class;
+};
+
+typedef enum
+{
+  EPHY_DOWNLOAD_STATE_IN_PROGRESS,
+  EPHY_DOWNLOAD_STATE_FINISHED,
+  EPHY_DOWNLOAD_STATE_FAILED,
+  EPHY_DOWNLOAD_STATE_INTERRUPTED
+} EphyDownloadState;
+
+typedef struct
+{
+  guint id;
+  char *source;
+  char *destination;
+  guint64 received_bytes;
+  guint64 total_bytes;
+  EphyDownloadState state;
+  gint64 start_time;
+  gint64 end_time;
+} EphyDownloadRecord;
+
+GType                ephy_download_manager_get_type       (void) G_GNUC_CONST;
+
+EphyDownloadManager *ephy_download_manager_new            (const char *filename);
+
+void                 ephy_download_manager_add_download   (EphyDownloadManager *manager,
+                                                           EphyDownload *download);
+
+GList               *ephy_download_manager_get_records    (EphyDownloadManager *manager);
+
+EphyDownload        *ephy_download_manager_resume         (EphyDownloadManager *manager,
+                                                           guint id,
+                                                           GtkWindow *parent);
+
+void                 ephy_download_manager_remove_record  (EphyDownloadManager *manager,
+                                                           guint id);
+
+void                 ephy_download_manager_save           (EphyDownloadManager *manager);
+
+G_END_DECLS
+
+#endif /* EPHY_DOWNLOAD_MANAGER_H */
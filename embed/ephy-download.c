@@ -34,14 +34,19 @@
 #include "ephy-settings.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <string.h>
+#include <unistd.h>
 
 G_DEFINE_TYPE (EphyDownload, ephy_download, G_TYPE_OBJECT)
 
 #define EPHY_DOWNLOAD_GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), EPHY_TYPE_DOWNLOAD, EphyDownloadPrivate))
 
+typedef struct _DestinationListing DestinationListing;
+
 struct _EphyDownloadPrivate
 {
   WebKitDownload *download;
@@ -51,6 +56,17 @@ struct _EphyDownloadPrivate
 
   EphyDownloadActionType action;
   guint32 start_time;
+  gboolean finished;
+
+  gdouble rate;
+  gdouble remaining_time;
+
+  char *content_type;
+  DestinationListing *destination_listing;
+  /* The empty file created to reserve the destination's name, until the
+   * download has finished. */
+  char *reserved_destination;
+  GCancellable *cancellable;
 
   GtkWindow *window;
   GtkWidget *widget;
@@ -139,13 +155,34 @@ ephy_download_set_property (GObject      *object,
   }
 }
 
+/* The MIME type sent by the server, unless it says nothing more than
+ * "some bytes", in which case the file has to be sniffed. */
+static char *
+get_response_content_type (EphyDownload *download)
+{
+  WebKitURIResponse *response;
+  const char *mime_type;
+
+  response = webkit_download_get_response (download->priv->download);
+  if (!response)
+    return NULL;
+
+  mime_type = webkit_uri_response_get_mime_type (response);
+  if (!mime_type || g_content_type_is_unknown (mime_type))
+    return NULL;
+
+  return g_strdup (mime_type);
+}
+
 /**
  * ephy_download_get_content_type:
  * @download: an #EphyDownload
  *
- * Gets content-type information for @download. If the file is already
- * present on the filesystem and readable, uses GIO to get the
- * content-type. Otherwise it uses WebKit and Soup.
+ * Gets content-type information for @download. The MIME type of the
+ * response is used when the server sent a meaningful one, otherwise the
+ * file is sniffed with GIO if it is already present on the filesystem.
+ * This blocks on the file system; prefer
+ * ephy_download_get_content_type_async() in the UI.
  *
  * Returns: content-type for @download, must be freed with g_free()
  **/
@@ -153,9 +190,18 @@ char *
 ephy_download_get_content_type (EphyDownload *download)
 {
   WebKitURIResponse *response;
-  char *content_type = NULL;
+  char *content_type;
   GError *error = NULL;
 
+  content_type = get_response_content_type (download);
+  if (content_type) {
+    LOG ("ephy_download_get_content_type: Soup: %s", content_type);
+    return content_type;
+  }
+
+  if (download->priv->content_type)
+    return g_strdup (download->priv->content_type);
+
   if (download->priv->destination) {
     GFile *destination;
     GFileInfo *info;
@@ -179,46 +225,161 @@ ephy_download_get_content_type (EphyDownload *download)
   if (content_type)
     return content_type;
 
-  /* Fallback to Soup */
+  /* Fallback to whatever the server said */
   response = webkit_download_get_response (download->priv->download);
   if (response)
     content_type = g_strdup (webkit_uri_response_get_mime_type (response));
 
-  LOG ("ephy_download_get_content_type: Soup: %s", content_type);
-
   LOG ("ephy_download_get_content_type: %s", content_type);
 
   return content_type;
 }
 
+static void
+content_type_query_info_cb (GFile *file,
+                            GAsyncResult *result,
+                            GTask *task)
+{
+  EphyDownload *download = g_task_get_source_object (task);
+  WebKitURIResponse *response;
+  GFileInfo *info;
+  GError *error = NULL;
 
-/* Helper function to decide what EphyDownloadActionType should be the
- * default for the download. This implies that you want something to
- * happen, this function will never return EPHY_DOWNLOAD_ACTION_NONE.
- */
-static EphyDownloadActionType
-decide_action_from_mime (EphyDownload *ephy_download)
+  info = g_file_query_info_finish (file, result, &error);
+  if (info) {
+    /* The file is complete, so what it sniffs as will not change. */
+    g_free (download->priv->content_type);
+    download->priv->content_type = g_strdup (g_file_info_get_content_type (info));
+    LOG ("ephy_download_get_content_type_async: GIO: %s", download->priv->content_type);
+    g_object_unref (info);
+
+    g_task_return_pointer (task, g_strdup (download->priv->content_type), g_free);
+  } else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_task_return_error (task, error);
+    error = NULL;
+  } else {
+    response = webkit_download_get_response (download->priv->download);
+    g_task_return_pointer (task,
+                           response ? g_strdup (webkit_uri_response_get_mime_type (response)) : NULL,
+                           g_free);
+  }
+
+  if (error)
+    g_error_free (error);
+  g_object_unref (task);
+}
+
+/**
+ * ephy_download_get_content_type_async:
+ * @download: an #EphyDownload
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the content-type is known
+ * @user_data: data for @callback
+ *
+ * Asynchronously gets content-type information for @download. The MIME
+ * type of the response is preferred; the file is only sniffed, in a
+ * GIO worker thread, when the server sent a generic type and the
+ * download has finished.
+ **/
+void
+ephy_download_get_content_type_async (EphyDownload *download,
+                                      GCancellable *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data)
 {
+  EphyDownloadPrivate *priv;
+  WebKitURIResponse *response;
+  GTask *task;
   char *content_type;
-  GAppInfo *helper_app = NULL;
-  EphyDownloadActionType action;
+  GFile *destination;
 
-  content_type = ephy_download_get_content_type (ephy_download);
+  g_return_if_fail (EPHY_IS_DOWNLOAD (download));
+
+  priv = download->priv;
+  task = g_task_new (download, cancellable, callback, user_data);
+
+  content_type = get_response_content_type (download);
   if (content_type) {
-    helper_app = g_app_info_get_default_for_type (content_type, FALSE);
-    if (helper_app)
-      action = EPHY_DOWNLOAD_ACTION_OPEN;
+    g_task_return_pointer (task, content_type, g_free);
+    g_object_unref (task);
+    return;
+  }
 
-    g_free (content_type);
+  if (priv->content_type) {
+    g_task_return_pointer (task, g_strdup (priv->content_type), g_free);
+    g_object_unref (task);
+    return;
   }
 
+  /* Sniffing a file that is still being written says little. */
+  if (!priv->finished || !priv->destination) {
+    response = webkit_download_get_response (priv->download);
+    g_task_return_pointer (task,
+                           response ? g_strdup (webkit_uri_response_get_mime_type (response)) : NULL,
+                           g_free);
+    g_object_unref (task);
+    return;
+  }
+
+  destination = g_file_new_for_uri (priv->destination);
+  g_file_query_info_async (destination, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+                           G_FILE_QUERY_INFO_NONE, G_PRIORITY_DEFAULT, cancellable,
+                           (GAsyncReadyCallback)content_type_query_info_cb, task);
+  g_object_unref (destination);
+}
+
+/**
+ * ephy_download_get_content_type_finish:
+ * @download: an #EphyDownload
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with ephy_download_get_content_type_async().
+ *
+ * Returns: content-type for @download, or %NULL, must be freed with g_free()
+ **/
+char *
+ephy_download_get_content_type_finish (EphyDownload *download,
+                                       GAsyncResult *result,
+                                       GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, download), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static EphyDownloadActionType
+decide_action_from_content_type (const char *content_type)
+{
+  GAppInfo *helper_app = NULL;
+
+  if (content_type)
+    helper_app = g_app_info_get_default_for_type (content_type, FALSE);
+
   /* Downloads that have no content_type, or no helper_app, are
    * considered unsafe/unable to open. Default them to BROWSE_TO.
    */
   if (helper_app == NULL)
-    action = EPHY_DOWNLOAD_ACTION_BROWSE_TO;
-  else
-    g_object_unref (helper_app);
+    return EPHY_DOWNLOAD_ACTION_BROWSE_TO;
+
+  g_object_unref (helper_app);
+
+  return EPHY_DOWNLOAD_ACTION_OPEN;
+}
+
+/* Helper function to decide what EphyDownloadActionType should be the
+ * default for the download. This implies that you want something to
+ * happen, this function will never return EPHY_DOWNLOAD_ACTION_NONE.
+ */
+static EphyDownloadActionType
+decide_action_from_mime (EphyDownload *ephy_download)
+{
+  char *content_type;
+  EphyDownloadActionType action;
+
+  content_type = ephy_download_get_content_type (ephy_download);
+  action = decide_action_from_content_type (content_type);
+  g_free (content_type);
 
   return action;
 }
@@ -273,65 +434,350 @@ parse_extension (const char *filename)
   return strrchr ((last_separator) ? last_separator : filename, '.');
 }
 
+/* What is known about the names in a downloads directory, from listing
+ * it once: the names taken, and for each name the highest "(n)" suffix
+ * it was given, so the next free one is found without probing. */
+struct _DestinationDirectory
+{
+  char *path;
+  GHashTable *names;
+  GHashTable *serials;
+};
+
+static void
+destination_directory_free (DestinationDirectory *directory)
+{
+  g_free (directory->path);
+  g_hash_table_destroy (directory->names);
+  g_hash_table_destroy (directory->serials);
+  g_slice_free (DestinationDirectory, directory);
+}
+
+/* Splits "name(n).ext" into "name.ext" and n. */
 static char *
-define_destination_uri (EphyDownload *download, const char *suggested_filename)
+split_serial (const char *filename,
+              guint *serial)
 {
-  char *dest_dir;
-  char *dest_name;
-  char *destination_filename;
-  char *destination_uri;
+  const char *dot_pos, *open, *p;
+  gsize position;
+  guint64 value;
 
-  dest_dir = ephy_file_get_downloads_dir ();
+  dot_pos = parse_extension (filename);
+  position = dot_pos ? dot_pos - filename : strlen (filename);
 
-  /* Make sure the download directory exists */
-  if (g_mkdir_with_parents (dest_dir, 0700) == -1) {
-    g_critical ("Could not create downloads directory \"%s\": %s",
-                dest_dir, strerror (errno));
-    g_free (dest_dir);
+  if (position < 3 || filename[position - 1] != ')')
     return NULL;
-  }
 
-  if (suggested_filename != NULL) {
-    dest_name = ephy_sanitize_filename (g_strdup (suggested_filename));
-  } else {
-    dest_name = ephy_file_tmp_filename ("ephy-download-XXXXXX", NULL);
+  for (p = filename + position - 2; p > filename && g_ascii_isdigit (*p); p--);
+
+  open = p;
+  if (*open != '(' || open == filename + position - 2)
+    return NULL;
+
+  value = g_ascii_strtoull (open + 1, NULL, 10);
+  if (value == 0 || value > G_MAXUINT)
+    return NULL;
+
+  *serial = value;
+
+  return g_strdup_printf ("%.*s%s", (int)(open - filename), filename, filename + position);
+}
+
+static void
+destination_directory_add_name (DestinationDirectory *directory,
+                                const char *name)
+{
+  char *key;
+  guint serial;
+
+  g_hash_table_add (directory->names, g_strdup (name));
+
+  key = split_serial (name, &serial);
+  if (!key)
+    return;
+
+  if (serial > GPOINTER_TO_UINT (g_hash_table_lookup (directory->serials, key)))
+    g_hash_table_insert (directory->serials, key, GUINT_TO_POINTER (serial));
+  else
+    g_free (key);
+}
+
+/* Lists @path once. Safe to call from any thread. */
+static DestinationDirectory *
+destination_directory_new (const char *path,
+                           GError **error)
+{
+  DestinationDirectory *directory;
+  const char *name;
+  GDir *dir;
+
+  if (g_mkdir_with_parents (path, 0700) == -1) {
+    int errsv = errno;
+
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 _("Could not create downloads directory “%s”: %s"),
+                 path, g_strerror (errsv));
+    return NULL;
   }
 
-  destination_filename = g_build_filename (dest_dir, dest_name, NULL);
-  g_free (dest_dir);
-  g_free (dest_name);
+  dir = g_dir_open (path, 0, error);
+  if (!dir)
+    return NULL;
+
+  directory = g_slice_new (DestinationDirectory);
+  directory->path = g_strdup (path);
+  directory->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  directory->serials = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    destination_directory_add_name (directory, name);
+
+  g_dir_close (dir);
+
+  return directory;
+}
+
+/* Picks the first name after the ones known to be taken and creates it
+ * with O_EXCL, so that two downloads, or another program, racing for
+ * the same name cannot both get it. Returns the new file's path. */
+static char *
+destination_directory_allocate (DestinationDirectory *directory,
+                                const char *filename,
+                                GError **error)
+{
+  const char *dot_pos;
+  gsize position;
+  guint serial;
+  char *name;
+
+  dot_pos = parse_extension (filename);
+  position = dot_pos ? dot_pos - filename : strlen (filename);
+
+  if (g_hash_table_contains (directory->names, filename))
+    serial = GPOINTER_TO_UINT (g_hash_table_lookup (directory->serials, filename)) + 1;
+  else
+    serial = 0;
+
+  while (TRUE) {
+    char *path;
+    int fd;
 
-  /* Append (n) as needed. */
-  if (g_file_test (destination_filename, G_FILE_TEST_EXISTS)) {
-    int i = 1;
-    const char *dot_pos;
-    gssize position;
-    char *serial = NULL;
-    GString *tmp_filename;
-
-    dot_pos = parse_extension (destination_filename);
-    if (dot_pos)
-      position = dot_pos - destination_filename;
+    if (serial == 0)
+      name = g_strdup (filename);
     else
-      position = strlen (destination_filename);
+      name = g_strdup_printf ("%.*s(%u)%s", (int)position, filename, serial, filename + position);
+
+    path = g_build_filename (directory->path, name, NULL);
+    fd = g_open (path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd != -1) {
+      close (fd);
+      destination_directory_add_name (directory, name);
+      g_free (name);
+      return path;
+    }
+
+    if (errno != EEXIST) {
+      int errsv = errno;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   _("Could not create download destination “%s”: %s"),
+                   path, g_strerror (errsv));
+      g_free (path);
+      g_free (name);
+      return NULL;
+    }
+
+    /* Someone else took it since the directory was listed. */
+    destination_directory_add_name (directory, name);
+    g_free (path);
+    g_free (name);
+    serial++;
+  }
+}
+
+static char *
+get_destination_filename (const char *suggested_filename)
+{
+  if (suggested_filename != NULL)
+    return ephy_sanitize_filename (g_strdup (suggested_filename));
+
+  return ephy_file_tmp_filename ("ephy-download-XXXXXX", NULL);
+}
+
+/* The listing of the downloads directory, done in a worker thread
+ * while the request is in flight. Shared by the download and the
+ * thread, hence the reference count. */
+struct _DestinationListing
+{
+  volatile gint ref_count;
+
+  GMutex mutex;
+  GCond cond;
+  gboolean done;
+
+  char *path;
+  DestinationDirectory *directory;
+  GError *error;
+};
+
+static DestinationListing *
+destination_listing_new (const char *path)
+{
+  DestinationListing *listing;
+
+  listing = g_slice_new0 (DestinationListing);
+  listing->ref_count = 1;
+  g_mutex_init (&listing->mutex);
+  g_cond_init (&listing->cond);
+  listing->path = g_strdup (path);
+
+  return listing;
+}
+
+static DestinationListing *
+destination_listing_ref (DestinationListing *listing)
+{
+  g_atomic_int_inc (&listing->ref_count);
+
+  return listing;
+}
 
-    tmp_filename = g_string_new (NULL);
+static void
+destination_listing_unref (DestinationListing *listing)
+{
+  if (!g_atomic_int_dec_and_test (&listing->ref_count))
+    return;
 
-    do {
-      serial = g_strdup_printf ("(%d)", i++);
+  g_mutex_clear (&listing->mutex);
+  g_cond_clear (&listing->cond);
+  g_free (listing->path);
+  if (listing->directory)
+    destination_directory_free (listing->directory);
+  if (listing->error)
+    g_error_free (listing->error);
+  g_slice_free (DestinationListing, listing);
+}
+
+static void
+destination_listing_thread (GTask *task,
+                            gpointer source_object,
+                            DestinationListing *listing,
+                            GCancellable *cancellable)
+{
+  DestinationDirectory *directory;
+  GError *error = NULL;
+
+  directory = destination_directory_new (listing->path, &error);
+
+  g_mutex_lock (&listing->mutex);
+  listing->directory = directory;
+  listing->error = error;
+  listing->done = TRUE;
+  g_cond_signal (&listing->cond);
+  g_mutex_unlock (&listing->mutex);
+}
+
+/* WebKit asks for the destination synchronously once the response
+ * arrives, so the downloads directory is listed in a thread as soon as
+ * the download is created. */
+static void
+list_destination_directory (EphyDownload *download)
+{
+  DestinationListing *listing;
+  char *path;
+  GTask *task;
+
+  path = ephy_file_get_downloads_dir ();
+  listing = destination_listing_new (path);
+  g_free (path);
+
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_task_data (task, destination_listing_ref (listing),
+                        (GDestroyNotify)destination_listing_unref);
+  g_task_run_in_thread (task, (GTaskThreadFunc)destination_listing_thread);
+  g_object_unref (task);
+
+  download->priv->destination_listing = listing;
+}
+
+/* Returns the listing of @path, waiting for the worker thread if the
+ * response came before it was done. That only waits for the rest of a
+ * listing already under way, rather than probing the name once per
+ * copy of it the directory holds. */
+static DestinationDirectory *
+get_destination_directory (EphyDownload *download,
+                           const char *path,
+                           GError **error)
+{
+  DestinationListing *listing = download->priv->destination_listing;
+
+  /* Only when the setting changed since the download was created. */
+  if (!listing || g_strcmp0 (listing->path, path) != 0) {
+    DestinationDirectory *directory;
+
+    directory = destination_directory_new (path, error);
+    if (!directory)
+      return NULL;
+
+    if (listing)
+      destination_listing_unref (listing);
+
+    listing = destination_listing_new (path);
+    listing->directory = directory;
+    listing->done = TRUE;
+
+    download->priv->destination_listing = listing;
+  }
+
+  g_mutex_lock (&listing->mutex);
+  while (!listing->done)
+    g_cond_wait (&listing->cond, &listing->mutex);
+  g_mutex_unlock (&listing->mutex);
+
+  if (!listing->directory) {
+    g_propagate_error (error, g_error_copy (listing->error));
+    return NULL;
+  }
+
+  return listing->directory;
+}
+
+static char *
+define_destination_uri (EphyDownload *download, const char *suggested_filename)
+{
+  EphyDownloadPrivate *priv = download->priv;
+  DestinationDirectory *directory;
+  char *dest_dir;
+  char *dest_name;
+  char *destination_filename;
+  char *destination_uri;
+  GError *error = NULL;
+
+  dest_dir = ephy_file_get_downloads_dir ();
+  directory = get_destination_directory (download, dest_dir, &error);
+  g_free (dest_dir);
 
-      g_string_assign (tmp_filename, destination_filename);
-      g_string_insert (tmp_filename, position, serial);
+  if (!directory) {
+    g_critical ("%s", error->message);
+    g_error_free (error);
+    return NULL;
+  }
 
-      g_free (serial);
-    } while (g_file_test (tmp_filename->str, G_FILE_TEST_EXISTS));
+  /* The listing tells which name is free, so usually this opens a
+   * single file, however many copies the name already has. */
+  dest_name = get_destination_filename (suggested_filename);
+  destination_filename = destination_directory_allocate (directory, dest_name, &error);
+  g_free (dest_name);
 
-    destination_filename = g_strdup (tmp_filename->str);
-    g_string_free (tmp_filename, TRUE);
+  if (!destination_filename) {
+    g_critical ("%s", error->message);
+    g_error_free (error);
+    return NULL;
   }
 
   destination_uri = g_filename_to_uri (destination_filename, NULL, NULL);
-  g_free (destination_filename);
+  g_free (priv->reserved_destination);
+  priv->reserved_destination = destination_filename;
 
   g_assert (destination_uri);
 
@@ -522,6 +968,53 @@ ephy_download_get_action (EphyDownload *download)
   return download->priv->action;
 }
 
+/**
+ * ephy_download_get_rate:
+ * @download: an #EphyDownload
+ *
+ * Gets the smoothed rate at which @download is receiving data, as last
+ * reported with the #EphyDownload::progress signal.
+ *
+ * Returns: the rate, in bytes per second
+ **/
+gdouble
+ephy_download_get_rate (EphyDownload *download)
+{
+  g_return_val_if_fail (EPHY_IS_DOWNLOAD (download), 0);
+
+  return download->priv->rate;
+}
+
+/**
+ * ephy_download_get_remaining_time:
+ * @download: an #EphyDownload
+ *
+ * Gets the estimated time until @download finishes, as last reported
+ * with the #EphyDownload::progress signal.
+ *
+ * Returns: the remaining time in seconds, or -1 if it is not known
+ **/
+gdouble
+ephy_download_get_remaining_time (EphyDownload *download)
+{
+  g_return_val_if_fail (EPHY_IS_DOWNLOAD (download), -1);
+
+  return download->priv->remaining_time;
+}
+
+void
+_ephy_download_set_progress (EphyDownload *download,
+                             gdouble rate,
+                             gdouble remaining_time)
+{
+  g_return_if_fail (EPHY_IS_DOWNLOAD (download));
+
+  download->priv->rate = rate;
+  download->priv->remaining_time = remaining_time;
+
+  g_signal_emit_by_name (download, "progress");
+}
+
 /**
  * ephy_download_get_start_time:
  * @download: an #EphyDownload
@@ -641,6 +1134,12 @@ ephy_download_dispose (GObject *object)
 
   priv = download->priv;
 
+  if (priv->cancellable) {
+    g_cancellable_cancel (priv->cancellable);
+    g_object_unref (priv->cancellable);
+    priv->cancellable = NULL;
+  }
+
   if (priv->download) {
     g_signal_handlers_disconnect_matched (priv->download, G_SIGNAL_MATCH_DATA, 0, 0, 0, 0, download);
     g_object_unref (priv->download);
@@ -672,6 +1171,11 @@ ephy_download_finalize (GObject *object)
 
   g_free (priv->destination);
   g_free (priv->source);
+  g_free (priv->content_type);
+  g_free (priv->reserved_destination);
+
+  if (priv->destination_listing)
+    destination_listing_unref (priv->destination_listing);
 
   LOG ("EphyDownload finalised %p", object);
 
@@ -827,6 +1331,22 @@ ephy_download_class_init (EphyDownloadClass *klass)
                 g_cclosure_marshal_generic,
                 G_TYPE_NONE,
                 0);
+
+  /**
+   * EphyDownload::progress:
+   *
+   * The ::progress signal is emitted when the progress of @download is
+   * worth showing again. It is emitted by the #EphyDownloadManager at
+   * most once per frame, however often WebKit reports data.
+   **/
+  g_signal_new ("progress",
+                G_OBJECT_CLASS_TYPE (object_class),
+                G_SIGNAL_RUN_LAST,
+                G_STRUCT_OFFSET (EphyDownloadClass, progress),
+                NULL, NULL,
+                g_cclosure_marshal_VOID__VOID,
+                G_TYPE_NONE,
+                0);
 }
 
 static void
@@ -840,8 +1360,10 @@ ephy_download_init (EphyDownload *download)
   download->priv->destination = NULL;
 
   download->priv->action = EPHY_DOWNLOAD_ACTION_NONE;
+  download->priv->cancellable = g_cancellable_new ();
 
   download->priv->start_time = 0;
+  download->priv->remaining_time = -1;
 
   download->priv->window = NULL;
   download->priv->widget = NULL;
@@ -855,6 +1377,11 @@ download_decide_destination_cb (WebKitDownload *wk_download,
   char *dest;
 
   if (download->priv->destination) {
+#if WEBKIT_CHECK_VERSION (2, 5, 90)
+    /* A preset destination is either chosen by the user or the one an
+     * interrupted download was writing to, so replace what is there. */
+    webkit_download_set_allow_overwrite (wk_download, TRUE);
+#endif
     webkit_download_set_destination (wk_download, download->priv->destination);
     return TRUE;
   }
@@ -864,6 +1391,10 @@ download_decide_destination_cb (WebKitDownload *wk_download,
     return FALSE;
 
   ephy_download_set_destination_uri (download, dest);
+#if WEBKIT_CHECK_VERSION (2, 5, 90)
+  /* The destination was created empty to reserve its name. */
+  webkit_download_set_allow_overwrite (wk_download, TRUE);
+#endif
   webkit_download_set_destination (wk_download, dest);
   g_free (dest);
 
@@ -881,6 +1412,49 @@ download_created_destination_cb (WebKitDownload *wk_download,
   ephy_download_set_destination_uri (download, destination);
 }
 
+/* Forgets the reserved destination. With @delete_unused, the file is deleted
+ * if the download never wrote to it, so a failed or cancelled download
+ * leaves no empty file behind. */
+static void
+release_reserved_destination (EphyDownload *download,
+                              gboolean delete_unused)
+{
+  EphyDownloadPrivate *priv = download->priv;
+  GStatBuf buf;
+
+  if (!priv->reserved_destination)
+    return;
+
+  if (delete_unused &&
+      g_stat (priv->reserved_destination, &buf) == 0 && buf.st_size == 0) {
+    LOG ("Removing unused download destination %s", priv->reserved_destination);
+    g_unlink (priv->reserved_destination);
+  }
+
+  g_free (priv->reserved_destination);
+  priv->reserved_destination = NULL;
+}
+
+static void
+auto_action_content_type_cb (EphyDownload *download,
+                             GAsyncResult *result,
+                             gpointer user_data)
+{
+  char *content_type;
+  GError *error = NULL;
+
+  content_type = ephy_download_get_content_type_finish (download, result, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_error_free (error);
+    return;
+  }
+
+  ephy_download_do_download_action (download, decide_action_from_content_type (content_type));
+  g_free (content_type);
+
+  ephy_embed_shell_remove_download (ephy_embed_shell_get_default (), download);
+}
+
 static void
 download_finished_cb (WebKitDownload *wk_download,
                       EphyDownload *download)
@@ -888,14 +1462,23 @@ download_finished_cb (WebKitDownload *wk_download,
   EphyDownloadPrivate *priv;
 
   priv = download->priv;
+  priv->finished = TRUE;
+
+  release_reserved_destination (download, FALSE);
 
   g_signal_emit_by_name (download, "completed");
 
+  /* Deciding what to do may need the file sniffed, which is not done
+   * on this thread. The task keeps the download alive meanwhile. */
   if (g_settings_get_boolean (EPHY_SETTINGS_MAIN, EPHY_PREFS_AUTO_DOWNLOADS) &&
-      priv->action == EPHY_DOWNLOAD_ACTION_NONE)
-    ephy_download_do_download_action (download, EPHY_DOWNLOAD_ACTION_AUTO);
-  else
-    ephy_download_do_download_action (download, priv->action);
+      priv->action == EPHY_DOWNLOAD_ACTION_NONE) {
+    ephy_download_get_content_type_async (download, priv->cancellable,
+                                          (GAsyncReadyCallback)auto_action_content_type_cb,
+                                          NULL);
+    return;
+  }
+
+  ephy_download_do_download_action (download, priv->action);
 
   ephy_embed_shell_remove_download (ephy_embed_shell_get_default (), download);
 }
@@ -909,6 +1492,9 @@ download_failed_cb (WebKitDownload *wk_download,
 
   g_signal_handlers_disconnect_by_func (wk_download, download_finished_cb, download);
 
+  /* Also reached when the download is cancelled. */
+  release_reserved_destination (download, TRUE);
+
   LOG ("error (%d - %d)! %s", error->code, 0, error->message);
   g_signal_emit_by_name (download, "error", 0, error->code, error->message, &ret);
 }
@@ -964,6 +1550,7 @@ ephy_download_new_for_download (WebKitDownload *download,
 
   ephy_download->priv->download = g_object_ref (download);
   g_object_set_data (G_OBJECT (download), "ephy-download-set", GINT_TO_POINTER (TRUE));
+  list_destination_directory (ephy_download);
   request = webkit_download_get_request (download);
   ephy_download->priv->source = g_strdup (webkit_uri_request_get_uri (request));
 
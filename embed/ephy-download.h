@@ -61,6 +61,7 @@ struct _EphyDownloadClass
                        gint error_code,
                        gint error_detail,
                        char *reason);
+  void (* progress)   (EphyDownload *download);
 };
 
 typedef enum
@@ -94,9 +95,22 @@ WebKitDownload *ephy_download_get_webkit_download (EphyDownload *download);
 const char   *ephy_download_get_destination_uri   (EphyDownload *download);
 const char   *ephy_download_get_source_uri        (EphyDownload *download);
 char         *ephy_download_get_content_type      (EphyDownload *download);
+void          ephy_download_get_content_type_async (EphyDownload *download,
+                                                   GCancellable *cancellable,
+                                                   GAsyncReadyCallback callback,
+                                                   gpointer user_data);
+char         *ephy_download_get_content_type_finish (EphyDownload *download,
+                                                    GAsyncResult *result,
+                                                    GError **error);
 
 guint32       ephy_download_get_start_time        (EphyDownload *download);
 
+gdouble       ephy_download_get_rate              (EphyDownload *download);
+gdouble       ephy_download_get_remaining_time    (EphyDownload *download);
+void          _ephy_download_set_progress         (EphyDownload *download,
+                                                   gdouble rate,
+                                                   gdouble remaining_time);
+
 GtkWindow    *ephy_download_get_window            (EphyDownload *download);
 
 EphyDownloadActionType ephy_download_get_action   (EphyDownload *download);
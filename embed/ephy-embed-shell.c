@@ -30,7 +30,9 @@
 #include "ephy-embed-type-builtins.h"
 #include "ephy-encodings.h"
 #include "ephy-file-helpers.h"
+#include "ephy-form-auth-data.h"
 #include "ephy-history-service.h"
+#include "ephy-host-predictor.h"
 #include "ephy-profile-utils.h"
 #include "ephy-settings.h"
 #include "ephy-snapshot-service.h"
@@ -42,6 +44,7 @@
 
 #define PAGE_SETUP_FILENAME "page-setup-gtk.ini"
 #define PRINT_SETTINGS_FILENAME "print-settings.ini"
+#define DOWNLOADS_FILENAME "downloads.ini"
 #define NSPLUGINWRAPPER_SETUP "/usr/bin/mozilla-plugin-config"
 
 #define EPHY_EMBED_SHELL_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), EPHY_TYPE_EMBED_SHELL, EphyEmbedShellPrivate))
@@ -50,15 +53,20 @@ struct _EphyEmbedShellPrivate
 {
   EphyHistoryService *global_history_service;
   GList *downloads;
+  EphyDownloadManager *download_manager;
   EphyEncodings *encodings;
   GtkPageSetup *page_setup;
   GtkPrintSettings *print_settings;
   EphyEmbedShellMode mode;
   EphyFrecentStore *frecent_store;
+  EphyHostPredictor *host_predictor;
   EphyAboutHandler *about_handler;
   GDBusProxy *web_extension;
   guint web_extension_watch_name_id;
   guint web_extension_form_auth_save_signal_id;
+  guint web_extension_form_auth_query_signal_id;
+  guint web_extension_form_auth_stored_signal_id;
+  EphyFormAuthDataCache *form_auth_data_cache;
 };
 
 enum
@@ -97,6 +105,8 @@ ephy_embed_shell_dispose (GObject *object)
   g_clear_object (&priv->page_setup);
   g_clear_object (&priv->print_settings);
   g_clear_object (&priv->frecent_store);
+  g_clear_object (&priv->host_predictor);
+  g_clear_object (&priv->download_manager);
   g_clear_object (&priv->global_history_service);
 
   if (priv->downloads != NULL) {
@@ -106,6 +116,7 @@ ephy_embed_shell_dispose (GObject *object)
   }
 
   g_clear_object (&priv->about_handler);
+  g_clear_pointer (&priv->form_auth_data_cache, ephy_form_auth_data_cache_free);
 
   G_OBJECT_CLASS (ephy_embed_shell_parent_class)->dispose (object);
 }
@@ -129,6 +140,104 @@ web_extension_form_auth_save_requested (GDBusConnection *connection,
                  request_id, page_id, hostname, username);
 }
 
+/* Saved form passwords are cached by host here, the web processes ask
+ * for the hosts of the login forms they find instead of each of them
+ * loading everything from the secret service. */
+static EphyFormAuthDataCache *
+ephy_embed_shell_get_form_auth_data_cache (EphyEmbedShell *shell)
+{
+  if (shell->priv->form_auth_data_cache == NULL)
+    shell->priv->form_auth_data_cache = ephy_form_auth_data_cache_new ();
+
+  return shell->priv->form_auth_data_cache;
+}
+
+typedef struct {
+  EphyEmbedShell *shell;
+  guint request_id;
+  char *hostname;
+} FormAuthDataQueryData;
+
+static void
+form_auth_data_query_finished (GSList *auth_data_list,
+                               FormAuthDataQueryData *data)
+{
+  GVariantBuilder builder;
+  GSList *l;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sss)"));
+  for (l = auth_data_list; l; l = l->next) {
+    EphyFormAuthData *auth_data = (EphyFormAuthData *)l->data;
+
+    g_variant_builder_add (&builder, "(sss)",
+                           auth_data->form_username,
+                           auth_data->form_password,
+                           auth_data->username);
+  }
+
+  /* Not answered if the cache is being freed with the shell, the web
+   * process gives up on the query on its own. */
+  if (data->shell->priv->form_auth_data_cache && data->shell->priv->web_extension) {
+    g_dbus_proxy_call (data->shell->priv->web_extension,
+                       "FormAuthDataQueryResponse",
+                       g_variant_new ("(usa(sss))", data->request_id, data->hostname, &builder),
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1, NULL, NULL, NULL);
+  } else {
+    g_variant_builder_clear (&builder);
+  }
+
+  g_free (data->hostname);
+  g_slice_free (FormAuthDataQueryData, data);
+}
+
+static void
+web_extension_form_auth_query_requested (GDBusConnection *connection,
+                                         const char *sender_name,
+                                         const char *object_path,
+                                         const char *interface_name,
+                                         const char *signal_name,
+                                         GVariant *parameters,
+                                         EphyEmbedShell *shell)
+{
+  FormAuthDataQueryData *data;
+  const char *hostname;
+
+  data = g_slice_new (FormAuthDataQueryData);
+  /* The cache is owned by @shell, so it outlives the query. */
+  data->shell = shell;
+  g_variant_get (parameters, "(u&s)", &data->request_id, &hostname);
+  data->hostname = g_strdup (hostname);
+
+  ephy_form_auth_data_cache_query_host (ephy_embed_shell_get_form_auth_data_cache (shell),
+                                        hostname,
+                                        (EphyFormAuthDataCacheQueryCallback)form_auth_data_query_finished,
+                                        data);
+}
+
+static void
+web_extension_form_auth_stored (GDBusConnection *connection,
+                                const char *sender_name,
+                                const char *object_path,
+                                const char *interface_name,
+                                const char *signal_name,
+                                GVariant *parameters,
+                                EphyEmbedShell *shell)
+{
+  const char *hostname;
+  const char *form_username;
+  const char *form_password;
+  const char *username;
+
+  /* Nothing to update if no one asked for anything yet. */
+  if (!shell->priv->form_auth_data_cache)
+    return;
+
+  g_variant_get (parameters, "(&s&s&s&s)", &hostname, &form_username, &form_password, &username);
+  ephy_form_auth_data_cache_add (shell->priv->form_auth_data_cache,
+                                 hostname, form_username, form_password, username);
+}
+
 static void
 web_extension_proxy_created_cb (GDBusProxy *proxy,
                                 GAsyncResult *result,
@@ -152,6 +261,28 @@ web_extension_proxy_created_cb (GDBusProxy *proxy,
                                           (GDBusSignalCallback)web_extension_form_auth_save_requested,
                                           shell,
                                           NULL);
+    shell->priv->web_extension_form_auth_query_signal_id =
+      g_dbus_connection_signal_subscribe (g_dbus_proxy_get_connection (shell->priv->web_extension),
+                                          g_dbus_proxy_get_name (shell->priv->web_extension),
+                                          EPHY_WEB_EXTENSION_INTERFACE,
+                                          "FormAuthDataQueryRequired",
+                                          EPHY_WEB_EXTENSION_OBJECT_PATH,
+                                          NULL,
+                                          G_DBUS_SIGNAL_FLAGS_NONE,
+                                          (GDBusSignalCallback)web_extension_form_auth_query_requested,
+                                          shell,
+                                          NULL);
+    shell->priv->web_extension_form_auth_stored_signal_id =
+      g_dbus_connection_signal_subscribe (g_dbus_proxy_get_connection (shell->priv->web_extension),
+                                          g_dbus_proxy_get_name (shell->priv->web_extension),
+                                          EPHY_WEB_EXTENSION_INTERFACE,
+                                          "FormAuthDataStored",
+                                          EPHY_WEB_EXTENSION_OBJECT_PATH,
+                                          NULL,
+                                          G_DBUS_SIGNAL_FLAGS_NONE,
+                                          (GDBusSignalCallback)web_extension_form_auth_stored,
+                                          shell,
+                                          NULL);
   }
 }
 
@@ -274,6 +405,30 @@ ephy_embed_shell_get_frecent_store (EphyEmbedShell *shell)
   return shell->priv->frecent_store;
 }
 
+/**
+ * ephy_embed_shell_get_host_predictor:
+ * @shell: a #EphyEmbedShell
+ *
+ * Gets the #EphyHostPredictor that prefetches the hosts pages are
+ * likely to need, learning them from the global history.
+ *
+ * Return value: (transfer none): the #EphyHostPredictor
+ **/
+GObject *
+ephy_embed_shell_get_host_predictor (EphyEmbedShell *shell)
+{
+  g_return_val_if_fail (EPHY_IS_EMBED_SHELL (shell), NULL);
+
+  if (shell->priv->host_predictor == NULL) {
+    EphyHistoryService *service;
+
+    service = EPHY_HISTORY_SERVICE (ephy_embed_shell_get_global_history_service (shell));
+    shell->priv->host_predictor = ephy_host_predictor_new (service);
+  }
+
+  return G_OBJECT (shell->priv->host_predictor);
+}
+
 /**
  * ephy_embed_shell_get_encodings:
  * @shell: the #EphyEmbedShell
@@ -374,6 +529,8 @@ ephy_embed_shell_startup (GApplication* application)
   g_free (cookie_policy);
 
   ephy_embed_prefs_init ();
+
+  ephy_trace_milestone ("embed-shell-started");
 }
 
 static void
@@ -394,8 +551,22 @@ ephy_embed_shell_shutdown (GApplication* application)
     priv->web_extension_form_auth_save_signal_id = 0;
   }
 
+  if (priv->web_extension_form_auth_query_signal_id > 0) {
+    g_dbus_connection_signal_unsubscribe (g_dbus_proxy_get_connection (priv->web_extension),
+                                          priv->web_extension_form_auth_query_signal_id);
+    priv->web_extension_form_auth_query_signal_id = 0;
+  }
+
+  if (priv->web_extension_form_auth_stored_signal_id > 0) {
+    g_dbus_connection_signal_unsubscribe (g_dbus_proxy_get_connection (priv->web_extension),
+                                          priv->web_extension_form_auth_stored_signal_id);
+    priv->web_extension_form_auth_stored_signal_id = 0;
+  }
+
   g_clear_object (&priv->web_extension);
 
+  ephy_snapshot_service_sync (ephy_snapshot_service_get_default ());
+
   ephy_embed_prefs_shutdown ();
 }
 
@@ -743,6 +914,36 @@ ephy_embed_shell_get_downloads (EphyEmbedShell *shell)
   return priv->downloads;
 }
 
+/**
+ * ephy_embed_shell_get_download_manager:
+ * @shell: the #EphyEmbedShell
+ *
+ * Gets the #EphyDownloadManager that keeps track of the downloads,
+ * across sessions unless the shell is in incognito mode.
+ *
+ * Returns: (transfer none): the #EphyDownloadManager
+ **/
+EphyDownloadManager *
+ephy_embed_shell_get_download_manager (EphyEmbedShell *shell)
+{
+  EphyEmbedShellPrivate *priv;
+
+  g_return_val_if_fail (EPHY_IS_EMBED_SHELL (shell), NULL);
+  priv = shell->priv;
+
+  if (priv->download_manager == NULL) {
+    char *filename = NULL;
+
+    if (priv->mode != EPHY_EMBED_SHELL_MODE_INCOGNITO)
+      filename = g_build_filename (ephy_dot_dir (), DOWNLOADS_FILENAME, NULL);
+
+    priv->download_manager = ephy_download_manager_new (filename);
+    g_free (filename);
+  }
+
+  return priv->download_manager;
+}
+
 void
 ephy_embed_shell_add_download (EphyEmbedShell *shell, EphyDownload *download)
 {
@@ -753,6 +954,8 @@ ephy_embed_shell_add_download (EphyEmbedShell *shell, EphyDownload *download)
   priv = shell->priv;
   priv->downloads = g_list_prepend (priv->downloads, download);
 
+  ephy_download_manager_add_download (ephy_embed_shell_get_download_manager (shell), download);
+
   g_signal_emit_by_name (shell, "download-added", download, NULL);
 }
 
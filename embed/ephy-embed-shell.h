@@ -29,6 +29,7 @@
 #include <gtk/gtk.h>
 
 #include "ephy-download.h"
+#include "ephy-download-manager.h"
 
 G_BEGIN_DECLS
 
@@ -79,6 +80,7 @@ struct _EphyEmbedShellClass
 GType              ephy_embed_shell_get_type                   (void);
 EphyEmbedShell    *ephy_embed_shell_get_default                (void);
 GObject           *ephy_embed_shell_get_global_history_service (EphyEmbedShell   *shell);
+GObject           *ephy_embed_shell_get_host_predictor         (EphyEmbedShell   *shell);
 GObject           *ephy_embed_shell_get_encodings              (EphyEmbedShell   *shell);
 void               ephy_embed_shell_prepare_close              (EphyEmbedShell   *shell);
 void               ephy_embed_shell_restored_window            (EphyEmbedShell   *shell);
@@ -89,6 +91,7 @@ void               ephy_embed_shell_set_print_settings         (EphyEmbedShell
                                                                 GtkPrintSettings *settings);
 GtkPrintSettings  *ephy_embed_shell_get_print_settings         (EphyEmbedShell   *shell);
 GList             *ephy_embed_shell_get_downloads              (EphyEmbedShell   *shell);
+EphyDownloadManager *ephy_embed_shell_get_download_manager     (EphyEmbedShell   *shell);
 void               ephy_embed_shell_add_download               (EphyEmbedShell   *shell,
                                                                 EphyDownload     *download);
 void               ephy_embed_shell_remove_download            (EphyEmbedShell   *shell,
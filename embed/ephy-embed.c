@@ -64,6 +64,11 @@ struct _EphyEmbedPrivate
   char *fullscreen_string;
 
   WebKitURIRequest *delayed_request;
+  guint hibernated : 1;
+#if WEBKIT_CHECK_VERSION (2, 7, 1)
+  /* Back/forward list of the page replaced by the placeholder. */
+  WebKitWebViewSessionState *hibernated_state;
+#endif
 
   GtkWidget *overview;
   guint overview_mode : 1;
@@ -339,6 +344,9 @@ ephy_embed_dispose (GObject *object)
   }
 
   g_clear_object (&priv->delayed_request);
+#if WEBKIT_CHECK_VERSION (2, 7, 1)
+  g_clear_pointer (&priv->hibernated_state, webkit_web_view_session_state_unref);
+#endif
 
   G_OBJECT_CLASS (ephy_embed_parent_class)->dispose (object);
 }
@@ -622,8 +630,28 @@ ephy_embed_maybe_load_delayed_request (EphyEmbed *embed)
 
   web_view = ephy_embed_get_web_view (embed);
 
-  ephy_web_view_load_request (web_view, priv->delayed_request);
-  g_clear_object (&priv->delayed_request);
+#if WEBKIT_CHECK_VERSION (2, 7, 1)
+  if (priv->hibernated_state) {
+    WebKitBackForwardListItem *item;
+
+    /* This drops the entry added by the placeholder, and loading the
+     * current item from the list adds none. */
+    webkit_web_view_restore_session_state (WEBKIT_WEB_VIEW (web_view), priv->hibernated_state);
+    g_clear_pointer (&priv->hibernated_state, webkit_web_view_session_state_unref);
+
+    item = webkit_back_forward_list_get_current_item (webkit_web_view_get_back_forward_list (WEBKIT_WEB_VIEW (web_view)));
+    if (item) {
+      webkit_web_view_go_to_back_forward_list_item (WEBKIT_WEB_VIEW (web_view), item);
+      g_clear_object (&priv->delayed_request);
+    }
+  }
+#endif
+
+  if (priv->delayed_request) {
+    ephy_web_view_load_request (web_view, priv->delayed_request);
+    g_clear_object (&priv->delayed_request);
+  }
+  priv->hibernated = FALSE;
 
   /* This is to allow UI elements watching load status to show that the page is
    * loading as soon as possible.
@@ -896,6 +924,113 @@ ephy_embed_has_load_pending (EphyEmbed *embed)
   return !!embed->priv->delayed_request;
 }
 
+/**
+ * ephy_embed_hibernate:
+ * @embed: a #EphyEmbed
+ *
+ * Replaces the page in @embed with a placeholder keeping its address and
+ * title, so that the resources used by the page can be released. The page
+ * is loaded again when the tab is switched to, or by ephy_embed_wake_up(),
+ * with the back/forward list as it was.
+ *
+ * The back/forward list can't be restored with WebKit older than 2.7.1,
+ * so tabs are never hibernated then.
+ */
+void
+ephy_embed_hibernate (EphyEmbed *embed)
+{
+#if WEBKIT_CHECK_VERSION (2, 7, 1)
+  EphyEmbedPrivate *priv;
+  EphyWebView *web_view;
+  WebKitURIRequest *request;
+  char *address, *title;
+
+  g_return_if_fail (EPHY_IS_EMBED (embed));
+
+  priv = embed->priv;
+  if (priv->hibernated || priv->delayed_request)
+    return;
+
+  web_view = ephy_embed_get_web_view (embed);
+  if (ephy_web_view_get_address (web_view) == NULL)
+    return;
+
+  /* The placeholder changes both of them. */
+  address = g_strdup (ephy_web_view_get_address (web_view));
+  title = g_strdup (ephy_web_view_get_title (web_view));
+
+  priv->hibernated_state = webkit_web_view_get_session_state (WEBKIT_WEB_VIEW (web_view));
+
+  /* Only used if the list turns out to be empty. */
+  request = webkit_uri_request_new (address);
+  ephy_embed_set_delayed_load_request (embed, request);
+  g_object_unref (request);
+
+  ephy_web_view_set_placeholder (web_view, address, title ? title : address);
+  priv->hibernated = TRUE;
+
+  g_free (address);
+  g_free (title);
+#else
+  g_return_if_fail (EPHY_IS_EMBED (embed));
+#endif
+}
+
+/**
+ * ephy_embed_get_hibernated:
+ * @embed: a #EphyEmbed
+ *
+ * Checks whether @embed was hibernated with ephy_embed_hibernate() and
+ * hasn't been loaded again yet.
+ *
+ * Returns: %TRUE or %FALSE
+ */
+gboolean
+ephy_embed_get_hibernated (EphyEmbed *embed)
+{
+  g_return_val_if_fail (EPHY_IS_EMBED (embed), FALSE);
+
+  return embed->priv->hibernated;
+}
+
+#if WEBKIT_CHECK_VERSION (2, 7, 1)
+/**
+ * ephy_embed_get_session_state:
+ * @embed: a #EphyEmbed
+ *
+ * Gets the back/forward list of the page in @embed. For a hibernated
+ * @embed, that is the list of the page the placeholder stands for, not
+ * the one of the web view.
+ *
+ * Returns: (transfer full): a new reference to the session state
+ */
+WebKitWebViewSessionState *
+ephy_embed_get_session_state (EphyEmbed *embed)
+{
+  g_return_val_if_fail (EPHY_IS_EMBED (embed), NULL);
+
+  if (embed->priv->hibernated_state)
+    return webkit_web_view_session_state_ref (embed->priv->hibernated_state);
+
+  return webkit_web_view_get_session_state (WEBKIT_WEB_VIEW (ephy_embed_get_web_view (embed)));
+}
+#endif
+
+/**
+ * ephy_embed_wake_up:
+ * @embed: a #EphyEmbed
+ *
+ * Loads the page of a hibernated @embed, or any delayed load request,
+ * without waiting for the tab to be shown.
+ */
+void
+ephy_embed_wake_up (EphyEmbed *embed)
+{
+  g_return_if_fail (EPHY_IS_EMBED (embed));
+
+  ephy_embed_maybe_load_delayed_request (embed);
+}
+
 /**
  * ephy_embed_get_overview:
  * @embed: a #EphyEmbed
@@ -65,6 +65,13 @@ void         ephy_embed_leaving_fullscreen       (EphyEmbed *embed);
 void         ephy_embed_set_delayed_load_request (EphyEmbed *embed,
                                                   WebKitURIRequest     *request);
 gboolean     ephy_embed_has_load_pending         (EphyEmbed *embed);
+void         ephy_embed_hibernate                (EphyEmbed *embed);
+gboolean     ephy_embed_get_hibernated           (EphyEmbed *embed);
+#if WEBKIT_CHECK_VERSION (2, 7, 1)
+WebKitWebViewSessionState *
+             ephy_embed_get_session_state        (EphyEmbed *embed);
+#endif
+void         ephy_embed_wake_up                  (EphyEmbed *embed);
 void         ephy_embed_set_overview_mode        (EphyEmbed *embed,
                                                   gboolean   overview_mode);
 gboolean     ephy_embed_get_overview_mode        (EphyEmbed *embed);
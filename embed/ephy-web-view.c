@@ -37,10 +37,12 @@
 #include "ephy-file-monitor.h"
 #include "ephy-form-auth-data.h"
 #include "ephy-history-service.h"
+#include "ephy-host-predictor.h"
 #include "ephy-overview.h"
 #include "ephy-prefs.h"
 #include "ephy-settings.h"
 #include "ephy-string.h"
+#include "ephy-uri-split.h"
 #include "ephy-web-app-utils.h"
 #include "ephy-web-dom-utils.h"
 #include "ephy-zoom.h"
@@ -77,6 +79,8 @@ struct _EphyWebViewPrivate {
   guint is_setting_zoom : 1;
   guint load_failed : 1;
   guint history_frozen : 1;
+  guint loading_form_submission : 1;
+  guint is_form_submission : 1;
 
   char *address;
   char *typed_address;
@@ -103,8 +107,15 @@ struct _EphyWebViewPrivate {
 
   guint snapshot_idle_id;
 
+  /* Load phase currently open in the trace. */
+  const char *load_trace_phase;
+
   EphyHistoryPageVisitType visit_type;
 
+  /* Other hosts contacted by the current load, for the host predictor. */
+  char *load_host;
+  GHashTable *load_hosts;
+
   gulong do_not_track_handler;
 
   /* TLS information. */
@@ -680,6 +691,13 @@ ephy_web_view_dispose (GObject *object)
 
   g_clear_object(&priv->certificate);
 
+  if (priv->load_host) {
+    ephy_host_predictor_load_cancelled (EPHY_HOST_PREDICTOR (ephy_embed_shell_get_host_predictor (ephy_embed_shell_get_default ())),
+                                        object);
+    g_free (priv->load_host);
+    priv->load_host = NULL;
+  }
+
   G_OBJECT_CLASS (ephy_web_view_parent_class)->dispose (object);
 }
 
@@ -706,6 +724,8 @@ ephy_web_view_finalize (GObject *object)
   g_free (priv->status_message);
   g_free (priv->link_message);
   g_free (priv->loading_title);
+  g_free (priv->load_host);
+  g_hash_table_destroy (priv->load_hosts);
 
   G_OBJECT_CLASS (ephy_web_view_parent_class)->finalize (object);
 }
@@ -1287,6 +1307,19 @@ decide_policy_cb (WebKitWebView *web_view,
   const char *mime_type;
   const char *request_uri;
 
+  if (decision_type == WEBKIT_POLICY_DECISION_TYPE_NAVIGATION_ACTION) {
+    WebKitNavigationType navigation_type;
+
+    /* The request method isn't available, so any page coming from a form
+     * is taken for the result of a POST that can't be loaded again. */
+    navigation_type = webkit_navigation_policy_decision_get_navigation_type (WEBKIT_NAVIGATION_POLICY_DECISION (decision));
+    EPHY_WEB_VIEW (web_view)->priv->loading_form_submission =
+      navigation_type == WEBKIT_NAVIGATION_TYPE_FORM_SUBMITTED ||
+      navigation_type == WEBKIT_NAVIGATION_TYPE_FORM_RESUBMITTED;
+
+    return FALSE;
+  }
+
   if (decision_type != WEBKIT_POLICY_DECISION_TYPE_RESPONSE)
     return FALSE;
 
@@ -1534,6 +1567,45 @@ web_view_check_snapshot (WebKitWebView *web_view)
   return FALSE;
 }
 
+static void
+trace_load_phase (EphyWebView *view,
+                  const char *phase)
+{
+  EphyWebViewPrivate *priv = view->priv;
+
+  if (priv->load_trace_phase)
+    ephy_trace_async_end (priv->load_trace_phase, view);
+  else if (phase)
+    ephy_trace_async_begin ("Page load", view);
+
+  if (phase)
+    ephy_trace_async_begin (phase, view);
+  else if (priv->load_trace_phase)
+    ephy_trace_async_end ("Page load", view);
+
+  priv->load_trace_phase = phase;
+}
+
+static void
+resource_load_started_cb (WebKitWebView *web_view,
+                          WebKitWebResource *resource,
+                          WebKitURIRequest *request,
+                          gpointer user_data)
+{
+  EphyWebViewPrivate *priv = EPHY_WEB_VIEW (web_view)->priv;
+  EphyUriSplit split;
+
+  if (!priv->load_host)
+    return;
+
+  if (!ephy_uri_split (webkit_uri_request_get_uri (request), &split) ||
+      !split.host || split.host_length == 0 ||
+      ephy_uri_split_has_host (&split, priv->load_host))
+    return;
+
+  g_hash_table_add (priv->load_hosts, ephy_uri_split_dup_host (&split));
+}
+
 static void
 load_changed_cb (WebKitWebView *web_view,
                  WebKitLoadEvent load_event,
@@ -1549,6 +1621,8 @@ load_changed_cb (WebKitWebView *web_view,
   case WEBKIT_LOAD_STARTED: {
     const char *loading_uri = NULL;
 
+    trace_load_phase (view, "Page load: provisional");
+
     priv->load_failed = FALSE;
 
     loading_uri = webkit_web_view_get_uri (web_view);
@@ -1557,6 +1631,17 @@ load_changed_cb (WebKitWebView *web_view,
     if (ephy_embed_utils_is_no_show_address (loading_uri))
       ephy_web_view_freeze_history (view);
 
+    /* Start resolving the hosts this page is likely to need. */
+    g_hash_table_remove_all (priv->load_hosts);
+    g_free (priv->load_host);
+    priv->load_host = NULL;
+    if (!ephy_web_view_is_history_frozen (view) && loading_uri) {
+      priv->load_host = ephy_string_get_host_name (loading_uri);
+      if (priv->load_host)
+        ephy_host_predictor_load_started (EPHY_HOST_PREDICTOR (ephy_embed_shell_get_host_predictor (ephy_embed_shell_get_default ())),
+                                          view, loading_uri);
+    }
+
     if (priv->address == NULL || priv->address[0] == '\0')
       ephy_web_view_set_address (view, loading_uri);
 
@@ -1578,10 +1663,26 @@ load_changed_cb (WebKitWebView *web_view,
     const char* uri;
     EphyWebViewSecurityLevel security_level = EPHY_WEB_VIEW_STATE_IS_UNKNOWN;
 
+    trace_load_phase (view, "Page load: committed");
+
     /* Title and location. */
     uri = webkit_web_view_get_uri (web_view);
+
+    priv->is_form_submission = priv->loading_form_submission;
+
+    if (priv->visit_type == EPHY_PAGE_VISIT_LINK && priv->address &&
+        !ephy_web_view_is_history_frozen (view))
+      ephy_host_predictor_add_link (EPHY_HOST_PREDICTOR (ephy_embed_shell_get_host_predictor (ephy_embed_shell_get_default ())),
+                                    priv->address, uri);
+
     ephy_web_view_location_changed (view, uri);
 
+    /* Redirects may have changed the host being loaded. */
+    if (priv->load_host) {
+      g_free (priv->load_host);
+      priv->load_host = ephy_string_get_host_name (uri);
+    }
+
     /* Security status. */
     g_clear_object (&priv->certificate);
     if (webkit_web_view_get_tls_info (web_view, &priv->certificate, &priv->tls_errors)) {
@@ -1626,6 +1727,23 @@ load_changed_cb (WebKitWebView *web_view,
     /* Reset visit type. */
     priv->visit_type = EPHY_PAGE_VISIT_NONE;
 
+    if (priv->load_host) {
+      EphyHostPredictor *predictor;
+
+      predictor = EPHY_HOST_PREDICTOR (ephy_embed_shell_get_host_predictor (ephy_embed_shell_get_default ()));
+      if (!priv->load_failed) {
+        GList *hosts = g_hash_table_get_keys (priv->load_hosts);
+
+        ephy_host_predictor_load_finished (predictor, view,
+                                           webkit_web_view_get_uri (web_view), hosts);
+        g_list_free (hosts);
+      } else
+        ephy_host_predictor_load_cancelled (predictor, view);
+    }
+    g_hash_table_remove_all (priv->load_hosts);
+    g_free (priv->load_host);
+    priv->load_host = NULL;
+
     if (!ephy_web_view_is_history_frozen (view)) {
       if (priv->snapshot_idle_id)
         g_source_remove (priv->snapshot_idle_id);
@@ -1634,6 +1752,8 @@ load_changed_cb (WebKitWebView *web_view,
 
     ephy_web_view_thaw_history (view);
 
+    trace_load_phase (view, NULL);
+
     break;
   }
 
@@ -1925,6 +2045,8 @@ ephy_web_view_init (EphyWebView *web_view)
   priv->history_service = EPHY_HISTORY_SERVICE (ephy_embed_shell_get_global_history_service (ephy_embed_shell_get_default ()));
   priv->history_service_cancellable = g_cancellable_new ();
 
+  priv->load_hosts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
   g_signal_connect (priv->history_service,
                     "cleared", G_CALLBACK (ephy_web_view_history_cleared_cb),
                     web_view);
@@ -1941,6 +2063,10 @@ ephy_web_view_init (EphyWebView *web_view)
                     G_CALLBACK (load_changed_cb),
                     NULL);
 
+  g_signal_connect (web_view, "resource-load-started",
+                    G_CALLBACK (resource_load_started_cb),
+                    NULL);
+
   g_signal_connect (web_view, "close",
                     G_CALLBACK (close_web_view_cb),
                     NULL);
@@ -2247,6 +2373,23 @@ ephy_web_view_get_is_blank (EphyWebView *view)
   return view->priv->is_blank;
 }
 
+/**
+ * ephy_web_view_is_form_submission:
+ * @view: an #EphyWebView
+ *
+ * Returns whether the page in @view was loaded by submitting a form, so
+ * that loading its address again wouldn't give back the same page.
+ *
+ * Return value: %TRUE if the current page is the result of a form
+ **/
+gboolean
+ephy_web_view_is_form_submission (EphyWebView *view)
+{
+  g_return_val_if_fail (EPHY_IS_WEB_VIEW (view), FALSE);
+
+  return view->priv->is_form_submission;
+}
+
 /**
  * ephy_web_view_get_address:
  * @view: an #EphyWebView
@@ -2625,6 +2768,172 @@ ephy_web_view_has_modified_forms_finish (EphyWebView *view,
   return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+static void
+free_view_list (GList *views)
+{
+  g_list_free_full (views, g_object_unref);
+}
+
+#ifdef HAVE_WEBKIT2
+static void
+list_modified_forms_cb (GDBusProxy *web_extension,
+                        GAsyncResult *result,
+                        GTask *task)
+{
+  GList *views = g_task_get_task_data (task);
+  GList *modified_views = NULL;
+  GVariant *return_value;
+
+  return_value = g_dbus_proxy_call_finish (web_extension, result, NULL);
+  if (return_value) {
+    GVariantIter *iter;
+    guint64 page_id;
+    gboolean has_modified_forms;
+
+    /* Results come in the same order as the views were given. */
+    g_variant_get (return_value, "(a(tb))", &iter);
+    while (g_variant_iter_next (iter, "(tb)", &page_id, &has_modified_forms)) {
+      GList *l;
+
+      if (!has_modified_forms)
+        continue;
+
+      for (l = views; l != NULL; l = l->next) {
+        if (webkit_web_view_get_page_id (WEBKIT_WEB_VIEW (l->data)) == page_id) {
+          modified_views = g_list_prepend (modified_views, g_object_ref (l->data));
+          break;
+        }
+      }
+    }
+    g_variant_iter_free (iter);
+    g_variant_unref (return_value);
+  }
+
+  g_task_return_pointer (task, g_list_reverse (modified_views), (GDestroyNotify)free_view_list);
+  g_object_unref (task);
+}
+#endif
+
+/**
+ * ephy_web_view_list_modified_forms:
+ * @views: (element-type EphyWebView): a list of #EphyWebView
+ * @cancellable: (allow-none): a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the check is done
+ * @user_data: the data to pass to @callback
+ *
+ * Looks for all the @views that have modified forms, as
+ * ephy_web_view_has_modified_forms() would say, asking the web process
+ * about all of them at once.
+ **/
+void
+ephy_web_view_list_modified_forms (GList *views,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data)
+{
+  GTask *task = g_task_new (NULL, cancellable, callback, user_data);
+  GList *l;
+#ifdef HAVE_WEBKIT2
+  GDBusProxy *web_extension;
+  GVariantBuilder builder;
+
+  web_extension = ephy_embed_shell_get_web_extension_proxy (ephy_embed_shell_get_default ());
+  if (!web_extension) {
+    g_task_return_pointer (task, NULL, NULL);
+    g_object_unref (task);
+    return;
+  }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("at"));
+  for (l = views; l != NULL; l = l->next)
+    g_variant_builder_add (&builder, "t", webkit_web_view_get_page_id (WEBKIT_WEB_VIEW (l->data)));
+
+  g_task_set_task_data (task,
+                        g_list_copy_deep (views, (GCopyFunc)g_object_ref, NULL),
+                        (GDestroyNotify)free_view_list);
+  g_dbus_proxy_call (web_extension,
+                     "HasModifiedFormsForPages",
+                     g_variant_new ("(at)", &builder),
+                     G_DBUS_CALL_FLAGS_NONE,
+                     -1,
+                     cancellable,
+                     (GAsyncReadyCallback)list_modified_forms_cb,
+                     g_object_ref (task));
+#else
+  GList *modified_views = NULL;
+
+  for (l = views; l != NULL; l = l->next) {
+    WebKitDOMDocument *document = webkit_web_view_get_dom_document (WEBKIT_WEB_VIEW (l->data));
+
+    if (ephy_web_dom_utils_has_modified_forms (document))
+      modified_views = g_list_prepend (modified_views, g_object_ref (l->data));
+  }
+
+  g_task_return_pointer (task, g_list_reverse (modified_views), (GDestroyNotify)free_view_list);
+#endif
+
+  g_object_unref (task);
+}
+
+/**
+ * ephy_web_view_list_modified_forms_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns: (transfer full) (element-type EphyWebView): the views with
+ * modified forms, in the order they were given.
+ **/
+GList *
+ephy_web_view_list_modified_forms_finish (GAsyncResult *result,
+                                          GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * ephy_web_view_find_modified_forms:
+ * @views: (element-type EphyWebView): a list of #EphyWebView
+ * @cancellable: (allow-none): a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the check is done
+ * @user_data: the data to pass to @callback
+ *
+ * Looks for the first of @views that has modified forms, as
+ * ephy_web_view_has_modified_forms() would say, asking the web process
+ * about all of them at once.
+ **/
+void
+ephy_web_view_find_modified_forms (GList *views,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data)
+{
+  ephy_web_view_list_modified_forms (views, cancellable, callback, user_data);
+}
+
+/**
+ * ephy_web_view_find_modified_forms_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns: (transfer full): the first #EphyWebView with modified forms,
+ * or %NULL if there is none.
+ **/
+EphyWebView *
+ephy_web_view_find_modified_forms_finish (GAsyncResult *result,
+                                          GError **error)
+{
+  GList *modified_views;
+  EphyWebView *view;
+
+  modified_views = ephy_web_view_list_modified_forms_finish (result, error);
+  view = modified_views ? g_object_ref (modified_views->data) : NULL;
+  free_view_list (modified_views);
+
+  return view;
+}
+
 /**
  * ephy_web_view_get_security_level:
  * @view: an #EphyWebView
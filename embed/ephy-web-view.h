@@ -144,6 +144,7 @@ const char *               ephy_web_view_get_typed_address        (EphyWebView
 void                       ephy_web_view_set_typed_address        (EphyWebView               *view,
                                                                    const char                *address);
 gboolean                   ephy_web_view_get_is_blank             (EphyWebView               *view);
+gboolean                   ephy_web_view_is_form_submission       (EphyWebView               *view);
 void                       ephy_web_view_has_modified_forms       (EphyWebView               *view,
                                                                    GCancellable              *cancellable,
                                                                    GAsyncReadyCallback        callback,
@@ -151,6 +152,18 @@ void                       ephy_web_view_has_modified_forms       (EphyWebView
 gboolean                  ephy_web_view_has_modified_forms_finish (EphyWebView               *view,
                                                                    GAsyncResult              *result,
                                                                    GError                   **error);
+void                       ephy_web_view_find_modified_forms      (GList                     *views,
+                                                                   GCancellable              *cancellable,
+                                                                   GAsyncReadyCallback        callback,
+                                                                   gpointer                   user_data);
+EphyWebView *              ephy_web_view_find_modified_forms_finish (GAsyncResult            *result,
+                                                                   GError                   **error);
+void                       ephy_web_view_list_modified_forms      (GList                     *views,
+                                                                   GCancellable              *cancellable,
+                                                                   GAsyncReadyCallback        callback,
+                                                                   gpointer                   user_data);
+GList *                    ephy_web_view_list_modified_forms_finish (GAsyncResult            *result,
+                                                                   GError                   **error);
 void                       ephy_web_view_get_security_level       (EphyWebView               *view,
                                                                    EphyWebViewSecurityLevel  *level,
                                                                    GTlsCertificate          **certificate,
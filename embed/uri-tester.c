@@ -719,9 +719,11 @@ uri_tester_parse_file_at_uri (UriTester *tester, const char *fileuri)
   path = g_filename_from_uri (fileuri, NULL, NULL);
   if ((file = g_fopen (path, "r")))
     {
+      ephy_trace_begin ("UriTester: parse filter");
       while (fgets (line, 2000, file))
         g_free (uri_tester_parse_line (tester, line));
       fclose (file);
+      ephy_trace_end ("UriTester: parse filter");
 
       result = TRUE;
     }
@@ -855,11 +857,17 @@ uri_tester_test_uri (UriTester *tester,
                      const char *page_uri,
                      AdUriCheckType type)
 {
+  gboolean matched;
+
   /* Don't block top level documents. */
   if (type == AD_URI_CHECK_TYPE_DOCUMENT)
     return FALSE;
 
-  return uri_tester_is_matched (tester, NULL, req_uri, page_uri);
+  ephy_trace_begin ("UriTester: test URI");
+  matched = uri_tester_is_matched (tester, NULL, req_uri, page_uri);
+  ephy_trace_end ("UriTester: test URI");
+
+  return matched;
 }
 
 void
@@ -24,6 +24,7 @@
 struct _EphyEmbedFormAuthPrivate
 {
   guint64 page_id;
+  char *uri_string;
   SoupURI *uri;
   WebKitDOMNode *username_node;
   WebKitDOMNode *password_node;
@@ -37,8 +38,10 @@ ephy_embed_form_auth_finalize (GObject *object)
 {
   EphyEmbedFormAuthPrivate *priv = EPHY_EMBED_FORM_AUTH (object)->priv;
 
+  g_free (priv->uri_string);
   if (priv->uri)
     soup_uri_free (priv->uri);
+  g_free (priv->username);
   g_clear_object (&priv->username_node);
   g_clear_object (&priv->password_node);
 
@@ -74,7 +77,7 @@ ephy_embed_form_auth_new (WebKitWebPage *web_page,
   form_auth = EPHY_EMBED_FORM_AUTH (g_object_new (EPHY_TYPE_EMBED_FORM_AUTH, NULL));
 
   form_auth->priv->page_id = webkit_web_page_get_id (web_page);
-  form_auth->priv->uri = soup_uri_new (webkit_web_page_get_uri (web_page));
+  form_auth->priv->uri_string = g_strdup (webkit_web_page_get_uri (web_page));
   form_auth->priv->username_node = username_node;
   form_auth->priv->password_node = password_node;
   form_auth->priv->username = g_strdup (username);
@@ -97,7 +100,14 @@ ephy_embed_form_auth_get_password_node (EphyEmbedFormAuth *form_auth)
 SoupURI *
 ephy_embed_form_auth_get_uri (EphyEmbedFormAuth *form_auth)
 {
-  return form_auth->priv->uri;
+  EphyEmbedFormAuthPrivate *priv = form_auth->priv;
+
+  /* Most forms are never submitted nor filled, so only parse the
+   * page URI when it is needed. */
+  if (!priv->uri && priv->uri_string)
+    priv->uri = soup_uri_new (priv->uri_string);
+
+  return priv->uri;
 }
 
 guint64
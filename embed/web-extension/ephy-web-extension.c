@@ -26,6 +26,7 @@
 #include "ephy-form-auth-data.h"
 #include "ephy-prefs.h"
 #include "ephy-settings.h"
+#include "ephy-uri-split.h"
 #include "ephy-web-dom-utils.h"
 #include "uri-tester.h"
 
@@ -37,7 +38,7 @@
 
 /* FIXME: These global variables should be freed somehow. */
 static UriTester *uri_tester;
-static EphyFormAuthDataCache *form_auth_data_cache;
+static GQueue *form_auth_hosts;
 static GDBusConnection *dbus_connection;
 
 static const char introspection_xml[] =
@@ -58,6 +59,10 @@ static const char introspection_xml[] =
   "   <arg type='s' name='uri' direction='out'/>"
   "   <arg type='s' name='color' direction='out'/>"
   "  </method>"
+  "  <method name='HasModifiedFormsForPages'>"
+  "   <arg type='at' name='page_ids' direction='in'/>"
+  "   <arg type='a(tb)' name='results' direction='out'/>"
+  "  </method>"
   "  <signal name='FormAuthDataSaveConfirmationRequired'>"
   "   <arg type='u' name='request_id' direction='out'/>"
   "   <arg type='t' name='page_id' direction='out'/>"
@@ -68,6 +73,21 @@ static const char introspection_xml[] =
   "   <arg type='u' name='request_id' direction='in'/>"
   "   <arg type='b' name='should_store' direction='in'/>"
   "  </method>"
+  "  <signal name='FormAuthDataQueryRequired'>"
+  "   <arg type='u' name='request_id' direction='out'/>"
+  "   <arg type='s' name='hostname' direction='out'/>"
+  "  </signal>"
+  "  <method name='FormAuthDataQueryResponse'>"
+  "   <arg type='u' name='request_id' direction='in'/>"
+  "   <arg type='s' name='hostname' direction='in'/>"
+  "   <arg type='a(sss)' name='auth_data' direction='in'/>"
+  "  </method>"
+  "  <signal name='FormAuthDataStored'>"
+  "   <arg type='s' name='hostname' direction='out'/>"
+  "   <arg type='s' name='form_username' direction='out'/>"
+  "   <arg type='s' name='form_password' direction='out'/>"
+  "   <arg type='s' name='username' direction='out'/>"
+  "  </signal>"
   " </interface>"
   "</node>";
 
@@ -133,6 +153,224 @@ form_auth_data_save_request_new_id (void)
   return ++form_auth_data_save_request_id;
 }
 
+/* The saved logins of the hosts of the latest login forms, most
+ * recently used first. The UI process keeps all of them, and is asked
+ * for the ones of a host the first time a login form of it is found. */
+#define MAX_FORM_AUTH_HOSTS 16
+
+typedef struct {
+  char *host;
+  GSList *auth_data_list;
+} FormAuthHost;
+
+static void
+form_auth_host_free (FormAuthHost *entry)
+{
+  g_free (entry->host);
+  g_slist_free_full (entry->auth_data_list, (GDestroyNotify)ephy_form_auth_data_free);
+
+  g_slice_free (FormAuthHost, entry);
+}
+
+static FormAuthHost *
+form_auth_hosts_lookup (const char *host)
+{
+  GList *l;
+
+  for (l = form_auth_hosts->head; l; l = l->next) {
+    FormAuthHost *entry = (FormAuthHost *)l->data;
+
+    if (g_str_equal (entry->host, host)) {
+      g_queue_unlink (form_auth_hosts, l);
+      g_queue_push_head_link (form_auth_hosts, l);
+
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+static FormAuthHost *
+form_auth_hosts_insert (const char *host,
+                        GSList *auth_data_list)
+{
+  FormAuthHost *entry;
+
+  entry = form_auth_hosts_lookup (host);
+  if (entry) {
+    g_slist_free_full (entry->auth_data_list, (GDestroyNotify)ephy_form_auth_data_free);
+    entry->auth_data_list = auth_data_list;
+
+    return entry;
+  }
+
+  entry = g_slice_new (FormAuthHost);
+  entry->host = g_strdup (host);
+  entry->auth_data_list = auth_data_list;
+  g_queue_push_head (form_auth_hosts, entry);
+
+  while (g_queue_get_length (form_auth_hosts) > MAX_FORM_AUTH_HOSTS)
+    form_auth_host_free ((FormAuthHost *)g_queue_pop_tail (form_auth_hosts));
+
+  return entry;
+}
+
+static void
+form_auth_host_add (FormAuthHost *entry,
+                    const char *form_username,
+                    const char *form_password,
+                    const char *username)
+{
+  GSList *l;
+
+  for (l = entry->auth_data_list; l; l = l->next) {
+    EphyFormAuthData *data = (EphyFormAuthData *)l->data;
+
+    if (g_str_equal (data->form_username, form_username) &&
+        g_str_equal (data->form_password, form_password) &&
+        g_str_equal (data->username, username))
+      return;
+  }
+
+  entry->auth_data_list = g_slist_append (entry->auth_data_list,
+                                          ephy_form_auth_data_new (form_username, form_password, username));
+}
+
+static GSList *
+get_form_auth_host_list (const char *host)
+{
+  FormAuthHost *entry;
+
+  if (!form_auth_hosts || !host)
+    return NULL;
+
+  entry = form_auth_hosts_lookup (host);
+
+  return entry ? entry->auth_data_list : NULL;
+}
+
+typedef struct {
+  guint request_id;
+  char *host;
+  GSList *form_auths;
+  guint n_retries;
+  guint retry_source_id;
+} FormAuthDataQuery;
+
+/* Requests are sent again while there is no answer, as the UI process
+ * might not be listening yet, and given up after a few tries. */
+#define FORM_AUTH_DATA_QUERY_RETRY_SECONDS 2
+#define FORM_AUTH_DATA_QUERY_MAX_RETRIES 5
+
+static gboolean
+emit_form_auth_data_query_required (guint request_id,
+                                    const char *host)
+{
+  GError *error = NULL;
+
+  g_dbus_connection_emit_signal (dbus_connection,
+                                 NULL,
+                                 EPHY_WEB_EXTENSION_OBJECT_PATH,
+                                 EPHY_WEB_EXTENSION_INTERFACE,
+                                 "FormAuthDataQueryRequired",
+                                 g_variant_new ("(us)", request_id, host),
+                                 &error);
+  if (error) {
+    g_warning ("Error emitting signal FormAuthDataQueryRequired: %s\n", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+form_auth_data_query_free (FormAuthDataQuery *query)
+{
+  if (query->retry_source_id)
+    g_source_remove (query->retry_source_id);
+  g_free (query->host);
+  g_slist_free_full (query->form_auths, g_object_unref);
+
+  g_slice_free (FormAuthDataQuery, query);
+}
+
+static GHashTable *
+get_form_auth_data_queries (void)
+{
+  static GHashTable *form_auth_data_queries = NULL;
+
+  if (!form_auth_data_queries) {
+    form_auth_data_queries =
+      g_hash_table_new_full (g_direct_hash,
+                             g_direct_equal,
+                             NULL,
+                             (GDestroyNotify)form_auth_data_query_free);
+  }
+
+  return form_auth_data_queries;
+}
+
+static guint
+form_auth_data_query_new_id (void)
+{
+  static guint form_auth_data_query_id = 0;
+
+  return ++form_auth_data_query_id;
+}
+
+static gboolean
+form_auth_data_query_retry_cb (FormAuthDataQuery *query)
+{
+  if (query->n_retries++ < FORM_AUTH_DATA_QUERY_MAX_RETRIES) {
+    emit_form_auth_data_query_required (query->request_id, query->host);
+    return TRUE;
+  }
+
+  LOG ("No saved logins received for %s, giving up", query->host);
+
+  /* Drops the forms waiting for it. */
+  query->retry_source_id = 0;
+  g_hash_table_remove (get_form_auth_data_queries (), GUINT_TO_POINTER (query->request_id));
+
+  return FALSE;
+}
+
+static void
+request_form_auth_data (EphyEmbedFormAuth *form_auth)
+{
+  GHashTable *queries = get_form_auth_data_queries ();
+  GHashTableIter iter;
+  FormAuthDataQuery *query;
+  const char *host;
+
+  if (!dbus_connection)
+    return;
+
+  host = ephy_embed_form_auth_get_uri (form_auth)->host;
+
+  /* All the forms of a host waiting for its logins share the query. */
+  g_hash_table_iter_init (&iter, queries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&query)) {
+    if (g_str_equal (query->host, host)) {
+      query->form_auths = g_slist_prepend (query->form_auths, g_object_ref (form_auth));
+      return;
+    }
+  }
+
+  query = g_slice_new0 (FormAuthDataQuery);
+  query->request_id = form_auth_data_query_new_id ();
+  query->host = g_strdup (host);
+  query->form_auths = g_slist_prepend (NULL, g_object_ref (form_auth));
+  query->retry_source_id = g_timeout_add_seconds (FORM_AUTH_DATA_QUERY_RETRY_SECONDS,
+                                                  (GSourceFunc)form_auth_data_query_retry_cb,
+                                                  query);
+  g_hash_table_insert (queries, GUINT_TO_POINTER (query->request_id), query);
+
+  emit_form_auth_data_query_required (query->request_id, host);
+}
+
 static void
 store_password (EphyEmbedFormAuth *form_auth)
 {
@@ -163,11 +401,26 @@ store_password (EphyEmbedFormAuth *form_auth)
   g_free (uri_str);
 
   /* Update internal caching */
-  ephy_form_auth_data_cache_add (form_auth_data_cache,
-                                 uri->host,
-                                 username_field_name,
-                                 password_field_name,
-                                 username_field_value);
+  if (form_auth_hosts) {
+    FormAuthHost *entry = form_auth_hosts_lookup (uri->host);
+
+    if (entry)
+      form_auth_host_add (entry, username_field_name, password_field_name, username_field_value);
+  }
+
+  if (dbus_connection) {
+    g_dbus_connection_emit_signal (dbus_connection,
+                                   NULL,
+                                   EPHY_WEB_EXTENSION_OBJECT_PATH,
+                                   EPHY_WEB_EXTENSION_INTERFACE,
+                                   "FormAuthDataStored",
+                                   g_variant_new ("(ssss)",
+                                                  uri->host,
+                                                  username_field_name,
+                                                  password_field_name,
+                                                  username_field_value),
+                                   NULL);
+  }
 
   g_free (username_field_name);
   g_free (username_field_value);
@@ -352,7 +605,7 @@ pre_fill_form (EphyEmbedFormAuth *form_auth)
   if (!uri)
     return;
 
-  form_auth_data_list = ephy_form_auth_data_cache_get_list (form_auth_data_cache, uri->host);
+  form_auth_data_list = get_form_auth_host_list (uri->host);
   l = g_slist_find_custom (form_auth_data_list, form_auth, (GCompareFunc)ephy_form_auth_data_compare);
   if (!l)
     return;
@@ -824,93 +1077,330 @@ form_destroyed_cb (gpointer form_auth, GObject *form)
   g_object_unref (form_auth);
 }
 
+/* The form fields the user has typed in are recorded from the input
+ * events of each loaded document, so that the UI process can ask for
+ * many pages at once without walking every form of each of them. Only
+ * those fields are looked at when asked, with the heuristic of
+ * ephy_web_dom_utils_has_modified_forms(). */
+#define EDITED_FORM_ELEMENTS_KEY "ephy-edited-form-elements"
+#define EDITED_FORM_ELEMENTS_CAUGHT_UP_KEY "ephy-edited-form-elements-caught-up"
+
 static void
-web_page_document_loaded (WebKitWebPage *web_page,
-                          gpointer user_data)
+add_edited_form_element (GHashTable *edited,
+                         WebKitDOMEventTarget *target)
+{
+  if (WEBKIT_DOM_IS_HTML_TEXT_AREA_ELEMENT (target)) {
+    if (!webkit_dom_html_text_area_element_is_edited (WEBKIT_DOM_HTML_TEXT_AREA_ELEMENT (target)))
+      return;
+  } else if (WEBKIT_DOM_IS_HTML_INPUT_ELEMENT (target)) {
+    if (!webkit_dom_html_input_element_is_edited (WEBKIT_DOM_HTML_INPUT_ELEMENT (target)))
+      return;
+  } else
+    return;
+
+  if (!g_hash_table_contains (edited, target))
+    g_hash_table_add (edited, g_object_ref (target));
+}
+
+static gboolean
+document_input_cb (WebKitDOMDocument *document,
+                   WebKitDOMEvent *dom_event,
+                   GHashTable *edited)
 {
-  WebKitDOMHTMLCollection *forms = NULL;
-  WebKitDOMDocument *document = NULL;
+  add_edited_form_element (edited, webkit_dom_event_get_target (dom_event));
+
+  return TRUE;
+}
+
+static gboolean
+edited_form_elements_are_modified (GHashTable *edited)
+{
+  GHashTable *forms_with_input;
+  GHashTableIter iter;
+  gpointer element;
+  gboolean modified = FALSE;
+
+  forms_with_input = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  g_hash_table_iter_init (&iter, edited);
+  while (!modified && g_hash_table_iter_next (&iter, &element, NULL)) {
+    WebKitDOMHTMLFormElement *form;
+    char *text;
+    glong length;
+
+    /* Fields the user emptied again, or that are no longer in a
+     * form, have nothing to lose. */
+    if (WEBKIT_DOM_IS_HTML_TEXT_AREA_ELEMENT (element)) {
+      form = webkit_dom_html_text_area_element_get_form (WEBKIT_DOM_HTML_TEXT_AREA_ELEMENT (element));
+      text = webkit_dom_html_text_area_element_get_value (WEBKIT_DOM_HTML_TEXT_AREA_ELEMENT (element));
+      modified = form && text && *text;
+      g_free (text);
+      continue;
+    }
+
+    form = webkit_dom_html_input_element_get_form (WEBKIT_DOM_HTML_INPUT_ELEMENT (element));
+    text = webkit_dom_html_input_element_get_value (WEBKIT_DOM_HTML_INPUT_ELEMENT (element));
+    length = text ? g_utf8_strlen (text, -1) : 0;
+    g_free (text);
+
+    if (!form || length == 0)
+      continue;
+
+    /* A single modified input without a lot of text in a form is likely
+     * something like a search entry, not worth a confirmation. */
+    if (length > 50 || g_hash_table_contains (forms_with_input, form))
+      modified = TRUE;
+    else
+      g_hash_table_add (forms_with_input, form);
+  }
+
+  g_hash_table_destroy (forms_with_input);
+
+  return modified;
+}
+
+static void
+track_form_modifications (WebKitDOMDocument *document)
+{
+  GHashTable *edited;
+
+  if (g_object_get_data (G_OBJECT (document), EDITED_FORM_ELEMENTS_KEY))
+    return;
+
+  edited = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+  g_object_set_data_full (G_OBJECT (document), EDITED_FORM_ELEMENTS_KEY,
+                          edited, (GDestroyNotify)g_hash_table_destroy);
+  webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (document), "input",
+                                              G_CALLBACK (document_input_cb), TRUE,
+                                              edited);
+}
+
+/* The user may have typed while the document was loading, before the
+ * input listener was there. Look for those fields the first time the
+ * document is asked about, rather than walking the forms of every
+ * document when it is loaded. */
+static void
+catch_up_form_modifications (WebKitDOMDocument *document,
+                             GHashTable *edited)
+{
+  WebKitDOMHTMLCollection *forms;
   gulong forms_n;
   int i;
 
-  if (!form_auth_data_cache ||
-      !g_settings_get_boolean (EPHY_SETTINGS_MAIN, EPHY_PREFS_REMEMBER_PASSWORDS))
+  if (g_object_get_data (G_OBJECT (document), EDITED_FORM_ELEMENTS_CAUGHT_UP_KEY))
     return;
 
-  document = webkit_web_page_get_dom_document (web_page);
+  g_object_set_data (G_OBJECT (document), EDITED_FORM_ELEMENTS_CAUGHT_UP_KEY,
+                     GINT_TO_POINTER (TRUE));
+
   forms = webkit_dom_document_get_forms (document);
   forms_n = webkit_dom_html_collection_get_length (forms);
+  for (i = 0; i < forms_n; i++) {
+    WebKitDOMHTMLCollection *elements;
+    WebKitDOMNode *form;
+    gulong elements_n;
+    int j;
+
+    form = webkit_dom_html_collection_item (forms, i);
+    elements = webkit_dom_html_form_element_get_elements (WEBKIT_DOM_HTML_FORM_ELEMENT (form));
+    elements_n = webkit_dom_html_collection_get_length (elements);
+
+    for (j = 0; j < elements_n; j++)
+      add_edited_form_element (edited, WEBKIT_DOM_EVENT_TARGET (webkit_dom_html_collection_item (elements, j)));
+  }
+}
+
+static gboolean
+web_page_has_modified_forms (WebKitWebPage *web_page)
+{
+  WebKitDOMDocument *document;
+  GHashTable *edited;
+
+  document = webkit_web_page_get_dom_document (web_page);
+  if (!document)
+    return FALSE;
+
+  edited = g_object_get_data (G_OBJECT (document), EDITED_FORM_ELEMENTS_KEY);
+
+  /* The document is still loading, so it is not being tracked yet. */
+  if (!edited)
+    return ephy_web_dom_utils_has_modified_forms (document);
+
+  catch_up_form_modifications (document, edited);
+
+  return edited_form_elements_are_modified (edited);
+}
+
+static GSList *
+copy_auth_data_list (GSList *auth_data_list)
+{
+  GSList *copy = NULL;
+  GSList *l;
+
+  for (l = auth_data_list; l; l = l->next) {
+    EphyFormAuthData *data = (EphyFormAuthData *)l->data;
+
+    copy = g_slist_prepend (copy, ephy_form_auth_data_new (data->form_username,
+                                                           data->form_password,
+                                                           data->username));
+  }
+
+  return g_slist_reverse (copy);
+}
+
+static void
+free_auth_data_list (GSList *auth_data_list)
+{
+  g_slist_free_full (auth_data_list, (GDestroyNotify)ephy_form_auth_data_free);
+}
+
+static void
+hook_form_auth (WebKitWebPage *web_page,
+                EphyEmbedFormAuth *form_auth,
+                GSList *auth_data_list)
+{
+  WebKitDOMNode *username_node;
 
-  if (forms_n == 0) {
-    LOG ("No forms found.");
-    g_object_unref(forms);
+  username_node = ephy_embed_form_auth_get_username_node (form_auth);
+  if (g_object_get_data (G_OBJECT (username_node), "ephy-form-auth-hooked"))
+    return;
+
+  LOG ("Hooking and pre-filling a form");
+  g_object_set_data (G_OBJECT (username_node), "ephy-form-auth-hooked", GINT_TO_POINTER (TRUE));
+  webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "blur",
+                                              G_CALLBACK (username_changed_cb), FALSE,
+                                              form_auth);
+
+  /* Plug in the user autocomplete */
+  if (auth_data_list && auth_data_list->next) {
+    LOG ("More than 1 password saved, hooking menu for choosing which on focus");
+    /* The host may be dropped from the cache before the form is. */
+    g_object_set_data_full (G_OBJECT (username_node), "ephy-auth-data-list",
+                            copy_auth_data_list (auth_data_list),
+                            (GDestroyNotify)free_auth_data_list);
+    g_object_set_data (G_OBJECT (username_node), "ephy-document", webkit_web_page_get_dom_document (web_page));
+    webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "input",
+                                                G_CALLBACK (username_node_input_cb), TRUE,
+                                                web_page);
+    webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "keydown",
+                                                G_CALLBACK (username_node_keydown_cb), FALSE,
+                                                web_page);
+    webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "mouseup",
+                                                G_CALLBACK (username_node_clicked_cb), FALSE,
+                                                web_page);
+    webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "change",
+                                                G_CALLBACK (username_node_changed_cb), FALSE,
+                                                web_page);
+    webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "blur",
+                                                G_CALLBACK (username_node_changed_cb), FALSE,
+                                                web_page);
+  } else
+    LOG ("No items or a single item in auth_data_list, not hooking menu for choosing.");
+
+  pre_fill_form (form_auth);
+}
+
+static gboolean
+username_node_focus_cb (WebKitDOMNode  *username_node,
+                        WebKitDOMEvent *dom_event,
+                        WebKitWebPage  *web_page)
+{
+  EphyEmbedFormAuth *form_auth;
+  SoupURI *uri;
+
+  form_auth = (EphyEmbedFormAuth *)g_object_get_data (G_OBJECT (username_node),
+                                                      "ephy-form-auth");
+  if (!form_auth)
+    return TRUE;
+
+  uri = ephy_embed_form_auth_get_uri (form_auth);
+  hook_form_auth (web_page, form_auth, uri ? get_form_auth_host_list (uri->host) : NULL);
+
+  return TRUE;
+}
+
+static void
+web_page_document_loaded (WebKitWebPage *web_page,
+                          gpointer user_data)
+{
+  WebKitDOMNodeList *password_inputs;
+  WebKitDOMDocument *document;
+  FormAuthHost *entry = NULL;
+  EphyUriSplit split;
+  char *host;
+  gulong password_inputs_n;
+  int i;
+
+  document = webkit_web_page_get_dom_document (web_page);
+  track_form_modifications (document);
+
+  if (!form_auth_hosts ||
+      !g_settings_get_boolean (EPHY_SETTINGS_MAIN, EPHY_PREFS_REMEMBER_PASSWORDS))
+    return;
+
+  /* Only forms with a password input can be login forms, and most
+   * pages have none at all, so look for those first. */
+  password_inputs = webkit_dom_document_query_selector_all (document, "input[type='password']", NULL);
+  password_inputs_n = password_inputs ? webkit_dom_node_list_get_length (password_inputs) : 0;
+
+  if (password_inputs_n == 0) {
+    LOG ("No password inputs found.");
+    g_clear_object (&password_inputs);
     return;
   }
 
-  for (i = 0; i < forms_n; i++) {
+  if (!ephy_uri_split (webkit_web_page_get_uri (web_page), &split) || !split.host) {
+    g_object_unref (password_inputs);
+    return;
+  }
+  host = ephy_uri_split_dup_host (&split);
+
+  for (i = 0; i < password_inputs_n; i++) {
+    WebKitDOMNode *password_input;
     WebKitDOMHTMLFormElement *form;
     WebKitDOMNode *username_node = NULL;
     WebKitDOMNode *password_node = NULL;
+    EphyEmbedFormAuth *form_auth;
+
+    password_input = webkit_dom_node_list_item (password_inputs, i);
+    form = webkit_dom_html_input_element_get_form (WEBKIT_DOM_HTML_INPUT_ELEMENT (password_input));
 
-    form = WEBKIT_DOM_HTML_FORM_ELEMENT (webkit_dom_html_collection_item (forms, i));
+    /* Forms with several password inputs are seen more than once. */
+    if (!form || g_object_get_data (G_OBJECT (form), "ephy-form-auth-checked"))
+      continue;
+    g_object_set_data (G_OBJECT (form), "ephy-form-auth-checked", GINT_TO_POINTER (TRUE));
 
     /* We have a field that may be the user, and one for a password. */
-    if (ephy_web_dom_utils_find_form_auth_elements (form, &username_node, &password_node)) {
-      EphyEmbedFormAuth *form_auth;
-      GSList *auth_data_list;
-      const char *uri_string;
-      SoupURI *uri;
-
-      LOG ("Hooking and pre-filling a form");
-
-      /* EphyEmbedFormAuth takes ownership of the nodes */
-      form_auth = ephy_embed_form_auth_new (web_page, username_node, password_node, NULL);
-      webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (form), "submit",
-                                                  G_CALLBACK (form_submitted_cb), FALSE,
-                                                  web_page);
-      webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "blur",
-                                                  G_CALLBACK (username_changed_cb), FALSE,
-                                                  form_auth);
-
-      /* Plug in the user autocomplete */
-      uri_string = webkit_web_page_get_uri (web_page);
-      uri = soup_uri_new (uri_string);
-
-      auth_data_list = ephy_form_auth_data_cache_get_list (form_auth_data_cache, uri->host);
-
-      soup_uri_free (uri);
-
-      if (auth_data_list && auth_data_list->next) {
-        LOG ("More than 1 password saved, hooking menu for choosing which on focus");
-        g_object_set_data (G_OBJECT (username_node), "ephy-auth-data-list", auth_data_list);
-        g_object_set_data (G_OBJECT (username_node), "ephy-form-auth", form_auth);
-        g_object_set_data (G_OBJECT (username_node), "ephy-document", document);
-        webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "input",
-                                                    G_CALLBACK (username_node_input_cb), TRUE,
-                                                    web_page);
-        webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "keydown",
-                                                    G_CALLBACK (username_node_keydown_cb), FALSE,
-                                                    web_page);
-        webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "mouseup",
-                                                    G_CALLBACK (username_node_clicked_cb), FALSE,
-                                                    web_page);
-        webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "change",
-                                                    G_CALLBACK (username_node_changed_cb), FALSE,
-                                                    web_page);
-        webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "blur",
-                                                    G_CALLBACK (username_node_changed_cb), FALSE,
-                                                    web_page);
-      } else
-        LOG ("No items or a single item in auth_data_list, not hooking menu for choosing.");
-
-      pre_fill_form (form_auth);
-
-      g_object_weak_ref (G_OBJECT (form), form_destroyed_cb, form_auth);
-    } else
+    if (!ephy_web_dom_utils_find_form_auth_elements (form, &username_node, &password_node)) {
       LOG ("No pre-fillable/hookable form found");
+      continue;
+    }
+
+    /* EphyEmbedFormAuth takes ownership of the nodes */
+    form_auth = ephy_embed_form_auth_new (web_page, username_node, password_node, NULL);
+    webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (form), "submit",
+                                                G_CALLBACK (form_submitted_cb), FALSE,
+                                                web_page);
+    g_object_weak_ref (G_OBJECT (form), form_destroyed_cb, form_auth);
+
+    /* The rest of the listeners are only needed once the user gets to
+     * the form, or to pre-fill it if there are saved logins. */
+    g_object_set_data (G_OBJECT (username_node), "ephy-form-auth", form_auth);
+    webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (username_node), "focus",
+                                                G_CALLBACK (username_node_focus_cb), FALSE,
+                                                web_page);
+
+    if (!entry)
+      entry = form_auth_hosts_lookup (host);
+
+    if (!entry)
+      request_form_auth_data (form_auth, host);
+    else if (entry->auth_data_list)
+      hook_form_auth (web_page, form_auth, entry->auth_data_list);
   }
 
-  g_object_unref(forms);
+  g_free (host);
+  g_object_unref (password_inputs);
 }
 
 static void
@@ -956,7 +1446,6 @@ handle_method_call (GDBusConnection *connection,
 
   if (g_strcmp0 (method_name, "HasModifiedForms") == 0) {
     WebKitWebPage *web_page;
-    WebKitDOMDocument *document;
     guint64 page_id;
     gboolean has_modifed_forms;
 
@@ -965,10 +1454,27 @@ handle_method_call (GDBusConnection *connection,
     if (!web_page)
       return;
 
-    document = webkit_web_page_get_dom_document (web_page);
-    has_modifed_forms = ephy_web_dom_utils_has_modified_forms (document);
+    has_modifed_forms = web_page_has_modified_forms (web_page);
 
     g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", has_modifed_forms));
+  } else if (g_strcmp0 (method_name, "HasModifiedFormsForPages") == 0) {
+    GVariantIter *iter;
+    GVariantBuilder builder;
+    guint64 page_id;
+
+    g_variant_get (parameters, "(at)", &iter);
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(tb)"));
+
+    /* Pages that are gone have nothing to lose, so they are not an error. */
+    while (g_variant_iter_next (iter, "t", &page_id)) {
+      WebKitWebPage *web_page = webkit_web_extension_get_page (web_extension, page_id);
+
+      g_variant_builder_add (&builder, "(tb)", page_id,
+                             web_page ? web_page_has_modified_forms (web_page) : FALSE);
+    }
+    g_variant_iter_free (iter);
+
+    g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a(tb))", &builder));
   } else if (g_strcmp0 (method_name, "GetWebAppTitle") == 0) {
     WebKitWebPage *web_page;
     WebKitDOMDocument *document;
@@ -1024,6 +1530,51 @@ handle_method_call (GDBusConnection *connection,
     if (should_store)
       store_password (form_auth);
     g_hash_table_remove (requests, GINT_TO_POINTER (request_id));
+  } else if (g_strcmp0 (method_name, "FormAuthDataQueryResponse") == 0) {
+    FormAuthDataQuery *query;
+    FormAuthHost *entry;
+    GVariantIter *iter;
+    GSList *auth_data_list = NULL;
+    GSList *l;
+    guint request_id;
+    const char *hostname;
+    const char *form_username;
+    const char *form_password;
+    const char *username;
+    GHashTable *queries = get_form_auth_data_queries ();
+
+    g_dbus_method_invocation_return_value (invocation, NULL);
+
+    if (!form_auth_hosts)
+      return;
+
+    g_variant_get (parameters, "(u&sa(sss))", &request_id, &hostname, &iter);
+    while (g_variant_iter_next (iter, "(&s&s&s)", &form_username, &form_password, &username))
+      auth_data_list = g_slist_prepend (auth_data_list,
+                                        ephy_form_auth_data_new (form_username, form_password, username));
+    g_variant_iter_free (iter);
+
+    entry = form_auth_hosts_insert (hostname, g_slist_reverse (auth_data_list));
+
+    query = g_hash_table_lookup (queries, GINT_TO_POINTER (request_id));
+    if (!query)
+      return;
+
+    for (l = query->form_auths; l; l = l->next) {
+      EphyEmbedFormAuth *form_auth = EPHY_EMBED_FORM_AUTH (l->data);
+      WebKitWebPage *web_page;
+
+      /* Without saved logins there is nothing to pre-fill, so the
+       * form is left alone until it gets the focus. The page might also
+       * have been closed meanwhile. */
+      if (!entry->auth_data_list)
+        break;
+
+      web_page = webkit_web_extension_get_page (web_extension, ephy_embed_form_auth_get_page_id (form_auth));
+      if (web_page)
+        hook_form_auth (web_page, form_auth, entry->auth_data_list);
+    }
+    g_hash_table_remove (queries, GINT_TO_POINTER (request_id));
   }
 
 }
@@ -1070,7 +1621,7 @@ webkit_web_extension_initialize (WebKitWebExtension *extension)
   ephy_debug_init ();
   uri_tester = uri_tester_new (g_getenv ("EPHY_DOT_DIR"));
   if (!g_getenv ("EPHY_PRIVATE_PROFILE"))
-    form_auth_data_cache = ephy_form_auth_data_cache_new ();
+    form_auth_hosts = g_queue_new ();
 
   g_signal_connect (extension, "page-created",
                     G_CALLBACK (web_page_created_callback),
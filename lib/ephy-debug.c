@@ -21,32 +21,28 @@
 
 #include "ephy-debug.h"
 
+#include <glib-unix.h>
 #include <string.h>
 #ifdef HAVE_EXECINFO_H
 #include <execinfo.h>
 #endif
 #include <signal.h>
+#include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <glib.h>
 
 /**
  * SECTION:ephy-debug
- * @short_description: Epiphany debugging and profiling facilities
+ * @short_description: Epiphany debugging facilities
  *
- * Epiphany includes powerful profiling and debugging facilities to log and
- * analyze modules. Refer to doc/debugging.txt for more information.
+ * Epiphany includes powerful debugging facilities to log and analyze
+ * modules. Refer to doc/debugging.txt for more information.
  */
 
 static const char *ephy_debug_break = NULL;
 
-#ifndef DISABLE_PROFILING
-static GHashTable *ephy_profilers_hash = NULL;
-static char **ephy_profile_modules;
-static gboolean ephy_profile_all_modules;
-#endif /* !DISABLE_PROFILING */
-
-#ifdef GNOME_ENABLE_DEBUG
+#ifndef DISABLE_LOGGING
 
 static char **
 build_modules (const char *name,
@@ -68,10 +64,6 @@ build_modules (const char *name,
 	return g_strsplit (g_getenv (name), ":", -1);
 }
 
-#endif
-
-#ifndef DISABLE_LOGGING
-
 static char **ephy_log_modules;
 static gboolean ephy_log_all_modules;
 
@@ -164,141 +156,50 @@ trap_handler (const char *log_domain,
 	}
 }
 
-/**
- * ephy_debug_init:
- *
- * Starts the debugging facility, see doc/debugging.txt in Epiphany's source for
- * more information. It also starts module logging and profiling if the
- * appropiate variables are set: EPHY_LOG_MODULES and EPHY_PROFILE_MODULES.
- **/
-void
-ephy_debug_init (void)
-{
-#ifndef DISABLE_LOGGING
-	ephy_log_modules = build_modules ("EPHY_LOG_MODULES", &ephy_log_all_modules);
-
-	g_log_set_handler (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, log_module, NULL);
-
-#endif
-
-	ephy_debug_break = g_getenv ("EPHY_DEBUG_BREAK");
-	g_log_set_default_handler (trap_handler, NULL);
-
-#ifndef DISABLE_PROFILING
-	ephy_profile_modules = build_modules ("EPHY_PROFILE_MODULES", &ephy_profile_all_modules);
-#endif
-}
-
-#ifndef DISABLE_PROFILING
-
-static EphyProfiler *
-ephy_profiler_new (const char *name, const char *module)
-{
-	EphyProfiler *profiler;
-
-	profiler = g_new0 (EphyProfiler, 1);
-	profiler->timer = g_timer_new ();
-	profiler->name  = g_strdup (name);
-	profiler->module  = g_strdup (module);
-
-	g_timer_start (profiler->timer);
-
-	return profiler;
-}
-
 static gboolean
-ephy_should_profile (const char *module)
+dump_trace (gpointer user_data)
 {
-	char *slash;
-	gboolean result = FALSE;
-	guint i;
+	GError *error = NULL;
+	char *filename;
 
-	slash = strrchr (module, '/');
+	filename = g_strdup_printf ("%s/epiphany-trace-%d.json",
+				    g_get_tmp_dir (), getpid ());
 
-	/* Happens on builddir != srcdir builds */
-	if (slash != NULL) module = slash + 1;
-
-	for (i = 0; ephy_profile_modules[i] != NULL; i++)
+	if (ephy_trace_dump (filename, &error))
 	{
-		if (strcmp (ephy_profile_modules[i], module) == 0)
-		{
-			result = TRUE;
-			break;
-		}
+		g_message ("Trace written to %s", filename);
 	}
-
-	return result;
-}
-
-static void
-ephy_profiler_dump (EphyProfiler *profiler)
-{
-	double seconds;
-
-	g_return_if_fail (profiler != NULL);
-
-	seconds = g_timer_elapsed (profiler->timer, NULL);
-
-	g_print ("[ %s ] %s %f s elapsed\n",
-		 profiler->module, profiler->name,
-		 seconds);
-}
-
-static void
-ephy_profiler_free (EphyProfiler *profiler)
-{
-	g_return_if_fail (profiler != NULL);
-
-	g_timer_destroy (profiler->timer);
-	g_free (profiler->name);
-	g_free (profiler->module);
-	g_free (profiler);
-}
-
-/**
- * ephy_profiler_start:
- * @name: name of this new profiler
- * @module: Epiphany module to profile
- *
- * Starts a new profiler on @module naming it @name.
- **/
-void
-ephy_profiler_start (const char *name, const char *module)
-{
-	EphyProfiler *profiler;
-
-	if (ephy_profilers_hash == NULL)
+	else
 	{
-		ephy_profilers_hash =
-			g_hash_table_new_full (g_str_hash, g_str_equal,
-					       g_free, NULL);
+		g_warning ("Could not write trace: %s", error->message);
+		g_error_free (error);
 	}
 
-	if (!ephy_profile_all_modules &&
-	    (ephy_profile_modules == NULL || !ephy_should_profile (module))) return;
-
-	profiler = ephy_profiler_new (name, module);
+	g_free (filename);
 
-	g_hash_table_insert (ephy_profilers_hash, g_strdup (name), profiler);
+	return TRUE;
 }
 
 /**
- * ephy_profiler_stop:
- * @name: name of the profiler to stop
+ * ephy_debug_init:
  *
- * Stops the profiler named @name.
+ * Starts the debugging facility, see doc/debugging.txt in Epiphany's source for
+ * more information. It also starts module logging if the appropiate variable
+ * is set: EPHY_LOG_MODULES, and makes SIGUSR2 dump the trace buffers.
  **/
 void
-ephy_profiler_stop (const char *name)
+ephy_debug_init (void)
 {
-	EphyProfiler *profiler;
-
-	profiler = g_hash_table_lookup (ephy_profilers_hash, name);
-	if (profiler == NULL) return;
-	g_hash_table_remove (ephy_profilers_hash, name);
+#ifndef DISABLE_LOGGING
+	ephy_log_modules = build_modules ("EPHY_LOG_MODULES", &ephy_log_all_modules);
 
-	ephy_profiler_dump (profiler);
-	ephy_profiler_free (profiler);
-}
+	g_log_set_handler (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, log_module, NULL);
 
 #endif
+
+	ephy_debug_break = g_getenv ("EPHY_DEBUG_BREAK");
+	g_log_set_default_handler (trap_handler, NULL);
+
+	ephy_trace_set_thread_name ("main");
+	g_unix_signal_add (SIGUSR2, dump_trace, NULL);
+}
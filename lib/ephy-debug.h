@@ -26,11 +26,12 @@
 
 #include <glib.h>
 
+#include "ephy-trace.h"
+
 G_BEGIN_DECLS
 
 #ifndef GNOME_ENABLE_DEBUG
 #define DISABLE_LOGGING
-#define DISABLE_PROFILING
 #endif
 
 #if defined(G_HAVE_GNUC_VARARGS)
@@ -54,34 +55,8 @@ static void LOG(const char *format, ...) {}
 
 #endif
 
-#ifdef DISABLE_PROFILING
-#define START_PROFILER(name)
-#define STOP_PROFILER(name)
-#else
-#define START_PROFILER(name)	\
-ephy_profiler_start (name, __FILE__);
-#define STOP_PROFILER(name)	\
-ephy_profiler_stop (name);
-#endif
-
-typedef struct
-{
-	GTimer *timer;
-	char *name;
-	char *module;
-} EphyProfiler;
-
 void		ephy_debug_init		(void);
 
-#ifndef DISABLE_PROFILING
-
-void		ephy_profiler_start	(const char *name,
-					 const char *module);
-
-void		ephy_profiler_stop	(const char *name);
-
-#endif
-
 G_END_DECLS
 
 #endif
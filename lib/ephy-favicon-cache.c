@@ -0,0 +1,473 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-favicon-cache.h"
+
+#include "ephy-debug.h"
+#include "ephy-favicon-helpers.h"
+
+#include <string.h>
+#ifdef HAVE_WEBKIT2
+#include <webkit2/webkit2.h>
+#else
+#include <webkit/webkit.h>
+#endif
+
+/* Enough for a completion popup, a few menus and the hosts list. */
+#define FAVICON_CACHE_MAX_ENTRIES 512
+
+#define EPHY_FAVICON_CACHE_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), EPHY_TYPE_FAVICON_CACHE, EphyFaviconCachePrivate))
+
+typedef struct {
+  char *key;
+  const char *page_uri;
+  /* NULL if the page is known not to have a favicon. */
+  GdkPixbuf *favicon;
+  GList *link;
+} CacheEntry;
+
+typedef struct {
+  EphyFaviconCache *cache;
+  char *key;
+  char *page_uri;
+  int size;
+  GList *tasks;
+  gboolean stale;
+} PendingRequest;
+
+struct _EphyFaviconCachePrivate
+{
+  WebKitFaviconDatabase *database;
+
+  /* Scaled favicons by "size:page_uri", most recently used first in lru. */
+  GHashTable *entries;
+  GQueue lru;
+
+  /* Database requests in flight, by the same key. */
+  GHashTable *pending;
+};
+
+enum {
+  FAVICON_CHANGED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+G_DEFINE_TYPE (EphyFaviconCache, ephy_favicon_cache, G_TYPE_OBJECT)
+
+static char *
+make_key (const char *page_uri, int size)
+{
+  return g_strdup_printf ("%d:%s", size, page_uri);
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_free (entry->key);
+  g_clear_object (&entry->favicon);
+  g_slice_free (CacheEntry, entry);
+}
+
+static void
+cache_remove_entry (EphyFaviconCache *cache, CacheEntry *entry)
+{
+  EphyFaviconCachePrivate *priv = cache->priv;
+
+  g_queue_delete_link (&priv->lru, entry->link);
+  g_hash_table_remove (priv->entries, entry->key);
+}
+
+static void
+cache_insert (EphyFaviconCache *cache,
+              const char *key,
+              GdkPixbuf *favicon)
+{
+  EphyFaviconCachePrivate *priv = cache->priv;
+  CacheEntry *entry;
+
+  entry = g_hash_table_lookup (priv->entries, key);
+  if (entry)
+    cache_remove_entry (cache, entry);
+
+  while (g_queue_get_length (&priv->lru) >= FAVICON_CACHE_MAX_ENTRIES)
+    cache_remove_entry (cache, g_queue_peek_tail (&priv->lru));
+
+  entry = g_slice_new (CacheEntry);
+  entry->key = g_strdup (key);
+  entry->page_uri = strchr (entry->key, ':') + 1;
+  entry->favicon = favicon ? g_object_ref (favicon) : NULL;
+
+  g_queue_push_head (&priv->lru, entry);
+  entry->link = g_queue_peek_head_link (&priv->lru);
+  g_hash_table_insert (priv->entries, entry->key, entry);
+}
+
+static void
+favicon_changed_cb (WebKitFaviconDatabase *database,
+                    const char *page_uri,
+#ifdef HAVE_WEBKIT2
+                    const char *favicon_uri,
+#endif
+                    EphyFaviconCache *cache)
+{
+  ephy_favicon_cache_invalidate (cache, page_uri);
+}
+
+static WebKitFaviconDatabase *
+get_database (EphyFaviconCache *cache)
+{
+  EphyFaviconCachePrivate *priv = cache->priv;
+
+  /* The database can only be used once the shell has set its
+   * directory, so don't grab it before the first request. */
+  if (priv->database == NULL) {
+#ifdef HAVE_WEBKIT2
+    priv->database = webkit_web_context_get_favicon_database (webkit_web_context_get_default ());
+    g_signal_connect_object (priv->database, "favicon-changed",
+                             G_CALLBACK (favicon_changed_cb), cache, 0);
+#else
+    priv->database = webkit_get_favicon_database ();
+    g_signal_connect_object (priv->database, "icon-loaded",
+                             G_CALLBACK (favicon_changed_cb), cache, 0);
+#endif
+  }
+
+  return priv->database;
+}
+
+static void
+ephy_favicon_cache_finalize (GObject *object)
+{
+  EphyFaviconCachePrivate *priv = EPHY_FAVICON_CACHE (object)->priv;
+
+  g_hash_table_destroy (priv->entries);
+  g_queue_clear (&priv->lru);
+  g_hash_table_destroy (priv->pending);
+
+  G_OBJECT_CLASS (ephy_favicon_cache_parent_class)->finalize (object);
+}
+
+static void
+ephy_favicon_cache_class_init (EphyFaviconCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ephy_favicon_cache_finalize;
+
+  /**
+   * EphyFaviconCache::favicon-changed:
+   * @cache: the #EphyFaviconCache
+   * @page_uri: the page whose favicon changed
+   *
+   * Emitted after the cached favicons for @page_uri have been dropped
+   * because the favicon database has a new icon for it.
+   */
+  signals[FAVICON_CHANGED] =
+    g_signal_new ("favicon-changed",
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (EphyFaviconCacheClass, favicon_changed),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__STRING,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
+
+  g_type_class_add_private (klass, sizeof (EphyFaviconCachePrivate));
+}
+
+static void
+ephy_favicon_cache_init (EphyFaviconCache *cache)
+{
+  cache->priv = EPHY_FAVICON_CACHE_GET_PRIVATE (cache);
+
+  cache->priv->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                NULL,
+                                                (GDestroyNotify)cache_entry_free);
+  g_queue_init (&cache->priv->lru);
+  cache->priv->pending = g_hash_table_new (g_str_hash, g_str_equal);
+}
+
+/**
+ * ephy_favicon_cache_get_default:
+ *
+ * Gets the process-wide #EphyFaviconCache.
+ *
+ * Returns: (transfer none): the default #EphyFaviconCache
+ **/
+EphyFaviconCache *
+ephy_favicon_cache_get_default (void)
+{
+  static EphyFaviconCache *cache = NULL;
+
+  if (cache == NULL)
+    cache = g_object_new (EPHY_TYPE_FAVICON_CACHE, NULL);
+
+  return cache;
+}
+
+/**
+ * ephy_favicon_cache_lookup:
+ * @cache: an #EphyFaviconCache
+ * @page_uri: the page address
+ * @size: the width and height of the favicon, or 0 for its original size
+ * @favicon: (out) (transfer full): return location for the favicon
+ *
+ * Looks up the favicon of @page_uri at @size without querying the
+ * favicon database.
+ *
+ * Returns: %TRUE if the answer is cached. @favicon is set to %NULL
+ * when the page is known not to have a favicon.
+ **/
+gboolean
+ephy_favicon_cache_lookup (EphyFaviconCache *cache,
+                           const char *page_uri,
+                           int size,
+                           GdkPixbuf **favicon)
+{
+  EphyFaviconCachePrivate *priv;
+  CacheEntry *entry;
+  char *key;
+
+  g_return_val_if_fail (EPHY_IS_FAVICON_CACHE (cache), FALSE);
+  g_return_val_if_fail (page_uri != NULL, FALSE);
+  g_return_val_if_fail (favicon != NULL, FALSE);
+
+  priv = cache->priv;
+
+  key = make_key (page_uri, size);
+  entry = g_hash_table_lookup (priv->entries, key);
+  g_free (key);
+
+  if (entry == NULL)
+    return FALSE;
+
+  g_queue_unlink (&priv->lru, entry->link);
+  g_queue_push_head_link (&priv->lru, entry->link);
+
+  *favicon = entry->favicon ? g_object_ref (entry->favicon) : NULL;
+
+  return TRUE;
+}
+
+static void
+pending_request_complete (PendingRequest *request,
+                          GdkPixbuf *favicon,
+                          gboolean definitive)
+{
+  EphyFaviconCache *cache = request->cache;
+  GList *l;
+
+  g_hash_table_remove (cache->priv->pending, request->key);
+
+  /* Don't cache an answer that predates an icon change, nor a failure
+   * that a later query might not hit. */
+  if (definitive && !request->stale)
+    cache_insert (cache, request->key, favicon);
+
+  request->tasks = g_list_reverse (request->tasks);
+  for (l = request->tasks; l; l = l->next) {
+    GTask *task = G_TASK (l->data);
+
+    g_task_return_pointer (task,
+                           favicon ? g_object_ref (favicon) : NULL,
+                           g_object_unref);
+    g_object_unref (task);
+  }
+
+  g_list_free (request->tasks);
+  g_free (request->key);
+  g_free (request->page_uri);
+  g_object_unref (request->cache);
+  g_slice_free (PendingRequest, request);
+}
+
+static void
+favicon_loaded_cb (GObject *source,
+                   GAsyncResult *result,
+                   gpointer user_data)
+{
+  PendingRequest *request = (PendingRequest *)user_data;
+  WebKitFaviconDatabase *database = WEBKIT_FAVICON_DATABASE (source);
+  GdkPixbuf *favicon = NULL;
+  GError *error = NULL;
+  gboolean definitive;
+#ifdef HAVE_WEBKIT2
+  cairo_surface_t *icon_surface;
+
+  icon_surface = webkit_favicon_database_get_favicon_finish (database, result, &error);
+  if (icon_surface) {
+    favicon = ephy_pixbuf_get_from_surface_scaled (icon_surface, request->size, request->size);
+    cairo_surface_destroy (icon_surface);
+  }
+
+  /* Only an unknown favicon means the page has none. The database may
+   * not be open yet, or may know the icon but not have its data. */
+  definitive = favicon != NULL ||
+    g_error_matches (error, WEBKIT_FAVICON_DATABASE_ERROR,
+                     WEBKIT_FAVICON_DATABASE_ERROR_FAVICON_UNKNOWN);
+#else
+  favicon = webkit_favicon_database_get_favicon_pixbuf_finish (database, result, &error);
+  definitive = error == NULL;
+#endif
+
+  if (error) {
+    LOG ("Favicon request for %s failed: %s", request->key, error->message);
+    g_error_free (error);
+  }
+
+  pending_request_complete (request, favicon, definitive);
+
+  if (favicon)
+    g_object_unref (favicon);
+}
+
+/**
+ * ephy_favicon_cache_get_favicon_async:
+ * @cache: an #EphyFaviconCache
+ * @page_uri: the page address
+ * @size: the width and height of the favicon, or 0 for its original size
+ * @cancellable: (allow-none): a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback
+ * @user_data: data for @callback
+ *
+ * Gets the favicon of @page_uri scaled to @size. Cached favicons are
+ * returned without touching the favicon database, and concurrent
+ * requests for the same page and size share a single database query.
+ **/
+void
+ephy_favicon_cache_get_favicon_async (EphyFaviconCache *cache,
+                                      const char *page_uri,
+                                      int size,
+                                      GCancellable *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data)
+{
+  EphyFaviconCachePrivate *priv;
+  PendingRequest *request;
+  GdkPixbuf *favicon;
+  GTask *task;
+  char *key;
+
+  g_return_if_fail (EPHY_IS_FAVICON_CACHE (cache));
+  g_return_if_fail (page_uri != NULL);
+
+  priv = cache->priv;
+  task = g_task_new (cache, cancellable, callback, user_data);
+
+  if (ephy_favicon_cache_lookup (cache, page_uri, size, &favicon)) {
+    g_task_return_pointer (task, favicon, g_object_unref);
+    g_object_unref (task);
+    return;
+  }
+
+  key = make_key (page_uri, size);
+  request = g_hash_table_lookup (priv->pending, key);
+  if (request) {
+    LOG ("Coalescing favicon request for %s", key);
+    request->tasks = g_list_prepend (request->tasks, task);
+    g_free (key);
+    return;
+  }
+
+  request = g_slice_new0 (PendingRequest);
+  request->cache = g_object_ref (cache);
+  request->key = key;
+  request->page_uri = g_strdup (page_uri);
+  request->size = size;
+  request->tasks = g_list_prepend (NULL, task);
+  g_hash_table_insert (priv->pending, request->key, request);
+
+  /* The query is shared, so it is never cancelled; each caller's
+   * cancellable only affects its own task. */
+#ifdef HAVE_WEBKIT2
+  webkit_favicon_database_get_favicon (get_database (cache), page_uri,
+                                       NULL, favicon_loaded_cb, request);
+#else
+  webkit_favicon_database_get_favicon_pixbuf (get_database (cache), page_uri,
+                                              size, size,
+                                              NULL, favicon_loaded_cb, request);
+#endif
+}
+
+/**
+ * ephy_favicon_cache_get_favicon_finish:
+ * @cache: an #EphyFaviconCache
+ * @result: a #GAsyncResult
+ * @error: a location to store a #GError or %NULL
+ *
+ * Finishes an operation started with
+ * ephy_favicon_cache_get_favicon_async().
+ *
+ * Returns: (transfer full): the favicon, or %NULL if the page has none
+ **/
+GdkPixbuf *
+ephy_favicon_cache_get_favicon_finish (EphyFaviconCache *cache,
+                                       GAsyncResult *result,
+                                       GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, cache), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * ephy_favicon_cache_invalidate:
+ * @cache: an #EphyFaviconCache
+ * @page_uri: the page address
+ *
+ * Drops every cached favicon of @page_uri and emits
+ * #EphyFaviconCache::favicon-changed. This happens automatically when
+ * the favicon database reports a new icon.
+ **/
+void
+ephy_favicon_cache_invalidate (EphyFaviconCache *cache,
+                               const char *page_uri)
+{
+  EphyFaviconCachePrivate *priv;
+  GHashTableIter iter;
+  PendingRequest *request;
+  GList *l;
+
+  g_return_if_fail (EPHY_IS_FAVICON_CACHE (cache));
+  g_return_if_fail (page_uri != NULL);
+
+  priv = cache->priv;
+
+  l = priv->lru.head;
+  while (l) {
+    CacheEntry *entry = (CacheEntry *)l->data;
+
+    l = l->next;
+    if (strcmp (entry->page_uri, page_uri) == 0)
+      cache_remove_entry (cache, entry);
+  }
+
+  g_hash_table_iter_init (&iter, priv->pending);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&request)) {
+    if (strcmp (request->page_uri, page_uri) == 0)
+      request->stale = TRUE;
+  }
+
+  g_signal_emit (cache, signals[FAVICON_CHANGED], 0, page_uri);
+}
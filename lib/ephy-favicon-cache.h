@@ -0,0 +1,85 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#if !defined (__EPHY_EPIPHANY_H_INSIDE__) && !defined (EPIPHANY_COMPILATION)
+#error "Only <epiphany/epiphany.h> can be included directly."
+#endif
+
+#ifndef _EPHY_FAVICON_CACHE_H
+#define _EPHY_FAVICON_CACHE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define EPHY_TYPE_FAVICON_CACHE            (ephy_favicon_cache_get_type())
+#define EPHY_FAVICON_CACHE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), EPHY_TYPE_FAVICON_CACHE, EphyFaviconCache))
+#define EPHY_FAVICON_CACHE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), EPHY_TYPE_FAVICON_CACHE, EphyFaviconCacheClass))
+#define EPHY_IS_FAVICON_CACHE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EPHY_TYPE_FAVICON_CACHE))
+#define EPHY_IS_FAVICON_CACHE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EPHY_TYPE_FAVICON_CACHE))
+#define EPHY_FAVICON_CACHE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), EPHY_TYPE_FAVICON_CACHE, EphyFaviconCacheClass))
+
+typedef struct _EphyFaviconCache        EphyFaviconCache;
+typedef struct _EphyFaviconCacheClass   EphyFaviconCacheClass;
+typedef struct _EphyFaviconCachePrivate EphyFaviconCachePrivate;
+
+struct _EphyFaviconCache
+{
+  GObject parent;
+
+  /*< private >*/
+  EphyFaviconCachePrivate *priv;
+};
+
+struct _EphyFaviconCacheClass
+{
+  GObjectClass parent_class;
+
+  void (* favicon_changed) (EphyFaviconCache *cache,
+                            const char *page_uri);
+};
+
+GType             ephy_favicon_cache_get_type           (void) G_GNUC_CONST;
+
+EphyFaviconCache *ephy_favicon_cache_get_default        (void);
+
+gboolean          ephy_favicon_cache_lookup             (EphyFaviconCache *cache,
+                                                         const char *page_uri,
+                                                         int size,
+                                                         GdkPixbuf **favicon);
+
+void              ephy_favicon_cache_get_favicon_async  (EphyFaviconCache *cache,
+                                                         const char *page_uri,
+                                                         int size,
+                                                         GCancellable *cancellable,
+                                                         GAsyncReadyCallback callback,
+                                                         gpointer user_data);
+
+GdkPixbuf        *ephy_favicon_cache_get_favicon_finish (EphyFaviconCache *cache,
+                                                         GAsyncResult *result,
+                                                         GError **error);
+
+void              ephy_favicon_cache_invalidate         (EphyFaviconCache *cache,
+                                                         const char *page_uri);
+
+G_END_DECLS
+
+#endif /* _EPHY_FAVICON_CACHE_H */
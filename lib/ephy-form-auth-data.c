@@ -255,7 +255,7 @@ ephy_form_auth_data_query (const char *uri,
   g_free (key_str);
 }
 
-static EphyFormAuthData *
+EphyFormAuthData *
 ephy_form_auth_data_new (const char *form_username,
                          const char *form_password,
                          const char *username)
@@ -270,7 +270,7 @@ ephy_form_auth_data_new (const char *form_username,
   return data;
 }
 
-static void
+void
 ephy_form_auth_data_free (EphyFormAuthData *data)
 {
   g_free (data->form_username);
@@ -280,6 +280,51 @@ ephy_form_auth_data_free (EphyFormAuthData *data)
   g_slice_free (EphyFormAuthData, data);
 }
 
+struct _EphyFormAuthDataCache {
+  GHashTable  *form_auth_data_map;
+
+  GCancellable *cancellable;
+  gboolean     loaded;
+  GSList      *pending_queries;
+};
+
+typedef struct {
+  char *host;
+  EphyFormAuthDataCacheQueryCallback callback;
+  gpointer user_data;
+} EphyFormAuthDataCacheQuery;
+
+static void
+ephy_form_auth_data_cache_query_free (EphyFormAuthDataCacheQuery *query)
+{
+  g_free (query->host);
+  g_slice_free (EphyFormAuthDataCacheQuery, query);
+}
+
+static void
+ephy_form_auth_data_cache_run_pending_queries (EphyFormAuthDataCache *cache)
+{
+  GSList *queries, *l;
+
+  queries = g_slist_reverse (cache->pending_queries);
+  cache->pending_queries = NULL;
+
+  for (l = queries; l; l = l->next) {
+    EphyFormAuthDataCacheQuery *query = (EphyFormAuthDataCacheQuery *)l->data;
+
+    query->callback (cache->loaded ? ephy_form_auth_data_cache_get_list (cache, query->host) : NULL,
+                     query->user_data);
+  }
+  g_slist_free_full (queries, (GDestroyNotify)ephy_form_auth_data_cache_query_free);
+}
+
+static void
+ephy_form_auth_data_cache_set_loaded (EphyFormAuthDataCache *cache)
+{
+  cache->loaded = TRUE;
+  ephy_form_auth_data_cache_run_pending_queries (cache);
+}
+
 static void
 screcet_service_search_finished (SecretService *service,
                                  GAsyncResult *result,
@@ -289,9 +334,16 @@ screcet_service_search_finished (SecretService *service,
   GError *error = NULL;
 
   results = secret_service_search_finish (service, result, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    /* The cache is gone already. */
+    g_error_free (error);
+    return;
+  }
+
   if (error != NULL) {
     g_warning ("Error caching form data: %s", error->message);
     g_error_free (error);
+    ephy_form_auth_data_cache_set_loaded (cache);
     return;
   }
 
@@ -312,6 +364,8 @@ screcet_service_search_finished (SecretService *service,
   }
 
   g_list_free_full (results, g_object_unref);
+
+  ephy_form_auth_data_cache_set_loaded (cache);
 }
 
 static void
@@ -324,25 +378,22 @@ ephy_form_auth_data_cache_init (EphyFormAuthDataCache *cache)
                          EPHY_FORM_PASSWORD_SCHEMA,
                          attributes,
                          SECRET_SEARCH_UNLOCK | SECRET_SEARCH_ALL,
-                         NULL,
+                         cache->cancellable,
                          (GAsyncReadyCallback)screcet_service_search_finished,
                          cache);
   g_hash_table_unref (attributes);
 }
 
-struct _EphyFormAuthDataCache {
-  GHashTable  *form_auth_data_map;
-};
-
 EphyFormAuthDataCache *
 ephy_form_auth_data_cache_new (void)
 {
-  EphyFormAuthDataCache *cache = g_slice_new (EphyFormAuthDataCache);
+  EphyFormAuthDataCache *cache = g_slice_new0 (EphyFormAuthDataCache);
 
   cache->form_auth_data_map = g_hash_table_new_full (g_str_hash,
                                                      g_str_equal,
                                                      g_free,
                                                      NULL);
+  cache->cancellable = g_cancellable_new ();
   ephy_form_auth_data_cache_init (cache);
 
   return cache;
@@ -361,6 +412,11 @@ ephy_form_auth_data_cache_free (EphyFormAuthDataCache *cache)
 {
   g_return_if_fail (cache);
 
+  g_cancellable_cancel (cache->cancellable);
+  g_object_unref (cache->cancellable);
+  /* Let the callbacks free their data. */
+  ephy_form_auth_data_cache_run_pending_queries (cache);
+
   g_hash_table_foreach (cache->form_auth_data_map,
                         (GHFunc)form_auth_data_map_free_value,
                         NULL);
@@ -377,7 +433,7 @@ ephy_form_auth_data_cache_add (EphyFormAuthDataCache *cache,
                                const char *username)
 {
   EphyFormAuthData *data;
-  GSList *l;
+  GSList *l, *p;
 
   g_return_if_fail (cache);
   g_return_if_fail (uri);
@@ -385,8 +441,19 @@ ephy_form_auth_data_cache_add (EphyFormAuthDataCache *cache,
   g_return_if_fail (form_password);
   g_return_if_fail (username);
 
-  data = ephy_form_auth_data_new (form_username, form_password, username);
   l = g_hash_table_lookup (cache->form_auth_data_map, uri);
+  for (p = l; p; p = p->next) {
+    data = (EphyFormAuthData *)p->data;
+
+    /* The cache holds no passwords, so storing one again for the same
+     * user and form leaves nothing to update. */
+    if (g_str_equal (data->form_username, form_username) &&
+        g_str_equal (data->form_password, form_password) &&
+        g_str_equal (data->username, username))
+      return;
+  }
+
+  data = ephy_form_auth_data_new (form_username, form_password, username);
   l = g_slist_append (l, data);
   g_hash_table_replace (cache->form_auth_data_map,
                         g_strdup (uri), l);
@@ -401,3 +468,39 @@ ephy_form_auth_data_cache_get_list (EphyFormAuthDataCache *cache,
 
   return g_hash_table_lookup (cache->form_auth_data_map, uri);
 }
+
+/**
+ * ephy_form_auth_data_cache_query_host:
+ * @cache: an #EphyFormAuthDataCache
+ * @host: the host name to look up
+ * @callback: called with the list of #EphyFormAuthData for @host
+ * @user_data: the data to pass to @callback
+ *
+ * Like ephy_form_auth_data_cache_get_list(), but waits for @cache to be
+ * loaded from the secret service first, if it is not yet. The list
+ * passed to @callback is owned by @cache. If @cache is freed before it
+ * is loaded, @callback is called with a %NULL list.
+ **/
+void
+ephy_form_auth_data_cache_query_host (EphyFormAuthDataCache *cache,
+                                      const char *host,
+                                      EphyFormAuthDataCacheQueryCallback callback,
+                                      gpointer user_data)
+{
+  EphyFormAuthDataCacheQuery *query;
+
+  g_return_if_fail (cache);
+  g_return_if_fail (host);
+  g_return_if_fail (callback);
+
+  if (cache->loaded) {
+    callback (ephy_form_auth_data_cache_get_list (cache, host), user_data);
+    return;
+  }
+
+  query = g_slice_new (EphyFormAuthDataCacheQuery);
+  query->host = g_strdup (host);
+  query->callback = callback;
+  query->user_data = user_data;
+  cache->pending_queries = g_slist_prepend (cache->pending_queries, query);
+}
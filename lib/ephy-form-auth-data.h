@@ -63,8 +63,16 @@ typedef struct {
   char *username;
 } EphyFormAuthData;
 
+EphyFormAuthData *ephy_form_auth_data_new  (const char *form_username,
+                                            const char *form_password,
+                                            const char *username);
+void              ephy_form_auth_data_free (EphyFormAuthData *data);
+
 typedef struct _EphyFormAuthDataCache EphyFormAuthDataCache;
 
+typedef void (*EphyFormAuthDataCacheQueryCallback) (GSList *auth_data_list,
+                                                    gpointer user_data);
+
 EphyFormAuthDataCache *ephy_form_auth_data_cache_new      (void);
 void                   ephy_form_auth_data_cache_free     (EphyFormAuthDataCache *cache);
 void                   ephy_form_auth_data_cache_add      (EphyFormAuthDataCache *cache,
@@ -74,5 +82,9 @@ void                   ephy_form_auth_data_cache_add      (EphyFormAuthDataCache
                                                            const char            *username);
 GSList                *ephy_form_auth_data_cache_get_list (EphyFormAuthDataCache *cache,
                                                            const char            *uri);
+void                   ephy_form_auth_data_cache_query_host (EphyFormAuthDataCache *cache,
+                                                             const char            *host,
+                                                             EphyFormAuthDataCacheQueryCallback callback,
+                                                             gpointer               user_data);
 
 #endif
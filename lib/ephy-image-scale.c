@@ -0,0 +1,292 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-image-scale.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Each destination pixel is the average of a box of whole source
+ * pixels. Rows of the box are summed into per-channel accumulators,
+ * in B, G, R, A order, which is how ARGB32 pixels are laid out in
+ * memory on little endian machines. Only the row summing, which
+ * touches every source pixel, has a vectorized version. */
+
+typedef void (* BoxSumRowFunc) (const guchar *row,
+                                const int *x_bounds,
+                                int dest_width,
+                                guint32 *sums);
+
+static void
+box_sum_row_scalar (const guchar *row,
+                    const int *x_bounds,
+                    int dest_width,
+                    guint32 *sums)
+{
+  const guint32 *pixels = (const guint32 *)row;
+  int dx, x;
+
+  for (dx = 0; dx < dest_width; dx++) {
+    guint32 b = 0, g = 0, r = 0, a = 0;
+
+    for (x = x_bounds[dx]; x < x_bounds[dx + 1]; x++) {
+      guint32 pixel = pixels[x];
+
+      b += pixel & 0xff;
+      g += (pixel >> 8) & 0xff;
+      r += (pixel >> 16) & 0xff;
+      a += pixel >> 24;
+    }
+
+    sums[0] += b;
+    sums[1] += g;
+    sums[2] += r;
+    sums[3] += a;
+    sums += 4;
+  }
+}
+
+#ifdef __SSE2__
+/* Channels are summed in 16 bit lanes, so boxes can be at most
+ * 257 pixels wide. */
+#define SSE2_MAX_BOX_WIDTH 256
+
+static void
+box_sum_row_sse2 (const guchar *row,
+                  const int *x_bounds,
+                  int dest_width,
+                  guint32 *sums)
+{
+  const guint32 *pixels = (const guint32 *)row;
+  const __m128i zero = _mm_setzero_si128 ();
+  int dx, x;
+
+  for (dx = 0; dx < dest_width; dx++) {
+    __m128i sum = _mm_setzero_si128 ();
+    __m128i acc;
+
+    x = x_bounds[dx];
+
+    for (; x + 4 <= x_bounds[dx + 1]; x += 4) {
+      __m128i four = _mm_loadu_si128 ((const __m128i *)(pixels + x));
+
+      sum = _mm_add_epi16 (sum, _mm_unpacklo_epi8 (four, zero));
+      sum = _mm_add_epi16 (sum, _mm_unpackhi_epi8 (four, zero));
+    }
+
+    /* Fold the two pixels per register into one. */
+    sum = _mm_add_epi16 (sum, _mm_srli_si128 (sum, 8));
+
+    for (; x < x_bounds[dx + 1]; x++)
+      sum = _mm_add_epi16 (sum, _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (pixels[x]), zero));
+
+    acc = _mm_loadu_si128 ((const __m128i *)sums);
+    acc = _mm_add_epi32 (acc, _mm_unpacklo_epi16 (sum, zero));
+    _mm_storeu_si128 ((__m128i *)sums, acc);
+    sums += 4;
+  }
+}
+#endif
+
+static void
+box_scale (const guchar *src,
+           int src_width,
+           int src_height,
+           int src_stride,
+           gboolean has_alpha,
+           guchar *dest,
+           int dest_width,
+           int dest_height,
+           int dest_stride,
+           BoxSumRowFunc sum_row)
+{
+  guint32 *sums;
+  int *x_bounds;
+  int dx, dy, y;
+
+  g_return_if_fail (dest_width > 0 && dest_width <= src_width);
+  g_return_if_fail (dest_height > 0 && dest_height <= src_height);
+
+  x_bounds = g_new (int, dest_width + 1);
+  for (dx = 0; dx <= dest_width; dx++)
+    x_bounds[dx] = (gint64)dx * src_width / dest_width;
+
+  sums = g_new (guint32, dest_width * 4);
+
+  for (dy = 0; dy < dest_height; dy++) {
+    int y0 = (gint64)dy * src_height / dest_height;
+    int y1 = (gint64)(dy + 1) * src_height / dest_height;
+    guchar *out = dest + dy * dest_stride;
+
+    memset (sums, 0, dest_width * 4 * sizeof (guint32));
+    for (y = y0; y < y1; y++)
+      sum_row (src + y * src_stride, x_bounds, dest_width, sums);
+
+    for (dx = 0; dx < dest_width; dx++) {
+      guint32 count = (x_bounds[dx + 1] - x_bounds[dx]) * (y1 - y0);
+      guint32 *sum = sums + dx * 4;
+      guint32 b = (sum[0] + count / 2) / count;
+      guint32 g = (sum[1] + count / 2) / count;
+      guint32 r = (sum[2] + count / 2) / count;
+      guint32 a = has_alpha ? (sum[3] + count / 2) / count : 0xff;
+
+      if (a == 0) {
+        r = g = b = 0;
+      } else if (a < 0xff) {
+        r = MIN ((r * 0xff + a / 2) / a, 0xff);
+        g = MIN ((g * 0xff + a / 2) / a, 0xff);
+        b = MIN ((b * 0xff + a / 2) / a, 0xff);
+      }
+
+      out[0] = r;
+      out[1] = g;
+      out[2] = b;
+      out[3] = a;
+      out += 4;
+    }
+  }
+
+  g_free (sums);
+  g_free (x_bounds);
+}
+
+static BoxSumRowFunc
+choose_box_sum_row (int src_width,
+                    int dest_width)
+{
+#ifdef __SSE2__
+  if (dest_width > 0 && (src_width + dest_width - 1) / dest_width <= SSE2_MAX_BOX_WIDTH)
+    return box_sum_row_sse2;
+#endif
+
+  return box_sum_row_scalar;
+}
+
+/**
+ * ephy_image_box_scale_argb32:
+ * @src: premultiplied ARGB32 source pixels
+ * @src_width: width of @src
+ * @src_height: height of @src
+ * @src_stride: bytes between rows of @src
+ * @dest: RGBA destination pixels
+ * @dest_width: width of @dest, at most @src_width
+ * @dest_height: height of @dest, at most @src_height
+ * @dest_stride: bytes between rows of @dest
+ *
+ * Downscales @src into @dest, averaging the area covered by each
+ * destination pixel. Uses SSE2 when available.
+ **/
+void
+ephy_image_box_scale_argb32 (const guchar *src,
+                             int src_width,
+                             int src_height,
+                             int src_stride,
+                             guchar *dest,
+                             int dest_width,
+                             int dest_height,
+                             int dest_stride)
+{
+  box_scale (src, src_width, src_height, src_stride, TRUE,
+             dest, dest_width, dest_height, dest_stride,
+             choose_box_sum_row (src_width, dest_width));
+}
+
+/**
+ * ephy_image_box_scale_argb32_scalar:
+ *
+ * Same as ephy_image_box_scale_argb32(), but never vectorized. The
+ * results of both are identical.
+ **/
+void
+ephy_image_box_scale_argb32_scalar (const guchar *src,
+                                    int src_width,
+                                    int src_height,
+                                    int src_stride,
+                                    guchar *dest,
+                                    int dest_width,
+                                    int dest_height,
+                                    int dest_stride)
+{
+  box_scale (src, src_width, src_height, src_stride, TRUE,
+             dest, dest_width, dest_height, dest_stride,
+             box_sum_row_scalar);
+}
+
+/**
+ * ephy_image_scale_surface_area:
+ * @surface: an image surface
+ * @x: left of the area to scale
+ * @y: top of the area to scale
+ * @width: width of the area to scale
+ * @height: height of the area to scale
+ * @dest_width: width of the result
+ * @dest_height: height of the result
+ *
+ * Scales the given area of @surface into a new pixbuf, without an
+ * intermediate copy of the area. Safe to call from any thread as long
+ * as nothing draws on @surface meanwhile.
+ *
+ * Returns: (transfer full): a new #GdkPixbuf with an alpha channel.
+ **/
+GdkPixbuf *
+ephy_image_scale_surface_area (cairo_surface_t *surface,
+                               int x,
+                               int y,
+                               int width,
+                               int height,
+                               int dest_width,
+                               int dest_height)
+{
+  GdkPixbuf *pixbuf, *scaled;
+  cairo_format_t format;
+  const guchar *src;
+  int stride;
+
+  g_return_val_if_fail (cairo_surface_get_type (surface) == CAIRO_SURFACE_TYPE_IMAGE, NULL);
+
+  format = cairo_image_surface_get_format (surface);
+
+  /* Upscaling is rare and cheap, leave it to GdkPixbuf. */
+  if (width < dest_width || height < dest_height ||
+      (format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24)) {
+    pixbuf = gdk_pixbuf_get_from_surface (surface, x, y, width, height);
+    scaled = gdk_pixbuf_scale_simple (pixbuf, dest_width, dest_height, GDK_INTERP_TILES);
+    g_object_unref (pixbuf);
+
+    return scaled;
+  }
+
+  cairo_surface_flush (surface);
+  stride = cairo_image_surface_get_stride (surface);
+  src = cairo_image_surface_get_data (surface) + y * stride + x * 4;
+
+  scaled = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, dest_width, dest_height);
+
+  box_scale (src, width, height, stride, format == CAIRO_FORMAT_ARGB32,
+             gdk_pixbuf_get_pixels (scaled), dest_width, dest_height,
+             gdk_pixbuf_get_rowstride (scaled),
+             choose_box_sum_row (width, dest_width));
+
+  return scaled;
+}
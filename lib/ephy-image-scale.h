@@ -0,0 +1,65 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#if !defined (__EPHY_EPIPHANY_H_INSIDE__) && !defined (EPIPHANY_COMPILATION)
+#error "Only <epiphany/epiphany.h> can be included directly."
+#endif
+
+#ifndef EPHY_IMAGE_SCALE_H
+#define EPHY_IMAGE_SCALE_H
+
+#include <cairo.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/* Area-average downscaling of premultiplied CAIRO_FORMAT_ARGB32 pixels
+ * into unpremultiplied RGBA, the layout of a GdkPixbuf with alpha.
+ * The destination must not be larger than the source. */
+
+void       ephy_image_box_scale_argb32        (const guchar *src,
+                                               int src_width,
+                                               int src_height,
+                                               int src_stride,
+                                               guchar *dest,
+                                               int dest_width,
+                                               int dest_height,
+                                               int dest_stride);
+
+void       ephy_image_box_scale_argb32_scalar (const guchar *src,
+                                               int src_width,
+                                               int src_height,
+                                               int src_stride,
+                                               guchar *dest,
+                                               int dest_width,
+                                               int dest_height,
+                                               int dest_stride);
+
+GdkPixbuf *ephy_image_scale_surface_area      (cairo_surface_t *surface,
+                                               int x,
+                                               int y,
+                                               int width,
+                                               int height,
+                                               int dest_width,
+                                               int dest_height);
+
+G_END_DECLS
+
+#endif /* EPHY_IMAGE_SCALE_H */
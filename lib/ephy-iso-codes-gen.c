@@ -0,0 +1,162 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* Turns the iso-codes XML files into the sorted tables ephy-langs.c
+ * looks names up in, so nothing has to parse XML at runtime:
+ *
+ *   ephy-iso-codes-gen <iso-codes xml dir> > ephy-iso-codes-tables.h
+ */
+
+#include <glib.h>
+#include <libxml/xmlreader.h>
+#include <stdio.h>
+#include <string.h>
+
+static void
+read_iso_639_entry (xmlTextReaderPtr reader,
+                    GHashTable *table)
+{
+  xmlChar *code, *name;
+
+  code = xmlTextReaderGetAttribute (reader, (const xmlChar *)"iso_639_1_code");
+  name = xmlTextReaderGetAttribute (reader, (const xmlChar *)"name");
+
+  /* Get iso-639-2 code */
+  if (code == NULL || code[0] == '\0') {
+    xmlFree (code);
+    code = xmlTextReaderGetAttribute (reader, (const xmlChar *)"iso_639_2T_code");
+  }
+
+  if (code != NULL && code[0] != '\0' && name != NULL && name[0] != '\0')
+    g_hash_table_insert (table, g_strdup ((char *)code), g_strdup ((char *)name));
+
+  xmlFree (code);
+  xmlFree (name);
+}
+
+static void
+read_iso_3166_entry (xmlTextReaderPtr reader,
+                     GHashTable *table)
+{
+  xmlChar *code, *name;
+
+  code = xmlTextReaderGetAttribute (reader, (const xmlChar *)"alpha_2_code");
+  name = xmlTextReaderGetAttribute (reader, (const xmlChar *)"name");
+
+  if (code != NULL && code[0] != '\0' && name != NULL && name[0] != '\0')
+    g_hash_table_insert (table, g_ascii_strdown ((char *)code, -1), g_strdup ((char *)name));
+
+  xmlFree (code);
+  xmlFree (name);
+}
+
+static gboolean
+load_iso_entries (const char *dir,
+                  int iso,
+                  GHashTable *table)
+{
+  xmlTextReaderPtr reader;
+  xmlChar iso_entry[32];
+  char *filename;
+  int ret;
+
+  filename = g_strdup_printf ("%s/iso_%d.xml", dir, iso);
+  reader = xmlNewTextReaderFilename (filename);
+  g_free (filename);
+  if (reader == NULL)
+    return FALSE;
+
+  xmlStrPrintf (iso_entry, sizeof (iso_entry), (const xmlChar *)"iso_%d_entry", iso);
+
+  while ((ret = xmlTextReaderRead (reader)) == 1) {
+    if (xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT ||
+        !xmlStrEqual (xmlTextReaderConstName (reader), iso_entry))
+      continue;
+
+    if (iso == 639)
+      read_iso_639_entry (reader, table);
+    else
+      read_iso_3166_entry (reader, table);
+  }
+
+  xmlFreeTextReader (reader);
+
+  return ret == 0 && g_hash_table_size (table) > 0;
+}
+
+static void
+print_table (const char *prefix,
+             GHashTable *table)
+{
+  GList *codes, *l;
+  guint offset = 0;
+
+  codes = g_list_sort (g_hash_table_get_keys (table), (GCompareFunc)strcmp);
+
+  printf ("static const char %s_names[] =\n", prefix);
+  for (l = codes; l != NULL; l = l->next) {
+    char *escaped = g_strescape (g_hash_table_lookup (table, l->data), NULL);
+
+    printf ("  \"%s\\0\"\n", escaped);
+    g_free (escaped);
+  }
+  printf ("  ;\n\n");
+
+  printf ("static const EphyIsoCode %s_codes[] = {\n", prefix);
+  for (l = codes; l != NULL; l = l->next) {
+    printf ("  { \"%s\", %u },\n", (char *)l->data, offset);
+    offset += strlen (g_hash_table_lookup (table, l->data)) + 1;
+  }
+  printf ("};\n\n");
+
+  g_list_free (codes);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GHashTable *iso_639, *iso_3166;
+  int ret = 0;
+
+  if (argc != 2) {
+    fprintf (stderr, "Usage: %s ISO-CODES-XML-DIR\n", argv[0]);
+    return 1;
+  }
+
+  iso_639 = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  iso_3166 = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  if (!load_iso_entries (argv[1], 639, iso_639) ||
+      !load_iso_entries (argv[1], 3166, iso_3166)) {
+    fprintf (stderr, "Failed to load ISO codes from %s\n", argv[1]);
+    ret = 1;
+    goto out;
+  }
+
+  printf ("/* Generated by ephy-iso-codes-gen, do not edit. */\n\n");
+  print_table ("iso_639", iso_639);
+  print_table ("iso_3166", iso_3166);
+
+out:
+  g_hash_table_destroy (iso_639);
+  g_hash_table_destroy (iso_3166);
+
+  return ret;
+}
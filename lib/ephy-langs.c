@@ -25,10 +25,9 @@
 
 #include <glib/gi18n.h>
 
+#include <stdlib.h>
 #include <string.h>
 
-#include <libxml/xmlreader.h>
-
 /* sanitise the languages list according to the rules for HTTP accept-language
  * in RFC 2616, Sect. 14.4
  */
@@ -171,172 +170,78 @@ ephy_langs_bind_iso_domains (void)
 #endif
 }
 
-static void
-read_iso_639_entry (xmlTextReaderPtr reader,
-		    GHashTable *table)
+typedef struct
 {
-	xmlChar *code, *name;
+	char code[4];
+	guint32 name_offset;
+} EphyIsoCode;
 
-	code = xmlTextReaderGetAttribute (reader, (const xmlChar *) "iso_639_1_code");
-	name = xmlTextReaderGetAttribute (reader, (const xmlChar *) "name");
+/* Generated from the iso-codes XML files at build time, sorted by code. */
+#include "ephy-iso-codes-tables.h"
 
-	/* Get iso-639-2 code */
-	if (code == NULL || code[0] == '\0')
-	{
-		xmlFree (code);
-		/* FIXME: use the 2T or 2B code? */
-		code = xmlTextReaderGetAttribute (reader, (const xmlChar *) "iso_639_2T_code");
-	}
-
-	if (code != NULL && code[0] != '\0' && name != NULL && name[0] != '\0')
-	{
-		g_hash_table_insert (table, code, name);
-	}
-	else
-	{
-		xmlFree (code);
-		xmlFree (name);
-	}
+static int
+compare_iso_code (const void *code,
+		  const void *entry)
+{
+	return strcmp ((const char *) code, ((const EphyIsoCode *) entry)->code);
 }
 
-static void
-read_iso_3166_entry (xmlTextReaderPtr reader,
-		     GHashTable *table)
+static const char *
+lookup_iso_name (const EphyIsoCode *codes,
+		 gsize n_codes,
+		 const char *names,
+		 const char *code)
 {
-	xmlChar *code, *name;
-
-	code = xmlTextReaderGetAttribute (reader, (const xmlChar *) "alpha_2_code");
-	name = xmlTextReaderGetAttribute (reader, (const xmlChar *) "name");
-
-	if (code != NULL && code[0] != '\0' && name != NULL && name[0] != '\0')
-	{
-		char *lcode;
+	const EphyIsoCode *entry;
 
-		lcode = g_ascii_strdown ((char *) code, -1);
-		xmlFree (code);
-
-		g_hash_table_insert (table, lcode, name);
-	}
-	else
-	{
-		xmlFree (code);
-		xmlFree (name);
-	}
+	entry = bsearch (code, codes, n_codes, sizeof (EphyIsoCode), compare_iso_code);
 
+	return entry != NULL ? names + entry->name_offset : NULL;
 }
 
-typedef enum
-{
-	STATE_START,
-	STATE_STOP,
-	STATE_ENTRIES,
-} ParserState;
-
-static void
-load_iso_entries (int iso,
-		  GFunc read_entry_func,
-		  gpointer user_data)
+/**
+ * ephy_langs_iso_639_name:
+ * @code: a lowercase ISO 639-1 code, or ISO 639-2T code for languages
+ * that have none
+ *
+ * Returns: the localized name of the language, or %NULL if @code is
+ * unknown
+ **/
+const char *
+ephy_langs_iso_639_name (const char *code)
 {
-	xmlTextReaderPtr reader;
-	ParserState state = STATE_START;
-	xmlChar iso_entries[32], iso_entry[32];
-	char *filename;
-	int ret = -1;
-
-	LOG ("Loading ISO-%d codes", iso);
-
-	START_PROFILER ("Loading ISO codes")
-
-	filename = g_strdup_printf (ISO_CODES_PREFIX "/share/xml/iso-codes/iso_%d.xml", iso);
-	reader = xmlNewTextReaderFilename (filename);
-	if (reader == NULL) goto out;
-
-	xmlStrPrintf (iso_entries, sizeof (iso_entries), (const xmlChar *)"iso_%d_entries", iso);
-	xmlStrPrintf (iso_entry, sizeof (iso_entry), (const xmlChar *)"iso_%d_entry", iso);
+	const char *name;
 
-	ret = xmlTextReaderRead (reader);
+	g_return_val_if_fail (code != NULL, NULL);
 
-	while (ret == 1)
-	{
-		const xmlChar *tag;
-		xmlReaderTypes type;
-
-		tag = xmlTextReaderConstName (reader);
-		type = xmlTextReaderNodeType (reader);
-
-		if (state == STATE_ENTRIES &&
-		    type == XML_READER_TYPE_ELEMENT &&
-		    xmlStrEqual (tag, iso_entry))
-		{
-			read_entry_func (reader, user_data);
-		}
-		else if (state == STATE_START &&
-			 type == XML_READER_TYPE_ELEMENT &&
-			 xmlStrEqual (tag, iso_entries))
-		{
-			state = STATE_ENTRIES;
-		}
-		else if (state == STATE_ENTRIES &&
-			 type == XML_READER_TYPE_END_ELEMENT &&
-			 xmlStrEqual (tag, iso_entries))
-		{
-			state = STATE_STOP;
-		}
-		else if (type == XML_READER_TYPE_SIGNIFICANT_WHITESPACE ||
-			 type == XML_READER_TYPE_WHITESPACE ||
-			 type == XML_READER_TYPE_TEXT ||
-			 type == XML_READER_TYPE_COMMENT)
-		{
-			/* eat it */
-		}
-		else
-		{
-			/* ignore it */
-		}
+	name = lookup_iso_name (iso_639_codes, G_N_ELEMENTS (iso_639_codes),
+				iso_639_names, code);
+	if (name == NULL) return NULL;
 
-		ret = xmlTextReaderRead (reader);
-	}
-
-	xmlFreeTextReader (reader);
-
-out:
-	if (ret < 0 || state != STATE_STOP)
-	{
-		g_warning ("Failed to load ISO-%d codes from %s!\n",
-			   iso, filename);
-	}
-
-	g_free (filename);
+	ephy_langs_bind_iso_domains ();
 
-	STOP_PROFILER ("Loading ISO codes")
+	return dgettext (ISO_639_DOMAIN, name);
 }
 
-GHashTable *
-ephy_langs_iso_639_table (void)
+/**
+ * ephy_langs_iso_3166_name:
+ * @code: a lowercase ISO 3166 alpha-2 code
+ *
+ * Returns: the localized name of the country, or %NULL if @code is
+ * unknown
+ **/
+const char *
+ephy_langs_iso_3166_name (const char *code)
 {
-	GHashTable *table;
-
-	ephy_langs_bind_iso_domains ();
-	table = g_hash_table_new_full (g_str_hash, g_str_equal,
-				       (GDestroyNotify) xmlFree,
-				       (GDestroyNotify) xmlFree);
+	const char *name;
 
-	load_iso_entries (639, (GFunc) read_iso_639_entry, table);
+	g_return_val_if_fail (code != NULL, NULL);
 
-	return table;
-}
-
-GHashTable *
-ephy_langs_iso_3166_table (void)
-{
-	GHashTable *table;
+	name = lookup_iso_name (iso_3166_codes, G_N_ELEMENTS (iso_3166_codes),
+				iso_3166_names, code);
+	if (name == NULL) return NULL;
 
 	ephy_langs_bind_iso_domains ();
-	table = g_hash_table_new_full (g_str_hash, g_str_equal,
-				       (GDestroyNotify) g_free,
-				       (GDestroyNotify) xmlFree);
-	
-	load_iso_entries (3166, (GFunc) read_iso_3166_entry, table);
 
-	return table;
+	return dgettext (ISO_3166_DOMAIN, name);
 }
@@ -38,9 +38,9 @@ void			     ephy_langs_sanitise	 (GArray *array);
 
 char			   **ephy_langs_get_languages	 (void);
 
-GHashTable		    *ephy_langs_iso_639_table	 (void);
+const char		    *ephy_langs_iso_639_name	 (const char *code);
 
-GHashTable		    *ephy_langs_iso_3166_table   (void);
+const char		    *ephy_langs_iso_3166_name	 (const char *code);
 
 G_END_DECLS
 
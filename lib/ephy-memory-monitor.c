@@ -0,0 +1,295 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-memory-monitor.h"
+
+#include "ephy-debug.h"
+#include "ephy-smaps.h"
+
+#include <string.h>
+
+#define EPHY_MEMORY_MONITOR_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), EPHY_TYPE_MEMORY_MONITOR, EphyMemoryMonitorPrivate))
+
+/* How often the system memory is looked at, in seconds. */
+#define LOW_MEMORY_CHECK_INTERVAL 10
+/* The system is low on memory when less than this percentage of it
+ * is available. */
+#define LOW_MEMORY_PERCENTAGE 5
+
+struct _EphyMemoryMonitorPrivate
+{
+  /* Usage is measured in a thread, see ephy_memory_monitor_get_usage_async(). */
+  GMutex smaps_mutex;
+  EphySMaps *smaps;
+
+  guint check_source_id;
+  guint memory_low : 1;
+};
+
+enum {
+  LOW_MEMORY,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+G_DEFINE_TYPE (EphyMemoryMonitor, ephy_memory_monitor, G_TYPE_OBJECT)
+
+static guint64
+ephy_memory_monitor_real_get_usage (EphyMemoryMonitor *monitor)
+{
+  EphyMemoryMonitorPrivate *priv = monitor->priv;
+  guint64 usage;
+
+  g_mutex_lock (&priv->smaps_mutex);
+
+  if (priv->smaps == NULL)
+    priv->smaps = ephy_smaps_new ();
+
+  usage = ephy_smaps_get_private_memory (priv->smaps);
+
+  g_mutex_unlock (&priv->smaps_mutex);
+
+  return usage;
+}
+
+static gboolean
+ephy_memory_monitor_real_is_memory_low (EphyMemoryMonitor *monitor)
+{
+  char *contents;
+  char **lines;
+  guint64 total = 0, available = 0, free_memory = 0, cached = 0;
+  gboolean has_available = FALSE;
+  guint i;
+
+  if (!g_file_get_contents ("/proc/meminfo", &contents, NULL, NULL))
+    return FALSE;
+
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  for (i = 0; lines[i]; i++) {
+    char *value = strchr (lines[i], ':');
+
+    if (value == NULL)
+      continue;
+    value++;
+
+    if (g_str_has_prefix (lines[i], "MemTotal:"))
+      total = g_ascii_strtoull (value, NULL, 10);
+    else if (g_str_has_prefix (lines[i], "MemAvailable:")) {
+      available = g_ascii_strtoull (value, NULL, 10);
+      has_available = TRUE;
+    } else if (g_str_has_prefix (lines[i], "MemFree:"))
+      free_memory = g_ascii_strtoull (value, NULL, 10);
+    else if (g_str_has_prefix (lines[i], "Cached:"))
+      cached = g_ascii_strtoull (value, NULL, 10);
+  }
+  g_strfreev (lines);
+
+  /* Older kernels don't estimate the available memory. */
+  if (!has_available)
+    available = free_memory + cached;
+
+  return total > 0 && available * 100 < total * LOW_MEMORY_PERCENTAGE;
+}
+
+static gboolean
+check_memory_cb (EphyMemoryMonitor *monitor)
+{
+  EphyMemoryMonitorPrivate *priv = monitor->priv;
+  gboolean memory_low;
+
+  memory_low = EPHY_MEMORY_MONITOR_GET_CLASS (monitor)->is_memory_low (monitor);
+
+  /* Only tell about it once each time memory gets low. */
+  if (memory_low && !priv->memory_low) {
+    LOG ("Running low on memory");
+    g_signal_emit (monitor, signals[LOW_MEMORY], 0);
+  }
+  priv->memory_low = memory_low;
+
+  return TRUE;
+}
+
+static void
+ephy_memory_monitor_init (EphyMemoryMonitor *monitor)
+{
+  monitor->priv = EPHY_MEMORY_MONITOR_GET_PRIVATE (monitor);
+
+  g_mutex_init (&monitor->priv->smaps_mutex);
+
+  monitor->priv->check_source_id =
+    g_timeout_add_seconds (LOW_MEMORY_CHECK_INTERVAL,
+                           (GSourceFunc)check_memory_cb,
+                           monitor);
+}
+
+static void
+ephy_memory_monitor_dispose (GObject *object)
+{
+  EphyMemoryMonitorPrivate *priv = EPHY_MEMORY_MONITOR (object)->priv;
+
+  if (priv->check_source_id) {
+    g_source_remove (priv->check_source_id);
+    priv->check_source_id = 0;
+  }
+
+  g_clear_object (&priv->smaps);
+
+  G_OBJECT_CLASS (ephy_memory_monitor_parent_class)->dispose (object);
+}
+
+static void
+ephy_memory_monitor_finalize (GObject *object)
+{
+  EphyMemoryMonitorPrivate *priv = EPHY_MEMORY_MONITOR (object)->priv;
+
+  g_mutex_clear (&priv->smaps_mutex);
+
+  G_OBJECT_CLASS (ephy_memory_monitor_parent_class)->finalize (object);
+}
+
+static void
+ephy_memory_monitor_class_init (EphyMemoryMonitorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = ephy_memory_monitor_dispose;
+  object_class->finalize = ephy_memory_monitor_finalize;
+
+  klass->get_usage = ephy_memory_monitor_real_get_usage;
+  klass->is_memory_low = ephy_memory_monitor_real_is_memory_low;
+
+  /**
+   * EphyMemoryMonitor::low-memory:
+   * @monitor: the #EphyMemoryMonitor
+   *
+   * Emitted when the system starts running out of memory, so that
+   * whatever can be given back should be.
+   **/
+  signals[LOW_MEMORY] =
+    g_signal_new ("low-memory",
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (EphyMemoryMonitorClass, low_memory),
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE,
+                  0);
+
+  g_type_class_add_private (object_class, sizeof (EphyMemoryMonitorPrivate));
+}
+
+/**
+ * ephy_memory_monitor_new:
+ *
+ * Creates a monitor measuring memory from /proc.
+ *
+ * Returns: (transfer full): a new #EphyMemoryMonitor
+ **/
+EphyMemoryMonitor *
+ephy_memory_monitor_new (void)
+{
+  return EPHY_MEMORY_MONITOR (g_object_new (EPHY_TYPE_MEMORY_MONITOR, NULL));
+}
+
+/**
+ * ephy_memory_monitor_get_usage:
+ * @monitor: an #EphyMemoryMonitor
+ *
+ * Measures the memory used by the browser and its web processes. This
+ * blocks while /proc is read, see ephy_memory_monitor_get_usage_async().
+ *
+ * Returns: the memory in use, in bytes
+ **/
+guint64
+ephy_memory_monitor_get_usage (EphyMemoryMonitor *monitor)
+{
+  g_return_val_if_fail (EPHY_IS_MEMORY_MONITOR (monitor), 0);
+
+  return EPHY_MEMORY_MONITOR_GET_CLASS (monitor)->get_usage (monitor);
+}
+
+static void
+get_usage_thread (GTask *task,
+                  EphyMemoryMonitor *monitor,
+                  gpointer task_data,
+                  GCancellable *cancellable)
+{
+  guint64 *usage;
+
+  usage = g_new (guint64, 1);
+  *usage = EPHY_MEMORY_MONITOR_GET_CLASS (monitor)->get_usage (monitor);
+
+  g_task_return_pointer (task, usage, g_free);
+}
+
+/**
+ * ephy_memory_monitor_get_usage_async:
+ * @monitor: an #EphyMemoryMonitor
+ * @cancellable: (allow-none): a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the usage is known
+ * @user_data: the data to pass to @callback
+ *
+ * Measures the memory used by the browser and its web processes in a
+ * thread, as reading the maps of every process takes a while.
+ **/
+void
+ephy_memory_monitor_get_usage_async (EphyMemoryMonitor *monitor,
+                                     GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
+{
+  GTask *task;
+
+  g_return_if_fail (EPHY_IS_MEMORY_MONITOR (monitor));
+
+  task = g_task_new (monitor, cancellable, callback, user_data);
+  g_task_run_in_thread (task, (GTaskThreadFunc)get_usage_thread);
+  g_object_unref (task);
+}
+
+/**
+ * ephy_memory_monitor_get_usage_finish:
+ * @monitor: an #EphyMemoryMonitor
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns: the memory in use, in bytes, or 0 on error
+ **/
+guint64
+ephy_memory_monitor_get_usage_finish (EphyMemoryMonitor *monitor,
+                                      GAsyncResult *result,
+                                      GError **error)
+{
+  guint64 *usage;
+  guint64 retval = 0;
+
+  g_return_val_if_fail (g_task_is_valid (result, monitor), 0);
+
+  usage = g_task_propagate_pointer (G_TASK (result), error);
+  if (usage) {
+    retval = *usage;
+    g_free (usage);
+  }
+
+  return retval;
+}
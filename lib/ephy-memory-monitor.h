@@ -0,0 +1,77 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef EPHY_MEMORY_MONITOR_H
+#define EPHY_MEMORY_MONITOR_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define EPHY_TYPE_MEMORY_MONITOR            (ephy_memory_monitor_get_type ())
+#define EPHY_MEMORY_MONITOR(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), EPHY_TYPE_MEMORY_MONITOR, EphyMemoryMonitor))
+#define EPHY_MEMORY_MONITOR_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), EPHY_TYPE_MEMORY_MONITOR, EphyMemoryMonitorClass))
+#define EPHY_IS_MEMORY_MONITOR(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EPHY_TYPE_MEMORY_MONITOR))
+#define EPHY_IS_MEMORY_MONITOR_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EPHY_TYPE_MEMORY_MONITOR))
+#define EPHY_MEMORY_MONITOR_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), EPHY_TYPE_MEMORY_MONITOR, EphyMemoryMonitorClass))
+
+typedef struct _EphyMemoryMonitor        EphyMemoryMonitor;
+typedef struct _EphyMemoryMonitorClass   EphyMemoryMonitorClass;
+typedef struct _EphyMemoryMonitorPrivate EphyMemoryMonitorPrivate;
+
+struct _EphyMemoryMonitor
+{
+  GObject parent;
+
+  /*< private >*/
+  EphyMemoryMonitorPrivate *priv;
+};
+
+struct _EphyMemoryMonitorClass
+{
+  GObjectClass parent_class;
+
+  /* Memory used by the browser and its web processes, in bytes. */
+  guint64  (* get_usage)      (EphyMemoryMonitor *monitor);
+  /* Whether the system as a whole is running out of memory. */
+  gboolean (* is_memory_low)  (EphyMemoryMonitor *monitor);
+
+  /* Signals */
+  void     (* low_memory)     (EphyMemoryMonitor *monitor);
+};
+
+GType              ephy_memory_monitor_get_type      (void) G_GNUC_CONST;
+
+EphyMemoryMonitor *ephy_memory_monitor_new           (void);
+
+guint64            ephy_memory_monitor_get_usage     (EphyMemoryMonitor *monitor);
+
+void               ephy_memory_monitor_get_usage_async  (EphyMemoryMonitor  *monitor,
+                                                         GCancellable       *cancellable,
+                                                         GAsyncReadyCallback callback,
+                                                         gpointer            user_data);
+
+guint64            ephy_memory_monitor_get_usage_finish (EphyMemoryMonitor  *monitor,
+                                                         GAsyncResult       *result,
+                                                         GError            **error);
+
+G_END_DECLS
+
+#endif /* EPHY_MEMORY_MONITOR_H */
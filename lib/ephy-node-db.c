@@ -28,6 +28,7 @@
 #include <libxml/xmlreader.h>
 #include <libxml/xmlwriter.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
@@ -43,6 +44,8 @@ enum
 
 #define EPHY_NODE_DB_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), EPHY_TYPE_NODE_DB, EphyNodeDbPrivate))
 
+typedef struct _StringPool StringPool;
+
 struct _EphyNodeDbPrivate
 {
 	char *name;
@@ -51,10 +54,52 @@ struct _EphyNodeDbPrivate
 	guint id_factory;
 
 	GPtrArray *id_to_node;
+
+	StringPool *strings;
+	guint64 interned_properties;
 };
 
+/* The pool is refcounted, and every string in it holds a reference, so
+ * that nodes outliving their db can still release their strings. */
+struct _StringPool
+{
+	guint ref_count;
+	/* string -> InternedString, shared by all nodes in the db */
+	GHashTable *table;
+};
+
+typedef struct
+{
+	guint ref_count;
+	StringPool *pool;
+	char str[1];
+} InternedString;
+
 static GObjectClass *parent_class = NULL;
 
+static StringPool *
+string_pool_new (void)
+{
+	StringPool *pool;
+
+	pool = g_slice_new (StringPool);
+	pool->ref_count = 1;
+	pool->table = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     NULL, g_free);
+
+	return pool;
+}
+
+static void
+string_pool_unref (StringPool *pool)
+{
+	if (--pool->ref_count > 0)
+		return;
+
+	g_hash_table_destroy (pool->table);
+	g_slice_free (StringPool, pool);
+}
+
 static void
 ephy_node_db_get_property (GObject *object,
                            guint prop_id,
@@ -110,6 +155,9 @@ ephy_node_db_init (EphyNodeDb *db)
 
 	/* id factory */
 	db->priv->id_factory = RESERVED_IDS;
+
+	/* string pool */
+	db->priv->strings = string_pool_new ();
 }
 
 static void
@@ -119,6 +167,9 @@ ephy_node_db_finalize (GObject *object)
 
 	g_ptr_array_free (db->priv->id_to_node, TRUE);
 
+	/* nodes still alive keep the pool alive through their strings */
+	string_pool_unref (db->priv->strings);
+
 	g_free (db->priv->name);
 
 	G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -253,6 +304,80 @@ _ephy_node_db_remove_id (EphyNodeDb *db,
 	db->priv->id_factory = RESERVED_IDS;
 }
 
+/**
+ * ephy_node_db_set_interned_property:
+ * @db: an #EphyNodeDb
+ * @property_id: the id of a string property
+ *
+ * Makes string values of @property_id be stored in a string pool shared by
+ * all the nodes of @db, instead of a private copy per node. This is useful
+ * for properties whose values repeat a lot, like icon addresses. It only
+ * affects values set after this call, so it should be called before the
+ * db is loaded.
+ **/
+void
+ephy_node_db_set_interned_property (EphyNodeDb *db,
+				    guint property_id)
+{
+	g_return_if_fail (EPHY_IS_NODE_DB (db));
+	g_return_if_fail (property_id < 64);
+
+	db->priv->interned_properties |= G_GUINT64_CONSTANT (1) << property_id;
+}
+
+gboolean
+_ephy_node_db_is_property_interned (EphyNodeDb *db,
+				    guint property_id)
+{
+	if (property_id >= 64)
+		return FALSE;
+
+	return (db->priv->interned_properties & (G_GUINT64_CONSTANT (1) << property_id)) != 0;
+}
+
+const char *
+_ephy_node_db_intern_string (EphyNodeDb *db,
+			     const char *string)
+{
+	InternedString *interned;
+	gsize len;
+
+	interned = g_hash_table_lookup (db->priv->strings->table, string);
+	if (interned != NULL)
+	{
+		interned->ref_count++;
+		return interned->str;
+	}
+
+	len = strlen (string);
+	interned = g_malloc (G_STRUCT_OFFSET (InternedString, str) + len + 1);
+	interned->ref_count = 1;
+	interned->pool = db->priv->strings;
+	interned->pool->ref_count++;
+	memcpy (interned->str, string, len + 1);
+
+	g_hash_table_insert (interned->pool->table, interned->str, interned);
+
+	return interned->str;
+}
+
+/* Does not touch the db, which may be gone already. */
+void
+_ephy_node_db_release_string (const char *string)
+{
+	InternedString *interned;
+	StringPool *pool;
+
+	interned = (InternedString *)(string - G_STRUCT_OFFSET (InternedString, str));
+
+	if (--interned->ref_count > 0)
+		return;
+
+	pool = interned->pool;
+	g_hash_table_remove (pool->table, string);
+	string_pool_unref (pool);
+}
+
 /**
  * ephy_node_db_load_from_file:
  * @db: a new #EphyNodeDb
@@ -283,8 +408,6 @@ ephy_node_db_load_from_file (EphyNodeDb *db,
 
 	LOG ("ephy_node_db_load_from_file %s", xml_file);
 
-	START_PROFILER ("loading node db")
-
 	if (g_file_test (xml_file, G_FILE_TEST_EXISTS) == FALSE)
 	{
 		return FALSE;
@@ -296,6 +419,8 @@ ephy_node_db_load_from_file (EphyNodeDb *db,
 		return FALSE;
 	}
 
+	ephy_trace_begin ("Loading node db");
+
 	was_immutable = db->priv->immutable;
 	db->priv->immutable = FALSE;
 
@@ -351,7 +476,7 @@ ephy_node_db_load_from_file (EphyNodeDb *db,
 
 	db->priv->immutable = was_immutable;
 
-	STOP_PROFILER ("loading node db")
+	ephy_trace_end ("Loading node db");
 
 	return (success && ret == 0);
 }
@@ -369,8 +494,6 @@ ephy_node_db_write_to_xml_valist (EphyNodeDb *db,
 	EphyNode *node;
 	int ret;
 
-	START_PROFILER ("Saving node db")
-
 	/* FIXME: do we want to turn compression on ? */
 	writer = xmlNewTextWriterMemory (buffer, 0);
 	if (writer == NULL)
@@ -378,6 +501,8 @@ ephy_node_db_write_to_xml_valist (EphyNodeDb *db,
 		return -1;
 	}
 
+	ephy_trace_begin ("Saving node db");
+
 	ret = xmlTextWriterSetIndent (writer, 1);
 	if (ret < 0) goto out;
 
@@ -438,7 +563,7 @@ ephy_node_db_write_to_xml_valist (EphyNodeDb *db,
 out:
 	xmlFreeTextWriter (writer);
 
-	STOP_PROFILER ("Saving node db")
+	ephy_trace_end ("Saving node db");
 
 	return ret >= 0 ? 0 : -1;
 }
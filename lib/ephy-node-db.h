@@ -82,6 +82,9 @@ void	      ephy_node_db_set_immutable	(EphyNodeDb *db,
 EphyNode     *ephy_node_db_get_node_from_id	(EphyNodeDb *db,
 						 guint id);
 
+void	      ephy_node_db_set_interned_property (EphyNodeDb *db,
+						 guint property_id);
+
 guint	      _ephy_node_db_new_id		(EphyNodeDb *db);
 
 void	      _ephy_node_db_add_id		(EphyNodeDb *db,
@@ -91,6 +94,14 @@ void	      _ephy_node_db_add_id		(EphyNodeDb *db,
 void	      _ephy_node_db_remove_id		(EphyNodeDb *db,
 						 guint id);
 
+gboolean      _ephy_node_db_is_property_interned (EphyNodeDb *db,
+						 guint property_id);
+
+const char   *_ephy_node_db_intern_string	(EphyNodeDb *db,
+						 const char *string);
+
+void	      _ephy_node_db_release_string	(const char *string);
+
 G_END_DECLS
 
 #endif /* __EPHY_NODE_DB_H */
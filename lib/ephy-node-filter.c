@@ -43,6 +43,11 @@ enum
 struct _EphyNodeFilterPrivate
 {
 	GPtrArray *levels;
+
+	/* the expressions before ephy_node_filter_empty(), to tell in
+	 * ephy_node_filter_done_changing() how the filter changed */
+	GPtrArray *old_levels;
+	EphyNodeFilterChange change;
 };
 
 struct _EphyNodeFilterExpression
@@ -133,14 +138,31 @@ ephy_node_filter_init (EphyNodeFilter *filter)
 	filter->priv->levels = g_ptr_array_new ();
 }
 
+static void
+free_levels (GPtrArray *levels)
+{
+	int i;
+
+	if (levels == NULL)
+		return;
+
+	for (i = 0; i < levels->len; i++)
+	{
+		GList *list = g_ptr_array_index (levels, i);
+
+		g_list_free_full (list, (GDestroyNotify) ephy_node_filter_expression_free);
+	}
+
+	g_ptr_array_free (levels, TRUE);
+}
+
 static void
 ephy_node_filter_finalize (GObject *object)
 {
 	EphyNodeFilter *filter = EPHY_NODE_FILTER (object);
 
-	ephy_node_filter_empty (filter);
-
-	g_ptr_array_free (filter->priv->levels, TRUE);
+	free_levels (filter->priv->levels);
+	free_levels (filter->priv->old_levels);
 
 	G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -167,35 +189,156 @@ ephy_node_filter_add_expression (EphyNodeFilter *filter,
 void
 ephy_node_filter_empty (EphyNodeFilter *filter)
 {
-	int i;
-	
-	for (i = filter->priv->levels->len - 1; i >= 0; i--)
+	/* keep the first expressions if the filter is emptied
+	 * several times before it is done changing */
+	if (filter->priv->old_levels == NULL)
 	{
-		GList *list, *l;
+		filter->priv->old_levels = filter->priv->levels;
+	}
+	else
+	{
+		free_levels (filter->priv->levels);
+	}
 
-		list = g_ptr_array_index (filter->priv->levels, i);
+	filter->priv->levels = g_ptr_array_new ();
+}
 
-		for (l = list; l != NULL; l = g_list_next (l))
-		{
-			EphyNodeFilterExpression *exp;
+static gboolean
+expressions_compare (EphyNodeFilterExpression *old_exp,
+		     EphyNodeFilterExpression *new_exp,
+		     gboolean *narrowed,
+		     gboolean *widened)
+{
+	if (old_exp->type != new_exp->type)
+		return FALSE;
+
+	switch (new_exp->type)
+	{
+	case EPHY_NODE_FILTER_EXPRESSION_ALWAYS_TRUE:
+		return TRUE;
+	case EPHY_NODE_FILTER_EXPRESSION_NODE_EQUALS:
+	case EPHY_NODE_FILTER_EXPRESSION_EQUALS:
+	case EPHY_NODE_FILTER_EXPRESSION_HAS_PARENT:
+	case EPHY_NODE_FILTER_EXPRESSION_HAS_CHILD:
+		return old_exp->args.node_args.a == new_exp->args.node_args.a &&
+		       old_exp->args.node_args.b == new_exp->args.node_args.b;
+	case EPHY_NODE_FILTER_EXPRESSION_NODE_PROP_EQUALS:
+	case EPHY_NODE_FILTER_EXPRESSION_CHILD_PROP_EQUALS:
+		return old_exp->args.prop_args.prop_id == new_exp->args.prop_args.prop_id &&
+		       old_exp->args.prop_args.second_arg.node == new_exp->args.prop_args.second_arg.node;
+	case EPHY_NODE_FILTER_EXPRESSION_STRING_PROP_CONTAINS:
+	{
+		const char *old_string = old_exp->args.prop_args.second_arg.string;
+		const char *new_string = new_exp->args.prop_args.second_arg.string;
 
-			exp = (EphyNodeFilterExpression *) l->data;
+		if (old_exp->args.prop_args.prop_id != new_exp->args.prop_args.prop_id)
+			return FALSE;
+
+		if (strcmp (old_string, new_string) == 0)
+			return TRUE;
 
-			ephy_node_filter_expression_free (exp);
+		/* whatever contains the longer string contains the shorter */
+		if (strstr (new_string, old_string) != NULL)
+		{
+			*widened = FALSE;
+			return TRUE;
+		}
+		if (strstr (old_string, new_string) != NULL)
+		{
+			*narrowed = FALSE;
+			return TRUE;
 		}
 
-		g_list_free (list);
+		return FALSE;
+	}
+	case EPHY_NODE_FILTER_EXPRESSION_STRING_PROP_EQUALS:
+	case EPHY_NODE_FILTER_EXPRESSION_KEY_PROP_CONTAINS:
+	case EPHY_NODE_FILTER_EXPRESSION_KEY_PROP_EQUALS:
+		return old_exp->args.prop_args.prop_id == new_exp->args.prop_args.prop_id &&
+		       strcmp (old_exp->args.prop_args.second_arg.string,
+			       new_exp->args.prop_args.second_arg.string) == 0;
+	case EPHY_NODE_FILTER_EXPRESSION_INT_PROP_EQUALS:
+	case EPHY_NODE_FILTER_EXPRESSION_INT_PROP_BIGGER_THAN:
+	case EPHY_NODE_FILTER_EXPRESSION_INT_PROP_LESS_THAN:
+		return old_exp->args.prop_args.prop_id == new_exp->args.prop_args.prop_id &&
+		       old_exp->args.prop_args.second_arg.number == new_exp->args.prop_args.second_arg.number;
+	default:
+		break;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Expressions are ORed within a level and levels are ANDed, so when
+ * every expression matches a subset (superset) of what it matched
+ * before, so does the whole filter.
+ */
+static EphyNodeFilterChange
+levels_compare (GPtrArray *old_levels,
+		GPtrArray *new_levels)
+{
+	gboolean narrowed = TRUE, widened = TRUE;
+	int i;
+
+	if (old_levels == NULL || old_levels->len != new_levels->len)
+		return EPHY_NODE_FILTER_CHANGE_ANY;
+
+	for (i = 0; i < new_levels->len; i++)
+	{
+		GList *o, *n;
+
+		o = g_ptr_array_index (old_levels, i);
+		n = g_ptr_array_index (new_levels, i);
+
+		for (; o != NULL && n != NULL; o = o->next, n = n->next)
+		{
+			if (!expressions_compare (o->data, n->data, &narrowed, &widened))
+				return EPHY_NODE_FILTER_CHANGE_ANY;
+		}
 
-		g_ptr_array_remove_index (filter->priv->levels, i);
+		if (o != NULL || n != NULL)
+			return EPHY_NODE_FILTER_CHANGE_ANY;
 	}
+
+	/* an unchanged filter is refiltered in full, as it always was */
+	if (narrowed == widened)
+		return EPHY_NODE_FILTER_CHANGE_ANY;
+
+	return narrowed ? EPHY_NODE_FILTER_CHANGE_NARROWED : EPHY_NODE_FILTER_CHANGE_WIDENED;
 }
 
 void
 ephy_node_filter_done_changing (EphyNodeFilter *filter)
 {
+	filter->priv->change = levels_compare (filter->priv->old_levels,
+					       filter->priv->levels);
+
+	free_levels (filter->priv->old_levels);
+	filter->priv->old_levels = NULL;
+
 	g_signal_emit (G_OBJECT (filter), ephy_node_filter_signals[CHANGED], 0);
 }
 
+/**
+ * ephy_node_filter_get_change:
+ * @filter: an #EphyNodeFilter
+ *
+ * Tells how the filter changed the last time it was done changing, so
+ * that only the nodes whose result may differ need to be evaluated
+ * again: the ones it accepted if it was narrowed, the ones it rejected
+ * if it was widened.
+ *
+ * Return value: the last #EphyNodeFilterChange
+ **/
+EphyNodeFilterChange
+ephy_node_filter_get_change (EphyNodeFilter *filter)
+{
+	g_return_val_if_fail (EPHY_IS_NODE_FILTER (filter), EPHY_NODE_FILTER_CHANGE_ANY);
+
+	return filter->priv->change;
+}
+
 /*
  * We go through each level evaluating the filter expressions. 
  * Every time we get a match we immediately do a break and jump
@@ -359,38 +502,26 @@ ephy_node_filter_expression_evaluate (EphyNodeFilterExpression *exp,
 	}
 	case EPHY_NODE_FILTER_EXPRESSION_STRING_PROP_CONTAINS:
 	{
-		const char *prop;
-		char *folded_case;
-		gboolean ret;
+		const char *folded_case;
 
-		prop = ephy_node_get_property_string (node,
-						    exp->args.prop_args.prop_id);
-		if (prop == NULL)
+		/* folded once per property change, not once per evaluation */
+		folded_case = ephy_node_get_property_folded_string (node,
+								    exp->args.prop_args.prop_id);
+		if (folded_case == NULL)
 			return FALSE;
 
-		folded_case = g_utf8_casefold (prop, -1);
-		ret = (strstr (folded_case, exp->args.prop_args.second_arg.string) != NULL);
-		g_free (folded_case);
-
-		return ret;
+		return (strstr (folded_case, exp->args.prop_args.second_arg.string) != NULL);
 	}
 	case EPHY_NODE_FILTER_EXPRESSION_STRING_PROP_EQUALS:
 	{
-		const char *prop;
-		char *folded_case;
-		gboolean ret;
+		const char *folded_case;
 
-		prop = ephy_node_get_property_string (node,
-						    exp->args.prop_args.prop_id);
-
-		if (prop == NULL)
+		folded_case = ephy_node_get_property_folded_string (node,
+								    exp->args.prop_args.prop_id);
+		if (folded_case == NULL)
 			return FALSE;
 
-		folded_case = g_utf8_casefold (prop, -1);
-		ret = (strcmp (folded_case, exp->args.prop_args.second_arg.string) == 0);
-		g_free (folded_case);
-
-		return ret;
+		return (strcmp (folded_case, exp->args.prop_args.second_arg.string) == 0);
 	}
 	case EPHY_NODE_FILTER_EXPRESSION_KEY_PROP_CONTAINS:
 	{
@@ -75,6 +75,13 @@ typedef enum
 
 typedef struct _EphyNodeFilterExpression EphyNodeFilterExpression;
 
+typedef enum
+{
+	EPHY_NODE_FILTER_CHANGE_ANY,      /* any node may have a different result */
+	EPHY_NODE_FILTER_CHANGE_NARROWED, /* only nodes that matched may not anymore */
+	EPHY_NODE_FILTER_CHANGE_WIDENED   /* only nodes that did not match may now */
+} EphyNodeFilterChange;
+
 /* The filter starts iterating over all expressions at level 0,
  * if one of them is TRUE it continues to level 1, etc.
  * If it still has TRUE when there are no more expressions at the
@@ -93,6 +100,8 @@ void            ephy_node_filter_empty          (EphyNodeFilter *filter);
 
 void            ephy_node_filter_done_changing  (EphyNodeFilter *filter);
 
+EphyNodeFilterChange ephy_node_filter_get_change (EphyNodeFilter *filter);
+
 gboolean        ephy_node_filter_evaluate       (EphyNodeFilter *filter,
 					         EphyNode *node);
 
@@ -53,14 +53,62 @@ typedef struct
 	guint property_id;
 } EphyNodeChange;
 
+typedef enum
+{
+	EPHY_NODE_PROPERTY_UNSET,
+	EPHY_NODE_PROPERTY_STRING,
+	EPHY_NODE_PROPERTY_INTERNED_STRING,
+	EPHY_NODE_PROPERTY_BOOLEAN,
+	EPHY_NODE_PROPERTY_INT,
+	EPHY_NODE_PROPERTY_LONG,
+	EPHY_NODE_PROPERTY_FLOAT,
+	EPHY_NODE_PROPERTY_DOUBLE,
+	EPHY_NODE_PROPERTY_POINTER
+} EphyNodePropertyType;
+
+/* A property is stored by value in a small array sorted by id, instead of
+ * a separately allocated GValue per slot. Interned strings are owned by the
+ * EphyNodeDb string pool.
+ *
+ * Collation keys and case folded copies of string properties are cached in
+ * the same array, under the property id with one of the flags below set.
+ * They are never saved and are dropped whenever the property they were
+ * computed from changes.
+ */
+#define MAX_PROPERTY_ID    0x3fff
+#define COLLATE_KEY_FLAG   0x4000
+#define CASEFOLD_KEY_FLAG  0x8000
+#define FOLDED_STRING_FLAG 0xc000
+
+typedef struct
+{
+	guint16 id;
+	guint8 type;
+	union
+	{
+		char *v_string;
+		gboolean v_boolean;
+		int v_int;
+		long v_long;
+		float v_float;
+		double v_double;
+		gpointer v_pointer;
+	} data;
+} EphyNodeProperty;
+
 struct _EphyNode
 {
 	int ref_count;
 
 	guint id;
 
-	GPtrArray *properties;
+	EphyNodeProperty *properties;
+	guint16 n_properties;
 
+	guint is_drag_source : 1;
+	guint is_drag_dest : 1;
+
+	/* created on demand, most nodes never get parents or signals */
 	GHashTable *parents;
 	GPtrArray *children;
 
@@ -68,8 +116,6 @@ struct _EphyNode
 	int signal_id;
 	guint emissions;
 	guint invalidated_signals;
-	guint is_drag_source : 1;
-	guint is_drag_dest : 1;
 
 	EphyNodeDb *db;
 };
@@ -93,6 +139,17 @@ int_hash (gconstpointer a)
 	return GPOINTER_TO_INT (a);
 }
 
+static inline EphyNodeParent *
+lookup_parent_info (EphyNode *child,
+		    EphyNode *parent)
+{
+	if (child->parents == NULL)
+		return NULL;
+
+	return g_hash_table_lookup (child->parents,
+				    GINT_TO_POINTER (parent->id));
+}
+
 static void
 callback (long id, EphyNodeSignalData *data, gpointer *dummy)
 {
@@ -179,6 +236,8 @@ ephy_node_emit_signal (EphyNode *node, EphyNodeSignalType type, ...)
 {
 	ENESCData data;
 
+	if (node->signals == NULL) return;
+
 	++node->emissions;
 
 	va_start (data.valist, type);
@@ -213,8 +272,7 @@ real_remove_child (EphyNode *node,
 {
 	EphyNodeParent *node_info;
 
-	node_info = g_hash_table_lookup (child->parents,
-			                 GINT_TO_POINTER (node->id));
+	node_info = lookup_parent_info (child, node);
 
 	if (remove_from_parent) {
 		guint i;
@@ -233,15 +291,14 @@ real_remove_child (EphyNode *node,
 			borked_node = g_ptr_array_index (node->children, i);
 
 
-			borked_node_info = g_hash_table_lookup (borked_node->parents,
-						                GINT_TO_POINTER (node->id));
+			borked_node_info = lookup_parent_info (borked_node, node);
 			borked_node_info->index--;
 		}
 
 		ephy_node_emit_signal (node, EPHY_NODE_CHILD_REMOVED, child, old_index);
 	}
 
-	if (remove_from_child) {
+	if (remove_from_child && child->parents != NULL) {
 		g_hash_table_remove (child->parents,
 				     GINT_TO_POINTER (node->id));
 	}
@@ -276,6 +333,25 @@ destroy_signal_data (EphyNodeSignalData *signal_data)
         g_slice_free (EphyNodeSignalData, signal_data);
 }
 
+static inline void
+property_clear (EphyNode *node,
+		EphyNodeProperty *prop)
+{
+	switch (prop->type)
+	{
+	case EPHY_NODE_PROPERTY_STRING:
+		g_free (prop->data.v_string);
+		break;
+	case EPHY_NODE_PROPERTY_INTERNED_STRING:
+		_ephy_node_db_release_string (prop->data.v_string);
+		break;
+	default:
+		break;
+	}
+
+	prop->type = EPHY_NODE_PROPERTY_UNSET;
+}
+
 static void
 node_parent_free (EphyNodeParent *parent)
 {
@@ -290,10 +366,12 @@ ephy_node_destroy (EphyNode *node)
 	ephy_node_emit_signal (node, EPHY_NODE_DESTROY);
 
         /* Remove from parents. */
-	g_hash_table_foreach (node->parents,
-			      (GHFunc) remove_child,
-			      node);
-	g_hash_table_destroy (node->parents);
+	if (node->parents != NULL) {
+		g_hash_table_foreach (node->parents,
+				      (GHFunc) remove_child,
+				      node);
+		g_hash_table_destroy (node->parents);
+	}
 
         /* Remove children. */
 	for (i = 0; i < node->children->len; i++) {
@@ -306,23 +384,17 @@ ephy_node_destroy (EphyNode *node)
 	g_ptr_array_free (node->children, TRUE);
         
         /* Remove signals. */
-	g_hash_table_destroy (node->signals);
-
-        /* Remove id. */
-	_ephy_node_db_remove_id (node->db, node->id);
+	if (node->signals != NULL)
+		g_hash_table_destroy (node->signals);
 
         /* Remove properties. */
-	for (i = 0; i < node->properties->len; i++) {
-		GValue *val;
-
-		val = g_ptr_array_index (node->properties, i);
-
-		if (val != NULL) {
-			g_value_unset (val);
-			g_slice_free (GValue, val);
-		}
+	for (i = 0; i < node->n_properties; i++) {
+		property_clear (node, &node->properties[i]);
 	}
-	g_ptr_array_free (node->properties, TRUE);
+	g_free (node->properties);
+
+        /* Remove id. */
+	_ephy_node_db_remove_id (node->db, node->id);
 
 	g_slice_free (EphyNode, node);
 }
@@ -358,16 +430,13 @@ ephy_node_new_with_id (EphyNodeDb *db, guint reserved_id)
 
 	node->db = db;
 
-	node->properties = g_ptr_array_new ();
+	node->properties = NULL;
+	node->n_properties = 0;
 
 	node->children = g_ptr_array_new ();
 
-	node->parents = g_hash_table_new_full
-          (int_hash, int_equal, NULL, (GDestroyNotify) node_parent_free);
-
-	node->signals = g_hash_table_new_full
-          (int_hash, int_equal, NULL,
-           (GDestroyNotify)destroy_signal_data);
+	node->parents = NULL;
+	node->signals = NULL;
 
 	node->signal_id = 0;
 	node->emissions = 0;
@@ -434,43 +503,187 @@ child_changed (guint id,
 			       change->node, change->property_id);
 }
 
-static inline void
+static inline EphyNodeProperty *
+lookup_property (EphyNode *node,
+		 guint property_id)
+{
+	guint i;
+
+	/* properties are few and kept sorted by id, a linear scan
+	 * beats anything fancier here */
+	for (i = 0; i < node->n_properties; i++) {
+		EphyNodeProperty *prop = &node->properties[i];
+
+		if (prop->id == property_id)
+			return prop;
+		if (prop->id > property_id)
+			break;
+	}
+
+	return NULL;
+}
+
+static void
+remove_property (EphyNode *node,
+		 guint property_id)
+{
+	EphyNodeProperty *prop;
+	guint i;
+
+	prop = lookup_property (node, property_id);
+	if (prop == NULL)
+		return;
+
+	property_clear (node, prop);
+
+	i = prop - node->properties;
+	memmove (prop, prop + 1,
+		 (node->n_properties - i - 1) * sizeof (EphyNodeProperty));
+	node->n_properties--;
+}
+
+static EphyNodeProperty *
+ensure_property (EphyNode *node,
+		 guint property_id)
+{
+	EphyNodeProperty *prop;
+	guint i;
+
+	/* the cached keys are stale now */
+	if (property_id <= MAX_PROPERTY_ID) {
+		remove_property (node, property_id | COLLATE_KEY_FLAG);
+		remove_property (node, property_id | CASEFOLD_KEY_FLAG);
+		remove_property (node, property_id | FOLDED_STRING_FLAG);
+	}
+
+	prop = lookup_property (node, property_id);
+	if (prop != NULL) {
+		property_clear (node, prop);
+		return prop;
+	}
+
+	for (i = 0; i < node->n_properties; i++) {
+		if (node->properties[i].id > property_id)
+			break;
+	}
+
+	node->properties = g_renew (EphyNodeProperty, node->properties,
+				    node->n_properties + 1);
+	memmove (&node->properties[i + 1], &node->properties[i],
+		 (node->n_properties - i) * sizeof (EphyNodeProperty));
+	node->n_properties++;
+
+	prop = &node->properties[i];
+	prop->id = property_id;
+	prop->type = EPHY_NODE_PROPERTY_UNSET;
+
+	return prop;
+}
+
+static void
+real_set_property_string (EphyNode *node,
+			  guint property_id,
+			  const char *value)
+{
+	EphyNodeProperty *prop;
+	EphyNodePropertyType type;
+	char *copy;
+
+	/* copy before clearing the old value, @value may point into it */
+	if (value != NULL &&
+	    _ephy_node_db_is_property_interned (node->db, property_id)) {
+		type = EPHY_NODE_PROPERTY_INTERNED_STRING;
+		copy = (char *)_ephy_node_db_intern_string (node->db, value);
+	} else {
+		type = EPHY_NODE_PROPERTY_STRING;
+		copy = g_strdup (value);
+	}
+
+	prop = ensure_property (node, property_id);
+	prop->type = type;
+	prop->data.v_string = copy;
+}
+
+static gboolean
 real_set_property (EphyNode *node,
 		   guint property_id,
-		   GValue *value)
+		   const GValue *value)
 {
-	GValue *old;
+	EphyNodeProperty *prop;
 
-	if (property_id >= node->properties->len) {
-		g_ptr_array_set_size (node->properties, property_id + 1);
-	}
+	g_return_val_if_fail (property_id <= MAX_PROPERTY_ID, FALSE);
 
-	old = g_ptr_array_index (node->properties, property_id);
-	if (old != NULL) {
-		g_value_unset (old);
-		g_slice_free (GValue, old);
+	switch (G_VALUE_TYPE (value))
+	{
+	case G_TYPE_STRING:
+		real_set_property_string (node, property_id,
+					  g_value_get_string (value));
+		break;
+	case G_TYPE_BOOLEAN:
+		prop = ensure_property (node, property_id);
+		prop->type = EPHY_NODE_PROPERTY_BOOLEAN;
+		prop->data.v_boolean = g_value_get_boolean (value);
+		break;
+	case G_TYPE_INT:
+		prop = ensure_property (node, property_id);
+		prop->type = EPHY_NODE_PROPERTY_INT;
+		prop->data.v_int = g_value_get_int (value);
+		break;
+	case G_TYPE_LONG:
+		prop = ensure_property (node, property_id);
+		prop->type = EPHY_NODE_PROPERTY_LONG;
+		prop->data.v_long = g_value_get_long (value);
+		break;
+	case G_TYPE_FLOAT:
+		prop = ensure_property (node, property_id);
+		prop->type = EPHY_NODE_PROPERTY_FLOAT;
+		prop->data.v_float = g_value_get_float (value);
+		break;
+	case G_TYPE_DOUBLE:
+		prop = ensure_property (node, property_id);
+		prop->type = EPHY_NODE_PROPERTY_DOUBLE;
+		prop->data.v_double = g_value_get_double (value);
+		break;
+	case G_TYPE_POINTER:
+		prop = ensure_property (node, property_id);
+		prop->type = EPHY_NODE_PROPERTY_POINTER;
+		prop->data.v_pointer = g_value_get_pointer (value);
+		break;
+	default:
+		g_warning ("Unsupported EphyNode property type %s",
+			   g_type_name (G_VALUE_TYPE (value)));
+		return FALSE;
 	}
 
-	g_ptr_array_index (node->properties, property_id) = value;
+	return TRUE;
 }
 
 static inline void
-ephy_node_set_property_internal (EphyNode *node,
-		        	 guint property_id,
-		        	 GValue *value)
+ephy_node_property_changed (EphyNode *node,
+			    guint property_id)
 {
 	EphyNodeChange change;
 
-	real_set_property (node, property_id, value);
+	if (node->parents != NULL) {
+		change.node = node;
+		change.property_id = property_id;
+		g_hash_table_foreach (node->parents,
+				      (GHFunc) child_changed,
+				      &change);
+	}
 
-	change.node = node;
-	change.property_id = property_id;
-	g_hash_table_foreach (node->parents,
-			      (GHFunc) child_changed,
-			      &change);
-    
 	ephy_node_emit_signal (node, EPHY_NODE_CHANGED, property_id);
+}
+
+static inline EphyNodeProperty *
+ephy_node_prepare_set (EphyNode *node,
+		       guint property_id)
+{
+	if (ephy_node_db_is_immutable (node->db)) return NULL;
+
+	g_return_val_if_fail (property_id <= MAX_PROPERTY_ID, NULL);
 
+	return ensure_property (node, property_id);
 }
 
 void
@@ -478,18 +691,13 @@ ephy_node_set_property (EphyNode *node,
 		        guint property_id,
 		        const GValue *value)
 {
-	GValue *new;
-
 	g_return_if_fail (EPHY_IS_NODE (node));
 	g_return_if_fail (value != NULL);
 
 	if (ephy_node_db_is_immutable (node->db)) return;
 
-	new = g_slice_new0 (GValue);
-	g_value_init (new, G_VALUE_TYPE (value));
-	g_value_copy (value, new);
-
-	ephy_node_set_property_internal (node, property_id, new);
+	if (real_set_property (node, property_id, value))
+		ephy_node_property_changed (node, property_id);
 }
 
 /**
@@ -502,23 +710,51 @@ ephy_node_get_property (EphyNode *node,
 		        guint property_id,
 		        GValue *value)
 {
-	GValue *ret;
+	EphyNodeProperty *prop;
 
 	g_return_val_if_fail (EPHY_IS_NODE (node), FALSE);
 	g_return_val_if_fail (value != NULL, FALSE);
 
-	if (property_id >= node->properties->len) {
+	prop = lookup_property (node, property_id);
+	if (prop == NULL) {
 		return FALSE;
 	}
 
-	ret = g_ptr_array_index (node->properties, property_id);
-	if (ret == NULL) {
+	switch (prop->type)
+	{
+	case EPHY_NODE_PROPERTY_STRING:
+	case EPHY_NODE_PROPERTY_INTERNED_STRING:
+		g_value_init (value, G_TYPE_STRING);
+		g_value_set_string (value, prop->data.v_string);
+		break;
+	case EPHY_NODE_PROPERTY_BOOLEAN:
+		g_value_init (value, G_TYPE_BOOLEAN);
+		g_value_set_boolean (value, prop->data.v_boolean);
+		break;
+	case EPHY_NODE_PROPERTY_INT:
+		g_value_init (value, G_TYPE_INT);
+		g_value_set_int (value, prop->data.v_int);
+		break;
+	case EPHY_NODE_PROPERTY_LONG:
+		g_value_init (value, G_TYPE_LONG);
+		g_value_set_long (value, prop->data.v_long);
+		break;
+	case EPHY_NODE_PROPERTY_FLOAT:
+		g_value_init (value, G_TYPE_FLOAT);
+		g_value_set_float (value, prop->data.v_float);
+		break;
+	case EPHY_NODE_PROPERTY_DOUBLE:
+		g_value_init (value, G_TYPE_DOUBLE);
+		g_value_set_double (value, prop->data.v_double);
+		break;
+	case EPHY_NODE_PROPERTY_POINTER:
+		g_value_init (value, G_TYPE_POINTER);
+		g_value_set_pointer (value, prop->data.v_pointer);
+		break;
+	default:
 		return FALSE;
 	}
 
-	g_value_init (value, G_VALUE_TYPE (ret));
-	g_value_copy (ret, value);
-
 	return TRUE;
 }
 
@@ -527,40 +763,32 @@ ephy_node_set_property_string (EphyNode *node,
 			       guint property_id,
 			       const char *value)
 {
-	GValue *new;
-
 	g_return_if_fail (EPHY_IS_NODE (node));
+	g_return_if_fail (property_id <= MAX_PROPERTY_ID);
 
 	if (ephy_node_db_is_immutable (node->db)) return;
 
-	new = g_slice_new0 (GValue);
-	g_value_init (new, G_TYPE_STRING);
-	g_value_set_string (new, value);
+	real_set_property_string (node, property_id, value);
 
-	ephy_node_set_property_internal (node, property_id, new);
+	ephy_node_property_changed (node, property_id);
 }
 
 const char *
 ephy_node_get_property_string (EphyNode *node,
 			       guint property_id)
 {
-	GValue *ret;
-	const char *retval;
+	EphyNodeProperty *prop;
 
 	g_return_val_if_fail (EPHY_IS_NODE (node), NULL);
 
-	if (property_id >= node->properties->len) {
+	prop = lookup_property (node, property_id);
+	if (prop == NULL ||
+	    (prop->type != EPHY_NODE_PROPERTY_STRING &&
+	     prop->type != EPHY_NODE_PROPERTY_INTERNED_STRING)) {
 		return NULL;
 	}
 
-	ret = g_ptr_array_index (node->properties, property_id);
-	if (ret == NULL) {
-		return NULL;
-	}
-
-	retval = g_value_get_string (ret);
-
-	return retval;
+	return prop->data.v_string;
 }
 
 void
@@ -568,40 +796,33 @@ ephy_node_set_property_boolean (EphyNode *node,
 			        guint property_id,
 			        gboolean value)
 {
-	GValue *new;
+	EphyNodeProperty *prop;
 
 	g_return_if_fail (EPHY_IS_NODE (node));
 
-	if (ephy_node_db_is_immutable (node->db)) return;
+	prop = ephy_node_prepare_set (node, property_id);
+	if (prop == NULL) return;
 
-	new = g_slice_new0 (GValue);
-	g_value_init (new, G_TYPE_BOOLEAN);
-	g_value_set_boolean (new, value);
+	prop->type = EPHY_NODE_PROPERTY_BOOLEAN;
+	prop->data.v_boolean = value;
 
-	ephy_node_set_property_internal (node, property_id, new);
+	ephy_node_property_changed (node, property_id);
 }
 
 gboolean
 ephy_node_get_property_boolean (EphyNode *node,
 			        guint property_id)
 {
-	GValue *ret;
-	gboolean retval;
+	EphyNodeProperty *prop;
 
 	g_return_val_if_fail (EPHY_IS_NODE (node), FALSE);
 
-	if (property_id >= node->properties->len) {
-		return FALSE;
-	}
-
-	ret = g_ptr_array_index (node->properties, property_id);
-	if (ret == NULL) {
+	prop = lookup_property (node, property_id);
+	if (prop == NULL || prop->type != EPHY_NODE_PROPERTY_BOOLEAN) {
 		return FALSE;
 	}
 
-	retval = g_value_get_boolean (ret);
-
-	return retval;
+	return prop->data.v_boolean;
 }
 
 void
@@ -609,40 +830,33 @@ ephy_node_set_property_long (EphyNode *node,
 			     guint property_id,
 			     long value)
 {
-	GValue *new;
+	EphyNodeProperty *prop;
 
 	g_return_if_fail (EPHY_IS_NODE (node));
 
-	if (ephy_node_db_is_immutable (node->db)) return;
+	prop = ephy_node_prepare_set (node, property_id);
+	if (prop == NULL) return;
 
-	new = g_slice_new0 (GValue);
-	g_value_init (new, G_TYPE_LONG);
-	g_value_set_long (new, value);
+	prop->type = EPHY_NODE_PROPERTY_LONG;
+	prop->data.v_long = value;
 
-	ephy_node_set_property_internal (node, property_id, new);
+	ephy_node_property_changed (node, property_id);
 }
 
 long
 ephy_node_get_property_long (EphyNode *node,
 			     guint property_id)
 {
-	GValue *ret;
-	long retval;
+	EphyNodeProperty *prop;
 
 	g_return_val_if_fail (EPHY_IS_NODE (node), -1);
 
-	if (property_id >= node->properties->len) {
+	prop = lookup_property (node, property_id);
+	if (prop == NULL || prop->type != EPHY_NODE_PROPERTY_LONG) {
 		return -1;
 	}
 
-	ret = g_ptr_array_index (node->properties, property_id);
-	if (ret == NULL) {
-		return -1;
-	}
-
-	retval = g_value_get_long (ret);
-
-	return retval;
+	return prop->data.v_long;
 }
 
 void
@@ -650,40 +864,33 @@ ephy_node_set_property_int (EphyNode *node,
 			    guint property_id,
 			    int value)
 {
-	GValue *new;
+	EphyNodeProperty *prop;
 
 	g_return_if_fail (EPHY_IS_NODE (node));
 
-	if (ephy_node_db_is_immutable (node->db)) return;
+	prop = ephy_node_prepare_set (node, property_id);
+	if (prop == NULL) return;
 
-	new = g_slice_new0 (GValue);
-	g_value_init (new, G_TYPE_INT);
-	g_value_set_int (new, value);
+	prop->type = EPHY_NODE_PROPERTY_INT;
+	prop->data.v_int = value;
 
-	ephy_node_set_property_internal (node, property_id, new);
+	ephy_node_property_changed (node, property_id);
 }
 
 int
 ephy_node_get_property_int (EphyNode *node,
 			    guint property_id)
 {
-	GValue *ret;
-	int retval;
+	EphyNodeProperty *prop;
 
 	g_return_val_if_fail (EPHY_IS_NODE (node), -1);
 
-	if (property_id >= node->properties->len) {
-		return -1;
-	}
-
-	ret = g_ptr_array_index (node->properties, property_id);
-	if (ret == NULL) {
+	prop = lookup_property (node, property_id);
+	if (prop == NULL || prop->type != EPHY_NODE_PROPERTY_INT) {
 		return -1;
 	}
 
-	retval = g_value_get_int (ret);
-
-	return retval;
+	return prop->data.v_int;
 }
 
 void
@@ -691,40 +898,33 @@ ephy_node_set_property_double (EphyNode *node,
 			       guint property_id,
 			       double value)
 {
-	GValue *new;
+	EphyNodeProperty *prop;
 
 	g_return_if_fail (EPHY_IS_NODE (node));
 
-	if (ephy_node_db_is_immutable (node->db)) return;
+	prop = ephy_node_prepare_set (node, property_id);
+	if (prop == NULL) return;
 
-	new = g_slice_new0 (GValue);
-	g_value_init (new, G_TYPE_DOUBLE);
-	g_value_set_double (new, value);
+	prop->type = EPHY_NODE_PROPERTY_DOUBLE;
+	prop->data.v_double = value;
 
-	ephy_node_set_property_internal (node, property_id, new);
+	ephy_node_property_changed (node, property_id);
 }
 
 double
 ephy_node_get_property_double (EphyNode *node,
 			       guint property_id)
 {
-	GValue *ret;
-	double retval;
+	EphyNodeProperty *prop;
 
 	g_return_val_if_fail (EPHY_IS_NODE (node), -1);
 
-	if (property_id >= node->properties->len) {
+	prop = lookup_property (node, property_id);
+	if (prop == NULL || prop->type != EPHY_NODE_PROPERTY_DOUBLE) {
 		return -1;
 	}
 
-	ret = g_ptr_array_index (node->properties, property_id);
-	if (ret == NULL) {
-		return -1;
-	}
-
-	retval = g_value_get_double (ret);
-
-	return retval;
+	return prop->data.v_double;
 }
 
 void
@@ -732,40 +932,134 @@ ephy_node_set_property_float (EphyNode *node,
 			      guint property_id,
 			      float value)
 {
-	GValue *new;
+	EphyNodeProperty *prop;
 
 	g_return_if_fail (EPHY_IS_NODE (node));
 
-	if (ephy_node_db_is_immutable (node->db)) return;
+	prop = ephy_node_prepare_set (node, property_id);
+	if (prop == NULL) return;
 
-	new = g_slice_new0 (GValue);
-	g_value_init (new, G_TYPE_FLOAT);
-	g_value_set_float (new, value);
+	prop->type = EPHY_NODE_PROPERTY_FLOAT;
+	prop->data.v_float = value;
 
-	ephy_node_set_property_internal (node, property_id, new);
+	ephy_node_property_changed (node, property_id);
 }
 
 float
 ephy_node_get_property_float (EphyNode *node,
 			      guint property_id)
 {
-	GValue *ret;
-	float retval;
+	EphyNodeProperty *prop;
 
 	g_return_val_if_fail (EPHY_IS_NODE (node), -1);
 
-	if (property_id >= node->properties->len) {
+	prop = lookup_property (node, property_id);
+	if (prop == NULL || prop->type != EPHY_NODE_PROPERTY_FLOAT) {
 		return -1;
 	}
 
-	ret = g_ptr_array_index (node->properties, property_id);
-	if (ret == NULL) {
-		return -1;
+	return prop->data.v_float;
+}
+
+static const char *
+get_cached_key (EphyNode *node,
+		guint property_id,
+		guint flag)
+{
+	EphyNodeProperty *prop;
+	const char *string;
+	char *key;
+
+	prop = lookup_property (node, property_id | flag);
+	if (prop != NULL) {
+		return prop->data.v_string;
+	}
+
+	string = ephy_node_get_property_string (node, property_id);
+	if (string == NULL) {
+		return NULL;
 	}
 
-	retval = g_value_get_float (ret);
+	if (flag == FOLDED_STRING_FLAG) {
+		key = g_utf8_casefold (string, -1);
+	} else if (flag == CASEFOLD_KEY_FLAG) {
+		char *folded;
 
-	return retval;
+		folded = g_utf8_casefold (string, -1);
+		key = g_utf8_collate_key (folded, -1);
+		g_free (folded);
+	} else {
+		key = g_utf8_collate_key (string, -1);
+	}
+
+	prop = ensure_property (node, property_id | flag);
+	prop->type = EPHY_NODE_PROPERTY_STRING;
+	prop->data.v_string = key;
+
+	return key;
+}
+
+/**
+ * ephy_node_get_property_collate_key:
+ * @node: an #EphyNode
+ * @property_id: the id of a string property
+ *
+ * Returns the g_utf8_collate_key() of the string property @property_id,
+ * computing it only the first time it is asked for after the property
+ * changed. Comparing two keys with strcmp() gives the same result as
+ * g_utf8_collate() on the strings.
+ *
+ * Return value: the collation key, or %NULL if the property is not set
+ **/
+const char *
+ephy_node_get_property_collate_key (EphyNode *node,
+				    guint property_id)
+{
+	g_return_val_if_fail (EPHY_IS_NODE (node), NULL);
+	g_return_val_if_fail (property_id <= MAX_PROPERTY_ID, NULL);
+
+	return get_cached_key (node, property_id, COLLATE_KEY_FLAG);
+}
+
+/**
+ * ephy_node_get_property_casefold_key:
+ * @node: an #EphyNode
+ * @property_id: the id of a string property
+ *
+ * Like ephy_node_get_property_collate_key(), but the key is computed on the
+ * case folded string, for case insensitive sorting.
+ *
+ * Return value: the collation key, or %NULL if the property is not set
+ **/
+const char *
+ephy_node_get_property_casefold_key (EphyNode *node,
+				     guint property_id)
+{
+	g_return_val_if_fail (EPHY_IS_NODE (node), NULL);
+	g_return_val_if_fail (property_id <= MAX_PROPERTY_ID, NULL);
+
+	return get_cached_key (node, property_id, CASEFOLD_KEY_FLAG);
+}
+
+/**
+ * ephy_node_get_property_folded_string:
+ * @node: an #EphyNode
+ * @property_id: the id of a string property
+ *
+ * Returns the g_utf8_casefold() of the string property @property_id,
+ * cached like ephy_node_get_property_collate_key(), for case insensitive
+ * matching.
+ *
+ * Return value: the case folded string, or %NULL if the property is not set
+ **/
+const char *
+ephy_node_get_property_folded_string (EphyNode *node,
+				      guint property_id)
+{
+	g_return_val_if_fail (EPHY_IS_NODE (node), NULL);
+	g_return_val_if_fail (property_id <= MAX_PROPERTY_ID, NULL);
+
+	return get_cached_key (node, property_id, FOLDED_STRING_FLAG);
 }
 
 /**
@@ -777,23 +1071,16 @@ EphyNode *
 ephy_node_get_property_node (EphyNode *node,
 			     guint property_id)
 {
-	GValue *ret;
-	EphyNode *retval;
+	EphyNodeProperty *prop;
 
 	g_return_val_if_fail (EPHY_IS_NODE (node), NULL);
 
-	if (property_id >= node->properties->len) {
+	prop = lookup_property (node, property_id);
+	if (prop == NULL || prop->type != EPHY_NODE_PROPERTY_POINTER) {
 		return NULL;
 	}
 
-	ret = g_ptr_array_index (node->properties, property_id);
-	if (ret == NULL) {
-		return NULL;
-	}
-
-	retval = g_value_get_pointer (ret);
-
-	return retval;
+	return prop->data.v_pointer;
 }
 
 typedef struct
@@ -878,53 +1165,86 @@ ephy_node_write_to_xml(EphyNode *node,
 	if (ret < 0) goto out;
 
 	/* write node properties */
-	for (i = 0; i < node->properties->len; i++)
+	for (i = 0; i < node->n_properties; i++)
 	{
-		GValue *value;
+		EphyNodeProperty *prop;
+		const char *type_name;
 
-		value = g_ptr_array_index (node->properties, i);
+		prop = &node->properties[i];
 
-		if (value == NULL) continue;
-		if (G_VALUE_TYPE (value) == G_TYPE_STRING &&
-		    g_value_get_string (value) == NULL) continue;
+		/* cached collation keys are not part of the data */
+		if (prop->id > MAX_PROPERTY_ID) break;
+
+		switch (prop->type)
+		{
+		case EPHY_NODE_PROPERTY_STRING:
+		case EPHY_NODE_PROPERTY_INTERNED_STRING:
+			type_name = "gchararray";
+			break;
+		case EPHY_NODE_PROPERTY_BOOLEAN:
+			type_name = "gboolean";
+			break;
+		case EPHY_NODE_PROPERTY_INT:
+			type_name = "gint";
+			break;
+		case EPHY_NODE_PROPERTY_LONG:
+			type_name = "glong";
+			break;
+		case EPHY_NODE_PROPERTY_FLOAT:
+			type_name = "gfloat";
+			break;
+		case EPHY_NODE_PROPERTY_DOUBLE:
+			type_name = "gdouble";
+			break;
+		case EPHY_NODE_PROPERTY_UNSET:
+			continue;
+		default:
+			g_assert_not_reached ();
+			continue;
+		}
+
+		if ((prop->type == EPHY_NODE_PROPERTY_STRING ||
+		     prop->type == EPHY_NODE_PROPERTY_INTERNED_STRING) &&
+		    prop->data.v_string == NULL) continue;
 
 		ret = xmlTextWriterStartElement (writer, (const xmlChar *)"property");
 		if (ret < 0) break;
 
-		ret = xmlTextWriterWriteFormatAttribute (writer, (const xmlChar *)"id", "%d", i);
+		ret = xmlTextWriterWriteFormatAttribute (writer, (const xmlChar *)"id", "%d", prop->id);
 		if (ret < 0) break;
 
 		ret = xmlTextWriterWriteAttribute
 			(writer, (const xmlChar *)"value_type", 
-			 (const xmlChar *)g_type_name (G_VALUE_TYPE (value)));
+			 (const xmlChar *)type_name);
 		if (ret < 0) break;
 
-		switch (G_VALUE_TYPE (value))
+		switch (prop->type)
 		{
-		case G_TYPE_STRING:
+		case EPHY_NODE_PROPERTY_STRING:
+		case EPHY_NODE_PROPERTY_INTERNED_STRING:
 			ret = safe_write_string
-				(writer, (const xmlChar *)g_value_get_string (value));
+				(writer, (const xmlChar *)prop->data.v_string);
 			break;
-		case G_TYPE_BOOLEAN:
+		case EPHY_NODE_PROPERTY_BOOLEAN:
 			ret = xmlTextWriterWriteFormatString
-				(writer, "%d", g_value_get_boolean (value));
+				(writer, "%d", prop->data.v_boolean);
 			break;
-		case G_TYPE_INT:
+		case EPHY_NODE_PROPERTY_INT:
 			ret = xmlTextWriterWriteFormatString
-				(writer, "%d", g_value_get_int (value));
+				(writer, "%d", prop->data.v_int);
 			break;
-		case G_TYPE_LONG:
+		case EPHY_NODE_PROPERTY_LONG:
 			ret = xmlTextWriterWriteFormatString
-				(writer, "%ld", g_value_get_long (value));
+				(writer, "%ld", prop->data.v_long);
 			break;
-		case G_TYPE_FLOAT:
+		case EPHY_NODE_PROPERTY_FLOAT:
 			g_ascii_dtostr ((gchar *)xml_buf, sizeof (xml_buf), 
-					g_value_get_float (value));
+					prop->data.v_float);
 			ret = xmlTextWriterWriteString (writer, xml_buf);
 			break;
-		case G_TYPE_DOUBLE:
+		case EPHY_NODE_PROPERTY_DOUBLE:
 			g_ascii_dtostr ((gchar *)xml_buf, sizeof (xml_buf),
-					g_value_get_double (value));
+					prop->data.v_double);
 			ret = xmlTextWriterWriteString (writer, xml_buf);
 			break;
 		default:
@@ -942,9 +1262,10 @@ ephy_node_write_to_xml(EphyNode *node,
 	data.writer = writer;
 	data.ret = 0;
 
-	g_hash_table_foreach (node->parents,
-			      (GHFunc) write_parent,
-			      &data);
+	if (node->parents != NULL)
+		g_hash_table_foreach (node->parents,
+				      (GHFunc) write_parent,
+				      &data);
 	ret = data.ret;
 	if (ret < 0) goto out;
 
@@ -961,8 +1282,7 @@ real_add_child (EphyNode *node,
 {
 	EphyNodeParent *node_info;
 
-	if (g_hash_table_lookup (child->parents,
-				 GINT_TO_POINTER (node->id)) != NULL) {
+	if (lookup_parent_info (child, node) != NULL) {
 		return;
 	}
 
@@ -972,6 +1292,10 @@ real_add_child (EphyNode *node,
 	node_info->node  = node;
 	node_info->index = node->children->len - 1;
 
+	if (child->parents == NULL)
+		child->parents = g_hash_table_new_full
+		  (int_hash, int_equal, NULL, (GDestroyNotify) node_parent_free);
+
 	g_hash_table_insert (child->parents,
 			     GINT_TO_POINTER (node->id),
 			     node_info);
@@ -1017,7 +1341,7 @@ ephy_node_new_from_xml (EphyNodeDb *db, xmlNodePtr xml_node)
 				ephy_node_emit_signal (parent, EPHY_NODE_CHILD_ADDED, node);
 			}
 		} else if (strcmp ((const char *)xml_child->name, "property") == 0) {
-			GValue *value;
+			GValue value = { 0, };
 			xmlChar *xmlType, *xmlValue;
 			int property_id;
 
@@ -1028,37 +1352,35 @@ ephy_node_new_from_xml (EphyNodeDb *db, xmlNodePtr xml_node)
 			xmlType = xmlGetProp (xml_child, (const xmlChar *)"value_type");
 			xmlValue = xmlNodeGetContent (xml_child);
 
-			value = g_slice_new0 (GValue);
-
 			if (xmlStrEqual (xmlType, (const xmlChar *) "gchararray"))
 			{
-				g_value_init (value, G_TYPE_STRING);
-				g_value_set_string (value, (const gchar *)xmlValue);
+				g_value_init (&value, G_TYPE_STRING);
+				g_value_set_static_string (&value, (const gchar *)xmlValue);
 			}
 			else if (xmlStrEqual (xmlType, (const xmlChar *) "gint"))
 			{
-				g_value_init (value, G_TYPE_INT);
-				g_value_set_int (value, atoi ((const char *)xmlValue));
+				g_value_init (&value, G_TYPE_INT);
+				g_value_set_int (&value, atoi ((const char *)xmlValue));
 			}
 			else if (xmlStrEqual (xmlType, (const xmlChar *) "gboolean"))
 			{
-				g_value_init (value, G_TYPE_BOOLEAN);
-				g_value_set_boolean (value, atoi ((const char *)xmlValue));
+				g_value_init (&value, G_TYPE_BOOLEAN);
+				g_value_set_boolean (&value, atoi ((const char *)xmlValue));
 			}
 			else if (xmlStrEqual (xmlType, (const xmlChar *) "glong"))
 			{
-				g_value_init (value, G_TYPE_LONG);
-				g_value_set_long (value, atol ((const char *)xmlValue));
+				g_value_init (&value, G_TYPE_LONG);
+				g_value_set_long (&value, atol ((const char *)xmlValue));
 			}
 			else if (xmlStrEqual (xmlType, (const xmlChar *) "gfloat"))
 			{
-				g_value_init (value, G_TYPE_FLOAT);
-				g_value_set_float (value, g_ascii_strtod ((const gchar *)xmlValue, NULL));
+				g_value_init (&value, G_TYPE_FLOAT);
+				g_value_set_float (&value, g_ascii_strtod ((const gchar *)xmlValue, NULL));
 			}
 			else if (xmlStrEqual (xmlType, (const xmlChar *) "gdouble"))
 			{
-				g_value_init (value, G_TYPE_DOUBLE);
-				g_value_set_double (value, g_ascii_strtod ((const gchar *)xmlValue, NULL));
+				g_value_init (&value, G_TYPE_DOUBLE);
+				g_value_set_double (&value, g_ascii_strtod ((const gchar *)xmlValue, NULL));
 			}
 			else if (xmlStrEqual (xmlType, (const xmlChar *) "gpointer"))
 			{
@@ -1066,15 +1388,19 @@ ephy_node_new_from_xml (EphyNodeDb *db, xmlNodePtr xml_node)
 
 				property_node = ephy_node_db_get_node_from_id (db, atol ((const char *)xmlValue));
 
-				g_value_set_pointer (value, property_node);
-				break;
+				g_value_init (&value, G_TYPE_POINTER);
+				g_value_set_pointer (&value, property_node);
 			}
 			else
 			{
 				g_assert_not_reached ();
 			}
 
-			real_set_property (node, property_id, value);
+			if (G_IS_VALUE (&value))
+			{
+				real_set_property (node, property_id, &value);
+				g_value_unset (&value);
+			}
 
 			xmlFree (xmlValue);
 			xmlFree (xmlType);
@@ -1118,8 +1444,7 @@ ephy_node_has_child (EphyNode *node,
 
 	g_return_val_if_fail (EPHY_IS_NODE (node), FALSE);
 	
-	ret = (g_hash_table_lookup (child->parents,
-				    GINT_TO_POINTER (node->id)) != NULL);
+	ret = (lookup_parent_info (child, node) != NULL);
 
 	return ret;
 }
@@ -1131,8 +1456,7 @@ ephy_node_real_get_child_index (EphyNode *node,
 	EphyNodeParent *node_info;
 	int ret;
 
-	node_info = g_hash_table_lookup (child->parents,
-					 GINT_TO_POINTER (node->id));
+	node_info = lookup_parent_info (child, node);
 
 	if (node_info == NULL)
 		return -1;
@@ -1183,8 +1507,7 @@ ephy_node_sort_children (EphyNode *node,
 
 		child = g_ptr_array_index (newkids, i);
 		new_order[ephy_node_real_get_child_index (node, child)] = i;
-		node_info = g_hash_table_lookup (child->parents,
-					         GINT_TO_POINTER (node->id));
+		node_info = lookup_parent_info (child, node);
 		node_info->index = i;
 	}
 
@@ -1219,8 +1542,7 @@ ephy_node_reorder_children (EphyNode *node,
 
 		g_ptr_array_index (newkids, new_order[i]) = child;
 
-		node_info = g_hash_table_lookup (child->parents,
-					         GINT_TO_POINTER (node->id));
+		node_info = lookup_parent_info (child, node);
 		node_info->index = new_order[i];
 	}
 
@@ -1283,8 +1605,7 @@ get_child_index_real (EphyNode *node,
 {
 	EphyNodeParent *node_info;
 
-	node_info = g_hash_table_lookup (child->parents,
-					 GINT_TO_POINTER (node->id));
+	node_info = lookup_parent_info (child, node);
 
 	if (node_info == NULL)
 		return -1;
@@ -1390,6 +1711,11 @@ ephy_node_signal_connect_object (EphyNode *node,
 	signal_data->type = type;
 	signal_data->data = object;
 
+	if (node->signals == NULL)
+		node->signals = g_hash_table_new_full
+		  (int_hash, int_equal, NULL,
+		   (GDestroyNotify)destroy_signal_data);
+
 	g_hash_table_insert (node->signals,
 			     GINT_TO_POINTER (node->signal_id),
 			     signal_data);
@@ -1457,6 +1783,9 @@ ephy_node_signal_disconnect_object (EphyNode *node,
 	user_data.type = type;
 	user_data.data = object;
 
+	if (node->signals == NULL)
+		return 0;
+
 	if (G_LIKELY (node->emissions == 0))
 	{
 		return g_hash_table_foreach_remove (node->signals,
@@ -1479,6 +1808,8 @@ ephy_node_signal_disconnect (EphyNode *node,
 	g_return_if_fail (EPHY_IS_NODE (node));
 	g_return_if_fail (signal_id != -1);
 
+	if (node->signals == NULL) return;
+
 	if (G_LIKELY (node->emissions == 0))
 	{
 		g_hash_table_remove (node->signals,
@@ -122,6 +122,12 @@ void        ephy_node_set_property_float    (EphyNode *node,
 					     float value);
 EphyNode   *ephy_node_get_property_node     (EphyNode *node,
 					     guint property_id);
+const char *ephy_node_get_property_collate_key (EphyNode *node,
+					     guint property_id);
+const char *ephy_node_get_property_casefold_key (EphyNode *node,
+					     guint property_id);
+const char *ephy_node_get_property_folded_string (EphyNode *node,
+					     guint property_id);
 
 /* xml storage */
 int           ephy_node_write_to_xml	    (EphyNode *node,
@@ -27,6 +27,7 @@
 #define EPHY_HISTORY_FILE       "ephy-history.db"
 #define EPHY_BOOKMARKS_FILE     "ephy-bookmarks.xml"
 #define EPHY_BOOKMARKS_FILE_RDF "bookmarks.rdf"
+#define EPHY_THUMBNAILS_FILE    "thumbnails.pack"
 
 int ephy_profile_utils_get_migration_version (void);
 
@@ -412,7 +412,9 @@ static EphyProcess get_ephy_process (pid_t pid)
   return process;
 }
 
-static void ephy_smaps_pid_children_to_html (EphySMaps *smaps, GString *str, pid_t parent_pid)
+typedef void (* EphyProcessFunc) (EphySMaps *smaps, pid_t pid, EphyProcess process, gpointer user_data);
+
+static void foreach_child_process (EphySMaps *smaps, pid_t parent_pid, EphyProcessFunc func, gpointer user_data)
 {
   GDir *proc;
   const char *name;
@@ -438,10 +440,20 @@ static void ephy_smaps_pid_children_to_html (EphySMaps *smaps, GString *str, pid
 
     process = get_ephy_process (pid);
     if (process != EPHY_PROCESS_OTHER)
-      ephy_smaps_pid_to_html (smaps, str, pid, process);
+      func (smaps, pid, process, user_data);
   }
   g_dir_close (proc);
 }
+
+static void child_process_to_html (EphySMaps *smaps, pid_t pid, EphyProcess process, gpointer user_data)
+{
+  ephy_smaps_pid_to_html (smaps, (GString *)user_data, pid, process);
+}
+
+static void ephy_smaps_pid_children_to_html (EphySMaps *smaps, GString *str, pid_t parent_pid)
+{
+  foreach_child_process (smaps, parent_pid, child_process_to_html, str);
+}
 #endif
 
 char* ephy_smaps_to_html (EphySMaps *smaps)
@@ -462,6 +474,81 @@ char* ephy_smaps_to_html (EphySMaps *smaps)
   return g_string_free (str, FALSE);
 }
 
+/* Only the Private_* lines are needed here, so this skips building
+ * the VMA list ephy_smaps_pid_to_html() uses. */
+static guint64 ephy_smaps_pid_private_memory (EphySMaps *smaps, pid_t pid)
+{
+  GFileInputStream *stream;
+  GDataInputStream *data_stream;
+  char *path;
+  GFile *file;
+  char *line;
+  guint64 total = 0;
+
+  path = g_strdup_printf ("/proc/%u/smaps", pid);
+  file = g_file_new_for_path (path);
+  g_free (path);
+
+  stream = g_file_read (file, NULL, NULL);
+  g_object_unref (file);
+  if (!stream)
+    return 0;
+
+  data_stream = g_data_input_stream_new (G_INPUT_STREAM (stream));
+  g_object_unref (stream);
+
+  while ((line = g_data_input_stream_read_line (data_stream, NULL, NULL, NULL))) {
+    GMatchInfo *match_info = NULL;
+
+    if (g_str_has_prefix (line, "Private_") &&
+        g_regex_match (smaps->priv->detail, line, 0, &match_info)) {
+      char *size = g_match_info_fetch (match_info, 2);
+
+      total += g_ascii_strtoull (size, NULL, 10) * 1024;
+      g_free (size);
+    }
+
+    g_match_info_free (match_info);
+    g_free (line);
+  }
+
+  g_object_unref (data_stream);
+
+  return total;
+}
+
+#ifdef HAVE_WEBKIT2
+static void add_child_private_memory (EphySMaps *smaps, pid_t pid, EphyProcess process, gpointer user_data)
+{
+  *(guint64 *)user_data += ephy_smaps_pid_private_memory (smaps, pid);
+}
+#endif
+
+/**
+ * ephy_smaps_get_private_memory:
+ * @smaps: an #EphySMaps
+ *
+ * Adds up the private memory, clean and dirty, of the browser and,
+ * with WebKit2, of its web and plugin processes.
+ *
+ * Returns: the private memory in bytes, or 0 if it cannot be read
+ **/
+guint64 ephy_smaps_get_private_memory (EphySMaps *smaps)
+{
+  pid_t pid = getpid ();
+  guint64 total;
+
+  g_return_val_if_fail (EPHY_IS_SMAPS (smaps), 0);
+
+  total = ephy_smaps_pid_private_memory (smaps, pid);
+
+#ifdef HAVE_WEBKIT2
+  foreach_child_process (smaps, pid, add_child_private_memory, &total);
+#endif
+
+  return total;
+}
+
 static void
 ephy_smaps_init (EphySMaps *smaps)
 {
@@ -46,5 +46,6 @@ typedef struct {
 GType       ephy_smaps_get_type (void);
 EphySMaps * ephy_smaps_new      (void);
 char      * ephy_smaps_to_html  (EphySMaps *smaps);
+guint64     ephy_smaps_get_private_memory (EphySMaps *smaps);
 
 #endif /* EPHY_SMAPS_H */
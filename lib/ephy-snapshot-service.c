@@ -21,7 +21,12 @@
 #include "config.h"
 #include "ephy-snapshot-service.h"
 
+#include "ephy-debug.h"
 #include "ephy-favicon-helpers.h"
+#include "ephy-file-helpers.h"
+#include "ephy-image-scale.h"
+#include "ephy-profile-utils.h"
+#include "ephy-thumbnail-pack.h"
 
 #ifndef GNOME_DESKTOP_USE_UNSTABLE_API
 #define GNOME_DESKTOP_USE_UNSTABLE_API
@@ -35,18 +40,77 @@
 
 #define EPHY_SNAPSHOT_SERVICE_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), EPHY_TYPE_SNAPSHOT_SERVICE, EphySnapshotServicePrivate))
 
+/* Enough for the overview of a few windows. Each decoded thumbnail
+ * takes ~95 KiB. */
+#define MAX_CACHED_SNAPSHOTS 32
+
+/* Around 25 MiB on disk. Compaction goes down to a quarter less, so
+ * that it doesn't happen again with each new snapshot. */
+#define MAX_PACKED_SNAPSHOTS 256
+#define COMPACTED_PACKED_SNAPSHOTS (MAX_PACKED_SNAPSHOTS * 3 / 4)
+
+/* How long frecency bumped by lookups is kept in memory only. */
+#define SCORES_WRITE_DELAY_SECONDS 60
+
 struct _EphySnapshotServicePrivate
 {
+  /* Only used to read snapshots saved by older versions. */
   GnomeDesktopThumbnailFactory *factory;
+
+  GMutex pack_mutex;
+  EphyThumbnailPack *pack;
+  gboolean pack_opened;
+  volatile gint scores_write_scheduled;
+
+  /* Decoded thumbnails, accessed from the worker threads too. */
+  GMutex cache_mutex;
+  GHashTable *cache;
+  GQueue *cache_lru;
 };
 
+typedef struct {
+  char *url;
+  time_t mtime;
+  GdkPixbuf *snapshot;
+  GList *lru_link;
+} CachedSnapshot;
+
 G_DEFINE_TYPE (EphySnapshotService, ephy_snapshot_service, G_TYPE_OBJECT)
 
+static void
+cached_snapshot_free (CachedSnapshot *cached)
+{
+  g_free (cached->url);
+  g_object_unref (cached->snapshot);
+
+  g_slice_free (CachedSnapshot, cached);
+}
+
 /* GObject boilerplate methods. */
 
+static void
+ephy_snapshot_service_finalize (GObject *object)
+{
+  EphySnapshotServicePrivate *priv = EPHY_SNAPSHOT_SERVICE (object)->priv;
+
+  g_queue_free (priv->cache_lru);
+  g_hash_table_destroy (priv->cache);
+  g_mutex_clear (&priv->cache_mutex);
+  g_object_unref (priv->factory);
+  if (priv->pack)
+    ephy_thumbnail_pack_free (priv->pack);
+  g_mutex_clear (&priv->pack_mutex);
+
+  G_OBJECT_CLASS (ephy_snapshot_service_parent_class)->finalize (object);
+}
+
 static void
 ephy_snapshot_service_class_init (EphySnapshotServiceClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ephy_snapshot_service_finalize;
+
   g_type_class_add_private (klass, sizeof (EphySnapshotServicePrivate));
 }
 
@@ -57,6 +121,196 @@ ephy_snapshot_service_init (EphySnapshotService *self)
 
   self->priv = EPHY_SNAPSHOT_SERVICE_GET_PRIVATE (self);
   self->priv->factory = gnome_desktop_thumbnail_factory_new (GNOME_DESKTOP_THUMBNAIL_SIZE_LARGE);
+
+  g_mutex_init (&self->priv->cache_mutex);
+  self->priv->cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             NULL, (GDestroyNotify)cached_snapshot_free);
+  self->priv->cache_lru = g_queue_new ();
+
+  g_mutex_init (&self->priv->pack_mutex);
+}
+
+/* Opened on first use, normally from a worker thread, so that reading
+ * the index doesn't slow down startup. */
+static EphyThumbnailPack *
+get_thumbnail_pack (EphySnapshotService *service)
+{
+  EphySnapshotServicePrivate *priv = service->priv;
+
+  g_mutex_lock (&priv->pack_mutex);
+
+  if (!priv->pack_opened) {
+    priv->pack_opened = TRUE;
+
+    if (ephy_dot_dir ()) {
+      char *filename = g_build_filename (ephy_dot_dir (), EPHY_THUMBNAILS_FILE, NULL);
+
+      priv->pack = ephy_thumbnail_pack_new (filename, EPHY_THUMBNAIL_WIDTH, EPHY_THUMBNAIL_HEIGHT);
+      g_free (filename);
+    }
+  }
+
+  g_mutex_unlock (&priv->pack_mutex);
+
+  return priv->pack;
+}
+
+static void
+write_scores_thread (GSimpleAsyncResult *result,
+                     EphySnapshotService *service,
+                     GCancellable *cancellable)
+{
+  ephy_thumbnail_pack_write_scores (service->priv->pack);
+}
+
+static gboolean
+write_scores_timeout_cb (EphySnapshotService *service)
+{
+  GSimpleAsyncResult *result;
+
+  g_atomic_int_set (&service->priv->scores_write_scheduled, FALSE);
+
+  result = g_simple_async_result_new (G_OBJECT (service), NULL, NULL,
+                                      write_scores_timeout_cb);
+  g_simple_async_result_run_in_thread (result,
+                                       (GSimpleAsyncThreadFunc)write_scores_thread,
+                                       G_PRIORITY_LOW, NULL);
+  g_object_unref (result);
+
+  return FALSE;
+}
+
+/* Lookups bump the frecency of the thumbnails they find in memory;
+ * write it to the pack a while later, from a worker thread. Called
+ * from any thread. */
+static void
+schedule_scores_write (EphySnapshotService *service)
+{
+  if (g_atomic_int_compare_and_exchange (&service->priv->scores_write_scheduled, FALSE, TRUE))
+    g_timeout_add_seconds_full (G_PRIORITY_LOW, SCORES_WRITE_DELAY_SECONDS,
+                                (GSourceFunc)write_scores_timeout_cb,
+                                g_object_ref (service), g_object_unref);
+}
+
+static GdkPixbuf *
+snapshot_cache_lookup (EphySnapshotService *service,
+                       const char *url,
+                       time_t mtime)
+{
+  EphySnapshotServicePrivate *priv = service->priv;
+  CachedSnapshot *cached;
+  GdkPixbuf *snapshot = NULL;
+
+  g_mutex_lock (&priv->cache_mutex);
+
+  cached = g_hash_table_lookup (priv->cache, url);
+  if (cached && cached->mtime == mtime) {
+    g_queue_unlink (priv->cache_lru, cached->lru_link);
+    g_queue_push_head_link (priv->cache_lru, cached->lru_link);
+    snapshot = g_object_ref (cached->snapshot);
+  }
+
+  g_mutex_unlock (&priv->cache_mutex);
+
+  return snapshot;
+}
+
+static void
+snapshot_cache_insert (EphySnapshotService *service,
+                       const char *url,
+                       time_t mtime,
+                       GdkPixbuf *snapshot)
+{
+  EphySnapshotServicePrivate *priv = service->priv;
+  CachedSnapshot *cached;
+
+  g_mutex_lock (&priv->cache_mutex);
+
+  cached = g_hash_table_lookup (priv->cache, url);
+  if (cached) {
+    /* Newer snapshots always win, whatever the order the workers
+     * finish in. */
+    if (cached->mtime <= mtime) {
+      g_object_unref (cached->snapshot);
+      cached->snapshot = g_object_ref (snapshot);
+      cached->mtime = mtime;
+    }
+    g_queue_unlink (priv->cache_lru, cached->lru_link);
+    g_queue_push_head_link (priv->cache_lru, cached->lru_link);
+    g_mutex_unlock (&priv->cache_mutex);
+    return;
+  }
+
+  if (g_queue_get_length (priv->cache_lru) >= MAX_CACHED_SNAPSHOTS) {
+    CachedSnapshot *oldest = g_queue_pop_tail (priv->cache_lru);
+
+    g_hash_table_remove (priv->cache, oldest->url);
+  }
+
+  cached = g_slice_new (CachedSnapshot);
+  cached->url = g_strdup (url);
+  cached->mtime = mtime;
+  cached->snapshot = g_object_ref (snapshot);
+  g_queue_push_head (priv->cache_lru, cached);
+  cached->lru_link = priv->cache_lru->head;
+  g_hash_table_insert (priv->cache, cached->url, cached);
+
+  g_mutex_unlock (&priv->cache_mutex);
+}
+
+static GdkPixbuf *
+load_snapshot_for_url (EphySnapshotService *service,
+                       const char *url,
+                       time_t mtime,
+                       GError **error)
+{
+  EphyThumbnailPack *pack;
+  GdkPixbuf *snapshot;
+  char *uri;
+  GError *local_error = NULL;
+
+  snapshot = snapshot_cache_lookup (service, url, mtime);
+  if (snapshot)
+    return snapshot;
+
+  pack = get_thumbnail_pack (service);
+  if (pack) {
+    snapshot = ephy_thumbnail_pack_lookup (pack, url, mtime);
+    if (snapshot) {
+      snapshot_cache_insert (service, url, mtime, snapshot);
+      schedule_scores_write (service);
+      return snapshot;
+    }
+  }
+
+  uri = gnome_desktop_thumbnail_factory_lookup (service->priv->factory, url, mtime);
+  if (uri == NULL) {
+    g_set_error (error,
+                 EPHY_SNAPSHOT_SERVICE_ERROR,
+                 EPHY_SNAPSHOT_SERVICE_ERROR_NOT_FOUND,
+                 "Snapshot for url \"%s\" not found in cache", url);
+    return NULL;
+  }
+
+  snapshot = gdk_pixbuf_new_from_file (uri, &local_error);
+  if (snapshot == NULL) {
+    g_set_error (error,
+                 EPHY_SNAPSHOT_SERVICE_ERROR,
+                 EPHY_SNAPSHOT_SERVICE_ERROR_INVALID,
+                 "Error creating pixbuf for snapshot file \"%s\": %s",
+                 uri, local_error->message);
+    g_error_free (local_error);
+  } else {
+    snapshot_cache_insert (service, url, mtime, snapshot);
+
+    /* Move it to the pack, so that it's faster to load next time. */
+    if (pack)
+      ephy_thumbnail_pack_store (pack, url, mtime, snapshot, NULL);
+  }
+
+  g_free (uri);
+
+  return snapshot;
 }
 
 typedef struct {
@@ -94,31 +348,78 @@ get_snapshot_for_url_thread (GSimpleAsyncResult *result,
                              GCancellable *cancellable)
 {
   SnapshotForURLAsyncData *data;
-  gchar *uri;
   GError *error = NULL;
 
   data = (SnapshotForURLAsyncData *)g_simple_async_result_get_op_res_gpointer (result);
 
-  uri = gnome_desktop_thumbnail_factory_lookup (service->priv->factory, data->url, data->mtime);
-  if (uri == NULL) {
-    g_simple_async_result_set_error (result,
-                                     EPHY_SNAPSHOT_SERVICE_ERROR,
-                                     EPHY_SNAPSHOT_SERVICE_ERROR_NOT_FOUND,
-                                     "Snapshot for url \"%s\" not found in cache", data->url);
-    return;
-  }
+  data->snapshot = load_snapshot_for_url (service, data->url, data->mtime, &error);
+  if (data->snapshot == NULL)
+    g_simple_async_result_take_error (result, error);
+}
 
-  data->snapshot = gdk_pixbuf_new_from_file (uri, &error);
-  if (data->snapshot == NULL) {
-    g_simple_async_result_set_error (result,
-                                     EPHY_SNAPSHOT_SERVICE_ERROR,
-                                     EPHY_SNAPSHOT_SERVICE_ERROR_INVALID,
-                                     "Error creating pixbuf for snapshot file \"%s\": %s",
-                                     uri, error->message);
-    g_error_free (error);
-  }
+typedef struct {
+  char **urls;
+  time_t *mtimes;
+  guint n_urls;
 
-  g_free (uri);
+  GPtrArray *snapshots;
+} SnapshotsForURLsAsyncData;
+
+static void
+clear_snapshot (GdkPixbuf *snapshot)
+{
+  if (snapshot)
+    g_object_unref (snapshot);
+}
+
+static SnapshotsForURLsAsyncData *
+snapshots_for_urls_async_data_new (const char * const *urls,
+                                   const time_t *mtimes,
+                                   guint n_urls)
+{
+  SnapshotsForURLsAsyncData *data;
+  guint i;
+
+  data = g_slice_new0 (SnapshotsForURLsAsyncData);
+  data->urls = g_new (char *, n_urls + 1);
+  for (i = 0; i < n_urls; i++)
+    data->urls[i] = g_strdup (urls[i]);
+  data->urls[n_urls] = NULL;
+  data->mtimes = g_memdup (mtimes, n_urls * sizeof (time_t));
+  data->n_urls = n_urls;
+
+  return data;
+}
+
+static void
+snapshots_for_urls_async_data_free (SnapshotsForURLsAsyncData *data)
+{
+  g_strfreev (data->urls);
+  g_free (data->mtimes);
+  if (data->snapshots)
+    g_ptr_array_unref (data->snapshots);
+
+  g_slice_free (SnapshotsForURLsAsyncData, data);
+}
+
+static void
+get_snapshots_for_urls_thread (GSimpleAsyncResult *result,
+                               EphySnapshotService *service,
+                               GCancellable *cancellable)
+{
+  SnapshotsForURLsAsyncData *data;
+  guint i;
+
+  data = (SnapshotsForURLsAsyncData *)g_simple_async_result_get_op_res_gpointer (result);
+
+  data->snapshots = g_ptr_array_new_full (data->n_urls, (GDestroyNotify)clear_snapshot);
+  for (i = 0; i < data->n_urls; i++) {
+    GdkPixbuf *snapshot = NULL;
+
+    if (!g_cancellable_is_cancelled (cancellable))
+      snapshot = load_snapshot_for_url (service, data->urls[i], data->mtimes[i], NULL);
+    g_ptr_array_add (data->snapshots, snapshot);
+  }
 }
 
 typedef struct {
@@ -164,6 +465,22 @@ snapshot_saved (EphySnapshotService *service,
   g_object_unref (simple);
 }
 
+static void
+snapshot_prepared (EphySnapshotService *service,
+                   GAsyncResult *result,
+                   GSimpleAsyncResult *simple)
+{
+  SnapshotAsyncData *data;
+
+  data = (SnapshotAsyncData *)g_simple_async_result_get_op_res_gpointer (simple);
+  data->snapshot = ephy_snapshot_service_prepare_snapshot_finish (service, result, NULL);
+
+  ephy_snapshot_service_save_snapshot_async (service, data->snapshot,
+                                             webkit_web_view_get_uri (data->web_view),
+                                             data->mtime, data->cancellable,
+                                             (GAsyncReadyCallback)snapshot_saved, simple);
+}
+
 static void
 save_snapshot (cairo_surface_t *surface,
                GSimpleAsyncResult *result)
@@ -172,14 +489,13 @@ save_snapshot (cairo_surface_t *surface,
   EphySnapshotService *service;
 
   data = (SnapshotAsyncData *)g_simple_async_result_get_op_res_gpointer (result);
-  data->snapshot = ephy_snapshot_service_prepare_snapshot (surface,
-                                                           webkit_web_view_get_favicon (data->web_view));
 
   service = (EphySnapshotService *)g_async_result_get_source_object (G_ASYNC_RESULT (result));
-  ephy_snapshot_service_save_snapshot_async (service, data->snapshot,
-                                             webkit_web_view_get_uri (data->web_view),
-                                             data->mtime, data->cancellable,
-                                             (GAsyncReadyCallback)snapshot_saved, result);
+  ephy_snapshot_service_prepare_snapshot_async (service, surface,
+                                                webkit_web_view_get_favicon (data->web_view),
+                                                NULL,
+                                                (GAsyncReadyCallback)snapshot_prepared, result);
+  g_object_unref (service);
 }
 
 #ifdef HAVE_WEBKIT2
@@ -369,12 +685,31 @@ save_snapshot_thread (GSimpleAsyncResult *result,
                       GCancellable *cancellable)
 {
   SaveSnapshotAsyncData *data;
+  EphyThumbnailPack *pack;
+  GError *error = NULL;
 
   data = (SaveSnapshotAsyncData *)g_simple_async_result_get_op_res_gpointer (result);
-  gnome_desktop_thumbnail_factory_save_thumbnail (service->priv->factory,
-                                                  data->snapshot,
-                                                  data->url,
-                                                  data->mtime);
+
+  pack = get_thumbnail_pack (service);
+  if (pack == NULL) {
+    gnome_desktop_thumbnail_factory_save_thumbnail (service->priv->factory,
+                                                    data->snapshot,
+                                                    data->url,
+                                                    data->mtime);
+    return;
+  }
+
+  if (!ephy_thumbnail_pack_store (pack, data->url, data->mtime, data->snapshot, &error)) {
+    g_simple_async_result_take_error (result, error);
+    return;
+  }
+
+  /* We are in a worker thread already, compact right away. */
+  if (ephy_thumbnail_pack_needs_compaction (pack, MAX_PACKED_SNAPSHOTS) &&
+      !ephy_thumbnail_pack_compact (pack, COMPACTED_PACKED_SNAPSHOTS, &error)) {
+    g_warning ("Error compacting thumbnails: %s", error->message);
+    g_error_free (error);
+  }
 }
 
 GQuark
@@ -422,6 +757,7 @@ ephy_snapshot_service_get_snapshot_for_url_async (EphySnapshotService *service,
                                                   gpointer user_data)
 {
   GSimpleAsyncResult *result;
+  SnapshotForURLAsyncData *data;
 
   g_return_if_fail (EPHY_IS_SNAPSHOT_SERVICE (service));
   g_return_if_fail (url != NULL);
@@ -429,12 +765,18 @@ ephy_snapshot_service_get_snapshot_for_url_async (EphySnapshotService *service,
   result = g_simple_async_result_new (G_OBJECT (service), callback, user_data,
                                       ephy_snapshot_service_get_snapshot_for_url_async);
 
-  g_simple_async_result_set_op_res_gpointer (result,
-                                             snapshot_for_url_async_data_new (url, mtime),
+  data = snapshot_for_url_async_data_new (url, mtime);
+  g_simple_async_result_set_op_res_gpointer (result, data,
                                              (GDestroyNotify)snapshot_for_url_async_data_free);
-  g_simple_async_result_run_in_thread (result,
-                                       (GSimpleAsyncThreadFunc)get_snapshot_for_url_thread,
-                                       G_PRIORITY_LOW, cancellable);
+
+  /* Don't bother a worker thread for thumbnails we have decoded already. */
+  data->snapshot = snapshot_cache_lookup (service, url, mtime);
+  if (data->snapshot)
+    g_simple_async_result_complete_in_idle (result);
+  else
+    g_simple_async_result_run_in_thread (result,
+                                         (GSimpleAsyncThreadFunc)get_snapshot_for_url_thread,
+                                         G_PRIORITY_LOW, cancellable);
   g_object_unref (result);
 }
 
@@ -474,6 +816,107 @@ ephy_snapshot_service_get_snapshot_for_url_finish (EphySnapshotService *service,
   return data->snapshot ? g_object_ref (data->snapshot) : NULL;
 }
 
+/**
+ * ephy_snapshot_service_lookup_cached_snapshot:
+ * @service: a #EphySnapshotService
+ * @url: the URL of the snapshot
+ * @mtime: the modification time of the wanted snapshot
+ *
+ * Looks up @url in the in-memory cache of decoded snapshots, without
+ * touching the disk.
+ *
+ * Returns: (transfer full): the snapshot, or %NULL if there is no
+ * up-to-date snapshot in memory.
+ **/
+GdkPixbuf *
+ephy_snapshot_service_lookup_cached_snapshot (EphySnapshotService *service,
+                                              const char *url,
+                                              time_t mtime)
+{
+  g_return_val_if_fail (EPHY_IS_SNAPSHOT_SERVICE (service), NULL);
+  g_return_val_if_fail (url != NULL, NULL);
+
+  return snapshot_cache_lookup (service, url, mtime);
+}
+
+/**
+ * ephy_snapshot_service_get_snapshots_for_urls_async:
+ * @service: a #EphySnapshotService
+ * @urls: the URLs for which snapshots are needed
+ * @mtimes: the modification times of the wanted snapshots
+ * @n_urls: the number of elements in @urls and @mtimes
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback
+ * @user_data: user data to pass to @callback
+ *
+ * Like ephy_snapshot_service_get_snapshot_for_url_async(), but
+ * retrieves the snapshots of all of @urls in a single worker job.
+ *
+ **/
+void
+ephy_snapshot_service_get_snapshots_for_urls_async (EphySnapshotService *service,
+                                                    const char * const *urls,
+                                                    const time_t *mtimes,
+                                                    guint n_urls,
+                                                    GCancellable *cancellable,
+                                                    GAsyncReadyCallback callback,
+                                                    gpointer user_data)
+{
+  GSimpleAsyncResult *result;
+
+  g_return_if_fail (EPHY_IS_SNAPSHOT_SERVICE (service));
+  g_return_if_fail (urls != NULL || n_urls == 0);
+
+  result = g_simple_async_result_new (G_OBJECT (service), callback, user_data,
+                                      ephy_snapshot_service_get_snapshots_for_urls_async);
+
+  g_simple_async_result_set_op_res_gpointer (result,
+                                             snapshots_for_urls_async_data_new (urls, mtimes, n_urls),
+                                             (GDestroyNotify)snapshots_for_urls_async_data_free);
+  g_simple_async_result_run_in_thread (result,
+                                       (GSimpleAsyncThreadFunc)get_snapshots_for_urls_thread,
+                                       G_PRIORITY_LOW, cancellable);
+  g_object_unref (result);
+}
+
+/**
+ * ephy_snapshot_service_get_snapshots_for_urls_finish:
+ * @service: a #EphySnapshotService
+ * @result: a #GAsyncResult
+ * @error: a location to store a #GError or %NULL
+ *
+ * Finishes the retrieval of a batch of snapshots. Call from the
+ * #GAsyncReadyCallback passed to
+ * ephy_snapshot_service_get_snapshots_for_urls_async().
+ *
+ * Returns: (transfer full): an array with one #GdkPixbuf for each of
+ * the requested URLs, in the same order. Elements are %NULL for URLs
+ * without an up-to-date snapshot.
+ **/
+GPtrArray *
+ephy_snapshot_service_get_snapshots_for_urls_finish (EphySnapshotService *service,
+                                                     GAsyncResult *result,
+                                                     GError **error)
+{
+  GSimpleAsyncResult *simple;
+  SnapshotsForURLsAsyncData *data;
+
+  g_return_val_if_fail (EPHY_IS_SNAPSHOT_SERVICE (service), NULL);
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+                                                        G_OBJECT (service),
+                                                        ephy_snapshot_service_get_snapshots_for_urls_async),
+                        NULL);
+
+  simple = (GSimpleAsyncResult *)result;
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return NULL;
+
+  data = (SnapshotsForURLsAsyncData *)g_simple_async_result_get_op_res_gpointer (simple);
+
+  return data->snapshots ? g_ptr_array_ref (data->snapshots) : NULL;
+}
+
 static void
 got_snapshot_for_url (EphySnapshotService *service,
                       GAsyncResult *result,
@@ -592,6 +1035,8 @@ ephy_snapshot_service_save_snapshot_async (EphySnapshotService *service,
   result = g_simple_async_result_new (G_OBJECT (service), callback, user_data,
                                       ephy_snapshot_service_save_snapshot_async);
 
+  snapshot_cache_insert (service, url, mtime, snapshot);
+
   g_simple_async_result_set_op_res_gpointer (result,
                                              save_snapshot_async_data_new (snapshot, url, mtime),
                                              (GDestroyNotify)save_snapshot_async_data_free);
@@ -615,11 +1060,22 @@ ephy_snapshot_service_save_snapshot_finish (EphySnapshotService *service,
   return !g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (result), error);
 }
 
+/**
+ * ephy_snapshot_service_prepare_snapshot:
+ * @surface: an image surface with the contents of a web view
+ * @favicon: (allow-none): the favicon of the page
+ *
+ * Crops and scales @surface down to the size of a thumbnail, and
+ * draws @favicon on top. This is expensive for large surfaces, use
+ * ephy_snapshot_service_prepare_snapshot_async() from the main thread.
+ *
+ * Returns: (transfer full): the thumbnail.
+ **/
 GdkPixbuf *
 ephy_snapshot_service_prepare_snapshot (cairo_surface_t *surface,
                                         cairo_surface_t *favicon)
 {
-  GdkPixbuf *snapshot, *scaled;
+  GdkPixbuf *scaled;
   int orig_width, orig_height;
   float orig_aspect_ratio, dest_aspect_ratio;
   int x_offset, new_width = 0, new_height;
@@ -629,13 +1085,11 @@ ephy_snapshot_service_prepare_snapshot (cairo_surface_t *surface,
 
   if (orig_width < EPHY_THUMBNAIL_WIDTH ||
       orig_height < EPHY_THUMBNAIL_HEIGHT) {
-    snapshot = gdk_pixbuf_get_from_surface (surface,
+    scaled = ephy_image_scale_surface_area (surface,
                                             0, 0,
-                                            orig_width, orig_height);
-    scaled = gdk_pixbuf_scale_simple (snapshot,
-                                      EPHY_THUMBNAIL_WIDTH,
-                                      EPHY_THUMBNAIL_HEIGHT,
-                                      GDK_INTERP_TILES);
+                                            orig_width, orig_height,
+                                            EPHY_THUMBNAIL_WIDTH,
+                                            EPHY_THUMBNAIL_HEIGHT);
   } else {
     orig_aspect_ratio = orig_width / (float)orig_height;
     dest_aspect_ratio = EPHY_THUMBNAIL_WIDTH / (float)EPHY_THUMBNAIL_HEIGHT;
@@ -652,14 +1106,15 @@ ephy_snapshot_service_prepare_snapshot (cairo_surface_t *surface,
       x_offset = 0;
     }
 
-    snapshot = gdk_pixbuf_get_from_surface (surface, x_offset, 0, new_width, new_height);
-    scaled = gnome_desktop_thumbnail_scale_down_pixbuf (snapshot,
-                                                        EPHY_THUMBNAIL_WIDTH,
-                                                        EPHY_THUMBNAIL_HEIGHT);
+    /* Scale straight from the surface, without copying the cropped
+       area into an intermediate pixbuf. */
+    scaled = ephy_image_scale_surface_area (surface,
+                                            x_offset, 0,
+                                            new_width, new_height,
+                                            EPHY_THUMBNAIL_WIDTH,
+                                            EPHY_THUMBNAIL_HEIGHT);
   }
 
-  g_object_unref (snapshot);
-
   if (favicon) {
     GdkPixbuf* fav_pixbuf;
     int favicon_size = 16;
@@ -675,3 +1130,151 @@ ephy_snapshot_service_prepare_snapshot (cairo_surface_t *surface,
 
   return scaled;
 }
+
+typedef struct {
+  cairo_surface_t *surface;
+  cairo_surface_t *favicon;
+
+  GdkPixbuf *snapshot;
+} PrepareSnapshotAsyncData;
+
+static PrepareSnapshotAsyncData *
+prepare_snapshot_async_data_new (cairo_surface_t *surface,
+                                 cairo_surface_t *favicon)
+{
+  PrepareSnapshotAsyncData *data;
+
+  data = g_slice_new0 (PrepareSnapshotAsyncData);
+  data->surface = cairo_surface_reference (surface);
+  data->favicon = favicon ? cairo_surface_reference (favicon) : NULL;
+
+  return data;
+}
+
+static void
+prepare_snapshot_async_data_free (PrepareSnapshotAsyncData *data)
+{
+  cairo_surface_destroy (data->surface);
+  if (data->favicon)
+    cairo_surface_destroy (data->favicon);
+  g_clear_object (&data->snapshot);
+
+  g_slice_free (PrepareSnapshotAsyncData, data);
+}
+
+static void
+prepare_snapshot_thread (GSimpleAsyncResult *result,
+                         EphySnapshotService *service,
+                         GCancellable *cancellable)
+{
+  PrepareSnapshotAsyncData *data;
+
+  data = (PrepareSnapshotAsyncData *)g_simple_async_result_get_op_res_gpointer (result);
+
+  ephy_trace_begin ("Snapshot: prepare");
+  data->snapshot = ephy_snapshot_service_prepare_snapshot (data->surface, data->favicon);
+  ephy_trace_end ("Snapshot: prepare");
+}
+
+/**
+ * ephy_snapshot_service_prepare_snapshot_async:
+ * @service: a #EphySnapshotService
+ * @surface: an image surface with the contents of a web view
+ * @favicon: (allow-none): the favicon of the page
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback
+ * @user_data: user data to pass to @callback
+ *
+ * Runs ephy_snapshot_service_prepare_snapshot() in a worker thread.
+ * Nothing must draw on @surface or @favicon until @callback is called.
+ *
+ **/
+void
+ephy_snapshot_service_prepare_snapshot_async (EphySnapshotService *service,
+                                              cairo_surface_t *surface,
+                                              cairo_surface_t *favicon,
+                                              GCancellable *cancellable,
+                                              GAsyncReadyCallback callback,
+                                              gpointer user_data)
+{
+  GSimpleAsyncResult *result;
+
+  g_return_if_fail (EPHY_IS_SNAPSHOT_SERVICE (service));
+  g_return_if_fail (surface != NULL);
+
+  result = g_simple_async_result_new (G_OBJECT (service), callback, user_data,
+                                      ephy_snapshot_service_prepare_snapshot_async);
+
+  /* Make sure any pending drawing has hit the pixels before another
+     thread reads them. */
+  cairo_surface_flush (surface);
+  if (favicon)
+    cairo_surface_flush (favicon);
+
+  g_simple_async_result_set_op_res_gpointer (result,
+                                             prepare_snapshot_async_data_new (surface, favicon),
+                                             (GDestroyNotify)prepare_snapshot_async_data_free);
+  g_simple_async_result_run_in_thread (result,
+                                       (GSimpleAsyncThreadFunc)prepare_snapshot_thread,
+                                       G_PRIORITY_LOW, cancellable);
+  g_object_unref (result);
+}
+
+/**
+ * ephy_snapshot_service_prepare_snapshot_finish:
+ * @service: a #EphySnapshotService
+ * @result: a #GAsyncResult
+ * @error: a location to store a #GError or %NULL
+ *
+ * Finishes the preparation of a snapshot started with
+ * ephy_snapshot_service_prepare_snapshot_async().
+ *
+ * Returns: (transfer full): the thumbnail.
+ **/
+GdkPixbuf *
+ephy_snapshot_service_prepare_snapshot_finish (EphySnapshotService *service,
+                                               GAsyncResult *result,
+                                               GError **error)
+{
+  GSimpleAsyncResult *simple;
+  PrepareSnapshotAsyncData *data;
+
+  g_return_val_if_fail (EPHY_IS_SNAPSHOT_SERVICE (service), NULL);
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+                                                        G_OBJECT (service),
+                                                        ephy_snapshot_service_prepare_snapshot_async),
+                        NULL);
+
+  simple = (GSimpleAsyncResult *)result;
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return NULL;
+
+  data = (PrepareSnapshotAsyncData *)g_simple_async_result_get_op_res_gpointer (simple);
+
+  return data->snapshot ? g_object_ref (data->snapshot) : NULL;
+}
+
+/**
+ * ephy_snapshot_service_sync:
+ * @service: an #EphySnapshotService
+ *
+ * Writes what is only kept in memory, the frecency of the thumbnails
+ * that were looked up, to disk. Meant to be called on shutdown, as the
+ * default service is never finalized.
+ **/
+void
+ephy_snapshot_service_sync (EphySnapshotService *service)
+{
+  EphySnapshotServicePrivate *priv;
+
+  g_return_if_fail (EPHY_IS_SNAPSHOT_SERVICE (service));
+
+  priv = service->priv;
+
+  /* Don't open the pack just for this. */
+  g_mutex_lock (&priv->pack_mutex);
+  if (priv->pack)
+    ephy_thumbnail_pack_write_scores (priv->pack);
+  g_mutex_unlock (&priv->pack_mutex);
+}
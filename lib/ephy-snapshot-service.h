@@ -84,6 +84,22 @@ GdkPixbuf           *ephy_snapshot_service_get_snapshot_for_url_finish (EphySnap
                                                                         GAsyncResult *result,
                                                                         GError **error);
 
+GdkPixbuf           *ephy_snapshot_service_lookup_cached_snapshot      (EphySnapshotService *service,
+                                                                        const char *url,
+                                                                        time_t mtime);
+
+void                 ephy_snapshot_service_get_snapshots_for_urls_async (EphySnapshotService *service,
+                                                                         const char * const *urls,
+                                                                         const time_t *mtimes,
+                                                                         guint n_urls,
+                                                                         GCancellable *cancellable,
+                                                                         GAsyncReadyCallback callback,
+                                                                         gpointer user_data);
+
+GPtrArray           *ephy_snapshot_service_get_snapshots_for_urls_finish (EphySnapshotService *service,
+                                                                          GAsyncResult *result,
+                                                                          GError **error);
+
 void                 ephy_snapshot_service_get_snapshot_async          (EphySnapshotService *service,
                                                                         WebKitWebView *web_view,
                                                                         const time_t mtime,
@@ -110,6 +126,19 @@ gboolean             ephy_snapshot_service_save_snapshot_finish        (EphySnap
 GdkPixbuf           *ephy_snapshot_service_prepare_snapshot            (cairo_surface_t *surface,
                                                                         cairo_surface_t *favicon);
 
+void                 ephy_snapshot_service_prepare_snapshot_async      (EphySnapshotService *service,
+                                                                        cairo_surface_t *surface,
+                                                                        cairo_surface_t *favicon,
+                                                                        GCancellable *cancellable,
+                                                                        GAsyncReadyCallback callback,
+                                                                        gpointer user_data);
+
+GdkPixbuf           *ephy_snapshot_service_prepare_snapshot_finish     (EphySnapshotService *service,
+                                                                        GAsyncResult *result,
+                                                                        GError **error);
+
+void                 ephy_snapshot_service_sync                        (EphySnapshotService *service);
+
 G_END_DECLS
 
 #endif /* _EPHY_SNAPSHOT_SERVICE_H */
@@ -21,6 +21,8 @@
 #include "config.h"
 #include "ephy-string.h"
 
+#include "ephy-uri-split.h"
+
 #include <errno.h>
 #include <glib.h>
 #include <libsoup/soup.h>
@@ -430,6 +432,7 @@ ephy_string_canonicalize_pathname (const char *cpath)
 char *
 ephy_string_get_host_name (const char *url)
 {
+  EphyUriSplit split;
   SoupURI *uri;
   char *ret;
   
@@ -439,6 +442,9 @@ ephy_string_get_host_name (const char *url)
       g_str_has_prefix (url, "ephy-about:"))
     return NULL;
 
+  if (ephy_uri_split (url, &split))
+    return ephy_uri_split_dup_host (&split);
+
   uri = soup_uri_new (url);
   /* If uri is NULL it's very possible that we just got
    * something without a scheme, let's try to prepend
@@ -0,0 +1,775 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-thumbnail-pack.h"
+
+#include "ephy-debug.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * SECTION:ephy-thumbnail-pack
+ * @short_description: A single file store of thumbnails
+ *
+ * The pack keeps every thumbnail in one append-only file, as raw
+ * RGBA pixels of a fixed size, so that they can be read straight from
+ * a memory map without opening or decoding anything. The index lives
+ * in memory and is rebuilt by walking the record headers when the
+ * pack is opened; a torn record at the end, left by a crash, is cut
+ * off.
+ *
+ * Storing a thumbnail again appends a new record and leaves the old
+ * one dead. ephy_thumbnail_pack_compact() rewrites the file with only
+ * the live records, evicting the ones with the lowest frecency: each
+ * lookup or store bumps a score that halves every week. Scores bumped
+ * by lookups are written back into their records with the next store,
+ * by ephy_thumbnail_pack_write_scores(), or when the pack is freed.
+ *
+ * All functions are thread safe.
+ */
+
+#define PACK_MAGIC "EPHYTHMB"
+#define PACK_VERSION 1
+#define RECORD_MAGIC 0x31434552
+
+#define SCORE_HALF_LIFE (60 * 60 * 24 * 7)
+
+/* URLs longer than this are not worth a thumbnail. */
+#define MAX_URL_LENGTH 8192
+
+#define ALIGN8(n) (((n) + 7) & ~7)
+
+typedef struct {
+  char magic[8];
+  guint32 version;
+  guint32 width;
+  guint32 height;
+  guint32 padding;
+} PackHeader;
+
+/* Followed by the NUL terminated URL, padded to 8 bytes, and the
+ * pixels. */
+typedef struct {
+  guint32 magic;
+  guint32 url_length;
+  gint64 mtime;
+  gdouble score;
+  gint64 score_time;
+} RecordHeader;
+
+typedef struct {
+  char *url;
+  time_t mtime;
+  goffset offset;
+  double score;
+  gint64 score_time;
+  /* The score in the record is out of date. */
+  gboolean score_dirty;
+} PackEntry;
+
+struct _EphyThumbnailPack {
+  GMutex mutex;
+
+  char *filename;
+  int width;
+  int height;
+  gsize pixels_size;
+
+  int fd;
+  goffset end;
+  goffset dead_bytes;
+  GMappedFile *map;
+
+  GHashTable *entries;
+};
+
+static void
+pack_entry_free (PackEntry *entry)
+{
+  g_free (entry->url);
+
+  g_slice_free (PackEntry, entry);
+}
+
+static gsize
+record_size (EphyThumbnailPack *pack,
+             gsize url_length)
+{
+  return sizeof (RecordHeader) + ALIGN8 (url_length + 1) + pack->pixels_size;
+}
+
+static gint64
+now_seconds (void)
+{
+  return g_get_real_time () / G_USEC_PER_SEC;
+}
+
+static double
+entry_current_score (PackEntry *entry,
+                     gint64 now)
+{
+  return entry->score * pow (0.5, (double)(now - entry->score_time) / SCORE_HALF_LIFE);
+}
+
+static void
+entry_touch (PackEntry *entry)
+{
+  gint64 now = now_seconds ();
+
+  entry->score = entry_current_score (entry, now) + 1;
+  entry->score_time = now;
+  entry->score_dirty = TRUE;
+}
+
+static gboolean
+write_all (int fd,
+           const void *data,
+           gsize length,
+           GError **error)
+{
+  const char *p = data;
+
+  while (length > 0) {
+    gssize written = write (fd, p, length);
+
+    if (written < 0) {
+      int errsv = errno;
+
+      if (errsv == EINTR)
+        continue;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "Error writing thumbnail pack: %s", g_strerror (errsv));
+      return FALSE;
+    }
+
+    p += written;
+    length -= written;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+write_header (EphyThumbnailPack *pack,
+              int fd,
+              GError **error)
+{
+  PackHeader header;
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, PACK_MAGIC, sizeof (header.magic));
+  header.version = PACK_VERSION;
+  header.width = pack->width;
+  header.height = pack->height;
+
+  return write_all (fd, &header, sizeof (header), error);
+}
+
+static gboolean
+write_record (EphyThumbnailPack *pack,
+              int fd,
+              PackEntry *entry,
+              const guchar *pixels,
+              int rowstride,
+              GError **error)
+{
+  RecordHeader header;
+  gsize url_length = strlen (entry->url);
+  char padding[8] = { 0 };
+  int y;
+
+  memset (&header, 0, sizeof (header));
+  header.magic = RECORD_MAGIC;
+  header.url_length = url_length;
+  header.mtime = entry->mtime;
+  header.score = entry->score;
+  header.score_time = entry->score_time;
+
+  if (!write_all (fd, &header, sizeof (header), error) ||
+      !write_all (fd, entry->url, url_length, error) ||
+      !write_all (fd, padding, ALIGN8 (url_length + 1) - url_length, error))
+    return FALSE;
+
+  for (y = 0; y < pack->height; y++) {
+    if (!write_all (fd, pixels + y * rowstride, pack->width * 4, error))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Updates the records whose score was bumped since they were written,
+ * in place, so frecency survives restarts without appending anything. */
+static void
+write_scores (EphyThumbnailPack *pack)
+{
+  GHashTableIter iter;
+  PackEntry *entry;
+
+  g_hash_table_iter_init (&iter, pack->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry)) {
+    struct {
+      gdouble score;
+      gint64 score_time;
+    } scores;
+    goffset offset;
+
+    if (!entry->score_dirty)
+      continue;
+
+    scores.score = entry->score;
+    scores.score_time = entry->score_time;
+    offset = entry->offset + G_STRUCT_OFFSET (RecordHeader, score);
+    if (pwrite (pack->fd, &scores, sizeof (scores), offset) != sizeof (scores)) {
+      LOG ("Error writing thumbnail scores: %s", g_strerror (errno));
+      return;
+    }
+
+    entry->score_dirty = FALSE;
+  }
+}
+
+static gboolean
+ensure_mapped (EphyThumbnailPack *pack,
+               goffset end)
+{
+  GError *error = NULL;
+
+  if (pack->map && g_mapped_file_get_length (pack->map) >= end)
+    return TRUE;
+
+  if (pack->map)
+    g_mapped_file_unref (pack->map);
+
+  pack->map = g_mapped_file_new (pack->filename, FALSE, &error);
+  if (pack->map == NULL) {
+    g_warning ("Could not map thumbnail pack %s: %s", pack->filename, error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  return g_mapped_file_get_length (pack->map) >= end;
+}
+
+static gboolean
+reset_pack (EphyThumbnailPack *pack)
+{
+  GError *error = NULL;
+
+  g_hash_table_remove_all (pack->entries);
+  pack->dead_bytes = 0;
+
+  if (ftruncate (pack->fd, 0) < 0 ||
+      lseek (pack->fd, 0, SEEK_SET) < 0 ||
+      !write_header (pack, pack->fd, &error)) {
+    g_warning ("Could not initialize thumbnail pack %s: %s", pack->filename,
+               error ? error->message : g_strerror (errno));
+    g_clear_error (&error);
+    return FALSE;
+  }
+
+  pack->end = sizeof (PackHeader);
+
+  return TRUE;
+}
+
+static void
+load_pack (EphyThumbnailPack *pack)
+{
+  const char *contents;
+  const PackHeader *header;
+  gsize length;
+  goffset offset;
+
+  if (!ensure_mapped (pack, 0)) {
+    reset_pack (pack);
+    return;
+  }
+
+  contents = g_mapped_file_get_contents (pack->map);
+  length = g_mapped_file_get_length (pack->map);
+  header = (const PackHeader *)contents;
+
+  if (length < sizeof (PackHeader) ||
+      memcmp (header->magic, PACK_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != PACK_VERSION ||
+      header->width != pack->width ||
+      header->height != pack->height) {
+    reset_pack (pack);
+    return;
+  }
+
+  offset = sizeof (PackHeader);
+  while (offset + sizeof (RecordHeader) <= length) {
+    RecordHeader record;
+    const char *url;
+    PackEntry *entry, *old;
+
+    memcpy (&record, contents + offset, sizeof (record));
+    if (record.magic != RECORD_MAGIC ||
+        record.url_length > MAX_URL_LENGTH ||
+        offset + record_size (pack, record.url_length) > length)
+      break;
+
+    url = contents + offset + sizeof (RecordHeader);
+    if (url[record.url_length] != '\0')
+      break;
+
+    old = g_hash_table_lookup (pack->entries, url);
+    if (old)
+      pack->dead_bytes += record_size (pack, record.url_length);
+
+    entry = g_slice_new (PackEntry);
+    entry->url = g_strdup (url);
+    entry->mtime = record.mtime;
+    entry->offset = offset;
+    entry->score = record.score;
+    entry->score_time = record.score_time;
+    entry->score_dirty = FALSE;
+    g_hash_table_replace (pack->entries, entry->url, entry);
+
+    offset += record_size (pack, record.url_length);
+  }
+
+  pack->end = offset;
+
+  if (pack->end < length) {
+    LOG ("Dropping %" G_GSIZE_FORMAT " bytes of torn records from thumbnail pack",
+         (gsize)(length - pack->end));
+    g_mapped_file_unref (pack->map);
+    pack->map = NULL;
+    if (ftruncate (pack->fd, pack->end) < 0)
+      reset_pack (pack);
+  }
+}
+
+/**
+ * ephy_thumbnail_pack_new:
+ * @filename: the file holding the pack, created if needed
+ * @width: the width of the thumbnails
+ * @height: the height of the thumbnails
+ *
+ * Opens the thumbnail pack at @filename. A pack with thumbnails of a
+ * different size, or an unreadable one, is started over.
+ *
+ * Returns: a new #EphyThumbnailPack, or %NULL if @filename can't be
+ * opened.
+ **/
+EphyThumbnailPack *
+ephy_thumbnail_pack_new (const char *filename,
+                         int width,
+                         int height)
+{
+  EphyThumbnailPack *pack;
+  int fd;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  fd = g_open (filename, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    g_warning ("Could not open thumbnail pack %s: %s", filename, g_strerror (errno));
+    return NULL;
+  }
+
+  pack = g_slice_new0 (EphyThumbnailPack);
+  g_mutex_init (&pack->mutex);
+  pack->filename = g_strdup (filename);
+  pack->width = width;
+  pack->height = height;
+  pack->pixels_size = width * height * 4;
+  pack->fd = fd;
+  pack->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         NULL, (GDestroyNotify)pack_entry_free);
+
+  ephy_trace_begin ("Thumbnail pack: load");
+  load_pack (pack);
+  ephy_trace_end ("Thumbnail pack: load");
+
+  return pack;
+}
+
+void
+ephy_thumbnail_pack_free (EphyThumbnailPack *pack)
+{
+  g_return_if_fail (pack != NULL);
+
+  write_scores (pack);
+
+  if (pack->map)
+    g_mapped_file_unref (pack->map);
+  close (pack->fd);
+  g_hash_table_destroy (pack->entries);
+  g_free (pack->filename);
+  g_mutex_clear (&pack->mutex);
+
+  g_slice_free (EphyThumbnailPack, pack);
+}
+
+/**
+ * ephy_thumbnail_pack_lookup:
+ * @pack: an #EphyThumbnailPack
+ * @url: the URL of the thumbnail
+ * @mtime: the modification time of the wanted thumbnail
+ *
+ * Returns: (transfer full): the thumbnail of @url, or %NULL if there
+ * isn't one for @mtime.
+ **/
+GdkPixbuf *
+ephy_thumbnail_pack_lookup (EphyThumbnailPack *pack,
+                            const char *url,
+                            time_t mtime)
+{
+  GdkPixbuf *thumbnail = NULL;
+  PackEntry *entry;
+  const guchar *pixels;
+  goffset pixels_offset;
+  guchar *dest;
+  int rowstride, y;
+
+  g_return_val_if_fail (pack != NULL, NULL);
+  g_return_val_if_fail (url != NULL, NULL);
+
+  g_mutex_lock (&pack->mutex);
+
+  entry = g_hash_table_lookup (pack->entries, url);
+  if (entry == NULL || entry->mtime != mtime)
+    goto out;
+
+  pixels_offset = entry->offset + sizeof (RecordHeader) + ALIGN8 (strlen (url) + 1);
+  if (!ensure_mapped (pack, pixels_offset + pack->pixels_size))
+    goto out;
+
+  pixels = (const guchar *)g_mapped_file_get_contents (pack->map) + pixels_offset;
+  thumbnail = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, pack->width, pack->height);
+  dest = gdk_pixbuf_get_pixels (thumbnail);
+  rowstride = gdk_pixbuf_get_rowstride (thumbnail);
+  for (y = 0; y < pack->height; y++)
+    memcpy (dest + y * rowstride, pixels + y * pack->width * 4, pack->width * 4);
+
+  entry_touch (entry);
+
+out:
+  g_mutex_unlock (&pack->mutex);
+
+  return thumbnail;
+}
+
+/**
+ * ephy_thumbnail_pack_store:
+ * @pack: an #EphyThumbnailPack
+ * @url: the URL of the thumbnail
+ * @mtime: the modification time of @thumbnail
+ * @thumbnail: the thumbnail
+ * @error: a location to store a #GError or %NULL
+ *
+ * Appends @thumbnail to @pack, replacing any previous thumbnail of
+ * @url. @thumbnail is scaled if it doesn't have the size of the pack.
+ *
+ * Returns: %TRUE if the thumbnail was stored.
+ **/
+gboolean
+ephy_thumbnail_pack_store (EphyThumbnailPack *pack,
+                           const char *url,
+                           time_t mtime,
+                           GdkPixbuf *thumbnail,
+                           GError **error)
+{
+  GdkPixbuf *pixbuf;
+  PackEntry *entry, *new_entry;
+  gboolean retval = FALSE;
+
+  g_return_val_if_fail (pack != NULL, FALSE);
+  g_return_val_if_fail (url != NULL, FALSE);
+  g_return_val_if_fail (GDK_IS_PIXBUF (thumbnail), FALSE);
+
+  if (strlen (url) > MAX_URL_LENGTH) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NAMETOOLONG,
+                 "URL too long for the thumbnail pack");
+    return FALSE;
+  }
+
+  if (gdk_pixbuf_get_width (thumbnail) != pack->width ||
+      gdk_pixbuf_get_height (thumbnail) != pack->height)
+    pixbuf = gdk_pixbuf_scale_simple (thumbnail, pack->width, pack->height, GDK_INTERP_BILINEAR);
+  else
+    pixbuf = g_object_ref (thumbnail);
+
+  if (!gdk_pixbuf_get_has_alpha (pixbuf)) {
+    GdkPixbuf *with_alpha = gdk_pixbuf_add_alpha (pixbuf, FALSE, 0, 0, 0);
+
+    g_object_unref (pixbuf);
+    pixbuf = with_alpha;
+  }
+
+  g_mutex_lock (&pack->mutex);
+
+  /* Stores happen off the main thread, so this is the time to catch
+   * up with the lookups. */
+  write_scores (pack);
+
+  entry = g_hash_table_lookup (pack->entries, url);
+
+  new_entry = g_slice_new (PackEntry);
+  new_entry->url = g_strdup (url);
+  new_entry->mtime = mtime;
+  new_entry->offset = pack->end;
+  new_entry->score = entry ? entry->score : 0;
+  new_entry->score_time = entry ? entry->score_time : now_seconds ();
+  entry_touch (new_entry);
+
+  if (lseek (pack->fd, pack->end, SEEK_SET) < 0) {
+    int errsv = errno;
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                 "Error writing thumbnail pack: %s", g_strerror (errsv));
+    pack_entry_free (new_entry);
+    goto out;
+  }
+
+  if (!write_record (pack, pack->fd, new_entry,
+                     gdk_pixbuf_get_pixels (pixbuf), gdk_pixbuf_get_rowstride (pixbuf),
+                     error)) {
+    /* Don't leave a torn record behind for the next append. */
+    if (ftruncate (pack->fd, pack->end) < 0)
+      reset_pack (pack);
+    pack_entry_free (new_entry);
+    goto out;
+  }
+
+  new_entry->score_dirty = FALSE;
+  if (entry)
+    pack->dead_bytes += record_size (pack, strlen (url));
+  g_hash_table_replace (pack->entries, new_entry->url, new_entry);
+  pack->end += record_size (pack, strlen (url));
+  retval = TRUE;
+
+out:
+  g_mutex_unlock (&pack->mutex);
+  g_object_unref (pixbuf);
+
+  return retval;
+}
+
+/**
+ * ephy_thumbnail_pack_write_scores:
+ * @pack: an #EphyThumbnailPack
+ *
+ * Writes the scores bumped by lookups since the last store back into
+ * the file. This does file I/O with @pack locked, so call it from a
+ * worker thread.
+ **/
+void
+ephy_thumbnail_pack_write_scores (EphyThumbnailPack *pack)
+{
+  g_return_if_fail (pack != NULL);
+
+  g_mutex_lock (&pack->mutex);
+  write_scores (pack);
+  g_mutex_unlock (&pack->mutex);
+}
+
+guint
+ephy_thumbnail_pack_get_n_entries (EphyThumbnailPack *pack)
+{
+  guint n_entries;
+
+  g_return_val_if_fail (pack != NULL, 0);
+
+  g_mutex_lock (&pack->mutex);
+  n_entries = g_hash_table_size (pack->entries);
+  g_mutex_unlock (&pack->mutex);
+
+  return n_entries;
+}
+
+/**
+ * ephy_thumbnail_pack_needs_compaction:
+ * @pack: an #EphyThumbnailPack
+ * @max_entries: the number of thumbnails to keep
+ *
+ * Returns: %TRUE if @pack has more than @max_entries thumbnails or
+ * is mostly made of replaced ones.
+ **/
+gboolean
+ephy_thumbnail_pack_needs_compaction (EphyThumbnailPack *pack,
+                                      guint max_entries)
+{
+  gboolean needs_compaction;
+
+  g_return_val_if_fail (pack != NULL, FALSE);
+
+  g_mutex_lock (&pack->mutex);
+  needs_compaction = g_hash_table_size (pack->entries) > max_entries ||
+    pack->dead_bytes > pack->end / 2;
+  g_mutex_unlock (&pack->mutex);
+
+  return needs_compaction;
+}
+
+static int
+compare_entries_by_score (PackEntry **a,
+                          PackEntry **b)
+{
+  if ((*a)->score > (*b)->score)
+    return -1;
+  if ((*a)->score < (*b)->score)
+    return 1;
+  return 0;
+}
+
+/**
+ * ephy_thumbnail_pack_compact:
+ * @pack: an #EphyThumbnailPack
+ * @max_entries: the number of thumbnails to keep
+ * @error: a location to store a #GError or %NULL
+ *
+ * Rewrites @pack without replaced thumbnails, keeping at most the
+ * @max_entries ones with the highest frecency. This does file I/O
+ * with @pack locked, so call it from a worker thread.
+ *
+ * Returns: %TRUE if the pack was rewritten.
+ **/
+gboolean
+ephy_thumbnail_pack_compact (EphyThumbnailPack *pack,
+                             guint max_entries,
+                             GError **error)
+{
+  GPtrArray *entries;
+  GArray *offsets;
+  GHashTableIter iter;
+  PackEntry *entry;
+  char *tmp_filename;
+  const char *contents;
+  goffset offset;
+  gint64 now;
+  int fd;
+  guint i;
+  gboolean retval = FALSE;
+
+  g_return_val_if_fail (pack != NULL, FALSE);
+
+  g_mutex_lock (&pack->mutex);
+
+  ephy_trace_begin ("Thumbnail pack: compact");
+
+  if (!ensure_mapped (pack, pack->end)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_IO,
+                 "Could not map thumbnail pack %s", pack->filename);
+    goto out;
+  }
+  contents = g_mapped_file_get_contents (pack->map);
+
+  now = now_seconds ();
+  entries = g_ptr_array_sized_new (g_hash_table_size (pack->entries));
+  g_hash_table_iter_init (&iter, pack->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry)) {
+    entry->score = entry_current_score (entry, now);
+    entry->score_time = now;
+    g_ptr_array_add (entries, entry);
+  }
+  g_ptr_array_sort (entries, (GCompareFunc)compare_entries_by_score);
+
+  tmp_filename = g_strconcat (pack->filename, ".tmp", NULL);
+  fd = g_open (tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    int errsv = errno;
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                 "Could not create %s: %s", tmp_filename, g_strerror (errsv));
+    goto out_free;
+  }
+
+  if (!write_header (pack, fd, error))
+    goto out_close;
+
+  offsets = g_array_sized_new (FALSE, FALSE, sizeof (goffset), entries->len);
+  offset = sizeof (PackHeader);
+  for (i = 0; i < entries->len && i < max_entries; i++) {
+    gsize url_length;
+
+    entry = g_ptr_array_index (entries, i);
+    url_length = strlen (entry->url);
+
+    if (!write_record (pack, fd, entry,
+                       (const guchar *)contents + entry->offset + sizeof (RecordHeader) + ALIGN8 (url_length + 1),
+                       pack->width * 4, error)) {
+      g_array_free (offsets, TRUE);
+      goto out_close;
+    }
+
+    g_array_append_val (offsets, offset);
+    offset += record_size (pack, url_length);
+  }
+
+  if (fsync (fd) < 0 || g_rename (tmp_filename, pack->filename) < 0) {
+    int errsv = errno;
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                 "Could not replace %s: %s", pack->filename, g_strerror (errsv));
+    g_array_free (offsets, TRUE);
+    goto out_close;
+  }
+
+  LOG ("Compacted thumbnail pack from %" G_GINT64_FORMAT " to %" G_GINT64_FORMAT " bytes, %u thumbnails evicted",
+       (gint64)pack->end, (gint64)offset, entries->len - offsets->len);
+
+  /* The file we had open and mapped is now unlinked. */
+  close (pack->fd);
+  pack->fd = fd;
+  fd = -1;
+  g_mapped_file_unref (pack->map);
+  pack->map = NULL;
+
+  for (i = 0; i < entries->len; i++) {
+    entry = g_ptr_array_index (entries, i);
+    if (i < offsets->len) {
+      entry->offset = g_array_index (offsets, goffset, i);
+      entry->score_dirty = FALSE;
+    } else
+      g_hash_table_remove (pack->entries, entry->url);
+  }
+  g_array_free (offsets, TRUE);
+
+  pack->end = offset;
+  pack->dead_bytes = 0;
+  retval = TRUE;
+
+out_close:
+  if (fd >= 0) {
+    close (fd);
+    g_unlink (tmp_filename);
+  }
+out_free:
+  g_free (tmp_filename);
+  g_ptr_array_free (entries, TRUE);
+out:
+  ephy_trace_end ("Thumbnail pack: compact");
+  g_mutex_unlock (&pack->mutex);
+
+  return retval;
+}
@@ -0,0 +1,63 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#if !defined (__EPHY_EPIPHANY_H_INSIDE__) && !defined (EPIPHANY_COMPILATION)
+#error "Only <epiphany/epiphany.h> can be included directly."
+#endif
+
+#ifndef EPHY_THUMBNAIL_PACK_H
+#define EPHY_THUMBNAIL_PACK_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+typedef struct _EphyThumbnailPack EphyThumbnailPack;
+
+EphyThumbnailPack *ephy_thumbnail_pack_new                (const char *filename,
+                                                           int width,
+                                                           int height);
+
+void               ephy_thumbnail_pack_free               (EphyThumbnailPack *pack);
+
+GdkPixbuf         *ephy_thumbnail_pack_lookup             (EphyThumbnailPack *pack,
+                                                           const char *url,
+                                                           time_t mtime);
+
+gboolean           ephy_thumbnail_pack_store              (EphyThumbnailPack *pack,
+                                                           const char *url,
+                                                           time_t mtime,
+                                                           GdkPixbuf *thumbnail,
+                                                           GError **error);
+
+void               ephy_thumbnail_pack_write_scores       (EphyThumbnailPack *pack);
+
+guint              ephy_thumbnail_pack_get_n_entries      (EphyThumbnailPack *pack);
+
+gboolean           ephy_thumbnail_pack_needs_compaction   (EphyThumbnailPack *pack,
+                                                           guint max_entries);
+
+gboolean           ephy_thumbnail_pack_compact            (EphyThumbnailPack *pack,
+                                                           guint max_entries,
+                                                           GError **error);
+
+G_END_DECLS
+
+#endif /* EPHY_THUMBNAIL_PACK_H */
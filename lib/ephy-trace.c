@@ -0,0 +1,445 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-trace.h"
+
+#include "ephy-debug.h"
+
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * SECTION:ephy-trace
+ * @short_description: Lightweight tracing of timed spans and counters
+ *
+ * Every thread records its events into a ring buffer of its own, so
+ * recording takes no lock and tracing is left enabled in release
+ * builds. Only the most recent events of each thread are kept. The
+ * buffers can be written out in the Chrome trace event format, which
+ * chrome://tracing and most trace viewers can load.
+ *
+ * Milestones mark one-off points in the life of the process, like the
+ * steps of startup. Unlike other events they are never overwritten,
+ * and their time can be queried back.
+ */
+
+#define TRACE_BUFFER_SIZE 4096 /* Must be a power of two */
+
+typedef enum {
+  TRACE_EVENT_BEGIN,
+  TRACE_EVENT_END,
+  TRACE_EVENT_ASYNC_BEGIN,
+  TRACE_EVENT_ASYNC_END,
+  TRACE_EVENT_COUNTER,
+  TRACE_EVENT_MILESTONE
+} TraceEventType;
+
+typedef struct {
+  const char *name;
+  gint64 timestamp;
+  gint64 value;
+  TraceEventType type;
+} TraceEvent;
+
+typedef struct {
+  TraceEvent events[TRACE_BUFFER_SIZE];
+
+  /* Number of events ever written. Only the owning thread writes it,
+   * after the event itself is in place. */
+  volatile gsize head;
+
+  guint tid;
+  const char *thread_name;
+  gboolean in_use;
+} TraceBuffer;
+
+static GMutex buffers_lock;
+static GSList *buffers;
+static guint last_tid;
+
+#define MAX_MILESTONES 32
+
+typedef struct {
+  const char *name;
+  gint64 timestamp;
+} Milestone;
+
+static GMutex milestones_lock;
+static Milestone milestones[MAX_MILESTONES];
+static guint n_milestones;
+
+static void
+trace_buffer_release (TraceBuffer *buffer)
+{
+  /* Keep the events of finished threads around until the next new
+   * thread takes the buffer over. */
+  g_mutex_lock (&buffers_lock);
+  buffer->in_use = FALSE;
+  g_mutex_unlock (&buffers_lock);
+}
+
+static GPrivate thread_buffer = G_PRIVATE_INIT ((GDestroyNotify)trace_buffer_release);
+
+static TraceBuffer *
+get_thread_buffer (void)
+{
+  TraceBuffer *buffer;
+  GSList *l;
+
+  buffer = g_private_get (&thread_buffer);
+  if (G_LIKELY (buffer))
+    return buffer;
+
+  g_mutex_lock (&buffers_lock);
+
+  for (l = buffers; l; l = l->next) {
+    TraceBuffer *unused = (TraceBuffer *)l->data;
+
+    if (!unused->in_use) {
+      buffer = unused;
+      break;
+    }
+  }
+
+  if (!buffer) {
+    buffer = g_new0 (TraceBuffer, 1);
+    buffers = g_slist_prepend (buffers, buffer);
+  }
+
+  /* A recycled buffer starts over, so that none of the finished
+   * thread's events are attributed to this one. */
+  buffer->tid = ++last_tid;
+  buffer->head = 0;
+  buffer->in_use = TRUE;
+  buffer->thread_name = NULL;
+
+  g_mutex_unlock (&buffers_lock);
+
+  g_private_set (&thread_buffer, buffer);
+
+  return buffer;
+}
+
+static inline void
+trace_event (TraceEventType type,
+             const char *name,
+             gint64 value)
+{
+  TraceBuffer *buffer = get_thread_buffer ();
+  gsize head = buffer->head;
+  TraceEvent *event;
+
+  event = &buffer->events[head & (TRACE_BUFFER_SIZE - 1)];
+  event->name = name;
+  event->timestamp = g_get_monotonic_time ();
+  event->value = value;
+  event->type = type;
+
+  g_atomic_pointer_set (&buffer->head, head + 1);
+}
+
+/**
+ * ephy_trace_begin:
+ * @name: a static string naming the span
+ *
+ * Opens a span on the calling thread. Spans must be closed with
+ * ephy_trace_end() on the same thread, in nesting order.
+ **/
+void
+ephy_trace_begin (const char *name)
+{
+  trace_event (TRACE_EVENT_BEGIN, name, 0);
+}
+
+/**
+ * ephy_trace_end:
+ * @name: the name given to ephy_trace_begin()
+ *
+ * Closes the innermost span opened on the calling thread.
+ **/
+void
+ephy_trace_end (const char *name)
+{
+  trace_event (TRACE_EVENT_END, name, 0);
+}
+
+/**
+ * ephy_trace_async_begin:
+ * @name: a static string naming the span
+ * @id: an identifier for this instance of the span, usually the object
+ *   the operation belongs to
+ *
+ * Opens a span that is not bound to a call stack, for operations made
+ * of several callbacks. It must be closed with ephy_trace_async_end()
+ * using the same @name and @id, from any thread.
+ **/
+void
+ephy_trace_async_begin (const char *name,
+                        gconstpointer id)
+{
+  trace_event (TRACE_EVENT_ASYNC_BEGIN, name, GPOINTER_TO_SIZE (id));
+}
+
+/**
+ * ephy_trace_async_end:
+ * @name: the name given to ephy_trace_async_begin()
+ * @id: the identifier given to ephy_trace_async_begin()
+ *
+ * Closes a span opened with ephy_trace_async_begin().
+ **/
+void
+ephy_trace_async_end (const char *name,
+                      gconstpointer id)
+{
+  trace_event (TRACE_EVENT_ASYNC_END, name, GPOINTER_TO_SIZE (id));
+}
+
+/**
+ * ephy_trace_counter:
+ * @name: a static string naming the counter
+ * @value: the current value of the counter
+ *
+ * Records a sample of a counter.
+ **/
+void
+ephy_trace_counter (const char *name,
+                    gint64 value)
+{
+  trace_event (TRACE_EVENT_COUNTER, name, value);
+}
+
+/**
+ * ephy_trace_set_thread_name:
+ * @name: a static string
+ *
+ * Names the calling thread in the trace output.
+ **/
+void
+ephy_trace_set_thread_name (const char *name)
+{
+  get_thread_buffer ()->thread_name = name;
+}
+
+/**
+ * ephy_trace_milestone:
+ * @name: a static string naming the milestone
+ *
+ * Records that the process reached the milestone @name. Only the first
+ * time a milestone is reached is recorded.
+ **/
+void
+ephy_trace_milestone (const char *name)
+{
+  gint64 timestamp = g_get_monotonic_time ();
+  guint i;
+
+  g_mutex_lock (&milestones_lock);
+
+  for (i = 0; i < n_milestones; i++) {
+    if (strcmp (milestones[i].name, name) == 0) {
+      g_mutex_unlock (&milestones_lock);
+      return;
+    }
+  }
+
+  if (n_milestones < MAX_MILESTONES) {
+    milestones[n_milestones].name = name;
+    milestones[n_milestones].timestamp = timestamp;
+    n_milestones++;
+  }
+
+  LOG ("Milestone %s reached at %" G_GINT64_FORMAT " ms", name,
+       (timestamp - milestones[0].timestamp) / G_TIME_SPAN_MILLISECOND);
+
+  g_mutex_unlock (&milestones_lock);
+
+  trace_event (TRACE_EVENT_MILESTONE, name, 0);
+}
+
+/**
+ * ephy_trace_get_milestone:
+ * @name: the name of a milestone
+ *
+ * Returns: the monotonic time at which @name was first reached, or -1
+ * if it has not been reached yet
+ **/
+gint64
+ephy_trace_get_milestone (const char *name)
+{
+  gint64 timestamp = -1;
+  guint i;
+
+  g_mutex_lock (&milestones_lock);
+
+  for (i = 0; i < n_milestones; i++) {
+    if (strcmp (milestones[i].name, name) == 0) {
+      timestamp = milestones[i].timestamp;
+      break;
+    }
+  }
+
+  g_mutex_unlock (&milestones_lock);
+
+  return timestamp;
+}
+
+static void
+append_json_string (GString *json,
+                    const char *str)
+{
+  const char *p;
+
+  g_string_append_c (json, '"');
+  for (p = str; *p; p++) {
+    if (*p == '"' || *p == '\\')
+      g_string_append_c (json, '\\');
+
+    if ((guchar)*p < 0x20)
+      g_string_append_printf (json, "\\u%04x", (guchar)*p);
+    else
+      g_string_append_c (json, *p);
+  }
+  g_string_append_c (json, '"');
+}
+
+static void
+append_event (GString *json,
+              TraceEvent *event,
+              int pid,
+              guint tid)
+{
+  static const char *phases[] = { "B", "E", "b", "e", "C", "i" };
+
+  if (json->str[json->len - 1] != '[')
+    g_string_append (json, ",\n");
+
+  g_string_append (json, "{\"name\":");
+  append_json_string (json, event->name);
+  g_string_append_printf (json,
+                          ",\"cat\":\"ephy\",\"ph\":\"%s\",\"ts\":%" G_GINT64_FORMAT
+                          ",\"pid\":%d,\"tid\":%u",
+                          phases[event->type], event->timestamp, pid, tid);
+
+  switch (event->type) {
+  case TRACE_EVENT_ASYNC_BEGIN:
+  case TRACE_EVENT_ASYNC_END:
+    g_string_append_printf (json, ",\"id\":\"0x%" G_GINT64_MODIFIER "x\"", event->value);
+    break;
+  case TRACE_EVENT_COUNTER:
+    g_string_append_printf (json, ",\"args\":{\"value\":%" G_GINT64_FORMAT "}", event->value);
+    break;
+  case TRACE_EVENT_MILESTONE:
+    g_string_append (json, ",\"s\":\"g\"");
+    break;
+  default:
+    break;
+  }
+
+  g_string_append_c (json, '}');
+}
+
+static void
+append_buffer (GString *json,
+               TraceBuffer *buffer,
+               int pid)
+{
+  TraceEvent *events;
+  gsize first, head, written, i;
+
+  if (buffer->thread_name) {
+    if (json->str[json->len - 1] != '[')
+      g_string_append (json, ",\n");
+
+    g_string_append_printf (json,
+                            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+                            pid, buffer->tid);
+    append_json_string (json, buffer->thread_name);
+    g_string_append (json, "}}");
+  }
+
+  /* The owning thread keeps writing while we copy. Take a snapshot and
+   * then drop whatever it may have overwritten in the meantime. */
+  events = g_new (TraceEvent, TRACE_BUFFER_SIZE);
+
+  head = (gsize)g_atomic_pointer_get (&buffer->head);
+  first = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+  for (i = first; i < head; i++)
+    events[i & (TRACE_BUFFER_SIZE - 1)] = buffer->events[i & (TRACE_BUFFER_SIZE - 1)];
+
+  written = (gsize)g_atomic_pointer_get (&buffer->head);
+  if (written >= TRACE_BUFFER_SIZE && first <= written - TRACE_BUFFER_SIZE)
+    first = written - TRACE_BUFFER_SIZE + 1;
+
+  for (i = first; i < head; i++)
+    append_event (json, &events[i & (TRACE_BUFFER_SIZE - 1)], pid, buffer->tid);
+
+  g_free (events);
+}
+
+/**
+ * ephy_trace_to_json:
+ *
+ * Serializes the events currently held by all threads in the Chrome
+ * trace event format.
+ *
+ * Returns: (transfer full): a JSON document
+ **/
+char *
+ephy_trace_to_json (void)
+{
+  GString *json;
+  GSList *l;
+  int pid = getpid ();
+
+  json = g_string_new ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  g_mutex_lock (&buffers_lock);
+  for (l = buffers; l; l = l->next)
+    append_buffer (json, (TraceBuffer *)l->data, pid);
+  g_mutex_unlock (&buffers_lock);
+
+  g_string_append (json, "]}\n");
+
+  return g_string_free (json, FALSE);
+}
+
+/**
+ * ephy_trace_dump:
+ * @filename: the file to write
+ * @error: return location for a #GError, or %NULL
+ *
+ * Writes the output of ephy_trace_to_json() to @filename.
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+ephy_trace_dump (const char *filename,
+                 GError **error)
+{
+  char *json;
+  gboolean retval;
+
+  json = ephy_trace_to_json ();
+  retval = g_file_set_contents (filename, json, -1, error);
+  g_free (json);
+
+  return retval;
+}
@@ -0,0 +1,61 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#if !defined (__EPHY_EPIPHANY_H_INSIDE__) && !defined (EPIPHANY_COMPILATION)
+#error "Only <epiphany/epiphany.h> can be included directly."
+#endif
+
+#ifndef EPHY_TRACE_H
+#define EPHY_TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Event names are stored by pointer, so they must be string literals
+ * or otherwise outlive the process. */
+
+void      ephy_trace_begin           (const char *name);
+
+void      ephy_trace_end             (const char *name);
+
+void      ephy_trace_async_begin     (const char *name,
+                                      gconstpointer id);
+
+void      ephy_trace_async_end       (const char *name,
+                                      gconstpointer id);
+
+void      ephy_trace_counter         (const char *name,
+                                      gint64 value);
+
+void      ephy_trace_set_thread_name (const char *name);
+
+void      ephy_trace_milestone       (const char *name);
+
+gint64    ephy_trace_get_milestone   (const char *name);
+
+char     *ephy_trace_to_json         (void);
+
+gboolean  ephy_trace_dump            (const char *filename,
+                                      GError **error);
+
+G_END_DECLS
+
+#endif
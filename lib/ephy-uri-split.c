@@ -0,0 +1,199 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-uri-split.h"
+
+#include <string.h>
+
+/* This follows what soup_uri_new() does, so that both agree on the
+ * parts of any URI that can be split. URIs that would need some
+ * rewriting, like percent-decoding the host, are not split at all, so
+ * callers can fall back to libsoup for them. */
+
+#define MAX_PORT_DIGITS 5
+
+static const char *
+find_char (const char *start,
+           const char *end,
+           char c)
+{
+  return memchr (start, c, end - start);
+}
+
+/**
+ * ephy_uri_split:
+ * @uri: the URI to split
+ * @split: (out): return location for the parts of @uri
+ *
+ * Splits @uri into its scheme, host, port and path, without copying
+ * any of them.
+ *
+ * Returns: %TRUE if @uri could be split, %FALSE if it is not a valid
+ * URI or soup_uri_new() would have to rewrite its parts.
+ **/
+gboolean
+ephy_uri_split (const char *uri,
+                EphyUriSplit *split)
+{
+  const char *p, *end, *hash, *question;
+
+  g_return_val_if_fail (split, FALSE);
+
+  memset (split, 0, sizeof (EphyUriSplit));
+
+  if (!uri)
+    return FALSE;
+
+  /* Leading and trailing whitespace is ignored. */
+  while (g_ascii_isspace (*uri))
+    uri++;
+  end = uri + strlen (uri);
+  while (end > uri && g_ascii_isspace (*(end - 1)))
+    end--;
+
+  for (p = uri; p < end; p++) {
+    if (*p == '\t' || *p == '\n' || *p == '\r')
+      return FALSE;
+  }
+
+  /* Scheme */
+  p = uri;
+  while (p < end && (g_ascii_isalpha (*p) ||
+                     (p > uri && (g_ascii_isdigit (*p) || *p == '.' || *p == '+' || *p == '-'))))
+    p++;
+
+  if (p == uri || p == end || *p != ':')
+    return FALSE;
+
+  split->scheme = uri;
+  split->scheme_length = p - uri;
+  p++;
+
+  hash = find_char (p, end, '#');
+  if (hash)
+    end = hash;
+
+  /* Authority */
+  if (end - p >= 2 && p[0] == '/' && p[1] == '/') {
+    const char *authority_end, *at, *host_end, *colon;
+
+    p += 2;
+    authority_end = p + strcspn (p, "/?#");
+    if (authority_end > end)
+      authority_end = end;
+
+    at = find_char (p, authority_end, '@');
+    if (at)
+      p = at + 1;
+
+    if (*p == '[') {
+      p++;
+      host_end = find_char (p, authority_end, ']');
+      if (!host_end)
+        return FALSE;
+
+      colon = host_end + 1 < authority_end && host_end[1] == ':' ? host_end + 1 : NULL;
+    } else {
+      colon = find_char (p, authority_end, ':');
+      host_end = colon ? colon : authority_end;
+    }
+
+    if (find_char (p, host_end, '%'))
+      return FALSE;
+
+    split->host = p;
+    split->host_length = host_end - p;
+
+    if (colon && colon != authority_end - 1) {
+      const char *q;
+
+      if (authority_end - colon - 1 > MAX_PORT_DIGITS)
+        return FALSE;
+
+      for (q = colon + 1; q < authority_end; q++) {
+        if (!g_ascii_isdigit (*q))
+          return FALSE;
+        split->port = split->port * 10 + (*q - '0');
+      }
+    }
+
+    p = authority_end;
+  }
+
+  /* HTTP URIs are only valid with a host. */
+  if (!split->host &&
+      (ephy_uri_split_has_scheme (split, "http") || ephy_uri_split_has_scheme (split, "https")))
+    return FALSE;
+
+  question = find_char (p, end, '?');
+  if (question)
+    end = question;
+
+  split->path = p;
+  split->path_length = end - p;
+
+  return TRUE;
+}
+
+/**
+ * ephy_uri_split_has_scheme:
+ * @split: a split URI
+ * @scheme: a lowercase scheme
+ *
+ * Returns: whether the scheme of @split is @scheme, ignoring case.
+ **/
+gboolean
+ephy_uri_split_has_scheme (const EphyUriSplit *split,
+                           const char *scheme)
+{
+  return split->scheme &&
+    g_ascii_strncasecmp (split->scheme, scheme, split->scheme_length) == 0 &&
+    scheme[split->scheme_length] == '\0';
+}
+
+/**
+ * ephy_uri_split_has_host:
+ * @split: a split URI
+ * @host: a host name
+ *
+ * Returns: whether the host of @split is @host.
+ **/
+gboolean
+ephy_uri_split_has_host (const EphyUriSplit *split,
+                         const char *host)
+{
+  return split->host &&
+    strncmp (split->host, host, split->host_length) == 0 &&
+    host[split->host_length] == '\0';
+}
+
+/**
+ * ephy_uri_split_dup_host:
+ * @split: a split URI
+ *
+ * Returns: (transfer full): a copy of the host of @split, or %NULL if
+ * it has none.
+ **/
+char *
+ephy_uri_split_dup_host (const EphyUriSplit *split)
+{
+  return split->host ? g_strndup (split->host, split->host_length) : NULL;
+}
@@ -0,0 +1,63 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#if !defined (__EPHY_EPIPHANY_H_INSIDE__) && !defined (EPIPHANY_COMPILATION)
+#error "Only <epiphany/epiphany.h> can be included directly."
+#endif
+
+#ifndef EPHY_URI_SPLIT_H
+#define EPHY_URI_SPLIT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The parts of a URI, pointing into the string that was split. None
+ * of them are nul-terminated. */
+typedef struct {
+  const char *scheme;
+  gsize scheme_length;
+
+  /* NULL if the URI has no authority. */
+  const char *host;
+  gsize host_length;
+
+  /* 0 if the URI does not say. */
+  guint port;
+
+  /* Not normalized, and empty if the URI has no path. */
+  const char *path;
+  gsize path_length;
+} EphyUriSplit;
+
+gboolean ephy_uri_split           (const char *uri,
+                                   EphyUriSplit *split);
+
+gboolean ephy_uri_split_has_scheme (const EphyUriSplit *split,
+                                    const char *scheme);
+
+gboolean ephy_uri_split_has_host   (const EphyUriSplit *split,
+                                    const char *host);
+
+char    *ephy_uri_split_dup_host   (const EphyUriSplit *split);
+
+G_END_DECLS
+
+#endif /* EPHY_URI_SPLIT_H */
@@ -0,0 +1,784 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-web-app-registry.h"
+
+#include "ephy-debug.h"
+#include "ephy-file-helpers.h"
+
+#include <libsoup/soup.h>
+#include <string.h>
+
+#define EPHY_WEB_APP_REGISTRY_GET_PRIVATE(object) (G_TYPE_INSTANCE_GET_PRIVATE ((object), EPHY_TYPE_WEB_APP_REGISTRY, EphyWebAppRegistryPrivate))
+
+#define INDEX_FILENAME "web-apps.ini"
+
+/* Directories appearing in the profile are usually empty for a moment,
+ * until the desktop file is written. */
+#define RESCAN_DELAY_SECONDS 1
+
+typedef struct {
+  EphyWebApplication *app;
+  char *id;
+  char *origin;
+  gint64 install_time;
+} RegistryEntry;
+
+struct _EphyWebAppRegistryPrivate
+{
+  char *directory;
+  char *index_filename;
+
+  /* Only the cache is used from other threads. */
+  GMutex mutex;
+
+  /* Profile directory name -> RegistryEntry. */
+  GHashTable *entries;
+  /* Name -> RegistryEntry, owned by entries. */
+  GHashTable *by_name;
+  /* Origin -> RegistryEntry, owned by entries. */
+  GHashTable *by_origin;
+
+  GFileMonitor *monitor;
+  guint rescan_id;
+};
+
+enum {
+  PROP_0,
+  PROP_DIRECTORY
+};
+
+enum {
+  CHANGED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+G_DEFINE_TYPE (EphyWebAppRegistry, ephy_web_app_registry, G_TYPE_OBJECT)
+
+static char *
+get_origin (const char *address)
+{
+  SoupURI *uri;
+  char *origin = NULL;
+
+  uri = soup_uri_new (address);
+  if (!uri)
+    return NULL;
+
+  if (uri->host)
+    origin = g_strdup_printf ("%s://%s:%u", uri->scheme, uri->host, uri->port);
+  soup_uri_free (uri);
+
+  return origin;
+}
+
+static EphyWebApplication *
+ephy_web_application_copy (EphyWebApplication *app)
+{
+  EphyWebApplication *copy;
+
+  copy = g_slice_new0 (EphyWebApplication);
+  copy->name = g_strdup (app->name);
+  copy->icon_url = g_strdup (app->icon_url);
+  copy->url = g_strdup (app->url);
+  copy->desktop_file = g_strdup (app->desktop_file);
+  memcpy (copy->install_date, app->install_date, sizeof (app->install_date));
+
+  return copy;
+}
+
+static RegistryEntry *
+registry_entry_new (EphyWebAppRegistry *registry,
+                    const char *id,
+                    char *name,
+                    char *url,
+                    gint64 install_time)
+{
+  RegistryEntry *entry;
+  GDate *date;
+
+  entry = g_slice_new0 (RegistryEntry);
+  entry->id = g_strdup (id);
+  entry->origin = get_origin (url);
+  entry->install_time = install_time;
+
+  entry->app = g_slice_new0 (EphyWebApplication);
+  entry->app->name = name;
+  entry->app->url = url;
+  entry->app->icon_url = g_build_filename (registry->priv->directory, id, EPHY_WEB_APP_ICON_NAME, NULL);
+  entry->app->desktop_file = g_strconcat (id + strlen (EPHY_WEB_APP_PREFIX), ".desktop", NULL);
+
+  date = g_date_new ();
+  g_date_set_time_t (date, (time_t)install_time);
+  g_date_strftime (entry->app->install_date, sizeof (entry->app->install_date) - 1, "%x", date);
+  g_date_free (date);
+
+  return entry;
+}
+
+static void
+registry_entry_free (RegistryEntry *entry)
+{
+  ephy_web_application_free (entry->app);
+  g_free (entry->id);
+  g_free (entry->origin);
+  g_slice_free (RegistryEntry, entry);
+}
+
+/* Parses the desktop file of the application in the profile directory
+ * @id. This is what the registry saves having to do for every app. */
+static RegistryEntry *
+registry_entry_load (EphyWebAppRegistry *registry,
+                     const char *id)
+{
+  RegistryEntry *entry = NULL;
+  GKeyFile *key;
+  GFile *file;
+  GFileInfo *info;
+  char *desktop_file_path, *desktop_file;
+  char *name, *exec;
+  char **strings;
+  int i;
+
+  desktop_file = g_strconcat (id + strlen (EPHY_WEB_APP_PREFIX), ".desktop", NULL);
+  desktop_file_path = g_build_filename (registry->priv->directory, id, desktop_file, NULL);
+  g_free (desktop_file);
+
+  key = g_key_file_new ();
+  if (!g_key_file_load_from_file (key, desktop_file_path, G_KEY_FILE_NONE, NULL))
+    goto out;
+
+  exec = g_key_file_get_string (key, "Desktop Entry", "Exec", NULL);
+  if (!exec)
+    goto out;
+
+  name = g_key_file_get_string (key, "Desktop Entry", "Name", NULL);
+  strings = g_strsplit (exec, " ", -1);
+  for (i = 0; strings[i]; i++);
+
+  /* FIXME: this should use TIME_CREATED but it does not seem to be working. */
+  file = g_file_new_for_path (desktop_file_path);
+  info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED, 0, NULL, NULL);
+  g_object_unref (file);
+
+  entry = registry_entry_new (registry, id, name, g_strdup (i > 0 ? strings[i - 1] : ""),
+                              info ? g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) : 0);
+
+  if (info)
+    g_object_unref (info);
+  g_strfreev (strings);
+  g_free (exec);
+
+out:
+  g_key_file_free (key);
+  g_free (desktop_file_path);
+
+  return entry;
+}
+
+/* Must be called with the mutex held. */
+static gboolean
+registry_remove (EphyWebAppRegistry *registry,
+                 const char *id)
+{
+  EphyWebAppRegistryPrivate *priv = registry->priv;
+  RegistryEntry *entry;
+
+  entry = g_hash_table_lookup (priv->entries, id);
+  if (!entry)
+    return FALSE;
+
+  if (entry->app->name && g_hash_table_lookup (priv->by_name, entry->app->name) == entry)
+    g_hash_table_remove (priv->by_name, entry->app->name);
+
+  if (entry->origin && g_hash_table_lookup (priv->by_origin, entry->origin) == entry) {
+    GHashTableIter iter;
+    RegistryEntry *other;
+
+    g_hash_table_remove (priv->by_origin, entry->origin);
+
+    /* Another app of the same origin takes its place. */
+    g_hash_table_iter_init (&iter, priv->entries);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&other)) {
+      if (other != entry && g_strcmp0 (other->origin, entry->origin) == 0) {
+        g_hash_table_insert (priv->by_origin, other->origin, other);
+        break;
+      }
+    }
+  }
+
+  g_hash_table_remove (priv->entries, id);
+
+  return TRUE;
+}
+
+/* Must be called with the mutex held. */
+static void
+registry_insert (EphyWebAppRegistry *registry,
+                 RegistryEntry *entry)
+{
+  EphyWebAppRegistryPrivate *priv = registry->priv;
+
+  registry_remove (registry, entry->id);
+
+  g_hash_table_insert (priv->entries, entry->id, entry);
+  if (entry->app->name)
+    g_hash_table_replace (priv->by_name, entry->app->name, entry);
+  if (entry->origin && !g_hash_table_lookup (priv->by_origin, entry->origin))
+    g_hash_table_insert (priv->by_origin, entry->origin, entry);
+}
+
+static void
+ephy_web_app_registry_save (EphyWebAppRegistry *registry)
+{
+  EphyWebAppRegistryPrivate *priv = registry->priv;
+  GKeyFile *key_file;
+  GHashTableIter iter;
+  RegistryEntry *entry;
+  char *data;
+  gsize length;
+  guint i = 0;
+  GError *error = NULL;
+
+  key_file = g_key_file_new ();
+
+  g_mutex_lock (&priv->mutex);
+  g_hash_table_iter_init (&iter, priv->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry)) {
+    char *group = g_strdup_printf ("web-app-%u", i++);
+
+    /* Profile directory names are not valid group names. */
+    g_key_file_set_string (key_file, group, "Directory", entry->id);
+    if (entry->app->name)
+      g_key_file_set_string (key_file, group, "Name", entry->app->name);
+    g_key_file_set_string (key_file, group, "URL", entry->app->url);
+    g_key_file_set_int64 (key_file, group, "InstallTime", entry->install_time);
+    g_free (group);
+  }
+  g_mutex_unlock (&priv->mutex);
+
+  data = g_key_file_to_data (key_file, &length, NULL);
+  if (!g_file_set_contents (priv->index_filename, data, length, &error)) {
+    g_warning ("Could not save the web applications index: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (data);
+  g_key_file_free (key_file);
+}
+
+static gboolean
+ephy_web_app_registry_load_index (EphyWebAppRegistry *registry)
+{
+  EphyWebAppRegistryPrivate *priv = registry->priv;
+  GKeyFile *key_file;
+  char **groups;
+  guint i;
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, priv->index_filename, G_KEY_FILE_NONE, NULL)) {
+    g_key_file_free (key_file);
+    return FALSE;
+  }
+
+  groups = g_key_file_get_groups (key_file, NULL);
+  for (i = 0; groups[i]; i++) {
+    char *id, *url;
+
+    id = g_key_file_get_string (key_file, groups[i], "Directory", NULL);
+    url = g_key_file_get_string (key_file, groups[i], "URL", NULL);
+
+    if (id && url && g_str_has_prefix (id, EPHY_WEB_APP_PREFIX)) {
+      registry_insert (registry,
+                       registry_entry_new (registry, id,
+                                           g_key_file_get_string (key_file, groups[i], "Name", NULL),
+                                           url,
+                                           g_key_file_get_int64 (key_file, groups[i], "InstallTime", NULL)));
+    } else {
+      g_free (url);
+    }
+    g_free (id);
+  }
+
+  g_strfreev (groups);
+  g_key_file_free (key_file);
+
+  return TRUE;
+}
+
+/* Brings the cache in line with the profile directories that exist. Only
+ * the names are listed; desktop files are parsed for new apps alone. */
+static gboolean
+ephy_web_app_registry_sync (EphyWebAppRegistry *registry)
+{
+  EphyWebAppRegistryPrivate *priv = registry->priv;
+  GFileEnumerator *children;
+  GFileInfo *info;
+  GFile *directory;
+  GHashTable *seen;
+  GHashTableIter iter;
+  GList *new_entries = NULL, *gone = NULL, *l;
+  const char *id;
+  gboolean changed;
+
+  directory = g_file_new_for_path (priv->directory);
+  children = g_file_enumerate_children (directory, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                        0, NULL, NULL);
+  g_object_unref (directory);
+  if (!children)
+    return FALSE;
+
+  seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  while ((info = g_file_enumerator_next_file (children, NULL, NULL))) {
+    const char *name = g_file_info_get_name (info);
+
+    if (g_str_has_prefix (name, EPHY_WEB_APP_PREFIX)) {
+      g_hash_table_add (seen, g_strdup (name));
+
+      g_mutex_lock (&priv->mutex);
+      if (!g_hash_table_contains (priv->entries, name)) {
+        RegistryEntry *entry;
+
+        g_mutex_unlock (&priv->mutex);
+        entry = registry_entry_load (registry, name);
+        if (entry)
+          new_entries = g_list_prepend (new_entries, entry);
+      } else {
+        g_mutex_unlock (&priv->mutex);
+      }
+    }
+
+    g_object_unref (info);
+  }
+  g_object_unref (children);
+
+  g_mutex_lock (&priv->mutex);
+  for (l = new_entries; l; l = l->next)
+    registry_insert (registry, l->data);
+
+  g_hash_table_iter_init (&iter, priv->entries);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&id, NULL)) {
+    if (!g_hash_table_contains (seen, id))
+      gone = g_list_prepend (gone, g_strdup (id));
+  }
+  for (l = gone; l; l = l->next)
+    registry_remove (registry, l->data);
+  g_mutex_unlock (&priv->mutex);
+
+  changed = new_entries != NULL || gone != NULL;
+
+  g_list_free (new_entries);
+  g_list_free_full (gone, g_free);
+  g_hash_table_destroy (seen);
+
+  return changed;
+}
+
+static gboolean
+rescan_cb (EphyWebAppRegistry *registry)
+{
+  registry->priv->rescan_id = 0;
+
+  if (ephy_web_app_registry_sync (registry)) {
+    ephy_web_app_registry_save (registry);
+    g_signal_emit (registry, signals[CHANGED], 0);
+  }
+
+  return FALSE;
+}
+
+static void
+directory_changed_cb (GFileMonitor *monitor,
+                      GFile *file,
+                      GFile *other_file,
+                      GFileMonitorEvent event_type,
+                      EphyWebAppRegistry *registry)
+{
+  char *name;
+
+  if (event_type != G_FILE_MONITOR_EVENT_CREATED &&
+      event_type != G_FILE_MONITOR_EVENT_DELETED &&
+      event_type != G_FILE_MONITOR_EVENT_MOVED)
+    return;
+
+  /* Only profile directories matter, not the history or the cookies. */
+  name = g_file_get_basename (file);
+  if (g_str_has_prefix (name, EPHY_WEB_APP_PREFIX) && registry->priv->rescan_id == 0) {
+    registry->priv->rescan_id = g_timeout_add_seconds (RESCAN_DELAY_SECONDS,
+                                                       (GSourceFunc)rescan_cb,
+                                                       registry);
+  }
+  g_free (name);
+}
+
+static void
+ephy_web_app_registry_set_property (GObject *object,
+                                    guint prop_id,
+                                    const GValue *value,
+                                    GParamSpec *pspec)
+{
+  EphyWebAppRegistry *registry = EPHY_WEB_APP_REGISTRY (object);
+
+  switch (prop_id) {
+  case PROP_DIRECTORY:
+    registry->priv->directory = g_value_dup_string (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+ephy_web_app_registry_get_property (GObject *object,
+                                    guint prop_id,
+                                    GValue *value,
+                                    GParamSpec *pspec)
+{
+  EphyWebAppRegistry *registry = EPHY_WEB_APP_REGISTRY (object);
+
+  switch (prop_id) {
+  case PROP_DIRECTORY:
+    g_value_set_string (value, registry->priv->directory);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+ephy_web_app_registry_constructed (GObject *object)
+{
+  EphyWebAppRegistry *registry = EPHY_WEB_APP_REGISTRY (object);
+  EphyWebAppRegistryPrivate *priv = registry->priv;
+  GFile *directory;
+  gboolean had_index;
+
+  G_OBJECT_CLASS (ephy_web_app_registry_parent_class)->constructed (object);
+
+  priv->index_filename = g_build_filename (priv->directory, INDEX_FILENAME, NULL);
+
+  had_index = ephy_web_app_registry_load_index (registry);
+  if (ephy_web_app_registry_sync (registry) || !had_index)
+    ephy_web_app_registry_save (registry);
+
+  LOG ("Web application registry for %s: %u applications",
+       priv->directory, g_hash_table_size (priv->entries));
+
+  directory = g_file_new_for_path (priv->directory);
+  priv->monitor = g_file_monitor_directory (directory, G_FILE_MONITOR_NONE, NULL, NULL);
+  if (priv->monitor)
+    g_signal_connect (priv->monitor, "changed",
+                      G_CALLBACK (directory_changed_cb), registry);
+  g_object_unref (directory);
+}
+
+static void
+ephy_web_app_registry_dispose (GObject *object)
+{
+  EphyWebAppRegistryPrivate *priv = EPHY_WEB_APP_REGISTRY (object)->priv;
+
+  if (priv->rescan_id) {
+    g_source_remove (priv->rescan_id);
+    priv->rescan_id = 0;
+  }
+
+  if (priv->monitor) {
+    g_file_monitor_cancel (priv->monitor);
+    g_clear_object (&priv->monitor);
+  }
+
+  G_OBJECT_CLASS (ephy_web_app_registry_parent_class)->dispose (object);
+}
+
+static void
+ephy_web_app_registry_finalize (GObject *object)
+{
+  EphyWebAppRegistryPrivate *priv = EPHY_WEB_APP_REGISTRY (object)->priv;
+
+  g_hash_table_destroy (priv->by_origin);
+  g_hash_table_destroy (priv->by_name);
+  g_hash_table_destroy (priv->entries);
+  g_mutex_clear (&priv->mutex);
+  g_free (priv->index_filename);
+  g_free (priv->directory);
+
+  G_OBJECT_CLASS (ephy_web_app_registry_parent_class)->finalize (object);
+}
+
+static void
+ephy_web_app_registry_init (EphyWebAppRegistry *registry)
+{
+  EphyWebAppRegistryPrivate *priv;
+
+  priv = registry->priv = EPHY_WEB_APP_REGISTRY_GET_PRIVATE (registry);
+
+  g_mutex_init (&priv->mutex);
+  priv->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         NULL, (GDestroyNotify)registry_entry_free);
+  priv->by_name = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->by_origin = g_hash_table_new (g_str_hash, g_str_equal);
+}
+
+static void
+ephy_web_app_registry_class_init (EphyWebAppRegistryClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = ephy_web_app_registry_set_property;
+  object_class->get_property = ephy_web_app_registry_get_property;
+  object_class->constructed = ephy_web_app_registry_constructed;
+  object_class->dispose = ephy_web_app_registry_dispose;
+  object_class->finalize = ephy_web_app_registry_finalize;
+
+  g_object_class_install_property (object_class,
+                                   PROP_DIRECTORY,
+                                   g_param_spec_string ("directory",
+                                                        "Directory",
+                                                        "The profile directory of the web applications",
+                                                        NULL,
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * EphyWebAppRegistry::changed:
+   * @registry: the #EphyWebAppRegistry
+   *
+   * Emitted when web applications are installed or removed, by this
+   * process or any other.
+   **/
+  signals[CHANGED] =
+    g_signal_new ("changed",
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (EphyWebAppRegistryClass, changed),
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE,
+                  0);
+
+  g_type_class_add_private (object_class, sizeof (EphyWebAppRegistryPrivate));
+}
+
+/**
+ * ephy_web_app_registry_new:
+ * @directory: the profile directory the web applications live in
+ *
+ * Creates a registry of the web applications in @directory. The index
+ * kept there is read, and only the applications it does not know about
+ * have their desktop files parsed.
+ *
+ * Returns: (transfer full): a new #EphyWebAppRegistry
+ **/
+EphyWebAppRegistry *
+ephy_web_app_registry_new (const char *directory)
+{
+  g_return_val_if_fail (directory != NULL, NULL);
+
+  return g_object_new (EPHY_TYPE_WEB_APP_REGISTRY,
+                       "directory", directory,
+                       NULL);
+}
+
+/**
+ * ephy_web_app_registry_get_default:
+ *
+ * Gets the registry of the web applications in the current profile.
+ *
+ * Returns: (transfer none): the default #EphyWebAppRegistry
+ **/
+EphyWebAppRegistry *
+ephy_web_app_registry_get_default (void)
+{
+  static gsize registry = 0;
+
+  if (g_once_init_enter (&registry))
+    g_once_init_leave (&registry, (gsize)ephy_web_app_registry_new (ephy_dot_dir ()));
+
+  return EPHY_WEB_APP_REGISTRY (registry);
+}
+
+static int
+compare_applications (EphyWebApplication *a,
+                      EphyWebApplication *b)
+{
+  return g_strcmp0 (a->name, b->name);
+}
+
+/**
+ * ephy_web_app_registry_get_applications:
+ * @registry: an #EphyWebAppRegistry
+ *
+ * Gets the installed web applications, sorted by name. Free the list
+ * with ephy_web_application_free_application_list().
+ *
+ * Returns: (transfer full): a #GList of #EphyWebApplication
+ **/
+GList *
+ephy_web_app_registry_get_applications (EphyWebAppRegistry *registry)
+{
+  GHashTableIter iter;
+  RegistryEntry *entry;
+  GList *applications = NULL;
+
+  g_return_val_if_fail (EPHY_IS_WEB_APP_REGISTRY (registry), NULL);
+
+  g_mutex_lock (&registry->priv->mutex);
+  g_hash_table_iter_init (&iter, registry->priv->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry))
+    applications = g_list_prepend (applications, ephy_web_application_copy (entry->app));
+  g_mutex_unlock (&registry->priv->mutex);
+
+  return g_list_sort (applications, (GCompareFunc)compare_applications);
+}
+
+/**
+ * ephy_web_app_registry_get_n_applications:
+ * @registry: an #EphyWebAppRegistry
+ *
+ * Returns: the number of installed web applications
+ **/
+guint
+ephy_web_app_registry_get_n_applications (EphyWebAppRegistry *registry)
+{
+  guint n_applications;
+
+  g_return_val_if_fail (EPHY_IS_WEB_APP_REGISTRY (registry), 0);
+
+  g_mutex_lock (&registry->priv->mutex);
+  n_applications = g_hash_table_size (registry->priv->entries);
+  g_mutex_unlock (&registry->priv->mutex);
+
+  return n_applications;
+}
+
+/**
+ * ephy_web_app_registry_lookup_by_name:
+ * @registry: an #EphyWebAppRegistry
+ * @name: the name of a web application
+ *
+ * Returns: (transfer full): the web application called @name, to be
+ * freed with ephy_web_application_free(), or %NULL
+ **/
+EphyWebApplication *
+ephy_web_app_registry_lookup_by_name (EphyWebAppRegistry *registry,
+                                      const char *name)
+{
+  RegistryEntry *entry;
+  EphyWebApplication *app = NULL;
+
+  g_return_val_if_fail (EPHY_IS_WEB_APP_REGISTRY (registry), NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  g_mutex_lock (&registry->priv->mutex);
+  entry = g_hash_table_lookup (registry->priv->by_name, name);
+  if (entry)
+    app = ephy_web_application_copy (entry->app);
+  g_mutex_unlock (&registry->priv->mutex);
+
+  return app;
+}
+
+/**
+ * ephy_web_app_registry_lookup_by_origin:
+ * @registry: an #EphyWebAppRegistry
+ * @address: an address
+ *
+ * Finds a web application for the scheme, host and port of @address.
+ *
+ * Returns: (transfer full): the web application, to be freed with
+ * ephy_web_application_free(), or %NULL
+ **/
+EphyWebApplication *
+ephy_web_app_registry_lookup_by_origin (EphyWebAppRegistry *registry,
+                                        const char *address)
+{
+  RegistryEntry *entry;
+  EphyWebApplication *app = NULL;
+  char *origin;
+
+  g_return_val_if_fail (EPHY_IS_WEB_APP_REGISTRY (registry), NULL);
+  g_return_val_if_fail (address != NULL, NULL);
+
+  origin = get_origin (address);
+  if (!origin)
+    return NULL;
+
+  g_mutex_lock (&registry->priv->mutex);
+  entry = g_hash_table_lookup (registry->priv->by_origin, origin);
+  if (entry)
+    app = ephy_web_application_copy (entry->app);
+  g_mutex_unlock (&registry->priv->mutex);
+
+  g_free (origin);
+
+  return app;
+}
+
+/* Called by ephy_web_application_create() once the desktop file of the
+ * application in @profile_dir has been written. */
+void
+_ephy_web_app_registry_add (EphyWebAppRegistry *registry,
+                            const char *profile_dir)
+{
+  RegistryEntry *entry;
+  char *id;
+
+  g_return_if_fail (EPHY_IS_WEB_APP_REGISTRY (registry));
+
+  id = g_path_get_basename (profile_dir);
+  entry = registry_entry_load (registry, id);
+  g_free (id);
+
+  if (!entry)
+    return;
+
+  g_mutex_lock (&registry->priv->mutex);
+  registry_insert (registry, entry);
+  g_mutex_unlock (&registry->priv->mutex);
+
+  ephy_web_app_registry_save (registry);
+  g_signal_emit (registry, signals[CHANGED], 0);
+}
+
+/* Called by ephy_web_application_delete() once @profile_dir is gone. */
+void
+_ephy_web_app_registry_remove (EphyWebAppRegistry *registry,
+                               const char *profile_dir)
+{
+  gboolean removed;
+  char *id;
+
+  g_return_if_fail (EPHY_IS_WEB_APP_REGISTRY (registry));
+
+  id = g_path_get_basename (profile_dir);
+  g_mutex_lock (&registry->priv->mutex);
+  removed = registry_remove (registry, id);
+  g_mutex_unlock (&registry->priv->mutex);
+  g_free (id);
+
+  if (removed) {
+    ephy_web_app_registry_save (registry);
+    g_signal_emit (registry, signals[CHANGED], 0);
+  }
+}
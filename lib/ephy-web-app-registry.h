@@ -0,0 +1,84 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#if !defined (__EPHY_EPIPHANY_H_INSIDE__) && !defined (EPIPHANY_COMPILATION)
+#error "Only <epiphany/epiphany.h> can be included directly."
+#endif
+
+#ifndef EPHY_WEB_APP_REGISTRY_H
+#define EPHY_WEB_APP_REGISTRY_H
+
+#include <glib-object.h>
+
+#include "ephy-web-app-utils.h"
+
+G_BEGIN_DECLS
+
+#define EPHY_TYPE_WEB_APP_REGISTRY            (ephy_web_app_registry_get_type())
+#define EPHY_WEB_APP_REGISTRY(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), EPHY_TYPE_WEB_APP_REGISTRY, EphyWebAppRegistry))
+#define EPHY_WEB_APP_REGISTRY_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), EPHY_TYPE_WEB_APP_REGISTRY, EphyWebAppRegistryClass))
+#define EPHY_IS_WEB_APP_REGISTRY(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EPHY_TYPE_WEB_APP_REGISTRY))
+#define EPHY_IS_WEB_APP_REGISTRY_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EPHY_TYPE_WEB_APP_REGISTRY))
+#define EPHY_WEB_APP_REGISTRY_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), EPHY_TYPE_WEB_APP_REGISTRY, EphyWebAppRegistryClass))
+
+typedef struct _EphyWebAppRegistry        EphyWebAppRegistry;
+typedef struct _EphyWebAppRegistryClass   EphyWebAppRegistryClass;
+typedef struct _EphyWebAppRegistryPrivate EphyWebAppRegistryPrivate;
+
+struct _EphyWebAppRegistry
+{
+  GObject parent;
+
+  /*< private >*/
+  EphyWebAppRegistryPrivate *priv;
+};
+
+struct _EphyWebAppRegistryClass
+{
+  GObjectClass parent_class;
+
+  void (* changed) (EphyWebAppRegistry *registry);
+};
+
+GType               ephy_web_app_registry_get_type          (void) G_GNUC_CONST;
+
+EphyWebAppRegistry *ephy_web_app_registry_new               (const char *directory);
+
+EphyWebAppRegistry *ephy_web_app_registry_get_default       (void);
+
+GList              *ephy_web_app_registry_get_applications  (EphyWebAppRegistry *registry);
+
+guint               ephy_web_app_registry_get_n_applications (EphyWebAppRegistry *registry);
+
+EphyWebApplication *ephy_web_app_registry_lookup_by_name    (EphyWebAppRegistry *registry,
+                                                             const char *name);
+
+EphyWebApplication *ephy_web_app_registry_lookup_by_origin  (EphyWebAppRegistry *registry,
+                                                             const char *address);
+
+void                _ephy_web_app_registry_add              (EphyWebAppRegistry *registry,
+                                                             const char *profile_dir);
+
+void                _ephy_web_app_registry_remove           (EphyWebAppRegistry *registry,
+                                                             const char *profile_dir);
+
+G_END_DECLS
+
+#endif /* EPHY_WEB_APP_REGISTRY_H */
@@ -24,6 +24,7 @@
 
 #include "ephy-debug.h"
 #include "ephy-file-helpers.h"
+#include "ephy-web-app-registry.h"
 
 #include <glib/gstdio.h>
 #include <libsoup/soup.h>
@@ -145,6 +146,8 @@ ephy_web_application_delete (const char *name)
     goto out;
   LOG ("Deleted application profile.\n");
 
+  _ephy_web_app_registry_remove (ephy_web_app_registry_get_default (), profile_dir);
+
   wm_class = get_wm_class_from_app_title (name);
   desktop_file = desktop_filename_from_wm_class (wm_class);
   g_free (wm_class);
@@ -366,6 +369,8 @@ ephy_web_application_create (const char *address, const char *name, GdkPixbuf *i
 
   /* Create the deskop file. */
   desktop_file_path = create_desktop_file (address, profile_dir, name, icon);
+  if (desktop_file_path)
+    _ephy_web_app_registry_add (ephy_web_app_registry_get_default (), profile_dir);
 
 out:
   if (profile_dir)
@@ -386,95 +391,16 @@ out:
 GList *
 ephy_web_application_get_application_list ()
 {
-  GFileEnumerator *children = NULL;
-  GFileInfo *info;
-  GList *applications = NULL;
-  GFile *dot_dir;
-
-  dot_dir = g_file_new_for_path (ephy_dot_dir ());
-  children = g_file_enumerate_children (dot_dir,
-                                        "standard::name",
-                                        0, NULL, NULL);
-  g_object_unref (dot_dir);
-
-  info = g_file_enumerator_next_file (children, NULL, NULL);
-  while (info) {
-    EphyWebApplication *app;
-    const char *name;
-    glong prefix_length = g_utf8_strlen (EPHY_WEB_APP_PREFIX, -1);
-
-    name = g_file_info_get_name (info);
-    if (g_str_has_prefix (name, EPHY_WEB_APP_PREFIX)) {
-      char *profile_dir;
-      guint64 created;
-      GDate *date;
-      char *desktop_file, *desktop_file_path;
-      char *contents;
-      GFileInfo *desktop_info;
-
-      app = g_slice_new0 (EphyWebApplication);
-
-      profile_dir = g_build_filename (ephy_dot_dir (), name, NULL);
-      app->icon_url = g_build_filename (profile_dir, EPHY_WEB_APP_ICON_NAME, NULL);
-
-      desktop_file = g_strconcat (name + prefix_length, ".desktop", NULL);
-      desktop_file_path = g_build_filename (profile_dir, desktop_file, NULL);
-      app->desktop_file = g_strdup (desktop_file);
-
-      if (g_file_get_contents (desktop_file_path, &contents, NULL, NULL)) {
-        char *exec;
-        char **strings;
-        GKeyFile *key;
-        int i;
-        GFile *file;
-
-        key = g_key_file_new ();
-        g_key_file_load_from_data (key, contents, -1, 0, NULL);
-        app->name = g_key_file_get_string (key, "Desktop Entry", "Name", NULL);
-        exec = g_key_file_get_string (key, "Desktop Entry", "Exec", NULL);
-        strings = g_strsplit (exec, " ", -1);
-
-        for (i = 0; strings[i]; i++);
-        app->url = g_strdup (strings[i - 1]);
-
-        g_strfreev (strings);
-        g_free (exec);
-        g_key_file_free (key);
-
-        file = g_file_new_for_path (desktop_file_path);
-
-        /* FIXME: this should use TIME_CREATED but it does not seem to be working. */
-        desktop_info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED, 0, NULL, NULL);
-        created = g_file_info_get_attribute_uint64 (desktop_info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
-
-        date = g_date_new ();
-        g_date_set_time_t (date, (time_t)created);
-        g_date_strftime (app->install_date, 127, "%x", date);
-
-        g_date_free (date);
-        g_object_unref (file);
-        g_object_unref (desktop_info);
-
-        applications = g_list_append (applications, app);
-      }
-
-      g_free (contents);
-      g_free (desktop_file);
-      g_free (profile_dir);
-      g_free (desktop_file_path);
-    }
-
-    g_object_unref (info);
-
-    info = g_file_enumerator_next_file (children, NULL, NULL);
-  }
-
-  g_object_unref (children);
-
-  return applications;
+  return ephy_web_app_registry_get_applications (ephy_web_app_registry_get_default ());
 }
 
-static void
+/**
+ * ephy_web_application_free:
+ * @app: an #EphyWebApplication
+ *
+ * Frees @app.
+ **/
+void
 ephy_web_application_free (EphyWebApplication *app)
 {
   g_free (app->name);
@@ -510,9 +436,18 @@ ephy_web_application_free_application_list (GList *list)
 gboolean
 ephy_web_application_exists (const char *name)
 {
+  EphyWebApplication *app;
   char *profile_dir;
   gboolean profile_exists;
 
+  app = ephy_web_app_registry_lookup_by_name (ephy_web_app_registry_get_default (), name);
+  if (app) {
+    ephy_web_application_free (app);
+    return TRUE;
+  }
+
+  /* The registry only knows applications with a readable desktop file,
+   * but creating one would still collide with a leftover profile. */
   profile_dir = ephy_web_application_get_profile_directory (name);
   profile_exists = g_file_test (profile_dir, G_FILE_TEST_IS_DIR);
   g_free (profile_dir);
@@ -56,6 +56,8 @@ GList   *ephy_web_application_get_application_list (void);
 
 void     ephy_web_application_free_application_list (GList *list);
 
+void     ephy_web_application_free (EphyWebApplication *app);
+
 gboolean ephy_web_application_exists (const char *name);
 
 G_END_DECLS
@@ -0,0 +1,253 @@
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "ephy-history-service.h"
+#include "ephy-history-service-private.h"
+
+/* How many predicted hosts are remembered for each host. Those seen the
+ * least, and the longest ago, are forgotten first. */
+#define MAX_PREDICTED_HOSTS_PER_HOST 32
+
+gboolean
+ephy_history_service_initialize_host_predictions_table (EphyHistoryService *self)
+{
+  EphyHistoryServicePrivate *priv = EPHY_HISTORY_SERVICE (self)->priv;
+  GError *error = NULL;
+
+  if (ephy_sqlite_connection_table_exists (priv->history_database, "host_predictions"))
+    return TRUE;
+
+  ephy_sqlite_connection_execute (priv->history_database,
+    "CREATE TABLE host_predictions ("
+    "id INTEGER PRIMARY KEY,"
+    "host LONGVARCAR NOT NULL,"
+    "predicted_host LONGVARCAR NOT NULL,"
+    "hits INTEGER DEFAULT 0 NOT NULL,"
+    "last_seen INTEGER DEFAULT 0 NOT NULL,"
+    "UNIQUE (host, predicted_host))", &error);
+
+  if (error) {
+    g_error ("Could not create host_predictions table: %s", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+  ephy_history_service_schedule_commit (self);
+  return TRUE;
+}
+
+static void
+trim_host_prediction_rows (EphyHistoryService *self, const char *host)
+{
+  EphyHistoryServicePrivate *priv = EPHY_HISTORY_SERVICE (self)->priv;
+  EphySQLiteStatement *statement;
+  GError *error = NULL;
+
+  statement = ephy_sqlite_connection_create_statement (
+    priv->history_database,
+    "DELETE FROM host_predictions WHERE host = ? AND id NOT IN "
+    "  (SELECT id FROM host_predictions WHERE host = ? "
+    "    ORDER BY hits DESC, last_seen DESC LIMIT ?)", &error);
+  if (error) {
+    g_error ("Could not build host_predictions table trim statement: %s", error->message);
+    g_error_free (error);
+    return;
+  }
+
+  if (ephy_sqlite_statement_bind_string (statement, 0, host, &error) == FALSE ||
+      ephy_sqlite_statement_bind_string (statement, 1, host, &error) == FALSE ||
+      ephy_sqlite_statement_bind_int (statement, 2, MAX_PREDICTED_HOSTS_PER_HOST, &error) == FALSE) {
+    g_error ("Could not build host_predictions table trim statement: %s", error->message);
+    g_error_free (error);
+    g_object_unref (statement);
+    return;
+  }
+
+  ephy_sqlite_statement_step (statement, &error);
+  if (error) {
+    g_error ("Could not trim host_predictions table: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_object_unref (statement);
+}
+
+void
+ephy_history_service_add_host_prediction_rows (EphyHistoryService *self,
+                                               const char *host,
+                                               GList *predicted_hosts,
+                                               gint64 time)
+{
+  EphyHistoryServicePrivate *priv = EPHY_HISTORY_SERVICE (self)->priv;
+  EphySQLiteStatement *insert_statement, *update_statement;
+  GList *l;
+  GError *error = NULL;
+
+  g_assert (priv->history_thread == g_thread_self ());
+  g_assert (priv->history_database != NULL);
+
+  insert_statement = ephy_sqlite_connection_create_statement (
+    priv->history_database,
+    "INSERT OR IGNORE INTO host_predictions (host, predicted_host) "
+    " VALUES (?, ?) ", &error);
+  if (error) {
+    g_error ("Could not build host_predictions table addition statement: %s", error->message);
+    g_error_free (error);
+    return;
+  }
+
+  update_statement = ephy_sqlite_connection_create_statement (
+    priv->history_database,
+    "UPDATE host_predictions SET hits = hits + 1, last_seen = ? "
+    "WHERE host = ? AND predicted_host = ?", &error);
+  if (error) {
+    g_error ("Could not build host_predictions table update statement: %s", error->message);
+    g_error_free (error);
+    g_object_unref (insert_statement);
+    return;
+  }
+
+  for (l = predicted_hosts; l != NULL; l = l->next) {
+    const char *predicted_host = (const char *)l->data;
+
+    if (ephy_sqlite_statement_bind_string (insert_statement, 0, host, &error) == FALSE ||
+        ephy_sqlite_statement_bind_string (insert_statement, 1, predicted_host, &error) == FALSE) {
+      g_error ("Could not build host_predictions table addition statement: %s", error->message);
+      g_error_free (error);
+      break;
+    }
+
+    ephy_sqlite_statement_step (insert_statement, &error);
+    ephy_sqlite_statement_reset (insert_statement);
+    if (error) {
+      g_error ("Could not insert host into host_predictions table: %s", error->message);
+      g_error_free (error);
+      break;
+    }
+
+    if (ephy_sqlite_statement_bind_int (update_statement, 0, (int)time, &error) == FALSE ||
+        ephy_sqlite_statement_bind_string (update_statement, 1, host, &error) == FALSE ||
+        ephy_sqlite_statement_bind_string (update_statement, 2, predicted_host, &error) == FALSE) {
+      g_error ("Could not build host_predictions table update statement: %s", error->message);
+      g_error_free (error);
+      break;
+    }
+
+    ephy_sqlite_statement_step (update_statement, &error);
+    ephy_sqlite_statement_reset (update_statement);
+    if (error) {
+      g_error ("Could not update host in host_predictions table: %s", error->message);
+      g_error_free (error);
+      break;
+    }
+  }
+
+  g_object_unref (insert_statement);
+  g_object_unref (update_statement);
+
+  trim_host_prediction_rows (self, host);
+  ephy_history_service_schedule_commit (self);
+}
+
+GList *
+ephy_history_service_find_host_prediction_rows (EphyHistoryService *self,
+                                                const char *host,
+                                                guint limit)
+{
+  EphyHistoryServicePrivate *priv = EPHY_HISTORY_SERVICE (self)->priv;
+  EphySQLiteStatement *statement;
+  GList *predicted_hosts = NULL;
+  GError *error = NULL;
+
+  g_assert (priv->history_thread == g_thread_self ());
+  g_assert (priv->history_database != NULL);
+
+  statement = ephy_sqlite_connection_create_statement (
+    priv->history_database,
+    "SELECT predicted_host FROM host_predictions WHERE host = ? "
+    "ORDER BY hits DESC, last_seen DESC LIMIT ?", &error);
+  if (error) {
+    g_error ("Could not build host_predictions table query statement: %s", error->message);
+    g_error_free (error);
+    return NULL;
+  }
+
+  if (ephy_sqlite_statement_bind_string (statement, 0, host, &error) == FALSE ||
+      ephy_sqlite_statement_bind_int (statement, 1, limit, &error) == FALSE) {
+    g_error ("Could not build host_predictions table query statement: %s", error->message);
+    g_error_free (error);
+    g_object_unref (statement);
+    return NULL;
+  }
+
+  while (ephy_sqlite_statement_step (statement, &error))
+    predicted_hosts = g_list_prepend (predicted_hosts,
+                                      g_strdup (ephy_sqlite_statement_get_column_as_string (statement, 0)));
+
+  predicted_hosts = g_list_reverse (predicted_hosts);
+
+  if (error) {
+    g_error ("Could not execute host_predictions table query statement: %s", error->message);
+    g_error_free (error);
+    g_object_unref (statement);
+    g_list_free_full (predicted_hosts, g_free);
+    return NULL;
+  }
+
+  g_object_unref (statement);
+  return predicted_hosts;
+}
+
+void
+ephy_history_service_delete_host_prediction_rows (EphyHistoryService *self,
+                                                  const char *host)
+{
+  EphyHistoryServicePrivate *priv = EPHY_HISTORY_SERVICE (self)->priv;
+  EphySQLiteStatement *statement;
+  GError *error = NULL;
+
+  g_assert (priv->history_thread == g_thread_self ());
+  g_assert (priv->history_database != NULL);
+
+  /* Forget what the host predicted, and where it was predicted. */
+  statement = ephy_sqlite_connection_create_statement (
+    priv->history_database,
+    "DELETE FROM host_predictions WHERE host = ? OR predicted_host = ?", &error);
+  if (error) {
+    g_error ("Could not build host_predictions table delete statement: %s", error->message);
+    g_error_free (error);
+    return;
+  }
+
+  if (ephy_sqlite_statement_bind_string (statement, 0, host, &error) == FALSE ||
+      ephy_sqlite_statement_bind_string (statement, 1, host, &error) == FALSE) {
+    g_error ("Could not build host_predictions table delete statement: %s", error->message);
+    g_error_free (error);
+    g_object_unref (statement);
+    return;
+  }
+
+  ephy_sqlite_statement_step (statement, &error);
+  if (error) {
+    g_error ("Could not delete host from host_predictions table: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_object_unref (statement);
+}
@@ -30,9 +30,13 @@ struct _EphyHistoryServicePrivate {
   gboolean scheduled_to_quit;
   gboolean scheduled_to_commit;
   int queue_urls_visited_id;
+  gboolean incremental_vacuum;
+  gboolean vacuum_pending;
+  gboolean vacuum_conversion_pending;
 };
 
 void                     ephy_history_service_schedule_commit         (EphyHistoryService *self); 
+void                     ephy_history_service_schedule_vacuum         (EphyHistoryService *self);
 gboolean                 ephy_history_service_initialize_urls_table   (EphyHistoryService *self);
 EphyHistoryURL *         ephy_history_service_get_url_row             (EphyHistoryService *self, const char *url_string, EphyHistoryURL *url);
 void                     ephy_history_service_add_url_row             (EphyHistoryService *self, EphyHistoryURL *url);
@@ -43,6 +47,7 @@ void                     ephy_history_service_delete_url              (EphyHisto
 gboolean                 ephy_history_service_initialize_visits_table (EphyHistoryService *self);
 void                     ephy_history_service_add_visit_row           (EphyHistoryService *self, EphyHistoryPageVisit *visit);
 GList *                  ephy_history_service_find_visit_rows         (EphyHistoryService *self, EphyHistoryQuery *query);
+GList *                  ephy_history_service_delete_visit_rows_in_time (EphyHistoryService *self, gint64 from, gint64 to);
 
 gboolean                 ephy_history_service_initialize_hosts_table  (EphyHistoryService *self);
 void                     ephy_history_service_add_host_row            (EphyHistoryService *self, EphyHistoryHost *host);
@@ -54,4 +59,9 @@ EphyHistoryHost *        ephy_history_service_get_host_row_from_url   (EphyHisto
 void                     ephy_history_service_delete_host_row         (EphyHistoryService *self, EphyHistoryHost *host);
 void                     ephy_history_service_delete_orphan_hosts     (EphyHistoryService *self);
 
+gboolean                 ephy_history_service_initialize_host_predictions_table (EphyHistoryService *self);
+void                     ephy_history_service_add_host_prediction_rows          (EphyHistoryService *self, const char *host, GList *predicted_hosts, gint64 time);
+GList *                  ephy_history_service_find_host_prediction_rows         (EphyHistoryService *self, const char *host, guint limit);
+void                     ephy_history_service_delete_host_prediction_rows       (EphyHistoryService *self, const char *host);
+
 #endif /* EPHY_HISTORY_SERVICE_PRIVATE_H */
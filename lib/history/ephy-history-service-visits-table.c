@@ -217,3 +217,125 @@ ephy_history_service_find_visit_rows (EphyHistoryService *self, EphyHistoryQuery
   g_object_unref (statement);
   return visits;
 }
+
+static EphySQLiteStatement *
+create_time_range_statement (EphyHistoryService *self,
+                             const char *sql,
+                             gint64 from,
+                             gint64 to)
+{
+  EphyHistoryServicePrivate *priv = EPHY_HISTORY_SERVICE (self)->priv;
+  EphySQLiteStatement *statement;
+  GError *error = NULL;
+
+  statement = ephy_sqlite_connection_create_statement (priv->history_database, sql, &error);
+  if (error) {
+    g_error ("Could not build visits table deletion statement: %s", error->message);
+    g_error_free (error);
+    return NULL;
+  }
+
+  /* The statements refer to the range as ?1 and ?2. */
+  if (ephy_sqlite_statement_bind_int (statement, 0, (int)from, &error) == FALSE ||
+      ephy_sqlite_statement_bind_int (statement, 1, (int)to, &error) == FALSE) {
+    g_error ("Could not build visits table deletion statement: %s", error->message);
+    g_error_free (error);
+    g_object_unref (statement);
+    return NULL;
+  }
+
+  return statement;
+}
+
+static gboolean
+execute_time_range_statement (EphyHistoryService *self,
+                              const char *sql,
+                              gint64 from,
+                              gint64 to)
+{
+  EphySQLiteStatement *statement;
+  GError *error = NULL;
+
+  statement = create_time_range_statement (self, sql, from, to);
+  if (!statement)
+    return FALSE;
+
+  ephy_sqlite_statement_step (statement, &error);
+  g_object_unref (statement);
+
+  if (error) {
+    g_error ("Could not delete visits in time range: %s", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* URLs whose visits all fall in the range go away with them. */
+#define URLS_ONLY_VISITED_IN_RANGE \
+  "SELECT url FROM visits WHERE visit_time BETWEEN ?1 AND ?2 " \
+  "EXCEPT SELECT url FROM visits WHERE visit_time NOT BETWEEN ?1 AND ?2"
+
+/* Deletes the visits between @from and @to, and the URLs that were not
+ * visited outside of that range, with a fixed number of statements
+ * however many rows go. The visit counts and last visit times of what
+ * is kept are updated. Returns the deleted URLs. */
+GList *
+ephy_history_service_delete_visit_rows_in_time (EphyHistoryService *self,
+                                                gint64 from,
+                                                gint64 to)
+{
+  EphyHistoryServicePrivate *priv = EPHY_HISTORY_SERVICE (self)->priv;
+  EphySQLiteStatement *statement;
+  GList *urls = NULL;
+  GError *error = NULL;
+
+  g_assert (priv->history_thread == g_thread_self ());
+  g_assert (priv->history_database != NULL);
+
+  statement = create_time_range_statement (self,
+                                           "SELECT url FROM urls WHERE id IN (" URLS_ONLY_VISITED_IN_RANGE ")",
+                                           from, to);
+  if (!statement)
+    return NULL;
+
+  while (ephy_sqlite_statement_step (statement, &error))
+    urls = g_list_prepend (urls, g_strdup (ephy_sqlite_statement_get_column_as_string (statement, 0)));
+  g_object_unref (statement);
+
+  if (error) {
+    g_error ("Could not query visits table: %s", error->message);
+    g_error_free (error);
+    g_list_free_full (urls, g_free);
+    return NULL;
+  }
+
+  /* Counts first, while the visits being deleted can still be counted. */
+  if (!execute_time_range_statement (self,
+                                     "UPDATE hosts SET visit_count = MAX (0, visit_count - "
+                                     "  (SELECT COUNT (*) FROM visits JOIN urls ON visits.url = urls.id "
+                                     "    WHERE urls.host = hosts.id AND visit_time BETWEEN ?1 AND ?2)) "
+                                     "WHERE id IN (SELECT urls.host FROM visits JOIN urls ON visits.url = urls.id "
+                                     "  WHERE visit_time BETWEEN ?1 AND ?2)",
+                                     from, to) ||
+      !execute_time_range_statement (self,
+                                     "UPDATE urls SET "
+                                     "visit_count = MAX (0, visit_count - "
+                                     "  (SELECT COUNT (*) FROM visits WHERE visits.url = urls.id AND visit_time BETWEEN ?1 AND ?2)), "
+                                     "last_visit_time = "
+                                     "  (SELECT MAX (visit_time) FROM visits WHERE visits.url = urls.id AND visit_time NOT BETWEEN ?1 AND ?2) "
+                                     "WHERE id IN (SELECT url FROM visits WHERE visit_time BETWEEN ?1 AND ?2)",
+                                     from, to) ||
+      !execute_time_range_statement (self,
+                                     "DELETE FROM urls WHERE id IN (" URLS_ONLY_VISITED_IN_RANGE ")",
+                                     from, to) ||
+      !execute_time_range_statement (self,
+                                     "DELETE FROM visits WHERE visit_time BETWEEN ?1 AND ?2",
+                                     from, to)) {
+    g_list_free_full (urls, g_free);
+    return NULL;
+  }
+
+  return g_list_reverse (urls);
+}
@@ -19,10 +19,12 @@
 #include "config.h"
 #include "ephy-history-service.h"
 
+#include "ephy-debug.h"
 #include "ephy-history-service-private.h"
 #include "ephy-history-types.h"
 #include "ephy-history-type-builtins.h"
 #include "ephy-sqlite-connection.h"
+#include "ephy-string.h"
 
 typedef gboolean (*EphyHistoryServiceMethod)                              (EphyHistoryService *self, gpointer data, gpointer *result);
 
@@ -36,6 +38,8 @@ typedef enum {
   ADD_VISITS,
   DELETE_URLS,
   DELETE_HOST,
+  DELETE_VISITS_IN_TIME,
+  ADD_HOST_PREDICTIONS,
   CLEAR,
   /* QUIT */
   QUIT,
@@ -45,7 +49,8 @@ typedef enum {
   QUERY_URLS,
   QUERY_VISITS,
   GET_HOSTS,
-  QUERY_HOSTS
+  QUERY_HOSTS,
+  GET_HOST_PREDICTIONS
 } EphyHistoryServiceMessageType;
 
 enum {
@@ -54,6 +59,7 @@ enum {
   CLEARED,
   URL_TITLE_CHANGED,
   URL_DELETED,
+  URLS_DELETED,
   HOST_DELETED,
   LAST_SIGNAL
 };
@@ -251,6 +257,25 @@ ephy_history_service_class_init (EphyHistoryServiceClass *klass)
                   1,
                   G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
 
+/**
+ * EphyHistoryService::urls-deleted:
+ * @service: the #EphyHistoryService that received the signal
+ * @urls: the URLs that were deleted
+ *
+ * The ::urls-deleted signal is emitted once for each batch of URLs
+ * removed from the history, however many there are. ::url-deleted is
+ * still emitted for each of them afterwards.
+ **/
+  signals[URLS_DELETED] =
+    g_signal_new ("urls-deleted",
+                  G_OBJECT_CLASS_TYPE (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__BOXED,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_STRV | G_SIGNAL_TYPE_STATIC_SCOPE);
+
   signals[HOST_DELETED] =
     g_signal_new ("host-deleted",
                   G_OBJECT_CLASS_TYPE (gobject_class),
@@ -301,6 +326,7 @@ ephy_history_service_send_message (EphyHistoryService *self, EphyHistoryServiceM
   EphyHistoryServicePrivate *priv = self->priv;
 
   g_async_queue_push_sorted (priv->queue, message, (GCompareDataFunc)sort_messages, NULL);
+  ephy_trace_counter ("History queue length", g_async_queue_length (priv->queue));
 }
 
 static void
@@ -313,6 +339,7 @@ ephy_history_service_commit (EphyHistoryService *self)
   if (NULL == priv->history_database)
     return;
 
+  ephy_trace_begin ("History: commit");
   ephy_sqlite_connection_commit_transaction (priv->history_database, &error);
   if (NULL != error) {
     g_error ("Could not commit idle history database transaction: %s", error->message);
@@ -323,10 +350,139 @@ ephy_history_service_commit (EphyHistoryService *self)
     g_error ("Could not start long-running history database transaction: %s", error->message);
     g_error_free (error);
   }
+  ephy_trace_end ("History: commit");
 
   self->priv->scheduled_to_commit = FALSE;
 }
 
+static int
+ephy_history_service_get_pragma (EphyHistoryService *self,
+                                 const char *pragma)
+{
+  EphyHistoryServicePrivate *priv = self->priv;
+  EphySQLiteStatement *statement;
+  GError *error = NULL;
+  int value = -1;
+
+  statement = ephy_sqlite_connection_create_statement (priv->history_database, pragma, &error);
+  if (error) {
+    g_warning ("Could not build %s statement: %s", pragma, error->message);
+    g_error_free (error);
+    return -1;
+  }
+
+  if (ephy_sqlite_statement_step (statement, &error))
+    value = ephy_sqlite_statement_get_column_as_int (statement, 0);
+
+  if (error) {
+    g_warning ("Could not execute %s: %s", pragma, error->message);
+    g_error_free (error);
+  }
+
+  g_object_unref (statement);
+
+  return value;
+}
+
+/* Pages freed by deletions are given back to the file system a few at a
+ * time, between messages, instead of with a VACUUM that would rewrite
+ * the whole database and block the thread meanwhile. */
+#define VACUUM_STEP_PAGES 128
+
+void
+ephy_history_service_schedule_vacuum (EphyHistoryService *self)
+{
+  if (self->priv->incremental_vacuum)
+    self->priv->vacuum_pending = TRUE;
+}
+
+static void
+ephy_history_service_vacuum_step (EphyHistoryService *self)
+{
+  EphyHistoryServicePrivate *priv = self->priv;
+  GError *error = NULL;
+  int free_pages;
+  char *sql;
+
+  g_assert (priv->history_thread == g_thread_self ());
+
+  /* Deletions must be committed before their pages are free. */
+  if (priv->scheduled_to_commit)
+    ephy_history_service_commit (self);
+
+  free_pages = ephy_history_service_get_pragma (self, "PRAGMA freelist_count");
+  if (free_pages <= 0) {
+    priv->vacuum_pending = FALSE;
+    return;
+  }
+
+  ephy_trace_begin ("History: vacuum step");
+  sql = g_strdup_printf ("PRAGMA incremental_vacuum(%d)", VACUUM_STEP_PAGES);
+  ephy_sqlite_connection_execute (priv->history_database, sql, &error);
+  g_free (sql);
+  ephy_trace_end ("History: vacuum step");
+
+  if (error) {
+    g_warning ("Could not vacuum history database: %s", error->message);
+    g_error_free (error);
+    priv->vacuum_pending = FALSE;
+    return;
+  }
+
+  ephy_history_service_commit (self);
+
+  if (free_pages <= VACUUM_STEP_PAGES)
+    priv->vacuum_pending = FALSE;
+}
+
+/* Databases created before incremental vacuum was enabled are converted
+ * once the history thread has had nothing to do for this long. */
+#define VACUUM_CONVERSION_IDLE_TIME (30 * G_USEC_PER_SEC)
+
+/* Converting a database to incremental vacuum takes a full VACUUM,
+ * which rewrites the whole file, so it is only done when idle or when
+ * the database has just been emptied. */
+static void
+ephy_history_service_convert_to_incremental_vacuum (EphyHistoryService *self)
+{
+  EphyHistoryServicePrivate *priv = self->priv;
+  GError *error = NULL;
+
+  g_assert (priv->history_thread == g_thread_self ());
+
+  ephy_trace_begin ("History: convert to incremental vacuum");
+  ephy_sqlite_connection_commit_transaction (priv->history_database, NULL);
+  ephy_sqlite_connection_execute (priv->history_database,
+                                  "PRAGMA auto_vacuum = INCREMENTAL", NULL);
+  ephy_sqlite_connection_execute (priv->history_database, "VACUUM", &error);
+  if (error) {
+    g_warning ("Couldn't vacuum history database: %s", error->message);
+    g_error_free (error);
+  }
+  ephy_sqlite_connection_begin_transaction (priv->history_database, NULL);
+  ephy_trace_end ("History: convert to incremental vacuum");
+
+  priv->scheduled_to_commit = FALSE;
+  priv->vacuum_conversion_pending = FALSE;
+  priv->incremental_vacuum = ephy_history_service_get_pragma (self, "PRAGMA auto_vacuum") == 2;
+}
+
+static void
+ephy_history_service_enable_incremental_vacuum (EphyHistoryService *self)
+{
+  EphyHistoryServicePrivate *priv = self->priv;
+  GError *error = NULL;
+
+  /* Only takes effect on new databases; existing ones are converted
+   * with ephy_history_service_convert_to_incremental_vacuum(). */
+  ephy_sqlite_connection_execute (priv->history_database,
+                                  "PRAGMA auto_vacuum = INCREMENTAL", &error);
+  if (error) {
+    g_warning ("Could not enable incremental vacuum: %s", error->message);
+    g_error_free (error);
+  }
+}
+
 static void
 ephy_history_service_enable_foreign_keys (EphyHistoryService *self)
 {
@@ -350,6 +506,7 @@ ephy_history_service_open_database_connections (EphyHistoryService *self)
 {
   EphyHistoryServicePrivate *priv = EPHY_HISTORY_SERVICE (self)->priv;
   GError *error = NULL;
+  int auto_vacuum;
 
   g_assert (priv->history_thread == g_thread_self ());
 
@@ -364,6 +521,7 @@ ephy_history_service_open_database_connections (EphyHistoryService *self)
   }
 
   ephy_history_service_enable_foreign_keys (self);
+  ephy_history_service_enable_incremental_vacuum (self);
 
   ephy_sqlite_connection_begin_transaction (priv->history_database, &error);
   if (error) {
@@ -374,9 +532,15 @@ ephy_history_service_open_database_connections (EphyHistoryService *self)
 
   if ((ephy_history_service_initialize_hosts_table (self) == FALSE) ||
       (ephy_history_service_initialize_urls_table (self) == FALSE) ||
-      (ephy_history_service_initialize_visits_table (self) == FALSE))
+      (ephy_history_service_initialize_visits_table (self) == FALSE) ||
+      (ephy_history_service_initialize_host_predictions_table (self) == FALSE))
     return FALSE;
 
+  /* 0 is NONE, 2 is INCREMENTAL. */
+  auto_vacuum = ephy_history_service_get_pragma (self, "PRAGMA auto_vacuum");
+  priv->incremental_vacuum = auto_vacuum == 2;
+  priv->vacuum_conversion_pending = auto_vacuum == 0;
+
   return TRUE;
 }
 
@@ -406,7 +570,24 @@ ephy_history_service_clear_all (EphyHistoryService *self)
   if (error) {
     g_error ("Couldn't clear history database: %s", error->message);
     g_error_free(error);
+    return;
+  }
+
+  ephy_sqlite_connection_execute (priv->history_database,
+                                  "DELETE FROM host_predictions;", &error);
+  if (error) {
+    g_error ("Couldn't clear host predictions: %s", error->message);
+    g_error_free(error);
+    return;
   }
+
+  if (priv->incremental_vacuum) {
+    ephy_history_service_schedule_vacuum (self);
+    return;
+  }
+
+  /* Cheap now that the database is empty. */
+  ephy_history_service_convert_to_incremental_vacuum (self);
 }
 
 static gboolean
@@ -451,9 +632,13 @@ run_history_service_thread (EphyHistoryService *self)
 
   g_assert (priv->history_thread == g_thread_self ());
 
+  ephy_trace_set_thread_name ("EphyHistoryService");
+
   if (ephy_history_service_open_database_connections (self) == FALSE)
     return NULL;
 
+  ephy_trace_milestone ("history-opened");
+
   do {
     message = g_async_queue_try_pop (priv->queue);
     if (!message) {
@@ -461,8 +646,23 @@ run_history_service_thread (EphyHistoryService *self)
       if (ephy_history_service_is_scheduled_to_commit (self))
         ephy_history_service_commit (self);
 
-      /* Block the thread until there's data in the queue. */
-      message = g_async_queue_pop (priv->queue);
+      /* Give back some free pages, then look at the queue again. */
+      if (priv->vacuum_pending) {
+        ephy_history_service_vacuum_step (self);
+        continue;
+      }
+
+      /* Convert an old database once nothing has happened for a while. */
+      if (priv->vacuum_conversion_pending) {
+        message = g_async_queue_timeout_pop (priv->queue, VACUUM_CONVERSION_IDLE_TIME);
+        if (!message) {
+          ephy_history_service_convert_to_incremental_vacuum (self);
+          continue;
+        }
+      } else {
+        /* Block the thread until there's data in the queue. */
+        message = g_async_queue_pop (priv->queue);
+      }
     }
 
     /* Process item. */
@@ -1049,13 +1249,53 @@ ephy_history_service_get_host_for_url (EphyHistoryService *self,
 static gboolean
 delete_urls_signal_emit (SignalEmissionContext *ctx)
 {
-  char *url = (char *)ctx->user_data;
+  char **urls = (char **)ctx->user_data;
+  guint i;
 
-  g_signal_emit (ctx->service, signals[URL_DELETED], 0, url);
+  g_signal_emit (ctx->service, signals[URLS_DELETED], 0, urls);
+
+  for (i = 0; urls[i] != NULL; i++)
+    g_signal_emit (ctx->service, signals[URL_DELETED], 0, urls[i]);
 
   return FALSE;
 }
 
+/* Takes ownership of @urls, a NULL terminated array of URL strings. */
+static void
+ephy_history_service_queue_urls_deleted (EphyHistoryService *self,
+                                         char **urls)
+{
+  SignalEmissionContext *ctx;
+
+  if (urls[0] == NULL) {
+    g_strfreev (urls);
+    return;
+  }
+
+  ctx = signal_emission_context_new (self, urls, (GDestroyNotify)g_strfreev);
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                   (GSourceFunc)delete_urls_signal_emit,
+                   ctx,
+                   (GDestroyNotify)signal_emission_context_free);
+}
+
+static char **
+url_strings_to_strv (GList *urls)
+{
+  char **strv;
+  GList *l;
+  guint i = 0;
+
+  strv = g_new (char *, g_list_length (urls) + 1);
+  for (l = urls; l != NULL; l = l->next)
+    strv[i++] = l->data;
+  strv[i] = NULL;
+
+  g_list_free (urls);
+
+  return strv;
+}
+
 static gboolean
 ephy_history_service_execute_delete_urls (EphyHistoryService *self,
                                           GList *urls,
@@ -1063,26 +1303,78 @@ ephy_history_service_execute_delete_urls (EphyHistoryService *self,
 {
   GList *l;
   EphyHistoryURL *url;
-  SignalEmissionContext *ctx;
+  GList *deleted_urls = NULL;
 
   for (l = urls; l != NULL; l = l->next) {
     url = l->data;
     ephy_history_service_delete_url (self, url);
-
-    ctx = signal_emission_context_new (self, g_strdup (url->url),
-                                       (GDestroyNotify) g_free);
-    g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
-                     (GSourceFunc)delete_urls_signal_emit,
-                     ctx,
-                     (GDestroyNotify)signal_emission_context_free);
+    deleted_urls = g_list_prepend (deleted_urls, g_strdup (url->url));
   }
 
   ephy_history_service_delete_orphan_hosts (self);
   ephy_history_service_schedule_commit (self);
+  ephy_history_service_schedule_vacuum (self);
+
+  ephy_history_service_queue_urls_deleted (self, url_strings_to_strv (g_list_reverse (deleted_urls)));
 
   return TRUE;
 }
 
+static gboolean
+ephy_history_service_execute_delete_visits_in_time (EphyHistoryService *self,
+                                                    GVariant *variant,
+                                                    gpointer *result)
+{
+  gint64 from, to;
+  GList *urls;
+
+  g_variant_get (variant, "(xx)", &from, &to);
+
+  urls = ephy_history_service_delete_visit_rows_in_time (self, from, to);
+  ephy_history_service_delete_orphan_hosts (self);
+  ephy_history_service_schedule_commit (self);
+  ephy_history_service_schedule_vacuum (self);
+
+  ephy_history_service_queue_urls_deleted (self, url_strings_to_strv (urls));
+
+  return TRUE;
+}
+
+/**
+ * ephy_history_service_delete_visits_in_time:
+ * @self: an #EphyHistoryService
+ * @from: the start of the range, in seconds since the epoch
+ * @to: the end of the range, in seconds since the epoch
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: (allow-none): a callback, or %NULL
+ * @user_data: data for @callback
+ *
+ * Deletes the visits made between @from and @to, both included, and the
+ * URLs that were only visited then. The deleted URLs are announced with
+ * a single #EphyHistoryService::urls-deleted emission.
+ **/
+void
+ephy_history_service_delete_visits_in_time (EphyHistoryService *self,
+                                            gint64 from,
+                                            gint64 to,
+                                            GCancellable *cancellable,
+                                            EphyHistoryJobCallback callback,
+                                            gpointer user_data)
+{
+  EphyHistoryServiceMessage *message;
+  GVariant *variant;
+
+  g_return_if_fail (EPHY_IS_HISTORY_SERVICE (self));
+  g_return_if_fail (from <= to);
+
+  variant = g_variant_new ("(xx)", from, to);
+
+  message = ephy_history_service_message_new (self, DELETE_VISITS_IN_TIME,
+                                              variant, (GDestroyNotify)g_variant_unref,
+                                              cancellable, callback, user_data);
+  ephy_history_service_send_message (self, message);
+}
+
 static gboolean
 delete_host_signal_emit (SignalEmissionContext *ctx)
 {
@@ -1100,8 +1392,16 @@ ephy_history_service_execute_delete_host (EphyHistoryService *self,
                                           gpointer user_data)
 {
   SignalEmissionContext *ctx;
+  char *hostname;
 
   ephy_history_service_delete_host_row (self, host);
+
+  hostname = ephy_string_get_host_name (host->url);
+  if (hostname) {
+    ephy_history_service_delete_host_prediction_rows (self, hostname);
+    g_free (hostname);
+  }
+
   ephy_history_service_schedule_commit (self);
 
   ctx = signal_emission_context_new (self, g_strdup (host->url),
@@ -1114,6 +1414,119 @@ ephy_history_service_execute_delete_host (EphyHistoryService *self,
   return TRUE;
 }
 
+static gboolean
+ephy_history_service_execute_add_host_predictions (EphyHistoryService *self,
+                                                   GVariant *variant,
+                                                   gpointer *result)
+{
+  const char *host;
+  const char *predicted_host;
+  gint64 time;
+  GVariantIter *iter;
+  GList *predicted_hosts = NULL;
+
+  g_variant_get (variant, "(&sxas)", &host, &time, &iter);
+  while (g_variant_iter_next (iter, "&s", &predicted_host))
+    predicted_hosts = g_list_prepend (predicted_hosts, (gpointer)predicted_host);
+  g_variant_iter_free (iter);
+
+  ephy_history_service_add_host_prediction_rows (self, host, predicted_hosts, time);
+  g_list_free (predicted_hosts);
+
+  return TRUE;
+}
+
+/**
+ * ephy_history_service_add_host_predictions:
+ * @self: an #EphyHistoryService
+ * @host: a host name
+ * @predicted_hosts: (element-type utf8): the other hosts that were
+ * contacted while loading a page from @host
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: (allow-none): a callback, or %NULL
+ * @user_data: data for @callback
+ *
+ * Records that loading a page from @host led to @predicted_hosts, so
+ * that they can be returned by ephy_history_service_get_host_predictions()
+ * next time.
+ **/
+void
+ephy_history_service_add_host_predictions (EphyHistoryService *self,
+                                           const char *host,
+                                           GList *predicted_hosts,
+                                           GCancellable *cancellable,
+                                           EphyHistoryJobCallback callback,
+                                           gpointer user_data)
+{
+  EphyHistoryServiceMessage *message;
+  GVariantBuilder builder;
+  GVariant *variant;
+  GList *l;
+
+  g_return_if_fail (EPHY_IS_HISTORY_SERVICE (self));
+  g_return_if_fail (host != NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
+  for (l = predicted_hosts; l != NULL; l = l->next)
+    g_variant_builder_add (&builder, "s", l->data);
+
+  variant = g_variant_new ("(sxas)", host, g_get_real_time () / G_USEC_PER_SEC, &builder);
+
+  message = ephy_history_service_message_new (self, ADD_HOST_PREDICTIONS,
+                                              variant, (GDestroyNotify)g_variant_unref,
+                                              cancellable, callback, user_data);
+  ephy_history_service_send_message (self, message);
+}
+
+static gboolean
+ephy_history_service_execute_get_host_predictions (EphyHistoryService *self,
+                                                   GVariant *variant,
+                                                   gpointer *result)
+{
+  const char *host;
+  guint limit;
+
+  g_variant_get (variant, "(&su)", &host, &limit);
+  *result = ephy_history_service_find_host_prediction_rows (self, host, limit);
+
+  return TRUE;
+}
+
+/**
+ * ephy_history_service_get_host_predictions:
+ * @self: an #EphyHistoryService
+ * @host: a host name
+ * @limit: the maximum number of hosts to return
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a callback
+ * @user_data: data for @callback
+ *
+ * Looks up the hosts that are most likely to be contacted when loading
+ * a page from @host. The result passed to @callback is a #GList of
+ * host names, most likely first, owned by the caller.
+ **/
+void
+ephy_history_service_get_host_predictions (EphyHistoryService *self,
+                                           const char *host,
+                                           guint limit,
+                                           GCancellable *cancellable,
+                                           EphyHistoryJobCallback callback,
+                                           gpointer user_data)
+{
+  EphyHistoryServiceMessage *message;
+  GVariant *variant;
+
+  g_return_if_fail (EPHY_IS_HISTORY_SERVICE (self));
+  g_return_if_fail (host != NULL);
+
+  variant = g_variant_new ("(su)", host, limit);
+
+  message = ephy_history_service_message_new (self, GET_HOST_PREDICTIONS,
+                                              variant, (GDestroyNotify)g_variant_unref,
+                                              cancellable, callback, user_data);
+  ephy_history_service_send_message (self, message);
+}
+
 static gboolean
 ephy_history_service_execute_clear (EphyHistoryService *self,
                                     gpointer pointer,
@@ -1195,6 +1608,8 @@ static EphyHistoryServiceMethod methods[] = {
   (EphyHistoryServiceMethod)ephy_history_service_execute_add_visits,
   (EphyHistoryServiceMethod)ephy_history_service_execute_delete_urls,
   (EphyHistoryServiceMethod)ephy_history_service_execute_delete_host,
+  (EphyHistoryServiceMethod)ephy_history_service_execute_delete_visits_in_time,
+  (EphyHistoryServiceMethod)ephy_history_service_execute_add_host_predictions,
   (EphyHistoryServiceMethod)ephy_history_service_execute_clear,
   (EphyHistoryServiceMethod)ephy_history_service_execute_quit,
   (EphyHistoryServiceMethod)ephy_history_service_execute_get_url,
@@ -1202,7 +1617,30 @@ static EphyHistoryServiceMethod methods[] = {
   (EphyHistoryServiceMethod)ephy_history_service_execute_query_urls,
   (EphyHistoryServiceMethod)ephy_history_service_execute_find_visits,
   (EphyHistoryServiceMethod)ephy_history_service_execute_get_hosts,
-  (EphyHistoryServiceMethod)ephy_history_service_execute_query_hosts
+  (EphyHistoryServiceMethod)ephy_history_service_execute_query_hosts,
+  (EphyHistoryServiceMethod)ephy_history_service_execute_get_host_predictions
+};
+
+static const char *method_names[] = {
+  "History: set URL title",
+  "History: set URL zoom level",
+  "History: set URL hidden",
+  "History: set URL thumbnail time",
+  "History: add visit",
+  "History: add visits",
+  "History: delete URLs",
+  "History: delete host",
+  "History: delete visits in time",
+  "History: add host predictions",
+  "History: clear",
+  "History: quit",
+  "History: get URL",
+  "History: get host for URL",
+  "History: query URLs",
+  "History: query visits",
+  "History: get hosts",
+  "History: query hosts",
+  "History: get host predictions"
 };
 
 static gboolean
@@ -1227,7 +1665,9 @@ ephy_history_service_process_message (EphyHistoryService *self,
 
   method = methods[message->type];
   message->result = NULL;
+  ephy_trace_begin (method_names[message->type]);
   message->success = method (message->service, message->method_argument, &message->result);
+  ephy_trace_end (method_names[message->type]);
 
   if (message->callback || message->type == CLEAR)
     g_idle_add ((GSourceFunc)ephy_history_service_execute_job_callback, message);
@@ -0,0 +1,548 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-host-predictor.h"
+
+#include "ephy-debug.h"
+#include "ephy-string.h"
+#include "ephy-trace.h"
+
+#include <string.h>
+#ifdef HAVE_WEBKIT2
+#include <webkit2/webkit2.h>
+#else
+#include <libsoup/soup.h>
+#include <webkit/webkit.h>
+#endif
+
+/* The predictor remembers which other hosts were contacted while
+ * loading pages from a host (CDNs, APIs, the targets of the links that
+ * were followed) and resolves them as soon as a new load from that host
+ * starts, or the host is highlighted in the location entry. */
+
+#define EPHY_HOST_PREDICTOR_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), EPHY_TYPE_HOST_PREDICTOR, EphyHostPredictorPrivate))
+
+/* How many hosts are prefetched for each load. */
+#define MAX_PREDICTED_HOSTS 4
+
+/* How many hosts are learned from each load. */
+#define MAX_LEARNED_HOSTS 16
+
+/* No more than this many prefetches are issued in each period, however
+ * many pages are loaded. */
+#define PREFETCH_BUDGET 16
+#define PREFETCH_BUDGET_PERIOD (10 * G_USEC_PER_SEC)
+
+/* A host that was prefetched is not prefetched again for this long, the
+ * resolver cache still has it. */
+#define PREFETCH_EXPIRY (60 * G_USEC_PER_SEC)
+#define MAX_RECENT_PREFETCHES 256
+
+/* Loads that never finish must not accumulate. */
+#define MAX_PENDING_LOADS 32
+
+struct _EphyHostPredictorPrivate
+{
+  EphyHistoryService *history_service;
+  GCancellable *cancellable;
+
+  EphyHostPredictorPrefetchFunc prefetch_func;
+  gpointer prefetch_data;
+
+  /* host -> monotonic time of the last prefetch. */
+  GHashTable *recent_prefetches;
+  gint64 budget_period_start;
+  guint budget_used;
+
+  /* Load being tracked -> PendingLoad. Keyed by load rather than by
+   * host, since a host can be loaded in several views at once. */
+  GHashTable *pending_loads;
+  guint last_load_id;
+
+  guint n_predicted;
+  guint n_hits;
+};
+
+typedef struct {
+  guint id;
+  /* Set of the hosts predicted for the load. */
+  GHashTable *predicted;
+} PendingLoad;
+
+typedef struct {
+  EphyHostPredictor *predictor;
+  char *host;
+  gconstpointer load;
+  guint load_id;
+} PredictionRequest;
+
+enum
+{
+  PROP_0,
+  PROP_HISTORY_SERVICE
+};
+
+G_DEFINE_TYPE (EphyHostPredictor, ephy_host_predictor, G_TYPE_OBJECT)
+
+static void
+pending_load_free (PendingLoad *pending)
+{
+  g_hash_table_destroy (pending->predicted);
+  g_slice_free (PendingLoad, pending);
+}
+
+static void
+default_prefetch_func (const char *host,
+                       gpointer user_data)
+{
+#ifdef HAVE_WEBKIT2
+  webkit_web_context_prefetch_dns (webkit_web_context_get_default (), host);
+#else
+  soup_session_prefetch_dns (webkit_get_default_session (), host, NULL, NULL, NULL);
+#endif
+}
+
+static void
+ephy_host_predictor_set_property (GObject *object,
+                                  guint prop_id,
+                                  const GValue *value,
+                                  GParamSpec *pspec)
+{
+  EphyHostPredictor *predictor = EPHY_HOST_PREDICTOR (object);
+
+  switch (prop_id) {
+  case PROP_HISTORY_SERVICE:
+    predictor->priv->history_service = g_value_dup_object (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+ephy_host_predictor_dispose (GObject *object)
+{
+  EphyHostPredictorPrivate *priv = EPHY_HOST_PREDICTOR (object)->priv;
+
+  if (priv->cancellable) {
+    g_cancellable_cancel (priv->cancellable);
+    g_clear_object (&priv->cancellable);
+  }
+
+  g_clear_object (&priv->history_service);
+
+  G_OBJECT_CLASS (ephy_host_predictor_parent_class)->dispose (object);
+}
+
+static void
+ephy_host_predictor_finalize (GObject *object)
+{
+  EphyHostPredictorPrivate *priv = EPHY_HOST_PREDICTOR (object)->priv;
+
+  g_hash_table_destroy (priv->recent_prefetches);
+  g_hash_table_destroy (priv->pending_loads);
+
+  G_OBJECT_CLASS (ephy_host_predictor_parent_class)->finalize (object);
+}
+
+static void
+ephy_host_predictor_class_init (EphyHostPredictorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = ephy_host_predictor_set_property;
+  object_class->dispose = ephy_host_predictor_dispose;
+  object_class->finalize = ephy_host_predictor_finalize;
+
+  g_object_class_install_property (object_class,
+                                   PROP_HISTORY_SERVICE,
+                                   g_param_spec_object ("history-service",
+                                                        "History service",
+                                                        "The history service the predictions are kept in",
+                                                        EPHY_TYPE_HISTORY_SERVICE,
+                                                        G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  g_type_class_add_private (klass, sizeof (EphyHostPredictorPrivate));
+}
+
+static void
+ephy_host_predictor_init (EphyHostPredictor *predictor)
+{
+  EphyHostPredictorPrivate *priv;
+
+  priv = predictor->priv = EPHY_HOST_PREDICTOR_GET_PRIVATE (predictor);
+
+  priv->cancellable = g_cancellable_new ();
+  priv->prefetch_func = default_prefetch_func;
+  priv->recent_prefetches = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, g_free);
+  priv->pending_loads = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                               NULL, (GDestroyNotify)pending_load_free);
+}
+
+/**
+ * ephy_host_predictor_new:
+ * @history_service: the #EphyHistoryService to keep the predictions in
+ *
+ * Returns: (transfer full): a new #EphyHostPredictor
+ **/
+EphyHostPredictor *
+ephy_host_predictor_new (EphyHistoryService *history_service)
+{
+  g_return_val_if_fail (EPHY_IS_HISTORY_SERVICE (history_service), NULL);
+
+  return EPHY_HOST_PREDICTOR (g_object_new (EPHY_TYPE_HOST_PREDICTOR,
+                                            "history-service", history_service,
+                                            NULL));
+}
+
+/**
+ * ephy_host_predictor_set_prefetch_func:
+ * @predictor: an #EphyHostPredictor
+ * @func: the function resolving the predicted hosts
+ * @user_data: data for @func
+ *
+ * Replaces the function that resolves the predicted hosts, which by
+ * default asks WebKit to prefetch them.
+ **/
+void
+ephy_host_predictor_set_prefetch_func (EphyHostPredictor *predictor,
+                                       EphyHostPredictorPrefetchFunc func,
+                                       gpointer user_data)
+{
+  g_return_if_fail (EPHY_IS_HOST_PREDICTOR (predictor));
+  g_return_if_fail (func != NULL);
+
+  predictor->priv->prefetch_func = func;
+  predictor->priv->prefetch_data = user_data;
+}
+
+static gboolean
+remove_expired_prefetch (gpointer key,
+                         gpointer value,
+                         gpointer user_data)
+{
+  gint64 now = *(gint64 *)user_data;
+
+  return now - *(gint64 *)value > PREFETCH_EXPIRY;
+}
+
+static void
+prefetch_host (EphyHostPredictor *predictor,
+               const char *host)
+{
+  EphyHostPredictorPrivate *priv = predictor->priv;
+  gint64 *last_prefetch;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  last_prefetch = g_hash_table_lookup (priv->recent_prefetches, host);
+  if (last_prefetch && now - *last_prefetch <= PREFETCH_EXPIRY)
+    return;
+
+  if (now - priv->budget_period_start > PREFETCH_BUDGET_PERIOD) {
+    priv->budget_period_start = now;
+    priv->budget_used = 0;
+  }
+
+  if (priv->budget_used >= PREFETCH_BUDGET) {
+    LOG ("Prefetch budget exhausted, not prefetching %s", host);
+    return;
+  }
+
+  priv->budget_used++;
+
+  if (g_hash_table_size (priv->recent_prefetches) >= MAX_RECENT_PREFETCHES)
+    g_hash_table_foreach_remove (priv->recent_prefetches, remove_expired_prefetch, &now);
+
+  last_prefetch = g_new (gint64, 1);
+  *last_prefetch = now;
+  g_hash_table_replace (priv->recent_prefetches, g_strdup (host), last_prefetch);
+
+  LOG ("Prefetching predicted host %s", host);
+  priv->prefetch_func (host, priv->prefetch_data);
+}
+
+static void
+got_host_predictions_cb (EphyHistoryService *service,
+                         gboolean success,
+                         gpointer result_data,
+                         gpointer user_data)
+{
+  PredictionRequest *request = (PredictionRequest *)user_data;
+  EphyHostPredictor *predictor = request->predictor;
+  EphyHostPredictorPrivate *priv = predictor->priv;
+  GList *predicted_hosts = (GList *)result_data;
+  GHashTable *predicted = NULL;
+  GList *l;
+
+  /* The load may have finished, or been replaced by another one in
+   * the same view, while the history service was being asked. */
+  if (request->load) {
+    PendingLoad *pending = g_hash_table_lookup (priv->pending_loads, request->load);
+
+    if (pending && pending->id == request->load_id)
+      predicted = pending->predicted;
+  }
+
+  for (l = predicted_hosts; l != NULL; l = l->next) {
+    prefetch_host (predictor, l->data);
+
+    if (predicted)
+      g_hash_table_add (predicted, g_strdup (l->data));
+  }
+
+  g_list_free_full (predicted_hosts, g_free);
+  g_free (request->host);
+  g_slice_free (PredictionRequest, request);
+}
+
+static void
+predict_hosts (EphyHostPredictor *predictor,
+               const char *host,
+               gconstpointer load,
+               guint load_id)
+{
+  PredictionRequest *request;
+
+  request = g_slice_new (PredictionRequest);
+  request->predictor = predictor;
+  request->host = g_strdup (host);
+  request->load = load;
+  request->load_id = load_id;
+
+  ephy_history_service_get_host_predictions (predictor->priv->history_service,
+                                             host, MAX_PREDICTED_HOSTS,
+                                             predictor->priv->cancellable,
+                                             got_host_predictions_cb,
+                                             request);
+}
+
+/**
+ * ephy_host_predictor_prefetch_for_host:
+ * @predictor: an #EphyHostPredictor
+ * @host: a host name
+ *
+ * Prefetches the hosts that loading a page from @host is likely to
+ * need, for instance because the user is about to go there.
+ **/
+void
+ephy_host_predictor_prefetch_for_host (EphyHostPredictor *predictor,
+                                       const char *host)
+{
+  g_return_if_fail (EPHY_IS_HOST_PREDICTOR (predictor));
+  g_return_if_fail (host != NULL);
+
+  predict_hosts (predictor, host, NULL, 0);
+}
+
+/**
+ * ephy_host_predictor_load_started:
+ * @predictor: an #EphyHostPredictor
+ * @load: identifies the load, usually the web view doing it
+ * @url: the URL being loaded
+ *
+ * Prefetches the hosts loading @url is likely to need. Whether they
+ * are used is checked in ephy_host_predictor_load_finished(). A new
+ * load with the same @load replaces the previous one.
+ **/
+void
+ephy_host_predictor_load_started (EphyHostPredictor *predictor,
+                                  gconstpointer load,
+                                  const char *url)
+{
+  EphyHostPredictorPrivate *priv;
+  PendingLoad *pending;
+  char *host;
+
+  g_return_if_fail (EPHY_IS_HOST_PREDICTOR (predictor));
+  g_return_if_fail (load != NULL);
+  g_return_if_fail (url != NULL);
+
+  priv = predictor->priv;
+
+  host = ephy_string_get_host_name (url);
+  if (!host) {
+    g_hash_table_remove (priv->pending_loads, load);
+    return;
+  }
+
+  if (g_hash_table_size (priv->pending_loads) >= MAX_PENDING_LOADS &&
+      !g_hash_table_contains (priv->pending_loads, load))
+    g_hash_table_remove_all (priv->pending_loads);
+
+  pending = g_slice_new (PendingLoad);
+  pending->id = ++priv->last_load_id;
+  pending->predicted = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_hash_table_replace (priv->pending_loads, (gpointer)load, pending);
+
+  predict_hosts (predictor, host, load, pending->id);
+  g_free (host);
+}
+
+/**
+ * ephy_host_predictor_load_cancelled:
+ * @predictor: an #EphyHostPredictor
+ * @load: the load given to ephy_host_predictor_load_started()
+ *
+ * Forgets about @load, which failed or whose view is going away.
+ **/
+void
+ephy_host_predictor_load_cancelled (EphyHostPredictor *predictor,
+                                    gconstpointer load)
+{
+  g_return_if_fail (EPHY_IS_HOST_PREDICTOR (predictor));
+
+  g_hash_table_remove (predictor->priv->pending_loads, load);
+}
+
+/**
+ * ephy_host_predictor_load_finished:
+ * @predictor: an #EphyHostPredictor
+ * @load: the load given to ephy_host_predictor_load_started(), or %NULL
+ * @url: the URL that was loaded
+ * @hosts: (element-type utf8): the other hosts contacted by the load
+ *
+ * Learns which hosts were needed to load @url, and counts how many of
+ * the ones predicted for @load were.
+ **/
+void
+ephy_host_predictor_load_finished (EphyHostPredictor *predictor,
+                                   gconstpointer load,
+                                   const char *url,
+                                   GList *hosts)
+{
+  EphyHostPredictorPrivate *priv;
+  PendingLoad *pending;
+  GList *l, *learned = NULL;
+  char *host;
+  guint n_learned = 0;
+
+  g_return_if_fail (EPHY_IS_HOST_PREDICTOR (predictor));
+  g_return_if_fail (url != NULL);
+
+  priv = predictor->priv;
+
+  host = ephy_string_get_host_name (url);
+  if (!host)
+    return;
+
+  pending = load ? g_hash_table_lookup (priv->pending_loads, load) : NULL;
+  if (pending) {
+    GHashTableIter iter;
+    gpointer predicted_host;
+
+    g_hash_table_iter_init (&iter, pending->predicted);
+    while (g_hash_table_iter_next (&iter, &predicted_host, NULL)) {
+      priv->n_predicted++;
+      if (g_list_find_custom (hosts, predicted_host, (GCompareFunc)g_strcmp0))
+        priv->n_hits++;
+    }
+
+    g_hash_table_remove (priv->pending_loads, load);
+
+    LOG ("Host predictions: %u hits out of %u", priv->n_hits, priv->n_predicted);
+    if (priv->n_predicted > 0)
+      ephy_trace_counter ("Host prediction hit rate", priv->n_hits * 100 / priv->n_predicted);
+  }
+
+  for (l = hosts; l != NULL && n_learned < MAX_LEARNED_HOSTS; l = l->next) {
+    if (g_strcmp0 (l->data, host) == 0)
+      continue;
+
+    learned = g_list_prepend (learned, l->data);
+    n_learned++;
+  }
+
+  if (learned) {
+    ephy_history_service_add_host_predictions (priv->history_service, host, learned,
+                                               NULL, NULL, NULL);
+    g_list_free (learned);
+  }
+
+  g_free (host);
+}
+
+/**
+ * ephy_host_predictor_add_link:
+ * @predictor: an #EphyHostPredictor
+ * @from_url: the URL of the page with the link
+ * @to_url: the URL of the link that was followed
+ *
+ * Learns that pages from the host of @from_url link to the host of
+ * @to_url.
+ **/
+void
+ephy_host_predictor_add_link (EphyHostPredictor *predictor,
+                              const char *from_url,
+                              const char *to_url)
+{
+  char *from_host, *to_host;
+
+  g_return_if_fail (EPHY_IS_HOST_PREDICTOR (predictor));
+  g_return_if_fail (from_url != NULL);
+  g_return_if_fail (to_url != NULL);
+
+  from_host = ephy_string_get_host_name (from_url);
+  to_host = ephy_string_get_host_name (to_url);
+
+  if (from_host && to_host && strcmp (from_host, to_host) != 0) {
+    GList *hosts = g_list_prepend (NULL, to_host);
+
+    ephy_history_service_add_host_predictions (predictor->priv->history_service,
+                                               from_host, hosts,
+                                               NULL, NULL, NULL);
+    g_list_free (hosts);
+  }
+
+  g_free (from_host);
+  g_free (to_host);
+}
+
+/**
+ * ephy_host_predictor_get_n_predicted:
+ * @predictor: an #EphyHostPredictor
+ *
+ * Returns: how many hosts were predicted for the loads that finished.
+ **/
+guint
+ephy_host_predictor_get_n_predicted (EphyHostPredictor *predictor)
+{
+  g_return_val_if_fail (EPHY_IS_HOST_PREDICTOR (predictor), 0);
+
+  return predictor->priv->n_predicted;
+}
+
+/**
+ * ephy_host_predictor_get_n_hits:
+ * @predictor: an #EphyHostPredictor
+ *
+ * Returns: how many of the predicted hosts were actually contacted.
+ **/
+guint
+ephy_host_predictor_get_n_hits (EphyHostPredictor *predictor)
+{
+  g_return_val_if_fail (EPHY_IS_HOST_PREDICTOR (predictor), 0);
+
+  return predictor->priv->n_hits;
+}
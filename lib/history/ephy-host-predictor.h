@@ -0,0 +1,90 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef EPHY_HOST_PREDICTOR_H
+#define EPHY_HOST_PREDICTOR_H
+
+#include <glib-object.h>
+
+#include "ephy-history-service.h"
+
+G_BEGIN_DECLS
+
+#define EPHY_TYPE_HOST_PREDICTOR            (ephy_host_predictor_get_type())
+#define EPHY_HOST_PREDICTOR(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), EPHY_TYPE_HOST_PREDICTOR, EphyHostPredictor))
+#define EPHY_HOST_PREDICTOR_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), EPHY_TYPE_HOST_PREDICTOR, EphyHostPredictorClass))
+#define EPHY_IS_HOST_PREDICTOR(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EPHY_TYPE_HOST_PREDICTOR))
+#define EPHY_IS_HOST_PREDICTOR_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EPHY_TYPE_HOST_PREDICTOR))
+#define EPHY_HOST_PREDICTOR_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), EPHY_TYPE_HOST_PREDICTOR, EphyHostPredictorClass))
+
+typedef struct _EphyHostPredictor        EphyHostPredictor;
+typedef struct _EphyHostPredictorClass   EphyHostPredictorClass;
+typedef struct _EphyHostPredictorPrivate EphyHostPredictorPrivate;
+
+struct _EphyHostPredictor
+{
+  GObject parent;
+
+  /*< private >*/
+  EphyHostPredictorPrivate *priv;
+};
+
+struct _EphyHostPredictorClass
+{
+  GObjectClass parent_class;
+};
+
+typedef void (* EphyHostPredictorPrefetchFunc) (const char *host,
+                                                gpointer user_data);
+
+GType              ephy_host_predictor_get_type          (void) G_GNUC_CONST;
+
+EphyHostPredictor *ephy_host_predictor_new               (EphyHistoryService *history_service);
+
+void               ephy_host_predictor_set_prefetch_func (EphyHostPredictor *predictor,
+                                                          EphyHostPredictorPrefetchFunc func,
+                                                          gpointer user_data);
+
+void               ephy_host_predictor_prefetch_for_host (EphyHostPredictor *predictor,
+                                                          const char *host);
+
+void               ephy_host_predictor_load_started      (EphyHostPredictor *predictor,
+                                                          gconstpointer load,
+                                                          const char *url);
+
+void               ephy_host_predictor_load_cancelled    (EphyHostPredictor *predictor,
+                                                          gconstpointer load);
+
+void               ephy_host_predictor_load_finished     (EphyHostPredictor *predictor,
+                                                          gconstpointer load,
+                                                          const char *url,
+                                                          GList *hosts);
+
+void               ephy_host_predictor_add_link          (EphyHostPredictor *predictor,
+                                                          const char *from_url,
+                                                          const char *to_url);
+
+guint              ephy_host_predictor_get_n_predicted   (EphyHostPredictor *predictor);
+
+guint              ephy_host_predictor_get_n_hits        (EphyHostPredictor *predictor);
+
+G_END_DECLS
+
+#endif /* EPHY_HOST_PREDICTOR_H */
@@ -52,6 +52,8 @@ struct _EphyDownloadWidgetPrivate
   GtkWidget *menu;
   GtkWidget *icon;
 
+  GCancellable *cancellable;
+
   gboolean finished;
 };
 
@@ -61,6 +63,19 @@ enum
   PROP_DOWNLOAD
 };
 
+static GIcon *
+get_gicon_for_content_type (const char *content_type)
+{
+  GIcon *gicon;
+
+  if (content_type != NULL)
+    gicon = g_content_type_get_icon (content_type);
+  else
+    gicon = g_icon_new_for_string ("package-x-generic", NULL);
+
+  return gicon;
+}
+
 static GIcon *
 get_gicon_from_download (EphyDownload *ephy_download)
 {
@@ -68,13 +83,8 @@ get_gicon_from_download (EphyDownload *ephy_download)
   GIcon *gicon;
 
   content_type = ephy_download_get_content_type (ephy_download);
-
-  if (content_type != NULL) {
-    gicon = g_content_type_get_icon (content_type);
-    g_free (content_type);
-  } else {
-    gicon = g_icon_new_for_string ("package-x-generic", NULL);
-  }
+  gicon = get_gicon_for_content_type (content_type);
+  g_free (content_type);
 
   return gicon;
 }
@@ -128,23 +138,21 @@ format_interval (gdouble interval)
 }
 
 static gdouble
-get_remaining_time (WebKitDownload *download)
+get_remaining_time (EphyDownload *ephy_download)
 {
+#ifdef HAVE_WEBKIT2
+  /* Smoothed over the recent rate, not the average since the start. */
+  return ephy_download_get_remaining_time (ephy_download);
+#else
+  WebKitDownload *download;
   gint64 total, cur;
   gdouble elapsed_time;
   gdouble remaining_time;
   gdouble per_byte_time;
-#ifdef HAVE_WEBKIT2
-  WebKitURIResponse *response;
-
-  response = webkit_download_get_response (download);
-  total = webkit_uri_response_get_content_length (response);
-  cur = webkit_download_get_received_data_length (download);
-#else
 
+  download = ephy_download_get_webkit_download (ephy_download);
   total = webkit_download_get_total_size (download);
   cur = webkit_download_get_current_size (download);
-#endif
   elapsed_time = webkit_download_get_elapsed_time (download);
 
   if (cur <= 0)
@@ -154,6 +162,7 @@ get_remaining_time (WebKitDownload *download)
   remaining_time = per_byte_time * (total - cur);
 
   return remaining_time;
+#endif
 }
 
 static void
@@ -171,11 +180,24 @@ download_clicked_cb (GtkButton *button,
 }
 
 static void
-update_download_icon (EphyDownloadWidget *widget)
+download_content_type_cb (EphyDownload *download,
+                          GAsyncResult *result,
+                          EphyDownloadWidget *widget)
 {
   GIcon *new_icon, *old_icon;
+  char *content_type;
+  GError *error = NULL;
+
+  content_type = ephy_download_get_content_type_finish (download, result, &error);
+  if (error) {
+    /* Cancelled, the widget may be gone already. */
+    g_error_free (error);
+    return;
+  }
+
+  new_icon = get_gicon_for_content_type (content_type);
+  g_free (content_type);
 
-  new_icon = get_gicon_from_download (widget->priv->download);
   gtk_image_get_gicon (GTK_IMAGE (widget->priv->icon), &old_icon, NULL);
   if (!g_icon_equal (new_icon, old_icon)) {
     gtk_image_set_from_gicon (GTK_IMAGE (widget->priv->icon), new_icon,
@@ -184,6 +206,19 @@ update_download_icon (EphyDownloadWidget *widget)
   g_object_unref (new_icon);
 }
 
+static void
+update_download_icon (EphyDownloadWidget *widget)
+{
+  g_cancellable_cancel (widget->priv->cancellable);
+  g_object_unref (widget->priv->cancellable);
+  widget->priv->cancellable = g_cancellable_new ();
+
+  ephy_download_get_content_type_async (widget->priv->download,
+                                        widget->priv->cancellable,
+                                        (GAsyncReadyCallback)download_content_type_cb,
+                                        widget);
+}
+
 static void
 update_download_label_and_tooltip (EphyDownloadWidget *widget,
                                    const char *download_label)
@@ -226,13 +261,14 @@ download_content_length_is_known (WebKitDownload *download)
 }
 
 static void
-widget_progress_cb (WebKitDownload *download,
-                    GParamSpec *pspec,
-                    EphyDownloadWidget *widget)
+update_download_progress (EphyDownloadWidget *widget)
 {
+  WebKitDownload *download;
   int progress;
   char *download_label = NULL;
 
+  download = ephy_download_get_webkit_download (widget->priv->download);
+
 #ifdef HAVE_WEBKIT2
   if (!webkit_download_get_destination (download))
     return;
@@ -248,7 +284,7 @@ widget_progress_cb (WebKitDownload *download,
   if (download_content_length_is_known (download)) {
     gdouble time;
 
-    time = get_remaining_time (download);
+    time = get_remaining_time (widget->priv->download);
     if (time > 0) {
       char *remaining;
 
@@ -269,12 +305,31 @@ widget_progress_cb (WebKitDownload *download,
       download_label = g_format_size (current_size);
   }
 
-  if (download_label) {
+  /* Most updates only change the progress of large downloads. */
+  if (download_label &&
+      g_strcmp0 (download_label, gtk_label_get_text (GTK_LABEL (widget->priv->remaining))) != 0)
     update_download_label_and_tooltip (widget, download_label);
-    g_free (download_label);
-  }
+
+  g_free (download_label);
 }
 
+#ifdef HAVE_WEBKIT2
+static void
+widget_progress_cb (EphyDownload *download,
+                    EphyDownloadWidget *widget)
+{
+  update_download_progress (widget);
+}
+#else
+static void
+widget_progress_cb (WebKitDownload *download,
+                    GParamSpec *pspec,
+                    EphyDownloadWidget *widget)
+{
+  update_download_progress (widget);
+}
+#endif
+
 #ifdef HAVE_WEBKIT2
 static void
 widget_destination_changed_cb (WebKitDownload *download,
@@ -293,6 +348,7 @@ widget_finished_cb (WebKitDownload *download,
                     EphyDownloadWidget *widget)
 {
   widget->priv->finished = TRUE;
+  update_download_icon (widget);
   update_download_label_and_tooltip (widget, _("Finished"));
   totem_glow_button_set_glow (TOTEM_GLOW_BUTTON (widget->priv->button), TRUE);
 }
@@ -488,11 +544,17 @@ ephy_download_widget_dispose (GObject *object)
 
   widget = EPHY_DOWNLOAD_WIDGET (object);
 
+  if (widget->priv->cancellable != NULL) {
+    g_cancellable_cancel (widget->priv->cancellable);
+    g_object_unref (widget->priv->cancellable);
+    widget->priv->cancellable = NULL;
+  }
+
   if (widget->priv->download != NULL) {
     download = ephy_download_get_webkit_download (widget->priv->download);
 
 #ifdef HAVE_WEBKIT2
-    g_signal_handlers_disconnect_by_func (download, widget_progress_cb, widget);
+    g_signal_handlers_disconnect_by_func (widget->priv->download, widget_progress_cb, widget);
     g_signal_handlers_disconnect_by_func (download, widget_destination_changed_cb, widget);
     g_signal_handlers_disconnect_by_func (download, widget_finished_cb, widget);
     g_signal_handlers_disconnect_by_func (download, widget_failed_cb, widget);
@@ -543,6 +605,7 @@ ephy_download_widget_init (EphyDownloadWidget *self)
   GtkStyleContext *context;
 
   self->priv = DOWNLOAD_WIDGET_PRIVATE (self);
+  self->priv->cancellable = g_cancellable_new ();
 
   gtk_orientable_set_orientation (GTK_ORIENTABLE (self),
                                   GTK_ORIENTATION_HORIZONTAL);
@@ -643,7 +706,8 @@ ephy_download_widget_new (EphyDownload *ephy_download)
   widget->priv->menu = menu;
 
 #ifdef HAVE_WEBKIT2
-  g_signal_connect (download, "notify::estimated-progress",
+  /* Progress comes from the download manager, a frame at a time. */
+  g_signal_connect (ephy_download, "progress",
                     G_CALLBACK (widget_progress_cb), widget);
   g_signal_connect (download, "notify::destination",
                     G_CALLBACK (widget_destination_changed_cb), widget);
@@ -23,6 +23,7 @@
 #include "ephy-frecent-store.h"
 #include "ephy-history-service.h"
 #include "ephy-snapshot-service.h"
+#include "ephy-uri-split.h"
 
 #include <libsoup/soup.h>
 
@@ -52,6 +53,7 @@ on_find_urls_cb (EphyHistoryService *service,
   GtkTreeIter treeiter;
   gboolean valid;
   GList *iter;
+  GList *peek_urls = NULL;
   gboolean peek_snapshot;
   GdkPixbuf *default_icon;
 
@@ -97,18 +99,22 @@ on_find_urls_cb (EphyHistoryService *service,
     }
 
     if (peek_snapshot)
-      ephy_overview_store_peek_snapshot (EPHY_OVERVIEW_STORE (store),
-                                         NULL, &treeiter);
+      peek_urls = g_list_prepend (peek_urls, url);
 
     valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (store), &treeiter);
   }
 
-  g_list_free_full (urls, (GDestroyNotify)ephy_history_url_free);
-
   g_object_unref (default_icon);
 
   while (valid)
     valid = ephy_overview_store_remove (EPHY_OVERVIEW_STORE (store), &treeiter);
+
+  /* The query already gave us the thumbnail times, so all the
+     snapshots can be looked up in one go. */
+  ephy_overview_store_peek_snapshots (EPHY_OVERVIEW_STORE (store), peek_urls);
+  g_list_free (peek_urls);
+
+  g_list_free_full (urls, (GDestroyNotify)ephy_history_url_free);
 }
 
 static void
@@ -175,34 +181,63 @@ on_url_title_changed (EphyHistoryService *service,
 }
 
 static void
-on_url_deleted (EphyHistoryService *service,
-                const char *url,
-                EphyFrecentStore *store)
+on_urls_deleted (EphyHistoryService *service,
+                 const char * const *urls,
+                 EphyFrecentStore *store)
 {
   GtkTreeIter iter;
+  GHashTable *deleted;
   gchar *iter_url;
   gboolean needs_update = FALSE;
+  gboolean valid;
+  guint i;
 
   if (!gtk_tree_model_get_iter_first (GTK_TREE_MODEL (store), &iter))
     return;
 
+  deleted = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; urls[i] != NULL; i++)
+    g_hash_table_add (deleted, (gpointer)urls[i]);
+
+  /* A whole batch of deleted URLs is removed in one walk, and the
+   * store refetched once. */
   do {
     gtk_tree_model_get (GTK_TREE_MODEL (store), &iter,
                         EPHY_OVERVIEW_STORE_URI, &iter_url,
                         -1);
-    if (g_strcmp0 (iter_url, url) == 0) {
+    if (iter_url && g_hash_table_contains (deleted, iter_url)) {
       needs_update = TRUE;
-      ephy_overview_store_remove (EPHY_OVERVIEW_STORE (store), &iter);
-      g_free (iter_url);
-      break;
-    }
+      valid = ephy_overview_store_remove (EPHY_OVERVIEW_STORE (store), &iter);
+    } else
+      valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (store), &iter);
     g_free (iter_url);
-  } while (gtk_tree_model_iter_next (GTK_TREE_MODEL (store), &iter));
+  } while (valid);
+
+  g_hash_table_destroy (deleted);
 
   if (needs_update)
     ephy_frecent_store_fetch_urls (store, service);
 }
 
+static gboolean
+url_has_host (const char *url,
+              const char *host)
+{
+  EphyUriSplit split;
+  SoupURI *uri;
+  gboolean retval;
+
+  if (ephy_uri_split (url, &split))
+    return split.host ? host && ephy_uri_split_has_host (&split, host) : host == NULL;
+
+  uri = soup_uri_new (url);
+  retval = g_strcmp0 (uri ? soup_uri_get_host (uri) : NULL, host) == 0;
+  if (uri)
+    soup_uri_free (uri);
+
+  return retval;
+}
+
 static void
 on_host_deleted (EphyHistoryService *service,
                  const char *deleted_url,
@@ -210,8 +245,8 @@ on_host_deleted (EphyHistoryService *service,
 {
   GtkTreeIter iter;
   gchar *iter_url;
-  SoupURI *store_uri;
   SoupURI *deleted_uri;
+  const char *deleted_host;
   gboolean needs_update = FALSE;
   gboolean remove, valid;
 
@@ -219,14 +254,13 @@ on_host_deleted (EphyHistoryService *service,
     return;
 
   deleted_uri = soup_uri_new (deleted_url);
+  deleted_host = deleted_uri ? soup_uri_get_host (deleted_uri) : NULL;
 
   do {
     gtk_tree_model_get (GTK_TREE_MODEL (store), &iter,
                         EPHY_OVERVIEW_STORE_URI, &iter_url,
                         -1);
-    store_uri = soup_uri_new (iter_url);
-    remove = g_strcmp0 (soup_uri_get_host (deleted_uri), soup_uri_get_host (store_uri)) == 0;
-    soup_uri_free (store_uri);
+    remove = url_has_host (iter_url, deleted_host);
     g_free (iter_url);
 
     if (remove) {
@@ -236,7 +270,8 @@ on_host_deleted (EphyHistoryService *service,
       valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (store), &iter);
   } while (valid);
 
-  soup_uri_free (deleted_uri);
+  if (deleted_uri)
+    soup_uri_free (deleted_uri);
 
   if (needs_update)
     ephy_frecent_store_fetch_urls (store, service);
@@ -258,8 +293,8 @@ setup_history_service (EphyFrecentStore *store)
                     G_CALLBACK (on_cleared_cb), store);
   g_signal_connect (service, "url-title-changed",
                     G_CALLBACK (on_url_title_changed), store);
-  g_signal_connect (service, "url-deleted",
-                    G_CALLBACK (on_url_deleted), store);
+  g_signal_connect (service, "urls-deleted",
+                    G_CALLBACK (on_urls_deleted), store);
   g_signal_connect (service, "host-deleted",
                     G_CALLBACK (on_host_deleted), store);
   g_object_unref (service);
@@ -22,13 +22,12 @@
 #include "config.h"
 
 #include "ephy-embed-prefs.h"
-#include "ephy-favicon-helpers.h"
+#include "ephy-favicon-cache.h"
 #include "ephy-hosts-store.h"
 
 #include <glib/gi18n.h>
-#ifdef HAVE_WEBKIT2
 #include <libsoup/soup.h>
-#endif
+#include <string.h>
 
 G_DEFINE_TYPE (EphyHostsStore, ephy_hosts_store, GTK_TYPE_LIST_STORE)
 
@@ -43,24 +42,9 @@ async_update_favicon_icon (GObject *source, GAsyncResult *result, gpointer user_
   GtkTreeIter iter;
   GtkTreePath *path;
   IconLoadData *data = (IconLoadData *)user_data;
-  WebKitFaviconDatabase *database;
-  GdkPixbuf *favicon = NULL;
-#ifdef HAVE_WEBKIT2
-  cairo_surface_t *icon_surface;
-#endif
-
-  database = WEBKIT_FAVICON_DATABASE (source);
-
-#ifdef HAVE_WEBKIT2
-  icon_surface = webkit_favicon_database_get_favicon_finish (database, result, NULL);
+  GdkPixbuf *favicon;
 
-  if (icon_surface) {
-    favicon = ephy_pixbuf_get_from_surface_scaled (icon_surface, FAVICON_SIZE, FAVICON_SIZE);
-    cairo_surface_destroy (icon_surface);
-  }
-#else
-  favicon = webkit_favicon_database_get_favicon_pixbuf_finish (database, result, NULL);
-#endif
+  favicon = ephy_favicon_cache_get_favicon_finish (EPHY_FAVICON_CACHE (source), result, NULL);
 
   if (favicon) {
     /* The completion model might have changed its contents */
@@ -80,11 +64,35 @@ async_update_favicon_icon (GObject *source, GAsyncResult *result, gpointer user_
 }
 
 static void
-icon_changed_cb (WebKitFaviconDatabase *database,
+set_favicon (GtkListStore *store, GtkTreeIter *iter, const char *address)
+{
+  EphyFaviconCache *cache = ephy_favicon_cache_get_default ();
+  GdkPixbuf *favicon;
+  IconLoadData *data;
+  GtkTreePath *path;
+
+  if (ephy_favicon_cache_lookup (cache, address, FAVICON_SIZE, &favicon)) {
+    gtk_list_store_set (store, iter,
+                        EPHY_HOSTS_STORE_COLUMN_FAVICON, favicon,
+                        -1);
+    if (favicon)
+      g_object_unref (favicon);
+    return;
+  }
+
+  data = g_slice_new (IconLoadData);
+  data->model = GTK_LIST_STORE (g_object_ref (store));
+  path = gtk_tree_model_get_path (GTK_TREE_MODEL (store), iter);
+  data->row_reference = gtk_tree_row_reference_new (GTK_TREE_MODEL (store), path);
+  gtk_tree_path_free (path);
+
+  ephy_favicon_cache_get_favicon_async (cache, address, FAVICON_SIZE, NULL,
+                                        async_update_favicon_icon, data);
+}
+
+static void
+icon_changed_cb (EphyFaviconCache *cache,
                  const char *page_uri,
-#ifdef HAVE_WEBKIT2
-                 const char *favicon_uri,
-#endif
                  GtkTreeModel *model)
 {
   GtkTreeIter iter;
@@ -98,8 +106,9 @@ icon_changed_cb (WebKitFaviconDatabase *database,
   /* If the page_uri has a path, this icon is not for a host, so it
      can be skipped. */
   uri = soup_uri_new (page_uri);
-  done = strcmp (soup_uri_get_path (uri), "/") != 0;
-  soup_uri_free (uri);
+  done = uri == NULL || strcmp (soup_uri_get_path (uri), "/") != 0;
+  if (uri)
+    soup_uri_free (uri);
 
   while (valid && !done) {
     gtk_tree_model_get (model, &iter,
@@ -107,36 +116,9 @@ icon_changed_cb (WebKitFaviconDatabase *database,
     cmp = g_strcmp0 (host_address, page_uri);
     g_free (host_address);
 
-    if (cmp == 0) {
-#ifdef HAVE_WEBKIT2
-      IconLoadData *data;
-      GtkTreePath *path;
-
-      data = g_slice_new (IconLoadData);
-      data->model = GTK_LIST_STORE (g_object_ref (model));
-      path = gtk_tree_model_get_path (model, &iter);
-      data->row_reference = gtk_tree_row_reference_new (model, path);
-      gtk_tree_path_free (path);
+    if (cmp == 0)
+      set_favicon (GTK_LIST_STORE (model), &iter, page_uri);
 
-      webkit_favicon_database_get_favicon (database,
-                                           page_uri,
-                                           0,
-                                           async_update_favicon_icon,
-                                           data);
-#else
-      GdkPixbuf *favicon = webkit_favicon_database_try_get_favicon_pixbuf (database,
-                                                                           page_uri,
-                                                                           FAVICON_SIZE,
-                                                                           FAVICON_SIZE);
-      if (favicon) {
-        gtk_list_store_set (GTK_LIST_STORE (model), &iter,
-                            EPHY_HOSTS_STORE_COLUMN_FAVICON, favicon,
-                            -1);
-        g_object_unref (favicon);
-      }
-
-#endif
-    }
     valid = gtk_tree_model_iter_next (model, &iter);
 
     /* Since the list is sorted alphanumerically, if the result of the
@@ -150,15 +132,9 @@ static void
 ephy_hosts_store_finalize (GObject *object)
 {
   EphyHostsStore *store = EPHY_HOSTS_STORE (object);
-  WebKitFaviconDatabase *database;
-
-#ifdef HAVE_WEBKIT2
-  database = webkit_web_context_get_favicon_database (webkit_web_context_get_default ());
-#else
-  database = webkit_get_favicon_database ();
-#endif
 
-  g_signal_handlers_disconnect_by_func (database, icon_changed_cb, store);
+  g_signal_handlers_disconnect_by_func (ephy_favicon_cache_get_default (),
+                                        icon_changed_cb, store);
 
   G_OBJECT_CLASS (ephy_hosts_store_parent_class)->finalize (object);
 }
@@ -189,13 +165,8 @@ ephy_hosts_store_init (EphyHostsStore *self)
                                         EPHY_HOSTS_STORE_COLUMN_ADDRESS,
                                         GTK_SORT_ASCENDING);
 
-#ifdef HAVE_WEBKIT2
-  g_signal_connect (webkit_web_context_get_favicon_database (webkit_web_context_get_default ()),
-                    "favicon-changed", G_CALLBACK (icon_changed_cb), self);
-#else
-  g_signal_connect (webkit_get_favicon_database (), "icon-loaded",
+  g_signal_connect (ephy_favicon_cache_get_default (), "favicon-changed",
                     G_CALLBACK (icon_changed_cb), self);
-#endif
 }
 
 EphyHostsStore *
@@ -211,27 +182,10 @@ ephy_hosts_store_add_hosts (EphyHostsStore *store,
 {
   EphyHistoryHost *host;
   GtkTreeIter treeiter;
-  GtkTreePath *path;
   GList *iter;
-  GdkPixbuf *favicon;
-  IconLoadData *data;
-  WebKitFaviconDatabase *database;
-
-#ifdef HAVE_WEBKIT2
-  database = webkit_web_context_get_favicon_database (webkit_web_context_get_default ());
-#else
-  database = webkit_get_favicon_database ();
-#endif
 
   for (iter = hosts; iter != NULL; iter = iter->next) {
     host = (EphyHistoryHost *)iter->data;
-#ifdef HAVE_WEBKIT2
-    /* Flag favicon to NULL to reuse some code later on */
-    favicon = NULL;
-#else
-    favicon = webkit_favicon_database_try_get_favicon_pixbuf (database, host->url,
-                                                              FAVICON_SIZE, FAVICON_SIZE);
-#endif
 
     gtk_list_store_insert_with_values (GTK_LIST_STORE (store),
                                        &treeiter, G_MAXINT,
@@ -239,31 +193,8 @@ ephy_hosts_store_add_hosts (EphyHostsStore *store,
                                        EPHY_HOSTS_STORE_COLUMN_TITLE, host->title,
                                        EPHY_HOSTS_STORE_COLUMN_ADDRESS, host->url,
                                        EPHY_HOSTS_STORE_COLUMN_VISIT_COUNT, host->visit_count,
-#ifndef HAVE_WEBKIT2
-                                       EPHY_HOSTS_STORE_COLUMN_FAVICON, favicon,
-#endif
                                        -1);
-    if (favicon)
-      g_object_unref (favicon);
-    else {
-      data = g_slice_new (IconLoadData);
-      data->model = GTK_LIST_STORE (g_object_ref (store));
-      path = gtk_tree_model_get_path (GTK_TREE_MODEL (store), &treeiter);
-      data->row_reference = gtk_tree_row_reference_new (GTK_TREE_MODEL (store), path);
-      gtk_tree_path_free (path);
-
-#ifdef HAVE_WEBKIT2
-      webkit_favicon_database_get_favicon (database,
-                                           host->url,
-                                           NULL,
-                                           async_update_favicon_icon,
-                                           data);
-#else
-      webkit_favicon_database_get_favicon_pixbuf (database, host->url,
-                                                  FAVICON_SIZE, FAVICON_SIZE, NULL,
-                                                  async_update_favicon_icon, data);
-#endif
-    }
+    set_favicon (GTK_LIST_STORE (store), &treeiter, host->url);
   }
 }
 
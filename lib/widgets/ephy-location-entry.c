@@ -74,6 +74,7 @@ struct _EphyLocationEntryPrivate
 	guint hash;
 
 	gulong dns_prefetch_handler;
+	EphyHostPredictor *host_predictor;
 
 	guint user_changed : 1;
 	guint can_redo : 1;
@@ -188,6 +189,11 @@ ephy_location_entry_finalize (GObject *object)
 	
 	g_free (priv->saved_text);
 
+	if (priv->host_predictor != NULL)
+	{
+		g_object_unref (priv->host_predictor);
+	}
+
 	if (priv->favicon != NULL)
 	{
 		g_object_unref (priv->favicon);
@@ -965,6 +971,11 @@ do_dns_prefetch (PrefetchHelper *helper)
 		soup_session_prefetch_dns (session, helper->uri->host, NULL, NULL, NULL);
 #endif
 
+	/* And whatever the page there is likely to need. */
+	if (helper->uri && helper->entry->priv->host_predictor)
+		ephy_host_predictor_prefetch_for_host (helper->entry->priv->host_predictor,
+						       helper->uri->host);
+
 	helper->entry->priv->dns_prefetch_handler = 0;
 
 	return FALSE;
@@ -1140,6 +1151,31 @@ ephy_location_entry_set_match_func (EphyLocationEntry *entry,
 	gtk_entry_completion_set_match_func (completion, match_func, user_data, notify);
 }
 
+/**
+ * ephy_location_entry_set_host_predictor:
+ * @entry: an #EphyLocationEntry widget
+ * @predictor: an #EphyHostPredictor
+ *
+ * Sets the #EphyHostPredictor used to prefetch the hosts that the
+ * highlighted completion is likely to need, besides its own.
+ *
+ **/
+void
+ephy_location_entry_set_host_predictor (EphyLocationEntry *entry,
+					EphyHostPredictor *predictor)
+{
+	EphyLocationEntryPrivate *priv = entry->priv;
+
+	g_return_if_fail (EPHY_IS_LOCATION_ENTRY (entry));
+
+	if (predictor)
+		g_object_ref (predictor);
+	if (priv->host_predictor)
+		g_object_unref (priv->host_predictor);
+
+	priv->host_predictor = predictor;
+}
+
 /**
  * ephy_location_entry_set_completion:
  * @entry: an #EphyLocationEntry widget
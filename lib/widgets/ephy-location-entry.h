@@ -28,6 +28,8 @@
 
 #include <gtk/gtk.h>
 
+#include "ephy-host-predictor.h"
+
 G_BEGIN_DECLS
 
 #define EPHY_TYPE_LOCATION_ENTRY		(ephy_location_entry_get_type())
@@ -86,6 +88,9 @@ void		ephy_location_entry_set_match_func	(EphyLocationEntry *entry,
 							 GtkEntryCompletionMatchFunc match_func,
 							 gpointer user_data,
 							 GDestroyNotify notify);
+
+void		ephy_location_entry_set_host_predictor	(EphyLocationEntry *entry,
+							 EphyHostPredictor *predictor);
 					
 const char     *ephy_location_entry_get_location	(EphyLocationEntry *entry);
 
@@ -61,6 +61,7 @@ struct _EphyNodeViewPrivate
 	GtkTargetList *drag_targets;
 
 	int sort_column;
+	guint sort_prop_id;
 	GtkSortType sort_type;
 	guint priority_prop_id;
 	int priority_column;
@@ -490,6 +491,65 @@ ephy_node_view_enable_drag_dest (EphyNodeView *view,
 			  G_CALLBACK (drag_leave_cb), view);
 }
 
+/* Evaluates the filter again only on the rows that are shown, or only on
+ * those that are hidden, by telling the filter model they changed. The
+ * others keep their visibility. */
+static void
+refilter_nodes (EphyNodeView *view,
+		gboolean visible)
+{
+	GtkTreeModel *nodemodel = GTK_TREE_MODEL (view->priv->nodemodel);
+	GtkTreeModelFilter *filtermodel = GTK_TREE_MODEL_FILTER (view->priv->filtermodel);
+	GtkTreeIter iter, filter_iter;
+	GPtrArray *nodes;
+	gboolean valid;
+	guint i;
+
+	/* collect first, the filter model changes under us afterwards */
+	nodes = g_ptr_array_new ();
+
+	if (visible)
+	{
+		for (valid = gtk_tree_model_get_iter_first (view->priv->filtermodel, &filter_iter);
+		     valid;
+		     valid = gtk_tree_model_iter_next (view->priv->filtermodel, &filter_iter))
+		{
+			gtk_tree_model_filter_convert_iter_to_child_iter
+				(filtermodel, &iter, &filter_iter);
+			g_ptr_array_add (nodes, ephy_tree_model_node_node_from_iter
+						(view->priv->nodemodel, &iter));
+		}
+	}
+	else
+	{
+		for (valid = gtk_tree_model_get_iter_first (nodemodel, &iter);
+		     valid;
+		     valid = gtk_tree_model_iter_next (nodemodel, &iter))
+		{
+			if (!gtk_tree_model_filter_convert_child_iter_to_iter
+				(filtermodel, &filter_iter, &iter))
+			{
+				g_ptr_array_add (nodes, ephy_tree_model_node_node_from_iter
+							(view->priv->nodemodel, &iter));
+			}
+		}
+	}
+
+	for (i = 0; i < nodes->len; i++)
+	{
+		GtkTreePath *path;
+
+		ephy_tree_model_node_iter_from_node (view->priv->nodemodel,
+						     g_ptr_array_index (nodes, i),
+						     &iter);
+		path = gtk_tree_model_get_path (nodemodel, &iter);
+		gtk_tree_model_row_changed (nodemodel, path, &iter);
+		gtk_tree_path_free (path);
+	}
+
+	g_ptr_array_free (nodes, TRUE);
+}
+
 static void
 filter_changed_cb (EphyNodeFilter *filter,
 		   EphyNodeView *view)
@@ -519,8 +579,19 @@ filter_changed_cb (EphyNodeFilter *filter,
 		 * only when the UI is free again */
 	}
 
-	gtk_tree_model_filter_refilter
-			(GTK_TREE_MODEL_FILTER (view->priv->filtermodel));
+	switch (ephy_node_filter_get_change (filter))
+	{
+	case EPHY_NODE_FILTER_CHANGE_NARROWED:
+		refilter_nodes (view, TRUE);
+		break;
+	case EPHY_NODE_FILTER_CHANGE_WIDENED:
+		refilter_nodes (view, FALSE);
+		break;
+	default:
+		gtk_tree_model_filter_refilter
+				(GTK_TREE_MODEL_FILTER (view->priv->filtermodel));
+		break;
+	}
 }
 
 static void
@@ -1059,36 +1130,28 @@ renderer_editing_canceled_cb (GtkCellRendererText *cell,
 	}
 }
 
-static inline int
-compare_string_values (const GValue *a_value, const GValue *b_value)
-{
-	const char *str1, *str2;
-	int retval;
-
-	str1 = g_value_get_string (a_value);
-	str2 = g_value_get_string (b_value);
-
-	if (str1 == NULL)
-	{
-		retval = -1;
-	}
-	else if (str2 == NULL)
-	{
-		retval = 1;
-	}
-	else
-	{
-		char *str_a;
-		char *str_b;
-
-		str_a = g_utf8_casefold (str1, -1);
-		str_b = g_utf8_casefold (str2, -1);
-		retval = g_utf8_collate (str_a, str_b);
-		g_free (str_a);
-		g_free (str_b);
-	}
-
-	return retval;
+static int
+compare_node_keys (EphyNodeView *view,
+		   GtkTreeIter *a,
+		   GtkTreeIter *b)
+{
+	GtkTreeModelFilter *filter = GTK_TREE_MODEL_FILTER (view->priv->filtermodel);
+	GtkTreeIter node_iter;
+	EphyNode *node_a, *node_b;
+	const char *key1, *key2;
+
+	gtk_tree_model_filter_convert_iter_to_child_iter (filter, &node_iter, a);
+	node_a = ephy_tree_model_node_node_from_iter (view->priv->nodemodel, &node_iter);
+	gtk_tree_model_filter_convert_iter_to_child_iter (filter, &node_iter, b);
+	node_b = ephy_tree_model_node_node_from_iter (view->priv->nodemodel, &node_iter);
+
+	key1 = ephy_node_get_property_casefold_key (node_a, view->priv->sort_prop_id);
+	key2 = ephy_node_get_property_casefold_key (node_b, view->priv->sort_prop_id);
+
+	if (key1 == key2) return 0;
+	if (key1 == NULL) return -1;
+	if (key2 == NULL) return 1;
+	return strcmp (key1, key2);
 }
 
 static int
@@ -1138,14 +1201,20 @@ ephy_node_view_sort_func (GtkTreeModel *model,
 
 		type = gtk_tree_model_get_column_type (model, column);
 
+		/* use the collation keys cached on the nodes instead of
+		 * folding and collating copies of the strings on every
+		 * comparison */
+		if (G_TYPE_FUNDAMENTAL (type) == G_TYPE_STRING)
+		{
+			retval = compare_node_keys (view, a, b);
+			goto out;
+		}
+
 		gtk_tree_model_get_value (model, a, column, &a_value);
 		gtk_tree_model_get_value (model, b, column, &b_value);
 
 		switch (G_TYPE_FUNDAMENTAL (type))
 		{
-		case G_TYPE_STRING:
-			retval = compare_string_values (&a_value, &b_value);
-			break;
 		case G_TYPE_INT:
 			if (g_value_get_int (&a_value) < g_value_get_int (&b_value))
 			{
@@ -1183,6 +1252,7 @@ ephy_node_view_sort_func (GtkTreeModel *model,
 		g_value_unset (&b_value);
 	}
 
+out:
 	if (sort_type == GTK_SORT_DESCENDING)
 	{
 		if (retval > 0)
@@ -1420,6 +1490,7 @@ ephy_node_view_set_sort (EphyNodeView *view, GType value_type, guint prop_id,
 	column = ephy_tree_model_node_add_prop_column
 		(view->priv->nodemodel, value_type, prop_id);
 	view->priv->sort_column = column;
+	view->priv->sort_prop_id = prop_id;
 	view->priv->sort_type = sort_type;
 
 	gtk_tree_sortable_set_default_sort_func
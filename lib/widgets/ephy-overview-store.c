@@ -245,38 +245,79 @@ on_snapshot_saved_cb (EphySnapshotService *service,
   g_slice_free (ThumbnailTimeContext, ctx);
 }
 
-void
-ephy_overview_store_set_snapshot (EphyOverviewStore *store,
-                                  GtkTreeIter *iter,
-                                  cairo_surface_t *snapshot,
-                                  cairo_surface_t *favicon)
+typedef struct {
+  GtkTreeRowReference *ref;
+  int mtime;
+} SetSnapshotContext;
+
+static void
+on_snapshot_prepared_cb (EphySnapshotService *service,
+                         GAsyncResult *res,
+                         SetSnapshotContext *ctx)
 {
+  EphyOverviewStore *store;
   GdkPixbuf *pixbuf;
+  GtkTreePath *path;
+  GtkTreeIter iter;
   char *url;
-  ThumbnailTimeContext *ctx;
-  EphySnapshotService *snapshot_service;
-  int mtime;
+  ThumbnailTimeContext *time_ctx;
 
-  mtime = time (NULL);
-  pixbuf = ephy_snapshot_service_prepare_snapshot (snapshot, favicon);
-  ephy_overview_store_set_snapshot_internal (store, iter, pixbuf, mtime);
-  gtk_tree_model_get (GTK_TREE_MODEL (store), iter,
+  pixbuf = ephy_snapshot_service_prepare_snapshot_finish (service, res, NULL);
+
+  /* The row might be gone by the time the snapshot is ready. */
+  if (pixbuf == NULL || !gtk_tree_row_reference_valid (ctx->ref))
+    goto out;
+
+  store = EPHY_OVERVIEW_STORE (gtk_tree_row_reference_get_model (ctx->ref));
+  path = gtk_tree_row_reference_get_path (ctx->ref);
+  gtk_tree_model_get_iter (GTK_TREE_MODEL (store), &iter, path);
+  gtk_tree_path_free (path);
+
+  ephy_overview_store_set_snapshot_internal (store, &iter, pixbuf, ctx->mtime);
+  gtk_tree_model_get (GTK_TREE_MODEL (store), &iter,
                       EPHY_OVERVIEW_STORE_URI, &url,
                       -1);
 
-  ctx = g_slice_new (ThumbnailTimeContext);
-  ctx->url = ephy_history_url_new (url, NULL, 0, 0, 0);
-  ctx->url->thumbnail_time = mtime;
-  ctx->history_service = store->priv->history_service;
+  time_ctx = g_slice_new (ThumbnailTimeContext);
+  time_ctx->url = ephy_history_url_new (url, NULL, 0, 0, 0);
+  time_ctx->url->thumbnail_time = ctx->mtime;
+  time_ctx->history_service = store->priv->history_service;
   g_free (url);
 
-  snapshot_service = ephy_snapshot_service_get_default ();
-  ephy_snapshot_service_save_snapshot_async (snapshot_service,
-                                             pixbuf, ctx->url->url, ctx->url->thumbnail_time,
+  ephy_snapshot_service_save_snapshot_async (service,
+                                             pixbuf, time_ctx->url->url, time_ctx->url->thumbnail_time,
                                              NULL,
                                              (GAsyncReadyCallback) on_snapshot_saved_cb,
-                                             ctx);
-  g_object_unref (pixbuf);
+                                             time_ctx);
+
+out:
+  if (pixbuf)
+    g_object_unref (pixbuf);
+  gtk_tree_row_reference_free (ctx->ref);
+  g_slice_free (SetSnapshotContext, ctx);
+}
+
+void
+ephy_overview_store_set_snapshot (EphyOverviewStore *store,
+                                  GtkTreeIter *iter,
+                                  cairo_surface_t *snapshot,
+                                  cairo_surface_t *favicon)
+{
+  SetSnapshotContext *ctx;
+  GtkTreePath *path;
+
+  ctx = g_slice_new (SetSnapshotContext);
+  ctx->mtime = time (NULL);
+  path = gtk_tree_model_get_path (GTK_TREE_MODEL (store), iter);
+  ctx->ref = gtk_tree_row_reference_new (GTK_TREE_MODEL (store), path);
+  gtk_tree_path_free (path);
+
+  /* Cropping and scaling a full web view is too much work for the
+     main thread, specially on high resolution screens. */
+  ephy_snapshot_service_prepare_snapshot_async (ephy_snapshot_service_get_default (),
+                                                snapshot, favicon, NULL,
+                                                (GAsyncReadyCallback) on_snapshot_prepared_cb,
+                                                ctx);
 }
 
 
@@ -420,6 +461,146 @@ ephy_overview_store_peek_snapshot (EphyOverviewStore *self,
   gtk_tree_path_free (path);
 }
 
+typedef struct {
+  EphyOverviewStore *store;
+  GPtrArray *refs;
+  GPtrArray *cancellables;
+  GArray *timestamps;
+} BatchPeekContext;
+
+static void
+batch_peek_context_free (BatchPeekContext *ctx)
+{
+  g_object_unref (ctx->store);
+  g_ptr_array_unref (ctx->refs);
+  g_ptr_array_unref (ctx->cancellables);
+  g_array_unref (ctx->timestamps);
+
+  g_slice_free (BatchPeekContext, ctx);
+}
+
+static void
+on_snapshots_retrieved_for_urls_cb (GObject *object,
+                                    GAsyncResult *res,
+                                    BatchPeekContext *ctx)
+{
+  GPtrArray *snapshots;
+  guint i;
+
+  snapshots = ephy_snapshot_service_get_snapshots_for_urls_finish (EPHY_SNAPSHOT_SERVICE (object),
+                                                                   res, NULL);
+
+  for (i = 0; i < ctx->refs->len; i++) {
+    GtkTreeRowReference *ref = g_ptr_array_index (ctx->refs, i);
+
+    /* The row was removed or peeked again in the meantime. */
+    if (g_cancellable_is_cancelled (g_ptr_array_index (ctx->cancellables, i)) ||
+        !gtk_tree_row_reference_valid (ref))
+      continue;
+
+    set_snapshot (ctx->store,
+                  snapshots ? g_ptr_array_index (snapshots, i) : NULL,
+                  ref, g_array_index (ctx->timestamps, time_t, i));
+  }
+
+  if (snapshots)
+    g_ptr_array_unref (snapshots);
+
+  batch_peek_context_free (ctx);
+}
+
+/**
+ * ephy_overview_store_peek_snapshots:
+ * @store: a #EphyOverviewStore
+ * @urls: (element-type EphyHistoryURL): the history URLs whose rows need a snapshot
+ *
+ * Like ephy_overview_store_peek_snapshot(), for all the rows showing
+ * @urls at once. The thumbnail times are taken from @urls rather than
+ * queried again, snapshots already in memory are set right away and
+ * the rest are loaded in a single worker job.
+ **/
+void
+ephy_overview_store_peek_snapshots (EphyOverviewStore *store,
+                                    GList *urls)
+{
+  BatchPeekContext *ctx;
+  GPtrArray *url_strings;
+  GList *l;
+
+  g_return_if_fail (EPHY_IS_OVERVIEW_STORE (store));
+
+  ctx = g_slice_new (BatchPeekContext);
+  ctx->store = g_object_ref (store);
+  ctx->refs = g_ptr_array_new_with_free_func ((GDestroyNotify)gtk_tree_row_reference_free);
+  ctx->cancellables = g_ptr_array_new_with_free_func (g_object_unref);
+  ctx->timestamps = g_array_new (FALSE, FALSE, sizeof (time_t));
+  url_strings = g_ptr_array_new ();
+
+  for (l = urls; l; l = l->next) {
+    EphyHistoryURL *url = (EphyHistoryURL *)l->data;
+    GtkTreeIter iter;
+    GtkTreePath *path;
+    GCancellable *cancellable;
+    GdkPixbuf *snapshot;
+    time_t timestamp;
+
+    if (url->url == NULL || g_strcmp0 (url->url, "about:blank") == 0)
+      continue;
+
+    if (!ephy_overview_store_find_url (store, url->url, &iter))
+      continue;
+
+    gtk_tree_model_get (GTK_TREE_MODEL (store), &iter,
+                        EPHY_OVERVIEW_STORE_SNAPSHOT_CANCELLABLE, &cancellable,
+                        -1);
+    if (cancellable) {
+      g_cancellable_cancel (cancellable);
+      g_object_unref (cancellable);
+    }
+
+    timestamp = url->thumbnail_time;
+    snapshot = ephy_snapshot_service_lookup_cached_snapshot (ephy_snapshot_service_get_default (),
+                                                             url->url, timestamp);
+    if (snapshot) {
+      ephy_overview_store_set_snapshot_internal (store, &iter, snapshot, timestamp);
+      gtk_list_store_set (GTK_LIST_STORE (store), &iter,
+                          EPHY_OVERVIEW_STORE_SNAPSHOT_CANCELLABLE, NULL,
+                          -1);
+      g_object_unref (snapshot);
+      continue;
+    }
+
+    cancellable = g_cancellable_new ();
+    gtk_list_store_set (GTK_LIST_STORE (store), &iter,
+                        EPHY_OVERVIEW_STORE_SNAPSHOT_CANCELLABLE, cancellable,
+                        -1);
+
+    path = gtk_tree_model_get_path (GTK_TREE_MODEL (store), &iter);
+    g_ptr_array_add (ctx->refs, gtk_tree_row_reference_new (GTK_TREE_MODEL (store), path));
+    gtk_tree_path_free (path);
+    g_ptr_array_add (ctx->cancellables, cancellable);
+    g_array_append_val (ctx->timestamps, timestamp);
+    g_ptr_array_add (url_strings, url->url);
+  }
+
+  if (url_strings->len == 0) {
+    batch_peek_context_free (ctx);
+    g_ptr_array_free (url_strings, TRUE);
+    return;
+  }
+
+  /* Each row has its own cancellable, checked when the batch is done,
+     so that removing a row doesn't abort the rest of the batch. */
+  ephy_snapshot_service_get_snapshots_for_urls_async (ephy_snapshot_service_get_default (),
+                                                      (const char * const *)url_strings->pdata,
+                                                      (time_t *)ctx->timestamps->data,
+                                                      url_strings->len,
+                                                      NULL,
+                                                      (GAsyncReadyCallback)on_snapshots_retrieved_for_urls_cb,
+                                                      ctx);
+  g_ptr_array_free (url_strings, TRUE);
+}
+
 static gboolean
 set_default_icon_helper (GtkTreeModel *model,
                          GtkTreePath *path,
@@ -74,6 +74,9 @@ void     ephy_overview_store_peek_snapshot        (EphyOverviewStore *self,
                                                    WebKitWebView *webview,
                                                    GtkTreeIter *iter);
 
+void     ephy_overview_store_peek_snapshots       (EphyOverviewStore *store,
+                                                   GList             *urls);
+
 void     ephy_overview_store_set_default_icon     (EphyOverviewStore *store,
                                                    GdkPixbuf         *default_icon);
 
@@ -27,7 +27,7 @@
 #include "ephy-debug.h"
 #include "ephy-dnd.h"
 #include "ephy-embed-prefs.h"
-#include "ephy-favicon-helpers.h"
+#include "ephy-favicon-cache.h"
 #include "ephy-gui.h"
 #include "ephy-shell.h"
 #include "ephy-string.h"
@@ -67,86 +67,60 @@ typedef struct
 
 G_DEFINE_TYPE (EphyBookmarkAction, ephy_bookmark_action, EPHY_TYPE_LINK_ACTION)
 
-#ifdef HAVE_WEBKIT2
 static void
-favicon_changed_cb (WebKitFaviconDatabase *database,
-                    const char *page_address,
-                    const char *icon_address,
-                    EphyBookmarkAction *action)
+favicon_changed_cb (EphyFaviconCache *cache,
+		    const char *page_address,
+		    EphyBookmarkAction *action)
 {
-        const char *icon;
+	const char *location;
+
+	g_return_if_fail (action->priv->node != NULL);
+
+	location = ephy_node_get_property_string (action->priv->node,
+						  EPHY_NODE_BMK_PROP_LOCATION);
 
-        icon = ephy_node_get_property_string (action->priv->node,
-                                              EPHY_NODE_BMK_PROP_ICON);
-        if (g_strcmp0 (icon, icon_address) == 0)
-        {
-                g_signal_handler_disconnect (database, action->priv->cache_handler);
-                action->priv->cache_handler = 0;
+	if (g_strcmp0 (location, page_address) == 0)
+	{
+		g_signal_handler_disconnect (cache, action->priv->cache_handler);
+		action->priv->cache_handler = 0;
 
-                g_object_notify (G_OBJECT (action), "icon");
-        }
+		g_object_notify (G_OBJECT (action), "icon");
+	}
 }
 
 static void
-async_get_favicon_pixbuf_callback (GObject *source, GAsyncResult *result, gpointer user_data)
+set_proxy_favicon (GtkWidget *proxy,
+		   GdkPixbuf *pixbuf)
 {
-       GtkWidget *proxy = GTK_WIDGET (user_data);
-       WebKitFaviconDatabase *database = WEBKIT_FAVICON_DATABASE (source);
-       GdkPixbuf *pixbuf = NULL;
-
-       cairo_surface_t *icon_surface = webkit_favicon_database_get_favicon_finish (database, result, NULL);
-       if (icon_surface)
-       {
-               pixbuf = ephy_pixbuf_get_from_surface_scaled (icon_surface, FAVICON_SIZE, FAVICON_SIZE);
-               cairo_surface_destroy (icon_surface);
-       }
+	if (GTK_IS_MENU_ITEM (proxy))
+	{
+		GtkWidget *image;
 
-       if (pixbuf)
-       {
-               if (GTK_IS_MENU_ITEM (proxy))
-               {
-                       GtkWidget *image;
-
-                       image = gtk_image_new_from_pixbuf (pixbuf);
-                       gtk_widget_show (image);
-
-                       gtk_image_menu_item_set_image
-                         (GTK_IMAGE_MENU_ITEM (proxy), image);
-                       gtk_image_menu_item_set_always_show_image (GTK_IMAGE_MENU_ITEM (proxy),
-                                                                  TRUE);
-               }
-               g_object_unref (pixbuf);
-       }
+		image = gtk_image_new_from_pixbuf (pixbuf);
+		gtk_widget_show (image);
 
-       g_object_unref (proxy);
+		gtk_image_menu_item_set_image
+			(GTK_IMAGE_MENU_ITEM (proxy), image);
+		gtk_image_menu_item_set_always_show_image (GTK_IMAGE_MENU_ITEM (proxy),
+							   TRUE);
+	}
 }
 
-#else
 static void
-favicon_changed_cb (WebKitFaviconDatabase *database,
-                    const char *page_address,
-                    EphyBookmarkAction *action)
+async_get_favicon_pixbuf_callback (GObject *source, GAsyncResult *result, gpointer user_data)
 {
-	const char *icon;
-	char *icon_address;
-
-	g_return_if_fail (action->priv->node != NULL);
-
-	icon = ephy_node_get_property_string (action->priv->node,
-					      EPHY_NODE_BMK_PROP_ICON);
-	icon_address = webkit_favicon_database_get_favicon_uri (database, page_address);
+	GtkWidget *proxy = GTK_WIDGET (user_data);
+	GdkPixbuf *pixbuf;
 
-	if (g_strcmp0 (icon, icon_address) == 0)
+	pixbuf = ephy_favicon_cache_get_favicon_finish (EPHY_FAVICON_CACHE (source), result, NULL);
+	if (pixbuf)
 	{
-		g_signal_handler_disconnect (database, action->priv->cache_handler);
-		action->priv->cache_handler = 0;
-
-		g_object_notify (G_OBJECT (action), "icon");
+		set_proxy_favicon (proxy, pixbuf);
+		g_object_unref (pixbuf);
 	}
 
-	g_free (icon_address);
+	g_object_unref (proxy);
 }
-#endif
 
 static void
 ephy_bookmark_action_sync_icon (GtkAction *action,
@@ -154,63 +128,40 @@ ephy_bookmark_action_sync_icon (GtkAction *action,
 				GtkWidget *proxy)
 {
 	EphyBookmarkAction *bma = EPHY_BOOKMARK_ACTION (action);
+	EphyFaviconCache *cache;
 	const char *page_location;
-	WebKitFaviconDatabase *database;
+	GdkPixbuf *pixbuf;
 
 	g_return_if_fail (bma->priv->node != NULL);
 
 	page_location = ephy_node_get_property_string (bma->priv->node,
 						       EPHY_NODE_BMK_PROP_LOCATION);
 
-#ifdef HAVE_WEBKIT2
-        database = webkit_web_context_get_favicon_database (webkit_web_context_get_default ());
-#else
-        database = webkit_get_favicon_database ();
-#endif
-	if (page_location && *page_location)
+	if (page_location == NULL || *page_location == '\0') return;
+
+	cache = ephy_favicon_cache_get_default ();
+
+	if (bma->priv->cache_handler == 0)
 	{
-#ifndef HAVE_WEBKIT2
-                GdkPixbuf *pixbuf = webkit_favicon_database_try_get_favicon_pixbuf (database, page_location,
-                                                                                    FAVICON_SIZE, FAVICON_SIZE);
-                if (pixbuf == NULL && bma->priv->cache_handler == 0)
-                {
-                        bma->priv->cache_handler =
-                        g_signal_connect_object (database, "icon-loaded",
-                                                 G_CALLBACK (favicon_changed_cb),
-                                                 action, 0);
-                }
-
-                if (GTK_IS_MENU_ITEM (proxy) && pixbuf)
-                {
-                        GtkWidget *image;
-
-                        image = gtk_image_new_from_pixbuf (pixbuf);
-                        gtk_widget_show (image);
-
-                        gtk_image_menu_item_set_image
-                                (GTK_IMAGE_MENU_ITEM (proxy), image);
-                        gtk_image_menu_item_set_always_show_image (GTK_IMAGE_MENU_ITEM (proxy),
-                                                                  TRUE);
-                }
-
-                if (pixbuf)
-                {
-                        g_object_unref (pixbuf);
-                }
-#else
-                webkit_favicon_database_get_favicon (database, page_location,
-                                                     0, async_get_favicon_pixbuf_callback,
-                                                     g_object_ref (proxy));
-                if (bma->priv->cache_handler == 0)
-                {
-	                bma->priv->cache_handler =
-			g_signal_connect_object
-				(database, "favicon-changed",
-				 G_CALLBACK (favicon_changed_cb),
-				 action, 0);
-                }
-#endif
+		bma->priv->cache_handler =
+			g_signal_connect_object (cache, "favicon-changed",
+						 G_CALLBACK (favicon_changed_cb),
+						 action, 0);
 	}
+
+	if (ephy_favicon_cache_lookup (cache, page_location, FAVICON_SIZE, &pixbuf))
+	{
+		if (pixbuf)
+		{
+			set_proxy_favicon (proxy, pixbuf);
+			g_object_unref (pixbuf);
+		}
+		return;
+	}
+
+	ephy_favicon_cache_get_favicon_async (cache, page_location, FAVICON_SIZE,
+					      NULL, async_get_favicon_pixbuf_callback,
+					      g_object_ref (proxy));
 }
 
 void
@@ -448,13 +399,8 @@ ephy_bookmark_action_dispose (GObject *object)
 
 	if (priv->cache_handler != 0)
 	{
-		WebKitFaviconDatabase *database;
-#ifdef HAVE_WEBKIT2
-                database = webkit_web_context_get_favicon_database (webkit_web_context_get_default ());
-#else
-                database = webkit_get_favicon_database ();
-#endif
-		g_signal_handler_disconnect (database, priv->cache_handler);
+		g_signal_handler_disconnect (ephy_favicon_cache_get_default (),
+					     priv->cache_handler);
 		priv->cache_handler = 0;
 	}
 
@@ -27,6 +27,7 @@
 #include "ephy-debug.h"
 #include "ephy-dnd.h"
 #include "ephy-embed-prefs.h"
+#include "ephy-favicon-cache.h"
 #include "ephy-file-chooser.h"
 #include "ephy-file-helpers.h"
 #include "ephy-gui.h"
@@ -529,16 +530,106 @@ add_bookmarks_source (const char *file,
 	g_strfreev (path);
 }
 
+typedef struct
+{
+	EphyBookmarksEditor *editor;
+	char *filename;
+	GCancellable *cancellable;
+	GtkWidget *dialog;
+	GtkWidget *progress;
+} ImportData;
+
 static void
-import_bookmarks (EphyBookmarksEditor *editor,
-		  const char *filename)
+import_progress_cb (guint n_done,
+		    guint n_total,
+		    gpointer user_data)
+{
+	ImportData *data = user_data;
+	char *text;
+
+	/* The total is not known while the file is parsed */
+	if (n_total == 0)
+	{
+		text = g_strdup_printf (ngettext ("Found %u bookmark",
+						  "Found %u bookmarks",
+						  n_done), n_done);
+		gtk_progress_bar_pulse (GTK_PROGRESS_BAR (data->progress));
+	}
+	else
+	{
+		text = g_strdup_printf (ngettext ("Added %u of %u bookmark",
+						  "Added %u of %u bookmarks",
+						  n_total), n_done, n_total);
+		gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (data->progress),
+					       (double) n_done / n_total);
+	}
+
+	gtk_progress_bar_set_text (GTK_PROGRESS_BAR (data->progress), text);
+	g_free (text);
+}
+
+static void
+import_progress_response_cb (GtkDialog *dialog,
+			     int response,
+			     ImportData *data)
+{
+	/* Whatever was added so far is removed again */
+	g_cancellable_cancel (data->cancellable);
+	gtk_widget_set_sensitive (GTK_WIDGET (dialog), FALSE);
+}
+
+static GtkWidget *
+import_progress_dialog_new (ImportData *data)
+{
+	GtkWidget *dialog;
+	GtkWidget *content_area;
+
+	dialog = gtk_message_dialog_new (GTK_WINDOW (data->editor),
+					 GTK_DIALOG_DESTROY_WITH_PARENT,
+					 GTK_MESSAGE_INFO,
+					 GTK_BUTTONS_CANCEL,
+					 _("Importing bookmarks"));
+	gtk_window_set_title (GTK_WINDOW (dialog), _("Import Bookmarks"));
+
+	/* Kept alive for the progress callback, until the import is
+	 * over, even if the editor takes the dialog down with it */
+	data->progress = g_object_ref_sink (gtk_progress_bar_new ());
+	gtk_progress_bar_set_show_text (GTK_PROGRESS_BAR (data->progress), TRUE);
+	content_area = gtk_message_dialog_get_message_area (GTK_MESSAGE_DIALOG (dialog));
+	gtk_box_pack_start (GTK_BOX (content_area),
+			    data->progress, FALSE, FALSE, 0);
+	gtk_widget_show (data->progress);
+
+	gtk_window_group_add_window (gtk_window_get_group (GTK_WINDOW (data->editor)),
+				     GTK_WINDOW (dialog));
+
+	g_signal_connect (dialog, "response",
+			  G_CALLBACK (import_progress_response_cb), data);
+
+	return dialog;
+}
+
+static void
+import_bookmarks_cb (GObject *source,
+		     GAsyncResult *result,
+		     gpointer user_data)
 {
-	if (ephy_bookmarks_import (editor->priv->bookmarks, filename) == FALSE)
+	ImportData *data = user_data;
+	EphyBookmarksEditor *editor = data->editor;
+	GError *error = NULL;
+
+	g_signal_handlers_disconnect_by_func (data->dialog,
+					      import_progress_response_cb, data);
+	gtk_widget_destroy (data->dialog);
+
+	if (!ephy_bookmarks_import_finish (EPHY_BOOKMARKS (source), result, &error) &&
+	    !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+	    gtk_widget_get_realized (GTK_WIDGET (editor)))
 	{
 		GtkWidget *dialog;
 		char *basename;
 
-		basename = g_filename_display_basename (filename);
+		basename = g_filename_display_basename (data->filename);
 		dialog = gtk_message_dialog_new (GTK_WINDOW (editor),
 						 GTK_DIALOG_MODAL,
 						 GTK_MESSAGE_ERROR,
@@ -561,6 +652,35 @@ import_bookmarks (EphyBookmarksEditor *editor,
 		g_free (basename);
 		gtk_widget_destroy (dialog);
 	}
+
+	g_clear_error (&error);
+	g_object_unref (data->progress);
+	g_object_unref (data->dialog);
+	g_object_unref (data->cancellable);
+	g_object_unref (data->editor);
+	g_free (data->filename);
+	g_slice_free (ImportData, data);
+}
+
+static void
+import_bookmarks (EphyBookmarksEditor *editor,
+		  const char *filename)
+{
+	ImportData *data;
+
+	data = g_slice_new (ImportData);
+	data->editor = g_object_ref (editor);
+	data->filename = g_strdup (filename);
+	data->cancellable = g_cancellable_new ();
+	data->dialog = g_object_ref (import_progress_dialog_new (data));
+
+	gtk_widget_show (data->dialog);
+
+	/* Parsing runs in a thread, keep the editor responsive meanwhile */
+	ephy_bookmarks_import_async (editor->priv->bookmarks, filename,
+				     data->cancellable,
+				     import_progress_cb, data,
+				     import_bookmarks_cb, data);
 }
 
 static void
@@ -1448,89 +1568,69 @@ node_dropped_cb (EphyNodeView *view,
 	}
 }
 
-#ifdef HAVE_WEBKIT2
-/* TODO: Favicons */
-#else
-static gboolean
-webkit_favicon_database_has_favicon (WebKitFaviconDatabase *database, const char *page_uri)
-{
-    gboolean result;
-    char *uri;
-
-    uri = webkit_favicon_database_get_favicon_uri (database, page_uri);
-    result = (uri != NULL);
-    g_free (uri);
-
-    return result;
-}
-
 static void
-icon_loaded_cb (WebKitFaviconDatabase *database, GAsyncResult *result, GtkTreeRowReference *reference)
+icon_loaded_cb (GObject *source, GAsyncResult *result, gpointer user_data)
 {
-    GdkPixbuf *favicon = webkit_favicon_database_get_favicon_pixbuf_finish (database, result, NULL);
+	GtkTreeRowReference *reference = user_data;
+	GdkPixbuf *favicon;
 
-    if (favicon && gtk_tree_row_reference_valid (reference)) {
-	    GtkTreeModel *model = gtk_tree_row_reference_get_model (reference);
-	    GtkTreePath *path = gtk_tree_row_reference_get_path (reference);
-	    GtkTreeIter iter;
+	favicon = ephy_favicon_cache_get_favicon_finish (EPHY_FAVICON_CACHE (source), result, NULL);
 
-	    /* Force repaint. */
-	    if (gtk_tree_model_get_iter (model, &iter, path))
-		    gtk_tree_model_row_changed (model, path, &iter);
+	if (favicon && gtk_tree_row_reference_valid (reference))
+	{
+		GtkTreeModel *model = gtk_tree_row_reference_get_model (reference);
+		GtkTreePath *path = gtk_tree_row_reference_get_path (reference);
+		GtkTreeIter iter;
 
-	    gtk_tree_path_free (path);
-    }
+		/* Force repaint, the favicon is in the cache now. */
+		if (gtk_tree_model_get_iter (model, &iter, path))
+			gtk_tree_model_row_changed (model, path, &iter);
 
-    gtk_tree_row_reference_free (reference);
-    if (favicon)
-	    g_object_unref (favicon);
+		gtk_tree_path_free (path);
+	}
+
+	gtk_tree_row_reference_free (reference);
+	if (favicon)
+		g_object_unref (favicon);
 }
-#endif
 
 static void
 provide_favicon (EphyNode *node, GValue *value, gpointer user_data)
 {
+	EphyFaviconCache *cache;
 	GdkPixbuf *favicon = NULL;
-#ifndef HAVE_WEBKIT2
 	const char *page_location;
 
 	page_location = ephy_node_get_property_string
 		(node, EPHY_NODE_BMK_PROP_LOCATION);
 
 	LOG ("Get favicon for %s", page_location ? page_location : "None");
-#endif
-
-#ifdef HAVE_WEBKIT2
-        /* TODO: Favicons */
-#else
-	if (page_location)
-        {
-		WebKitFaviconDatabase *database = webkit_get_favicon_database ();
-
-		/* Try with the sync version first as this method will be frequently called. */
-                favicon = webkit_favicon_database_try_get_favicon_pixbuf (database, page_location,
-									  FAVICON_SIZE, FAVICON_SIZE);
-
-		if (!favicon && webkit_favicon_database_has_favicon (database, page_location)) {
-			GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (user_data));
-			GtkTreeIter iter;
-
-			if (ephy_node_view_get_iter_for_node (EPHY_NODE_VIEW (user_data), &iter, node)) {
-				GtkTreeRowReference *reference;
-				GtkTreePath *path;
-
-				path = gtk_tree_model_get_path (model, &iter);
-				reference = gtk_tree_row_reference_new (model, path);
-				gtk_tree_path_free (path);
-
-				webkit_favicon_database_get_favicon_pixbuf (database, page_location,
-									    FAVICON_SIZE, FAVICON_SIZE, NULL,
-									    (GAsyncReadyCallback) icon_loaded_cb,
-									    reference);
-			}
+
+	cache = ephy_favicon_cache_get_default ();
+
+	/* This is called for every row on every redraw, so only go to
+	 * the favicon database on a cache miss. */
+	if (page_location &&
+	    !ephy_favicon_cache_lookup (cache, page_location, FAVICON_SIZE, &favicon))
+	{
+		GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (user_data));
+		GtkTreeIter iter;
+
+		if (ephy_node_view_get_iter_for_node (EPHY_NODE_VIEW (user_data), &iter, node))
+		{
+			GtkTreeRowReference *reference;
+			GtkTreePath *path;
+
+			path = gtk_tree_model_get_path (model, &iter);
+			reference = gtk_tree_row_reference_new (model, path);
+			gtk_tree_path_free (path);
+
+			ephy_favicon_cache_get_favicon_async (cache, page_location,
+							      FAVICON_SIZE, NULL,
+							      icon_loaded_cb, reference);
 		}
-        }
-#endif
+	}
+
 	g_value_init (value, GDK_TYPE_PIXBUF);
 	g_value_take_object (value, favicon);
 }
@@ -128,7 +128,7 @@ write_rdf (EphyBookmarks *bookmarks,
 	EphyNode *local;
 #endif
 
-	START_PROFILER ("Writing RDF")
+	ephy_trace_begin ("Writing RDF");
 
 	ret = xmlTextWriterStartDocument (writer, "1.0", NULL, NULL);
 	if (ret < 0) goto out;
@@ -380,7 +380,7 @@ write_rdf (EphyBookmarks *bookmarks,
 	ret = xmlTextWriterEndDocument (writer);
 
 out:
-	STOP_PROFILER ("Writing RDF")
+	ephy_trace_end ("Writing RDF");
 
 	return ret;
 }
@@ -396,8 +396,6 @@ ephy_bookmarks_export_rdf (EphyBookmarks *bookmarks,
 
 	LOG ("Exporting as RDF to %s", file_path);
 
-	START_PROFILER ("Exporting as RDF")
-
 	buf = xmlBufferCreate ();
 	if (buf == NULL)
 	{
@@ -411,6 +409,8 @@ ephy_bookmarks_export_rdf (EphyBookmarks *bookmarks,
 		return;
 	}
 
+	ephy_trace_begin ("Exporting as RDF");
+
 	ret = xmlTextWriterSetIndent (writer, 1);
 	if (ret < 0) goto out;
 
@@ -437,7 +437,7 @@ out:
 
 	xmlBufferFree (buf);
 
-	STOP_PROFILER ("Exporting as RDF")
+	ephy_trace_end ("Exporting as RDF");
 
 	LOG ("Exporting as RDF %s.", ret >= 0 ? "succeeded" : "FAILED");
 }
@@ -468,7 +468,7 @@ ephy_bookmarks_export_mozilla (EphyBookmarks *bookmarks,
 		return;
 	}
 
-	START_PROFILER ("Exporting as Mozilla");
+	ephy_trace_begin ("Exporting as Mozilla");
 	
 	tmp_file = g_file_new_for_path (tmp_file_path);
 	ret = write_rdf (bookmarks, tmp_file, writer);
@@ -503,7 +503,7 @@ out:
 	xmlFreeDoc (doc);
 	g_free (tmp_file_path);
 
-	STOP_PROFILER ("Exporting as Mozilla")
+	ephy_trace_end ("Exporting as Mozilla");
 	
 	LOG ("Exporting as Mozilla %s.", ret >= 0 ? "succeeded" : "FAILED");
 }
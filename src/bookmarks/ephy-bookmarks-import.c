@@ -46,55 +46,397 @@ typedef enum
 	NS_UNKNOWN
 } NSItemType;
 
+#define IMPORT_COMMIT_CHUNK_SIZE	250
+#define IMPORT_PROGRESS_INTERVAL	100 /* ms */
+#define IMPORT_READ_BUFFER_SIZE		(64 * 1024)
+
+/*
+ * Importing happens in two stages. The parsers run without touching the
+ * bookmarks database (in a worker thread for the async API) and collect a
+ * flat ImportBatch; the batch is then committed to the database on the
+ * main thread, deduplicated against the existing addresses, with saving
+ * and tree-changed notifications frozen until the whole batch is in.
+ */
+
+typedef struct
+{
+	char *title;
+	char *address;
+	char **topics;
+} ImportItem;
+
+typedef struct
+{
+	GPtrArray *items;
+	GCancellable *cancellable;
+	volatile gint n_parsed;
+} ImportBatch;
+
+typedef gboolean (* ImportParseFunc) (const char *filename,
+				      ImportBatch *batch,
+				      GError **error);
+
+static void
+import_item_free (ImportItem *item)
+{
+	g_free (item->title);
+	g_free (item->address);
+	g_strfreev (item->topics);
+	g_slice_free (ImportItem, item);
+}
+
+static ImportBatch *
+import_batch_new (GCancellable *cancellable)
+{
+	ImportBatch *batch;
+
+	batch = g_slice_new0 (ImportBatch);
+	batch->items = g_ptr_array_new_with_free_func ((GDestroyNotify) import_item_free);
+	batch->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+
+	return batch;
+}
+
+static void
+import_batch_free (ImportBatch *batch)
+{
+	g_ptr_array_free (batch->items, TRUE);
+	if (batch->cancellable)
+		g_object_unref (batch->cancellable);
+	g_slice_free (ImportBatch, batch);
+}
+
+static gboolean
+import_batch_is_cancelled (ImportBatch *batch)
+{
+	return g_cancellable_is_cancelled (batch->cancellable);
+}
+
+static void
+import_batch_add (ImportBatch *batch,
+		  const char *title,
+		  const char *address,
+		  GList *topics)
+{
+	ImportItem *item;
+	GList *l;
+
+	if (address == NULL) return;
+
+	item = g_slice_new (ImportItem);
+	item->title = g_strdup (title);
+	item->address = g_strdup (address);
+	item->topics = NULL;
+
+	if (topics != NULL)
+	{
+		GPtrArray *names;
+
+		names = g_ptr_array_new ();
+		for (l = topics; l != NULL; l = l->next)
+		{
+			const char *name = l->data;
+
+			if (name != NULL && name[0] != '\0')
+			{
+				g_ptr_array_add (names, g_strdup (name));
+			}
+		}
+		g_ptr_array_add (names, NULL);
+
+		item->topics = (char **) g_ptr_array_free (names, FALSE);
+	}
+
+	g_ptr_array_add (batch->items, item);
+
+	g_atomic_int_inc (&batch->n_parsed);
+}
+
+/* Committing a batch */
+
+typedef struct
+{
+	EphyBookmarks *bookmarks;
+	ImportBatch *batch;
+	GHashTable *addresses;
+	GHashTable *topics;
+	GHashTable *created;
+	GPtrArray *added;
+	GPtrArray *linked;
+	guint n_committed;
+} ImportCommit;
+
+static ImportCommit *
+import_commit_new (EphyBookmarks *bookmarks,
+		   ImportBatch *batch)
+{
+	ImportCommit *commit;
+	GPtrArray *children;
+	guint i;
+
+	commit = g_slice_new0 (ImportCommit);
+	commit->bookmarks = bookmarks;
+	commit->batch = batch;
+	commit->addresses = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   g_free, NULL);
+	commit->topics = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, NULL);
+	commit->created = g_hash_table_new (g_direct_hash, g_direct_equal);
+	commit->added = g_ptr_array_new ();
+	commit->linked = g_ptr_array_new ();
+
+	/* One pass over the existing bookmarks instead of a linear
+	 * ephy_bookmarks_find_bookmark() per imported item */
+	children = ephy_node_get_children (ephy_bookmarks_get_bookmarks (bookmarks));
+	for (i = 0; i < children->len; i++)
+	{
+		EphyNode *kid;
+		const char *location;
+
+		kid = g_ptr_array_index (children, i);
+		location = ephy_node_get_property_string
+			(kid, EPHY_NODE_BMK_PROP_LOCATION);
+
+		if (location != NULL)
+		{
+			g_hash_table_insert (commit->addresses,
+					     g_strdup (location), kid);
+		}
+	}
+
+	ephy_bookmarks_freeze (bookmarks);
+
+	return commit;
+}
+
 static EphyNode *
-bookmark_add (EphyBookmarks *bookmarks,
-	      const char *title,
-	      const char *address)
+import_commit_get_topic (ImportCommit *commit,
+			 const char *name)
 {
-	if (!ephy_bookmarks_find_bookmark (bookmarks, address))
+	EphyNode *topic;
+
+	topic = g_hash_table_lookup (commit->topics, name);
+	if (topic != NULL) return topic;
+
+	topic = ephy_bookmarks_find_keyword (commit->bookmarks, name, FALSE);
+	if (topic == NULL)
 	{
-		return ephy_bookmarks_add (bookmarks, title, address);
+		topic = ephy_bookmarks_add_keyword (commit->bookmarks, name);
+		if (topic == NULL) return NULL;
+
+		g_ptr_array_add (commit->added, topic);
+		g_hash_table_add (commit->created, topic);
 	}
-	else
+
+	g_hash_table_insert (commit->topics, g_strdup (name), topic);
+
+	return topic;
+}
+
+static gboolean
+import_topics_contain (GPtrArray *topics,
+		       EphyNode *topic)
+{
+	guint i;
+
+	for (i = 0; i < topics->len; i++)
 	{
-		return NULL;
+		if (g_ptr_array_index (topics, i) == topic) return TRUE;
 	}
+
+	return FALSE;
 }
 
-gboolean
-ephy_bookmarks_import (EphyBookmarks *bookmarks,
-		       const char *filename)
+/* Returns TRUE if there are items left to commit */
+static gboolean
+import_commit_step (ImportCommit *commit,
+		    guint max_items)
 {
-	const char *type;
+	GPtrArray *items = commit->batch->items;
+	GPtrArray *topics;
+	guint end;
+
+	end = MIN (items->len, commit->n_committed + max_items);
+	topics = g_ptr_array_new ();
+
+	for (; commit->n_committed < end; commit->n_committed++)
+	{
+		ImportItem *item;
+		EphyNode *node;
+		int i;
+
+		item = g_ptr_array_index (items, commit->n_committed);
+
+		node = g_hash_table_lookup (commit->addresses, item->address);
+		if (node == NULL)
+		{
+			/* A new bookmark is added with its topics at once,
+			 * instead of being filed under each one in turn */
+			g_ptr_array_set_size (topics, 0);
+			for (i = 0; item->topics != NULL && item->topics[i] != NULL; i++)
+			{
+				EphyNode *topic;
+
+				topic = import_commit_get_topic (commit, item->topics[i]);
+				if (topic != NULL &&
+				    !import_topics_contain (topics, topic))
+				{
+					g_ptr_array_add (topics, topic);
+				}
+			}
+
+			node = ephy_bookmarks_add_with_keywords (commit->bookmarks,
+								 item->title,
+								 item->address,
+								 topics);
+			if (node == NULL) continue;
+
+			g_hash_table_insert (commit->addresses,
+					     g_strdup (item->address), node);
+			g_ptr_array_add (commit->added, node);
+			g_hash_table_add (commit->created, node);
+
+			continue;
+		}
+
+		for (i = 0; item->topics != NULL && item->topics[i] != NULL; i++)
+		{
+			EphyNode *topic;
+
+			topic = import_commit_get_topic (commit, item->topics[i]);
+			if (topic == NULL ||
+			    ephy_node_has_child (topic, node)) continue;
+
+			/* Remember the topics given to bookmarks that were
+			 * already there, a rollback has to take them back */
+			if (!g_hash_table_contains (commit->created, node))
+			{
+				g_ptr_array_add (commit->linked, topic);
+				g_ptr_array_add (commit->linked, node);
+			}
+
+			ephy_bookmarks_set_keyword (commit->bookmarks,
+						    topic, node);
+		}
+	}
+
+	g_ptr_array_free (topics, TRUE);
+
+	return commit->n_committed < items->len;
+}
+
+static void
+import_commit_finish (ImportCommit *commit,
+		      gboolean rollback)
+{
+	if (rollback)
+	{
+		guint i;
+
+		/* Topics given to existing bookmarks, as (topic, bookmark)
+		 * pairs; unset before the topics are destroyed so that the
+		 * bookmarks are categorized as they were */
+		for (i = commit->linked->len; i > 0; i -= 2)
+		{
+			ephy_bookmarks_unset_keyword (commit->bookmarks,
+						      g_ptr_array_index (commit->linked, i - 2),
+						      g_ptr_array_index (commit->linked, i - 1));
+		}
+
+		/* Bookmarks and topics created by this import, newest first */
+		for (i = commit->added->len; i > 0; i--)
+		{
+			ephy_node_unref (g_ptr_array_index (commit->added, i - 1));
+		}
+	}
+
+	ephy_bookmarks_thaw (commit->bookmarks);
+
+	g_hash_table_destroy (commit->addresses);
+	g_hash_table_destroy (commit->topics);
+	g_hash_table_destroy (commit->created);
+	g_ptr_array_free (commit->added, TRUE);
+	g_ptr_array_free (commit->linked, TRUE);
+	g_slice_free (ImportCommit, commit);
+}
+
+static gboolean
+import_lockdown (void)
+{
+	return g_settings_get_boolean (EPHY_SETTINGS_LOCKDOWN,
+				       EPHY_PREFS_LOCKDOWN_BOOKMARK_EDITING);
+}
+
+/* Parses @filename with @parse_func and commits the result in one go */
+static gboolean
+import_sync (EphyBookmarks *bookmarks,
+	     const char *filename,
+	     ImportParseFunc parse_func)
+{
+	ImportBatch *batch;
+	GError *error = NULL;
+	gboolean ret;
+
+	if (import_lockdown ())
+		return FALSE;
+
+	batch = import_batch_new (NULL);
+
+	ret = parse_func (filename, batch, &error);
+	if (ret)
+	{
+		ImportCommit *commit;
+
+		commit = import_commit_new (bookmarks, batch);
+		import_commit_step (commit, G_MAXUINT);
+		import_commit_finish (commit, FALSE);
+	}
+	else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+	{
+		g_warning ("Failed to import bookmarks from %s: %s",
+			   filename, error ? error->message : "unknown error");
+	}
+
+	g_clear_error (&error);
+
+	import_batch_free (batch);
+
+	return ret;
+}
+
+static gboolean import_mozilla_parse (const char *filename, ImportBatch *batch, GError **error);
+static gboolean import_xbel_parse    (const char *filename, ImportBatch *batch, GError **error);
+static gboolean import_rdf_parse     (const char *filename, ImportBatch *batch, GError **error);
+
+/* May block on I/O */
+static ImportParseFunc
+import_get_parse_func (const char *filename)
+{
+	const char *type = NULL;
 	char *basename;
-	gboolean success = FALSE;
+	ImportParseFunc parse_func = NULL;
 	GFile *file;
 	GFileInfo *file_info;
 
-	if (g_settings_get_boolean (EPHY_SETTINGS_LOCKDOWN,
-				    EPHY_PREFS_LOCKDOWN_BOOKMARK_EDITING))
-		return FALSE;
-
-	g_return_val_if_fail (filename != NULL, FALSE);
-	
 	file = g_file_new_for_path (filename);
 	file_info = g_file_query_info (file,
 				       G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
 				       0, NULL, NULL);
-	type = g_file_info_get_content_type (file_info);
+	if (file_info != NULL)
+		type = g_file_info_get_content_type (file_info);
 
 	g_debug ("Importing bookmarks of type %s", type ? type : "(null)");
 
 	if (type != NULL && (strcmp (type, "application/rdf+xml") == 0 ||
 			     strcmp (type, "text/rdf") == 0))
 	{
-		success = ephy_bookmarks_import_rdf (bookmarks, filename);
+		parse_func = import_rdf_parse;
 	}
 	else if ((type != NULL && strcmp (type, "application/x-xbel") == 0) ||
 		 strstr (filename, GALEON_BOOKMARKS_DIR) != NULL ||
 		 strstr (filename, KDE_BOOKMARKS_DIR) != NULL)
 	{
-		success = ephy_bookmarks_import_xbel (bookmarks, filename);
+		parse_func = import_xbel_parse;
 	}
 	else if ((type != NULL && strcmp (type, "application/x-mozilla-bookmarks") == 0) ||
 		 (type != NULL && strcmp (type, "text/html") == 0) ||
@@ -103,7 +445,7 @@ ephy_bookmarks_import (EphyBookmarks *bookmarks,
                  strstr (filename, FIREFOX_BOOKMARKS_DIR_1) != NULL ||
 		 strstr (filename, FIREFOX_BOOKMARKS_DIR_2) != NULL)
 	{
-		success = ephy_bookmarks_import_mozilla (bookmarks, filename);
+		parse_func = import_mozilla_parse;
 	}
 	else if (type == NULL)
 	{
@@ -111,15 +453,15 @@ ephy_bookmarks_import (EphyBookmarks *bookmarks,
 
 		if (g_str_has_suffix (basename, ".rdf"))
 		{
-			success = ephy_bookmarks_import_rdf (bookmarks, filename);
+			parse_func = import_rdf_parse;
 		}
 		else if (g_str_has_suffix (basename, ".xbel"))
 		{
-			success = ephy_bookmarks_import_xbel (bookmarks, filename);
+			parse_func = import_xbel_parse;
 		}
 		else if (g_str_has_suffix (basename, ".html"))
 		{
-			success = ephy_bookmarks_import_mozilla (bookmarks, filename);
+			parse_func = import_mozilla_parse;
 		}
 		else
 		{
@@ -130,10 +472,232 @@ ephy_bookmarks_import (EphyBookmarks *bookmarks,
 		g_free (basename);
 	}
 
-	g_object_unref (file_info);
+	if (file_info != NULL)
+		g_object_unref (file_info);
 	g_object_unref (file);
 
-	return success;
+	return parse_func;
+}
+
+gboolean
+ephy_bookmarks_import (EphyBookmarks *bookmarks,
+		       const char *filename)
+{
+	ImportParseFunc parse_func;
+
+	if (import_lockdown ())
+		return FALSE;
+
+	g_return_val_if_fail (filename != NULL, FALSE);
+
+	parse_func = import_get_parse_func (filename);
+	if (parse_func == NULL)
+		return FALSE;
+
+	return import_sync (bookmarks, filename, parse_func);
+}
+
+/* Async import */
+
+typedef struct
+{
+	char *filename;
+	ImportBatch *batch;
+	ImportCommit *commit;
+	EphyBookmarksImportProgressFunc progress_callback;
+	gpointer progress_data;
+	guint source_id;
+} ImportAsyncData;
+
+static void
+import_async_data_free (ImportAsyncData *data)
+{
+	if (data->source_id != 0)
+		g_source_remove (data->source_id);
+	if (data->commit != NULL)
+		import_commit_finish (data->commit, TRUE);
+
+	import_batch_free (data->batch);
+	g_free (data->filename);
+	g_slice_free (ImportAsyncData, data);
+}
+
+static void
+import_parse_thread (GTask *task,
+		     gpointer source_object,
+		     gpointer task_data,
+		     GCancellable *cancellable)
+{
+	ImportAsyncData *data = task_data;
+	ImportParseFunc parse_func;
+	GError *error = NULL;
+
+	parse_func = import_get_parse_func (data->filename);
+	if (parse_func == NULL)
+	{
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+					 "Unrecognised bookmarks file format");
+		return;
+	}
+
+	if (!parse_func (data->filename, data->batch, &error) ||
+	    g_cancellable_set_error_if_cancelled (cancellable, &error))
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+import_parse_progress_cb (GTask *task)
+{
+	ImportAsyncData *data = g_task_get_task_data (task);
+
+	data->progress_callback (g_atomic_int_get (&data->batch->n_parsed), 0,
+				 data->progress_data);
+
+	return TRUE;
+}
+
+static gboolean
+import_commit_idle_cb (GTask *task)
+{
+	ImportAsyncData *data = g_task_get_task_data (task);
+	gboolean more;
+
+	if (g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+	{
+		import_commit_finish (data->commit, TRUE);
+		data->commit = NULL;
+		data->source_id = 0;
+
+		g_task_return_error_if_cancelled (task);
+		g_object_unref (task);
+		return FALSE;
+	}
+
+	more = import_commit_step (data->commit, IMPORT_COMMIT_CHUNK_SIZE);
+
+	if (data->progress_callback)
+	{
+		data->progress_callback (data->commit->n_committed,
+					 data->batch->items->len,
+					 data->progress_data);
+	}
+
+	if (more) return TRUE;
+
+	import_commit_finish (data->commit, FALSE);
+	data->commit = NULL;
+	data->source_id = 0;
+
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+
+	return FALSE;
+}
+
+static void
+import_parse_ready_cb (GObject *source_object,
+		       GAsyncResult *result,
+		       gpointer user_data)
+{
+	GTask *task = G_TASK (user_data);
+	ImportAsyncData *data = g_task_get_task_data (task);
+	GError *error = NULL;
+
+	if (data->source_id != 0)
+	{
+		g_source_remove (data->source_id);
+		data->source_id = 0;
+	}
+
+	if (!g_task_propagate_boolean (G_TASK (result), &error))
+	{
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	data->commit = import_commit_new (EPHY_BOOKMARKS (source_object),
+					  data->batch);
+	data->source_id = g_idle_add ((GSourceFunc) import_commit_idle_cb, task);
+}
+
+/**
+ * ephy_bookmarks_import_async:
+ * @bookmarks: an #EphyBookmarks
+ * @filename: the file to import
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @progress_callback: (allow-none): called periodically on the main thread
+ * @progress_data: data for @progress_callback
+ * @callback: called when the import is finished
+ * @user_data: data for @callback
+ *
+ * Imports the bookmarks in @filename without blocking the main loop. The
+ * file is parsed in a worker thread and the resulting bookmarks are added
+ * in chunks from idle callbacks; bookmarks already present are skipped.
+ * While parsing, @progress_callback gets the number of bookmarks found so
+ * far and a total of 0; while adding, the number of bookmarks processed
+ * and the total.
+ *
+ * Cancelling the import removes any bookmarks and topics it has added.
+ **/
+void
+ephy_bookmarks_import_async (EphyBookmarks *bookmarks,
+			     const char *filename,
+			     GCancellable *cancellable,
+			     EphyBookmarksImportProgressFunc progress_callback,
+			     gpointer progress_data,
+			     GAsyncReadyCallback callback,
+			     gpointer user_data)
+{
+	GTask *task, *parse_task;
+	ImportAsyncData *data;
+
+	g_return_if_fail (EPHY_IS_BOOKMARKS (bookmarks));
+	g_return_if_fail (filename != NULL);
+
+	task = g_task_new (bookmarks, cancellable, callback, user_data);
+
+	if (import_lockdown ())
+	{
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+					 "Bookmark editing is locked down");
+		g_object_unref (task);
+		return;
+	}
+
+	data = g_slice_new0 (ImportAsyncData);
+	data->filename = g_strdup (filename);
+	data->batch = import_batch_new (cancellable);
+	data->progress_callback = progress_callback;
+	data->progress_data = progress_data;
+	g_task_set_task_data (task, data, (GDestroyNotify) import_async_data_free);
+
+	if (progress_callback)
+	{
+		data->source_id = g_timeout_add (IMPORT_PROGRESS_INTERVAL,
+						 (GSourceFunc) import_parse_progress_cb,
+						 task);
+	}
+
+	parse_task = g_task_new (bookmarks, cancellable, import_parse_ready_cb, task);
+	g_task_set_task_data (parse_task, data, NULL);
+	g_task_run_in_thread (parse_task, import_parse_thread);
+	g_object_unref (parse_task);
+}
+
+gboolean
+ephy_bookmarks_import_finish (EphyBookmarks *bookmarks,
+			      GAsyncResult *result,
+			      GError **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, bookmarks), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
 /* XBEL import */
@@ -153,10 +717,9 @@ typedef enum
 } EphyXBELImporterState;
 
 static int
-xbel_parse_bookmark (EphyBookmarks *eb, xmlTextReaderPtr reader, EphyNode **ret_node)
+xbel_parse_bookmark (ImportBatch *batch, xmlTextReaderPtr reader, GList *folders)
 {
 	EphyXBELImporterState state = STATE_BOOKMARK;
-	EphyNode *node;
 	xmlChar *title = NULL;
 	xmlChar *address = NULL;
 	int ret = 1;
@@ -262,6 +825,7 @@ xbel_parse_bookmark (EphyBookmarks *eb, xmlTextReaderPtr reader, EphyNode **ret_
 
 	if (address == NULL)
 	{
+		xmlFree (title);
 		return ret;
 	}
 
@@ -270,23 +834,17 @@ xbel_parse_bookmark (EphyBookmarks *eb, xmlTextReaderPtr reader, EphyNode **ret_
 		title = xmlStrdup ((xmlChar *) _("Untitled"));
 	}
 
-	node = bookmark_add (eb, (const char *) title, (const char *) address);
-	if (node == NULL)
-	{
-		/* probably a duplicate */
-		node = ephy_bookmarks_find_bookmark (eb, (const char *) address);
-	}
+	import_batch_add (batch, (const char *) title, (const char *) address,
+			  folders);
 
 	xmlFree (title);
 	xmlFree (address);
 
-	*ret_node = node;
-
 	return ret;
 }
 
 static int
-xbel_parse_folder (EphyBookmarks *eb, xmlTextReaderPtr reader, GList *folders)
+xbel_parse_folder (ImportBatch *batch, xmlTextReaderPtr reader, GList *folders)
 {
 	EphyXBELImporterState state = STATE_FOLDER;
 	char *folder = NULL;
@@ -294,7 +852,7 @@ xbel_parse_folder (EphyBookmarks *eb, xmlTextReaderPtr reader, GList *folders)
 
 	ret = xmlTextReaderRead (reader);
 
-	while (ret == 1)
+	while (ret == 1 && !import_batch_is_cancelled (batch))
 	{
 		const xmlChar *tag;
 		xmlReaderTypes type;
@@ -321,29 +879,7 @@ xbel_parse_folder (EphyBookmarks *eb, xmlTextReaderPtr reader, GList *folders)
 		}
 		else if (xmlStrEqual (tag, (xmlChar *) "bookmark") && type == 1 && state == STATE_FOLDER)
 		{
-			EphyNode *node = NULL, *keyword;
-			GList *l;
-
-			ret = xbel_parse_bookmark (eb, reader, &node);
-
-			for (l = folders; l != NULL; l=l->next)
-			{
-				char *title;
-				
-				title = l->data ? (char *) l->data : "";
-				
-				keyword = ephy_bookmarks_find_keyword (eb, title, FALSE);
-			
-				if (keyword == NULL && title[0] != '\0')
-				{
-					keyword = ephy_bookmarks_add_keyword (eb, title);
-				}
-
-				if (node != NULL && keyword != NULL)
-				{
-					ephy_bookmarks_set_keyword (eb, keyword, node);
-				}
-			}
+			ret = xbel_parse_bookmark (batch, reader, folders);
 
 			if (ret != 1) break;
 		}
@@ -352,7 +888,7 @@ xbel_parse_folder (EphyBookmarks *eb, xmlTextReaderPtr reader, GList *folders)
 		{
 			if (type == XML_READER_TYPE_ELEMENT)
 			{
-				ret = xbel_parse_folder (eb, reader, folders);
+				ret = xbel_parse_folder (batch, reader, folders);
 				
 				if (ret != 1) break;
 			}
@@ -415,14 +951,15 @@ xbel_parse_folder (EphyBookmarks *eb, xmlTextReaderPtr reader, GList *folders)
 }
 
 static int
-xbel_parse_xbel (EphyBookmarks *eb, xmlTextReaderPtr reader)
+xbel_parse_xbel (ImportBatch *batch, xmlTextReaderPtr reader)
 {
 	EphyXBELImporterState state = STATE_XBEL;
 	int ret;
 
 	ret = xmlTextReaderRead (reader);
 
-	while (ret == 1 && state != STATE_STOP)
+	while (ret == 1 && state != STATE_STOP &&
+	       !import_batch_is_cancelled (batch))
 	{
 		const xmlChar *tag;
 		xmlReaderTypes type;
@@ -437,10 +974,8 @@ xbel_parse_xbel (EphyBookmarks *eb, xmlTextReaderPtr reader)
 		else if (xmlStrEqual (tag, (xmlChar *) "bookmark") && type == XML_READER_TYPE_ELEMENT
 			 && state == STATE_XBEL)
 		{
-			EphyNode *node = NULL;
-
 			/* this will eat the </bookmark> too */
-			ret = xbel_parse_bookmark (eb, reader, &node);
+			ret = xbel_parse_bookmark (batch, reader, NULL);
 
 			if (ret != 1) break;
 		}
@@ -448,7 +983,7 @@ xbel_parse_xbel (EphyBookmarks *eb, xmlTextReaderPtr reader)
 			 && state == STATE_XBEL)
 		{
 			/* this will eat the </folder> too */
-			ret = xbel_parse_folder (eb, reader, NULL);
+			ret = xbel_parse_folder (batch, reader, NULL);
 
 			if (ret != 1) break;
 		}
@@ -505,40 +1040,47 @@ xbel_parse_xbel (EphyBookmarks *eb, xmlTextReaderPtr reader)
 
 /* Mozilla/Netscape import */
 
-static gchar *
-gul_general_read_line_from_file (FILE *f)
+typedef struct
 {
-	gchar *line = g_strdup ("");
-	gchar *t;
-	gchar *buf = g_new0 (gchar, 256);
-	while ( ! ( strchr (buf, '\n') || feof (f) ) ) {
-		if (fgets(buf, 256, f))
-		{
-			t = line;
-			line = g_strconcat (line, buf, NULL);
-			g_free (t);
-		}
-	}
-	g_free (buf);
-	return line;
+	GRegex *site;
+	GRegex *folder;
+	GRegex *folder_end;
+} NSParser;
+
+static void
+ns_parser_init (NSParser *parser)
+{
+	parser->site = g_regex_new
+		("<a href=\"(?P<url>[^\"]*).*?>\\s*(?P<name>.*?)\\s*</a>",
+		 G_REGEX_CASELESS | G_REGEX_OPTIMIZE, G_REGEX_MATCH_NOTEMPTY, NULL);
+	parser->folder = g_regex_new
+		("<h3.*>(?P<name>\\w.*)</h3>",
+		 G_REGEX_CASELESS | G_REGEX_OPTIMIZE, G_REGEX_MATCH_NOTEMPTY, NULL);
+	parser->folder_end = g_regex_new
+		("</dl>",
+		 G_REGEX_CASELESS | G_REGEX_OPTIMIZE, G_REGEX_MATCH_NOTEMPTY, NULL);
+}
+
+static void
+ns_parser_clear (NSParser *parser)
+{
+	g_regex_unref (parser->site);
+	g_regex_unref (parser->folder);
+	g_regex_unref (parser->folder_end);
 }
 
 /**
- * Parses a line of a mozilla/netscape bookmark file. File must be open.
+ * Parses a line of a mozilla/netscape bookmark file.
  */
 /* this has been tested fairly well */
 static NSItemType
-ns_get_bookmark_item (FILE *f, GString *name, GString *url)
+ns_get_bookmark_item (NSParser *parser, const char *line, GString *name, GString *url)
 {
-	char *line = NULL;
-	GRegex *regex;
 	GMatchInfo *match_info;
 	int ret = NS_UNKNOWN;
 	char *match_url = NULL;
 	char *match_name = NULL;
 
-	line = gul_general_read_line_from_file (f);
-	
 	/*
 	 * Regex parsing of the html file:
 	 * 1. check if it's a bookmark, or a folder, or the end of a folder,
@@ -547,71 +1089,48 @@ ns_get_bookmark_item (FILE *f, GString *name, GString *url)
 	 * 3. return the ret val to tell our caller what we found, by default 
 	 * we don't know (NS_UNKWOWN).
 	 */
-	
+
 	/* check if it's a bookmark */
-	regex = g_regex_new
-		 ("<a href=\"(?P<url>[^\"]*).*?>\\s*(?P<name>.*?)\\s*</a>",
-		 G_REGEX_CASELESS, G_REGEX_MATCH_NOTEMPTY, NULL);
-	g_regex_match (regex, line, 0, &match_info);
-	
-	if (g_match_info_matches (match_info))
+	if (g_regex_match (parser->site, line, 0, &match_info))
 	{
 		match_url = g_match_info_fetch_named (match_info, "url");
 		match_name = g_match_info_fetch_named (match_info, "name");
 		ret = NS_SITE;
-		goto end;
 	}
 	g_match_info_free (match_info);
-	g_regex_unref (regex);
-	
-	/* check if it's a folder start */
-	regex = g_regex_new ("<h3.*>(?P<name>\\w.*)</h3>", 
-				G_REGEX_CASELESS, G_REGEX_MATCH_NOTEMPTY, NULL);
 
-	g_regex_match (regex, line, 0, &match_info);
-	if (g_match_info_matches (match_info))
+	/* check if it's a folder start */
+	if (ret == NS_UNKNOWN)
 	{
-		match_name = g_match_info_fetch_named (match_info, "name");
-		ret = NS_FOLDER;
-		goto end;
+		if (g_regex_match (parser->folder, line, 0, &match_info))
+		{
+			match_name = g_match_info_fetch_named (match_info, "name");
+			ret = NS_FOLDER;
+		}
+		g_match_info_free (match_info);
 	}
-	g_match_info_free (match_info);
-	g_regex_unref (regex);
-	
-	/* check if it's a folder end */
-	regex = g_regex_new ("</dl>", 
-				G_REGEX_CASELESS, G_REGEX_MATCH_NOTEMPTY, NULL);
 
-	g_regex_match (regex, line, 0, &match_info);
-	if (g_match_info_matches (match_info))
+	/* check if it's a folder end */
+	if (ret == NS_UNKNOWN &&
+	    g_regex_match (parser->folder_end, line, 0, NULL))
 	{
 		ret = NS_FOLDER_END;
-		goto end;
 	}
-	
-	/* now let's use the collected stuff */
-	end:
-		/* Due to the goto we'll always have an unfreed @match_info and 
-		 * @regex. Note that this two free/unrefs correspond to the last 
-		 * if() block too.
-		 */
-		g_match_info_free (match_info);
-		g_regex_unref (regex);
 
-		if (match_name)
-		{
-			g_string_assign (name, match_name);
-			g_free (match_name);
-		}
+	/* now let's use the collected stuff */
+	if (match_name)
+	{
+		g_string_assign (name, match_name);
+		g_free (match_name);
+	}
 
-		if (match_url)
-		{
-			g_string_assign (url, match_url);
-			g_free (match_url);
-		}
+	if (match_url)
+	{
+		g_string_assign (url, match_url);
+		g_free (match_url);
+	}
 
-		g_free (line);
-		return ret;
+	return ret;
 }
 
 /*
@@ -703,121 +1222,132 @@ ns_parse_bookmark_item (GString *string)
 	return temp;
 }
 
-gboolean
-ephy_bookmarks_import_mozilla (EphyBookmarks *bookmarks,
-			       const char *filename)
+static gboolean
+import_mozilla_parse (const char *filename,
+		      ImportBatch *batch,
+		      GError **error)
 {
-	FILE *bf;  /* bookmark file */
+	GFile *file;
+	GFileInputStream *file_stream;
+	GDataInputStream *stream;
+	NSParser parser;
 	GString *name, *url;
-	char *parsedname;
 	GList *folders = NULL;
-	gboolean retval = TRUE;
+	char *line;
+	GError *local_error = NULL;
 
-	if (g_settings_get_boolean (EPHY_SETTINGS_LOCKDOWN,
-				    EPHY_PREFS_LOCKDOWN_BOOKMARK_EDITING))
-		return FALSE;
+	file = g_file_new_for_path (filename);
+	file_stream = g_file_read (file, batch->cancellable, error);
+	g_object_unref (file);
 
-	if (!(bf = fopen (filename, "r"))) {
-		g_warning ("Failed to open file: %s\n", filename);
+	if (file_stream == NULL)
 		return FALSE;
-	}
 
+	/* Read line by line, but through a large buffer */
+	stream = g_data_input_stream_new (G_INPUT_STREAM (file_stream));
+	g_buffered_input_stream_set_buffer_size (G_BUFFERED_INPUT_STREAM (stream),
+						 IMPORT_READ_BUFFER_SIZE);
+	g_object_unref (file_stream);
+
+	ns_parser_init (&parser);
 	name = g_string_new (NULL);
 	url = g_string_new (NULL);
 
-	while (!feof (bf)) {
-		EphyNode *node;
-		NSItemType t;
-		t = ns_get_bookmark_item (bf, name, url);
-		switch (t)
+	while ((line = g_data_input_stream_read_line (stream, NULL,
+						      batch->cancellable,
+						      &local_error)) != NULL)
+	{
+		char *parsedname;
+
+		switch (ns_get_bookmark_item (&parser, line, name, url))
 		{
 		case NS_FOLDER:
-			folders = g_list_append (folders, ns_parse_bookmark_item (name));
+			folders = g_list_prepend (folders, ns_parse_bookmark_item (name));
 			break;
 		case NS_FOLDER_END:
 			if (folders)
 			{
-				GList *last = g_list_last (folders);
-
 				/* remove last entry */
-				g_free (last->data);
-				folders = g_list_delete_link (folders, last); 
+				g_free (folders->data);
+				folders = g_list_delete_link (folders, folders);
 			}
 			break;
 		case NS_SITE:
 			parsedname = ns_parse_bookmark_item (name);
-
-			node = bookmark_add (bookmarks, parsedname, url->str);
-
-			if (node == NULL)
-			{
-				node = ephy_bookmarks_find_bookmark (bookmarks, url->str);
-				if (node == NULL) {
-					g_warning ("%s: `node' is NULL", G_STRFUNC);
-					retval = FALSE;
-					goto out;
-				}
-			}
-
-			if (folders != NULL)
-			{
-				EphyNode *keyword;
-				GList *l;
-
-				for (l = folders; l != NULL; l = l->next)
-				{
-					keyword = ephy_bookmarks_find_keyword (bookmarks, l->data, FALSE);
-					if (keyword == NULL)
-					{
-						keyword = ephy_bookmarks_add_keyword (bookmarks, l->data);
-					}
-
-					ephy_bookmarks_set_keyword (bookmarks, keyword, node);
-				}
-			}
-
+			import_batch_add (batch, parsedname, url->str, folders);
 			g_free (parsedname);
-
 			break;
 		default:
 			break;
 		}
+
+		g_free (line);
 	}
-out:
-	fclose (bf);
+
+	ns_parser_clear (&parser);
 	g_string_free (name, TRUE);
 	g_string_free (url, TRUE);
+	g_list_free_full (folders, g_free);
+	g_object_unref (stream);
+
+	if (local_error != NULL)
+	{
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
 
-	return retval;
+	return TRUE;
 }
 
 gboolean
-ephy_bookmarks_import_xbel (EphyBookmarks *bookmarks,
-			    const char *filename)
+ephy_bookmarks_import_mozilla (EphyBookmarks *bookmarks,
+			       const char *filename)
+{
+	return import_sync (bookmarks, filename, import_mozilla_parse);
+}
+
+static gboolean
+import_xbel_parse (const char *filename,
+		   ImportBatch *batch,
+		   GError **error)
 {
 	xmlTextReaderPtr reader;
 	int ret;
 
-	if (g_settings_get_boolean (EPHY_SETTINGS_LOCKDOWN,
-				    EPHY_PREFS_LOCKDOWN_BOOKMARK_EDITING))
-		return FALSE;
-
 	if (g_file_test (filename, G_FILE_TEST_EXISTS) == FALSE)
 	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+			     "No such file");
 		return FALSE;
 	}
-	
+
 	reader = xmlNewTextReaderFilename (filename);
 	if (reader == NULL)
 	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+			     "Could not open file");
 		return FALSE;
 	}
 
-	ret = xbel_parse_xbel (bookmarks, reader);
+	ret = xbel_parse_xbel (batch, reader);
 
 	xmlFreeTextReader (reader);
 
-	return ret >= 0 ? TRUE : FALSE;
+	if (ret < 0)
+	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "Malformed XBEL file");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean
+ephy_bookmarks_import_xbel (EphyBookmarks *bookmarks,
+			    const char *filename)
+{
+	return import_sync (bookmarks, filename, import_xbel_parse);
 }
 
 static void
@@ -882,7 +1412,7 @@ parse_rdf_lang_tag (xmlNode  *child,
 }
 
 static void
-parse_rdf_item (EphyBookmarks *bookmarks,
+parse_rdf_item (ImportBatch *batch,
 		xmlNodePtr node)
 {
 	xmlChar *title = NULL;
@@ -893,9 +1423,8 @@ parse_rdf_item (EphyBookmarks *bookmarks,
 	 * a localized link */
 	gboolean use_smartlink = FALSE;
 	xmlChar *subject = NULL;
-	GList *subjects = NULL, *l = NULL;
+	GList *subjects = NULL;
 	xmlNode *child;
-	EphyNode *bmk = NULL;
 
 	child = node->children;
 
@@ -937,30 +1466,7 @@ parse_rdf_item (EphyBookmarks *bookmarks,
 	}
 
 	if (link)
-		bmk = bookmark_add (bookmarks, (char *) title, (char *) link);
-
-	if (bmk)
-	{
-		l = subjects;
-	}
-
-	for (; l != NULL; l = l->next)
-	{
-		char *topic_name = l->data;
-		EphyNode *topic;
-
-		topic = ephy_bookmarks_find_keyword (bookmarks, topic_name, FALSE);
-
-		if (topic == NULL)
-		{
-			topic = ephy_bookmarks_add_keyword (bookmarks, topic_name);
-		}
-
-		if (topic != NULL)
-		{
-			ephy_bookmarks_set_keyword (bookmarks, topic, bmk);
-		}
-	}
+		import_batch_add (batch, (char *) title, (char *) link, subjects);
 
 	xmlFree (title);
 	xmlFree (link);
@@ -969,46 +1475,74 @@ parse_rdf_item (EphyBookmarks *bookmarks,
 	g_list_free (subjects);
 }
 
-gboolean
-ephy_bookmarks_import_rdf (EphyBookmarks *bookmarks,
-			   const char *filename)
+static gboolean
+import_rdf_parse (const char *filename,
+		  ImportBatch *batch,
+		  GError **error)
 {
-	xmlDocPtr doc;
-	xmlNodePtr child;
-	xmlNodePtr root;
-
-	if (g_settings_get_boolean (EPHY_SETTINGS_LOCKDOWN,
-				    EPHY_PREFS_LOCKDOWN_BOOKMARK_EDITING))
-		return FALSE;
+	xmlTextReaderPtr reader;
+	int ret;
 
 	if (g_file_test (filename, G_FILE_TEST_EXISTS) == FALSE)
+	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+			     "No such file");
 		return FALSE;
+	}
 
-	doc = xmlParseFile (filename);
-	if (doc == NULL)
+	reader = xmlNewTextReaderFilename (filename);
+	if (reader == NULL)
 	{
-		/* FIXME: maybe put up a warning dialogue here, because this
-		 * is a severe dataloss?
-		 */
-		g_warning ("Failed to re-import the bookmarks. All bookmarks lost!\n");
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+			     "Could not open file");
 		return FALSE;
 	}
 
-	root = xmlDocGetRootElement (doc);
+	/* Expand one <item> at a time instead of building the whole DOM */
+	ret = xmlTextReaderRead (reader);
+	while (ret == 1 && !import_batch_is_cancelled (batch))
+	{
+		if (xmlTextReaderNodeType (reader) == XML_READER_TYPE_ELEMENT &&
+		    xmlTextReaderDepth (reader) == 1 &&
+		    xmlStrEqual (xmlTextReaderConstLocalName (reader), (xmlChar *) "item"))
+		{
+			xmlNodePtr node;
 
-	child = root->children;
+			node = xmlTextReaderExpand (reader);
+			if (node == NULL)
+			{
+				ret = -1;
+				break;
+			}
 
-	while (child != NULL)
-	{
-		if (xmlStrEqual (child->name, (xmlChar *) "item"))
+			parse_rdf_item (batch, node);
+
+			ret = xmlTextReaderNext (reader);
+		}
+		else
 		{
-			parse_rdf_item (bookmarks, child);
+			ret = xmlTextReaderRead (reader);
 		}
-
-		child = child->next;
 	}
 
-	xmlFreeDoc (doc);
+	xmlFreeTextReader (reader);
+
+	if (ret < 0)
+	{
+		/* FIXME: maybe put up a warning dialogue here, because this
+		 * is a severe dataloss?
+		 */
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "Malformed RDF file");
+		return FALSE;
+	}
 
 	return TRUE;
 }
+
+gboolean
+ephy_bookmarks_import_rdf (EphyBookmarks *bookmarks,
+			   const char *filename)
+{
+	return import_sync (bookmarks, filename, import_rdf_parse);
+}
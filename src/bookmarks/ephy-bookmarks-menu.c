@@ -69,9 +69,12 @@ append_bookmarks (GString *string,
 }
 
 /* Build a menu of the given bookmarks categorised by the given topics.
- * Shows categorisation using subdivisions, submenus, or a mix of both. */
+ * Shows categorisation using subdivisions, submenus, or a mix of both.
+ * If top_uncovered is given, the bookmarks left out of any category are
+ * stored in it instead, and an "Uncategorized" placeholder is left for them. */
 static void
-append_menu (GString *string, const GPtrArray *topics, const GPtrArray *bookmarks, guint flags)
+append_menu (GString *string, const GPtrArray *topics, const GPtrArray *bookmarks, guint flags,
+	     GPtrArray *top_uncovered)
 {
 	GPtrArray *uncovered;
 	guint i, j;
@@ -138,7 +141,7 @@ append_menu (GString *string, const GPtrArray *topics, const GPtrArray *bookmark
 				
 			g_string_append_printf (string, "<menu action=\"%s\">",
 						name);
-			append_menu (string, topics, subset, flags);
+			append_menu (string, topics, subset, flags, NULL);
 			g_string_append (string, "</menu>");
 			separate = TRUE;
 		}
@@ -174,7 +177,7 @@ append_menu (GString *string, const GPtrArray *topics, const GPtrArray *bookmark
 		g_ptr_array_free (subset, TRUE);
 		g_ptr_array_free (unused, TRUE);
 		
-		if (separate && uncovered->len) g_string_append (string, "<separator/>");
+		if (separate && (uncovered->len || top_uncovered)) g_string_append (string, "<separator/>");
 	}
 	else
 	{
@@ -186,12 +189,25 @@ append_menu (GString *string, const GPtrArray *topics, const GPtrArray *bookmark
 	
 	/* Create the final subdivision (uncovered bookmarks). */
 	g_ptr_array_sort (uncovered, ephy_bookmarks_compare_bookmark_pointers);
-	append_bookmarks (string, uncovered);
+	if (top_uncovered)
+	{
+		for (i = 0; i < uncovered->len; i++)
+		  g_ptr_array_add (top_uncovered, g_ptr_array_index (uncovered, i));
+		g_string_append (string, "<placeholder name=\"" EPHY_BOOKMARKS_MENU_UNCATEGORIZED "\"/>");
+	}
+	else
+	{
+		append_bookmarks (string, uncovered);
+	}
 	g_ptr_array_free (uncovered, TRUE);        
 }
 
+/* Appends the menu for the bookmarks in parent (all of them if NULL) to
+ * string. If uncovered is given, the bookmarks that do not belong in
+ * any submenu are added to it, sorted, and left to the caller to merge
+ * into the "Uncategorized" placeholder. */
 void
-ephy_bookmarks_menu_build (GString *string, EphyNode *parent)
+ephy_bookmarks_menu_build (GString *string, EphyNode *parent, GPtrArray *uncovered)
 {
 	GPtrArray *children, *topics;
 	EphyBookmarks *eb;
@@ -242,7 +258,7 @@ ephy_bookmarks_menu_build (GString *string, EphyNode *parent)
 			g_ptr_array_add (topics, ephy_bookmarks_get_local (eb));
 		}
 		
-		append_menu (string, topics, children, flags);
+		append_menu (string, topics, children, flags, uncovered);
 		g_ptr_array_free (topics, TRUE);
 	}
 	
@@ -251,7 +267,7 @@ ephy_bookmarks_menu_build (GString *string, EphyNode *parent)
 	{
 		char name[EPHY_OPEN_TABS_ACTION_NAME_BUFFER_SIZE];
 
-		append_menu (string, topics, children, flags);
+		append_menu (string, topics, children, flags, uncovered);
 		g_ptr_array_free (topics, TRUE);
 	
 		if (children->len > 1)
@@ -31,6 +31,8 @@
 
 #include <gtk/gtk.h>
 
-void ephy_bookmarks_menu_build (GString *string, EphyNode *parent);
+#define EPHY_BOOKMARKS_MENU_UNCATEGORIZED "Uncategorized"
+
+void ephy_bookmarks_menu_build (GString *string, EphyNode *parent, GPtrArray *uncovered);
 
 #endif
@@ -51,6 +51,8 @@
 typedef struct
 {
 	guint bookmarks_menu;
+	guint bookmarks_menu_generation;
+	GHashTable *bookmarks_menu_items;
 	guint toolbar_menu;
 } BookmarksWindowData;
 
@@ -60,7 +62,19 @@ enum
 	RESPONSE_NEW_BOOKMARK = 2
 };
 
+#define UNCATEGORIZED_PATH "/PagePopup/BookmarksMenu/" EPHY_BOOKMARKS_MENU_UNCATEGORIZED
+
+/* The bookmarks menu description is built once and shared by all the
+ * windows. The bookmarks without a submenu of their own are not part of
+ * it: each window merges them one by one, so that adding, removing or
+ * renaming one of them updates the merged menus in place. Any other
+ * change only bumps the generation; a window merges the new description
+ * the next time its menu is opened.
+ */
 static GString * bookmarks_menu_string = 0;
+static GPtrArray *bookmarks_menu_uncategorized = 0;
+static guint bookmarks_menu_generation = 0;
+static GList *bookmarks_menu_windows = 0;
 static GHashTable *properties_dialogs = 0;
 
 static GtkAction *
@@ -79,73 +93,316 @@ find_action (GtkUIManager *manager, const char *name)
 	return NULL;
 }
 
+static void
+bookmarks_window_data_free (BookmarksWindowData *data)
+{
+	g_hash_table_destroy (data->bookmarks_menu_items);
+	g_free (data);
+}
+
+/* Merges the item for bookmark before the one for before, or at the end
+ * of the uncategorized bookmarks if before is NULL. */
+static void
+merge_bookmarks_menu_item (GtkUIManager *manager,
+			   BookmarksWindowData *data,
+			   EphyNode *bookmark,
+			   EphyNode *before)
+{
+	char name[EPHY_BOOKMARK_ACTION_NAME_BUFFER_SIZE];
+	char *path;
+	guint merge_id;
+
+	EPHY_BOOKMARK_ACTION_NAME_PRINTF (name, bookmark);
+
+	if (before != NULL)
+	{
+		char before_name[EPHY_BOOKMARK_ACTION_NAME_BUFFER_SIZE];
+
+		EPHY_BOOKMARK_ACTION_NAME_PRINTF (before_name, before);
+		path = g_strconcat (UNCATEGORIZED_PATH "/", before_name, NULL);
+	}
+	else
+	{
+		path = g_strdup (UNCATEGORIZED_PATH);
+	}
+
+	merge_id = gtk_ui_manager_new_merge_id (manager);
+	gtk_ui_manager_add_ui (manager, merge_id, path, name, name,
+			       GTK_UI_MANAGER_MENUITEM, before != NULL);
+	g_hash_table_insert (data->bookmarks_menu_items, bookmark,
+			     GUINT_TO_POINTER (merge_id));
+
+	g_free (path);
+}
+
+static void
+unmerge_bookmarks_menu_item (GtkUIManager *manager,
+			     BookmarksWindowData *data,
+			     EphyNode *bookmark)
+{
+	guint merge_id;
+
+	merge_id = GPOINTER_TO_UINT (g_hash_table_lookup (data->bookmarks_menu_items, bookmark));
+	if (merge_id == 0) return;
+
+	gtk_ui_manager_remove_ui (manager, merge_id);
+	g_hash_table_remove (data->bookmarks_menu_items, bookmark);
+}
+
+static gboolean
+unmerge_item_cb (EphyNode *bookmark,
+		 gpointer merge_id,
+		 GtkUIManager *manager)
+{
+	gtk_ui_manager_remove_ui (manager, GPOINTER_TO_UINT (merge_id));
+
+	return TRUE;
+}
+
+static void
+unmerge_bookmarks_menu (GtkUIManager *manager,
+			BookmarksWindowData *data)
+{
+	g_hash_table_foreach_remove (data->bookmarks_menu_items,
+				     (GHRFunc)unmerge_item_cb, manager);
+
+	if (data->bookmarks_menu)
+	{
+		gtk_ui_manager_remove_ui (manager, data->bookmarks_menu);
+		data->bookmarks_menu = 0;
+	}
+}
+
 static void
 activate_bookmarks_menu (GtkAction *action, EphyWindow *window)
 {
 	BookmarksWindowData *data = g_object_get_data (G_OBJECT (window), BM_WINDOW_DATA_KEY);
-	if (data && !data->bookmarks_menu)
+	if (data == NULL) return;
+
+	if (!data->bookmarks_menu ||
+	    data->bookmarks_menu_generation != bookmarks_menu_generation)
 	{
 		GtkUIManager *manager = ephy_window_get_ui_manager (window);
+		guint i;
+
+		unmerge_bookmarks_menu (manager, data);
+
 		gtk_ui_manager_ensure_update (manager);
 
 		if (!bookmarks_menu_string->len)
 		{
 			g_string_append (bookmarks_menu_string,
 					 "<ui><popup name=\"PagePopup\" action=\"PagePopupAction\"><menu name=\"BookmarksMenu\" action=\"Bookmarks\">");
-			ephy_bookmarks_menu_build (bookmarks_menu_string, 0);
+			ephy_bookmarks_menu_build (bookmarks_menu_string, 0,
+						   bookmarks_menu_uncategorized);
 			g_string_append (bookmarks_menu_string, "</menu></popup></ui>");
 		}
 
 		data->bookmarks_menu = gtk_ui_manager_add_ui_from_string
 		  (manager, bookmarks_menu_string->str, bookmarks_menu_string->len, 0);
+		for (i = 0; i < bookmarks_menu_uncategorized->len; i++)
+		{
+			merge_bookmarks_menu_item (manager, data,
+						   g_ptr_array_index (bookmarks_menu_uncategorized, i),
+						   NULL);
+		}
+		data->bookmarks_menu_generation = bookmarks_menu_generation;
 		
 		gtk_ui_manager_ensure_update (manager);
 	}
 }
 
 static void
-erase_bookmarks_menu (EphyWindow *window)
+invalidate_bookmarks_menu (void)
 {
-	BookmarksWindowData *data;
-	GtkUIManager *manager;
+	/* Nothing to do if no window merged the current menu yet. */
+	if (bookmarks_menu_string->len == 0) return;
 
-	manager = ephy_window_get_ui_manager (window);
-	data = g_object_get_data (G_OBJECT (window), BM_WINDOW_DATA_KEY);
+	bookmarks_menu_generation++;
+	g_string_truncate (bookmarks_menu_string, 0);
+	g_ptr_array_set_size (bookmarks_menu_uncategorized, 0);
+}
 
-	if (data != NULL && data->bookmarks_menu != 0)
+/* The topics that may get a submenu, as in ephy_bookmarks_menu_build() */
+static GPtrArray *
+get_menu_topics (EphyBookmarks *eb)
+{
+	GPtrArray *children, *topics;
+	EphyNode *topic;
+	guint i;
+
+	children = ephy_node_get_children (ephy_bookmarks_get_keywords (eb));
+	topics = g_ptr_array_sized_new (children->len + 1);
+	for (i = 0; i < children->len; i++)
 	{
-		gtk_ui_manager_remove_ui (manager, data->bookmarks_menu);
-		data->bookmarks_menu = 0;
+		topic = g_ptr_array_index (children, i);
+		if (ephy_node_get_property_int (topic, EPHY_NODE_KEYWORD_PROP_PRIORITY) ==
+		    EPHY_NODE_NORMAL_PRIORITY)
+			g_ptr_array_add (topics, topic);
 	}
 
-	g_string_truncate (bookmarks_menu_string, 0);
+	topic = ephy_bookmarks_get_local (eb);
+	if (topic != NULL)
+		g_ptr_array_add (topics, topic);
+
+	return topics;
+}
+
+/* Whether adding or removing the uncategorized bookmark leaves the rest
+ * of the menu as it is. It does not if the bookmark is in a topic, or if
+ * a topic holds all the other bookmarks: such a topic gets no submenu
+ * while it holds all of them. */
+static gboolean
+uncategorized_change_is_local (EphyBookmarks *eb,
+			       EphyNode *bookmark)
+{
+	GPtrArray *topics;
+	EphyNode *topic;
+	int n_others, n_children;
+	gboolean local = TRUE;
+	guint i;
+
+	n_others = ephy_node_get_n_children (ephy_bookmarks_get_bookmarks (eb));
+	if (ephy_node_has_child (ephy_bookmarks_get_bookmarks (eb), bookmark))
+		n_others--;
+
+	topics = get_menu_topics (eb);
+	for (i = 0; i < topics->len && local; i++)
+	{
+		topic = g_ptr_array_index (topics, i);
+		n_children = ephy_node_get_n_children (topic);
+
+		local = !ephy_node_has_child (topic, bookmark) &&
+			!(n_children > 0 && n_children == n_others);
+	}
+	g_ptr_array_free (topics, TRUE);
+
+	return local;
+}
+
+static int
+find_uncategorized (EphyNode *bookmark)
+{
+	guint i;
+
+	for (i = 0; i < bookmarks_menu_uncategorized->len; i++)
+	{
+		if (g_ptr_array_index (bookmarks_menu_uncategorized, i) == bookmark)
+			return i;
+	}
+
+	return -1;
+}
+
+static void
+add_uncategorized (EphyNode *bookmark)
+{
+	GPtrArray *items = bookmarks_menu_uncategorized;
+	EphyNode *before = NULL;
+	GList *l;
+	guint i;
+
+	/* Keep the items sorted */
+	for (i = 0; i < items->len; i++)
+	{
+		if (ephy_bookmarks_compare_bookmark_pointers (&bookmark,
+							      &g_ptr_array_index (items, i)) < 0)
+		{
+			before = g_ptr_array_index (items, i);
+			break;
+		}
+	}
+
+	g_ptr_array_add (items, NULL);
+	memmove (items->pdata + i + 1, items->pdata + i,
+		 (items->len - i - 1) * sizeof (gpointer));
+	items->pdata[i] = bookmark;
+
+	for (l = bookmarks_menu_windows; l != NULL; l = l->next)
+	{
+		BookmarksWindowData *data = g_object_get_data (G_OBJECT (l->data), BM_WINDOW_DATA_KEY);
+
+		if (data->bookmarks_menu &&
+		    data->bookmarks_menu_generation == bookmarks_menu_generation)
+		{
+			merge_bookmarks_menu_item (ephy_window_get_ui_manager (l->data),
+						   data, bookmark, before);
+		}
+	}
+}
+
+static void
+remove_uncategorized (EphyNode *bookmark,
+		      int index)
+{
+	GList *l;
+
+	g_ptr_array_remove_index (bookmarks_menu_uncategorized, index);
+
+	for (l = bookmarks_menu_windows; l != NULL; l = l->next)
+	{
+		BookmarksWindowData *data = g_object_get_data (G_OBJECT (l->data), BM_WINDOW_DATA_KEY);
+
+		unmerge_bookmarks_menu_item (ephy_window_get_ui_manager (l->data),
+					     data, bookmark);
+	}
 }
 
 static void
 tree_changed_cb (EphyBookmarks *bookmarks,
-		 EphyWindow *window)
+		 gpointer user_data)
 {
-	erase_bookmarks_menu (window);
+	/* Some bookmark got or lost a topic */
+	invalidate_bookmarks_menu ();
 }
 
 static void
 node_added_cb (EphyNode *parent,
 	       EphyNode *child,
-	       EphyWindow *window)
+	       EphyBookmarks *eb)
 {
-	erase_bookmarks_menu (window);
+	if (bookmarks_menu_string->len == 0) return;
+
+	if (parent == ephy_bookmarks_get_keywords (eb))
+	{
+		/* A new topic gets no submenu until it has bookmarks */
+		if (ephy_node_get_n_children (child) > 0)
+			invalidate_bookmarks_menu ();
+	}
+	else if (uncategorized_change_is_local (eb, child))
+	{
+		add_uncategorized (child);
+	}
+	else
+	{
+		invalidate_bookmarks_menu ();
+	}
 }
 
 static void
 node_changed_cb (EphyNode *parent,
 		 EphyNode *child,
 		 guint property_id,
-		 EphyWindow *window)
+		 EphyBookmarks *eb)
 {
-	if (property_id == EPHY_NODE_KEYWORD_PROP_NAME ||
-	    property_id == EPHY_NODE_BMK_PROP_TITLE)
+	int index;
+
+	if (bookmarks_menu_string->len == 0) return;
+
+	/* The labels follow the titles on their own, but the items are
+	 * sorted by title */
+	if (property_id == EPHY_NODE_BMK_PROP_TITLE &&
+	    parent == ephy_bookmarks_get_bookmarks (eb) &&
+	    (index = find_uncategorized (child)) >= 0)
+	{
+		remove_uncategorized (child, index);
+		add_uncategorized (child);
+	}
+	else if (property_id == EPHY_NODE_BMK_PROP_TITLE ||
+		 (property_id == EPHY_NODE_KEYWORD_PROP_NAME &&
+		  ephy_node_get_n_children (child) > 0))
 	{
-		erase_bookmarks_menu (window);
+		invalidate_bookmarks_menu ();
 	}
 }
 
@@ -153,9 +410,68 @@ static void
 node_removed_cb (EphyNode *parent,
 		 EphyNode *child,
 		 guint index,
-		 EphyWindow *window)
+		 EphyBookmarks *eb)
 {
-	erase_bookmarks_menu (window);
+	int item_index;
+
+	if (bookmarks_menu_string->len == 0) return;
+
+	if (parent == ephy_bookmarks_get_keywords (eb))
+	{
+		/* A topic without bookmarks had no submenu */
+		if (ephy_node_get_n_children (child) > 0)
+			invalidate_bookmarks_menu ();
+	}
+	else
+	{
+		item_index = find_uncategorized (child);
+		if (item_index >= 0)
+			remove_uncategorized (child, item_index);
+
+		if (item_index < 0 || !uncategorized_change_is_local (eb, child))
+			invalidate_bookmarks_menu ();
+	}
+}
+
+static void
+bookmarks_menu_init (EphyBookmarks *eb)
+{
+	EphyNode *bookmarks;
+	EphyNode *topics;
+
+	if (bookmarks_menu_string != NULL) return;
+
+	bookmarks_menu_string = g_string_new ("");
+	bookmarks_menu_uncategorized = g_ptr_array_new ();
+
+	bookmarks = ephy_bookmarks_get_bookmarks (eb);
+	topics = ephy_bookmarks_get_keywords (eb);
+
+	/* Add signal handlers for the bookmark database, once for all
+	 * the windows. */
+	ephy_node_signal_connect_object (bookmarks, EPHY_NODE_CHILD_ADDED,
+					 (EphyNodeCallback)node_added_cb,
+					 G_OBJECT (eb));
+	ephy_node_signal_connect_object (topics, EPHY_NODE_CHILD_ADDED,
+					 (EphyNodeCallback)node_added_cb,
+					 G_OBJECT (eb));
+
+	ephy_node_signal_connect_object (bookmarks, EPHY_NODE_CHILD_REMOVED,
+					 (EphyNodeCallback)node_removed_cb,
+					 G_OBJECT (eb));
+	ephy_node_signal_connect_object (topics, EPHY_NODE_CHILD_REMOVED,
+					 (EphyNodeCallback)node_removed_cb,
+					 G_OBJECT (eb));
+
+	ephy_node_signal_connect_object (bookmarks, EPHY_NODE_CHILD_CHANGED,
+					 (EphyNodeCallback)node_changed_cb,
+					 G_OBJECT (eb));        
+	ephy_node_signal_connect_object (topics, EPHY_NODE_CHILD_CHANGED,
+					 (EphyNodeCallback)node_changed_cb,
+					 G_OBJECT (eb));
+
+	g_signal_connect (eb, "tree_changed",
+			  G_CALLBACK (tree_changed_cb), NULL);
 }
 
 void
@@ -175,10 +491,15 @@ ephy_bookmarks_ui_attach_window (EphyWindow *window)
 	data = g_object_get_data (G_OBJECT (window), BM_WINDOW_DATA_KEY);
 	g_return_if_fail (data == NULL);
 
+	bookmarks_menu_init (eb);
+
 	manager = ephy_window_get_ui_manager (window);
 
 	data = g_new0 (BookmarksWindowData, 1);
-	g_object_set_data_full (G_OBJECT (window), BM_WINDOW_DATA_KEY, data, g_free);
+	data->bookmarks_menu_items = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_object_set_data_full (G_OBJECT (window), BM_WINDOW_DATA_KEY, data,
+				(GDestroyNotify)bookmarks_window_data_free);
+	bookmarks_menu_windows = g_list_prepend (bookmarks_menu_windows, window);
 
 	/* Create the self-maintaining action groups for bookmarks and topics */
 	actions = ephy_bookmark_group_new (bookmarks);
@@ -198,37 +519,8 @@ ephy_bookmarks_ui_attach_window (EphyWindow *window)
 				 G_CALLBACK (ephy_link_open), G_OBJECT (window),
 				 G_CONNECT_SWAPPED | G_CONNECT_AFTER);
 	g_object_unref (actions);
-	
-	/* Add signal handlers for the bookmark database */
-	ephy_node_signal_connect_object (bookmarks, EPHY_NODE_CHILD_ADDED,
-					 (EphyNodeCallback)node_added_cb,
-					 G_OBJECT (window));
-	ephy_node_signal_connect_object (topics, EPHY_NODE_CHILD_ADDED,
-					 (EphyNodeCallback)node_added_cb,
-					 G_OBJECT (window));
-
-	ephy_node_signal_connect_object (bookmarks, EPHY_NODE_CHILD_REMOVED,
-					 (EphyNodeCallback)node_removed_cb,
-					 G_OBJECT (window));
-	ephy_node_signal_connect_object (topics, EPHY_NODE_CHILD_REMOVED,
-					 (EphyNodeCallback)node_removed_cb,
-					 G_OBJECT (window));
-
-	ephy_node_signal_connect_object (bookmarks, EPHY_NODE_CHILD_CHANGED,
-					 (EphyNodeCallback)node_changed_cb,
-					 G_OBJECT (window));        
-	ephy_node_signal_connect_object (topics, EPHY_NODE_CHILD_CHANGED,
-					 (EphyNodeCallback)node_changed_cb,
-					 G_OBJECT (window));
-
-	g_signal_connect_object (eb, "tree_changed",
-				 G_CALLBACK (tree_changed_cb),
-				 G_OBJECT (window), 0);
-
-	/* Setup empty menu strings and add signal handlers to build the menus on demand */
-	if (!bookmarks_menu_string)
-            bookmarks_menu_string = g_string_new ("");
 
+	/* Build the menu on demand */
 	action = find_action (manager, "Bookmarks");
 	g_signal_connect_object (action, "activate",
 				 G_CALLBACK (activate_bookmarks_menu),
@@ -238,45 +530,17 @@ ephy_bookmarks_ui_attach_window (EphyWindow *window)
 void
 ephy_bookmarks_ui_detach_window (EphyWindow *window)
 {
-	EphyBookmarks *eb = ephy_shell_get_bookmarks (ephy_shell_get_default ());
-	EphyNode *bookmarks = ephy_bookmarks_get_bookmarks (eb);
-	EphyNode *topics = ephy_bookmarks_get_keywords (eb);
-
 	BookmarksWindowData *data = g_object_get_data (G_OBJECT (window), BM_WINDOW_DATA_KEY);
 	GtkUIManager *manager = ephy_window_get_ui_manager (window);
 	GtkAction *action;
 
 	g_return_if_fail (data != 0);
 
-	if (data->bookmarks_menu)
-		gtk_ui_manager_remove_ui (manager, data->bookmarks_menu);
+	unmerge_bookmarks_menu (manager, data);
 
+	bookmarks_menu_windows = g_list_remove (bookmarks_menu_windows, window);
 	g_object_set_data (G_OBJECT (window), BM_WINDOW_DATA_KEY, 0);
 	
-	ephy_node_signal_disconnect_object (bookmarks, EPHY_NODE_CHILD_ADDED,
-					    (EphyNodeCallback)node_added_cb,
-					    G_OBJECT (window));
-	ephy_node_signal_disconnect_object (topics, EPHY_NODE_CHILD_ADDED,
-					    (EphyNodeCallback)node_added_cb,
-					    G_OBJECT (window));
-	
-	ephy_node_signal_disconnect_object (bookmarks, EPHY_NODE_CHILD_REMOVED,
-					    (EphyNodeCallback)node_removed_cb,
-					    G_OBJECT (window));
-	ephy_node_signal_disconnect_object (topics, EPHY_NODE_CHILD_REMOVED,
-					    (EphyNodeCallback)node_removed_cb,
-					    G_OBJECT (window));
-	
-	ephy_node_signal_disconnect_object (bookmarks, EPHY_NODE_CHILD_CHANGED,
-					    (EphyNodeCallback)node_changed_cb,
-					    G_OBJECT (window));        
-	ephy_node_signal_disconnect_object (topics, EPHY_NODE_CHILD_CHANGED,
-					    (EphyNodeCallback)node_changed_cb,
-					    G_OBJECT (window));
-	
-	g_signal_handlers_disconnect_by_func
-	  (G_OBJECT (eb), G_CALLBACK (tree_changed_cb), G_OBJECT (window));
-	
 	action = find_action (manager, "Bookmarks");
 	g_signal_handlers_disconnect_by_func
 	  (G_OBJECT (action), G_CALLBACK (activate_bookmarks_menu), G_OBJECT (window));
@@ -66,6 +66,9 @@ struct _EphyBookmarksPrivate
 	gboolean init_defaults;
 	gboolean dirty;
 	guint save_timeout_id;
+	guint freeze_count;
+	gboolean save_pending;
+	gboolean tree_changed_pending;
 	char *xml_file;
 	char *rdf_file;
 	EphyNodeDb *db;
@@ -78,6 +81,7 @@ struct _EphyBookmarksPrivate
 
 	/* Local sites */
 	EphyNode *local;
+	guint start_client_id;
 	GaClient *ga_client;
 	GaServiceBrowser *browse_handles[G_N_ELEMENTS (zeroconf_protos)];
 	GHashTable *resolve_handles;
@@ -211,6 +215,12 @@ save_bookmarks_delayed (EphyBookmarks *bookmarks)
 static void
 ephy_bookmarks_save_delayed (EphyBookmarks *bookmarks, int delay)
 {
+	if (bookmarks->priv->freeze_count > 0)
+	{
+		bookmarks->priv->save_pending = TRUE;
+		return;
+	}
+
 	if (!bookmarks->priv->dirty)
 	{
 		bookmarks->priv->dirty = TRUE;
@@ -231,6 +241,18 @@ ephy_bookmarks_save_delayed (EphyBookmarks *bookmarks, int delay)
 	}
 }
 
+static void
+ephy_bookmarks_emit_tree_changed (EphyBookmarks *eb)
+{
+	if (eb->priv->freeze_count > 0)
+	{
+		eb->priv->tree_changed_pending = TRUE;
+		return;
+	}
+
+	g_signal_emit (G_OBJECT (eb), ephy_bookmarks_signals[TREE_CHANGED], 0);
+}
+
 #ifdef HAVE_WEBKIT2
 static void
 icon_updated_cb (WebKitFaviconDatabase *favicon_database,
@@ -271,9 +293,8 @@ ephy_setup_history_notifiers (EphyBookmarks *eb)
 }
 
 static void
-update_bookmark_keywords (EphyBookmarks *eb, EphyNode *bookmark)
+set_bookmark_keywords (EphyBookmarks *eb, EphyNode *bookmark, GPtrArray *topics)
 {
-	GPtrArray *children;
 	int i;
 	GString *list;
 	const char *title;
@@ -281,24 +302,13 @@ update_bookmark_keywords (EphyBookmarks *eb, EphyNode *bookmark)
 
 	list = g_string_new (NULL);
 
-	children = ephy_node_get_children (eb->priv->keywords);
-	for (i = 0; i < children->len; i++)
+	for (i = 0; topics != NULL && i < topics->len; i++)
 	{
-		EphyNode *kid;
-
-		kid = g_ptr_array_index (children, i);
-
-		if (kid != eb->priv->notcategorized && 
-		    kid != eb->priv->bookmarks &&
-		    kid != eb->priv->local &&
-		    ephy_node_has_child (kid, bookmark))
-		{
-			const char *topic;
-			topic = ephy_node_get_property_string
-				(kid, EPHY_NODE_KEYWORD_PROP_NAME);
-			g_string_append (list, topic);
-			g_string_append (list, " ");
-		}
+		const char *topic;
+		topic = ephy_node_get_property_string
+			(g_ptr_array_index (topics, i), EPHY_NODE_KEYWORD_PROP_NAME);
+		g_string_append (list, topic);
+		g_string_append (list, " ");
 	}
 
 	title = ephy_node_get_property_string
@@ -317,6 +327,35 @@ update_bookmark_keywords (EphyBookmarks *eb, EphyNode *bookmark)
 	g_free (case_normalized_keywords);
 }
 
+static void
+update_bookmark_keywords (EphyBookmarks *eb, EphyNode *bookmark)
+{
+	GPtrArray *children, *topics;
+	int i;
+
+	topics = g_ptr_array_new ();
+
+	children = ephy_node_get_children (eb->priv->keywords);
+	for (i = 0; i < children->len; i++)
+	{
+		EphyNode *kid;
+
+		kid = g_ptr_array_index (children, i);
+
+		if (kid != eb->priv->notcategorized && 
+		    kid != eb->priv->bookmarks &&
+		    kid != eb->priv->local &&
+		    ephy_node_has_child (kid, bookmark))
+		{
+			g_ptr_array_add (topics, kid);
+		}
+	}
+
+	set_bookmark_keywords (eb, bookmark, topics);
+
+	g_ptr_array_free (topics, TRUE);
+}
+
 static void
 bookmarks_changed_cb (EphyNode *node,
 		      EphyNode *child,
@@ -892,6 +931,15 @@ ephy_local_bookmarks_start_client (EphyBookmarks *bookmarks)
 	priv->ga_client = ga_client;
 }
 
+static gboolean
+start_client_idle_cb (EphyBookmarks *bookmarks)
+{
+	bookmarks->priv->start_client_id = 0;
+	ephy_local_bookmarks_start_client (bookmarks);
+
+	return FALSE;
+}
+
 static void
 ephy_local_bookmarks_init (EphyBookmarks *bookmarks)
 {
@@ -899,7 +947,13 @@ ephy_local_bookmarks_init (EphyBookmarks *bookmarks)
 	priv->resolve_handles =	g_hash_table_new_full (g_str_hash, g_str_equal,
 						       g_free,
 						       (GDestroyNotify) resolve_data_free);
-        ephy_local_bookmarks_start_client (bookmarks);
+
+	/* Connecting to avahi blocks on D-Bus, and bookmarks are loaded
+	 * while the first window is being built; local sites can wait. */
+	priv->start_client_id =
+		g_idle_add_full (G_PRIORITY_LOW,
+				 (GSourceFunc) start_client_idle_cb,
+				 bookmarks, NULL);
 }
 
 static void
@@ -908,6 +962,12 @@ ephy_local_bookmarks_stop (EphyBookmarks *bookmarks)
 	EphyBookmarksPrivate *priv = bookmarks->priv;
 	guint i;
 
+	if (priv->start_client_id != 0)
+	{
+		g_source_remove (priv->start_client_id);
+		priv->start_client_id = 0;
+	}
+
 	for (i = 0; i < G_N_ELEMENTS (zeroconf_protos); ++i)
 	{
 		if (priv->browse_handles[i] != NULL)
@@ -957,6 +1017,14 @@ ephy_bookmarks_init (EphyBookmarks *eb)
 	db = ephy_node_db_new (EPHY_NODE_DB_BOOKMARKS);
 	eb->priv->db = db;
 
+	/* icon addresses repeat for every bookmark of a host, and topic
+	 * names are pooled along with them. Locations are left alone: they
+	 * are nearly always unique, so a pool entry would cost more than
+	 * the copy it saves. */
+	ephy_node_db_set_interned_property (db, EPHY_NODE_BMK_PROP_ICON);
+	ephy_node_db_set_interned_property (db, EPHY_NODE_BMK_PROP_USERICON);
+	ephy_node_db_set_interned_property (db, EPHY_NODE_KEYWORD_PROP_NAME);
+
 	eb->priv->xml_file = g_build_filename (ephy_dot_dir (),
 					       EPHY_BOOKMARKS_FILE,
 					       NULL);
@@ -1067,6 +1135,8 @@ ephy_bookmarks_init (EphyBookmarks *eb)
 			 G_SETTINGS_BIND_GET);
 
 	ephy_setup_history_notifiers (eb);
+
+	ephy_trace_milestone ("bookmarks-loaded");
 }
 
 static void
@@ -1105,6 +1175,54 @@ ephy_bookmarks_new (void)
 	return EPHY_BOOKMARKS (g_object_new (EPHY_TYPE_BOOKMARKS, NULL));
 }
 
+/**
+ * ephy_bookmarks_freeze:
+ * @eb: an #EphyBookmarks
+ *
+ * Holds back saving and #EphyBookmarks::tree-changed emission until a
+ * matching ephy_bookmarks_thaw(), so bulk operations such as importing
+ * cause a single save and a single notification.
+ **/
+void
+ephy_bookmarks_freeze (EphyBookmarks *eb)
+{
+	g_return_if_fail (EPHY_IS_BOOKMARKS (eb));
+
+	eb->priv->freeze_count++;
+}
+
+/**
+ * ephy_bookmarks_thaw:
+ * @eb: an #EphyBookmarks
+ *
+ * Reverts the effect of a previous ephy_bookmarks_freeze(), emitting
+ * the notification and scheduling the save that were held back.
+ **/
+void
+ephy_bookmarks_thaw (EphyBookmarks *eb)
+{
+	EphyBookmarksPrivate *priv;
+
+	g_return_if_fail (EPHY_IS_BOOKMARKS (eb));
+	g_return_if_fail (eb->priv->freeze_count > 0);
+
+	priv = eb->priv;
+
+	if (--priv->freeze_count > 0) return;
+
+	if (priv->tree_changed_pending)
+	{
+		priv->tree_changed_pending = FALSE;
+		g_signal_emit (G_OBJECT (eb), ephy_bookmarks_signals[TREE_CHANGED], 0);
+	}
+
+	if (priv->save_pending)
+	{
+		priv->save_pending = FALSE;
+		ephy_bookmarks_save_delayed (eb, 0);
+	}
+}
+
 static void
 update_has_smart_address (EphyBookmarks *bookmarks, EphyNode *bmk, const char *address)
 {
@@ -1151,9 +1269,33 @@ EphyNode *
 ephy_bookmarks_add (EphyBookmarks *eb,
 		    const char *title,
 		    const char *url)
+{
+	return ephy_bookmarks_add_with_keywords (eb, title, url, NULL);
+}
+
+/**
+ * ephy_bookmarks_add_with_keywords:
+ * @eb: an #EphyBookmarks
+ * @title: the title of the bookmark
+ * @url: the address of the bookmark
+ * @keywords: (allow-none): the topics to file the bookmark under
+ *
+ * Like ephy_bookmarks_add(), followed by ephy_bookmarks_set_keyword()
+ * for each of @keywords, but the bookmark is complete before it is
+ * added anywhere: each of its parents is notified once, and it never
+ * goes through the uncategorized bookmarks if it has topics.
+ *
+ * Returns: the new bookmark
+ **/
+EphyNode *
+ephy_bookmarks_add_with_keywords (EphyBookmarks *eb,
+				  const char *title,
+				  const char *url,
+				  GPtrArray *keywords)
 {
 	EphyNode *bm;
 	WebKitFaviconDatabase *favicon_database;
+	guint i;
 
 	bm = ephy_node_new (eb->priv->db);
 
@@ -1185,10 +1327,23 @@ ephy_bookmarks_add (EphyBookmarks *eb,
 	}
 
 	update_has_smart_address (eb, bm, url);
-	update_bookmark_keywords (eb, bm);
+	set_bookmark_keywords (eb, bm, keywords);
 
 	ephy_node_add_child (eb->priv->bookmarks, bm);
-	ephy_node_add_child (eb->priv->notcategorized, bm);
+
+	if (keywords != NULL && keywords->len > 0)
+	{
+		for (i = 0; i < keywords->len; i++)
+		{
+			ephy_node_add_child (g_ptr_array_index (keywords, i), bm);
+		}
+
+		ephy_bookmarks_emit_tree_changed (eb);
+	}
+	else
+	{
+		ephy_node_add_child (eb->priv->notcategorized, bm);
+	}
 
 	ephy_bookmarks_save_delayed (eb, 0);
 
@@ -1622,7 +1777,7 @@ ephy_bookmarks_set_keyword (EphyBookmarks *eb,
 
 	update_bookmark_keywords (eb, bookmark);
 
-	g_signal_emit (G_OBJECT (eb), ephy_bookmarks_signals[TREE_CHANGED], 0);
+	ephy_bookmarks_emit_tree_changed (eb);
 }
 
 void
@@ -1644,7 +1799,7 @@ ephy_bookmarks_unset_keyword (EphyBookmarks *eb,
 
 	update_bookmark_keywords (eb, bookmark);
 
-	g_signal_emit (G_OBJECT (eb), ephy_bookmarks_signals[TREE_CHANGED], 0);
+	ephy_bookmarks_emit_tree_changed (eb);
 }
 
 /**
@@ -1718,7 +1873,7 @@ ephy_bookmarks_compare_topics (gconstpointer a, gconstpointer b)
 {
 	EphyNode *node_a = (EphyNode *)a;
 	EphyNode *node_b = (EphyNode *)b;
-	const char *title1, *title2;
+	const char *key1, *key2;
 	int priority1, priority2;
 
 	priority1 = ephy_node_get_property_int (node_a, EPHY_NODE_KEYWORD_PROP_PRIORITY);
@@ -1727,13 +1882,13 @@ ephy_bookmarks_compare_topics (gconstpointer a, gconstpointer b)
 	if (priority1 > priority2) return 1;
 	if (priority1 < priority2) return -1;
 
-	title1 = ephy_node_get_property_string (node_a, EPHY_NODE_KEYWORD_PROP_NAME);
-	title2 = ephy_node_get_property_string (node_b, EPHY_NODE_KEYWORD_PROP_NAME);
+	key1 = ephy_node_get_property_collate_key (node_a, EPHY_NODE_KEYWORD_PROP_NAME);
+	key2 = ephy_node_get_property_collate_key (node_b, EPHY_NODE_KEYWORD_PROP_NAME);
 
-	if (title1 == title2) return 0;
-	if (title1 == NULL) return -1;
-	if (title2 == NULL) return 1;
-	return g_utf8_collate (title1, title2);
+	if (key1 == key2) return 0;
+	if (key1 == NULL) return -1;
+	if (key2 == NULL) return 1;
+	return strcmp (key1, key2);
 }
 
 int
@@ -1750,15 +1905,15 @@ ephy_bookmarks_compare_bookmarks (gconstpointer a, gconstpointer b)
 {
 	EphyNode *node_a = (EphyNode *)a;
 	EphyNode *node_b = (EphyNode *)b;
-	const char *title1, *title2;
+	const char *key1, *key2;
 	
-	title1 = ephy_node_get_property_string (node_a, EPHY_NODE_BMK_PROP_TITLE);
-	title2 = ephy_node_get_property_string (node_b, EPHY_NODE_BMK_PROP_TITLE);
+	key1 = ephy_node_get_property_collate_key (node_a, EPHY_NODE_BMK_PROP_TITLE);
+	key2 = ephy_node_get_property_collate_key (node_b, EPHY_NODE_BMK_PROP_TITLE);
 
-	if (title1 == title2) return 0;
-	if (title1 == NULL) return -1;
-	if (title2 == NULL) return 1;
-	return g_utf8_collate (title1, title2);
+	if (key1 == key2) return 0;
+	if (key1 == NULL) return -1;
+	if (key2 == NULL) return 1;
+	return strcmp (key1, key2);
 }
 
 int
@@ -77,6 +77,10 @@ GType		  ephy_bookmarks_get_type		(void);
 
 EphyBookmarks    *ephy_bookmarks_new			(void);
 
+void		  ephy_bookmarks_freeze			(EphyBookmarks *eb);
+
+void		  ephy_bookmarks_thaw			(EphyBookmarks *eb);
+
 EphyNode	 *ephy_bookmarks_get_from_id		(EphyBookmarks *eb,
 							 long id);
 
@@ -86,6 +90,11 @@ EphyNode	 *ephy_bookmarks_add			(EphyBookmarks *eb,
 							 const char *title,
 							 const char *url);
 
+EphyNode	 *ephy_bookmarks_add_with_keywords	(EphyBookmarks *eb,
+							 const char *title,
+							 const char *url,
+							 GPtrArray *keywords);
+
 EphyNode*	  ephy_bookmarks_find_bookmark		(EphyBookmarks *eb,
 							 const char *url);
 
@@ -104,7 +104,7 @@ get_popup (EphyTopicAction *action)
 		popup_menu_string = g_string_new (NULL);
 		g_string_append_printf (popup_menu_string, "<ui><popup name=\"%s\">", path + 1);
 
-		ephy_bookmarks_menu_build (popup_menu_string, priv->node);
+		ephy_bookmarks_menu_build (popup_menu_string, priv->node, NULL);
 		g_string_append (popup_menu_string, "</popup></ui>");
 
 		priv->merge_id = gtk_ui_manager_add_ui_from_string
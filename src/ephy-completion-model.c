@@ -23,24 +23,117 @@
 
 #include "ephy-embed-prefs.h"
 #include "ephy-embed-shell.h"
-#include "ephy-favicon-helpers.h"
+#include "ephy-favicon-cache.h"
 #include "ephy-history-service.h"
 #include "ephy-shell.h"
 
+#include "ephy-debug.h"
+
 #include <string.h>
 
 G_DEFINE_TYPE (EphyCompletionModel, ephy_completion_model, GTK_TYPE_LIST_STORE)
 
 #define EPHY_COMPLETION_MODEL_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), EPHY_TYPE_COMPLETION_MODEL, EphyCompletionModelPrivate))
 
+typedef struct _FindURLsData FindURLsData;
+
 struct _EphyCompletionModelPrivate {
   EphyHistoryService *history_service;
   GCancellable *cancellable;
 
   EphyNode *bookmarks;
-  GSList *search_terms;
+  char **search_terms;
+
+  /* Candidates matching the last search, kept around so that typing
+   * one more character only has to filter them. */
+  GPtrArray *bookmark_matches;
+  char *bookmark_search;
+  GPtrArray *history_matches;
+  char *history_search;
+  gboolean history_matches_complete;
+
+  FindURLsData *pending_query;
+  guint query_timeout_id;
+  gint64 query_latency;
 };
 
+typedef struct {
+  char *title;
+  char *location;
+  char *keywords;
+  int visit_count;
+  char *folded;
+} Candidate;
+
+static void
+candidate_free (Candidate *candidate)
+{
+  g_free (candidate->title);
+  g_free (candidate->location);
+  g_free (candidate->keywords);
+  g_free (candidate->folded);
+
+  g_slice_free (Candidate, candidate);
+}
+
+static void
+free_candidates (GPtrArray **candidates)
+{
+  if (*candidates == NULL)
+    return;
+
+  g_ptr_array_foreach (*candidates, (GFunc)candidate_free, NULL);
+  g_ptr_array_free (*candidates, TRUE);
+  *candidates = NULL;
+}
+
+static void
+invalidate_bookmark_matches (EphyCompletionModel *model)
+{
+  EphyCompletionModelPrivate *priv = model->priv;
+
+  free_candidates (&priv->bookmark_matches);
+  g_free (priv->bookmark_search);
+  priv->bookmark_search = NULL;
+}
+
+static void
+invalidate_history_matches (EphyCompletionModel *model)
+{
+  EphyCompletionModelPrivate *priv = model->priv;
+
+  free_candidates (&priv->history_matches);
+  g_free (priv->history_search);
+  priv->history_search = NULL;
+  priv->history_matches_complete = FALSE;
+}
+
+static void
+bookmark_added_cb (EphyNode *bookmarks,
+                   EphyNode *child,
+                   EphyCompletionModel *model)
+{
+  invalidate_bookmark_matches (model);
+}
+
+static void
+bookmark_changed_cb (EphyNode *bookmarks,
+                     EphyNode *child,
+                     guint property_id,
+                     EphyCompletionModel *model)
+{
+  invalidate_bookmark_matches (model);
+}
+
+static void
+bookmark_removed_cb (EphyNode *bookmarks,
+                     EphyNode *child,
+                     guint old_index,
+                     EphyCompletionModel *model)
+{
+  invalidate_bookmark_matches (model);
+}
+
 static void
 ephy_completion_model_constructed (GObject *object)
 {
@@ -53,25 +146,16 @@ ephy_completion_model_constructed (GObject *object)
                                    types);
 }
 
-static void
-free_search_terms (GSList *search_terms)
-{
-  GSList *iter;
-  
-  for (iter = search_terms; iter != NULL; iter = iter->next)
-    g_regex_unref ((GRegex*)iter->data);
-  
-  g_slist_free (search_terms);
-}
+static void find_urls_data_free (FindURLsData *data);
 
 static void
-ephy_completion_model_finalize (GObject *object)
+cancel_pending_query (EphyCompletionModel *model)
 {
-  EphyCompletionModelPrivate *priv = EPHY_COMPLETION_MODEL (object)->priv;
+  EphyCompletionModelPrivate *priv = model->priv;
 
-  if (priv->search_terms) {
-    free_search_terms (priv->search_terms);
-    priv->search_terms = NULL;
+  if (priv->query_timeout_id) {
+    g_source_remove (priv->query_timeout_id);
+    priv->query_timeout_id = 0;
   }
 
   if (priv->cancellable) {
@@ -79,6 +163,26 @@ ephy_completion_model_finalize (GObject *object)
     g_clear_object (&priv->cancellable);
   }
 
+  /* The history service drops the callback of cancelled jobs, so the
+   * query data is ours to free. */
+  if (priv->pending_query) {
+    find_urls_data_free (priv->pending_query);
+    priv->pending_query = NULL;
+  }
+}
+
+static void
+ephy_completion_model_finalize (GObject *object)
+{
+  EphyCompletionModel *model = EPHY_COMPLETION_MODEL (object);
+  EphyCompletionModelPrivate *priv = model->priv;
+
+  cancel_pending_query (model);
+
+  g_strfreev (priv->search_terms);
+  invalidate_bookmark_matches (model);
+  invalidate_history_matches (model);
+
   G_OBJECT_CLASS (ephy_completion_model_parent_class)->finalize (object);
 }
 
@@ -103,8 +207,37 @@ ephy_completion_model_init (EphyCompletionModel *model)
 
   priv->history_service = EPHY_HISTORY_SERVICE (ephy_embed_shell_get_global_history_service (ephy_embed_shell_get_default ()));
 
+  g_signal_connect_object (priv->history_service, "urls-visited",
+                           G_CALLBACK (invalidate_history_matches),
+                           model, G_CONNECT_SWAPPED);
+  g_signal_connect_object (priv->history_service, "cleared",
+                           G_CALLBACK (invalidate_history_matches),
+                           model, G_CONNECT_SWAPPED);
+  g_signal_connect_object (priv->history_service, "url-title-changed",
+                           G_CALLBACK (invalidate_history_matches),
+                           model, G_CONNECT_SWAPPED);
+  g_signal_connect_object (priv->history_service, "urls-deleted",
+                           G_CALLBACK (invalidate_history_matches),
+                           model, G_CONNECT_SWAPPED);
+  g_signal_connect_object (priv->history_service, "host-deleted",
+                           G_CALLBACK (invalidate_history_matches),
+                           model, G_CONNECT_SWAPPED);
+
   bookmarks_service = ephy_shell_get_bookmarks (ephy_shell_get_default ());
   priv->bookmarks = ephy_bookmarks_get_bookmarks (bookmarks_service);
+
+  ephy_node_signal_connect_object (priv->bookmarks,
+                                   EPHY_NODE_CHILD_ADDED,
+                                   (EphyNodeCallback)bookmark_added_cb,
+                                   G_OBJECT (model));
+  ephy_node_signal_connect_object (priv->bookmarks,
+                                   EPHY_NODE_CHILD_CHANGED,
+                                   (EphyNodeCallback)bookmark_changed_cb,
+                                   G_OBJECT (model));
+  ephy_node_signal_connect_object (priv->bookmarks,
+                                   EPHY_NODE_CHILD_REMOVED,
+                                   (EphyNodeCallback)bookmark_removed_cb,
+                                   G_OBJECT (model));
 }
 
 static gboolean
@@ -178,18 +311,9 @@ icon_loaded_cb (GObject *source, GAsyncResult *result, gpointer user_data)
   GtkTreeIter iter;
   GtkTreePath *path;
   IconLoadData *data = (IconLoadData *) user_data;
-  WebKitFaviconDatabase *database = WEBKIT_FAVICON_DATABASE (source);
-  GdkPixbuf *favicon = NULL;
-
-#ifdef HAVE_WEBKIT2
-  cairo_surface_t *icon_surface = webkit_favicon_database_get_favicon_finish (database, result, NULL);
-  if (icon_surface) {
-    favicon = ephy_pixbuf_get_from_surface_scaled (icon_surface, FAVICON_SIZE, FAVICON_SIZE);
-    cairo_surface_destroy (icon_surface);
-  }
-#else
-  favicon = webkit_favicon_database_get_favicon_pixbuf_finish (database, result, NULL);
-#endif
+  GdkPixbuf *favicon;
+
+  favicon = ephy_favicon_cache_get_favicon_finish (EPHY_FAVICON_CACHE (source), result, NULL);
 
   if (favicon) {
     /* The completion model might have changed its contents */
@@ -197,9 +321,9 @@ icon_loaded_cb (GObject *source, GAsyncResult *result, gpointer user_data)
       path = gtk_tree_row_reference_get_path (data->row_reference);
       gtk_tree_model_get_iter (GTK_TREE_MODEL (data->model), &iter, path);
       gtk_list_store_set (data->model, &iter, EPHY_COMPLETION_FAVICON_COL, favicon, -1);
-      g_object_unref (favicon);
       gtk_tree_path_free (path);
     }
+    g_object_unref (favicon);
   }
 
   g_object_unref (data->model);
@@ -213,14 +337,8 @@ set_row_in_model (EphyCompletionModel *model, int position, PotentialRow *row)
   GtkTreeIter iter;
   GtkTreePath *path;
   IconLoadData *data;
-  WebKitFaviconDatabase* database;
-
-#ifndef HAVE_WEBKIT2
+  EphyFaviconCache *cache;
   GdkPixbuf *favicon;
-  database = webkit_get_favicon_database ();
-#else
-  database = webkit_web_context_get_favicon_database (webkit_web_context_get_default ());
-#endif
 
   gtk_list_store_insert_with_values (GTK_LIST_STORE (model), &iter, position,
                                      EPHY_COMPLETION_TEXT_COL, row->title ? row->title : "",
@@ -231,17 +349,16 @@ set_row_in_model (EphyCompletionModel *model, int position, PotentialRow *row)
                                      EPHY_COMPLETION_RELEVANCE_COL, row->relevance,
                                      -1);
 
-#ifndef HAVE_WEBKIT2
-  /* We try first with the try_get_favicon_pixbuf() because if the icon
-     is in the DB it's faster than the async version. */
-  favicon = webkit_favicon_database_try_get_favicon_pixbuf (database, row->location,
-                                                            FAVICON_SIZE, FAVICON_SIZE);
-  if (favicon) {
-    gtk_list_store_set (GTK_LIST_STORE (model), &iter, EPHY_COMPLETION_FAVICON_COL, favicon, -1);
-    g_object_unref (favicon);
+  /* Rows are rebuilt on every keystroke; most of their favicons are
+     already scaled in the shared cache. */
+  cache = ephy_favicon_cache_get_default ();
+  if (ephy_favicon_cache_lookup (cache, row->location, FAVICON_SIZE, &favicon)) {
+    if (favicon) {
+      gtk_list_store_set (GTK_LIST_STORE (model), &iter, EPHY_COMPLETION_FAVICON_COL, favicon, -1);
+      g_object_unref (favicon);
+    }
     return;
   }
-#endif
 
   data = g_slice_new (IconLoadData);
   data->model = GTK_LIST_STORE (g_object_ref(model));
@@ -249,14 +366,8 @@ set_row_in_model (EphyCompletionModel *model, int position, PotentialRow *row)
   data->row_reference = gtk_tree_row_reference_new (GTK_TREE_MODEL (model), path);
   gtk_tree_path_free (path);
 
-#ifdef HAVE_WEBKIT2
-  webkit_favicon_database_get_favicon (database, row->location,
-                                       NULL, icon_loaded_cb, data);
-#else
-  webkit_favicon_database_get_favicon_pixbuf (database, row->location,
-                                              FAVICON_SIZE, FAVICON_SIZE,
-                                              NULL, icon_loaded_cb, data);
-#endif
+  ephy_favicon_cache_get_favicon_async (cache, row->location, FAVICON_SIZE,
+                                        NULL, icon_loaded_cb, data);
 }
 
 static void
@@ -276,40 +387,142 @@ replace_rows_in_model (EphyCompletionModel *model, GSList *new_rows)
   }
 }
 
-static gboolean
-should_add_bookmark_to_model (EphyCompletionModel *model,
-                              const char *search_string,
-                              const char *title,
-                              const char *location,
-                              const char *keywords)
-{
-  gboolean ret = TRUE;
-  EphyCompletionModelPrivate *priv = model->priv;
 
-  if (priv->search_terms) {
-    GSList *iter;
-    GRegex *current = NULL;
-
-    for (iter = priv->search_terms; iter != NULL; iter = iter->next) {
-      current = (GRegex*)iter->data;
-      if ((!g_regex_match (current, title ? title : "", G_REGEX_MATCH_NOTEMPTY, NULL)) &&
-          (!g_regex_match (current, location ? location : "", G_REGEX_MATCH_NOTEMPTY, NULL)) &&
-          (!g_regex_match (current, keywords ? keywords : "", G_REGEX_MATCH_NOTEMPTY, NULL))) {
-        ret = FALSE;
-        break;
-      }
-    }
-  }
+#define MAX_COMPLETION_HISTORY_URLS 8
 
-  return ret;
-}
+/* History queries faster than a frame are issued on every keystroke;
+ * slower ones are held back for about as long as they take, so that a
+ * burst of typing collapses into a single query. */
+#define INSTANT_QUERY_LATENCY (16 * G_TIME_SPAN_MILLISECOND)
+#define MAX_QUERY_DELAY_MS 150
 
-typedef struct {
+struct _FindURLsData {
   EphyCompletionModel *model;
   char *search_string;
   EphyHistoryJobCallback callback;
   gpointer user_data;
-} FindURLsData;
+  gint64 keystroke_time;
+  gint64 query_time;
+};
+
+static void
+find_urls_data_free (FindURLsData *data)
+{
+  g_free (data->search_string);
+  g_slice_free (FindURLsData, data);
+}
+
+static char *
+fold_string (const char *str)
+{
+  char *normalized;
+  char *folded;
+
+  if (!g_utf8_validate (str, -1, NULL))
+    return g_ascii_strdown (str, -1);
+
+  normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL);
+  folded = g_utf8_casefold (normalized, -1);
+  g_free (normalized);
+
+  return folded;
+}
+
+static Candidate *
+candidate_new (const char *title,
+               const char *location,
+               const char *keywords,
+               int visit_count)
+{
+  Candidate *candidate = g_slice_new (Candidate);
+  char *folded_title, *folded_location;
+
+  candidate->title = g_strdup (title);
+  candidate->location = g_strdup (location);
+  candidate->keywords = g_strdup (keywords);
+  candidate->visit_count = visit_count;
+
+  /* Bookmark keywords are stored already folded. */
+  folded_title = fold_string (title ? title : "");
+  folded_location = fold_string (location ? location : "");
+  candidate->folded = g_strconcat (folded_title, "\n",
+                                   folded_location, "\n",
+                                   keywords ? keywords : "", NULL);
+  g_free (folded_title);
+  g_free (folded_location);
+
+  return candidate;
+}
+
+static gboolean
+candidate_matches (Candidate *candidate,
+                   char **search_terms)
+{
+  int i;
+
+  for (i = 0; search_terms[i] != NULL; i++) {
+    if (strstr (candidate->folded, search_terms[i]) == NULL)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+filter_candidates (GPtrArray *candidates,
+                   char **search_terms)
+{
+  guint i, n_kept = 0;
+
+  for (i = 0; i < candidates->len; i++) {
+    Candidate *candidate = g_ptr_array_index (candidates, i);
+
+    if (candidate_matches (candidate, search_terms))
+      g_ptr_array_index (candidates, n_kept++) = candidate;
+    else
+      candidate_free (candidate);
+  }
+
+  g_ptr_array_set_size (candidates, n_kept);
+}
+
+static void
+update_bookmark_matches (EphyCompletionModel *model,
+                         const char *search_string)
+{
+  EphyCompletionModelPrivate *priv = model->priv;
+  GPtrArray *children;
+  guint i;
+
+  /* Typing one more character can only narrow the matches down. */
+  if (priv->bookmark_matches && priv->bookmark_search &&
+      g_str_has_prefix (search_string, priv->bookmark_search)) {
+    filter_candidates (priv->bookmark_matches, priv->search_terms);
+  } else {
+    free_candidates (&priv->bookmark_matches);
+    priv->bookmark_matches = g_ptr_array_new ();
+
+    children = ephy_node_get_children (priv->bookmarks);
+    for (i = 0; i < children->len; i++) {
+      EphyNode *kid;
+      Candidate *candidate;
+
+      kid = g_ptr_array_index (children, i);
+      candidate = candidate_new (ephy_node_get_property_string (kid, EPHY_NODE_BMK_PROP_TITLE),
+                                 ephy_node_get_property_string (kid, EPHY_NODE_BMK_PROP_LOCATION),
+                                 ephy_node_get_property_string (kid, EPHY_NODE_BMK_PROP_KEYWORDS),
+                                 0);
+
+      if (candidate_matches (candidate, priv->search_terms))
+        g_ptr_array_add (priv->bookmark_matches, candidate);
+      else
+        candidate_free (candidate);
+    }
+  }
+
+  g_free (priv->bookmark_search);
+  priv->bookmark_search = g_strdup (search_string);
+}
 
 static int
 find_url (gconstpointer a,
@@ -391,6 +604,37 @@ sort_by_relevance (gconstpointer a, gconstpointer b)
     return 0;
 }
 
+static void
+update_model (EphyCompletionModel *model)
+{
+  EphyCompletionModelPrivate *priv = model->priv;
+  GSList *list = NULL;
+  guint i;
+
+  for (i = 0; priv->bookmark_matches && i < priv->bookmark_matches->len; i++) {
+    Candidate *candidate = g_ptr_array_index (priv->bookmark_matches, i);
+
+    list = add_to_potential_rows (list, candidate->title, candidate->location,
+                                  candidate->keywords, 0, TRUE, FALSE);
+  }
+
+  for (i = 0; priv->history_matches && i < priv->history_matches->len; i++) {
+    Candidate *candidate = g_ptr_array_index (priv->history_matches, i);
+
+    list = add_to_potential_rows (list, candidate->title, candidate->location,
+                                  NULL, candidate->visit_count, FALSE, TRUE);
+  }
+
+  /* Sort the rows by relevance. */
+  list = g_slist_sort (list, sort_by_relevance);
+
+  /* Now that we have all the rows we want to insert, replace the rows
+   * in the current model one by one, sorted by relevance. */
+  replace_rows_in_model (model, list);
+
+  g_slist_free_full (list, (GDestroyNotify)free_potential_row);
+}
+
 static void
 query_completed_cb (EphyHistoryService *service,
                     gboolean success,
@@ -400,79 +644,99 @@ query_completed_cb (EphyHistoryService *service,
   EphyCompletionModel *model = user_data->model;
   EphyCompletionModelPrivate *priv = model->priv;
   GList *p, *urls;
-  GPtrArray *children;
-  GSList *list = NULL;
-  int i;
+  gint64 now, latency;
+  guint n_urls = 0;
 
-  /* Bookmarks */
-  children = ephy_node_get_children (priv->bookmarks);
-
-  /* FIXME: perhaps this could be done in a service thread? There
-   * should never be a ton of bookmarks, but seems a bit cleaner and
-   * consistent with what we do for the history. */
-  for (i = 0; i < children->len; i++) {
-    EphyNode *kid;
-    const char *keywords, *location, *title;
+  priv->pending_query = NULL;
+  g_clear_object (&priv->cancellable);
 
-    kid = g_ptr_array_index (children, i);
-    location = ephy_node_get_property_string (kid, EPHY_NODE_BMK_PROP_LOCATION);
-    title = ephy_node_get_property_string (kid, EPHY_NODE_BMK_PROP_TITLE);
-    keywords = ephy_node_get_property_string (kid, EPHY_NODE_BMK_PROP_KEYWORDS);
+  now = g_get_monotonic_time ();
+  latency = now - user_data->query_time;
+  if (priv->query_latency == 0)
+    priv->query_latency = latency;
+  else
+    priv->query_latency = (3 * priv->query_latency + latency) / 4;
 
-    if (should_add_bookmark_to_model (model, user_data->search_string,
-                                      title, location, keywords))
-      list = add_to_potential_rows (list, title, location, keywords, 0, TRUE, FALSE);
-  }
+  invalidate_history_matches (model);
+  priv->history_matches = g_ptr_array_new ();
 
-  /* History */
   urls = (GList*)result_data;
-
   for (p = urls; p != NULL; p = p->next) {
     EphyHistoryURL *url = (EphyHistoryURL*)p->data;
 
-    list = add_to_potential_rows (list, url->title, url->url, NULL, url->visit_count, FALSE, TRUE);
+    g_ptr_array_add (priv->history_matches,
+                     candidate_new (url->title, url->url, NULL, url->visit_count));
+    n_urls++;
   }
 
-  /* Sort the rows by relevance. */
-  list = g_slist_sort (list, sort_by_relevance);
+  /* A short result set holds every match, so longer search strings
+   * can be answered from it without asking the history service. */
+  priv->history_search = g_strdup (user_data->search_string);
+  priv->history_matches_complete = success && n_urls < MAX_COMPLETION_HISTORY_URLS;
 
-  /* Now that we have all the rows we want to insert, replace the rows
-   * in the current model one by one, sorted by relevance. */
-  replace_rows_in_model (model, list);
+  update_model (model);
+
+  /* Shown in about:trace, so they're available in release builds. */
+  ephy_trace_counter ("Completion: keystroke latency (us)",
+                      g_get_monotonic_time () - user_data->keystroke_time);
+  ephy_trace_counter ("Completion: history query latency (us)", latency);
 
   /* Notify */
   if (user_data->callback)
     user_data->callback (service, success, result_data, user_data->user_data);
 
-  g_free (user_data->search_string);
-  g_slice_free (FindURLsData, user_data);
   g_list_free_full (urls, (GDestroyNotify)ephy_history_url_free);
-  g_slist_free_full (list, (GDestroyNotify)free_potential_row);
-  g_clear_object (&priv->cancellable);
+  find_urls_data_free (user_data);
 }
 
 static void
-update_search_terms (EphyCompletionModel *model,
-                     const char *text)
+start_history_query (EphyCompletionModel *model)
+{
+  EphyCompletionModelPrivate *priv = model->priv;
+  FindURLsData *user_data = priv->pending_query;
+  char **strings;
+  int i;
+  GList *query = NULL;
+
+  /* Split the search string. */
+  strings = g_strsplit (user_data->search_string, " ", -1);
+  for (i = 0; strings[i]; i++)
+    query = g_list_append (query, g_strdup (strings[i]));
+  g_strfreev (strings);
+
+  priv->cancellable = g_cancellable_new ();
+  user_data->query_time = g_get_monotonic_time ();
+
+  ephy_history_service_find_urls (priv->history_service,
+                                  0, 0,
+                                  MAX_COMPLETION_HISTORY_URLS, 0,
+                                  query, priv->cancellable,
+                                  (EphyHistoryJobCallback)query_completed_cb,
+                                  user_data);
+}
+
+static gboolean
+query_timeout_cb (EphyCompletionModel *model)
+{
+  model->priv->query_timeout_id = 0;
+  start_history_query (model);
+
+  return FALSE;
+}
+
+static char **
+parse_search_terms (const char *text)
 {
   const char *current;
   const char *ptr;
-  char *tmp;
-  char *term;
-  GRegex *term_regex;
-  GRegex *quote_regex;
-  gint count;
+  GPtrArray *terms;
+  GString *term;
+  gint count, i;
   gboolean inside_quotes = FALSE;
-  EphyCompletionModelPrivate *priv = model->priv;
 
-  if (priv->search_terms) {
-    free_search_terms (priv->search_terms);
-    priv->search_terms = NULL;
-  }
+  terms = g_ptr_array_new ();
+  term = g_string_new (NULL);
 
-  quote_regex = g_regex_new ("\"", G_REGEX_OPTIMIZE,
-                             G_REGEX_MATCH_NOTEMPTY, NULL);
-    
   /*
    * This code loops through the string using pointer arythmetics.
    * Although the string we are handling may contain UTF-8 chars
@@ -503,25 +767,18 @@ update_search_terms (EphyCompletionModel *model,
        */
       if (ptr[1] == '\0')
         count++;
-        
-      /*
-       * remove quotes, and quote any regex-sensitive
-       * characters
-       */
-      tmp = g_regex_escape_string (current, count);
-      term = g_regex_replace (quote_regex, tmp, -1, 0,
-                              "", G_REGEX_MATCH_NOTEMPTY, NULL);
-      g_strstrip (term);
-      g_free (tmp);
 
-      /* we don't want empty search terms */
-      if (term[0] != '\0') {
-        term_regex = g_regex_new (term,
-                                  G_REGEX_CASELESS | G_REGEX_OPTIMIZE,
-                                  G_REGEX_MATCH_NOTEMPTY, NULL);
-        priv->search_terms = g_slist_append (priv->search_terms, term_regex);
+      /* remove quotes */
+      g_string_truncate (term, 0);
+      for (i = 0; i < count; i++) {
+        if (current[i] != '"')
+          g_string_append_c (term, current[i]);
       }
-      g_free (term);
+      g_strstrip (term->str);
+
+      /* we don't want empty search terms */
+      if (term->str[0] != '\0')
+        g_ptr_array_add (terms, fold_string (term->str));
 
       /* count will be incremented by the for loop */
       count = -1;
@@ -529,10 +786,11 @@ update_search_terms (EphyCompletionModel *model,
     }
   }
 
-  g_regex_unref (quote_regex);
-}
+  g_string_free (term, TRUE);
+  g_ptr_array_add (terms, NULL);
 
-#define MAX_COMPLETION_HISTORY_URLS 8
+  return (char **)g_ptr_array_free (terms, FALSE);
+}
 
 void
 ephy_completion_model_update_for_string (EphyCompletionModel *model,
@@ -541,42 +799,57 @@ ephy_completion_model_update_for_string (EphyCompletionModel *model,
                                          gpointer data)
 {
   EphyCompletionModelPrivate *priv;
-  char **strings;
-  int i;
-  GList *query = NULL;
   FindURLsData *user_data;
+  gboolean query_in_flight;
+  gint64 keystroke_time;
+  guint delay = 0;
 
   g_return_if_fail (EPHY_IS_COMPLETION_MODEL (model));
   g_return_if_fail (search_string != NULL);
 
   priv = model->priv;
+  keystroke_time = g_get_monotonic_time ();
 
-  /* Split the search string. */
-  strings = g_strsplit (search_string, " ", -1);
-  for (i = 0; strings[i]; i++)
-    query = g_list_append (query, g_strdup (strings[i]));
-  g_strfreev (strings);
+  g_strfreev (priv->search_terms);
+  priv->search_terms = parse_search_terms (search_string);
+
+  update_bookmark_matches (model, search_string);
+
+  query_in_flight = priv->pending_query != NULL;
+  cancel_pending_query (model);
 
-  update_search_terms (model, search_string);
+  if (priv->history_matches_complete && priv->history_search &&
+      g_str_has_prefix (search_string, priv->history_search)) {
+    filter_candidates (priv->history_matches, priv->search_terms);
+    g_free (priv->history_search);
+    priv->history_search = g_strdup (search_string);
+
+    update_model (model);
+
+    ephy_trace_counter ("Completion: in-memory refinement latency (us)",
+                        g_get_monotonic_time () - keystroke_time);
+
+    if (callback)
+      callback (priv->history_service, TRUE, NULL, data);
+    return;
+  }
 
   user_data = g_slice_new (FindURLsData);
   user_data->model = model;
   user_data->search_string = g_strdup (search_string);
   user_data->callback = callback;
   user_data->user_data = data;
+  user_data->keystroke_time = keystroke_time;
+  user_data->query_time = 0;
+  priv->pending_query = user_data;
 
-  if (priv->cancellable) {
-    g_cancellable_cancel (priv->cancellable);
-    g_object_unref (priv->cancellable);
-  }
-  priv->cancellable = g_cancellable_new ();
+  if (query_in_flight && priv->query_latency >= INSTANT_QUERY_LATENCY)
+    delay = MIN (priv->query_latency / G_TIME_SPAN_MILLISECOND, MAX_QUERY_DELAY_MS);
 
-  ephy_history_service_find_urls (priv->history_service,
-                                  0, 0,
-                                  MAX_COMPLETION_HISTORY_URLS, 0,
-                                  query, priv->cancellable,
-                                  (EphyHistoryJobCallback)query_completed_cb,
-                                  user_data);
+  if (delay == 0)
+    start_history_query (model);
+  else
+    priv->query_timeout_id = g_timeout_add (delay, (GSourceFunc)query_timeout_cb, model);
 }
 
 EphyCompletionModel *
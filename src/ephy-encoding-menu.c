@@ -122,7 +122,7 @@ update_encoding_menu_cb (GtkAction *dummy, EphyEncodingMenu *menu)
 	gboolean is_automatic = FALSE;
 	WebKitWebView *view;
 
-	START_PROFILER ("Rebuilding encoding menu")
+	ephy_trace_begin ("Rebuilding encoding menu");
 
 	/* FIXME: block the "activate" signal on the actions instead; needs to 
 	 * wait until g_signal_handlers_block_matched supports blocking
@@ -232,7 +232,7 @@ build_menu:
 
 	menu->priv->update_tag = FALSE;
 
-	STOP_PROFILER ("Rebuilding encoding menu")
+	ephy_trace_end ("Rebuilding encoding menu");
 }
 
 static void
@@ -370,6 +370,9 @@ ephy_location_controller_constructed (GObject *object)
 					    priv->location_entry,
 					    NULL);
 
+	ephy_location_entry_set_host_predictor (priv->location_entry,
+						EPHY_HOST_PREDICTOR (ephy_embed_shell_get_host_predictor (ephy_embed_shell_get_default ())));
+
 	add_completion_actions (controller, priv->location_entry);
 
 	sync_address (controller, NULL, widget);
@@ -659,29 +662,23 @@ compare_actions (gconstpointer a,
 {
 	EphyNode *node_a = (EphyNode *)a;
 	EphyNode *node_b = (EphyNode *)b;
-	const char *title1, *title2;
+	const char *key1, *key2;
 	int retval;
 
-	title1 = ephy_node_get_property_string (node_a, EPHY_NODE_BMK_PROP_TITLE);
-	title2 = ephy_node_get_property_string (node_b, EPHY_NODE_BMK_PROP_TITLE);
+	key1 = ephy_node_get_property_casefold_key (node_a, EPHY_NODE_BMK_PROP_TITLE);
+	key2 = ephy_node_get_property_casefold_key (node_b, EPHY_NODE_BMK_PROP_TITLE);
 
-	if (title1 == NULL)
+	if (key1 == NULL)
 	{
 		retval = -1;
 	}
-	else if (title2 == NULL)
+	else if (key2 == NULL)
 	{
 		retval = 1;
 	}
 	else
 	{
-		char *str_a, *str_b;
-
-		str_a = g_utf8_casefold (title1, -1);
-		str_b = g_utf8_casefold (title2, -1);
-		retval = g_utf8_collate (str_a, str_b);
-		g_free (str_a);
-		g_free (str_b);
+		retval = strcmp (key1, key2);
 	}
 
 	return retval;
@@ -244,6 +244,8 @@ main (int argc,
   int status;
   EphyFileHelpersFlags flags;
 
+  ephy_trace_milestone ("main");
+
 #ifdef ENABLE_NLS
   /* Initialize the i18n stuff */
   bindtextdomain (GETTEXT_PACKAGE, GNOMELOCALEDIR);
@@ -30,7 +30,7 @@
 #include "ephy-embed-prefs.h"
 #include "ephy-embed-shell.h"
 #include "ephy-embed-utils.h"
-#include "ephy-favicon-helpers.h"
+#include "ephy-favicon-cache.h"
 #include "ephy-gui.h"
 #include "ephy-history-service.h"
 #include "ephy-link.h"
@@ -271,18 +271,9 @@ icon_loaded_cb (GObject *source,
                 GAsyncResult *result,
                 GtkImageMenuItem *item)
 {
-  WebKitFaviconDatabase *database = WEBKIT_FAVICON_DATABASE (source);
-  GdkPixbuf *favicon = NULL;
+  GdkPixbuf *favicon;
 
-#ifdef HAVE_WEBKIT2
-  cairo_surface_t *icon_surface = webkit_favicon_database_get_favicon_finish (database, result, NULL);
-  if (icon_surface) {
-    favicon = ephy_pixbuf_get_from_surface_scaled (icon_surface, FAVICON_SIZE, FAVICON_SIZE);
-    cairo_surface_destroy (icon_surface);
-  }
-#else
-  favicon = webkit_favicon_database_get_favicon_pixbuf_finish (database, result, NULL);
-#endif
+  favicon = ephy_favicon_cache_get_favicon_finish (EPHY_FAVICON_CACHE (source), result, NULL);
 
   if (favicon) {
     GtkWidget *image;
@@ -304,10 +295,6 @@ new_history_menu_item (EphyWebView *view,
 {
   GtkWidget *item;
   GtkLabel *label;
-  WebKitFaviconDatabase* database;
-#ifndef HAVE_WEBKIT2
-  GdkPixbuf *favicon;
-#endif
 
   g_return_val_if_fail (address != NULL && origtext != NULL, NULL);
 
@@ -317,32 +304,10 @@ new_history_menu_item (EphyWebView *view,
   gtk_label_set_ellipsize (label, PANGO_ELLIPSIZE_END);
   gtk_label_set_max_width_chars (label, MAX_LABEL_LENGTH);
 
-#ifdef HAVE_WEBKIT2
-  database = webkit_web_context_get_favicon_database (webkit_web_context_get_default ());
-  webkit_favicon_database_get_favicon (database, address,
-                                       NULL,
-                                       (GAsyncReadyCallback)icon_loaded_cb,
-                                       g_object_ref (item));
-#else
-  database = webkit_get_favicon_database ();
-  favicon = webkit_favicon_database_try_get_favicon_pixbuf (database, address,
-                                                            FAVICON_SIZE, FAVICON_SIZE);
-
-  if (favicon) {
-    GtkWidget *image;
-
-    image = gtk_image_new_from_pixbuf (favicon);
-    gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (item), image);
-    gtk_image_menu_item_set_always_show_image (GTK_IMAGE_MENU_ITEM (item), TRUE);
-
-    g_object_unref (favicon);
-  } else {
-    webkit_favicon_database_get_favicon_pixbuf (database, address,
-                                                FAVICON_SIZE, FAVICON_SIZE, NULL,
-                                                (GAsyncReadyCallback) icon_loaded_cb,
-                                                GTK_IMAGE_MENU_ITEM (g_object_ref (item)));
-  }
-#endif
+  ephy_favicon_cache_get_favicon_async (ephy_favicon_cache_get_default (),
+                                        address, FAVICON_SIZE, NULL,
+                                        (GAsyncReadyCallback)icon_loaded_cb,
+                                        g_object_ref (item));
 
   g_object_set_data_full (G_OBJECT (item), "link-message", g_strdup (address), (GDestroyNotify) g_free);
 
@@ -65,6 +65,10 @@ void                     _ephy_shell_create_instance          (EphyEmbedShellMod
 
 /* EphySession */
 
+/* Bytes of navigation state kept for closed tabs, in memory and in
+ * the session file. The oldest closed tabs are dropped first. */
+#define EPHY_SESSION_CLOSED_TABS_BUDGET (512 * 1024)
+
 void                     ephy_session_clear                   (EphySession *session);
 
 #endif
@@ -43,6 +43,11 @@
 #include <libxml/tree.h>
 #include <libxml/xmlwriter.h>
 
+/* WebKit2 can save and restore the whole back/forward list. */
+#if defined (HAVE_WEBKIT2) && WEBKIT_CHECK_VERSION (2, 7, 1)
+#define HAVE_WEBKIT_SESSION_STATE 1
+#endif
+
 #define EPHY_SESSION_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), EPHY_TYPE_SESSION, EphySessionPrivate))
 
 typedef struct
@@ -50,18 +55,26 @@ typedef struct
 	gpointer* parent_location;
 	int position;
 	char *url;
-	GList *bflist;
+	/* "(ua(ss))": index of the current entry and the (uri, title)
+	 * pairs of the whole back/forward list, oldest first. */
+	GVariant *state;
+#ifdef HAVE_WEBKIT_SESSION_STATE
+	/* Serialized WebKitWebViewSessionState, used instead of the
+	 * above to restore the list when available. */
+	GBytes *session_state;
+#endif
 } ClosedTab;
 
 struct _EphySessionPrivate
 {
 	GQueue *closed_tabs;
+	gsize closed_tabs_size;
 	GCancellable *save_cancellable;
 	guint dont_save : 1;
 };
 
 #define SESSION_STATE		"type:session_state"
-#define MAX_CLOSED_TABS		10
+#define CLOSED_TAB_STATE_TYPE	"(ua(ss))"
 
 enum
 {
@@ -144,7 +157,10 @@ parent_location_new (EphyNotebook *notebook)
 {
 	gpointer *location = g_slice_new (gpointer);
 	*location = notebook;
-	g_object_add_weak_pointer (G_OBJECT (notebook), location);
+	/* Tabs restored from a session file may belong to a window
+	 * that no longer exists. */
+	if (notebook)
+		g_object_add_weak_pointer (G_OBJECT (notebook), location);
 
 	return location;
 }
@@ -163,14 +179,98 @@ parent_location_free (gpointer *location, gboolean last_reference)
 	g_slice_free (gpointer, location);
 }
 
+static GVariant *
+closed_tab_state_new (EphyWebView *view)
+{
+#ifdef HAVE_WEBKIT2
+	WebKitBackForwardList *list;
+	WebKitBackForwardListItem *item;
+#else
+	WebKitWebBackForwardList *list;
+	WebKitWebHistoryItem *item;
+#endif
+	GVariantBuilder builder;
+	GList *back, *forward;
+	int n_back, n_forward, i;
+
+	list = webkit_web_view_get_back_forward_list (WEBKIT_WEB_VIEW (view));
+#ifdef HAVE_WEBKIT2
+	back = webkit_back_forward_list_get_back_list_with_limit (list, EPHY_WEBKIT_BACK_FORWARD_LIMIT);
+	forward = webkit_back_forward_list_get_forward_list_with_limit (list, EPHY_WEBKIT_BACK_FORWARD_LIMIT);
+#else
+	back = webkit_web_back_forward_list_get_back_list_with_limit (list, EPHY_WEBKIT_BACK_FORWARD_LIMIT);
+	forward = webkit_web_back_forward_list_get_forward_list_with_limit (list, EPHY_WEBKIT_BACK_FORWARD_LIMIT);
+#endif
+	n_back = g_list_length (back);
+	n_forward = g_list_length (forward);
+	g_list_free (back);
+	g_list_free (forward);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ss)"));
+	for (i = -n_back; i <= n_forward; i++)
+	{
+		const char *uri, *title;
+
+		if (i == 0)
+		{
+			/* The list may not have an item for the current
+			 * page yet, e.g. while it is still loading. */
+			uri = ephy_web_view_get_address (view);
+			title = ephy_web_view_get_title (view);
+		}
+		else
+		{
+#ifdef HAVE_WEBKIT2
+			item = webkit_back_forward_list_get_nth_item (list, i);
+			uri = item ? webkit_back_forward_list_item_get_uri (item) : NULL;
+			title = item ? webkit_back_forward_list_item_get_title (item) : NULL;
+#else
+			item = webkit_web_back_forward_list_get_nth_item (list, i);
+			uri = item ? webkit_web_history_item_get_uri (item) : NULL;
+			title = item ? webkit_web_history_item_get_title (item) : NULL;
+#endif
+		}
+
+		g_variant_builder_add (&builder, "(ss)",
+				       uri ? uri : "", title ? title : "");
+	}
+
+	return g_variant_ref_sink (g_variant_new (CLOSED_TAB_STATE_TYPE, (guint) n_back, &builder));
+}
+
+static gsize
+closed_tab_get_size (ClosedTab *tab)
+{
+	gsize size = sizeof (ClosedTab);
+
+	if (tab->url)
+		size += strlen (tab->url) + 1;
+	if (tab->state)
+		size += g_variant_get_size (tab->state);
+#ifdef HAVE_WEBKIT_SESSION_STATE
+	if (tab->session_state)
+		size += g_bytes_get_size (tab->session_state);
+#endif
+
+	return size;
+}
+
 static void
 closed_tab_free (ClosedTab *tab)
 {
-	if (tab->bflist)
+	if (tab->state)
+	{
+		g_variant_unref (tab->state);
+		tab->state = NULL;
+	}
+
+#ifdef HAVE_WEBKIT_SESSION_STATE
+	if (tab->session_state)
 	{
-		g_list_free_full (tab->bflist, g_object_unref);
-		tab->bflist = NULL;
+		g_bytes_unref (tab->session_state);
+		tab->session_state = NULL;
 	}
+#endif
 
 	if (tab->url)
 	{
@@ -194,10 +294,24 @@ find_tab_with_notebook (GQueue *queue, EphyNotebook *notebook)
 	return item ? (ClosedTab*)item->data : NULL;
 }
 
+static gboolean
+parent_location_is_used (GQueue *queue, gpointer *location)
+{
+	GList *l;
+
+	for (l = queue->head; l; l = l->next)
+	{
+		if (((ClosedTab *)l->data)->parent_location == location)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
 static ClosedTab *
 closed_tab_new (GQueue *closed_tabs,
 		const char *address,
-		GList *bflist,
+		GVariant *state,
 		int position,
 		EphyNotebook *parent_notebook)
 {
@@ -205,9 +319,7 @@ closed_tab_new (GQueue *closed_tabs,
 	ClosedTab *sibling_tab;
 
 	tab->url = g_strdup (address);
-#ifndef HAVE_WEBKIT2
-	tab->bflist = g_list_copy_deep (bflist, (GCopyFunc)webkit_web_history_item_copy, NULL);
-#endif
+	tab->state = g_variant_ref (state);
 	tab->position = position;
 
 	sibling_tab = find_tab_with_notebook (closed_tabs, parent_notebook);
@@ -219,6 +331,29 @@ closed_tab_new (GQueue *closed_tabs,
 	return tab;
 }
 
+static void
+closed_tabs_pop_tail (EphySession *session)
+{
+	EphySessionPrivate *priv = session->priv;
+	ClosedTab *tab;
+
+	tab = g_queue_pop_tail (priv->closed_tabs);
+	if (tab == NULL)
+		return;
+
+	priv->closed_tabs_size -= closed_tab_get_size (tab);
+
+	if (tab->parent_location && !parent_location_is_used (priv->closed_tabs, tab->parent_location))
+	{
+		parent_location_free (tab->parent_location, TRUE);
+	}
+
+	LOG ("Evicted: %s from the list (%" G_GSIZE_FORMAT " bytes left)",
+	     tab->url, priv->closed_tabs_size);
+
+	closed_tab_free (tab);
+}
+
 static void
 post_restore_cleanup (GQueue *closed_tabs, ClosedTab *restored_tab, gboolean notebook_is_new)
 {
@@ -245,18 +380,71 @@ post_restore_cleanup (GQueue *closed_tabs, ClosedTab *restored_tab, gboolean not
 	}
 }
 
+#ifdef HAVE_WEBKIT_SESSION_STATE
+static gboolean
+closed_tab_restore_session_state (ClosedTab *tab,
+				  EphyEmbed *embed)
+{
+	WebKitWebView *view = EPHY_GET_WEBKIT_WEB_VIEW_FROM_EMBED (embed);
+	WebKitWebViewSessionState *state;
+	WebKitBackForwardListItem *item;
+
+	state = webkit_web_view_session_state_new (tab->session_state);
+	if (state == NULL)
+		return FALSE;
+
+	webkit_web_view_restore_session_state (view, state);
+	webkit_web_view_session_state_unref (state);
+
+	/* Only the list is restored, the current item has to be loaded
+	 * from it so that no entry is added. */
+	item = webkit_back_forward_list_get_current_item (webkit_web_view_get_back_forward_list (view));
+	if (item == NULL)
+		return FALSE;
+
+	webkit_web_view_go_to_back_forward_list_item (view, item);
+
+	return TRUE;
+}
+#endif
+
+#ifndef HAVE_WEBKIT2
+static void
+closed_tab_restore_history (ClosedTab *tab,
+			    EphyEmbed *embed)
+{
+	WebKitWebBackForwardList *dest;
+	GVariantIter *iter;
+	const char *uri, *title;
+	guint current, i;
+
+	/* Only the back entries can be recreated: adding an item makes it
+	 * the current one, and the page being loaded will be appended after
+	 * them. None of these items is loaded until the user goes back. */
+	dest = webkit_web_view_get_back_forward_list (EPHY_GET_WEBKIT_WEB_VIEW_FROM_EMBED (embed));
+
+	g_variant_get (tab->state, CLOSED_TAB_STATE_TYPE, &current, &iter);
+	for (i = 0; i < current && g_variant_iter_next (iter, "(&s&s)", &uri, &title); i++)
+	{
+		WebKitWebHistoryItem *item;
+
+		LOG ("ADDING TO BF: %s", title);
+		item = webkit_web_history_item_new_with_data (uri, title);
+		webkit_web_back_forward_list_add_item (dest, item);
+		g_object_unref (item);
+	}
+	g_variant_iter_free (iter);
+}
+#endif
+
 void
 ephy_session_undo_close_tab (EphySession *session)
 {
 	EphySessionPrivate *priv;
 	EphyEmbed *embed, *new_tab;
 	ClosedTab *tab;
-#ifndef HAVE_WEBKIT2
-	WebKitWebBackForwardList *dest;
-	GList *i;
-#endif
-	EphyNewTabFlags flags = EPHY_NEW_TAB_OPEN_PAGE
-		| EPHY_NEW_TAB_PRESENT_WINDOW
+	const char *url;
+	EphyNewTabFlags flags = EPHY_NEW_TAB_PRESENT_WINDOW
 		| EPHY_NEW_TAB_JUMP
 		| EPHY_NEW_TAB_DONT_COPY_HISTORY;
 
@@ -268,7 +456,19 @@ ephy_session_undo_close_tab (EphySession *session)
 	if (tab == NULL)
 		return;
 
+	priv->closed_tabs_size -= closed_tab_get_size (tab);
+
 	LOG ("UNDO CLOSE TAB: %s", tab->url);
+
+	/* With a saved back/forward list, the page is loaded from it. */
+	url = tab->url;
+#ifdef HAVE_WEBKIT_SESSION_STATE
+	if (tab->session_state)
+		url = NULL;
+#endif
+	if (url)
+		flags |= EPHY_NEW_TAB_OPEN_PAGE;
+
 	if (*tab->parent_location != NULL)
 	{
 		GtkWidget *window;
@@ -291,7 +491,7 @@ ephy_session_undo_close_tab (EphySession *session)
 
 		window = gtk_widget_get_toplevel (GTK_WIDGET (*tab->parent_location));
 		new_tab = ephy_shell_new_tab (ephy_shell_get_default (),
-					      EPHY_WINDOW (window), embed, tab->url,
+					      EPHY_WINDOW (window), embed, url,
 					      flags);
 		post_restore_cleanup (priv->closed_tabs, tab, FALSE);
 	}
@@ -300,7 +500,7 @@ ephy_session_undo_close_tab (EphySession *session)
 		EphyNotebook *notebook;
 		flags |=  EPHY_NEW_TAB_IN_NEW_WINDOW;
 		new_tab = ephy_shell_new_tab (ephy_shell_get_default (),
-					      NULL, NULL, tab->url, flags);
+					      NULL, NULL, url, flags);
 
 		/* FIXME: This makes the assumption that the notebook
 		   is the parent of the returned EphyEmbed. */
@@ -309,17 +509,11 @@ ephy_session_undo_close_tab (EphySession *session)
 		post_restore_cleanup (priv->closed_tabs, tab, TRUE);
 	}
 
-	/* This is deficient: we need to recreate the whole
-	 * BackForward list. Also, WebKit2 doesn't have this API. */
-#ifndef HAVE_WEBKIT2
-	dest = webkit_web_view_get_back_forward_list (EPHY_GET_WEBKIT_WEB_VIEW_FROM_EMBED (new_tab));
-	for (i = tab->bflist; i; i = i->next)
-	{
-		LOG ("ADDING TO BF: %s",
-		     webkit_web_history_item_get_title ((WebKitWebHistoryItem*) i->data));
-		webkit_web_back_forward_list_add_item (dest,
-						       webkit_web_history_item_copy ((WebKitWebHistoryItem*) i->data));
-	}
+#ifdef HAVE_WEBKIT_SESSION_STATE
+	if (url == NULL && !closed_tab_restore_session_state (tab, new_tab))
+		ephy_web_view_load_url (ephy_embed_get_web_view (new_tab), tab->url);
+#elif !defined (HAVE_WEBKIT2)
+	closed_tab_restore_history (tab, new_tab);
 #endif
 	closed_tab_free (tab);
 
@@ -336,49 +530,45 @@ ephy_session_tab_closed (EphySession *session,
 	EphySessionPrivate *priv = session->priv;
 	EphyWebView *view;
 	const char *address;
-#ifdef HAVE_WEBKIT2
-	WebKitBackForwardList *source;
-#else
-	WebKitWebBackForwardList *source;
-#endif
+	GVariant *state;
 	ClosedTab *tab;
-	GList *items = NULL;
 
 	view = ephy_embed_get_web_view (embed);
 	address = ephy_web_view_get_address (view);
 
-	source = webkit_web_view_get_back_forward_list (WEBKIT_WEB_VIEW (view));
-#ifdef HAVE_WEBKIT2
-	items = webkit_back_forward_list_get_back_list_with_limit (source, EPHY_WEBKIT_BACK_FORWARD_LIMIT);
-#else
-	items = webkit_web_back_forward_list_get_back_list_with_limit (source, EPHY_WEBKIT_BACK_FORWARD_LIMIT);
-#endif
-	if (items == NULL && g_strcmp0 (address, "ephy-about:overview") == 0)
+	if (!webkit_web_view_can_go_back (WEBKIT_WEB_VIEW (view)) &&
+	    g_strcmp0 (address, "ephy-about:overview") == 0)
 		return;
 
-	if (g_queue_get_length (priv->closed_tabs) == MAX_CLOSED_TABS)
+	state = closed_tab_state_new (view);
+	tab = closed_tab_new (priv->closed_tabs, address, state, position, notebook);
+	g_variant_unref (state);
+
+#ifdef HAVE_WEBKIT_SESSION_STATE
 	{
-		tab = g_queue_pop_tail (priv->closed_tabs);
-		if (tab->parent_location && !find_tab_with_notebook (priv->closed_tabs, *tab->parent_location))
-		{
-			parent_location_free (tab->parent_location, TRUE);
-		}
+		WebKitWebViewSessionState *session_state;
 
-		closed_tab_free (tab);
-		tab = NULL;
+		/* Not the web view's: a hibernated tab shows a placeholder */
+		session_state = ephy_embed_get_session_state (embed);
+		tab->session_state = webkit_web_view_session_state_serialize (session_state);
+		webkit_web_view_session_state_unref (session_state);
 	}
-
-	items = g_list_reverse (items);
-	tab = closed_tab_new (priv->closed_tabs, address, items, position, notebook);
-	g_list_free (items);
+#endif
 
 	g_queue_push_head (priv->closed_tabs, tab);
+	priv->closed_tabs_size += closed_tab_get_size (tab);
+
+	/* Make room for the new tab by dropping the oldest ones, but always
+	 * keep the most recently closed tab, however big its history is. */
+	while (priv->closed_tabs_size > EPHY_SESSION_CLOSED_TABS_BUDGET &&
+	       g_queue_get_length (priv->closed_tabs) > 1)
+		closed_tabs_pop_tail (session);
 
 	if (g_queue_get_length (priv->closed_tabs) == 1)
 		g_object_notify (G_OBJECT (session), "can-undo-tab-closed");
 
-	LOG ("Added: %s to the list (%d elements)",
-	     address, g_queue_get_length (priv->closed_tabs));
+	LOG ("Added: %s to the list (%d elements, %" G_GSIZE_FORMAT " bytes)",
+	     address, g_queue_get_length (priv->closed_tabs), priv->closed_tabs_size);
 }
 
 gboolean
@@ -410,8 +600,6 @@ notebook_page_removed_cb (GtkWidget *notebook,
 			  guint position,
 			  EphySession *session)
 {
-	ephy_session_save (session, SESSION_STATE);
-
 #ifdef HAVE_WEBKIT2
 	g_signal_handlers_disconnect_by_func
 		(ephy_embed_get_web_view (embed), G_CALLBACK (load_changed_cb),
@@ -422,6 +610,9 @@ notebook_page_removed_cb (GtkWidget *notebook,
 		 session);
 #endif
 	ephy_session_tab_closed (session, EPHY_NOTEBOOK (notebook), embed, position);
+
+	/* Save after the tab is in the closed tabs list, so it's restored too. */
+	ephy_session_save (session, SESSION_STATE);
 }
 
 static void
@@ -610,25 +801,27 @@ typedef struct {
 	gboolean loading;
 } SessionTab;
 
+static char *
+get_address_to_save (const char *address)
+{
+	/* Do not store ephy-about: URIs, they are not valid for loading. */
+	if (address && g_str_has_prefix (address, EPHY_ABOUT_SCHEME))
+	{
+		return g_strconcat ("about", address + EPHY_ABOUT_SCHEME_LEN, NULL);
+	}
+
+	return g_strdup (address);
+}
+
 static SessionTab *
 session_tab_new (EphyEmbed *embed)
 {
 	SessionTab *session_tab;
-	const char *address;
 	EphyWebView *web_view = ephy_embed_get_web_view (embed);
 
 	session_tab = g_slice_new (SessionTab);
 
-	address = ephy_web_view_get_address (web_view);
-	/* Do not store ephy-about: URIs, they are not valid for loading. */
-	if (g_str_has_prefix (address, EPHY_ABOUT_SCHEME))
-	{
-		session_tab->url = g_strconcat ("about", address + EPHY_ABOUT_SCHEME_LEN, NULL);
-	}
-	else
-	{
-		session_tab->url = g_strdup (address);
-	}
+	session_tab->url = get_address_to_save (ephy_web_view_get_address (web_view));
 
 	session_tab->title = g_strdup (ephy_web_view_get_title (web_view));
 	session_tab->loading = ephy_web_view_is_loading (web_view) && !ephy_embed_has_load_pending (embed);
@@ -698,13 +891,106 @@ session_window_free (SessionWindow *session_window)
 	g_slice_free (SessionWindow, session_window);
 }
 
+typedef struct {
+	char *url;
+	int position;
+	/* Index of the saved window the tab was closed in, or -1 if that
+	 * window is gone. Tabs closed together in a window that is gone
+	 * share the same closed_window instead. */
+	int window;
+	int closed_window;
+	GVariant *state;
+#ifdef HAVE_WEBKIT_SESSION_STATE
+	GBytes *session_state;
+#endif
+} SessionClosedTab;
+
+static SessionClosedTab *
+session_closed_tab_new (ClosedTab *tab,
+			int window,
+			int closed_window)
+{
+	SessionClosedTab *session_closed_tab;
+
+	session_closed_tab = g_slice_new (SessionClosedTab);
+	session_closed_tab->url = get_address_to_save (tab->url);
+	session_closed_tab->position = tab->position;
+	session_closed_tab->window = window;
+	session_closed_tab->closed_window = closed_window;
+	session_closed_tab->state = g_variant_ref (tab->state);
+#ifdef HAVE_WEBKIT_SESSION_STATE
+	session_closed_tab->session_state = tab->session_state ? g_bytes_ref (tab->session_state) : NULL;
+#endif
+
+	return session_closed_tab;
+}
+
+static void
+session_closed_tab_free (SessionClosedTab *tab)
+{
+	g_free (tab->url);
+	g_variant_unref (tab->state);
+#ifdef HAVE_WEBKIT_SESSION_STATE
+	if (tab->session_state)
+		g_bytes_unref (tab->session_state);
+#endif
+
+	g_slice_free (SessionClosedTab, tab);
+}
+
 typedef struct {
 	EphySession *session;
 	GFile *save_file;
 
 	GList *windows;
+	GList *closed_tabs;
 } SaveData;
 
+static GList *
+closed_tabs_snapshot (EphySession *session,
+		      GList *saved_windows)
+{
+	GHashTable *closed_windows;
+	GList *closed_tabs = NULL, *l;
+
+	/* The state blobs are immutable, so the tabs only take a
+	 * reference on them to be written from the saving thread. */
+	closed_windows = g_hash_table_new (NULL, NULL);
+	for (l = session->priv->closed_tabs->head; l != NULL; l = l->next)
+	{
+		ClosedTab *tab = (ClosedTab *) l->data;
+		int window = -1, closed_window = -1;
+
+		if (tab->url == NULL)
+			continue;
+
+		if (*tab->parent_location != NULL)
+		{
+			GtkWidget *toplevel = gtk_widget_get_toplevel (GTK_WIDGET (*tab->parent_location));
+
+			window = g_list_index (saved_windows, toplevel);
+		}
+
+		if (window == -1)
+		{
+			gpointer id;
+
+			if (!g_hash_table_lookup_extended (closed_windows, tab->parent_location, NULL, &id))
+			{
+				id = GINT_TO_POINTER (g_hash_table_size (closed_windows));
+				g_hash_table_insert (closed_windows, tab->parent_location, id);
+			}
+			closed_window = GPOINTER_TO_INT (id);
+		}
+
+		closed_tabs = g_list_prepend (closed_tabs,
+					      session_closed_tab_new (tab, window, closed_window));
+	}
+	g_hash_table_destroy (closed_windows);
+
+	return g_list_reverse (closed_tabs);
+}
+
 static SaveData *
 save_data_new (EphySession *session,
 	       const char *filename)
@@ -712,6 +998,7 @@ save_data_new (EphySession *session,
 	SaveData *data;
 	EphyShell *shell = ephy_shell_get_default ();
 	GList *windows, *w;
+	GList *saved_windows = NULL;
 
 	data = g_slice_new0 (SaveData);
 	data->session = g_object_ref (session);
@@ -724,9 +1011,16 @@ save_data_new (EphySession *session,
 
 		session_window = session_window_new (EPHY_WINDOW (w->data));
 		if (session_window)
+		{
 			data->windows = g_list_prepend (data->windows, session_window);
+			saved_windows = g_list_prepend (saved_windows, w->data);
+		}
 	}
 	data->windows = g_list_reverse (data->windows);
+	saved_windows = g_list_reverse (saved_windows);
+
+	data->closed_tabs = closed_tabs_snapshot (session, saved_windows);
+	g_list_free (saved_windows);
 
 	return data;
 }
@@ -735,6 +1029,7 @@ static void
 save_data_free (SaveData *data)
 {
 	g_list_free_full (data->windows, (GDestroyNotify)session_window_free);
+	g_list_free_full (data->closed_tabs, (GDestroyNotify)session_closed_tab_free);
 
 	g_object_unref (data->save_file);
 	g_object_unref (data->session);
@@ -832,6 +1127,79 @@ write_ephy_window (xmlTextWriterPtr writer,
 	return ret;
 }
 
+static int
+write_closed_tab (xmlTextWriterPtr writer,
+		  SessionClosedTab *tab)
+{
+	GVariantIter *iter;
+	const char *uri, *title;
+	guint current;
+	int ret;
+
+	ret = xmlTextWriterStartElement (writer, (xmlChar *) "closed-tab");
+	if (ret < 0) return ret;
+
+	ret = xmlTextWriterWriteAttribute (writer, (xmlChar *) "url",
+					   (const xmlChar *) tab->url);
+	if (ret < 0) return ret;
+
+	ret = xmlTextWriterWriteFormatAttribute (writer, (const xmlChar *) "position", "%d",
+						 tab->position);
+	if (ret < 0) return ret;
+
+	if (tab->window >= 0)
+	{
+		ret = xmlTextWriterWriteFormatAttribute (writer, (const xmlChar *) "window", "%d",
+							 tab->window);
+	}
+	else
+	{
+		ret = xmlTextWriterWriteFormatAttribute (writer, (const xmlChar *) "closed-window", "%d",
+							 tab->closed_window);
+	}
+	if (ret < 0) return ret;
+
+#ifdef HAVE_WEBKIT_SESSION_STATE
+	if (tab->session_state)
+	{
+		char *encoded;
+
+		encoded = g_base64_encode (g_bytes_get_data (tab->session_state, NULL),
+					   g_bytes_get_size (tab->session_state));
+		ret = xmlTextWriterWriteAttribute (writer, (xmlChar *) "session-state",
+						   (const xmlChar *) encoded);
+		g_free (encoded);
+		if (ret < 0) return ret;
+	}
+#endif
+
+	g_variant_get (tab->state, CLOSED_TAB_STATE_TYPE, &current, &iter);
+
+	ret = xmlTextWriterWriteFormatAttribute (writer, (const xmlChar *) "current", "%u",
+						 current);
+
+	while (ret >= 0 && g_variant_iter_next (iter, "(&s&s)", &uri, &title))
+	{
+		ret = xmlTextWriterStartElement (writer, (xmlChar *) "entry");
+		if (ret < 0) break;
+
+		ret = xmlTextWriterWriteAttribute (writer, (xmlChar *) "url",
+						   (const xmlChar *) uri);
+		if (ret < 0) break;
+
+		ret = xmlTextWriterWriteAttribute (writer, (xmlChar *) "title",
+						   (const xmlChar *) title);
+		if (ret < 0) break;
+
+		ret = xmlTextWriterEndElement (writer); /* entry */
+	}
+	g_variant_iter_free (iter);
+	if (ret < 0) return ret;
+
+	ret = xmlTextWriterEndElement (writer); /* closed-tab */
+	return ret;
+}
+
 static void
 save_session_in_thread_cb (GObject *source_object,
 			   GAsyncResult *res,
@@ -852,6 +1220,8 @@ save_session_sync (GTask *task,
 	GList *w;
 	int ret = -1;
 
+	ephy_trace_begin ("Saving session");
+
 	buffer = xmlBufferCreate ();
 	writer = xmlNewTextWriterMemory (buffer, 0);
 	if (writer == NULL) goto out;
@@ -862,8 +1232,6 @@ save_session_sync (GTask *task,
 	ret = xmlTextWriterSetIndentString (writer, (const xmlChar *) "	 ");
 	if (ret < 0) goto out;
 
-	START_PROFILER ("Saving session")
-
 	ret = xmlTextWriterStartDocument (writer, "1.0", NULL, NULL);
 	if (ret < 0) goto out;
 
@@ -878,6 +1246,13 @@ save_session_sync (GTask *task,
 	}
 	if (ret < 0) goto out;
 
+	/* most recently closed first */
+	for (w = data->closed_tabs; w != NULL && ret >= 0; w = w->next)
+	{
+		ret = write_closed_tab (writer, (SessionClosedTab *) w->data);
+	}
+	if (ret < 0) goto out;
+
 	ret = xmlTextWriterEndElement (writer); /* session */
 	if (ret < 0) goto out;
 
@@ -909,7 +1284,7 @@ out:
 
 	g_task_return_boolean (task, TRUE);
 
-	STOP_PROFILER ("Saving session")
+	ephy_trace_end ("Saving session");
 }
 
 void
@@ -996,6 +1371,19 @@ typedef struct {
 	gint active_tab;
 
 	gboolean is_first_tab;
+
+	/* Restored windows, in the order they were saved. */
+	GPtrArray *windows;
+	/* Parent locations shared by the tabs of a closed window. */
+	GHashTable *closed_windows;
+
+	ClosedTab *closed_tab;
+	int closed_tab_window;
+	int closed_tab_closed_window;
+	guint closed_tab_current;
+	guint closed_tab_n_entries;
+	GVariantBuilder *closed_tab_entries;
+	gboolean closed_tabs_full;
 } SessionParserContext;
 
 static SessionParserContext *
@@ -1008,6 +1396,8 @@ session_parser_context_new (EphySession *session,
 	context->session = g_object_ref (session);
 	context->user_time = user_time;
 	context->is_first_window = TRUE;
+	context->windows = g_ptr_array_new_with_free_func (g_object_unref);
+	context->closed_windows = g_hash_table_new (NULL, NULL);
 
 	return context;
 }
@@ -1015,6 +1405,13 @@ session_parser_context_new (EphySession *session,
 static void
 session_parser_context_free (SessionParserContext *context)
 {
+	if (context->closed_tab)
+		closed_tab_free (context->closed_tab);
+	if (context->closed_tab_entries)
+		g_variant_builder_unref (context->closed_tab_entries);
+
+	g_hash_table_destroy (context->closed_windows);
+	g_ptr_array_free (context->windows, TRUE);
 	g_object_unref (context->session);
 
 	g_slice_free (SessionParserContext, context);
@@ -1144,6 +1541,184 @@ session_parse_embed (SessionParserContext *context,
 	}
 }
 
+static void
+session_parse_closed_tab (SessionParserContext *context,
+			  const gchar **names,
+			  const gchar **values)
+{
+	guint i;
+
+	if (context->closed_tab)
+		return;
+
+	context->closed_tab = g_slice_new0 (ClosedTab);
+	context->closed_tab_window = -1;
+	context->closed_tab_closed_window = -1;
+	context->closed_tab_current = 0;
+	context->closed_tab_n_entries = 0;
+	context->closed_tab_entries = g_variant_builder_new (G_VARIANT_TYPE ("a(ss)"));
+
+	for (i = 0; names[i]; i++)
+	{
+		gulong int_value;
+
+		if (strcmp (names[i], "url") == 0)
+		{
+			g_free (context->closed_tab->url);
+			context->closed_tab->url = g_strdup (values[i]);
+		}
+		else if (strcmp (names[i], "position") == 0)
+		{
+			ephy_string_to_int (values[i], &int_value);
+			context->closed_tab->position = int_value;
+		}
+		else if (strcmp (names[i], "window") == 0)
+		{
+			ephy_string_to_int (values[i], &int_value);
+			context->closed_tab_window = int_value;
+		}
+		else if (strcmp (names[i], "closed-window") == 0)
+		{
+			ephy_string_to_int (values[i], &int_value);
+			context->closed_tab_closed_window = int_value;
+		}
+		else if (strcmp (names[i], "current") == 0)
+		{
+			ephy_string_to_int (values[i], &int_value);
+			context->closed_tab_current = int_value;
+		}
+#ifdef HAVE_WEBKIT_SESSION_STATE
+		else if (strcmp (names[i], "session-state") == 0)
+		{
+			guchar *data;
+			gsize length;
+
+			data = g_base64_decode (values[i], &length);
+			if (context->closed_tab->session_state)
+				g_bytes_unref (context->closed_tab->session_state);
+			context->closed_tab->session_state = g_bytes_new_take (data, length);
+		}
+#endif
+	}
+}
+
+static void
+session_parse_closed_tab_entry (SessionParserContext *context,
+				const gchar **names,
+				const gchar **values)
+{
+	const char *url = NULL;
+	const char *title = NULL;
+	guint i;
+
+	if (context->closed_tab == NULL)
+		return;
+
+	for (i = 0; names[i]; i++)
+	{
+		if (strcmp (names[i], "url") == 0)
+		{
+			url = values[i];
+		}
+		else if (strcmp (names[i], "title") == 0)
+		{
+			title = values[i];
+		}
+	}
+
+	g_variant_builder_add (context->closed_tab_entries, "(ss)",
+			       url ? url : "", title ? title : "");
+	context->closed_tab_n_entries++;
+}
+
+static gpointer *
+session_closed_tab_get_parent_location (SessionParserContext *context)
+{
+	EphySessionPrivate *priv = context->session->priv;
+	GtkWidget *notebook = NULL;
+	gpointer *location;
+	ClosedTab *sibling_tab;
+
+	if (context->closed_tab_window >= 0 &&
+	    context->closed_tab_window < (int) context->windows->len)
+	{
+		notebook = ephy_window_get_notebook (g_ptr_array_index (context->windows,
+									context->closed_tab_window));
+	}
+
+	if (notebook)
+	{
+		sibling_tab = find_tab_with_notebook (priv->closed_tabs, EPHY_NOTEBOOK (notebook));
+		if (sibling_tab)
+			return sibling_tab->parent_location;
+
+		return parent_location_new (EPHY_NOTEBOOK (notebook));
+	}
+
+	location = g_hash_table_lookup (context->closed_windows,
+					GINT_TO_POINTER (context->closed_tab_closed_window));
+	if (location == NULL)
+	{
+		location = parent_location_new (NULL);
+		g_hash_table_insert (context->closed_windows,
+				     GINT_TO_POINTER (context->closed_tab_closed_window),
+				     location);
+	}
+
+	return location;
+}
+
+static void
+session_end_closed_tab (SessionParserContext *context)
+{
+	EphySessionPrivate *priv = context->session->priv;
+	ClosedTab *tab = context->closed_tab;
+	gsize size;
+
+	context->closed_tab = NULL;
+
+	if (tab->url == NULL || context->closed_tabs_full)
+	{
+		closed_tab_free (tab);
+		g_variant_builder_unref (context->closed_tab_entries);
+		context->closed_tab_entries = NULL;
+		return;
+	}
+
+	if (context->closed_tab_n_entries == 0)
+	{
+		g_variant_builder_add (context->closed_tab_entries, "(ss)", tab->url, "");
+		context->closed_tab_n_entries++;
+	}
+	context->closed_tab_current = MIN (context->closed_tab_current,
+					   context->closed_tab_n_entries - 1);
+
+	tab->state = g_variant_ref_sink (g_variant_new (CLOSED_TAB_STATE_TYPE,
+							context->closed_tab_current,
+							context->closed_tab_entries));
+	g_variant_builder_unref (context->closed_tab_entries);
+	context->closed_tab_entries = NULL;
+
+	/* Tabs are saved most recent first, so once one doesn't fit
+	 * all the remaining ones are older and are dropped too. */
+	size = closed_tab_get_size (tab);
+	if (priv->closed_tabs_size + size > EPHY_SESSION_CLOSED_TABS_BUDGET &&
+	    !g_queue_is_empty (priv->closed_tabs))
+	{
+		context->closed_tabs_full = TRUE;
+		closed_tab_free (tab);
+		return;
+	}
+
+	tab->parent_location = session_closed_tab_get_parent_location (context);
+
+	g_queue_push_tail (priv->closed_tabs, tab);
+	priv->closed_tabs_size += size;
+
+	if (g_queue_get_length (priv->closed_tabs) == 1)
+		g_object_notify (G_OBJECT (context->session), "can-undo-tab-closed");
+}
+
 static void
 session_start_element (GMarkupParseContext  *ctx,
 		       const gchar          *element_name,
@@ -1163,6 +1738,14 @@ session_start_element (GMarkupParseContext  *ctx,
 	{
 		session_parse_embed (context, names, values);
 	}
+	else if (strcmp (element_name, "closed-tab") == 0)
+	{
+		session_parse_closed_tab (context, names, values);
+	}
+	else if (strcmp (element_name, "entry") == 0)
+	{
+		session_parse_closed_tab_entry (context, names, values);
+	}
 }
 
 static void
@@ -1192,6 +1775,7 @@ session_end_element (GMarkupParseContext  *ctx,
 
 		ephy_embed_shell_restored_window (shell);
 
+		g_ptr_array_add (context->windows, g_object_ref (context->window));
 		context->window = NULL;
 		context->active_tab = 0;
 		context->is_first_window = FALSE;
@@ -1200,6 +1784,10 @@ session_end_element (GMarkupParseContext  *ctx,
 	{
 		context->is_first_tab = FALSE;
 	}
+	else if (strcmp (element_name, "closed-tab") == 0 && context->closed_tab)
+	{
+		session_end_closed_tab (context);
+	}
 }
 
 static const GMarkupParser session_parser = {
@@ -1247,6 +1835,8 @@ load_stream_complete (GTask *task)
 	session = EPHY_SESSION (g_task_get_source_object (task));
 	session->priv->dont_save = FALSE;
 
+	ephy_trace_async_end ("Loading session", task);
+
 	ephy_session_save (session, SESSION_STATE);
 
 	g_object_unref (task);
@@ -1266,6 +1856,8 @@ load_stream_complete_error (GTask *task,
 
 	session = EPHY_SESSION (g_task_get_source_object (task));
 	session->priv->dont_save = FALSE;
+
+	ephy_trace_async_end ("Loading session", task);
 	/* If the session fails to load for whatever reason,
 	 * delete the file and open an empty window.
 	 */
@@ -1314,12 +1906,15 @@ load_stream_read_cb (GObject *object,
 		return;
 	}
 
+	ephy_trace_begin ("Parsing session");
 	if (!g_markup_parse_context_parse (data->parser, data->buffer, bytes_read, &error))
 	{
+		ephy_trace_end ("Parsing session");
 		load_stream_complete_error (task, error);
 
 		return;
 	}
+	ephy_trace_end ("Parsing session");
 
 	g_input_stream_read_async (stream, data->buffer, sizeof (data->buffer),
 				   g_task_get_priority (task),
@@ -1367,6 +1962,8 @@ ephy_session_load_from_stream (EphySession *session,
 	task = g_task_new (session, cancellable, callback, user_data);
 	g_task_set_priority (task, G_PRIORITY_HIGH);
 
+	ephy_trace_async_begin ("Loading session", task);
+
 	context = session_parser_context_new (session, user_time);
 	parser = g_markup_parse_context_new (&session_parser, 0, context, (GDestroyNotify)session_parser_context_free);
 	data = load_from_stream_async_data_new (parser);
@@ -1646,6 +2243,7 @@ ephy_session_clear (EphySession *session)
 	g_queue_foreach (session->priv->closed_tabs,
 			 (GFunc)closed_tab_free, NULL);
 	g_queue_clear (session->priv->closed_tabs);
+	session->priv->closed_tabs_size = 0;
 
 	ephy_session_save (session, SESSION_STATE);
 }
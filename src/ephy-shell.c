@@ -38,6 +38,7 @@
 #include "ephy-search-provider.h"
 #include "ephy-session.h"
 #include "ephy-settings.h"
+#include "ephy-tab-hibernator.h"
 #include "ephy-type-builtins.h"
 #include "ephy-web-view.h"
 #include "ephy-window.h"
@@ -48,14 +49,12 @@
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
 
-#define WNCK_I_KNOW_THIS_IS_UNSTABLE
-#include <libwnck/libwnck.h>
-
 #define EPHY_SHELL_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), EPHY_TYPE_SHELL, EphyShellPrivate))
 
 struct _EphyShellPrivate {
   EphySearchProvider *search_provider;
   EphySession *session;
+  EphyTabHibernator *tab_hibernator;
   GList *windows;
   GObject *lockdown;
   EphyBookmarks *bookmarks;
@@ -114,6 +113,14 @@ ephy_shell_startup_context_new (EphyStartupFlags startup_flags,
   return ctx;
 }
 
+static gboolean
+startup_interactive_cb (gpointer user_data)
+{
+  ephy_trace_milestone ("interactive");
+
+  return FALSE;
+}
+
 static void
 ephy_shell_startup_continue (EphyShell *shell)
 {
@@ -135,11 +142,10 @@ ephy_shell_startup_continue (EphyShell *shell)
                           ctx->startup_flags, ctx->user_time);
   }
 
-  /* Get an initial update on our windows and their workspaces,
-   * otherwise our first call to ephy_window_is_on_current_workspace
-   * will be unreliable.
-   */
-  wnck_screen_force_update (wnck_screen_get_default ());
+  /* Low priority idles only run once the windows opened so far have
+   * been drawn and no other work is pending. */
+  if (ephy_trace_get_milestone ("interactive") == -1)
+    g_idle_add_full (G_PRIORITY_LOW, (GSourceFunc)startup_interactive_cb, NULL, NULL);
 }
 
 static void
@@ -282,7 +288,15 @@ ephy_shell_startup (GApplication* application)
     gtk_application_set_app_menu (GTK_APPLICATION (application),
                                   G_MENU_MODEL (gtk_builder_get_object (builder, "app-menu")));
     g_object_unref (builder);
+
+#if WEBKIT_CHECK_VERSION (2, 7, 1)
+    /* Tabs can't be hibernated without restoring their history. */
+    if (mode != EPHY_EMBED_SHELL_MODE_TEST)
+      ephy_shell_get_tab_hibernator (EPHY_SHELL (application));
+#endif
   }
+
+  ephy_trace_milestone ("shell-started");
 }
 
 static void
@@ -293,6 +307,8 @@ session_load_cb (GObject *object,
   EphySession *session = EPHY_SESSION (object);
   EphyShell *shell = EPHY_SHELL (user_data);
 
+  ephy_trace_milestone ("session-restored");
+
   if (ephy_session_resume_finish (session, result, NULL))
     shell->priv->startup_context->startup_flags |= EPHY_STARTUP_RESUMING_SESSION;
 
@@ -670,6 +686,7 @@ ephy_shell_dispose (GObject *object)
   LOG ("EphyShell disposing");
 
   g_clear_object (&priv->search_provider);
+  g_clear_object (&priv->tab_hibernator);
   g_clear_object (&priv->session);
   g_clear_object (&priv->lockdown);
   g_clear_pointer (&priv->bme, gtk_widget_destroy);
@@ -933,6 +950,30 @@ ephy_shell_get_session (EphyShell *shell)
   return shell->priv->session;
 }
 
+/**
+ * ephy_shell_get_tab_hibernator:
+ * @shell: the #EphyShell
+ *
+ * Returns the object unloading background tabs when memory runs short.
+ *
+ * Return value: (transfer none): the #EphyTabHibernator.
+ **/
+EphyTabHibernator *
+ephy_shell_get_tab_hibernator (EphyShell *shell)
+{
+  g_return_val_if_fail (EPHY_IS_SHELL (shell), NULL);
+
+  if (shell->priv->tab_hibernator == NULL) {
+    shell->priv->tab_hibernator = ephy_tab_hibernator_new (NULL);
+    g_settings_bind (EPHY_SETTINGS_MAIN,
+                     EPHY_PREFS_TAB_HIBERNATION_THRESHOLD,
+                     shell->priv->tab_hibernator, "threshold",
+                     G_SETTINGS_BIND_GET);
+  }
+
+  return shell->priv->tab_hibernator;
+}
+
 /**
  * ephy_shell_get_bookmarks:
  *
@@ -31,6 +31,7 @@
 #include "ephy-embed-shell.h"
 #include "ephy-embed.h"
 #include "ephy-session.h"
+#include "ephy-tab-hibernator.h"
 #include "ephy-window.h"
 
 #ifdef HAVE_WEBKIT2
@@ -167,6 +168,8 @@ EphyEmbed      *ephy_shell_new_tab_full                 (EphyShell *shell,
 
 EphySession     *ephy_shell_get_session                  (EphyShell *shell);
 
+EphyTabHibernator *ephy_shell_get_tab_hibernator         (EphyShell *shell);
+
 GNetworkMonitor *ephy_shell_get_net_monitor              (EphyShell *shell);
 
 EphyBookmarks   *ephy_shell_get_bookmarks                (EphyShell *shell);
@@ -0,0 +1,807 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-tab-hibernator.h"
+
+#include "ephy-about-handler.h"
+#include "ephy-debug.h"
+#include "ephy-embed-container.h"
+#include "ephy-embed.h"
+#include "ephy-shell.h"
+#include "ephy-window.h"
+
+#include <gtk/gtk.h>
+
+#define EPHY_TAB_HIBERNATOR_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), EPHY_TYPE_TAB_HIBERNATOR, EphyTabHibernatorPrivate))
+
+/* How often the memory usage is compared to the threshold, in seconds. */
+#define HIBERNATION_CHECK_INTERVAL 30
+/* How long the web process is given to release the memory of the
+ * hibernated tabs before measuring again, in seconds. */
+#define HIBERNATION_SETTLE_DELAY 3
+
+#define MIB (1024 * 1024)
+
+struct _EphyTabHibernatorPrivate
+{
+  EphyMemoryMonitor *monitor;
+  guint threshold;
+
+  GCancellable *cancellable;
+  guint check_source_id;
+  guint settle_source_id;
+  guint n_checks_running;
+
+  /* Usage measured right before the last tabs were hibernated, to know
+   * how much they gave back at the next check. */
+  guint64 usage_before;
+  guint measuring : 1;
+
+  guint n_hibernations;
+  guint64 reclaimed_bytes;
+};
+
+enum {
+  PROP_0,
+  PROP_MEMORY_MONITOR,
+  PROP_THRESHOLD,
+  PROP_N_HIBERNATED,
+  PROP_N_HIBERNATIONS,
+  PROP_RECLAIMED_BYTES
+};
+
+typedef struct {
+  /* Whether the system is low on memory, rather than the browser being
+   * over the threshold. */
+  gboolean low_memory;
+  guint64 usage;
+  GList *candidates;
+} CheckData;
+
+G_DEFINE_TYPE (EphyTabHibernator, ephy_tab_hibernator, G_TYPE_OBJECT)
+
+static GQuark
+last_activity_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (quark == 0)
+    quark = g_quark_from_static_string ("ephy-tab-hibernator-last-activity");
+
+  return quark;
+}
+
+static void
+embed_touch (EphyEmbed *embed)
+{
+  gint64 *last_activity;
+
+  last_activity = g_object_get_qdata (G_OBJECT (embed), last_activity_quark ());
+  if (last_activity == NULL) {
+    last_activity = g_new (gint64, 1);
+    g_object_set_qdata_full (G_OBJECT (embed), last_activity_quark (),
+                             last_activity, g_free);
+  }
+
+  *last_activity = g_get_monotonic_time ();
+}
+
+static gint64
+embed_get_last_activity (EphyEmbed *embed)
+{
+  gint64 *last_activity;
+
+  last_activity = g_object_get_qdata (G_OBJECT (embed), last_activity_quark ());
+
+  return last_activity ? *last_activity : 0;
+}
+
+static int
+compare_last_activity (EphyEmbed *a,
+                       EphyEmbed *b)
+{
+  gint64 activity_a = embed_get_last_activity (a);
+  gint64 activity_b = embed_get_last_activity (b);
+
+  return activity_a < activity_b ? -1 : activity_a > activity_b;
+}
+
+/* Whether @embed is a background tab that would look the same after
+ * loading its address again. Modified forms are checked separately, as
+ * that needs asking the web process. */
+static gboolean
+embed_can_hibernate (EphyEmbed *embed)
+{
+  EphyWebView *web_view = ephy_embed_get_web_view (embed);
+  GtkWidget *window;
+  const char *address;
+
+  window = gtk_widget_get_toplevel (GTK_WIDGET (embed));
+  if (!EPHY_IS_WINDOW (window) ||
+      ephy_embed_container_get_active_child (EPHY_EMBED_CONTAINER (window)) == embed)
+    return FALSE;
+
+  if (ephy_embed_get_hibernated (embed) || ephy_embed_has_load_pending (embed))
+    return FALSE;
+
+  if (ephy_web_view_is_loading (web_view))
+    return FALSE;
+
+  /* Internal pages are cheap and can't be loaded back from a request. */
+  address = ephy_web_view_get_address (web_view);
+  if (address == NULL || g_str_has_prefix (address, EPHY_ABOUT_SCHEME))
+    return FALSE;
+
+  /* Loading it again would be a GET, losing what was posted. */
+  if (ephy_web_view_is_form_submission (web_view))
+    return FALSE;
+
+#if WEBKIT_CHECK_VERSION (2, 8, 0)
+  if (webkit_web_view_is_playing_audio (WEBKIT_WEB_VIEW (web_view)))
+    return FALSE;
+#endif
+
+  return TRUE;
+}
+
+/* Background tabs that can be hibernated, least recently used first. */
+static GList *
+get_candidates (void)
+{
+  GList *windows, *w;
+  GList *candidates = NULL;
+
+  windows = gtk_application_get_windows (GTK_APPLICATION (ephy_shell_get_default ()));
+  for (w = windows; w != NULL; w = w->next) {
+    GList *tabs, *t;
+
+    if (!EPHY_IS_WINDOW (w->data))
+      continue;
+
+    tabs = ephy_embed_container_get_children (EPHY_EMBED_CONTAINER (w->data));
+    for (t = tabs; t != NULL; t = t->next) {
+      EphyEmbed *embed = EPHY_EMBED (t->data);
+
+      if (embed_can_hibernate (embed))
+        candidates = g_list_prepend (candidates, g_object_ref (embed));
+    }
+    g_list_free (tabs);
+  }
+
+  return g_list_sort (candidates, (GCompareFunc)compare_last_activity);
+}
+
+static gboolean
+hibernate_embed (EphyTabHibernator *hibernator,
+                 EphyEmbed *embed)
+{
+  LOG ("Hibernating %s", ephy_web_view_get_address (ephy_embed_get_web_view (embed)));
+
+  ephy_embed_hibernate (embed);
+  if (!ephy_embed_get_hibernated (embed))
+    return FALSE;
+
+  hibernator->priv->n_hibernations++;
+  g_object_notify (G_OBJECT (hibernator), "n-hibernations");
+  g_object_notify (G_OBJECT (hibernator), "n-hibernated");
+
+  return TRUE;
+}
+
+static void
+finish_measuring (EphyTabHibernator *hibernator,
+                  guint64 usage)
+{
+  EphyTabHibernatorPrivate *priv = hibernator->priv;
+
+  if (!priv->measuring)
+    return;
+
+  priv->measuring = FALSE;
+
+  if (usage < priv->usage_before) {
+    priv->reclaimed_bytes += priv->usage_before - usage;
+    g_object_notify (G_OBJECT (hibernator), "reclaimed-bytes");
+
+    LOG ("Hibernated tabs gave back %" G_GUINT64_FORMAT " bytes",
+         priv->usage_before - usage);
+  }
+}
+
+static void start_check (EphyTabHibernator *hibernator,
+                         gboolean low_memory,
+                         GCancellable *cancellable,
+                         GAsyncReadyCallback callback,
+                         gpointer user_data);
+
+static gboolean
+settle_cb (EphyTabHibernator *hibernator)
+{
+  hibernator->priv->settle_source_id = 0;
+
+  start_check (hibernator, FALSE, hibernator->priv->cancellable, NULL, NULL);
+
+  return FALSE;
+}
+
+static void
+start_measuring (EphyTabHibernator *hibernator,
+                 guint64 usage)
+{
+  EphyTabHibernatorPrivate *priv = hibernator->priv;
+
+  priv->usage_before = usage;
+  priv->measuring = TRUE;
+
+  /* Measure, and keep hibernating if still needed, once the memory had
+   * a chance to be released instead of waiting for the next check. */
+  if (priv->settle_source_id == 0)
+    priv->settle_source_id = g_timeout_add_seconds (HIBERNATION_SETTLE_DELAY,
+                                                    (GSourceFunc)settle_cb,
+                                                    hibernator);
+}
+
+static void
+check_data_free (CheckData *data)
+{
+  g_list_free_full (data->candidates, g_object_unref);
+  g_slice_free (CheckData, data);
+}
+
+static void
+check_return (GTask *task,
+              gssize n_hibernated,
+              GError *error)
+{
+  EphyTabHibernator *hibernator = g_task_get_source_object (task);
+
+  hibernator->priv->n_checks_running--;
+
+  if (error)
+    g_task_return_error (task, error);
+  else
+    g_task_return_int (task, n_hibernated);
+  g_object_unref (task);
+}
+
+static void
+modified_forms_cb (GObject *source,
+                   GAsyncResult *result,
+                   GTask *task)
+{
+  EphyTabHibernator *hibernator = g_task_get_source_object (task);
+  CheckData *data = g_task_get_task_data (task);
+  GError *error = NULL;
+  GList *modified_views, *l;
+  guint n_hibernated = 0;
+
+  modified_views = ephy_web_view_list_modified_forms_finish (result, NULL);
+
+  if (g_cancellable_set_error_if_cancelled (g_task_get_cancellable (task), &error)) {
+    g_list_free_full (modified_views, g_object_unref);
+    check_return (task, 0, error);
+    return;
+  }
+
+  for (l = data->candidates; l != NULL; l = l->next) {
+    EphyEmbed *embed = EPHY_EMBED (l->data);
+
+    /* Over the threshold, one tab at a time is enough; the next check
+     * tells whether more are needed. When the whole system is short on
+     * memory, don't wait to see how much each tab gives back. */
+    if (!data->low_memory && n_hibernated > 0)
+      break;
+
+    if (g_list_find (modified_views, ephy_embed_get_web_view (embed)))
+      continue;
+
+    /* Things may have changed while waiting for the web process. */
+    if (!embed_can_hibernate (embed))
+      continue;
+
+    if (hibernate_embed (hibernator, embed))
+      n_hibernated++;
+  }
+  g_list_free_full (modified_views, g_object_unref);
+
+  if (n_hibernated > 0)
+    start_measuring (hibernator, data->usage);
+
+  check_return (task, n_hibernated, NULL);
+}
+
+static void
+usage_cb (EphyMemoryMonitor *monitor,
+          GAsyncResult *result,
+          GTask *task)
+{
+  EphyTabHibernator *hibernator = g_task_get_source_object (task);
+  EphyTabHibernatorPrivate *priv = hibernator->priv;
+  CheckData *data = g_task_get_task_data (task);
+  GError *error = NULL;
+  GList *views = NULL, *l;
+
+  data->usage = ephy_memory_monitor_get_usage_finish (monitor, result, &error);
+  if (error) {
+    check_return (task, 0, error);
+    return;
+  }
+
+  finish_measuring (hibernator, data->usage);
+
+  if (!data->low_memory &&
+      (priv->threshold == 0 || data->usage <= (guint64)priv->threshold * MIB)) {
+    check_return (task, 0, NULL);
+    return;
+  }
+
+  data->candidates = get_candidates ();
+  if (data->candidates == NULL) {
+    check_return (task, 0, NULL);
+    return;
+  }
+
+  /* Whatever the user typed would be lost. */
+  for (l = data->candidates; l != NULL; l = l->next)
+    views = g_list_prepend (views, ephy_embed_get_web_view (EPHY_EMBED (l->data)));
+  views = g_list_reverse (views);
+
+  ephy_web_view_list_modified_forms (views, g_task_get_cancellable (task),
+                                     (GAsyncReadyCallback)modified_forms_cb,
+                                     task);
+  g_list_free (views);
+}
+
+static void
+start_check (EphyTabHibernator *hibernator,
+             gboolean low_memory,
+             GCancellable *cancellable,
+             GAsyncReadyCallback callback,
+             gpointer user_data)
+{
+  EphyTabHibernatorPrivate *priv = hibernator->priv;
+  CheckData *data;
+  GTask *task;
+
+  task = g_task_new (hibernator, cancellable, callback, user_data);
+
+  /* Nothing to measure nor to compare to, don't read /proc at all. */
+  if (!low_memory && priv->threshold == 0 && !priv->measuring) {
+    g_task_return_int (task, 0);
+    g_object_unref (task);
+    return;
+  }
+
+  data = g_slice_new0 (CheckData);
+  data->low_memory = low_memory;
+  g_task_set_task_data (task, data, (GDestroyNotify)check_data_free);
+
+  priv->n_checks_running++;
+  ephy_memory_monitor_get_usage_async (priv->monitor, cancellable,
+                                       (GAsyncReadyCallback)usage_cb,
+                                       task);
+}
+
+static gboolean
+check_cb (EphyTabHibernator *hibernator)
+{
+  if (hibernator->priv->n_checks_running == 0)
+    start_check (hibernator, FALSE, hibernator->priv->cancellable, NULL, NULL);
+
+  return TRUE;
+}
+
+static void
+update_check_source (EphyTabHibernator *hibernator)
+{
+  EphyTabHibernatorPrivate *priv = hibernator->priv;
+
+  if (priv->threshold > 0 && priv->check_source_id == 0) {
+    priv->check_source_id = g_timeout_add_seconds (HIBERNATION_CHECK_INTERVAL,
+                                                   (GSourceFunc)check_cb,
+                                                   hibernator);
+  } else if (priv->threshold == 0 && priv->check_source_id != 0) {
+    g_source_remove (priv->check_source_id);
+    priv->check_source_id = 0;
+  }
+}
+
+static void
+low_memory_cb (EphyMemoryMonitor *monitor,
+               EphyTabHibernator *hibernator)
+{
+  LOG ("Low on memory, hibernating background tabs");
+
+  start_check (hibernator, TRUE, hibernator->priv->cancellable, NULL, NULL);
+}
+
+static void
+notebook_switch_page_cb (GtkNotebook *notebook,
+                         GtkWidget *page,
+                         guint page_num,
+                         EphyTabHibernator *hibernator)
+{
+  GtkWidget *previous_page;
+  int current;
+
+  /* Still the tab being left, which was in use until now. */
+  current = gtk_notebook_get_current_page (notebook);
+  previous_page = current >= 0 ? gtk_notebook_get_nth_page (notebook, current) : NULL;
+  if (previous_page && EPHY_IS_EMBED (previous_page))
+    embed_touch (EPHY_EMBED (previous_page));
+
+  if (!EPHY_IS_EMBED (page))
+    return;
+
+  embed_touch (EPHY_EMBED (page));
+
+  if (ephy_embed_get_hibernated (EPHY_EMBED (page))) {
+    LOG ("Waking up %s", ephy_web_view_get_address (ephy_embed_get_web_view (EPHY_EMBED (page))));
+    ephy_embed_wake_up (EPHY_EMBED (page));
+    g_object_notify (G_OBJECT (hibernator), "n-hibernated");
+  }
+}
+
+static void
+notebook_page_added_cb (GtkNotebook *notebook,
+                        GtkWidget *page,
+                        guint page_num,
+                        EphyTabHibernator *hibernator)
+{
+  if (EPHY_IS_EMBED (page))
+    embed_touch (EPHY_EMBED (page));
+}
+
+static void
+notebook_page_removed_cb (GtkNotebook *notebook,
+                          GtkWidget *page,
+                          guint page_num,
+                          EphyTabHibernator *hibernator)
+{
+  if (EPHY_IS_EMBED (page) && ephy_embed_get_hibernated (EPHY_EMBED (page)))
+    g_object_notify (G_OBJECT (hibernator), "n-hibernated");
+}
+
+static void
+window_added_cb (GtkApplication *application,
+                 GtkWindow *window,
+                 EphyTabHibernator *hibernator)
+{
+  GtkWidget *notebook;
+  GList *tabs, *l;
+
+  if (!EPHY_IS_WINDOW (window))
+    return;
+
+  notebook = ephy_window_get_notebook (EPHY_WINDOW (window));
+  g_signal_connect (notebook, "switch-page",
+                    G_CALLBACK (notebook_switch_page_cb), hibernator);
+  g_signal_connect (notebook, "page-added",
+                    G_CALLBACK (notebook_page_added_cb), hibernator);
+  g_signal_connect (notebook, "page-removed",
+                    G_CALLBACK (notebook_page_removed_cb), hibernator);
+
+  tabs = ephy_embed_container_get_children (EPHY_EMBED_CONTAINER (window));
+  for (l = tabs; l != NULL; l = l->next)
+    embed_touch (EPHY_EMBED (l->data));
+  g_list_free (tabs);
+}
+
+static void
+ephy_tab_hibernator_init (EphyTabHibernator *hibernator)
+{
+  hibernator->priv = EPHY_TAB_HIBERNATOR_GET_PRIVATE (hibernator);
+  hibernator->priv->cancellable = g_cancellable_new ();
+}
+
+static void
+ephy_tab_hibernator_constructed (GObject *object)
+{
+  EphyTabHibernator *hibernator = EPHY_TAB_HIBERNATOR (object);
+  EphyTabHibernatorPrivate *priv = hibernator->priv;
+  EphyShell *shell = ephy_shell_get_default ();
+  GList *windows, *w;
+
+  G_OBJECT_CLASS (ephy_tab_hibernator_parent_class)->constructed (object);
+
+  if (priv->monitor == NULL)
+    priv->monitor = ephy_memory_monitor_new ();
+
+  g_signal_connect (priv->monitor, "low-memory",
+                    G_CALLBACK (low_memory_cb), hibernator);
+
+  g_signal_connect (shell, "window-added",
+                    G_CALLBACK (window_added_cb), hibernator);
+  windows = gtk_application_get_windows (GTK_APPLICATION (shell));
+  for (w = windows; w != NULL; w = w->next)
+    window_added_cb (GTK_APPLICATION (shell), GTK_WINDOW (w->data), hibernator);
+
+  update_check_source (hibernator);
+}
+
+static void
+ephy_tab_hibernator_dispose (GObject *object)
+{
+  EphyTabHibernatorPrivate *priv = EPHY_TAB_HIBERNATOR (object)->priv;
+  EphyShell *shell = ephy_shell_get_default ();
+
+  if (priv->cancellable) {
+    g_cancellable_cancel (priv->cancellable);
+    g_clear_object (&priv->cancellable);
+  }
+
+  if (priv->check_source_id) {
+    g_source_remove (priv->check_source_id);
+    priv->check_source_id = 0;
+  }
+
+  if (priv->settle_source_id) {
+    g_source_remove (priv->settle_source_id);
+    priv->settle_source_id = 0;
+  }
+
+  if (shell) {
+    GList *windows, *w;
+
+    g_signal_handlers_disconnect_by_data (shell, object);
+
+    windows = gtk_application_get_windows (GTK_APPLICATION (shell));
+    for (w = windows; w != NULL; w = w->next) {
+      if (EPHY_IS_WINDOW (w->data))
+        g_signal_handlers_disconnect_by_data (ephy_window_get_notebook (EPHY_WINDOW (w->data)),
+                                              object);
+    }
+  }
+
+  if (priv->monitor) {
+    g_signal_handlers_disconnect_by_data (priv->monitor, object);
+    g_clear_object (&priv->monitor);
+  }
+
+  G_OBJECT_CLASS (ephy_tab_hibernator_parent_class)->dispose (object);
+}
+
+static void
+ephy_tab_hibernator_set_property (GObject *object,
+                                  guint prop_id,
+                                  const GValue *value,
+                                  GParamSpec *pspec)
+{
+  EphyTabHibernatorPrivate *priv = EPHY_TAB_HIBERNATOR (object)->priv;
+
+  switch (prop_id) {
+  case PROP_MEMORY_MONITOR:
+    priv->monitor = g_value_dup_object (value);
+    break;
+  case PROP_THRESHOLD:
+    priv->threshold = g_value_get_uint (value);
+    update_check_source (EPHY_TAB_HIBERNATOR (object));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
+}
+
+static void
+ephy_tab_hibernator_get_property (GObject *object,
+                                  guint prop_id,
+                                  GValue *value,
+                                  GParamSpec *pspec)
+{
+  EphyTabHibernator *hibernator = EPHY_TAB_HIBERNATOR (object);
+
+  switch (prop_id) {
+  case PROP_MEMORY_MONITOR:
+    g_value_set_object (value, hibernator->priv->monitor);
+    break;
+  case PROP_THRESHOLD:
+    g_value_set_uint (value, hibernator->priv->threshold);
+    break;
+  case PROP_N_HIBERNATED:
+    g_value_set_uint (value, ephy_tab_hibernator_get_n_hibernated (hibernator));
+    break;
+  case PROP_N_HIBERNATIONS:
+    g_value_set_uint (value, hibernator->priv->n_hibernations);
+    break;
+  case PROP_RECLAIMED_BYTES:
+    g_value_set_uint64 (value, hibernator->priv->reclaimed_bytes);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
+}
+
+static void
+ephy_tab_hibernator_class_init (EphyTabHibernatorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = ephy_tab_hibernator_constructed;
+  object_class->dispose = ephy_tab_hibernator_dispose;
+  object_class->set_property = ephy_tab_hibernator_set_property;
+  object_class->get_property = ephy_tab_hibernator_get_property;
+
+  g_object_class_install_property (object_class,
+                                   PROP_MEMORY_MONITOR,
+                                   g_param_spec_object ("memory-monitor",
+                                                        "Memory monitor",
+                                                        "The EphyMemoryMonitor measuring memory",
+                                                        EPHY_TYPE_MEMORY_MONITOR,
+                                                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class,
+                                   PROP_THRESHOLD,
+                                   g_param_spec_uint ("threshold",
+                                                      "Threshold",
+                                                      "Memory usage in MiB above which background tabs are hibernated, or 0",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class,
+                                   PROP_N_HIBERNATED,
+                                   g_param_spec_uint ("n-hibernated",
+                                                      "Hibernated tabs",
+                                                      "The number of tabs currently hibernated",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class,
+                                   PROP_N_HIBERNATIONS,
+                                   g_param_spec_uint ("n-hibernations",
+                                                      "Hibernations",
+                                                      "The number of times a tab has been hibernated",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class,
+                                   PROP_RECLAIMED_BYTES,
+                                   g_param_spec_uint64 ("reclaimed-bytes",
+                                                        "Reclaimed bytes",
+                                                        "Memory given back by hibernating tabs, in bytes",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_type_class_add_private (object_class, sizeof (EphyTabHibernatorPrivate));
+}
+
+/**
+ * ephy_tab_hibernator_new:
+ * @monitor: (allow-none): the #EphyMemoryMonitor to measure memory with,
+ *    or %NULL for the default one
+ *
+ * Creates a hibernator that unloads the least recently used background
+ * tabs of all the windows when memory usage goes above its threshold or
+ * @monitor reports the system is low on memory.
+ *
+ * Returns: (transfer full): a new #EphyTabHibernator
+ **/
+EphyTabHibernator *
+ephy_tab_hibernator_new (EphyMemoryMonitor *monitor)
+{
+  return EPHY_TAB_HIBERNATOR (g_object_new (EPHY_TYPE_TAB_HIBERNATOR,
+                                            "memory-monitor", monitor,
+                                            NULL));
+}
+
+/**
+ * ephy_tab_hibernator_check:
+ * @hibernator: an #EphyTabHibernator
+ * @cancellable: (allow-none): a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the check is done
+ * @user_data: the data to pass to @callback
+ *
+ * Measures memory usage and, if it's above the threshold, hibernates the
+ * least recently used background tab that can be loaded again as it is.
+ * This is done periodically, and again shortly after each hibernation
+ * until usage is below the threshold.
+ **/
+void
+ephy_tab_hibernator_check (EphyTabHibernator *hibernator,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data)
+{
+  g_return_if_fail (EPHY_IS_TAB_HIBERNATOR (hibernator));
+
+  start_check (hibernator, FALSE, cancellable, callback, user_data);
+}
+
+/**
+ * ephy_tab_hibernator_check_finish:
+ * @hibernator: an #EphyTabHibernator
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns: the number of tabs hibernated by the check
+ **/
+guint
+ephy_tab_hibernator_check_finish (EphyTabHibernator *hibernator,
+                                  GAsyncResult *result,
+                                  GError **error)
+{
+  gssize n_hibernated;
+
+  g_return_val_if_fail (g_task_is_valid (result, hibernator), 0);
+
+  n_hibernated = g_task_propagate_int (G_TASK (result), error);
+
+  return n_hibernated > 0 ? n_hibernated : 0;
+}
+
+/**
+ * ephy_tab_hibernator_get_n_hibernated:
+ * @hibernator: an #EphyTabHibernator
+ *
+ * Returns: the number of tabs that are hibernated right now
+ **/
+guint
+ephy_tab_hibernator_get_n_hibernated (EphyTabHibernator *hibernator)
+{
+  GList *windows, *w;
+  guint n_hibernated = 0;
+
+  g_return_val_if_fail (EPHY_IS_TAB_HIBERNATOR (hibernator), 0);
+
+  windows = gtk_application_get_windows (GTK_APPLICATION (ephy_shell_get_default ()));
+  for (w = windows; w != NULL; w = w->next) {
+    GList *tabs, *t;
+
+    if (!EPHY_IS_WINDOW (w->data))
+      continue;
+
+    tabs = ephy_embed_container_get_children (EPHY_EMBED_CONTAINER (w->data));
+    for (t = tabs; t != NULL; t = t->next) {
+      if (ephy_embed_get_hibernated (EPHY_EMBED (t->data)))
+        n_hibernated++;
+    }
+    g_list_free (tabs);
+  }
+
+  return n_hibernated;
+}
+
+/**
+ * ephy_tab_hibernator_get_n_hibernations:
+ * @hibernator: an #EphyTabHibernator
+ *
+ * Returns: how many times a tab has been hibernated
+ **/
+guint
+ephy_tab_hibernator_get_n_hibernations (EphyTabHibernator *hibernator)
+{
+  g_return_val_if_fail (EPHY_IS_TAB_HIBERNATOR (hibernator), 0);
+
+  return hibernator->priv->n_hibernations;
+}
+
+/**
+ * ephy_tab_hibernator_get_reclaimed_bytes:
+ * @hibernator: an #EphyTabHibernator
+ *
+ * Returns: how much memory usage went down after hibernating tabs, in bytes
+ **/
+guint64
+ephy_tab_hibernator_get_reclaimed_bytes (EphyTabHibernator *hibernator)
+{
+  g_return_val_if_fail (EPHY_IS_TAB_HIBERNATOR (hibernator), 0);
+
+  return hibernator->priv->reclaimed_bytes;
+}
@@ -0,0 +1,79 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#if !defined (__EPHY_EPIPHANY_H_INSIDE__) && !defined (EPIPHANY_COMPILATION)
+#error "Only <epiphany/epiphany.h> can be included directly."
+#endif
+
+#ifndef EPHY_TAB_HIBERNATOR_H
+#define EPHY_TAB_HIBERNATOR_H
+
+#include "ephy-memory-monitor.h"
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define EPHY_TYPE_TAB_HIBERNATOR            (ephy_tab_hibernator_get_type ())
+#define EPHY_TAB_HIBERNATOR(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), EPHY_TYPE_TAB_HIBERNATOR, EphyTabHibernator))
+#define EPHY_TAB_HIBERNATOR_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), EPHY_TYPE_TAB_HIBERNATOR, EphyTabHibernatorClass))
+#define EPHY_IS_TAB_HIBERNATOR(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EPHY_TYPE_TAB_HIBERNATOR))
+#define EPHY_IS_TAB_HIBERNATOR_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EPHY_TYPE_TAB_HIBERNATOR))
+#define EPHY_TAB_HIBERNATOR_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), EPHY_TYPE_TAB_HIBERNATOR, EphyTabHibernatorClass))
+
+typedef struct _EphyTabHibernator        EphyTabHibernator;
+typedef struct _EphyTabHibernatorClass   EphyTabHibernatorClass;
+typedef struct _EphyTabHibernatorPrivate EphyTabHibernatorPrivate;
+
+struct _EphyTabHibernator
+{
+  GObject parent;
+
+  /*< private >*/
+  EphyTabHibernatorPrivate *priv;
+};
+
+struct _EphyTabHibernatorClass
+{
+  GObjectClass parent_class;
+};
+
+GType              ephy_tab_hibernator_get_type              (void) G_GNUC_CONST;
+
+EphyTabHibernator *ephy_tab_hibernator_new                   (EphyMemoryMonitor *monitor);
+
+void               ephy_tab_hibernator_check                 (EphyTabHibernator  *hibernator,
+                                                              GCancellable       *cancellable,
+                                                              GAsyncReadyCallback callback,
+                                                              gpointer            user_data);
+
+guint              ephy_tab_hibernator_check_finish          (EphyTabHibernator  *hibernator,
+                                                              GAsyncResult       *result,
+                                                              GError            **error);
+
+guint              ephy_tab_hibernator_get_n_hibernated      (EphyTabHibernator *hibernator);
+
+guint              ephy_tab_hibernator_get_n_hibernations    (EphyTabHibernator *hibernator);
+
+guint64            ephy_tab_hibernator_get_reclaimed_bytes   (EphyTabHibernator *hibernator);
+
+G_END_DECLS
+
+#endif /* EPHY_TAB_HIBERNATOR_H */
@@ -3387,6 +3387,89 @@ download_added_cb (EphyEmbedShell *shell,
 	}
 }
 
+#define INTERRUPTED_DOWNLOAD_ID_KEY "ephy-interrupted-download-id"
+
+static void
+resume_download_cb (GtkButton *button,
+		    EphyWindow *window)
+{
+	EphyDownloadManager *manager;
+	guint id;
+
+	id = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (button),
+						  INTERRUPTED_DOWNLOAD_ID_KEY));
+	manager = ephy_embed_shell_get_download_manager (ephy_embed_shell_get_default ());
+
+	/* The new download gets its own widget through download_added_cb */
+	ephy_download_manager_resume (manager, id, GTK_WINDOW (window));
+
+	gtk_widget_destroy (GTK_WIDGET (button));
+}
+
+static GtkWidget *
+interrupted_download_widget_new (EphyWindow *window,
+				 EphyDownloadRecord *record)
+{
+	GtkWidget *button;
+	char *filename = NULL, *basename, *label, *tooltip;
+
+	if (record->destination)
+		filename = g_filename_from_uri (record->destination, NULL, NULL);
+	basename = g_path_get_basename (filename ? filename : record->source);
+	g_free (filename);
+
+	label = g_strdup_printf (_("Resume “%s”"), basename);
+	tooltip = g_strdup_printf (_("Download %s again, it was interrupted "
+				     "when the browser was last closed"),
+				   record->source);
+
+	button = gtk_button_new_with_label (label);
+	gtk_button_set_image (GTK_BUTTON (button),
+			      gtk_image_new_from_icon_name ("view-refresh-symbolic",
+							    GTK_ICON_SIZE_BUTTON));
+	gtk_widget_set_tooltip_text (button, tooltip);
+	g_object_set_data (G_OBJECT (button), INTERRUPTED_DOWNLOAD_ID_KEY,
+			   GUINT_TO_POINTER (record->id));
+	g_signal_connect (button, "clicked",
+			  G_CALLBACK (resume_download_cb), window);
+
+	g_free (basename);
+	g_free (label);
+	g_free (tooltip);
+
+	return button;
+}
+
+/* Downloads that were running when the last session ended can be
+ * started again from the downloads box of the first window. */
+static void
+add_interrupted_downloads (EphyWindow *window)
+{
+	static gboolean added = FALSE;
+	EphyDownloadManager *manager;
+	GList *l;
+
+	if (added) return;
+	added = TRUE;
+
+	manager = ephy_embed_shell_get_download_manager (ephy_embed_shell_get_default ());
+
+	for (l = ephy_download_manager_get_records (manager); l != NULL; l = l->next)
+	{
+		EphyDownloadRecord *record = l->data;
+		GtkWidget *widget;
+
+		if (record->state != EPHY_DOWNLOAD_STATE_INTERRUPTED)
+			continue;
+
+		widget = interrupted_download_widget_new (window, record);
+		gtk_box_pack_start (GTK_BOX (window->priv->downloads_box),
+				    widget, FALSE, FALSE, 0);
+		gtk_widget_show_all (widget);
+		ephy_window_set_downloads_box_visibility (window, TRUE);
+	}
+}
+
 static void
 downloads_removed_cb (GtkContainer *container,
 		      GtkWidget *widget,
@@ -3411,6 +3494,19 @@ downloads_close_cb (GtkButton *button, EphyWindow *window)
 
 	for (l = downloads; l != NULL; l = l->next)
 	{
+		gpointer id;
+
+		/* Interrupted downloads the user doesn't want back */
+		id = g_object_get_data (G_OBJECT (l->data), INTERRUPTED_DOWNLOAD_ID_KEY);
+		if (id != NULL)
+		{
+			ephy_download_manager_remove_record
+				(ephy_embed_shell_get_download_manager (ephy_embed_shell_get_default ()),
+				 GPOINTER_TO_UINT (id));
+			gtk_widget_destroy (GTK_WIDGET (l->data));
+			continue;
+		}
+
 		if (EPHY_IS_DOWNLOAD_WIDGET (l->data) != TRUE)
 			continue;
 
@@ -3914,6 +4010,8 @@ ephy_window_constructor (GType type,
 	g_object_bind_property (action, "active",
 				priv->downloads_box, "visible",
 				G_BINDING_SYNC_CREATE | G_BINDING_BIDIRECTIONAL);
+
+	add_interrupted_downloads (window);
 	
 	/* Now load the UI definition. */
 	gtk_ui_manager_add_ui_from_resource (priv->manager,
@@ -4052,6 +4150,24 @@ ephy_window_show (GtkWidget *widget)
 	GTK_WIDGET_CLASS (ephy_window_parent_class)->show (widget);
 }
 
+static gboolean
+ephy_window_draw (GtkWidget *widget,
+		  cairo_t *cr)
+{
+	static gboolean first_draw_done = FALSE;
+	gboolean retval;
+
+	retval = GTK_WIDGET_CLASS (ephy_window_parent_class)->draw (widget, cr);
+
+	if (G_UNLIKELY (!first_draw_done))
+	{
+		ephy_trace_milestone ("first-window-drawn");
+		first_draw_done = TRUE;
+	}
+
+	return retval;
+}
+
 static void
 ephy_window_class_init (EphyWindowClass *klass)
 {
@@ -4065,6 +4181,7 @@ ephy_window_class_init (EphyWindowClass *klass)
 	object_class->set_property = ephy_window_set_property;
 
 	widget_class->show = ephy_window_show;
+	widget_class->draw = ephy_window_draw;
 	widget_class->key_press_event = ephy_window_key_press_event;
 	widget_class->window_state_event = ephy_window_state_event;
 	widget_class->delete_event = ephy_window_delete_event;
@@ -4414,6 +4531,7 @@ ephy_window_get_location_controller (EphyWindow *window)
 gboolean
 ephy_window_is_on_current_workspace (EphyWindow *window)
 {
+	static gboolean wnck_updated = FALSE;
 	GdkWindow *gdk_window = NULL;
 	WnckWorkspace *workspace = NULL;
 	WnckWindow *wnck_window = NULL;
@@ -4421,6 +4539,16 @@ ephy_window_is_on_current_workspace (EphyWindow *window)
 	if (!gtk_widget_get_realized (GTK_WIDGET (window)))
 		return TRUE;
 
+	/* Get an initial update on our windows and their workspaces,
+	 * otherwise the first check will be unreliable. This takes several
+	 * round trips to the X server, so it's not done at startup.
+	 */
+	if (!wnck_updated)
+	{
+		wnck_screen_force_update (wnck_screen_get_default ());
+		wnck_updated = TRUE;
+	}
+
 	workspace = wnck_screen_get_active_workspace (wnck_screen_get_default ());
 
 	/* From WNCK docs:
@@ -4437,91 +4565,67 @@ ephy_window_is_on_current_workspace (EphyWindow *window)
 	return wnck_window_is_on_workspace (wnck_window, workspace);
 }
 
-typedef struct {
-	EphyWindow *window;
-	GCancellable *cancellable;
-
-	guint embeds_to_check;
-	EphyEmbed *modified_embed;
-} ModifiedFormsData;
-
 static void
-modified_forms_data_free (ModifiedFormsData *data)
-{
-	g_object_unref (data->cancellable);
-
-	g_slice_free (ModifiedFormsData, data);
-}
-
-static void
-continue_window_close_after_modified_forms_check (ModifiedFormsData *data)
+continue_window_close_after_modified_forms_check (EphyWindow *window,
+						  EphyEmbed *modified_embed)
 {
 	gboolean should_close;
 
-	data->window->priv->checking_modified_forms = FALSE;
+	window->priv->checking_modified_forms = FALSE;
 
-	if (data->modified_embed)
+	if (modified_embed)
 	{
 		/* jump to the first tab with modified forms */
-		impl_set_active_child (EPHY_EMBED_CONTAINER (data->window),
-				       data->modified_embed);
-		if (!confirm_close_with_modified_forms (data->window))
+		impl_set_active_child (EPHY_EMBED_CONTAINER (window),
+				       modified_embed);
+		if (!confirm_close_with_modified_forms (window))
 			return;
 	}
 
-	data->window->priv->force_close = TRUE;
-	should_close = ephy_window_close (data->window);
-	data->window->priv->force_close = FALSE;
+	window->priv->force_close = TRUE;
+	should_close = ephy_window_close (window);
+	window->priv->force_close = FALSE;
 	if (should_close)
-		gtk_widget_destroy (GTK_WIDGET (data->window));
+		gtk_widget_destroy (GTK_WIDGET (window));
 }
 
 static void
-has_modified_forms_cb (EphyWebView *view,
-		       GAsyncResult *result,
-		       ModifiedFormsData *data)
+find_modified_forms_cb (GObject *source,
+			GAsyncResult *result,
+			EphyWindow *window)
 {
-	gboolean has_modified_forms;
+	EphyWebView *modified_view;
 
-	data->embeds_to_check--;
-	has_modified_forms = ephy_web_view_has_modified_forms_finish (view, result, NULL);
-	if (has_modified_forms)
-	{
-		/* Cancel all others */
-		g_cancellable_cancel (data->cancellable);
-		data->modified_embed = EPHY_GET_EMBED_FROM_EPHY_WEB_VIEW (view);
-	}
-
-	if (data->embeds_to_check > 0)
-		return;
-
-	continue_window_close_after_modified_forms_check (data);
-	modified_forms_data_free (data);
+	modified_view = ephy_web_view_find_modified_forms_finish (result, NULL);
+	continue_window_close_after_modified_forms_check (window,
+							  modified_view ? EPHY_GET_EMBED_FROM_EPHY_WEB_VIEW (modified_view) : NULL);
+	if (modified_view)
+		g_object_unref (modified_view);
 }
 
 static void
 ephy_window_check_modified_forms (EphyWindow *window)
 {
-	GList *tabs, *l;
-	ModifiedFormsData *data;
+	GList *tabs, *views = NULL, *l;
 
 	window->priv->checking_modified_forms = TRUE;
 
-	data = g_slice_new0 (ModifiedFormsData);
-	data->window = window;
-	data->cancellable = g_cancellable_new ();
-	data->embeds_to_check = gtk_notebook_get_n_pages (window->priv->notebook);
-
+	/* All the tabs are checked with a single message to the web
+	 * process, rather than one round trip per tab. */
 	tabs = impl_get_children (EPHY_EMBED_CONTAINER (window));
 	for (l = tabs; l != NULL; l = l->next)
 	{
 		EphyEmbed *embed = (EphyEmbed *) l->data;
 
-		ephy_web_view_has_modified_forms (ephy_embed_get_web_view (embed),
-						  data->cancellable,
-						  (GAsyncReadyCallback)has_modified_forms_cb,
-						  data);
+		views = g_list_prepend (views, ephy_embed_get_web_view (embed));
 	}
+	views = g_list_reverse (views);
+
+	ephy_web_view_find_modified_forms (views,
+					   NULL,
+					   (GAsyncReadyCallback)find_modified_forms_cb,
+					   window);
+	g_list_free (views);
 	g_list_free (tabs);
 }
 
@@ -161,6 +161,7 @@ typedef struct
 {
 	EphyDialog *dialog;
 	GtkWidget *checkbutton_history;
+	GtkWidget *combo_history_range;
 	GtkWidget *checkbutton_cookies;
 	GtkWidget *checkbutton_passwords;
 	GtkWidget *checkbutton_cache;
@@ -187,6 +188,16 @@ get_cookie_jar (void)
 }
 #endif
 
+/* How far back the history is cleared, in seconds, 0 meaning all of it.
+ * The order matches the entries of the history range combo box. */
+static const gint64 history_ranges[] = {
+	60 * 60,
+	60 * 60 * 24,
+	60 * 60 * 24 * 7,
+	60 * 60 * 24 * 7 * 4,
+	0
+};
+
 static void
 clear_all_dialog_release_cb (PdmClearAllDialogButtons *data)
 {
@@ -239,10 +250,25 @@ clear_all_dialog_response_cb (GtkDialog *dialog,
 		{
 			EphyEmbedShell *shell;
 			EphyHistoryService *history;
+			int range;
 
 			shell = ephy_embed_shell_get_default ();
 			history = EPHY_HISTORY_SERVICE (ephy_embed_shell_get_global_history_service (shell));
-			ephy_history_service_clear (history, NULL, NULL, NULL);
+			range = gtk_combo_box_get_active (GTK_COMBO_BOX (checkbuttons->combo_history_range));
+
+			if (range < 0 || history_ranges[range] == 0)
+			{
+				ephy_history_service_clear (history, NULL, NULL, NULL);
+			}
+			else
+			{
+				gint64 now = time (NULL);
+
+				ephy_history_service_delete_visits_in_time (history,
+									    now - history_ranges[range],
+									    now,
+									    NULL, NULL, NULL);
+			}
 		}
 		if (gtk_toggle_button_get_active
 			(GTK_TOGGLE_BUTTON (checkbuttons->checkbutton_cookies)))
@@ -317,8 +343,8 @@ pdm_dialog_show_clear_all_dialog (EphyDialog *edialog,
 				  GtkWidget *parent,
 				  PdmClearAllDialogFlags flags)
 {
-	GtkWidget *dialog, *vbox;
-	GtkWidget *check, *label, *content_area;
+	GtkWidget *dialog, *vbox, *hbox;
+	GtkWidget *check, *combo, *label, *content_area;
 	PdmClearAllDialogButtons *checkbuttons;
 	GtkWidget *button;
 
@@ -391,12 +417,33 @@ pdm_dialog_show_clear_all_dialog (EphyDialog *edialog,
 	}
 
 	/* History */
+	hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 12);
+	gtk_box_pack_start (GTK_BOX (vbox), hbox,
+			    FALSE, FALSE, 0);
+
 	check = gtk_check_button_new_with_mnemonic (_("Hi_story"));
 	checkbuttons->checkbutton_history = check;
-	gtk_box_pack_start (GTK_BOX (vbox), check,
+	gtk_box_pack_start (GTK_BOX (hbox), check,
 			    FALSE, FALSE, 0);
 	g_signal_connect (check, "toggled",
 			  G_CALLBACK (clear_all_dialog_checkbutton_toggled_cb), checkbuttons);
+
+	combo = gtk_combo_box_text_new ();
+	gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), _("from the last hour"));
+	gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), _("from the last day"));
+	gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), _("from the last week"));
+	gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), _("from the last four weeks"));
+	gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), _("from all time"));
+	gtk_combo_box_set_active (GTK_COMBO_BOX (combo), G_N_ELEMENTS (history_ranges) - 1);
+	checkbuttons->combo_history_range = combo;
+	gtk_box_pack_start (GTK_BOX (hbox), combo,
+			    FALSE, FALSE, 0);
+
+	/* The range only makes sense when the history is cleared. */
+	g_object_bind_property (check, "active",
+				combo, "sensitive",
+				G_BINDING_SYNC_CREATE);
+
 	if (flags & CLEAR_ALL_HISTORY)
 	{
 		gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (check), TRUE);
@@ -68,8 +68,6 @@ struct PrefsDialogPrivate
 	GtkWidget *lang_remove_button;
 	GtkWidget *lang_up_button;
 	GtkWidget *lang_down_button;
-	GHashTable *iso_639_table;
-	GHashTable *iso_3166_table;
 };
 
 enum {
@@ -96,9 +94,6 @@ prefs_dialog_finalize (GObject *object)
 		g_object_unref (priv->add_lang_dialog);
 	}
 
-	g_hash_table_destroy (priv->iso_639_table);
-	g_hash_table_destroy (priv->iso_3166_table);
-
 	G_OBJECT_CLASS (prefs_dialog_parent_class)->finalize (object);
 }
 
@@ -430,15 +425,15 @@ get_name_for_lang_code (PrefsDialog *pd,
 	len = g_strv_length (str);
 	g_return_val_if_fail (len != 0, NULL);
 
-	langname = (const char *) g_hash_table_lookup (pd->priv->iso_639_table, str[0]);
+	langname = ephy_langs_iso_639_name (str[0]);
 
 	if (len == 1 && langname != NULL)
 	{
-		name = g_strdup (dgettext (ISO_639_DOMAIN, langname));
+		name = g_strdup (langname);
 	}
 	else if (len == 2 && langname != NULL)
 	{
-		localename = (const char *) g_hash_table_lookup (pd->priv->iso_3166_table, str[1]);
+		localename = ephy_langs_iso_3166_name (str[1]);
 
 		if (localename != NULL)
 		{
@@ -447,13 +442,12 @@ get_name_for_lang_code (PrefsDialog *pd,
 			 * "French (France)"
 			 */
 			name = g_strdup_printf (C_("language", "%s (%s)"),
-						dgettext (ISO_639_DOMAIN, langname),
-						dgettext (ISO_3166_DOMAIN, localename));
+						langname, localename);
 		}
 		else
 		{
 			name = g_strdup_printf (C_("language", "%s (%s)"),
-						dgettext (ISO_639_DOMAIN, langname), str[1]);
+						langname, str[1]);
 		}
 	}
 	else
@@ -717,9 +711,6 @@ create_language_section (EphyDialog *dialog)
 	char **list = NULL;
 	int i;
 
-	pd->priv->iso_639_table = ephy_langs_iso_639_table ();
-	pd->priv->iso_3166_table = ephy_langs_iso_3166_table ();
-
 	ephy_dialog_get_controls
 		(dialog,
 		 "lang_treeview", &treeview,
@@ -20,13 +20,22 @@
 
 #include "config.h"
 #include "ephy-bookmarks.h"
+#include "ephy-bookmarks-import.h"
 
 #include "ephy-debug.h"
 #include "ephy-file-helpers.h"
 #include "ephy-profile-utils.h"
 
+#include <glib/gstdio.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 const char* bookmarks_paths[] = { EPHY_BOOKMARKS_FILE, EPHY_BOOKMARKS_FILE_RDF };
 
+static GMainLoop *loop;
+
 static void
 clear_bookmark_files (void)
 {
@@ -97,6 +106,313 @@ test_ephy_bookmarks_set_address (void)
   clear_bookmark_files ();
 }
 
+static char *
+write_mozilla_bookmarks (guint n_bookmarks, guint n_duplicates)
+{
+  GString *html;
+  char *filename;
+  guint i;
+
+  html = g_string_new ("<!DOCTYPE NETSCAPE-Bookmark-file-1>\n"
+                       "<TITLE>Bookmarks</TITLE>\n"
+                       "<DL><p>\n"
+                       "<DT><H3>Imported</H3>\n"
+                       "<DL><p>\n");
+
+  for (i = 0; i < n_bookmarks; i++) {
+    if (i % 1000 == 0 && i > 0)
+      g_string_append_printf (html, "</DL><p>\n<DT><H3>Folder %u</H3>\n<DL><p>\n", i / 1000);
+
+    g_string_append_printf (html,
+                            "<DT><A HREF=\"http://www.example.com/%u\" ADD_DATE=\"0\">Page &amp; %u</A>\n",
+                            i % (n_bookmarks - n_duplicates), i);
+  }
+
+  g_string_append (html, "</DL><p>\n</DL><p>\n");
+
+  filename = g_build_filename (ephy_dot_dir (), "bookmarks.html", NULL);
+  g_assert (g_file_set_contents (filename, html->str, html->len, NULL));
+  g_string_free (html, TRUE);
+
+  return filename;
+}
+
+static void
+test_ephy_bookmarks_import_mozilla (void)
+{
+  EphyBookmarks *bookmarks;
+  EphyNode *node, *topic;
+  char *filename;
+  int before;
+
+  bookmarks = ephy_bookmarks_new ();
+  g_assert (bookmarks);
+
+  ephy_bookmarks_add (bookmarks, "Existing", "http://www.example.com/0");
+  before = ephy_node_get_n_children (ephy_bookmarks_get_bookmarks (bookmarks));
+
+  /* 10 entries, 3 of them pointing to addresses already in the file */
+  filename = write_mozilla_bookmarks (10, 3);
+  g_assert (ephy_bookmarks_import_mozilla (bookmarks, filename));
+
+  /* 7 distinct addresses, one of which was already bookmarked */
+  g_assert_cmpint (ephy_node_get_n_children (ephy_bookmarks_get_bookmarks (bookmarks)), ==, before + 6);
+
+  node = ephy_bookmarks_find_bookmark (bookmarks, "http://www.example.com/1");
+  g_assert (node);
+  g_assert_cmpstr (ephy_node_get_property_string (node, EPHY_NODE_BMK_PROP_TITLE), ==, "Page & 1");
+
+  topic = ephy_bookmarks_find_keyword (bookmarks, "Imported", FALSE);
+  g_assert (topic);
+  g_assert (ephy_bookmarks_has_keyword (bookmarks, topic, node));
+
+  /* Duplicates still get the topics of their folders */
+  node = ephy_bookmarks_find_bookmark (bookmarks, "http://www.example.com/0");
+  g_assert (ephy_bookmarks_has_keyword (bookmarks, topic, node));
+
+  g_unlink (filename);
+  g_free (filename);
+  g_object_unref (bookmarks);
+  clear_bookmark_files ();
+}
+
+static void
+import_finished_cb (GObject *source,
+                    GAsyncResult *result,
+                    gpointer user_data)
+{
+  GError **error = user_data;
+
+  ephy_bookmarks_import_finish (EPHY_BOOKMARKS (source), result, error);
+
+  g_main_loop_quit (loop);
+}
+
+static void
+count_progress_cb (guint n_done,
+                   guint n_total,
+                   gpointer user_data)
+{
+  guint *n_calls = user_data;
+
+  (*n_calls)++;
+}
+
+static void
+test_ephy_bookmarks_import_async_cancel (void)
+{
+  EphyBookmarks *bookmarks;
+  GCancellable *cancellable;
+  GError *error = NULL;
+  char *filename;
+  guint n_calls = 0;
+  int before;
+
+  bookmarks = ephy_bookmarks_new ();
+  before = ephy_node_get_n_children (ephy_bookmarks_get_bookmarks (bookmarks));
+
+  filename = write_mozilla_bookmarks (2000, 0);
+
+  cancellable = g_cancellable_new ();
+  ephy_bookmarks_import_async (bookmarks, filename, cancellable,
+                               count_progress_cb, &n_calls,
+                               import_finished_cb, &error);
+  g_cancellable_cancel (cancellable);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpint (ephy_node_get_n_children (ephy_bookmarks_get_bookmarks (bookmarks)), ==, before);
+
+  g_clear_error (&error);
+  g_object_unref (cancellable);
+  g_unlink (filename);
+  g_free (filename);
+  g_object_unref (bookmarks);
+  clear_bookmark_files ();
+}
+
+static void
+cancel_on_commit_cb (guint n_done,
+                     guint n_total,
+                     gpointer user_data)
+{
+  /* n_total is only known once the file is parsed */
+  if (n_total > 0)
+    g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+static void
+test_ephy_bookmarks_import_async_rollback (void)
+{
+  EphyBookmarks *bookmarks;
+  EphyNode *node;
+  GCancellable *cancellable;
+  GError *error = NULL;
+  char *filename;
+  int before;
+
+  bookmarks = ephy_bookmarks_new ();
+  node = ephy_bookmarks_add (bookmarks, "Existing", "http://www.example.com/0");
+  before = ephy_node_get_n_children (ephy_bookmarks_get_bookmarks (bookmarks));
+  g_assert (ephy_node_has_child (ephy_bookmarks_get_not_categorized (bookmarks), node));
+
+  filename = write_mozilla_bookmarks (2000, 0);
+
+  /* Cancelled after the first chunk, which gives the existing bookmark
+   * the "Imported" topic */
+  cancellable = g_cancellable_new ();
+  ephy_bookmarks_import_async (bookmarks, filename, cancellable,
+                               cancel_on_commit_cb, cancellable,
+                               import_finished_cb, &error);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpint (ephy_node_get_n_children (ephy_bookmarks_get_bookmarks (bookmarks)), ==, before);
+  g_assert (ephy_bookmarks_find_keyword (bookmarks, "Imported", FALSE) == NULL);
+  g_assert (ephy_bookmarks_find_bookmark (bookmarks, "http://www.example.com/0") == node);
+  g_assert (ephy_node_has_child (ephy_bookmarks_get_not_categorized (bookmarks), node));
+
+  g_clear_error (&error);
+  g_object_unref (cancellable);
+  g_unlink (filename);
+  g_free (filename);
+  g_object_unref (bookmarks);
+  clear_bookmark_files ();
+}
+
+#define IMPORT_N_BOOKMARKS 30000
+
+static void
+test_ephy_bookmarks_import_benchmark (void)
+{
+  EphyBookmarks *bookmarks;
+  GError *error = NULL;
+  char *filename;
+  guint n_calls = 0;
+  double elapsed;
+
+  bookmarks = ephy_bookmarks_new ();
+  filename = write_mozilla_bookmarks (IMPORT_N_BOOKMARKS, IMPORT_N_BOOKMARKS / 10);
+
+  g_test_timer_start ();
+
+  ephy_bookmarks_import_async (bookmarks, filename, NULL,
+                               count_progress_cb, &n_calls,
+                               import_finished_cb, &error);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_assert_no_error (error);
+  g_assert (n_calls > 0);
+
+  g_test_minimized_result (elapsed, "Imported %d bookmarks in %.2f seconds",
+                           IMPORT_N_BOOKMARKS, elapsed);
+
+  g_unlink (filename);
+  g_free (filename);
+  g_object_unref (bookmarks);
+  clear_bookmark_files ();
+}
+
+#ifdef __GLIBC__
+#define MEMORY_N_BOOKMARKS 50000
+#define MEMORY_N_HOSTS 500
+
+static const guint memory_properties[] = {
+  EPHY_NODE_BMK_PROP_TITLE,
+  EPHY_NODE_BMK_PROP_LOCATION,
+  EPHY_NODE_BMK_PROP_ICON,
+  EPHY_NODE_BMK_PROP_KEYWORDS
+};
+
+static char *
+get_memory_property (int i,
+                     guint property_id)
+{
+  int host = i % MEMORY_N_HOSTS;
+
+  switch (property_id) {
+  case EPHY_NODE_BMK_PROP_TITLE:
+    return g_strdup_printf ("Bookmark number %d", i);
+  case EPHY_NODE_BMK_PROP_LOCATION:
+    return g_strdup_printf ("http://www.host%d.example.com/page/%d", host, i);
+  case EPHY_NODE_BMK_PROP_ICON:
+    return g_strdup_printf ("http://www.host%d.example.com/favicon.ico", host);
+  case EPHY_NODE_BMK_PROP_KEYWORDS:
+    return g_strdup_printf ("bookmark number %d", i);
+  default:
+    g_assert_not_reached ();
+  }
+
+  return NULL;
+}
+
+static double
+measure_bookmarks (gboolean intern)
+{
+  struct mallinfo before, after;
+  EphyNodeDb *db;
+  EphyNode *root;
+  int i;
+  guint j;
+
+  before = mallinfo ();
+
+  db = ephy_node_db_new ("MemoryBenchmark");
+  if (intern)
+    ephy_node_db_set_interned_property (db, EPHY_NODE_BMK_PROP_ICON);
+  root = ephy_node_new (db);
+
+  for (i = 0; i < MEMORY_N_BOOKMARKS; i++) {
+    EphyNode *node = ephy_node_new (db);
+
+    for (j = 0; j < G_N_ELEMENTS (memory_properties); j++) {
+      char *string = get_memory_property (i, memory_properties[j]);
+
+      ephy_node_set_property_string (node, memory_properties[j], string);
+      g_free (string);
+    }
+
+    ephy_node_add_child (root, node);
+  }
+
+  after = mallinfo ();
+
+  g_object_unref (db);
+
+  return (double)(after.uordblks - before.uordblks) / MEMORY_N_BOOKMARKS;
+}
+
+/* The figure for the node layout itself can only be had by running this
+ * against the tree before it changed; only interning can be switched off
+ * here. */
+static void
+test_ephy_bookmarks_memory (void)
+{
+  double plain_bytes, bytes;
+
+  plain_bytes = measure_bookmarks (FALSE);
+  bytes = measure_bookmarks (TRUE);
+
+  g_test_message ("%d bookmarks: %.1f bytes per bookmark without interning, %.1f with (%.0f%%)",
+                  MEMORY_N_BOOKMARKS, plain_bytes, bytes, 100 * bytes / plain_bytes);
+  g_test_minimized_result (bytes, "%d bookmarks: %.1f bytes per bookmark",
+                           MEMORY_N_BOOKMARKS, bytes);
+
+  g_assert_cmpfloat (bytes, <, plain_bytes);
+}
+#endif
+
 int
 main (int argc, char *argv[])
 {
@@ -121,6 +437,25 @@ main (int argc, char *argv[])
   g_test_add_func ("/src/bookmarks/ephy-bookmarks/set_address",
                    test_ephy_bookmarks_set_address);
 
+  g_test_add_func ("/src/bookmarks/ephy-bookmarks/import_mozilla",
+                   test_ephy_bookmarks_import_mozilla);
+
+  g_test_add_func ("/src/bookmarks/ephy-bookmarks/import_async_cancel",
+                   test_ephy_bookmarks_import_async_cancel);
+
+  g_test_add_func ("/src/bookmarks/ephy-bookmarks/import_async_rollback",
+                   test_ephy_bookmarks_import_async_rollback);
+
+  if (g_test_perf ())
+    g_test_add_func ("/src/bookmarks/ephy-bookmarks/import_benchmark",
+                     test_ephy_bookmarks_import_benchmark);
+
+#ifdef __GLIBC__
+  if (g_test_perf ())
+    g_test_add_func ("/src/bookmarks/ephy-bookmarks/memory",
+                     test_ephy_bookmarks_memory);
+#endif
+
   ret = g_test_run ();
 
   return ret;
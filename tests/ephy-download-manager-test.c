@@ -0,0 +1,382 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-debug.h"
+#include "ephy-download.h"
+#include "ephy-download-manager.h"
+#include "ephy-embed-prefs.h"
+#include "ephy-embed-shell.h"
+#include "ephy-file-helpers.h"
+#include "ephy-private.h"
+#include "ephy-shell.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <libsoup/soup.h>
+#include <string.h>
+
+/* The body trickles in a chunk at a time, so WebKit reports data many
+ * more times than progress is worth showing. */
+#define CHUNK_SIZE 1024
+#define N_CHUNKS 40
+#define CHUNK_INTERVAL 20
+
+/* Keep in sync with ephy-download-manager.c */
+#define FRAME_INTERVAL_MS 250
+
+static SoupURI *base_uri;
+static char chunk[CHUNK_SIZE];
+
+typedef struct {
+  SoupServer *server;
+  SoupMessage *msg;
+  guint n_chunks;
+} SlowResponse;
+
+static gboolean
+write_chunk (SlowResponse *response)
+{
+  soup_message_body_append (response->msg->response_body, SOUP_MEMORY_STATIC,
+                            chunk, CHUNK_SIZE);
+  if (++response->n_chunks == N_CHUNKS)
+    soup_message_body_complete (response->msg->response_body);
+
+  soup_server_unpause_message (response->server, response->msg);
+
+  if (response->n_chunks < N_CHUNKS)
+    return TRUE;
+
+  g_object_unref (response->msg);
+  g_slice_free (SlowResponse, response);
+
+  return FALSE;
+}
+
+static void
+server_callback (SoupServer *server,
+                 SoupMessage *msg,
+                 const char *path,
+                 GHashTable *query,
+                 SoupClientContext *context,
+                 gpointer data)
+{
+  SlowResponse *response;
+
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_headers_set_content_length (msg->response_headers, CHUNK_SIZE * N_CHUNKS);
+
+  response = g_slice_new0 (SlowResponse);
+  response->server = server;
+  response->msg = g_object_ref (msg);
+
+  soup_server_pause_message (server, msg);
+  g_timeout_add (CHUNK_INTERVAL, (GSourceFunc)write_chunk, response);
+}
+
+static char *
+get_uri_for_path (const char *path)
+{
+  SoupURI *uri;
+  char *uri_string;
+
+  uri = soup_uri_new_with_base (base_uri, path);
+  uri_string = soup_uri_to_string (uri, FALSE);
+  soup_uri_free (uri);
+
+  return uri_string;
+}
+
+static char *
+get_tmp_destination_uri (void)
+{
+  char *tmp_filename;
+  char *filename;
+  char *uri;
+
+  tmp_filename = ephy_file_tmp_filename ("ephy-download-XXXXXX", NULL);
+  filename = g_build_filename (ephy_file_tmp_dir (), tmp_filename, NULL);
+  uri = g_filename_to_uri (filename, NULL, NULL);
+  g_free (tmp_filename);
+  g_free (filename);
+
+  return uri;
+}
+
+static void
+count_cb (gpointer instance,
+          guint *count)
+{
+  (*count)++;
+}
+
+static void
+received_data_cb (WebKitDownload *download,
+                  guint64 data_length,
+                  guint *count)
+{
+  (*count)++;
+}
+
+static void
+completed_cb (EphyDownload *download,
+              GMainLoop *loop)
+{
+  g_main_loop_quit (loop);
+}
+
+static void
+wait_for_download (EphyDownload *download)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+  g_signal_connect (download, "completed", G_CALLBACK (completed_cb), loop);
+  ephy_download_set_action (download, EPHY_DOWNLOAD_ACTION_DO_NOTHING);
+  ephy_download_start (download);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+}
+
+static void
+test_progress_is_coalesced (void)
+{
+  EphyDownloadManager *manager;
+  EphyDownloadRecord *record;
+  EphyDownload *download;
+  GTimer *timer;
+  char *source, *destination;
+  guint n_received = 0, n_progress = 0;
+  double elapsed;
+
+  manager = ephy_embed_shell_get_download_manager (ephy_embed_shell_get_default ());
+
+  source = get_uri_for_path ("/slow");
+  destination = get_tmp_destination_uri ();
+  download = ephy_download_new_for_uri (source, NULL);
+  ephy_download_set_destination_uri (download, destination);
+
+  g_signal_connect (ephy_download_get_webkit_download (download), "received-data",
+                    G_CALLBACK (received_data_cb), &n_received);
+  g_signal_connect (download, "progress", G_CALLBACK (count_cb), &n_progress);
+
+  timer = g_timer_new ();
+  wait_for_download (download);
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  /* At most one update per frame, plus the last one. */
+  g_assert_cmpuint (n_progress, >, 0);
+  g_assert_cmpuint (n_progress, <=, elapsed * 1000 / FRAME_INTERVAL_MS + 2);
+  g_assert_cmpuint (n_progress, <, n_received);
+
+  g_assert_cmpfloat (ephy_download_get_remaining_time (download), ==, 0);
+
+  record = ephy_download_manager_get_records (manager)->data;
+  g_assert_cmpstr (record->source, ==, source);
+  g_assert_cmpstr (record->destination, ==, destination);
+  g_assert_cmpint (record->state, ==, EPHY_DOWNLOAD_STATE_FINISHED);
+  g_assert_cmpuint (record->received_bytes, ==, CHUNK_SIZE * N_CHUNKS);
+  g_assert_cmpuint (record->total_bytes, ==, CHUNK_SIZE * N_CHUNKS);
+
+  g_object_unref (download);
+  g_free (source);
+  g_free (destination);
+}
+
+static char *
+get_interrupted_destination (void)
+{
+  char *path;
+  char *uri;
+
+  path = g_build_filename (ephy_file_tmp_dir (), "interrupted.iso", NULL);
+  uri = g_filename_to_uri (path, NULL, NULL);
+  g_free (path);
+
+  return uri;
+}
+
+static char *
+create_store (const char *source)
+{
+  char *filename;
+  char *destination;
+  char *contents;
+
+  filename = g_build_filename (ephy_file_tmp_dir (), "downloads.ini", NULL);
+  destination = get_interrupted_destination ();
+  contents = g_strdup_printf ("[download-3]\n"
+                              "source=%s\n"
+                              "destination=%s\n"
+                              "received=1024\n"
+                              "total=4096\n"
+                              "state=in-progress\n"
+                              "start-time=1000\n"
+                              "\n"
+                              "[download-5]\n"
+                              "source=http://www.example.com/finished.iso\n"
+                              "destination=file:///tmp/finished.iso\n"
+                              "received=4096\n"
+                              "total=4096\n"
+                              "state=finished\n"
+                              "start-time=2000\n"
+                              "end-time=2010\n",
+                              source, destination);
+  g_file_set_contents (filename, contents, -1, NULL);
+  g_free (contents);
+  g_free (destination);
+
+  return filename;
+}
+
+static void
+test_records_persist (void)
+{
+  EphyDownloadManager *manager;
+  EphyDownloadRecord *record;
+  GList *records;
+  char *filename;
+  char *destination;
+
+  filename = create_store ("http://www.example.com/interrupted.iso");
+  manager = ephy_download_manager_new (filename);
+
+  /* Newest first, and what was running did not finish. */
+  records = ephy_download_manager_get_records (manager);
+  g_assert_cmpuint (g_list_length (records), ==, 2);
+
+  record = records->data;
+  g_assert_cmpuint (record->id, ==, 5);
+  g_assert_cmpint (record->state, ==, EPHY_DOWNLOAD_STATE_FINISHED);
+  g_assert_cmpint (record->end_time, ==, 2010);
+
+  record = records->next->data;
+  g_assert_cmpuint (record->id, ==, 3);
+  g_assert_cmpstr (record->source, ==, "http://www.example.com/interrupted.iso");
+  destination = get_interrupted_destination ();
+  g_assert_cmpstr (record->destination, ==, destination);
+  g_free (destination);
+  g_assert_cmpuint (record->received_bytes, ==, 1024);
+  g_assert_cmpuint (record->total_bytes, ==, 4096);
+  g_assert_cmpint (record->state, ==, EPHY_DOWNLOAD_STATE_INTERRUPTED);
+
+  ephy_download_manager_remove_record (manager, 5);
+  g_object_unref (manager);
+
+  manager = ephy_download_manager_new (filename);
+  records = ephy_download_manager_get_records (manager);
+  g_assert_cmpuint (g_list_length (records), ==, 1);
+  record = records->data;
+  g_assert_cmpuint (record->id, ==, 3);
+  g_assert_cmpint (record->state, ==, EPHY_DOWNLOAD_STATE_INTERRUPTED);
+  g_object_unref (manager);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+test_resume (void)
+{
+  EphyDownloadManager *manager;
+  EphyDownload *download;
+  char *source, *filename, *destination, *path;
+  char *contents;
+  gsize length;
+
+  source = get_uri_for_path ("/interrupted");
+  filename = create_store (source);
+  manager = ephy_download_manager_new (filename);
+
+  /* What the interrupted download had written so far. */
+  destination = get_interrupted_destination ();
+  path = g_filename_from_uri (destination, NULL, NULL);
+  g_assert (g_file_set_contents (path, chunk, CHUNK_SIZE, NULL));
+
+  download = ephy_download_manager_resume (manager, 3, NULL);
+  g_assert (EPHY_IS_DOWNLOAD (download));
+  g_assert_cmpstr (ephy_download_get_source_uri (download), ==, source);
+  g_assert_cmpuint (g_list_length (ephy_download_manager_get_records (manager)), ==, 1);
+
+  /* It goes where the interrupted one was going, replacing the partial file. */
+  wait_for_download (download);
+  g_assert_cmpstr (ephy_download_get_destination_uri (download), ==, destination);
+  g_assert (g_file_get_contents (path, &contents, &length, NULL));
+  g_assert_cmpuint (length, ==, CHUNK_SIZE * N_CHUNKS);
+  g_free (contents);
+  g_unlink (path);
+  g_free (path);
+  g_free (destination);
+
+  g_object_unref (download);
+  g_object_unref (manager);
+  g_unlink (filename);
+  g_free (filename);
+  g_free (source);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+  SoupServer *server;
+
+  gtk_test_init (&argc, &argv);
+
+  ephy_debug_init ();
+  ephy_embed_prefs_init ();
+
+  if (!ephy_file_helpers_init (NULL,
+                               EPHY_FILE_HELPERS_PRIVATE_PROFILE | EPHY_FILE_HELPERS_ENSURE_EXISTS,
+                               NULL)) {
+    g_debug ("Something wrong happened with ephy_file_helpers_init()");
+    return -1;
+  }
+
+  _ephy_shell_create_instance (EPHY_EMBED_SHELL_MODE_TEST);
+
+  memset (chunk, 'x', CHUNK_SIZE);
+
+  server = soup_server_new (SOUP_SERVER_PORT, 0, NULL);
+  soup_server_run_async (server);
+
+  base_uri = soup_uri_new ("http://127.0.0.1/");
+  soup_uri_set_port (base_uri, soup_server_get_port (server));
+
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+
+  g_test_add_func ("/embed/ephy-download-manager/progress_is_coalesced",
+                   test_progress_is_coalesced);
+  g_test_add_func ("/embed/ephy-download-manager/records_persist",
+                   test_records_persist);
+  g_test_add_func ("/embed/ephy-download-manager/resume",
+                   test_resume);
+
+  ret = g_test_run ();
+
+  g_object_unref (ephy_shell_get_default ());
+  ephy_file_helpers_shutdown ();
+
+  soup_uri_free (base_uri);
+  g_object_unref (server);
+
+  return ret;
+}
@@ -27,7 +27,9 @@
 #include "ephy-download.h"
 #include "ephy-embed-prefs.h"
 #include "ephy-file-helpers.h"
+#include "ephy-prefs.h"
 #include "ephy-private.h"
+#include "ephy-settings.h"
 #include "ephy-shell.h"
 
 #include <glib.h>
@@ -65,6 +67,17 @@ server_callback (SoupServer *server,
   if (g_str_equal (path, "/cancelled"))
     soup_message_set_status (msg, SOUP_STATUS_CANT_CONNECT);
 
+  if (g_str_equal (path, "/text"))
+    soup_message_headers_append (msg->response_headers, "Content-Type", "text/plain");
+
+  if (g_str_has_prefix (path, "/attachment/")) {
+    char *disposition;
+
+    disposition = g_strdup_printf ("attachment; filename=%s", path + strlen ("/attachment/"));
+    soup_message_headers_append (msg->response_headers, "Content-Disposition", disposition);
+    g_free (disposition);
+  }
+
   soup_message_body_append (msg->response_body, SOUP_MEMORY_STATIC,
                             HTML_STRING, strlen (HTML_STRING));
 
@@ -156,6 +169,202 @@ test_ephy_download_start (Fixture *fixture, gconstpointer data)
   g_main_loop_run (fixture->loop);
 }
 
+static void
+content_type_cb (EphyDownload *download,
+                 GAsyncResult *result,
+                 Fixture *fixture)
+{
+  char *content_type;
+
+  content_type = ephy_download_get_content_type_finish (download, result, NULL);
+  g_assert_cmpstr (content_type, ==, "text/plain");
+  g_free (content_type);
+
+  g_main_loop_quit (fixture->loop);
+}
+
+static void
+completed_get_content_type_cb (EphyDownload *download,
+                               Fixture *fixture)
+{
+  ephy_download_get_content_type_async (download, NULL,
+                                        (GAsyncReadyCallback)content_type_cb,
+                                        fixture);
+}
+
+static void
+test_ephy_download_content_type (Fixture *fixture, gconstpointer data)
+{
+  EphyDownload *download;
+  char *source;
+  char *tmp_filename;
+  char *destination;
+
+  tmp_filename = ephy_file_tmp_filename ("ephy-download-XXXXXX", NULL);
+  destination = g_build_filename (ephy_file_tmp_dir (), tmp_filename, NULL);
+  g_free (tmp_filename);
+
+  source = get_uri_for_path ("/text");
+  download = ephy_download_new_for_uri (source, NULL);
+  g_free (source);
+
+  tmp_filename = g_filename_to_uri (destination, NULL, NULL);
+  ephy_download_set_destination_uri (download, tmp_filename);
+  g_free (tmp_filename);
+  g_free (destination);
+
+  g_signal_connect (G_OBJECT (download), "completed",
+                    G_CALLBACK (completed_get_content_type_cb), fixture);
+
+  ephy_download_set_action (download, EPHY_DOWNLOAD_ACTION_DO_NOTHING);
+  ephy_download_start (download);
+  g_main_loop_run (fixture->loop);
+
+  g_object_unref (download);
+}
+
+typedef struct {
+  GMainLoop *loop;
+  GPtrArray *paths;
+  guint pending;
+} AllocateData;
+
+static void
+destination_completed_cb (EphyDownload *download,
+                          AllocateData *data)
+{
+  char *path;
+
+  path = g_filename_from_uri (ephy_download_get_destination_uri (download), NULL, NULL);
+  g_assert (g_file_test (path, G_FILE_TEST_IS_REGULAR));
+  g_ptr_array_add (data->paths, path);
+
+  if (--data->pending == 0)
+    g_main_loop_quit (data->loop);
+}
+
+/* Downloads @filename into the downloads directory @n_downloads times at
+ * once, letting WebKit ask where each one goes. */
+static void
+download_attachments (const char *filename,
+                      guint n_downloads,
+                      GPtrArray *paths)
+{
+  AllocateData data;
+  GPtrArray *downloads;
+  char *path;
+  char *source;
+  guint i;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.paths = paths;
+  data.pending = n_downloads;
+
+  path = g_strconcat ("/attachment/", filename, NULL);
+  source = get_uri_for_path (path);
+  g_free (path);
+
+  downloads = g_ptr_array_new_with_free_func (g_object_unref);
+  for (i = 0; i < n_downloads; i++) {
+    EphyDownload *download;
+
+    download = ephy_download_new_for_uri (source, NULL);
+    ephy_download_set_action (download, EPHY_DOWNLOAD_ACTION_DO_NOTHING);
+    g_signal_connect (download, "completed",
+                      G_CALLBACK (destination_completed_cb), &data);
+    g_ptr_array_add (downloads, download);
+  }
+
+  g_main_loop_run (data.loop);
+  g_main_loop_unref (data.loop);
+
+  g_ptr_array_free (downloads, TRUE);
+  g_free (source);
+}
+
+static void
+remove_directory (const char *directory)
+{
+  const char *name;
+  GDir *dir;
+
+  dir = g_dir_open (directory, 0, NULL);
+  while ((name = g_dir_read_name (dir)) != NULL) {
+    char *path = g_build_filename (directory, name, NULL);
+
+    g_unlink (path);
+    g_free (path);
+  }
+  g_dir_close (dir);
+
+  g_rmdir (directory);
+}
+
+#define N_COLLISIONS 5000
+
+static void
+test_ephy_download_decide_destination (void)
+{
+  GPtrArray *paths;
+  char *directory;
+  char *path;
+  int i;
+
+  directory = g_dir_make_tmp ("ephy-download-XXXXXX", NULL);
+  g_assert (directory);
+
+  g_settings_set_string (EPHY_SETTINGS_STATE,
+                         EPHY_PREFS_STATE_DOWNLOAD_DIR,
+                         directory);
+
+  paths = g_ptr_array_new_with_free_func (g_free);
+
+  /* A free name is used as it is. */
+  download_attachments ("page.html", 1, paths);
+  path = g_build_filename (directory, "page.html", NULL);
+  g_assert_cmpstr (g_ptr_array_index (paths, 0), ==, path);
+  g_free (path);
+  g_ptr_array_set_size (paths, 0);
+
+  /* The same name downloaded thousands of times, with a gap. */
+  for (i = 0; i <= N_COLLISIONS; i++) {
+    if (i == N_COLLISIONS / 2)
+      continue;
+
+    if (i == 0)
+      path = g_build_filename (directory, "archive.tar.gz", NULL);
+    else {
+      char *name = g_strdup_printf ("archive(%d).tar.gz", i);
+
+      path = g_build_filename (directory, name, NULL);
+      g_free (name);
+    }
+    g_file_set_contents (path, "", 0, NULL);
+    g_free (path);
+  }
+
+  download_attachments ("archive.tar.gz", 1, paths);
+  path = g_strdup_printf ("%s" G_DIR_SEPARATOR_S "archive(%d).tar.gz", directory, N_COLLISIONS + 1);
+  g_assert_cmpstr (g_ptr_array_index (paths, 0), ==, path);
+  g_free (path);
+
+  /* Downloads racing for the name each get their own file. */
+  download_attachments ("archive.tar.gz", 16, paths);
+  g_assert_cmpuint (paths->len, ==, 17);
+  for (i = 0; i < paths->len; i++) {
+    int j;
+
+    for (j = i + 1; j < paths->len; j++)
+      g_assert_cmpstr (g_ptr_array_index (paths, i), !=, g_ptr_array_index (paths, j));
+  }
+
+  g_ptr_array_free (paths, TRUE);
+  remove_directory (directory);
+  g_free (directory);
+
+  g_settings_reset (EPHY_SETTINGS_STATE, EPHY_PREFS_STATE_DOWNLOAD_DIR);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -193,6 +402,11 @@ main (int argc, char *argv[])
   g_test_add ("/embed/ephy-download/start",
               Fixture, NULL, fixture_setup,
               test_ephy_download_start, fixture_teardown);
+  g_test_add ("/embed/ephy-download/content_type",
+              Fixture, NULL, fixture_setup,
+              test_ephy_download_content_type, fixture_teardown);
+  g_test_add_func ("/embed/ephy-download/decide_destination",
+                   test_ephy_download_decide_destination);
 
   ret = g_test_run ();
 
@@ -0,0 +1,256 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ * Copyright © 2013 Igalia S.L.
+ *
+ * Epiphany is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Epiphany is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Epiphany; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "ephy-debug.h"
+#include "ephy-favicon-cache.h"
+#include "ephy-file-helpers.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <webkit2/webkit2.h>
+
+/* FAVICON_CACHE_MAX_ENTRIES in lib/ephy-favicon-cache.c. */
+#define CACHE_SIZE 512
+
+#define FAVICON_SIZE 16
+
+typedef struct {
+  GMainLoop *loop;
+  GdkPixbuf *favicon;
+} FaviconResult;
+
+static void
+favicon_cb (EphyFaviconCache *cache,
+            GAsyncResult *result,
+            FaviconResult *data)
+{
+  data->favicon = ephy_favicon_cache_get_favicon_finish (cache, result, NULL);
+  g_main_loop_quit (data->loop);
+}
+
+static GdkPixbuf *
+get_favicon (EphyFaviconCache *cache,
+             const char *page_uri)
+{
+  FaviconResult data;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.favicon = NULL;
+
+  ephy_favicon_cache_get_favicon_async (cache, page_uri, FAVICON_SIZE, NULL,
+                                        (GAsyncReadyCallback)favicon_cb, &data);
+  g_main_loop_run (data.loop);
+  g_main_loop_unref (data.loop);
+
+  return data.favicon;
+}
+
+static gboolean
+is_cached (EphyFaviconCache *cache,
+           const char *page_uri)
+{
+  GdkPixbuf *favicon = NULL;
+  gboolean cached;
+
+  cached = ephy_favicon_cache_lookup (cache, page_uri, FAVICON_SIZE, &favicon);
+  if (favicon)
+    g_object_unref (favicon);
+
+  return cached;
+}
+
+static char *
+page_uri_for_index (int i)
+{
+  return g_strdup_printf ("http://page%d.favicon-cache-test.invalid/", i);
+}
+
+static void
+ensure_database_initialized (void)
+{
+  static gboolean initialized = FALSE;
+
+  if (initialized)
+    return;
+
+  webkit_web_context_set_favicon_database_directory (webkit_web_context_get_default (),
+                                                     ephy_dot_dir ());
+  initialized = TRUE;
+}
+
+static void
+test_error_not_cached (void)
+{
+  EphyFaviconCache *cache;
+  GdkPixbuf *favicon;
+  char *page_uri;
+
+  /* Must run before any other test opens the database, so that the
+   * query fails instead of answering "unknown". */
+  cache = g_object_new (EPHY_TYPE_FAVICON_CACHE, NULL);
+  page_uri = page_uri_for_index (0);
+
+  favicon = get_favicon (cache, page_uri);
+  g_assert (favicon == NULL);
+  g_assert (!is_cached (cache, page_uri));
+
+  g_free (page_uri);
+  g_object_unref (cache);
+}
+
+static void
+test_miss_is_cached (void)
+{
+  EphyFaviconCache *cache;
+  GdkPixbuf *favicon;
+  char *page_uri;
+
+  ensure_database_initialized ();
+
+  cache = g_object_new (EPHY_TYPE_FAVICON_CACHE, NULL);
+  page_uri = page_uri_for_index (0);
+  g_assert (!is_cached (cache, page_uri));
+
+  favicon = get_favicon (cache, page_uri);
+  g_assert (favicon == NULL);
+
+  /* The page has no favicon, and the cache now knows it. */
+  favicon = (GdkPixbuf *)0x1;
+  g_assert (ephy_favicon_cache_lookup (cache, page_uri, FAVICON_SIZE, &favicon));
+  g_assert (favicon == NULL);
+
+  /* Other sizes are separate entries. */
+  g_assert (!ephy_favicon_cache_lookup (cache, page_uri, FAVICON_SIZE * 2, &favicon));
+
+  g_free (page_uri);
+  g_object_unref (cache);
+}
+
+static void
+test_hit (void)
+{
+  EphyFaviconCache *cache;
+  GdkPixbuf *favicon;
+  char *page_uri;
+
+  ensure_database_initialized ();
+
+  cache = g_object_new (EPHY_TYPE_FAVICON_CACHE, NULL);
+  page_uri = page_uri_for_index (0);
+
+  favicon = get_favicon (cache, page_uri);
+  g_assert (favicon == NULL);
+  g_assert (is_cached (cache, page_uri));
+
+  /* Answered from the cache, and still cached afterwards. */
+  favicon = get_favicon (cache, page_uri);
+  g_assert (favicon == NULL);
+  g_assert (is_cached (cache, page_uri));
+
+  /* Until the favicon changes. */
+  ephy_favicon_cache_invalidate (cache, page_uri);
+  g_assert (!is_cached (cache, page_uri));
+
+  g_free (page_uri);
+  g_object_unref (cache);
+}
+
+static void
+test_eviction (void)
+{
+  EphyFaviconCache *cache;
+  char *page_uri;
+  int i;
+
+  ensure_database_initialized ();
+
+  cache = g_object_new (EPHY_TYPE_FAVICON_CACHE, NULL);
+
+  for (i = 0; i < CACHE_SIZE; i++) {
+    page_uri = page_uri_for_index (i);
+    g_assert (get_favicon (cache, page_uri) == NULL);
+    g_free (page_uri);
+  }
+
+  for (i = 0; i < CACHE_SIZE; i++) {
+    page_uri = page_uri_for_index (i);
+    g_assert (is_cached (cache, page_uri));
+    g_free (page_uri);
+  }
+
+  /* The lookups above left page 0 the least recently used. Use it
+   * again, so page 1 is the one to go. */
+  page_uri = page_uri_for_index (0);
+  g_assert (is_cached (cache, page_uri));
+  g_free (page_uri);
+
+  page_uri = page_uri_for_index (CACHE_SIZE);
+  g_assert (get_favicon (cache, page_uri) == NULL);
+  g_assert (is_cached (cache, page_uri));
+  g_free (page_uri);
+
+  page_uri = page_uri_for_index (1);
+  g_assert (!is_cached (cache, page_uri));
+  g_free (page_uri);
+
+  page_uri = page_uri_for_index (0);
+  g_assert (is_cached (cache, page_uri));
+  g_free (page_uri);
+
+  page_uri = page_uri_for_index (2);
+  g_assert (is_cached (cache, page_uri));
+  g_free (page_uri);
+
+  g_object_unref (cache);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+  gtk_test_init (&argc, &argv);
+
+  ephy_debug_init ();
+
+  if (!ephy_file_helpers_init (NULL,
+                               EPHY_FILE_HELPERS_PRIVATE_PROFILE | EPHY_FILE_HELPERS_ENSURE_EXISTS,
+                               NULL)) {
+    g_debug ("Something wrong happened with ephy_file_helpers_init()");
+    return -1;
+  }
+
+  /* Must be first, see the test. */
+  g_test_add_func ("/lib/ephy-favicon-cache/error_not_cached",
+                   test_error_not_cached);
+  g_test_add_func ("/lib/ephy-favicon-cache/miss_is_cached",
+                   test_miss_is_cached);
+  g_test_add_func ("/lib/ephy-favicon-cache/hit",
+                   test_hit);
+  g_test_add_func ("/lib/ephy-favicon-cache/eviction",
+                   test_eviction);
+
+  ret = g_test_run ();
+
+  ephy_file_helpers_shutdown ();
+
+  return ret;
+}
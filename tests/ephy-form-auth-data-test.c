@@ -0,0 +1,144 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ * Copyright © 2013 Igalia S.L.
+ *
+ * Epiphany is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Epiphany is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Epiphany; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "ephy-debug.h"
+#include "ephy-form-auth-data.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+/* No login is ever saved for it. */
+#define TEST_HOST "form-auth-data-test.invalid"
+
+typedef struct {
+  guint n_calls;
+  GSList *auth_data_list;
+  GMainLoop *loop;
+} QueryResult;
+
+static void
+query_cb (GSList *auth_data_list,
+          QueryResult *result)
+{
+  result->n_calls++;
+  result->auth_data_list = auth_data_list;
+
+  if (result->loop)
+    g_main_loop_quit (result->loop);
+}
+
+static void
+wait_for_query (EphyFormAuthDataCache *cache,
+                QueryResult *result)
+{
+  ephy_form_auth_data_cache_query_host (cache, TEST_HOST,
+                                        (EphyFormAuthDataCacheQueryCallback)query_cb,
+                                        result);
+  if (result->n_calls > 0)
+    return;
+
+  result->loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (result->loop);
+  g_main_loop_unref (result->loop);
+  result->loop = NULL;
+}
+
+static void
+test_query_waits_for_load (void)
+{
+  EphyFormAuthDataCache *cache;
+  QueryResult result = { 0, NULL, NULL };
+
+  /* The secret service search cannot have finished yet. */
+  cache = ephy_form_auth_data_cache_new ();
+  ephy_form_auth_data_cache_add (cache, TEST_HOST, "user", "pass", "me");
+
+  wait_for_query (cache, &result);
+  g_assert_cmpuint (result.n_calls, ==, 1);
+  g_assert_cmpuint (g_slist_length (result.auth_data_list), ==, 1);
+
+  /* Loaded now, so answered right away. */
+  ephy_form_auth_data_cache_query_host (cache, TEST_HOST,
+                                        (EphyFormAuthDataCacheQueryCallback)query_cb,
+                                        &result);
+  g_assert_cmpuint (result.n_calls, ==, 2);
+  g_assert (result.auth_data_list == ephy_form_auth_data_cache_get_list (cache, TEST_HOST));
+
+  ephy_form_auth_data_cache_free (cache);
+}
+
+static void
+test_free_runs_pending_queries (void)
+{
+  EphyFormAuthDataCache *cache;
+  QueryResult result = { 0, NULL, NULL };
+
+  cache = ephy_form_auth_data_cache_new ();
+  ephy_form_auth_data_cache_add (cache, TEST_HOST, "user", "pass", "me");
+  ephy_form_auth_data_cache_query_host (cache, TEST_HOST,
+                                        (EphyFormAuthDataCacheQueryCallback)query_cb,
+                                        &result);
+  g_assert_cmpuint (result.n_calls, ==, 0);
+
+  /* Pending queries are not dropped, so their data can be freed. */
+  ephy_form_auth_data_cache_free (cache);
+  g_assert_cmpuint (result.n_calls, ==, 1);
+  g_assert (result.auth_data_list == NULL);
+}
+
+static void
+test_add_ignores_duplicates (void)
+{
+  EphyFormAuthDataCache *cache;
+  GSList *list;
+  EphyFormAuthData *data;
+
+  cache = ephy_form_auth_data_cache_new ();
+  ephy_form_auth_data_cache_add (cache, TEST_HOST, "user", "pass", "me");
+  ephy_form_auth_data_cache_add (cache, TEST_HOST, "user", "pass", "me");
+  ephy_form_auth_data_cache_add (cache, TEST_HOST, "user", "pass", "someone");
+
+  list = ephy_form_auth_data_cache_get_list (cache, TEST_HOST);
+  g_assert_cmpuint (g_slist_length (list), ==, 2);
+  data = (EphyFormAuthData *)list->data;
+  g_assert_cmpstr (data->username, ==, "me");
+  data = (EphyFormAuthData *)list->next->data;
+  g_assert_cmpstr (data->username, ==, "someone");
+
+  ephy_form_auth_data_cache_free (cache);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gtk_test_init (&argc, &argv);
+
+  ephy_debug_init ();
+
+  g_test_add_func ("/lib/ephy-form-auth-data/query_waits_for_load",
+                   test_query_waits_for_load);
+  g_test_add_func ("/lib/ephy-form-auth-data/free_runs_pending_queries",
+                   test_free_runs_pending_queries);
+  g_test_add_func ("/lib/ephy-form-auth-data/add_ignores_duplicates",
+                   test_add_ignores_duplicates);
+
+  return g_test_run ();
+}
@@ -0,0 +1,759 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* Times every kind of history service message against a large,
+ * synthetic but deterministic profile, and prints the results as JSON:
+ *
+ *   ./ephy-history-benchmark --urls=50000 --visits=500000 > before.json
+ *
+ * The same seed always generates the same database, so runs before and
+ * after a change to the SQL or the schema can be compared. */
+
+#include "config.h"
+#include "ephy-history-service.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <string.h>
+
+/* Visits are spread over the 90 days before this time, so that the
+ * database does not depend on when the benchmark runs. */
+#define BASE_TIME G_GINT64_CONSTANT (1380000000)
+#define HISTORY_SPAN (90 * 24 * 60 * 60)
+
+#define POPULATE_BATCH_SIZE 1000
+#define ADD_VISITS_BATCH_SIZE 100
+#define DELETE_URLS_BATCH_SIZE 10
+
+static int n_urls = 20000;
+static int n_hosts = 1000;
+static int n_visits = 100000;
+static int iterations = 20;
+static int seed = 42;
+static double zipf_exponent = 1.0;
+static char *database_path = NULL;
+static char *output_path = NULL;
+
+static const GOptionEntry option_entries[] = {
+  { "urls", 0, 0, G_OPTION_ARG_INT, &n_urls, "Number of URLs", "N" },
+  { "hosts", 0, 0, G_OPTION_ARG_INT, &n_hosts, "Number of hosts", "N" },
+  { "visits", 0, 0, G_OPTION_ARG_INT, &n_visits, "Number of visits", "N" },
+  { "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Times each operation is run", "N" },
+  { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed of the generated data", "SEED" },
+  { "zipf-exponent", 0, 0, G_OPTION_ARG_DOUBLE, &zipf_exponent, "Skew of the host and URL popularity", "S" },
+  { "database", 0, 0, G_OPTION_ARG_FILENAME, &database_path, "Where to create the database", "FILE" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_path, "Write the results to FILE instead of stdout", "FILE" },
+  { NULL }
+};
+
+typedef struct {
+  double *cdf;
+  guint n;
+} Zipf;
+
+typedef struct {
+  EphyHistoryService *service;
+  GRand *rand;
+  Zipf *host_popularity;
+  Zipf *url_popularity;
+
+  /* URLs by popularity, most visited first. */
+  char **urls;
+
+  GString *json;
+  guint n_results;
+} Benchmark;
+
+typedef struct {
+  GMainLoop *loop;
+  gboolean success;
+  gpointer result;
+} Job;
+
+typedef gpointer (*OperationSetupFunc) (Benchmark *benchmark, guint iteration);
+typedef void     (*OperationRunFunc)   (Benchmark *benchmark, gpointer data, Job *job);
+
+typedef struct {
+  const char *name;
+  const char *message;
+  OperationSetupFunc setup;
+  OperationRunFunc run;
+  GDestroyNotify free_data;
+  GDestroyNotify free_result;
+  gboolean once;
+} Operation;
+
+static Zipf *
+zipf_new (guint n,
+          double exponent)
+{
+  Zipf *zipf;
+  double total = 0;
+  guint i;
+
+  zipf = g_slice_new (Zipf);
+  zipf->n = n;
+  zipf->cdf = g_new (double, n);
+
+  for (i = 0; i < n; i++) {
+    total += 1.0 / pow (i + 1, exponent);
+    zipf->cdf[i] = total;
+  }
+  for (i = 0; i < n; i++)
+    zipf->cdf[i] /= total;
+
+  return zipf;
+}
+
+static void
+zipf_free (Zipf *zipf)
+{
+  g_free (zipf->cdf);
+  g_slice_free (Zipf, zipf);
+}
+
+/* Returns a rank in [0, n), 0 being the most popular. */
+static guint
+zipf_sample (Zipf *zipf,
+             GRand *rand)
+{
+  double u = g_rand_double (rand);
+  guint low = 0, high = zipf->n - 1;
+
+  while (low < high) {
+    guint middle = (low + high) / 2;
+
+    if (zipf->cdf[middle] < u)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return low;
+}
+
+static void
+job_done_cb (EphyHistoryService *service,
+             gboolean success,
+             gpointer result_data,
+             Job *job)
+{
+  job->success = success;
+  job->result = result_data;
+  g_main_loop_quit (job->loop);
+}
+
+static void
+host_list_free (GList *hosts)
+{
+  g_list_free_full (hosts, (GDestroyNotify)ephy_history_host_free);
+}
+
+static void
+string_list_free (GList *strings)
+{
+  g_list_free_full (strings, g_free);
+}
+
+static const char *
+random_url (Benchmark *benchmark)
+{
+  return benchmark->urls[zipf_sample (benchmark->url_popularity, benchmark->rand)];
+}
+
+static EphyHistoryPageVisit *
+random_visit (Benchmark *benchmark,
+              gint64 visit_time)
+{
+  EphyHistoryPageVisitType visit_type;
+
+  visit_type = g_rand_int_range (benchmark->rand, 0, 10) == 0 ? EPHY_PAGE_VISIT_TYPED : EPHY_PAGE_VISIT_LINK;
+
+  return ephy_history_page_visit_new (random_url (benchmark), visit_time, visit_type);
+}
+
+static char *
+host_name (guint rank)
+{
+  return g_strdup_printf ("www.host%u.example.com", rank);
+}
+
+static void
+generate_urls (Benchmark *benchmark)
+{
+  guint i;
+
+  benchmark->urls = g_new0 (char *, n_urls + 1);
+  for (i = 0; i < n_urls; i++) {
+    guint host = zipf_sample (benchmark->host_popularity, benchmark->rand);
+
+    benchmark->urls[i] = g_strdup_printf ("http://www.host%u.example.com/%s/page%u.html",
+                                          host, i % 3 ? "news" : "blog", i);
+  }
+}
+
+static double
+populate (Benchmark *benchmark)
+{
+  GTimer *timer;
+  double elapsed;
+  guint i;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < n_visits; i += POPULATE_BATCH_SIZE) {
+    GList *visits = NULL;
+    Job job = { NULL, FALSE, NULL };
+    guint j;
+
+    for (j = i; j < MIN (i + POPULATE_BATCH_SIZE, n_visits); j++) {
+      gint64 visit_time = BASE_TIME - g_rand_int_range (benchmark->rand, 0, HISTORY_SPAN);
+
+      visits = g_list_prepend (visits, random_visit (benchmark, visit_time));
+    }
+
+    job.loop = g_main_loop_new (NULL, FALSE);
+    ephy_history_service_add_visits (benchmark->service, visits, NULL,
+                                     (EphyHistoryJobCallback)job_done_cb, &job);
+    g_main_loop_run (job.loop);
+    g_main_loop_unref (job.loop);
+    g_assert (job.success);
+
+    ephy_history_page_visit_list_free (visits);
+  }
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  return elapsed;
+}
+
+/* Operations. The setup functions run untimed, before each iteration. */
+
+static gpointer
+setup_random_url (Benchmark *benchmark,
+                  guint iteration)
+{
+  return g_strdup (random_url (benchmark));
+}
+
+static gpointer
+setup_visit (Benchmark *benchmark,
+             guint iteration)
+{
+  return random_visit (benchmark, BASE_TIME + iteration);
+}
+
+static void
+run_add_visit (Benchmark *benchmark,
+               EphyHistoryPageVisit *visit,
+               Job *job)
+{
+  ephy_history_service_add_visit (benchmark->service, visit, NULL,
+                                  (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static gpointer
+setup_visits (Benchmark *benchmark,
+              guint iteration)
+{
+  GList *visits = NULL;
+  guint i;
+
+  for (i = 0; i < ADD_VISITS_BATCH_SIZE; i++)
+    visits = g_list_prepend (visits, random_visit (benchmark, BASE_TIME + iteration));
+
+  return visits;
+}
+
+static void
+run_add_visits (Benchmark *benchmark,
+                GList *visits,
+                Job *job)
+{
+  ephy_history_service_add_visits (benchmark->service, visits, NULL,
+                                   (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_set_url_title (Benchmark *benchmark,
+                   const char *url,
+                   Job *job)
+{
+  ephy_history_service_set_url_title (benchmark->service, url, "A page title", NULL,
+                                      (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_set_url_zoom_level (Benchmark *benchmark,
+                        const char *url,
+                        Job *job)
+{
+  ephy_history_service_set_url_zoom_level (benchmark->service, url, 1.5, NULL,
+                                           (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_set_url_hidden (Benchmark *benchmark,
+                    const char *url,
+                    Job *job)
+{
+  ephy_history_service_set_url_hidden (benchmark->service, url, FALSE, NULL,
+                                       (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_set_url_thumbnail_time (Benchmark *benchmark,
+                            const char *url,
+                            Job *job)
+{
+  ephy_history_service_set_url_thumbnail_time (benchmark->service, url, BASE_TIME, NULL,
+                                               (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_get_url (Benchmark *benchmark,
+             const char *url,
+             Job *job)
+{
+  ephy_history_service_get_url (benchmark->service, url, NULL,
+                                (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_get_host_for_url (Benchmark *benchmark,
+                      const char *url,
+                      Job *job)
+{
+  ephy_history_service_get_host_for_url (benchmark->service, url, NULL,
+                                         (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static gpointer
+setup_search (Benchmark *benchmark,
+              guint iteration)
+{
+  EphyHistoryQuery *query;
+
+  /* What the location entry completion asks for a typed prefix. */
+  query = ephy_history_query_new ();
+  query->from = -1;
+  query->to = -1;
+  query->limit = 10;
+  query->sort_type = EPHY_HISTORY_SORT_MV;
+  query->substring_list = g_list_prepend (NULL, g_strdup_printf ("host%u", iteration % 10));
+
+  return query;
+}
+
+static gpointer
+setup_time_range (Benchmark *benchmark,
+                  guint iteration)
+{
+  EphyHistoryQuery *query;
+
+  /* What the history window asks for: the last day. */
+  query = ephy_history_query_new ();
+  query->from = BASE_TIME - 24 * 60 * 60;
+  query->to = BASE_TIME;
+  query->sort_type = EPHY_HISTORY_SORT_MRV;
+
+  return query;
+}
+
+static void
+run_query_urls (Benchmark *benchmark,
+                EphyHistoryQuery *query,
+                Job *job)
+{
+  ephy_history_service_query_urls (benchmark->service, query, NULL,
+                                   (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_query_visits (Benchmark *benchmark,
+                  EphyHistoryQuery *query,
+                  Job *job)
+{
+  ephy_history_service_query_visits (benchmark->service, query, NULL,
+                                     (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_get_hosts (Benchmark *benchmark,
+               gpointer data,
+               Job *job)
+{
+  ephy_history_service_get_hosts (benchmark->service, NULL,
+                                  (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_query_hosts (Benchmark *benchmark,
+                 EphyHistoryQuery *query,
+                 Job *job)
+{
+  ephy_history_service_query_hosts (benchmark->service, query, NULL,
+                                    (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static gpointer
+setup_host (Benchmark *benchmark,
+            guint iteration)
+{
+  return host_name (zipf_sample (benchmark->host_popularity, benchmark->rand));
+}
+
+static void
+run_add_host_predictions (Benchmark *benchmark,
+                          const char *host,
+                          Job *job)
+{
+  GList *predicted = NULL;
+  guint i;
+
+  for (i = 0; i < 4; i++)
+    predicted = g_list_prepend (predicted, g_strdup_printf ("cdn%u.%s", i, host));
+
+  ephy_history_service_add_host_predictions (benchmark->service, host, predicted, NULL,
+                                             (EphyHistoryJobCallback)job_done_cb, job);
+  g_list_free_full (predicted, g_free);
+}
+
+static void
+run_get_host_predictions (Benchmark *benchmark,
+                          const char *host,
+                          Job *job)
+{
+  ephy_history_service_get_host_predictions (benchmark->service, host, 8, NULL,
+                                             (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+/* Deletions take the least popular URLs, a different batch each time. */
+static gpointer
+setup_delete_urls (Benchmark *benchmark,
+                   guint iteration)
+{
+  GList *urls = NULL;
+  guint i;
+
+  for (i = 0; i < DELETE_URLS_BATCH_SIZE; i++) {
+    guint index = n_urls - 1 - (iteration * DELETE_URLS_BATCH_SIZE + i) % n_urls;
+
+    urls = g_list_prepend (urls, ephy_history_url_new (benchmark->urls[index], NULL, 0, 0, 0));
+  }
+
+  return urls;
+}
+
+static void
+run_delete_urls (Benchmark *benchmark,
+                 GList *urls,
+                 Job *job)
+{
+  ephy_history_service_delete_urls (benchmark->service, urls, NULL,
+                                    (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static gpointer
+setup_delete_host (Benchmark *benchmark,
+                   guint iteration)
+{
+  static guint next_url = 0;
+  EphyHistoryHost *host = NULL;
+
+  /* Hosts come from the URLs from the middle of the popularity list
+   * on, as the least popular ones were already deleted. */
+  while (host == NULL && n_urls / 2 + next_url < n_urls) {
+    Job job = { NULL, FALSE, NULL };
+
+    job.loop = g_main_loop_new (NULL, FALSE);
+    ephy_history_service_get_host_for_url (benchmark->service,
+                                           benchmark->urls[n_urls / 2 + next_url++],
+                                           NULL, (EphyHistoryJobCallback)job_done_cb, &job);
+    g_main_loop_run (job.loop);
+    g_main_loop_unref (job.loop);
+
+    host = job.result;
+  }
+
+  return host;
+}
+
+static void
+run_delete_host (Benchmark *benchmark,
+                 EphyHistoryHost *host,
+                 Job *job)
+{
+  ephy_history_service_delete_host (benchmark->service, host, NULL,
+                                    (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static gpointer
+setup_time_window (Benchmark *benchmark,
+                   guint iteration)
+{
+  gint64 *window = g_new (gint64, 2);
+
+  /* An hour at a time, going back from a month ago. */
+  window[1] = BASE_TIME - 30 * 24 * 60 * 60 - iteration * 60 * 60;
+  window[0] = window[1] - 60 * 60;
+
+  return window;
+}
+
+static void
+run_delete_visits_in_time (Benchmark *benchmark,
+                           gint64 *window,
+                           Job *job)
+{
+  ephy_history_service_delete_visits_in_time (benchmark->service, window[0], window[1], NULL,
+                                              (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static void
+run_clear (Benchmark *benchmark,
+           gpointer data,
+           Job *job)
+{
+  ephy_history_service_clear (benchmark->service, NULL,
+                              (EphyHistoryJobCallback)job_done_cb, job);
+}
+
+static const Operation operations[] = {
+  { "add_visit", "ADD_VISIT",
+    setup_visit, (OperationRunFunc)run_add_visit,
+    (GDestroyNotify)ephy_history_page_visit_free, NULL },
+  { "add_visits", "ADD_VISITS",
+    setup_visits, (OperationRunFunc)run_add_visits,
+    (GDestroyNotify)ephy_history_page_visit_list_free, NULL },
+  { "set_url_title", "SET_URL_TITLE",
+    setup_random_url, (OperationRunFunc)run_set_url_title, g_free, NULL },
+  { "set_url_zoom_level", "SET_URL_ZOOM_LEVEL",
+    setup_random_url, (OperationRunFunc)run_set_url_zoom_level, g_free, NULL },
+  { "set_url_hidden", "SET_URL_HIDDEN",
+    setup_random_url, (OperationRunFunc)run_set_url_hidden, g_free, NULL },
+  { "set_url_thumbnail_time", "SET_URL_THUMBNAIL_TIME",
+    setup_random_url, (OperationRunFunc)run_set_url_thumbnail_time, g_free, NULL },
+  { "get_url", "GET_URL",
+    setup_random_url, (OperationRunFunc)run_get_url, g_free,
+    (GDestroyNotify)ephy_history_url_free },
+  { "get_host_for_url", "GET_HOST_FOR_URL",
+    setup_random_url, (OperationRunFunc)run_get_host_for_url, g_free,
+    (GDestroyNotify)ephy_history_host_free },
+  { "query_urls_search", "QUERY_URLS",
+    setup_search, (OperationRunFunc)run_query_urls,
+    (GDestroyNotify)ephy_history_query_free, (GDestroyNotify)ephy_history_url_list_free },
+  { "query_urls_time_range", "QUERY_URLS",
+    setup_time_range, (OperationRunFunc)run_query_urls,
+    (GDestroyNotify)ephy_history_query_free, (GDestroyNotify)ephy_history_url_list_free },
+  { "query_visits_time_range", "QUERY_VISITS",
+    setup_time_range, (OperationRunFunc)run_query_visits,
+    (GDestroyNotify)ephy_history_query_free, (GDestroyNotify)ephy_history_page_visit_list_free },
+  { "get_hosts", "GET_HOSTS",
+    NULL, run_get_hosts, NULL, (GDestroyNotify)host_list_free },
+  { "query_hosts_search", "QUERY_HOSTS",
+    setup_search, (OperationRunFunc)run_query_hosts,
+    (GDestroyNotify)ephy_history_query_free, (GDestroyNotify)host_list_free },
+  { "add_host_predictions", "ADD_HOST_PREDICTIONS",
+    setup_host, (OperationRunFunc)run_add_host_predictions, g_free, NULL },
+  { "get_host_predictions", "GET_HOST_PREDICTIONS",
+    setup_host, (OperationRunFunc)run_get_host_predictions, g_free,
+    (GDestroyNotify)string_list_free },
+  { "delete_urls", "DELETE_URLS",
+    setup_delete_urls, (OperationRunFunc)run_delete_urls,
+    (GDestroyNotify)ephy_history_url_list_free, NULL },
+  { "delete_host", "DELETE_HOST",
+    setup_delete_host, (OperationRunFunc)run_delete_host,
+    (GDestroyNotify)ephy_history_host_free, NULL },
+  { "delete_visits_in_time", "DELETE_VISITS_IN_TIME",
+    setup_time_window, (OperationRunFunc)run_delete_visits_in_time, g_free, NULL },
+  { "clear", "CLEAR",
+    NULL, run_clear, NULL, NULL, TRUE }
+};
+
+static int
+compare_doubles (const double *a,
+                 const double *b)
+{
+  return *a < *b ? -1 : *a > *b;
+}
+
+static void
+append_result (Benchmark *benchmark,
+               const char *name,
+               const char *message,
+               GArray *samples)
+{
+  double total = 0;
+  guint i;
+
+  g_string_append_printf (benchmark->json,
+                          "%s    { \"name\": \"%s\", \"message\": \"%s\", \"iterations\": %u",
+                          benchmark->n_results++ ? ",\n" : "",
+                          name, message, samples->len);
+
+  if (samples->len == 0) {
+    g_string_append (benchmark->json, " }");
+    return;
+  }
+
+  g_array_sort (samples, (GCompareFunc)compare_doubles);
+  for (i = 0; i < samples->len; i++)
+    total += g_array_index (samples, double, i);
+
+  g_string_append_printf (benchmark->json,
+                          ", \"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f, \"max_ms\": %.3f }",
+                          g_array_index (samples, double, 0) * 1000,
+                          g_array_index (samples, double, samples->len / 2) * 1000,
+                          total / samples->len * 1000,
+                          g_array_index (samples, double, samples->len - 1) * 1000);
+}
+
+static void
+run_operation (Benchmark *benchmark,
+               const Operation *operation)
+{
+  GArray *samples;
+  GTimer *timer;
+  guint i, n_iterations;
+
+  samples = g_array_new (FALSE, FALSE, sizeof (double));
+  timer = g_timer_new ();
+  n_iterations = operation->once ? 1 : iterations;
+
+  for (i = 0; i < n_iterations; i++) {
+    Job job = { NULL, FALSE, NULL };
+    gpointer data;
+    double elapsed;
+
+    data = operation->setup ? operation->setup (benchmark, i) : NULL;
+    if (operation->setup && !data)
+      continue;
+
+    job.loop = g_main_loop_new (NULL, FALSE);
+
+    g_timer_start (timer);
+    operation->run (benchmark, data, &job);
+    g_main_loop_run (job.loop);
+    elapsed = g_timer_elapsed (timer, NULL);
+
+    g_main_loop_unref (job.loop);
+    g_array_append_val (samples, elapsed);
+
+    if (job.result && operation->free_result)
+      operation->free_result (job.result);
+    if (data && operation->free_data)
+      operation->free_data (data);
+  }
+
+  append_result (benchmark, operation->name, operation->message, samples);
+
+  g_timer_destroy (timer);
+  g_array_free (samples, TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  Benchmark benchmark;
+  GStatBuf buf;
+  GTimer *timer;
+  GArray *samples;
+  double elapsed;
+  guint i;
+  GError *error = NULL;
+
+  context = g_option_context_new ("- benchmark the history service");
+  g_option_context_add_main_entries (context, option_entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (n_urls <= 0 || n_hosts <= 0 || n_visits < 0 || iterations <= 0) {
+    g_printerr ("--urls, --hosts and --iterations must be positive\n");
+    return 1;
+  }
+
+  if (!database_path)
+    database_path = g_build_filename (g_get_tmp_dir (), "epiphany-history-benchmark.db", NULL);
+  g_unlink (database_path);
+
+  memset (&benchmark, 0, sizeof (Benchmark));
+  benchmark.rand = g_rand_new_with_seed (seed);
+  benchmark.host_popularity = zipf_new (n_hosts, zipf_exponent);
+  benchmark.url_popularity = zipf_new (n_urls, zipf_exponent);
+  benchmark.service = ephy_history_service_new (database_path);
+  benchmark.json = g_string_new ("{\n");
+
+  generate_urls (&benchmark);
+  elapsed = populate (&benchmark);
+
+  g_stat (database_path, &buf);
+  g_string_append_printf (benchmark.json,
+                          "  \"profile\": { \"seed\": %d, \"urls\": %d, \"hosts\": %d, \"visits\": %d, "
+                          "\"zipf_exponent\": %.2f, \"database_bytes\": %" G_GINT64_FORMAT ", "
+                          "\"populate_ms\": %.3f },\n",
+                          seed, n_urls, n_hosts, n_visits, zipf_exponent,
+                          (gint64)buf.st_size, elapsed * 1000);
+
+  g_string_append (benchmark.json, "  \"operations\": [\n");
+  for (i = 0; i < G_N_ELEMENTS (operations); i++)
+    run_operation (&benchmark, &operations[i]);
+
+  /* Quitting waits for the pending commit and the thread. */
+  timer = g_timer_new ();
+  g_object_unref (benchmark.service);
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  samples = g_array_new (FALSE, FALSE, sizeof (double));
+  g_array_append_val (samples, elapsed);
+  append_result (&benchmark, "quit", "QUIT", samples);
+  g_array_free (samples, TRUE);
+
+  g_string_append (benchmark.json, "\n  ]\n}\n");
+
+  if (output_path) {
+    if (!g_file_set_contents (output_path, benchmark.json->str, benchmark.json->len, &error)) {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+  } else {
+    g_print ("%s", benchmark.json->str);
+  }
+
+  g_string_free (benchmark.json, TRUE);
+  g_strfreev (benchmark.urls);
+  zipf_free (benchmark.url_popularity);
+  zipf_free (benchmark.host_popularity);
+  g_rand_free (benchmark.rand);
+  g_unlink (database_path);
+  g_free (database_path);
+  g_free (output_path);
+
+  return 0;
+}
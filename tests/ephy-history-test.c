@@ -475,6 +475,117 @@ test_clear (void)
   gtk_main ();
 }
 
+static void
+urls_deleted_cb (EphyHistoryService *service,
+                 const char * const *urls,
+                 int *n_emissions)
+{
+  /* Only the URL that was visited in the range alone is gone. */
+  g_assert_cmpint (g_strv_length ((char **)urls), ==, 1);
+  g_assert_cmpstr (urls[0], ==, "http://www.example.com");
+
+  (*n_emissions)++;
+}
+
+static void
+verify_url_after_delete_in_time (EphyHistoryService *service,
+                                 gboolean success,
+                                 gpointer result_data,
+                                 gpointer user_data)
+{
+  EphyHistoryURL *url = (EphyHistoryURL *)result_data;
+  int *n_emissions = (int *)user_data;
+
+  g_assert (success == TRUE);
+
+  /* Visited at 0 and 1000, the second visit was deleted. */
+  g_assert_cmpstr (url->url, ==, "http://www.webkitgtk.org");
+  g_assert_cmpint (url->visit_count, ==, 1);
+  g_assert_cmpint (url->last_visit_time, ==, 0);
+  ephy_history_url_free (url);
+
+  g_assert_cmpint (*n_emissions, ==, 1);
+
+  g_object_unref (service);
+  gtk_main_quit ();
+}
+
+static void
+verify_visits_after_delete_in_time (EphyHistoryService *service,
+                                    gboolean success,
+                                    gpointer result_data,
+                                    gpointer user_data)
+{
+  GList *visits = (GList *)result_data;
+  GList *l;
+
+  g_assert (success == TRUE);
+
+  /* gnome.org, wikipedia.org, freedesktop.org and musicbrainz.org keep
+   * their visits at 0, 10, 20 and 30, webkitgtk.org the one at 0. */
+  g_assert_cmpint (g_list_length (visits), ==, 17);
+  for (l = visits; l != NULL; l = l->next) {
+    EphyHistoryPageVisit *visit = (EphyHistoryPageVisit *)l->data;
+
+    g_assert_cmpint (visit->visit_time, <, 40);
+  }
+  g_list_free_full (visits, (GDestroyNotify)ephy_history_page_visit_free);
+
+  ephy_history_service_get_url (service, "http://www.webkitgtk.org", NULL,
+                                verify_url_after_delete_in_time, user_data);
+}
+
+static void
+perform_query_after_delete_in_time (EphyHistoryService *service,
+                                    gboolean success,
+                                    gpointer result_data,
+                                    gpointer user_data)
+{
+  EphyHistoryQuery *query;
+
+  g_assert (success == TRUE);
+
+  query = ephy_history_query_new ();
+  query->from = -1;
+  query->to = -1;
+  ephy_history_service_query_visits (service, query, NULL,
+                                     verify_visits_after_delete_in_time, user_data);
+  ephy_history_query_free (query);
+}
+
+static void
+perform_delete_in_time (EphyHistoryService *service,
+                        gboolean success,
+                        gpointer result_data,
+                        gpointer user_data)
+{
+  g_assert (success == TRUE);
+
+  ephy_history_service_delete_visits_in_time (service, 40, 1000, NULL,
+                                              perform_query_after_delete_in_time, user_data);
+}
+
+static void
+test_delete_visits_in_time (void)
+{
+  gchar *temporary_file = g_build_filename (g_get_tmp_dir (), "epiphany-history-test.db", NULL);
+  EphyHistoryService *service = ensure_empty_history (temporary_file);
+  GList *visits;
+  int n_emissions = 0;
+
+  visits = create_visits_for_complex_tests ();
+  visits = g_list_append (visits, ephy_history_page_visit_new ("http://www.example.com", 500, EPHY_PAGE_VISIT_TYPED));
+  visits = g_list_append (visits, ephy_history_page_visit_new ("http://www.example.com", 600, EPHY_PAGE_VISIT_TYPED));
+
+  g_signal_connect (service, "urls-deleted", G_CALLBACK (urls_deleted_cb), &n_emissions);
+
+  ephy_history_service_add_visits (service, visits, NULL, perform_delete_in_time, &n_emissions);
+
+  gtk_main ();
+
+  g_free (temporary_file);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -492,6 +603,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/embed/history/test_complex_url_query", test_complex_url_query);
   g_test_add_func ("/embed/history/test_complex_url_query_with_time_range", test_complex_url_query_with_time_range);
   g_test_add_func ("/embed/history/test_clear", test_clear);
+  g_test_add_func ("/embed/history/test_delete_visits_in_time", test_delete_visits_in_time);
 
   return g_test_run ();
 }
@@ -0,0 +1,394 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-debug.h"
+#include "ephy-embed-prefs.h"
+#include "ephy-embed-shell.h"
+#include "ephy-file-helpers.h"
+#include "ephy-history-service.h"
+#include "ephy-host-predictor.h"
+#include "ephy-private.h"
+#include "ephy-shell.h"
+#include "ephy-web-view.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <libsoup/soup.h>
+#include <string.h>
+
+#define SERVER_PORT 12322
+
+/* The page is loaded from localhost and its image from 127.0.0.1, so
+ * the same server stands for two different hosts. */
+#define PAGE_URL "http://localhost:12322/"
+#define IMAGE_URL "http://127.0.0.1:12322/image.png"
+#define HTML_STRING "<html><body><img src=\"" IMAGE_URL "\"></body></html>"
+
+/* The image is answered late, like a CDN on the other side of the
+ * world, so the predictions are in before the load finishes. */
+#define IMAGE_DELAY 200
+
+static gboolean
+unpause_message (SoupMessage *msg)
+{
+  SoupServer *server = g_object_get_data (G_OBJECT (msg), "test.server");
+
+  soup_server_unpause_message (server, msg);
+
+  return FALSE;
+}
+
+static void
+server_callback (SoupServer *server,
+                 SoupMessage *msg,
+                 const char *path,
+                 GHashTable *query,
+                 SoupClientContext *context,
+                 gpointer data)
+{
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+
+  if (g_str_equal (path, "/image.png")) {
+    soup_message_headers_append (msg->response_headers, "Content-Type", "image/png");
+    soup_message_body_complete (msg->response_body);
+
+    g_object_set_data (G_OBJECT (msg), "test.server", server);
+    soup_server_pause_message (server, msg);
+    g_timeout_add (IMAGE_DELAY, (GSourceFunc)unpause_message, msg);
+    return;
+  }
+
+  soup_message_headers_append (msg->response_headers, "Content-Type", "text/html");
+  soup_message_body_append (msg->response_body, SOUP_MEMORY_STATIC,
+                            HTML_STRING, strlen (HTML_STRING));
+  soup_message_body_complete (msg->response_body);
+}
+
+static void
+record_prefetch (const char *host,
+                 GPtrArray *prefetched)
+{
+  g_ptr_array_add (prefetched, g_strdup (host));
+}
+
+static gboolean
+was_prefetched (GPtrArray *prefetched,
+                const char *host)
+{
+  guint i;
+
+  for (i = 0; i < prefetched->len; i++) {
+    if (g_str_equal (g_ptr_array_index (prefetched, i), host))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static EphyHistoryService *
+ensure_empty_history (const char *filename)
+{
+  if (g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+    g_unlink (filename);
+
+  return ephy_history_service_new (filename);
+}
+
+static void
+quit_main_loop_cb (EphyHistoryService *service,
+                   gboolean success,
+                   gpointer result_data,
+                   GMainLoop *loop)
+{
+  g_list_free_full ((GList *)result_data, g_free);
+  g_main_loop_quit (loop);
+}
+
+/* Waits until everything that was sent to the history service has been
+ * processed, and the callbacks run. */
+static void
+flush_history_service (EphyHistoryService *service)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+  ephy_history_service_get_host_predictions (service, "flush", 1, NULL,
+                                             (EphyHistoryJobCallback)quit_main_loop_cb,
+                                             loop);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+}
+
+static void
+test_learn_and_predict (void)
+{
+  EphyHistoryService *service;
+  EphyHostPredictor *predictor;
+  GPtrArray *prefetched;
+  GList *hosts = NULL;
+  char *filename;
+
+  filename = g_build_filename (g_get_tmp_dir (), "epiphany-host-predictor-test.db", NULL);
+  service = ensure_empty_history (filename);
+  predictor = ephy_host_predictor_new (service);
+
+  prefetched = g_ptr_array_new_with_free_func (g_free);
+  ephy_host_predictor_set_prefetch_func (predictor, (EphyHostPredictorPrefetchFunc)record_prefetch, prefetched);
+
+  /* Nothing is known about the host yet. */
+  ephy_host_predictor_load_started (predictor, GINT_TO_POINTER (1), "http://www.gnome.org/");
+  flush_history_service (service);
+  g_assert_cmpuint (prefetched->len, ==, 0);
+
+  hosts = g_list_prepend (hosts, "static.gnome.org");
+  hosts = g_list_prepend (hosts, "api.gnome.org");
+  ephy_host_predictor_load_finished (predictor, GINT_TO_POINTER (1), "http://www.gnome.org/", hosts);
+  g_list_free (hosts);
+
+  ephy_host_predictor_load_started (predictor, GINT_TO_POINTER (1), "http://www.gnome.org/news");
+  flush_history_service (service);
+  g_assert_cmpuint (prefetched->len, ==, 2);
+  g_assert (was_prefetched (prefetched, "static.gnome.org"));
+  g_assert (was_prefetched (prefetched, "api.gnome.org"));
+
+  /* Only one of the predictions was right this time. */
+  hosts = g_list_prepend (NULL, "static.gnome.org");
+  ephy_host_predictor_load_finished (predictor, GINT_TO_POINTER (1), "http://www.gnome.org/news", hosts);
+  g_list_free (hosts);
+
+  g_assert_cmpuint (ephy_host_predictor_get_n_predicted (predictor), ==, 2);
+  g_assert_cmpuint (ephy_host_predictor_get_n_hits (predictor), ==, 1);
+
+  /* Hosts that were just prefetched are not prefetched again. */
+  ephy_host_predictor_prefetch_for_host (predictor, "www.gnome.org");
+  flush_history_service (service);
+  g_assert_cmpuint (prefetched->len, ==, 2);
+
+  /* Links that are followed are learned too. */
+  ephy_host_predictor_add_link (predictor, "http://planet.gnome.org/", "http://blogs.gnome.org/post");
+  ephy_host_predictor_prefetch_for_host (predictor, "planet.gnome.org");
+  flush_history_service (service);
+  g_assert_cmpuint (prefetched->len, ==, 3);
+  g_assert (was_prefetched (prefetched, "blogs.gnome.org"));
+
+  g_object_unref (predictor);
+  g_ptr_array_free (prefetched, TRUE);
+  g_object_unref (service);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+test_concurrent_loads (void)
+{
+  EphyHistoryService *service;
+  EphyHostPredictor *predictor;
+  GPtrArray *prefetched;
+  GList *hosts = NULL;
+  char *filename;
+
+  filename = g_build_filename (g_get_tmp_dir (), "epiphany-host-predictor-test.db", NULL);
+  service = ensure_empty_history (filename);
+  predictor = ephy_host_predictor_new (service);
+
+  prefetched = g_ptr_array_new_with_free_func (g_free);
+  ephy_host_predictor_set_prefetch_func (predictor, (EphyHostPredictorPrefetchFunc)record_prefetch, prefetched);
+
+  hosts = g_list_prepend (hosts, "static.gnome.org");
+  hosts = g_list_prepend (hosts, "api.gnome.org");
+  ephy_host_predictor_load_finished (predictor, NULL, "http://www.gnome.org/", hosts);
+  g_list_free (hosts);
+
+  /* Two views load from the same host at once. */
+  ephy_host_predictor_load_started (predictor, GINT_TO_POINTER (1), "http://www.gnome.org/a");
+  ephy_host_predictor_load_started (predictor, GINT_TO_POINTER (2), "http://www.gnome.org/b");
+  flush_history_service (service);
+
+  hosts = g_list_prepend (NULL, "static.gnome.org");
+  ephy_host_predictor_load_finished (predictor, GINT_TO_POINTER (1), "http://www.gnome.org/a", hosts);
+  g_list_free (hosts);
+
+  hosts = g_list_prepend (NULL, "api.gnome.org");
+  ephy_host_predictor_load_finished (predictor, GINT_TO_POINTER (2), "http://www.gnome.org/b", hosts);
+  g_list_free (hosts);
+
+  /* Each load is checked against its own predictions. */
+  g_assert_cmpuint (ephy_host_predictor_get_n_predicted (predictor), ==, 4);
+  g_assert_cmpuint (ephy_host_predictor_get_n_hits (predictor), ==, 2);
+
+  /* A cancelled load is not counted. */
+  ephy_host_predictor_load_started (predictor, GINT_TO_POINTER (3), "http://www.gnome.org/c");
+  flush_history_service (service);
+  ephy_host_predictor_load_cancelled (predictor, GINT_TO_POINTER (3));
+  ephy_host_predictor_load_finished (predictor, GINT_TO_POINTER (3), "http://www.gnome.org/c", NULL);
+  g_assert_cmpuint (ephy_host_predictor_get_n_predicted (predictor), ==, 4);
+
+  g_object_unref (predictor);
+  g_ptr_array_free (prefetched, TRUE);
+  g_object_unref (service);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+test_prefetch_budget (void)
+{
+  EphyHistoryService *service;
+  EphyHostPredictor *predictor;
+  GPtrArray *prefetched;
+  char *filename;
+  int i;
+
+  filename = g_build_filename (g_get_tmp_dir (), "epiphany-host-predictor-test.db", NULL);
+  service = ensure_empty_history (filename);
+  predictor = ephy_host_predictor_new (service);
+
+  prefetched = g_ptr_array_new_with_free_func (g_free);
+  ephy_host_predictor_set_prefetch_func (predictor, (EphyHostPredictorPrefetchFunc)record_prefetch, prefetched);
+
+  for (i = 0; i < 20; i++) {
+    GList *hosts = NULL;
+    char *url = g_strdup_printf ("http://www.example%d.com/", i);
+    int j;
+
+    for (j = 0; j < 4; j++)
+      hosts = g_list_prepend (hosts, g_strdup_printf ("cdn%d.example%d.com", j, i));
+
+    ephy_host_predictor_load_finished (predictor, NULL, url, hosts);
+    g_list_free_full (hosts, g_free);
+    g_free (url);
+  }
+
+  /* 80 hosts are predicted, but only a few of them are prefetched. */
+  for (i = 0; i < 20; i++) {
+    char *url = g_strdup_printf ("http://www.example%d.com/", i);
+
+    ephy_host_predictor_load_started (predictor, GINT_TO_POINTER (i + 1), url);
+    g_free (url);
+  }
+  flush_history_service (service);
+
+  g_assert_cmpuint (prefetched->len, >, 0);
+  g_assert_cmpuint (prefetched->len, <, 80);
+
+  g_object_unref (predictor);
+  g_ptr_array_free (prefetched, TRUE);
+  g_object_unref (service);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+load_changed_cb (WebKitWebView *view,
+                 WebKitLoadEvent load_event,
+                 GMainLoop *loop)
+{
+  if (load_event == WEBKIT_LOAD_FINISHED)
+    g_main_loop_quit (loop);
+}
+
+static void
+load_page (EphyWebView *view)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  gulong handler;
+
+  handler = g_signal_connect (view, "load-changed", G_CALLBACK (load_changed_cb), loop);
+  ephy_web_view_load_url (view, PAGE_URL);
+  g_main_loop_run (loop);
+  g_signal_handler_disconnect (view, handler);
+  g_main_loop_unref (loop);
+}
+
+static void
+test_web_view_loads (void)
+{
+  EphyEmbedShell *shell = ephy_embed_shell_get_default ();
+  EphyHostPredictor *predictor;
+  EphyHistoryService *service;
+  EphyWebView *view;
+  GPtrArray *prefetched;
+
+  predictor = EPHY_HOST_PREDICTOR (ephy_embed_shell_get_host_predictor (shell));
+  service = EPHY_HISTORY_SERVICE (ephy_embed_shell_get_global_history_service (shell));
+
+  prefetched = g_ptr_array_new_with_free_func (g_free);
+  ephy_host_predictor_set_prefetch_func (predictor, (EphyHostPredictorPrefetchFunc)record_prefetch, prefetched);
+
+  view = EPHY_WEB_VIEW (ephy_web_view_new ());
+  g_object_ref_sink (view);
+
+  /* The first load teaches the predictor about the image host. */
+  load_page (view);
+  flush_history_service (service);
+  g_assert_cmpuint (prefetched->len, ==, 0);
+
+  /* And the second one resolves it before the page asks for it. */
+  load_page (view);
+  g_assert (was_prefetched (prefetched, "127.0.0.1"));
+  g_assert_cmpuint (ephy_host_predictor_get_n_predicted (predictor), ==, 1);
+  g_assert_cmpuint (ephy_host_predictor_get_n_hits (predictor), ==, 1);
+
+  g_object_unref (view);
+  g_ptr_array_free (prefetched, TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+  SoupServer *server;
+
+  gtk_test_init (&argc, &argv);
+
+  ephy_debug_init ();
+  ephy_embed_prefs_init ();
+
+  if (!ephy_file_helpers_init (NULL,
+                               EPHY_FILE_HELPERS_PRIVATE_PROFILE | EPHY_FILE_HELPERS_ENSURE_EXISTS,
+                               NULL)) {
+    g_debug ("Something wrong happened with ephy_file_helpers_init()");
+    return -1;
+  }
+
+  _ephy_shell_create_instance (EPHY_EMBED_SHELL_MODE_TEST);
+
+  server = soup_server_new (SOUP_SERVER_PORT, SERVER_PORT, NULL);
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+  soup_server_run_async (server);
+
+  g_test_add_func ("/lib/history/ephy-host-predictor/learn_and_predict",
+                   test_learn_and_predict);
+  g_test_add_func ("/lib/history/ephy-host-predictor/concurrent_loads",
+                   test_concurrent_loads);
+  g_test_add_func ("/lib/history/ephy-host-predictor/prefetch_budget",
+                   test_prefetch_budget);
+  g_test_add_func ("/lib/history/ephy-host-predictor/web_view_loads",
+                   test_web_view_loads);
+
+  ret = g_test_run ();
+
+  g_object_unref (server);
+  g_object_unref (ephy_shell_get_default ());
+  ephy_file_helpers_shutdown ();
+
+  return ret;
+}
@@ -0,0 +1,184 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-debug.h"
+#include "ephy-langs.h"
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <gtk/gtk.h>
+#include <libxml/xmlreader.h>
+
+/* Reads the iso-codes XML the way ephy-langs.c used to at runtime, so
+ * the generated tables can be checked against their source. */
+static GHashTable *
+load_iso_entries (int iso)
+{
+  GHashTable *table;
+  xmlTextReaderPtr reader;
+  xmlChar iso_entry[32];
+  char *filename;
+
+  table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  filename = g_strdup_printf (ISO_CODES_PREFIX "/share/xml/iso-codes/iso_%d.xml", iso);
+  reader = xmlNewTextReaderFilename (filename);
+  g_assert (reader != NULL);
+  g_free (filename);
+
+  xmlStrPrintf (iso_entry, sizeof (iso_entry), (const xmlChar *)"iso_%d_entry", iso);
+
+  while (xmlTextReaderRead (reader) == 1) {
+    xmlChar *code, *name;
+
+    if (xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT ||
+        !xmlStrEqual (xmlTextReaderConstName (reader), iso_entry))
+      continue;
+
+    if (iso == 639) {
+      code = xmlTextReaderGetAttribute (reader, (const xmlChar *)"iso_639_1_code");
+      if (code == NULL || code[0] == '\0') {
+        xmlFree (code);
+        code = xmlTextReaderGetAttribute (reader, (const xmlChar *)"iso_639_2T_code");
+      }
+    } else {
+      code = xmlTextReaderGetAttribute (reader, (const xmlChar *)"alpha_2_code");
+    }
+    name = xmlTextReaderGetAttribute (reader, (const xmlChar *)"name");
+
+    if (code != NULL && code[0] != '\0' && name != NULL && name[0] != '\0') {
+      char *key = iso == 639 ? g_strdup ((char *)code) : g_ascii_strdown ((char *)code, -1);
+
+      g_hash_table_insert (table, key, g_strdup ((char *)name));
+    }
+
+    xmlFree (code);
+    xmlFree (name);
+  }
+
+  xmlFreeTextReader (reader);
+
+  return table;
+}
+
+static void
+test_iso_639_names (void)
+{
+  GHashTable *table;
+  GHashTableIter iter;
+  gpointer code, name;
+
+  table = load_iso_entries (639);
+  g_assert_cmpuint (g_hash_table_size (table), >, 0);
+
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, &code, &name)) {
+    const char *localized = ephy_langs_iso_639_name (code);
+
+    g_assert_cmpstr (localized, ==, dgettext (ISO_639_DOMAIN, name));
+  }
+
+  g_assert (ephy_langs_iso_639_name ("") == NULL);
+  g_assert (ephy_langs_iso_639_name ("xx-invalid") == NULL);
+  g_assert (ephy_langs_iso_639_name ("EN") == NULL);
+
+  g_hash_table_destroy (table);
+}
+
+static void
+test_iso_3166_names (void)
+{
+  GHashTable *table;
+  GHashTableIter iter;
+  gpointer code, name;
+
+  table = load_iso_entries (3166);
+  g_assert_cmpuint (g_hash_table_size (table), >, 0);
+
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, &code, &name)) {
+    const char *localized = ephy_langs_iso_3166_name (code);
+
+    g_assert_cmpstr (localized, ==, dgettext (ISO_3166_DOMAIN, name));
+  }
+
+  g_assert (ephy_langs_iso_3166_name ("") == NULL);
+  g_assert (ephy_langs_iso_3166_name ("zz") == NULL);
+
+  g_hash_table_destroy (table);
+}
+
+static void
+test_lookup_benchmark (void)
+{
+  GHashTable *table;
+  GList *codes, *l;
+  double elapsed;
+  guint n_codes;
+
+  /* What the preferences dialog used to wait for. */
+  g_test_timer_start ();
+  table = load_iso_entries (639);
+  g_hash_table_destroy (table);
+  table = load_iso_entries (3166);
+  g_hash_table_destroy (table);
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "Parsing the ISO XML files: %.3f ms", elapsed * 1000);
+
+  /* What it waits for now; nothing is loaded before the first lookup. */
+  g_test_timer_start ();
+  ephy_langs_iso_639_name ("fr");
+  ephy_langs_iso_3166_name ("fr");
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "Looking up a language and a country: %.3f ms", elapsed * 1000);
+
+  table = load_iso_entries (639);
+  codes = g_hash_table_get_keys (table);
+  n_codes = g_hash_table_size (table);
+
+  g_test_timer_start ();
+  for (l = codes; l != NULL; l = l->next)
+    ephy_langs_iso_639_name (l->data);
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed / n_codes, "%u language lookups: %.3f µs each",
+                           n_codes, elapsed * 1000000 / n_codes);
+
+  g_list_free (codes);
+  g_hash_table_destroy (table);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gtk_test_init (&argc, &argv);
+  ephy_debug_init ();
+
+  g_test_add_func ("/lib/ephy-langs/iso_639_names",
+                   test_iso_639_names);
+  g_test_add_func ("/lib/ephy-langs/iso_3166_names",
+                   test_iso_3166_names);
+
+  if (g_test_perf ())
+    g_test_add_func ("/lib/ephy-langs/lookup_benchmark",
+                     test_lookup_benchmark);
+
+  return g_test_run ();
+}
@@ -0,0 +1,276 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-bookmarks.h"
+#include "ephy-debug.h"
+#include "ephy-node-db.h"
+#include "ephy-node-filter.h"
+#include "ephy-node-view.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <string.h>
+
+static void
+set_search (EphyNodeFilter *filter,
+            const char *search_text)
+{
+  /* What the bookmarks editor does for each keystroke. */
+  ephy_node_filter_empty (filter);
+  ephy_node_filter_add_expression (filter,
+                                   ephy_node_filter_expression_new (EPHY_NODE_FILTER_EXPRESSION_STRING_PROP_CONTAINS,
+                                                                    EPHY_NODE_BMK_PROP_TITLE,
+                                                                    search_text),
+                                   0);
+  ephy_node_filter_add_expression (filter,
+                                   ephy_node_filter_expression_new (EPHY_NODE_FILTER_EXPRESSION_STRING_PROP_CONTAINS,
+                                                                    EPHY_NODE_BMK_PROP_LOCATION,
+                                                                    search_text),
+                                   0);
+  ephy_node_filter_done_changing (filter);
+}
+
+static EphyNode *
+create_bookmarks (EphyNodeDb *db,
+                  int n_bookmarks)
+{
+  EphyNode *root;
+  int i;
+
+  root = ephy_node_new (db);
+
+  for (i = 0; i < n_bookmarks; i++) {
+    EphyNode *node;
+    char *string;
+
+    node = ephy_node_new (db);
+
+    string = g_strdup_printf ("Bookmark Number %d", i);
+    ephy_node_set_property_string (node, EPHY_NODE_BMK_PROP_TITLE, string);
+    g_free (string);
+
+    string = g_strdup_printf ("http://www.host%d.example.com/page/%d", i % 100, i);
+    ephy_node_set_property_string (node, EPHY_NODE_BMK_PROP_LOCATION, string);
+    g_free (string);
+
+    ephy_node_add_child (root, node);
+  }
+
+  return root;
+}
+
+static void
+test_folded_string (void)
+{
+  EphyNodeDb *db;
+  EphyNode *node;
+
+  db = ephy_node_db_new ("FoldedString");
+  node = ephy_node_new (db);
+
+  g_assert (ephy_node_get_property_folded_string (node, EPHY_NODE_BMK_PROP_TITLE) == NULL);
+
+  ephy_node_set_property_string (node, EPHY_NODE_BMK_PROP_TITLE, "GNOME Web");
+  g_assert_cmpstr (ephy_node_get_property_folded_string (node, EPHY_NODE_BMK_PROP_TITLE), ==, "gnome web");
+  g_assert_cmpstr (ephy_node_get_property_string (node, EPHY_NODE_BMK_PROP_TITLE), ==, "GNOME Web");
+
+  /* The cached string follows the property. */
+  ephy_node_set_property_string (node, EPHY_NODE_BMK_PROP_TITLE, "Epiphany");
+  g_assert_cmpstr (ephy_node_get_property_folded_string (node, EPHY_NODE_BMK_PROP_TITLE), ==, "epiphany");
+
+  g_object_unref (db);
+}
+
+static void
+test_filter_change (void)
+{
+  EphyNodeFilter *filter;
+
+  filter = ephy_node_filter_new ();
+
+  set_search (filter, "bo");
+  g_assert_cmpint (ephy_node_filter_get_change (filter), ==, EPHY_NODE_FILTER_CHANGE_ANY);
+
+  set_search (filter, "boo");
+  g_assert_cmpint (ephy_node_filter_get_change (filter), ==, EPHY_NODE_FILTER_CHANGE_NARROWED);
+
+  set_search (filter, "Book");
+  g_assert_cmpint (ephy_node_filter_get_change (filter), ==, EPHY_NODE_FILTER_CHANGE_NARROWED);
+
+  set_search (filter, "ok");
+  g_assert_cmpint (ephy_node_filter_get_change (filter), ==, EPHY_NODE_FILTER_CHANGE_WIDENED);
+
+  set_search (filter, "");
+  g_assert_cmpint (ephy_node_filter_get_change (filter), ==, EPHY_NODE_FILTER_CHANGE_WIDENED);
+
+  set_search (filter, "x");
+  g_assert_cmpint (ephy_node_filter_get_change (filter), ==, EPHY_NODE_FILTER_CHANGE_NARROWED);
+
+  set_search (filter, "y");
+  g_assert_cmpint (ephy_node_filter_get_change (filter), ==, EPHY_NODE_FILTER_CHANGE_ANY);
+
+  set_search (filter, "y");
+  g_assert_cmpint (ephy_node_filter_get_change (filter), ==, EPHY_NODE_FILTER_CHANGE_ANY);
+
+  /* Other expressions than the search text can change anything. */
+  ephy_node_filter_empty (filter);
+  ephy_node_filter_add_expression (filter,
+                                   ephy_node_filter_expression_new (EPHY_NODE_FILTER_EXPRESSION_STRING_PROP_CONTAINS,
+                                                                    EPHY_NODE_BMK_PROP_TITLE,
+                                                                    "yz"),
+                                   0);
+  ephy_node_filter_done_changing (filter);
+  g_assert_cmpint (ephy_node_filter_get_change (filter), ==, EPHY_NODE_FILTER_CHANGE_ANY);
+
+  g_object_unref (filter);
+}
+
+static int
+count_matches (EphyNodeFilter *filter,
+               EphyNode *root)
+{
+  GPtrArray *children = ephy_node_get_children (root);
+  int i, n_matches = 0;
+
+  for (i = 0; i < children->len; i++) {
+    if (ephy_node_filter_evaluate (filter, g_ptr_array_index (children, i)))
+      n_matches++;
+  }
+
+  return n_matches;
+}
+
+static int
+count_rows (EphyNodeView *view)
+{
+  return gtk_tree_model_iter_n_children (gtk_tree_view_get_model (GTK_TREE_VIEW (view)), NULL);
+}
+
+static void
+test_node_view_refilter (void)
+{
+  static const char *searches[] = {
+    "", "1", "12", "123", "12", "1", "", "host1", "host12", "page/12", "y", "Y", ""
+  };
+  EphyNodeDb *db;
+  EphyNode *root;
+  EphyNodeFilter *filter;
+  GtkWidget *view;
+  int i;
+
+  db = ephy_node_db_new ("NodeViewRefilter");
+  root = create_bookmarks (db, 2000);
+  filter = ephy_node_filter_new ();
+
+  view = ephy_node_view_new (root, filter);
+  g_object_ref_sink (view);
+
+  /* Whichever way the filter changed, the rows shown are exactly the
+   * nodes it accepts. */
+  for (i = 0; i < G_N_ELEMENTS (searches); i++) {
+    set_search (filter, searches[i]);
+    g_assert_cmpint (count_rows (EPHY_NODE_VIEW (view)), ==, count_matches (filter, root));
+  }
+
+  /* Nodes changing while the filter is narrowed are still seen. */
+  set_search (filter, "renamed");
+  g_assert_cmpint (count_rows (EPHY_NODE_VIEW (view)), ==, 0);
+  ephy_node_set_property_string (ephy_node_get_nth_child (root, 7),
+                                 EPHY_NODE_BMK_PROP_TITLE, "Renamed bookmark");
+  g_assert_cmpint (count_rows (EPHY_NODE_VIEW (view)), ==, 1);
+  set_search (filter, "renamed b");
+  g_assert_cmpint (count_rows (EPHY_NODE_VIEW (view)), ==, 1);
+
+  g_object_unref (view);
+  g_object_unref (filter);
+  g_object_unref (db);
+}
+
+#define BENCHMARK_N_BOOKMARKS 20000
+
+static void
+test_node_view_refilter_benchmark (void)
+{
+  const char *search_text = "bookmark number 1999";
+  EphyNodeDb *db;
+  EphyNode *root;
+  EphyNodeFilter *filter;
+  GtkWidget *view;
+  double elapsed, max_elapsed = 0;
+  int length;
+
+  db = ephy_node_db_new ("RefilterBenchmark");
+  root = create_bookmarks (db, BENCHMARK_N_BOOKMARKS);
+  filter = ephy_node_filter_new ();
+
+  view = ephy_node_view_new (root, filter);
+  g_object_ref_sink (view);
+
+  /* Type the search text one character at a time, then delete it. */
+  for (length = 1; length <= strlen (search_text); length++) {
+    char *search = g_strndup (search_text, length);
+
+    g_test_timer_start ();
+    set_search (filter, search);
+    elapsed = g_test_timer_elapsed ();
+    max_elapsed = MAX (max_elapsed, elapsed);
+
+    g_free (search);
+  }
+
+  for (length = strlen (search_text) - 1; length >= 0; length--) {
+    char *search = g_strndup (search_text, length);
+
+    g_test_timer_start ();
+    set_search (filter, search);
+    elapsed = g_test_timer_elapsed ();
+    max_elapsed = MAX (max_elapsed, elapsed);
+
+    g_free (search);
+  }
+
+  g_test_minimized_result (max_elapsed, "%d bookmarks: %.2f ms per keystroke at most",
+                           BENCHMARK_N_BOOKMARKS, max_elapsed * 1000);
+
+  g_object_unref (view);
+  g_object_unref (filter);
+  g_object_unref (db);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gtk_test_init (&argc, &argv);
+  ephy_debug_init ();
+
+  g_test_add_func ("/lib/ephy-node-filter/folded_string",
+                   test_folded_string);
+  g_test_add_func ("/lib/ephy-node-filter/change",
+                   test_filter_change);
+  g_test_add_func ("/lib/ephy-node-filter/node_view_refilter",
+                   test_node_view_refilter);
+
+  if (g_test_perf ())
+    g_test_add_func ("/lib/ephy-node-filter/node_view_refilter_benchmark",
+                     test_node_view_refilter_benchmark);
+
+  return g_test_run ();
+}
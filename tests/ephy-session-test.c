@@ -24,6 +24,7 @@
 #include "ephy-embed-container.h"
 #include "ephy-embed-prefs.h"
 #include "ephy-embed-private.h"
+#include "ephy-embed-utils.h"
 #include "ephy-file-helpers.h"
 #include "ephy-private.h"
 #include "ephy-settings.h"
@@ -430,6 +431,215 @@ test_ephy_session_restore_tabs (void)
 }
 #endif
 
+static char *
+closed_tabs_session_data (guint n_tabs, gsize title_length)
+{
+  GString *data;
+  char *title;
+  guint i;
+
+  title = g_strnfill (title_length, 'x');
+
+  data = g_string_new ("<?xml version=\"1.0\"?>"
+                       "<session>"
+                       "<window x=\"94\" y=\"48\" width=\"1132\" height=\"684\" active-tab=\"0\">"
+                       "<embed url=\"about:blank\" title=\"Blank page\"/>"
+                       "</window>");
+
+  /* Most recently closed first, as the session saves them. */
+  for (i = 0; i < n_tabs; i++)
+    g_string_append_printf (data,
+                            "<closed-tab url=\"data:text/html,closed-%u\" position=\"0\" window=\"0\" current=\"0\">"
+                            "<entry url=\"data:text/html,closed-%u\" title=\"%s\"/>"
+                            "</closed-tab>",
+                            i, i, title);
+
+  g_string_append (data, "</session>");
+  g_free (title);
+
+  return g_string_free (data, FALSE);
+}
+
+static void
+undo_close_tab_and_check_address (EphySession *session,
+                                  EphyWindow *window,
+                                  const char *address)
+{
+  GMainLoop *loop;
+  EphyEmbed *embed;
+
+  loop = ephy_test_utils_setup_ensure_web_views_are_loaded ();
+  ephy_session_undo_close_tab (session);
+  ephy_test_utils_ensure_web_views_are_loaded (loop);
+
+  embed = ephy_embed_container_get_active_child (EPHY_EMBED_CONTAINER (window));
+  ephy_test_utils_check_ephy_embed_address (embed, address);
+}
+
+static void
+test_ephy_session_closed_tabs_eviction (void)
+{
+  EphySession *session;
+  GMainLoop *loop;
+  GList *l;
+  char *data;
+  gboolean ret;
+
+  disable_delayed_loading ();
+
+  session = ephy_shell_get_session (ephy_shell_get_default ());
+  g_assert (ephy_session_get_can_undo_tab_closed (session) == FALSE);
+
+  /* Each closed tab takes a bit more than a third of the budget, so
+   * only the two most recently closed ones are kept. */
+  data = closed_tabs_session_data (4, EPHY_SESSION_CLOSED_TABS_BUDGET / 3);
+
+  loop = ephy_test_utils_setup_ensure_web_views_are_loaded ();
+  ret = load_session_from_string (session, data);
+  g_assert (ret);
+  ephy_test_utils_ensure_web_views_are_loaded (loop);
+  g_free (data);
+
+  g_assert (ephy_session_get_can_undo_tab_closed (session) == TRUE);
+
+  l = gtk_application_get_windows (GTK_APPLICATION (ephy_shell_get_default ()));
+  g_assert_cmpint (g_list_length (l), ==, 1);
+
+  undo_close_tab_and_check_address (session, EPHY_WINDOW (l->data), "data:text/html,closed-0");
+  g_assert (ephy_session_get_can_undo_tab_closed (session) == TRUE);
+
+  undo_close_tab_and_check_address (session, EPHY_WINDOW (l->data), "data:text/html,closed-1");
+  g_assert (ephy_session_get_can_undo_tab_closed (session) == FALSE);
+
+  enable_delayed_loading ();
+  ephy_session_clear (session);
+}
+
+#if defined (HAVE_WEBKIT2) && WEBKIT_CHECK_VERSION (2, 7, 1)
+const char *session_data_closed_tab_session_state =
+"<?xml version=\"1.0\"?>"
+"<session>"
+	 "<window x=\"94\" y=\"48\" width=\"1132\" height=\"684\" active-tab=\"0\">"
+	   "<embed url=\"about:blank\" title=\"Blank page\"/>"
+	   "<embed url=\"data:text/html,page-0\" title=\"Page 0\"/>"
+	 "</window>"
+"</session>";
+
+static void
+load_url_and_wait (EphyWebView *view,
+                   const char *url)
+{
+  GMainLoop *loop;
+
+  loop = ephy_test_utils_setup_wait_until_load_is_committed (view);
+  ephy_web_view_load_url (view, url);
+  ephy_test_utils_wait_until_load_is_committed (loop);
+}
+
+static void
+test_ephy_session_closed_tab_session_state (void)
+{
+  EphySession *session;
+  GMainLoop *loop;
+  GList *l, *children, *back;
+  EphyEmbed *embed;
+  WebKitBackForwardList *bflist;
+  WebKitBackForwardListItem *item;
+  gboolean ret;
+
+  disable_delayed_loading ();
+
+  session = ephy_shell_get_session (ephy_shell_get_default ());
+
+  loop = ephy_test_utils_setup_ensure_web_views_are_loaded ();
+  ret = load_session_from_string (session, session_data_closed_tab_session_state);
+  g_assert (ret);
+  ephy_test_utils_ensure_web_views_are_loaded (loop);
+
+  l = gtk_application_get_windows (GTK_APPLICATION (ephy_shell_get_default ()));
+  children = ephy_embed_container_get_children (EPHY_EMBED_CONTAINER (l->data));
+  embed = EPHY_EMBED (g_list_nth_data (children, 1));
+  g_list_free (children);
+
+  load_url_and_wait (ephy_embed_get_web_view (embed), "data:text/html,page-1");
+  load_url_and_wait (ephy_embed_get_web_view (embed), "data:text/html,page-2");
+
+  gtk_widget_destroy (GTK_WIDGET (embed));
+  g_assert (ephy_session_get_can_undo_tab_closed (session) == TRUE);
+
+  undo_close_tab_and_check_address (session, EPHY_WINDOW (l->data), "data:text/html,page-2");
+
+  /* The whole list is back, without loading the previous pages. */
+  embed = ephy_embed_container_get_active_child (EPHY_EMBED_CONTAINER (l->data));
+  bflist = webkit_web_view_get_back_forward_list (EPHY_GET_WEBKIT_WEB_VIEW_FROM_EMBED (embed));
+  back = webkit_back_forward_list_get_back_list (bflist);
+  g_assert_cmpuint (g_list_length (back), ==, 2);
+  g_list_free (back);
+
+  item = webkit_back_forward_list_get_nth_item (bflist, -2);
+  g_assert_cmpstr (webkit_back_forward_list_item_get_uri (item), ==, "data:text/html,page-0");
+
+  enable_delayed_loading ();
+  ephy_session_clear (session);
+}
+#endif
+
+#ifndef HAVE_WEBKIT2
+const char *session_data_closed_tab_history =
+"<?xml version=\"1.0\"?>"
+"<session>"
+	 "<window x=\"94\" y=\"48\" width=\"1132\" height=\"684\" active-tab=\"0\">"
+	   "<embed url=\"about:blank\" title=\"Blank page\"/>"
+	 "</window>"
+	 "<closed-tab url=\"data:text/html,page-3\" position=\"1\" window=\"0\" current=\"3\">"
+	   "<entry url=\"data:text/html,page-0\" title=\"Page 0\"/>"
+	   "<entry url=\"data:text/html,page-1\" title=\"Page 1\"/>"
+	   "<entry url=\"data:text/html,page-2\" title=\"Page 2\"/>"
+	   "<entry url=\"data:text/html,page-3\" title=\"Page 3\"/>"
+	   "<entry url=\"data:text/html,page-4\" title=\"Page 4\"/>"
+	 "</closed-tab>"
+"</session>";
+
+static void
+test_ephy_session_closed_tab_history (void)
+{
+  EphySession *session;
+  GMainLoop *loop;
+  GList *l;
+  EphyEmbed *embed;
+  WebKitWebBackForwardList *bflist;
+  WebKitWebHistoryItem *item;
+  gboolean ret;
+
+  disable_delayed_loading ();
+
+  session = ephy_shell_get_session (ephy_shell_get_default ());
+
+  loop = ephy_test_utils_setup_ensure_web_views_are_loaded ();
+  ret = load_session_from_string (session, session_data_closed_tab_history);
+  g_assert (ret);
+  ephy_test_utils_ensure_web_views_are_loaded (loop);
+
+  l = gtk_application_get_windows (GTK_APPLICATION (ephy_shell_get_default ()));
+  undo_close_tab_and_check_address (session, EPHY_WINDOW (l->data), "data:text/html,page-3");
+
+  /* Everything before the current entry is back in the list,
+   * without having been loaded. */
+  embed = ephy_embed_container_get_active_child (EPHY_EMBED_CONTAINER (l->data));
+  bflist = webkit_web_view_get_back_forward_list (EPHY_GET_WEBKIT_WEB_VIEW_FROM_EMBED (embed));
+  g_assert_cmpint (webkit_web_back_forward_list_get_back_length (bflist), ==, 3);
+
+  item = webkit_web_back_forward_list_get_nth_item (bflist, -1);
+  g_assert_cmpstr (webkit_web_history_item_get_uri (item), ==, "data:text/html,page-2");
+  item = webkit_web_back_forward_list_get_nth_item (bflist, -3);
+  g_assert_cmpstr (webkit_web_history_item_get_uri (item), ==, "data:text/html,page-0");
+  g_assert_cmpstr (webkit_web_history_item_get_title (item), ==, "Page 0");
+
+  enable_delayed_loading ();
+  ephy_session_clear (session);
+}
+#endif
+
 int
 main (int argc, char *argv[])
 {
@@ -479,6 +689,17 @@ main (int argc, char *argv[])
                   test_ephy_session_restore_tabs);
 #endif
 
+  g_test_add_func ("/src/ephy-session/closed-tabs-eviction",
+                   test_ephy_session_closed_tabs_eviction);
+
+#if defined (HAVE_WEBKIT2) && WEBKIT_CHECK_VERSION (2, 7, 1)
+  g_test_add_func ("/src/ephy-session/closed-tab-history",
+                   test_ephy_session_closed_tab_session_state);
+#elif !defined (HAVE_WEBKIT2)
+  g_test_add_func ("/src/ephy-session/closed-tab-history",
+                   test_ephy_session_closed_tab_history);
+#endif
+
   ret = g_test_run ();
 
   g_object_unref (ephy_shell_get_default ());
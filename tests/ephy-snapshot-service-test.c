@@ -20,6 +20,7 @@
 
 #include "config.h"
 #include "ephy-debug.h"
+#include "ephy-image-scale.h"
 #include "ephy-snapshot-service.h"
 
 #include <libsoup/soup.h>
@@ -207,6 +208,258 @@ test_snapshot_and_timed_cancellation (void)
   gtk_main ();
 }
 
+static void
+on_snapshots_for_urls_ready (GObject *source,
+                             GAsyncResult *res,
+                             gpointer user_data)
+{
+  GPtrArray *snapshots;
+  GError *error = NULL;
+
+  snapshots = ephy_snapshot_service_get_snapshots_for_urls_finish (EPHY_SNAPSHOT_SERVICE (source),
+                                                                   res, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (snapshots->len, ==, 3);
+  g_assert (GDK_IS_PIXBUF (g_ptr_array_index (snapshots, 0)));
+  g_assert (g_ptr_array_index (snapshots, 1) == NULL);
+  g_assert (g_ptr_array_index (snapshots, 2) == NULL);
+  g_ptr_array_unref (snapshots);
+
+  gtk_main_quit ();
+}
+
+static void
+test_snapshots_for_urls (void)
+{
+  EphySnapshotService *service = ephy_snapshot_service_get_default ();
+  const char *urls[] = { TEST_SERVER_URI "/batch", TEST_SERVER_URI "/missing", TEST_SERVER_URI "/batch" };
+  time_t mtimes[] = { mtime, mtime, mtime - 1 };
+  GdkPixbuf *pixbuf, *cached;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                           EPHY_THUMBNAIL_WIDTH, EPHY_THUMBNAIL_HEIGHT);
+  gdk_pixbuf_fill (pixbuf, 0x336699ff);
+  ephy_snapshot_service_save_snapshot_async (service, pixbuf, urls[0], mtime,
+                                             NULL, NULL, NULL);
+
+  /* Saved snapshots are available from memory right away, but only
+     for the same modification time. */
+  cached = ephy_snapshot_service_lookup_cached_snapshot (service, urls[0], mtime);
+  g_assert (cached == pixbuf);
+  g_object_unref (cached);
+  g_assert (ephy_snapshot_service_lookup_cached_snapshot (service, urls[0], mtime - 1) == NULL);
+  g_object_unref (pixbuf);
+
+  ephy_snapshot_service_get_snapshots_for_urls_async (service, urls, mtimes, G_N_ELEMENTS (urls),
+                                                      NULL, on_snapshots_for_urls_ready, NULL);
+  gtk_main ();
+}
+
+/* A HiDPI sized web view. */
+#define SURFACE_WIDTH 2560
+#define SURFACE_HEIGHT 1920
+
+static cairo_surface_t *
+create_random_surface (int width,
+                       int height)
+{
+  cairo_surface_t *surface;
+  GRand *rand;
+  guint32 *pixels;
+  int stride, x, y;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  stride = cairo_image_surface_get_stride (surface);
+  rand = g_rand_new_with_seed (42);
+
+  cairo_surface_flush (surface);
+  for (y = 0; y < height; y++) {
+    pixels = (guint32 *)(cairo_image_surface_get_data (surface) + y * stride);
+    for (x = 0; x < width; x++) {
+      guint32 alpha = g_rand_int_range (rand, 0, 256);
+
+      /* Keep it premultiplied. */
+      pixels[x] = alpha << 24 |
+        g_rand_int_range (rand, 0, alpha + 1) << 16 |
+        g_rand_int_range (rand, 0, alpha + 1) << 8 |
+        g_rand_int_range (rand, 0, alpha + 1);
+    }
+  }
+  cairo_surface_mark_dirty (surface);
+
+  g_rand_free (rand);
+
+  return surface;
+}
+
+static void
+test_box_scale (void)
+{
+  cairo_surface_t *surface;
+  guchar *scalar, *vectorized;
+  int stride;
+  struct {
+    int width;
+    int height;
+  } sizes[] = {
+    { EPHY_THUMBNAIL_WIDTH, EPHY_THUMBNAIL_HEIGHT },
+    { 181, 137 },
+    { 1, 1 },
+    { SURFACE_WIDTH / 3, SURFACE_HEIGHT / 7 },
+    { SURFACE_WIDTH, SURFACE_HEIGHT }
+  };
+  int i;
+
+  surface = create_random_surface (SURFACE_WIDTH, SURFACE_HEIGHT);
+  stride = cairo_image_surface_get_stride (surface);
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    gsize size = sizes[i].width * sizes[i].height * 4;
+
+    scalar = g_malloc (size);
+    vectorized = g_malloc (size);
+
+    ephy_image_box_scale_argb32_scalar (cairo_image_surface_get_data (surface),
+                                        SURFACE_WIDTH, SURFACE_HEIGHT, stride,
+                                        scalar, sizes[i].width, sizes[i].height, sizes[i].width * 4);
+    ephy_image_box_scale_argb32 (cairo_image_surface_get_data (surface),
+                                 SURFACE_WIDTH, SURFACE_HEIGHT, stride,
+                                 vectorized, sizes[i].width, sizes[i].height, sizes[i].width * 4);
+
+    g_assert (memcmp (scalar, vectorized, size) == 0);
+
+    g_free (scalar);
+    g_free (vectorized);
+  }
+
+  cairo_surface_destroy (surface);
+}
+
+static void
+test_box_scale_solid (void)
+{
+  cairo_surface_t *surface;
+  GdkPixbuf *pixbuf;
+  cairo_t *cr;
+  guchar *pixels;
+  int x, y;
+
+  /* Half transparent red, which must survive premultiplication. */
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 1000, 750);
+  cr = cairo_create (surface);
+  cairo_set_source_rgba (cr, 1, 0, 0, 0.5);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+
+  pixbuf = ephy_snapshot_service_prepare_snapshot (surface, NULL);
+  g_assert_cmpint (gdk_pixbuf_get_width (pixbuf), ==, EPHY_THUMBNAIL_WIDTH);
+  g_assert_cmpint (gdk_pixbuf_get_height (pixbuf), ==, EPHY_THUMBNAIL_HEIGHT);
+
+  for (y = 0; y < EPHY_THUMBNAIL_HEIGHT; y++) {
+    pixels = gdk_pixbuf_get_pixels (pixbuf) + y * gdk_pixbuf_get_rowstride (pixbuf);
+    for (x = 0; x < EPHY_THUMBNAIL_WIDTH; x++) {
+      g_assert_cmpint (pixels[x * 4], ==, 255);
+      g_assert_cmpint (pixels[x * 4 + 1], ==, 0);
+      g_assert_cmpint (pixels[x * 4 + 2], ==, 0);
+      g_assert_cmpint (ABS (pixels[x * 4 + 3] - 128), <=, 1);
+    }
+  }
+
+  g_object_unref (pixbuf);
+  cairo_surface_destroy (surface);
+}
+
+static void
+on_snapshot_prepared (GObject *source,
+                      GAsyncResult *res,
+                      GdkPixbuf **pixbuf)
+{
+  *pixbuf = ephy_snapshot_service_prepare_snapshot_finish (EPHY_SNAPSHOT_SERVICE (source),
+                                                           res, NULL);
+  gtk_main_quit ();
+}
+
+static void
+test_prepare_snapshot_async (void)
+{
+  EphySnapshotService *service = ephy_snapshot_service_get_default ();
+  cairo_surface_t *surface;
+  GdkPixbuf *pixbuf = NULL, *expected;
+
+  surface = create_random_surface (SURFACE_WIDTH, SURFACE_HEIGHT);
+
+  ephy_snapshot_service_prepare_snapshot_async (service, surface, NULL, NULL,
+                                                (GAsyncReadyCallback)on_snapshot_prepared,
+                                                &pixbuf);
+  gtk_main ();
+
+  g_assert (GDK_IS_PIXBUF (pixbuf));
+  expected = ephy_snapshot_service_prepare_snapshot (surface, NULL);
+  g_assert (memcmp (gdk_pixbuf_get_pixels (pixbuf), gdk_pixbuf_get_pixels (expected),
+                    gdk_pixbuf_get_rowstride (pixbuf) * EPHY_THUMBNAIL_HEIGHT) == 0);
+
+  g_object_unref (expected);
+  g_object_unref (pixbuf);
+  cairo_surface_destroy (surface);
+}
+
+static double
+benchmark_scaler (cairo_surface_t *surface,
+                  void (* scale) (const guchar *, int, int, int, guchar *, int, int, int))
+{
+  guchar *dest;
+  double elapsed;
+  int i, runs = 20;
+
+  dest = g_malloc (EPHY_THUMBNAIL_WIDTH * EPHY_THUMBNAIL_HEIGHT * 4);
+
+  g_test_timer_start ();
+  for (i = 0; i < runs; i++)
+    scale (cairo_image_surface_get_data (surface),
+           SURFACE_WIDTH, SURFACE_HEIGHT, cairo_image_surface_get_stride (surface),
+           dest, EPHY_THUMBNAIL_WIDTH, EPHY_THUMBNAIL_HEIGHT, EPHY_THUMBNAIL_WIDTH * 4);
+  elapsed = g_test_timer_elapsed ();
+
+  g_free (dest);
+
+  /* Megapixels per second. */
+  return runs * (SURFACE_WIDTH * SURFACE_HEIGHT / 1e6) / elapsed;
+}
+
+static void
+test_box_scale_benchmark (void)
+{
+  cairo_surface_t *surface;
+  GdkPixbuf *pixbuf, *scaled;
+  double scalar, vectorized, elapsed;
+
+  surface = create_random_surface (SURFACE_WIDTH, SURFACE_HEIGHT);
+
+  scalar = benchmark_scaler (surface, ephy_image_box_scale_argb32_scalar);
+  g_test_maximized_result (scalar, "Scalar box scale: %.0f Mpixels/s", scalar);
+
+  vectorized = benchmark_scaler (surface, ephy_image_box_scale_argb32);
+  g_test_maximized_result (vectorized, "Vectorized box scale: %.0f Mpixels/s", vectorized);
+
+  /* What prepare_snapshot used to do. */
+  g_test_timer_start ();
+  pixbuf = gdk_pixbuf_get_from_surface (surface, 0, 0, SURFACE_WIDTH, SURFACE_HEIGHT);
+  scaled = gdk_pixbuf_scale_simple (pixbuf, EPHY_THUMBNAIL_WIDTH, EPHY_THUMBNAIL_HEIGHT,
+                                    GDK_INTERP_TILES);
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "GdkPixbuf copy and scale: %.2f ms", elapsed * 1000);
+  g_object_unref (scaled);
+  g_object_unref (pixbuf);
+
+  g_test_timer_start ();
+  pixbuf = ephy_snapshot_service_prepare_snapshot (surface, NULL);
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "Prepare snapshot: %.2f ms", elapsed * 1000);
+  g_object_unref (pixbuf);
+
+  cairo_surface_destroy (surface);
+}
+
 static void
 server_callback (SoupServer *server, SoupMessage *msg,
                  const char *path, GHashTable *query,
@@ -251,5 +504,17 @@ main (int argc, char *argv[])
                    test_already_cancelled_snapshot);
   g_test_add_func ("/lib/ephy-snapshot-service/test_snapshot_and_timed_cancellation",
                    test_snapshot_and_timed_cancellation);
+  g_test_add_func ("/lib/ephy-snapshot-service/test_snapshots_for_urls",
+                   test_snapshots_for_urls);
+  g_test_add_func ("/lib/ephy-snapshot-service/test_box_scale",
+                   test_box_scale);
+  g_test_add_func ("/lib/ephy-snapshot-service/test_box_scale_solid",
+                   test_box_scale_solid);
+  g_test_add_func ("/lib/ephy-snapshot-service/test_prepare_snapshot_async",
+                   test_prepare_snapshot_async);
+
+  if (g_test_perf ())
+    g_test_add_func ("/lib/ephy-snapshot-service/test_box_scale_benchmark",
+                     test_box_scale_benchmark);
   return g_test_run ();
 }
@@ -0,0 +1,239 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ * Copyright © 2013 Igalia S.L.
+ *
+ * Epiphany is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Epiphany is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Epiphany; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "ephy-bookmarks.h"
+#include "ephy-debug.h"
+#include "ephy-embed-prefs.h"
+#include "ephy-file-helpers.h"
+#include "ephy-history-service.h"
+#include "ephy-private.h"
+#include "ephy-profile-utils.h"
+#include "ephy-shell.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#define N_ITEMS 500
+#define PERF_N_ITEMS 20000
+#define N_SESSION_WINDOWS 4
+#define N_SESSION_TABS 10
+#define STARTUP_TIMEOUT 60
+
+static const char *milestones[] = {
+  "embed-shell-started",
+  "shell-started",
+  "bookmarks-loaded",
+  "history-opened",
+  "session-restored",
+  "first-window-drawn",
+  "interactive"
+};
+
+static GMainLoop *loop;
+
+static void
+add_visits_cb (EphyHistoryService *service,
+               gboolean success,
+               gpointer result_data,
+               gpointer user_data)
+{
+  g_assert (success);
+  g_main_loop_quit (loop);
+}
+
+static void
+seed_history (int n_urls)
+{
+  EphyHistoryService *service;
+  GList *visits = NULL;
+  char *filename;
+  int i;
+
+  filename = g_build_filename (ephy_dot_dir (), EPHY_HISTORY_FILE, NULL);
+  service = ephy_history_service_new (filename);
+  g_free (filename);
+
+  for (i = 0; i < n_urls; i++) {
+    char *url = g_strdup_printf ("http://www.example%d.com/page/%d", i % 200, i);
+
+    visits = g_list_prepend (visits,
+                             ephy_history_page_visit_new (url, i, EPHY_PAGE_VISIT_TYPED));
+    g_free (url);
+  }
+
+  ephy_history_service_add_visits (service, visits, NULL, add_visits_cb, NULL);
+  g_main_loop_run (loop);
+
+  ephy_history_page_visit_list_free (visits);
+  g_object_unref (service);
+}
+
+static void
+seed_bookmarks (int n_bookmarks)
+{
+  EphyBookmarks *bookmarks;
+  int i;
+
+  bookmarks = ephy_bookmarks_new ();
+
+  for (i = 0; i < n_bookmarks; i++) {
+    char *title = g_strdup_printf ("Bookmark %d", i);
+    char *url = g_strdup_printf ("http://www.example%d.com/bookmark/%d", i % 200, i);
+
+    ephy_bookmarks_add (bookmarks, title, url);
+    g_free (title);
+    g_free (url);
+  }
+
+  /* Saved on finalization. */
+  g_object_unref (bookmarks);
+}
+
+static void
+seed_session (void)
+{
+  GString *session;
+  char *filename;
+  int i, j;
+
+  session = g_string_new ("<?xml version=\"1.0\"?><session>");
+
+  for (i = 0; i < N_SESSION_WINDOWS; i++) {
+    g_string_append (session, "<window x=\"0\" y=\"0\" width=\"800\" height=\"600\" active-tab=\"0\">");
+    for (j = 0; j < N_SESSION_TABS; j++)
+      g_string_append (session, "<embed url=\"about:blank\" title=\"Blank page\"/>");
+    g_string_append (session, "</window>");
+  }
+
+  g_string_append (session, "</session>");
+
+  filename = g_build_filename (ephy_dot_dir (), "session_state.xml", NULL);
+  g_assert (g_file_set_contents (filename, session->str, -1, NULL));
+  g_free (filename);
+
+  g_string_free (session, TRUE);
+}
+
+static gboolean
+startup_timeout_cb (gpointer user_data)
+{
+  g_assert_not_reached ();
+
+  return FALSE;
+}
+
+static gboolean
+check_interactive_cb (gpointer user_data)
+{
+  if (ephy_trace_get_milestone ("interactive") == -1 ||
+      ephy_trace_get_milestone ("first-window-drawn") == -1)
+    return TRUE;
+
+  g_main_loop_quit (loop);
+
+  return FALSE;
+}
+
+static void
+test_ephy_startup_timeline (void)
+{
+  EphyShell *shell;
+  gint64 start, first_window, interactive;
+  guint timeout_id;
+  int i;
+
+  seed_history (g_test_perf () ? PERF_N_ITEMS : N_ITEMS);
+  seed_bookmarks (g_test_perf () ? PERF_N_ITEMS : N_ITEMS);
+  seed_session ();
+
+  start = g_get_monotonic_time ();
+
+  _ephy_shell_create_instance (EPHY_EMBED_SHELL_MODE_PRIVATE);
+  shell = ephy_shell_get_default ();
+  ephy_shell_set_startup_context (shell,
+                                  ephy_shell_startup_context_new (0, NULL, NULL, NULL, NULL, 0));
+
+  g_application_register (G_APPLICATION (shell), NULL, NULL);
+  g_application_activate (G_APPLICATION (shell));
+
+  timeout_id = g_timeout_add_seconds (STARTUP_TIMEOUT, startup_timeout_cb, NULL);
+  g_timeout_add (10, check_interactive_cb, NULL);
+  g_main_loop_run (loop);
+  g_source_remove (timeout_id);
+
+  for (i = 0; i < G_N_ELEMENTS (milestones); i++) {
+    gint64 reached = ephy_trace_get_milestone (milestones[i]);
+
+    if (reached == -1)
+      g_test_message ("%s: not reached", milestones[i]);
+    else
+      g_test_message ("%s: %.1f ms", milestones[i],
+                      (double)(reached - start) / G_TIME_SPAN_MILLISECOND);
+  }
+
+  g_assert_cmpint (ephy_trace_get_milestone ("embed-shell-started"), <=, ephy_trace_get_milestone ("shell-started"));
+  g_assert_cmpint (ephy_trace_get_milestone ("shell-started"), <=, ephy_trace_get_milestone ("session-restored"));
+  g_assert_cmpint (ephy_trace_get_milestone ("session-restored"), <=, ephy_trace_get_milestone ("interactive"));
+  g_assert_cmpint (ephy_shell_get_n_windows (shell), ==, N_SESSION_WINDOWS);
+
+  first_window = ephy_trace_get_milestone ("first-window-drawn") - start;
+  interactive = ephy_trace_get_milestone ("interactive") - start;
+
+  g_test_minimized_result ((double)first_window / G_TIME_SPAN_MILLISECOND,
+                           "Time to first window: %.1f ms",
+                           (double)first_window / G_TIME_SPAN_MILLISECOND);
+  g_test_minimized_result ((double)interactive / G_TIME_SPAN_MILLISECOND,
+                           "Time to interactive: %.1f ms",
+                           (double)interactive / G_TIME_SPAN_MILLISECOND);
+
+  ephy_shell_close_all_windows (shell);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+  g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+  gtk_test_init (&argc, &argv);
+
+  ephy_debug_init ();
+  ephy_embed_prefs_init ();
+
+  if (!ephy_file_helpers_init (NULL, EPHY_FILE_HELPERS_PRIVATE_PROFILE | EPHY_FILE_HELPERS_ENSURE_EXISTS, NULL)) {
+    g_debug ("Something wrong happened with ephy_file_helpers_init()");
+    return -1;
+  }
+
+  loop = g_main_loop_new (NULL, FALSE);
+
+  /* The shell can only be started once per process. */
+  g_test_add_func ("/src/ephy-startup/timeline",
+                   test_ephy_startup_timeline);
+
+  ret = g_test_run ();
+
+  g_main_loop_unref (loop);
+  ephy_file_helpers_shutdown ();
+
+  return ret;
+}
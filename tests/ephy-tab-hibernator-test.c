@@ -0,0 +1,504 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-debug.h"
+#include "ephy-embed-container.h"
+#include "ephy-embed-prefs.h"
+#include "ephy-file-helpers.h"
+#include "ephy-private.h"
+#include "ephy-shell.h"
+#include "ephy-tab-hibernator.h"
+#include "ephy-test-utils.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#define MIB (1024 * 1024)
+
+/* A memory monitor reporting whatever usage the test sets. */
+typedef EphyMemoryMonitor      FakeMemoryMonitor;
+typedef EphyMemoryMonitorClass FakeMemoryMonitorClass;
+
+G_DEFINE_TYPE (FakeMemoryMonitor, fake_memory_monitor, EPHY_TYPE_MEMORY_MONITOR)
+
+static guint64 fake_usage;
+
+static guint64
+fake_memory_monitor_get_usage (EphyMemoryMonitor *monitor)
+{
+  return fake_usage;
+}
+
+static gboolean
+fake_memory_monitor_is_memory_low (EphyMemoryMonitor *monitor)
+{
+  return FALSE;
+}
+
+static void
+fake_memory_monitor_init (FakeMemoryMonitor *monitor)
+{
+}
+
+static void
+fake_memory_monitor_class_init (FakeMemoryMonitorClass *klass)
+{
+  klass->get_usage = fake_memory_monitor_get_usage;
+  klass->is_memory_low = fake_memory_monitor_is_memory_low;
+}
+
+typedef struct {
+  GMainLoop *loop;
+  guint n_hibernated;
+} CheckClosure;
+
+static void
+check_finished_cb (EphyTabHibernator *hibernator,
+                   GAsyncResult *result,
+                   CheckClosure *closure)
+{
+  closure->n_hibernated = ephy_tab_hibernator_check_finish (hibernator, result, NULL);
+  g_main_loop_quit (closure->loop);
+}
+
+static guint
+run_check (EphyTabHibernator *hibernator)
+{
+  CheckClosure closure;
+
+  closure.loop = g_main_loop_new (NULL, FALSE);
+  closure.n_hibernated = 0;
+
+  ephy_tab_hibernator_check (hibernator, NULL,
+                             (GAsyncReadyCallback)check_finished_cb,
+                             &closure);
+  g_main_loop_run (closure.loop);
+  g_main_loop_unref (closure.loop);
+
+  return closure.n_hibernated;
+}
+
+static void
+wait_for_load_finished (EphyEmbed *embed)
+{
+  while (ephy_web_view_is_loading (ephy_embed_get_web_view (embed)))
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static EphyEmbed *
+open_tab (EphyWindow *window,
+          const char *address)
+{
+  EphyEmbed *embed;
+  GMainLoop *loop;
+
+  loop = ephy_test_utils_setup_ensure_web_views_are_loaded ();
+  embed = ephy_shell_new_tab (ephy_shell_get_default (), window, NULL, address,
+                              EPHY_NEW_TAB_DONT_SHOW_WINDOW | EPHY_NEW_TAB_IN_EXISTING_WINDOW |
+                              EPHY_NEW_TAB_APPEND_LAST | EPHY_NEW_TAB_OPEN_PAGE);
+  ephy_test_utils_ensure_web_views_are_loaded (loop);
+
+  /* Tabs still loading are never hibernated. */
+  wait_for_load_finished (embed);
+
+  return embed;
+}
+
+static void
+select_tab (EphyWindow *window,
+            EphyEmbed *embed)
+{
+  GtkNotebook *notebook = GTK_NOTEBOOK (ephy_window_get_notebook (window));
+
+  /* Make sure the tabs are used at different times. */
+  g_usleep (1000);
+  gtk_notebook_set_current_page (notebook, gtk_notebook_page_num (notebook, GTK_WIDGET (embed)));
+}
+
+static EphyWindow *
+create_window_with_tabs (EphyEmbed **embeds,
+                         guint n_embeds)
+{
+  EphyWindow *window;
+  guint i;
+
+  window = ephy_window_new ();
+  for (i = 0; i < n_embeds; i++) {
+    char *address = g_strdup_printf ("data:text/html,tab-%u", i);
+
+    embeds[i] = open_tab (window, address);
+    g_free (address);
+  }
+
+  /* The last one selected is the active tab. */
+  for (i = 0; i < n_embeds; i++)
+    select_tab (window, embeds[i]);
+
+  return window;
+}
+
+static void
+test_ephy_tab_hibernator_disabled (void)
+{
+  EphyMemoryMonitor *monitor;
+  EphyTabHibernator *hibernator;
+  EphyWindow *window;
+  EphyEmbed *embeds[2];
+
+  monitor = g_object_new (fake_memory_monitor_get_type (), NULL);
+  hibernator = ephy_tab_hibernator_new (monitor);
+
+  window = create_window_with_tabs (embeds, G_N_ELEMENTS (embeds));
+
+  fake_usage = G_MAXUINT64;
+  g_assert_cmpuint (run_check (hibernator), ==, 0);
+  g_assert_cmpuint (ephy_tab_hibernator_get_n_hibernated (hibernator), ==, 0);
+
+  gtk_widget_destroy (GTK_WIDGET (window));
+  g_object_unref (hibernator);
+  g_object_unref (monitor);
+}
+
+#if WEBKIT_CHECK_VERSION (2, 7, 1)
+static void
+test_ephy_tab_hibernator_threshold (void)
+{
+  EphyMemoryMonitor *monitor;
+  EphyTabHibernator *hibernator;
+  EphyWindow *window;
+  EphyEmbed *embeds[3];
+
+  monitor = g_object_new (fake_memory_monitor_get_type (), NULL);
+  hibernator = ephy_tab_hibernator_new (monitor);
+  g_object_set (hibernator, "threshold", 100, NULL);
+
+  window = create_window_with_tabs (embeds, G_N_ELEMENTS (embeds));
+
+  /* Nothing to do under the threshold. */
+  fake_usage = 50 * MIB;
+  g_assert_cmpuint (run_check (hibernator), ==, 0);
+  g_assert_cmpuint (ephy_tab_hibernator_get_n_hibernated (hibernator), ==, 0);
+
+  /* Above it, one tab at a time, least recently used first. */
+  fake_usage = 200 * MIB;
+  g_assert_cmpuint (run_check (hibernator), ==, 1);
+  g_assert (ephy_embed_get_hibernated (embeds[0]));
+  g_assert (!ephy_embed_get_hibernated (embeds[1]));
+  g_assert_cmpuint (ephy_tab_hibernator_get_n_hibernated (hibernator), ==, 1);
+  g_assert_cmpuint (ephy_tab_hibernator_get_reclaimed_bytes (hibernator), ==, 0);
+
+  /* The placeholder keeps the address. */
+  ephy_test_utils_check_ephy_embed_address (embeds[0], "data:text/html,tab-0");
+
+  /* What it gave back is measured on the next check. */
+  fake_usage = 150 * MIB;
+  g_assert_cmpuint (run_check (hibernator), ==, 1);
+  g_assert_cmpuint (ephy_tab_hibernator_get_reclaimed_bytes (hibernator), ==, 50 * MIB);
+  g_assert (ephy_embed_get_hibernated (embeds[1]));
+
+  /* The active tab is never hibernated. */
+  fake_usage = 120 * MIB;
+  g_assert_cmpuint (run_check (hibernator), ==, 0);
+  g_assert_cmpuint (ephy_tab_hibernator_get_reclaimed_bytes (hibernator), ==, 80 * MIB);
+  g_assert (!ephy_embed_get_hibernated (embeds[2]));
+  g_assert_cmpuint (ephy_tab_hibernator_get_n_hibernated (hibernator), ==, 2);
+  g_assert_cmpuint (ephy_tab_hibernator_get_n_hibernations (hibernator), ==, 2);
+
+  /* Switching to a hibernated tab loads it again. */
+  select_tab (window, embeds[0]);
+  g_assert (!ephy_embed_get_hibernated (embeds[0]));
+  g_assert (!ephy_embed_has_load_pending (embeds[0]));
+  g_assert_cmpuint (ephy_tab_hibernator_get_n_hibernated (hibernator), ==, 1);
+
+  gtk_widget_destroy (GTK_WIDGET (window));
+  g_object_unref (hibernator);
+  g_object_unref (monitor);
+}
+
+static void
+test_ephy_tab_hibernator_low_memory (void)
+{
+  EphyMemoryMonitor *monitor;
+  EphyTabHibernator *hibernator;
+  EphyWindow *window;
+  EphyEmbed *embeds[3];
+
+  monitor = g_object_new (fake_memory_monitor_get_type (), NULL);
+  hibernator = ephy_tab_hibernator_new (monitor);
+
+  window = create_window_with_tabs (embeds, G_N_ELEMENTS (embeds));
+
+  /* All the background tabs go at once, whatever the threshold. */
+  fake_usage = 300 * MIB;
+  g_signal_emit_by_name (monitor, "low-memory");
+  while (ephy_tab_hibernator_get_n_hibernations (hibernator) < 2)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert (ephy_embed_get_hibernated (embeds[0]));
+  g_assert (ephy_embed_get_hibernated (embeds[1]));
+  g_assert (!ephy_embed_get_hibernated (embeds[2]));
+  g_assert_cmpuint (ephy_tab_hibernator_get_n_hibernations (hibernator), ==, 2);
+
+  fake_usage = 100 * MIB;
+  g_assert_cmpuint (run_check (hibernator), ==, 0);
+  g_assert_cmpuint (ephy_tab_hibernator_get_reclaimed_bytes (hibernator), ==, 200 * MIB);
+
+  gtk_widget_destroy (GTK_WIDGET (window));
+  g_object_unref (hibernator);
+  g_object_unref (monitor);
+}
+
+static void
+test_ephy_tab_hibernator_form_submission (void)
+{
+  EphyMemoryMonitor *monitor;
+  EphyTabHibernator *hibernator;
+  EphyWindow *window;
+  EphyEmbed *embeds[2];
+  EphyWebView *view;
+  GMainLoop *loop;
+
+  monitor = g_object_new (fake_memory_monitor_get_type (), NULL);
+  hibernator = ephy_tab_hibernator_new (monitor);
+  g_object_set (hibernator, "threshold", 100, NULL);
+
+  window = ephy_window_new ();
+  embeds[0] = open_tab (window, "data:text/html,"
+                        "<form action='data:text/html,submitted' method='get'>"
+                        "<input name='q' value='x'></form>");
+  embeds[1] = open_tab (window, "data:text/html,active");
+  select_tab (window, embeds[0]);
+  select_tab (window, embeds[1]);
+
+  view = ephy_embed_get_web_view (embeds[0]);
+  g_assert (!ephy_web_view_is_form_submission (view));
+
+  loop = ephy_test_utils_setup_wait_until_load_is_committed (view);
+  webkit_web_view_run_javascript (WEBKIT_WEB_VIEW (view), "document.forms[0].submit();",
+                                  NULL, NULL, NULL);
+  ephy_test_utils_wait_until_load_is_committed (loop);
+  wait_for_load_finished (embeds[0]);
+
+  g_assert (ephy_web_view_is_form_submission (view));
+
+  /* Its address alone wouldn't give the same page back. */
+  fake_usage = 200 * MIB;
+  g_assert_cmpuint (run_check (hibernator), ==, 0);
+  g_assert (!ephy_embed_get_hibernated (embeds[0]));
+
+  gtk_widget_destroy (GTK_WIDGET (window));
+  g_object_unref (hibernator);
+  g_object_unref (monitor);
+}
+
+static void
+load_and_wait (EphyWebView *view,
+               const char *address)
+{
+  GMainLoop *loop;
+
+  loop = ephy_test_utils_setup_wait_until_load_is_committed (view);
+  if (address)
+    ephy_web_view_load_url (view, address);
+  else
+    webkit_web_view_go_back (WEBKIT_WEB_VIEW (view));
+  ephy_test_utils_wait_until_load_is_committed (loop);
+}
+
+static void
+check_back_forward_lengths (EphyWebView *view,
+                            guint back_length,
+                            guint forward_length)
+{
+  WebKitBackForwardList *list;
+  GList *items;
+
+  list = webkit_web_view_get_back_forward_list (WEBKIT_WEB_VIEW (view));
+
+  items = webkit_back_forward_list_get_back_list (list);
+  g_assert_cmpuint (g_list_length (items), ==, back_length);
+  g_list_free (items);
+
+  items = webkit_back_forward_list_get_forward_list (list);
+  g_assert_cmpuint (g_list_length (items), ==, forward_length);
+  g_list_free (items);
+}
+
+static void
+test_ephy_tab_hibernator_navigation_state (void)
+{
+  EphyMemoryMonitor *monitor;
+  EphyTabHibernator *hibernator;
+  EphyWindow *window;
+  EphyEmbed *embeds[2];
+  EphyWebView *view;
+  GMainLoop *loop;
+
+  monitor = g_object_new (fake_memory_monitor_get_type (), NULL);
+  hibernator = ephy_tab_hibernator_new (monitor);
+  g_object_set (hibernator, "threshold", 100, NULL);
+
+  window = ephy_window_new ();
+  embeds[0] = open_tab (window, "data:text/html,page-0");
+  embeds[1] = open_tab (window, "data:text/html,active");
+
+  /* Leave page-1 current, with an entry on each side. */
+  view = ephy_embed_get_web_view (embeds[0]);
+  load_and_wait (view, "data:text/html,page-1");
+  load_and_wait (view, "data:text/html,page-2");
+  load_and_wait (view, NULL);
+  wait_for_load_finished (embeds[0]);
+  check_back_forward_lengths (view, 1, 1);
+
+  select_tab (window, embeds[0]);
+  select_tab (window, embeds[1]);
+
+  /* Wait for the placeholder to be shown. */
+  loop = ephy_test_utils_setup_wait_until_load_is_committed (view);
+  fake_usage = 200 * MIB;
+  g_assert_cmpuint (run_check (hibernator), ==, 1);
+  ephy_test_utils_wait_until_load_is_committed (loop);
+  wait_for_load_finished (embeds[0]);
+  g_assert (ephy_embed_get_hibernated (embeds[0]));
+
+  loop = ephy_test_utils_setup_wait_until_load_is_committed (view);
+  select_tab (window, embeds[0]);
+  ephy_test_utils_wait_until_load_is_committed (loop);
+
+  ephy_test_utils_check_ephy_web_view_address (view, "data:text/html,page-1");
+  check_back_forward_lengths (view, 1, 1);
+
+  gtk_widget_destroy (GTK_WIDGET (window));
+  g_object_unref (hibernator);
+  g_object_unref (monitor);
+}
+
+static void
+test_ephy_tab_hibernator_undo_close (void)
+{
+  EphyMemoryMonitor *monitor;
+  EphyTabHibernator *hibernator;
+  EphySession *session;
+  EphyWindow *window;
+  EphyEmbed *embeds[2];
+  EphyEmbed *embed;
+  EphyWebView *view;
+  GMainLoop *loop;
+
+  monitor = g_object_new (fake_memory_monitor_get_type (), NULL);
+  hibernator = ephy_tab_hibernator_new (monitor);
+  g_object_set (hibernator, "threshold", 100, NULL);
+
+  session = ephy_shell_get_session (ephy_shell_get_default ());
+
+  window = ephy_window_new ();
+  embeds[0] = open_tab (window, "data:text/html,page-0");
+  embeds[1] = open_tab (window, "data:text/html,active");
+
+  view = ephy_embed_get_web_view (embeds[0]);
+  load_and_wait (view, "data:text/html,page-1");
+  load_and_wait (view, "data:text/html,page-2");
+  load_and_wait (view, NULL);
+  wait_for_load_finished (embeds[0]);
+
+  select_tab (window, embeds[0]);
+  select_tab (window, embeds[1]);
+
+  loop = ephy_test_utils_setup_wait_until_load_is_committed (view);
+  fake_usage = 200 * MIB;
+  g_assert_cmpuint (run_check (hibernator), ==, 1);
+  ephy_test_utils_wait_until_load_is_committed (loop);
+  wait_for_load_finished (embeds[0]);
+  g_assert (ephy_embed_get_hibernated (embeds[0]));
+
+  /* The closed tab keeps the list of the page, not the placeholder's. */
+  gtk_widget_destroy (GTK_WIDGET (embeds[0]));
+  g_assert (ephy_session_get_can_undo_tab_closed (session));
+
+  loop = ephy_test_utils_setup_ensure_web_views_are_loaded ();
+  ephy_session_undo_close_tab (session);
+  ephy_test_utils_ensure_web_views_are_loaded (loop);
+
+  embed = ephy_embed_container_get_active_child (EPHY_EMBED_CONTAINER (window));
+  g_assert (embed != embeds[1]);
+  view = ephy_embed_get_web_view (embed);
+  ephy_test_utils_check_ephy_web_view_address (view, "data:text/html,page-1");
+  check_back_forward_lengths (view, 1, 1);
+
+  gtk_widget_destroy (GTK_WIDGET (window));
+  g_object_unref (hibernator);
+  g_object_unref (monitor);
+}
+
+#endif
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+  setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+  gtk_test_init (&argc, &argv);
+
+  ephy_debug_init ();
+  ephy_embed_prefs_init ();
+
+  if (!ephy_file_helpers_init (NULL,
+                               EPHY_FILE_HELPERS_PRIVATE_PROFILE | EPHY_FILE_HELPERS_ENSURE_EXISTS,
+                               NULL)) {
+    g_debug ("Something wrong happened with ephy_file_helpers_init()");
+    return -1;
+  }
+
+  _ephy_shell_create_instance (EPHY_EMBED_SHELL_MODE_TEST);
+  g_assert (ephy_shell_get_default ());
+
+  g_application_register (G_APPLICATION (ephy_shell_get_default ()), NULL, NULL);
+
+  g_test_add_func ("/src/ephy-tab-hibernator/disabled",
+                   test_ephy_tab_hibernator_disabled);
+
+#if WEBKIT_CHECK_VERSION (2, 7, 1)
+  /* Older WebKit can't restore the back/forward list, so tabs are never
+   * hibernated. */
+  g_test_add_func ("/src/ephy-tab-hibernator/threshold",
+                   test_ephy_tab_hibernator_threshold);
+
+  g_test_add_func ("/src/ephy-tab-hibernator/low-memory",
+                   test_ephy_tab_hibernator_low_memory);
+
+  g_test_add_func ("/src/ephy-tab-hibernator/form-submission",
+                   test_ephy_tab_hibernator_form_submission);
+
+  g_test_add_func ("/src/ephy-tab-hibernator/navigation-state",
+                   test_ephy_tab_hibernator_navigation_state);
+
+  g_test_add_func ("/src/ephy-tab-hibernator/undo-close",
+                   test_ephy_tab_hibernator_undo_close);
+#endif
+
+  ret = g_test_run ();
+
+  g_object_unref (ephy_shell_get_default ());
+  ephy_file_helpers_shutdown ();
+
+  return ret;
+}
@@ -0,0 +1,308 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ *  Copyright © 2013 Igalia S.L.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "ephy-debug.h"
+#include "ephy-thumbnail-pack.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <string.h>
+
+#define WIDTH 180
+#define HEIGHT 135
+
+static char *
+get_empty_pack_filename (void)
+{
+  char *filename = g_build_filename (g_get_tmp_dir (), "epiphany-thumbnail-pack-test.pack", NULL);
+
+  g_unlink (filename);
+
+  return filename;
+}
+
+static GdkPixbuf *
+create_thumbnail (guint32 color)
+{
+  GdkPixbuf *pixbuf;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, WIDTH, HEIGHT);
+  gdk_pixbuf_fill (pixbuf, color);
+
+  return pixbuf;
+}
+
+static void
+assert_thumbnail_color (GdkPixbuf *pixbuf,
+                        guint32 color)
+{
+  guchar *pixels;
+
+  g_assert (GDK_IS_PIXBUF (pixbuf));
+  g_assert_cmpint (gdk_pixbuf_get_width (pixbuf), ==, WIDTH);
+  g_assert_cmpint (gdk_pixbuf_get_height (pixbuf), ==, HEIGHT);
+
+  /* Check the last pixel, to make sure the whole image made it. */
+  pixels = gdk_pixbuf_get_pixels (pixbuf) +
+    (HEIGHT - 1) * gdk_pixbuf_get_rowstride (pixbuf) + (WIDTH - 1) * 4;
+  g_assert_cmpint (pixels[0], ==, color >> 24);
+  g_assert_cmpint (pixels[1], ==, (color >> 16) & 0xff);
+  g_assert_cmpint (pixels[2], ==, (color >> 8) & 0xff);
+  g_assert_cmpint (pixels[3], ==, color & 0xff);
+}
+
+static void
+test_store_and_lookup (void)
+{
+  EphyThumbnailPack *pack;
+  GdkPixbuf *thumbnail;
+  char *filename;
+  GError *error = NULL;
+
+  filename = get_empty_pack_filename ();
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+  g_assert (pack);
+
+  thumbnail = create_thumbnail (0xff0000ff);
+  g_assert (ephy_thumbnail_pack_store (pack, "http://www.gnome.org/", 100, thumbnail, &error));
+  g_assert_no_error (error);
+  g_object_unref (thumbnail);
+
+  thumbnail = create_thumbnail (0x00ff00ff);
+  g_assert (ephy_thumbnail_pack_store (pack, "http://www.igalia.com/", 200, thumbnail, &error));
+  g_assert_no_error (error);
+  g_object_unref (thumbnail);
+
+  g_assert_cmpuint (ephy_thumbnail_pack_get_n_entries (pack), ==, 2);
+
+  thumbnail = ephy_thumbnail_pack_lookup (pack, "http://www.gnome.org/", 100);
+  assert_thumbnail_color (thumbnail, 0xff0000ff);
+  g_object_unref (thumbnail);
+
+  /* Outdated or unknown thumbnails are not returned. */
+  g_assert (ephy_thumbnail_pack_lookup (pack, "http://www.gnome.org/", 101) == NULL);
+  g_assert (ephy_thumbnail_pack_lookup (pack, "http://www.example.com/", 100) == NULL);
+
+  ephy_thumbnail_pack_free (pack);
+
+  /* Everything is still there after reopening. */
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+  g_assert_cmpuint (ephy_thumbnail_pack_get_n_entries (pack), ==, 2);
+  thumbnail = ephy_thumbnail_pack_lookup (pack, "http://www.igalia.com/", 200);
+  assert_thumbnail_color (thumbnail, 0x00ff00ff);
+  g_object_unref (thumbnail);
+  ephy_thumbnail_pack_free (pack);
+
+  /* But not if the size of the thumbnails changed. */
+  pack = ephy_thumbnail_pack_new (filename, WIDTH / 2, HEIGHT / 2);
+  g_assert_cmpuint (ephy_thumbnail_pack_get_n_entries (pack), ==, 0);
+  ephy_thumbnail_pack_free (pack);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+test_replace_and_compact (void)
+{
+  EphyThumbnailPack *pack;
+  GdkPixbuf *thumbnail;
+  char *filename;
+  GError *error = NULL;
+  int i;
+
+  filename = get_empty_pack_filename ();
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+
+  thumbnail = create_thumbnail (0x0000ffff);
+  ephy_thumbnail_pack_store (pack, "http://www.gnome.org/", 1, thumbnail, NULL);
+  g_object_unref (thumbnail);
+  g_assert (!ephy_thumbnail_pack_needs_compaction (pack, 10));
+
+  for (i = 2; i < 5; i++) {
+    thumbnail = create_thumbnail (0x000000ff + (i << 8));
+    ephy_thumbnail_pack_store (pack, "http://www.gnome.org/", i, thumbnail, NULL);
+    g_object_unref (thumbnail);
+  }
+
+  /* Most of the file is replaced thumbnails now. */
+  g_assert_cmpuint (ephy_thumbnail_pack_get_n_entries (pack), ==, 1);
+  g_assert (ephy_thumbnail_pack_needs_compaction (pack, 10));
+  g_assert (ephy_thumbnail_pack_compact (pack, 10, &error));
+  g_assert_no_error (error);
+  g_assert (!ephy_thumbnail_pack_needs_compaction (pack, 10));
+
+  thumbnail = ephy_thumbnail_pack_lookup (pack, "http://www.gnome.org/", 4);
+  assert_thumbnail_color (thumbnail, 0x000004ff);
+  g_object_unref (thumbnail);
+
+  /* Appending after a compaction still works. */
+  thumbnail = create_thumbnail (0x123456ff);
+  g_assert (ephy_thumbnail_pack_store (pack, "http://www.igalia.com/", 1, thumbnail, NULL));
+  g_object_unref (thumbnail);
+  ephy_thumbnail_pack_free (pack);
+
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+  g_assert_cmpuint (ephy_thumbnail_pack_get_n_entries (pack), ==, 2);
+  thumbnail = ephy_thumbnail_pack_lookup (pack, "http://www.igalia.com/", 1);
+  assert_thumbnail_color (thumbnail, 0x123456ff);
+  g_object_unref (thumbnail);
+  ephy_thumbnail_pack_free (pack);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+test_evict_by_frecency (void)
+{
+  EphyThumbnailPack *pack;
+  GdkPixbuf *thumbnail;
+  char *filename;
+  int i;
+
+  filename = get_empty_pack_filename ();
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+
+  thumbnail = create_thumbnail (0xffffffff);
+  ephy_thumbnail_pack_store (pack, "http://www.gnome.org/", 1, thumbnail, NULL);
+  ephy_thumbnail_pack_store (pack, "http://www.igalia.com/", 1, thumbnail, NULL);
+  ephy_thumbnail_pack_store (pack, "http://www.example.com/", 1, thumbnail, NULL);
+  g_object_unref (thumbnail);
+
+  for (i = 0; i < 3; i++) {
+    thumbnail = ephy_thumbnail_pack_lookup (pack, "http://www.igalia.com/", 1);
+    g_object_unref (thumbnail);
+  }
+
+  g_assert (ephy_thumbnail_pack_needs_compaction (pack, 1));
+  g_assert (ephy_thumbnail_pack_compact (pack, 1, NULL));
+  g_assert_cmpuint (ephy_thumbnail_pack_get_n_entries (pack), ==, 1);
+
+  thumbnail = ephy_thumbnail_pack_lookup (pack, "http://www.igalia.com/", 1);
+  g_assert (thumbnail);
+  g_object_unref (thumbnail);
+  g_assert (ephy_thumbnail_pack_lookup (pack, "http://www.gnome.org/", 1) == NULL);
+
+  ephy_thumbnail_pack_free (pack);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+test_frecency_persists (void)
+{
+  EphyThumbnailPack *pack;
+  GdkPixbuf *thumbnail;
+  char *filename;
+  int i;
+
+  filename = get_empty_pack_filename ();
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+
+  thumbnail = create_thumbnail (0xffffffff);
+  ephy_thumbnail_pack_store (pack, "http://www.gnome.org/", 1, thumbnail, NULL);
+  ephy_thumbnail_pack_store (pack, "http://www.igalia.com/", 1, thumbnail, NULL);
+  g_object_unref (thumbnail);
+
+  for (i = 0; i < 3; i++) {
+    thumbnail = ephy_thumbnail_pack_lookup (pack, "http://www.igalia.com/", 1);
+    g_object_unref (thumbnail);
+  }
+  ephy_thumbnail_pack_free (pack);
+
+  /* The lookups still count after reopening. */
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+  g_assert (ephy_thumbnail_pack_compact (pack, 1, NULL));
+  g_assert_cmpuint (ephy_thumbnail_pack_get_n_entries (pack), ==, 1);
+  g_assert (ephy_thumbnail_pack_lookup (pack, "http://www.gnome.org/", 1) == NULL);
+  ephy_thumbnail_pack_free (pack);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+test_torn_record (void)
+{
+  EphyThumbnailPack *pack;
+  GdkPixbuf *thumbnail;
+  char *filename;
+  char *contents;
+  gsize length;
+
+  filename = get_empty_pack_filename ();
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+  thumbnail = create_thumbnail (0xabcdefff);
+  ephy_thumbnail_pack_store (pack, "http://www.gnome.org/", 1, thumbnail, NULL);
+  ephy_thumbnail_pack_store (pack, "http://www.igalia.com/", 1, thumbnail, NULL);
+  g_object_unref (thumbnail);
+  ephy_thumbnail_pack_free (pack);
+
+  /* Simulate a crash in the middle of the second append. */
+  g_assert (g_file_get_contents (filename, &contents, &length, NULL));
+  g_assert (g_file_set_contents (filename, contents, length - 1000, NULL));
+  g_free (contents);
+
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+  g_assert_cmpuint (ephy_thumbnail_pack_get_n_entries (pack), ==, 1);
+  thumbnail = ephy_thumbnail_pack_lookup (pack, "http://www.gnome.org/", 1);
+  assert_thumbnail_color (thumbnail, 0xabcdefff);
+  g_object_unref (thumbnail);
+
+  /* The torn record must not get in the way of new ones. */
+  thumbnail = create_thumbnail (0x010203ff);
+  ephy_thumbnail_pack_store (pack, "http://www.igalia.com/", 2, thumbnail, NULL);
+  g_object_unref (thumbnail);
+  ephy_thumbnail_pack_free (pack);
+
+  pack = ephy_thumbnail_pack_new (filename, WIDTH, HEIGHT);
+  g_assert_cmpuint (ephy_thumbnail_pack_get_n_entries (pack), ==, 2);
+  thumbnail = ephy_thumbnail_pack_lookup (pack, "http://www.igalia.com/", 2);
+  assert_thumbnail_color (thumbnail, 0x010203ff);
+  g_object_unref (thumbnail);
+  ephy_thumbnail_pack_free (pack);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gtk_test_init (&argc, &argv);
+  ephy_debug_init ();
+
+  g_test_add_func ("/lib/ephy-thumbnail-pack/store_and_lookup",
+                   test_store_and_lookup);
+  g_test_add_func ("/lib/ephy-thumbnail-pack/replace_and_compact",
+                   test_replace_and_compact);
+  g_test_add_func ("/lib/ephy-thumbnail-pack/evict_by_frecency",
+                   test_evict_by_frecency);
+  g_test_add_func ("/lib/ephy-thumbnail-pack/frecency_persists",
+                   test_frecency_persists);
+  g_test_add_func ("/lib/ephy-thumbnail-pack/torn_record",
+                   test_torn_record);
+
+  return g_test_run ();
+}
@@ -0,0 +1,153 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ * Copyright © 2013 Igalia S.L.
+ *
+ * Epiphany is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Epiphany is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Epiphany; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "ephy-trace.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <string.h>
+
+static guint
+count_occurrences (const char *haystack,
+                   const char *needle)
+{
+  guint count = 0;
+
+  while ((haystack = strstr (haystack, needle)) != NULL) {
+    count++;
+    haystack += strlen (needle);
+  }
+
+  return count;
+}
+
+static gpointer
+trace_in_thread (gpointer data)
+{
+  ephy_trace_set_thread_name ("worker");
+  ephy_trace_begin ("worker span");
+  ephy_trace_counter ("worker counter", 42);
+  ephy_trace_end ("worker span");
+
+  return NULL;
+}
+
+static void
+test_ephy_trace_threads (void)
+{
+  GThread *thread;
+  char *json;
+
+  ephy_trace_begin ("main span");
+  thread = g_thread_new ("worker", trace_in_thread, NULL);
+  g_thread_join (thread);
+  ephy_trace_end ("main span");
+
+  json = ephy_trace_to_json ();
+
+  g_assert (g_str_has_prefix (json, "{"));
+  g_assert_cmpuint (count_occurrences (json, "\"name\":\"main span\""), ==, 2);
+  g_assert_cmpuint (count_occurrences (json, "\"name\":\"worker span\""), ==, 2);
+  g_assert (strstr (json, "\"args\":{\"value\":42}") != NULL);
+  g_assert (strstr (json, "\"args\":{\"name\":\"worker\"}") != NULL);
+
+  g_free (json);
+}
+
+static gpointer
+fill_buffer_in_thread (gpointer data)
+{
+  int i;
+
+  for (i = 0; i < 100000; i++) {
+    ephy_trace_begin ("wrapped span");
+    ephy_trace_end ("wrapped span");
+  }
+
+  return NULL;
+}
+
+static void
+test_ephy_trace_wrap (void)
+{
+  GThread *thread;
+  char *json;
+  guint count;
+
+  thread = g_thread_new ("filler", fill_buffer_in_thread, NULL);
+  g_thread_join (thread);
+
+  /* Only the newest events of the thread are kept. */
+  json = ephy_trace_to_json ();
+  count = count_occurrences (json, "\"name\":\"wrapped span\"");
+  g_assert_cmpuint (count, >, 0);
+  g_assert_cmpuint (count, <, 100000);
+
+  g_free (json);
+}
+
+static gpointer
+trace_span_in_thread (gpointer data)
+{
+  ephy_trace_begin ((const char *)data);
+  ephy_trace_end ((const char *)data);
+
+  return NULL;
+}
+
+static void
+test_ephy_trace_recycle (void)
+{
+  GThread *thread;
+  char *json;
+
+  thread = g_thread_new ("first", trace_span_in_thread, "first thread span");
+  g_thread_join (thread);
+
+  /* Takes over the buffer of the first thread, which has exited. */
+  thread = g_thread_new ("second", trace_span_in_thread, "second thread span");
+  g_thread_join (thread);
+
+  json = ephy_trace_to_json ();
+  g_assert_cmpuint (count_occurrences (json, "\"name\":\"first thread span\""), ==, 0);
+  g_assert_cmpuint (count_occurrences (json, "\"name\":\"second thread span\""), ==, 2);
+
+  g_free (json);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gboolean ret;
+
+  gtk_test_init (&argc, &argv);
+
+  g_test_add_func ("/lib/ephy-trace/threads",
+                   test_ephy_trace_threads);
+  g_test_add_func ("/lib/ephy-trace/wrap",
+                   test_ephy_trace_wrap);
+  g_test_add_func ("/lib/ephy-trace/recycle",
+                   test_ephy_trace_recycle);
+
+  ret = g_test_run ();
+
+  return ret;
+}
@@ -28,6 +28,7 @@
 #include "ephy-embed-private.h"
 #include "ephy-file-helpers.h"
 #include "ephy-shell.h"
+#include "ephy-web-app-registry.h"
 #include "ephy-web-app-utils.h"
 
 #include <glib.h>
@@ -120,6 +121,132 @@ test_web_app_lifetime (void)
   }
 }
 
+#define N_MANY_APPS 300
+
+static void
+count_changes_cb (EphyWebAppRegistry *registry,
+                  guint *n_changes)
+{
+  (*n_changes)++;
+}
+
+static void
+quit_on_change_cb (EphyWebAppRegistry *registry,
+                   GMainLoop *loop)
+{
+  g_main_loop_quit (loop);
+}
+
+static gboolean
+timeout_cb (gpointer data)
+{
+  g_assert_not_reached ();
+
+  return FALSE;
+}
+
+static void
+test_web_app_registry (void)
+{
+  EphyWebAppRegistry *registry, *other;
+  EphyWebApplication *app;
+  GMainLoop *loop;
+  GList *apps;
+  GFile *profile;
+  char *name, *url, *profile_dir;
+  guint n_changes = 0, timeout_id;
+  gulong handler;
+  int i;
+
+  registry = ephy_web_app_registry_get_default ();
+  handler = g_signal_connect (registry, "changed", G_CALLBACK (count_changes_cb), &n_changes);
+
+  for (i = 0; i < N_MANY_APPS; i++) {
+    char *desktop_file;
+
+    name = g_strdup_printf ("Web App %03d", i);
+    url = g_strdup_printf ("http://www.example%d.com/", i);
+    desktop_file = ephy_web_application_create (url, name, NULL);
+    g_assert (desktop_file != NULL);
+    g_free (desktop_file);
+    g_free (url);
+    g_free (name);
+  }
+
+  g_signal_handler_disconnect (registry, handler);
+  g_assert_cmpuint (n_changes, ==, N_MANY_APPS);
+  g_assert_cmpuint (ephy_web_app_registry_get_n_applications (registry), ==, N_MANY_APPS);
+
+  /* Sorted by name. */
+  apps = ephy_web_application_get_application_list ();
+  g_assert_cmpuint (g_list_length (apps), ==, N_MANY_APPS);
+  g_assert_cmpstr (((EphyWebApplication *)apps->data)->name, ==, "Web App 000");
+  g_assert_cmpstr (((EphyWebApplication *)g_list_last (apps)->data)->name, ==, "Web App 299");
+  ephy_web_application_free_application_list (apps);
+
+  g_assert (ephy_web_application_exists ("Web App 123"));
+  g_assert (!ephy_web_application_exists ("Web App 300"));
+
+  app = ephy_web_app_registry_lookup_by_name (registry, "Web App 042");
+  g_assert (app != NULL);
+  g_assert_cmpstr (app->url, ==, "http://www.example42.com/");
+  ephy_web_application_free (app);
+
+  app = ephy_web_app_registry_lookup_by_origin (registry, "http://www.example42.com/some/page?q=1");
+  g_assert (app != NULL);
+  g_assert_cmpstr (app->name, ==, "Web App 042");
+  ephy_web_application_free (app);
+
+  g_assert (ephy_web_app_registry_lookup_by_origin (registry, "https://www.example42.com/") == NULL);
+
+  /* A new registry reads the same apps from the index. */
+  other = ephy_web_app_registry_new (ephy_dot_dir ());
+  g_assert_cmpuint (ephy_web_app_registry_get_n_applications (other), ==, N_MANY_APPS);
+  app = ephy_web_app_registry_lookup_by_name (other, "Web App 299");
+  g_assert (app != NULL);
+  g_assert_cmpstr (app->url, ==, "http://www.example299.com/");
+  ephy_web_application_free (app);
+  g_object_unref (other);
+
+  /* Apps removed behind its back, by another instance, are noticed. */
+  loop = g_main_loop_new (NULL, FALSE);
+  handler = g_signal_connect (registry, "changed", G_CALLBACK (quit_on_change_cb), loop);
+  timeout_id = g_timeout_add_seconds (10, timeout_cb, NULL);
+
+  profile_dir = ephy_web_application_get_profile_directory ("Web App 007");
+  profile = g_file_new_for_path (profile_dir);
+  g_assert (ephy_file_delete_dir_recursively (profile, NULL));
+  g_object_unref (profile);
+  g_free (profile_dir);
+
+  g_main_loop_run (loop);
+  g_source_remove (timeout_id);
+  g_signal_handler_disconnect (registry, handler);
+  g_main_loop_unref (loop);
+
+  g_assert (!ephy_web_application_exists ("Web App 007"));
+  g_assert_cmpuint (ephy_web_app_registry_get_n_applications (registry), ==, N_MANY_APPS - 1);
+
+  for (i = 0; i < N_MANY_APPS; i++) {
+    if (i == 7)
+      continue;
+
+    name = g_strdup_printf ("Web App %03d", i);
+    g_assert (ephy_web_application_delete (name));
+    g_free (name);
+  }
+
+  g_assert_cmpuint (ephy_web_app_registry_get_n_applications (registry), ==, 0);
+
+  /* A profile without a desktop file is not listed, but still taken. */
+  profile_dir = ephy_web_application_get_profile_directory ("Web App 500");
+  g_assert (g_mkdir_with_parents (profile_dir, 0700) == 0);
+  g_assert (ephy_web_app_registry_lookup_by_name (registry, "Web App 500") == NULL);
+  g_assert (ephy_web_application_exists ("Web App 500"));
+  g_assert (g_rmdir (profile_dir) == 0);
+  g_free (profile_dir);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -143,6 +270,8 @@ main (int argc, char *argv[])
 
   g_test_add_func ("/embed/ephy-web-app-utils/lifetime",
                    test_web_app_lifetime);
+  g_test_add_func ("/embed/ephy-web-app-utils/registry",
+                   test_web_app_registry);
 
   ret = g_test_run ();
 
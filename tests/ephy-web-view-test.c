@@ -39,6 +39,10 @@
 #include <string.h>
 
 #define HTML_STRING "testing-ephy-web-view"
+#define FORM_HTML_STRING "<html><body><form>" \
+                         "<input id='first' type='text'>" \
+                         "<input id='second' type='text'>" \
+                         "</form></body></html>"
 #define SERVER_PORT 12321
 
 static void
@@ -57,9 +61,12 @@ server_callback (SoupServer *server,
   } else
     soup_message_set_status (msg, SOUP_STATUS_OK);
 
-
-  soup_message_body_append (msg->response_body, SOUP_MEMORY_STATIC,
-                            HTML_STRING, strlen (HTML_STRING));
+  if (g_str_equal (path, "/form"))
+    soup_message_body_append (msg->response_body, SOUP_MEMORY_STATIC,
+                              FORM_HTML_STRING, strlen (FORM_HTML_STRING));
+  else
+    soup_message_body_append (msg->response_body, SOUP_MEMORY_STATIC,
+                              HTML_STRING, strlen (HTML_STRING));
 
   soup_message_body_complete (msg->response_body);
 }
@@ -485,6 +492,154 @@ test_ephy_web_view_error_pages_not_stored_in_history (void)
     g_object_unref (g_object_ref_sink (view));
 }
 
+#ifdef HAVE_WEBKIT2
+static gboolean
+wait_for_web_extension (void)
+{
+  EphyEmbedShell *embed_shell = ephy_embed_shell_get_default ();
+  gint64 timeout;
+
+  timeout = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+  while (!ephy_embed_shell_get_web_extension_proxy (embed_shell) &&
+         g_get_monotonic_time () < timeout) {
+    if (!g_main_context_iteration (NULL, FALSE))
+      g_usleep (10000);
+  }
+
+  return ephy_embed_shell_get_web_extension_proxy (embed_shell) != NULL;
+}
+
+static void
+run_javascript_cb (WebKitWebView *view,
+                   GAsyncResult *result,
+                   GMainLoop *loop)
+{
+  WebKitJavascriptResult *js_result;
+
+  js_result = webkit_web_view_run_javascript_finish (view, result, NULL);
+  g_assert (js_result);
+  webkit_javascript_result_unref (js_result);
+
+  g_main_loop_quit (loop);
+}
+
+/* Types text in place of the value of an input, as the user would. */
+static void
+type_in_input (EphyWebView *view,
+               const char *id,
+               const char *text)
+{
+  GMainLoop *loop;
+  char *script;
+
+  script = g_strdup_printf ("var input = document.getElementById ('%s');"
+                            "input.focus ();"
+                            "input.select ();"
+                            "document.execCommand ('%s', false, '%s');",
+                            id, *text ? "insertText" : "delete", text);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  webkit_web_view_run_javascript (WEBKIT_WEB_VIEW (view), script, NULL,
+                                  (GAsyncReadyCallback)run_javascript_cb, loop);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+  g_free (script);
+}
+
+typedef struct {
+  GMainLoop *loop;
+  EphyWebView *view;
+} FindModifiedFormsClosure;
+
+static void
+find_modified_forms_cb (GObject *source,
+                        GAsyncResult *result,
+                        FindModifiedFormsClosure *closure)
+{
+  closure->view = ephy_web_view_find_modified_forms_finish (result, NULL);
+
+  g_main_loop_quit (closure->loop);
+}
+
+static EphyWebView *
+find_modified_forms (GList *views)
+{
+  FindModifiedFormsClosure closure;
+
+  closure.loop = g_main_loop_new (NULL, FALSE);
+  closure.view = NULL;
+  ephy_web_view_find_modified_forms (views, NULL,
+                                     (GAsyncReadyCallback)find_modified_forms_cb,
+                                     &closure);
+  g_main_loop_run (closure.loop);
+  g_main_loop_unref (closure.loop);
+
+  return closure.view;
+}
+
+static EphyWebView *
+load_form (void)
+{
+  GMainLoop *loop;
+  EphyWebView *view;
+  char *url;
+
+  view = EPHY_WEB_VIEW (ephy_web_view_new ());
+  g_object_ref_sink (view);
+
+  url = g_strdup_printf ("http://127.0.0.1:%u/form", SERVER_PORT);
+  loop = g_main_loop_new (NULL, FALSE);
+  g_signal_connect (view, "load-changed",
+                    G_CALLBACK (quit_main_loop_when_load_finished), loop);
+  ephy_web_view_load_url (view, url);
+  g_main_loop_run (loop);
+  g_signal_handlers_disconnect_by_func (view, quit_main_loop_when_load_finished, loop);
+  g_main_loop_unref (loop);
+  g_free (url);
+
+  return view;
+}
+
+static void
+test_ephy_web_view_find_modified_forms (void)
+{
+  EphyWebView *clean, *edited, *found;
+  GList *views;
+
+  clean = load_form ();
+  edited = load_form ();
+
+  if (!wait_for_web_extension ()) {
+    g_test_message ("The web extension is not installed, skipping");
+    g_object_unref (clean);
+    g_object_unref (edited);
+    return;
+  }
+
+  views = g_list_append (NULL, clean);
+  views = g_list_append (views, edited);
+
+  g_assert (find_modified_forms (views) == NULL);
+
+  /* A single short input is not worth a confirmation */
+  type_in_input (edited, "first", "some text");
+  g_assert (find_modified_forms (views) == NULL);
+
+  type_in_input (edited, "second", "more text");
+  found = find_modified_forms (views);
+  g_assert (found == edited);
+  g_object_unref (found);
+
+  /* Emptied fields are not modified anymore */
+  type_in_input (edited, "second", "");
+  g_assert (find_modified_forms (views) == NULL);
+
+  g_list_free (views);
+  g_object_unref (clean);
+  g_object_unref (edited);
+}
+#endif
+
 int
 main (int argc, char *argv[])
 {
@@ -524,6 +679,11 @@ main (int argc, char *argv[])
   g_test_add_func ("/embed/ephy-web-view/error-pages-not-stored-in-history",
                    test_ephy_web_view_error_pages_not_stored_in_history);
 
+#ifdef HAVE_WEBKIT2
+  g_test_add_func ("/embed/ephy-web-view/find-modified-forms",
+                   test_ephy_web_view_find_modified_forms);
+#endif
+
   ret = g_test_run ();
 
   g_object_unref (server);